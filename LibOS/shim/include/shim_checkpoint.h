@@ -330,6 +330,11 @@ struct checkpoint_hdr {
 
     size_t palhdl_offset;
     size_t palhdl_entries_cnt;
+
+    /* Memory of large processes is sent over `mem_streams_cnt` streams in parallel; all but the
+     * first one (the process stream itself) are connected by the child to `mem_streams_uri`. */
+    size_t mem_streams_cnt;
+    char mem_streams_uri[PIPE_URI_SIZE];
 };
 
 typedef int (*migrate_func_t)(struct shim_cp_store*, struct shim_process*, struct shim_thread*,
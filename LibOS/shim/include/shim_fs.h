@@ -27,8 +27,9 @@ struct shim_handle;
 #define FS_POLL_SZ 0x08
 
 struct shim_fs_ops {
-    /* mount: mount an uri to the certain location */
-    int (*mount)(const char* uri, void** mount_data);
+    /* mount: mount an uri to the certain location; `options` is the manifest table describing the
+     * mount (e.g. `fs.mount.<name>`), or NULL for mounts not specified in the manifest */
+    int (*mount)(const char* uri, const struct manifest_node* options, void** mount_data);
     int (*unmount)(void* mount_data);
 
     /* close: clean up the file state inside the handle */
@@ -40,6 +41,22 @@ struct shim_fs_ops {
     /* write: the content from the file opened as handle */
     ssize_t (*write)(struct shim_handle* hdl, const void* buf, size_t count);
 
+    /* readv/writev: like read/write, but with several buffers transferred in one operation
+     * (optional, otherwise readv/writev call read/write once per buffer) */
+    ssize_t (*readv)(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt);
+    ssize_t (*writev)(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt);
+
+    /* pread/pwrite: like read/write, but at position `pos`, without using or changing the file
+     * position of the handle (optional, otherwise pread64/pwrite64 temporarily seek the handle) */
+    ssize_t (*pread)(struct shim_handle* hdl, void* buf, size_t count, off_t pos);
+    ssize_t (*pwrite)(struct shim_handle* hdl, const void* buf, size_t count, off_t pos);
+
+    /* write_from: like write (or pwrite at `*pos`, if `pos` is not NULL), but the data is copied by
+     * PAL directly from stream `src` at `src_pos`, see DkStreamTransfer (optional, otherwise
+     * sendfile, splice and copy_file_range copy the data through a buffer) */
+    ssize_t (*write_from)(struct shim_handle* hdl, PAL_HANDLE src, off_t src_pos, size_t count,
+                          const off_t* pos);
+
     /* mmap: mmap handle to address */
     int (*mmap)(struct shim_handle* hdl, void** addr, size_t size, int prot, int flags,
                 uint64_t offset);
@@ -84,6 +101,15 @@ struct shim_fs_ops {
     /* POLL_SZ: return total size */
     off_t (*poll)(struct shim_handle* hdl, int poll_type);
 
+    /* poll_get/poll_put: for handles emulated inside the LibOS, which have no host stream to wait
+     * on; `poll_get` returns a PAL handle which poll and epoll wait on (for reading) instead of
+     * `pal_handle` while they are interested in `events` (PAL_WAIT_READ, PAL_WAIT_WRITE), see
+     * `struct shim_poll_notifier`. The exact events are then reported by `poll`. If the op is not
+     * provided or returns a NULL event, `pal_handle` has to be used. Every non-NULL event must be
+     * released by `poll_put` with the same `events`. (optional) */
+    int (*poll_get)(struct shim_handle* hdl, PAL_FLG events, PAL_HANDLE* out_event);
+    void (*poll_put)(struct shim_handle* hdl, PAL_FLG events);
+
     /* checkpoint/migrate the file system */
     ssize_t (*checkpoint)(void** checkpoint, void* mount_data);
     int (*migrate)(void* checkpoint, void** mount_data);
@@ -108,8 +134,9 @@ struct shim_fs_ops {
 // Catch memory corruption issues by checking for invalid state values
 #define DENTRY_INVALID_FLAGS (~0x7FFF)
 
-#define DCACHE_HASH_SIZE  1024
-#define DCACHE_HASH(hash) ((hash) & (DCACHE_HASH_SIZE - 1))
+/* Initial size (log2) of the hash table of directory children; the table doubles whenever the
+ * number of children exceeds the number of buckets. */
+#define DCACHE_HASH_INIT_BITS 3
 
 /* Limit for the number of dentry children. This is mostly to prevent overflow if (untrusted) host
  * pretends to have many files in a directory. */
@@ -119,8 +146,21 @@ struct fs_lock_info;
 
 DEFINE_LIST(shim_dentry);
 DEFINE_LISTP(shim_dentry);
+
+/* Hash table of directory children, indexed by `shim_dentry::name_hash`. */
+struct shim_dentry_hash {
+    unsigned int bits; /* log2 of the number of buckets */
+
+    /* Smaller tables replaced by this one. Lockless readers might still traverse them, so they are
+     * freed together with the directory. */
+    struct shim_dentry_hash* retired;
+
+    struct shim_dentry* buckets[];
+};
+
 struct shim_dentry {
-    int state; /* flags for managing state */
+    /* Flags for managing state. Read by lockless lookups, see `dentry_update_state`. */
+    int state;
 
     /* File name, maximum of NAME_MAX characters. By convention, the root has an empty name. Does
      * not change. */
@@ -141,6 +181,16 @@ struct shim_dentry {
     LISTP_TYPE(shim_dentry) children; /* These children and siblings link */
     LIST_TYPE(shim_dentry) siblings;
 
+    /* The same children, hashed by name for `lookup_dcache`. Allocated with the first child and
+     * modified under `g_dcache_lock`, but also traversed by `lookup_dcache_lockless`. */
+    struct shim_dentry_hash* children_hash;
+    struct shim_dentry* hash_next; /* next dentry in the same bucket of `parent->children_hash` */
+    HASHTYPE name_hash;            /* `hash_name_len(0, name)`. Does not change. */
+
+    /* Link in the list of dentries whose freeing is deferred until there are no lockless readers
+     * (see `begin_dcache_lockless_read`). */
+    struct shim_dentry* retired_next;
+
     /* Filesystem mounted under this dentry. If set, this dentry is a mountpoint: filesystem
      * operations should use `attached_mount->root` instead of this dentry. */
     struct shim_mount* attached_mount;
@@ -302,6 +352,7 @@ int init_mount(void);
  * \param type Filesystem type (currently defined in `mountable_fs` in `shim_fs.c`)
  * \param uri PAL URI to mount, or NULL if not applicable
  * \param mount_path Path to the mountpoint
+ * \param options Manifest table with filesystem-specific options, or NULL
  *
  * Creates a new `shim_mount` structure (mounted filesystem) and attaches to the dentry under
  * `mount_path`. That means (assuming the dentry is called `mount_point`):
@@ -321,7 +372,8 @@ int init_mount(void);
  *
  * TODO: On failure, this function does not clean the synthetic nodes it just created.
  */
-int mount_fs(const char* type, const char* uri, const char* mount_path);
+int mount_fs(const char* type, const char* uri, const char* mount_path,
+             const struct manifest_node* options);
 
 void get_mount(struct shim_mount* mount);
 void put_mount(struct shim_mount* mount);
@@ -431,6 +483,9 @@ int _path_lookupat(struct shim_dentry* start, const char* path, int flags,
  *
  * This is a version of `_path_lookupat` that does not require caller to hold `g_dcache_lock`, but
  * acquires and releases it by itself. See the documentation for `_path_lookupat` for details.
+ *
+ * If all components of `path` are already cached and validated, the lookup is done without taking
+ * `g_dcache_lock` at all (see `lookup_dcache_lockless`).
  */
 int path_lookupat(struct shim_dentry* start, const char* path, int flags,
                   struct shim_dentry** found);
@@ -612,6 +667,16 @@ static inline const char* dentry_get_name(struct shim_dentry* dent) {
     return qstrgetstr(&dent->name);
 }
 
+/*
+ * Clears the `clear` flags and sets the `set` flags in `dent->state`. Lockless lookups read the state
+ * without `g_dcache_lock`, so the new state is published with a single store, and they never see an
+ * intermediate one (e.g. a new directory that is already positive, but not yet a directory). Fields
+ * read together with the state, such as `type`, have to be written before.
+ */
+static inline void dentry_update_state(struct shim_dentry* dent, int clear, int set) {
+    __atomic_store_n(&dent->state, (dent->state & ~clear) | set, __ATOMIC_RELEASE);
+}
+
 ino_t dentry_ino(struct shim_dentry* dent);
 
 /*!
@@ -653,6 +718,38 @@ struct shim_dentry* get_new_dentry(struct shim_mount* mount, struct shim_dentry*
  */
 struct shim_dentry* lookup_dcache(struct shim_dentry* parent, const char* name, size_t name_len);
 
+/*!
+ * \brief Start a lockless dcache read section
+ *
+ * Between this call and `end_dcache_lockless_read`, the caller may traverse the dcache without
+ * holding `g_dcache_lock` or references to the traversed dentries: dentries (and hash tables of
+ * children) that become unreachable in the meantime are not freed until all readers finish. This is
+ * a simple form of RCU, in which a grace period ends whenever there are no active readers.
+ *
+ * The read section must not block, and must not drop dentry references.
+ */
+void begin_dcache_lockless_read(void);
+void end_dcache_lockless_read(void);
+
+/*!
+ * \brief Search for a child of a dentry without holding `g_dcache_lock`
+ *
+ * \param parent the dentry to search under
+ * \param name name of searched dentry
+ * \param name_len length of the name
+ *
+ * \return the dentry, or NULL if not found
+ *
+ * The caller should be in a lockless read section (see `begin_dcache_lockless_read`). The reference
+ * count of the returned dentry is not incremented, and the dentry might be concurrently removed from
+ * the dcache; if the caller wants to keep it, it has to use `REF_INC_NOT_ZERO`.
+ *
+ * This function can spuriously fail to find a dentry that is being concurrently moved to a bigger
+ * hash table, so NULL means only that the caller should retry with `lookup_dcache`.
+ */
+struct shim_dentry* lookup_dcache_lockless(struct shim_dentry* parent, const char* name,
+                                           size_t name_len);
+
 /*
  * Returns true if `anc` is an ancestor of `dent`. Both dentries need to be within the same mounted
  * filesystem.
@@ -672,10 +769,35 @@ bool dentry_is_ancestor(struct shim_dentry* anc, struct shim_dentry* dent);
 
 HASHTYPE hash_str(const char* str);
 HASHTYPE hash_name(HASHTYPE parent_hbuf, const char* name);
+HASHTYPE hash_name_len(HASHTYPE parent_hbuf, const char* name, size_t name_len);
 HASHTYPE hash_abs_path(struct shim_dentry* dent);
 
 #define READDIR_BUF_SIZE 4096
 
+/*
+ * Readiness notification for objects emulated inside the LibOS (see `poll_get` in `shim_fs_ops`).
+ *
+ * The object keeps `state` up to date (PAL_WAIT_READ/PAL_WAIT_WRITE while it is readable/writable,
+ * PAL_WAIT_ERROR after an error or hang-up). There is a separate event for each combination of
+ * events that waiters are interested in, so that e.g. a writable object does not wake up waiters
+ * for reading; an event is readable exactly while the state contains some of its events or an
+ * error. Events are created only for the first waiter, so objects which are not polled never touch
+ * the host. All functions must be called under a lock of the object.
+ */
+struct shim_poll_notifier {
+    struct {
+        AEVENTTYPE event;
+        bool set;
+        size_t waiters;
+    } events[4]; /* indexed by the waited-for events (PAL_WAIT_READ and PAL_WAIT_WRITE bits) */
+    PAL_FLG state;
+};
+
+int poll_notifier_get(struct shim_poll_notifier* notifier, PAL_FLG events, PAL_HANDLE* out_event);
+void poll_notifier_put(struct shim_poll_notifier* notifier, PAL_FLG events);
+void poll_notifier_set_state(struct shim_poll_notifier* notifier, PAL_FLG state);
+void poll_notifier_destroy(struct shim_poll_notifier* notifier);
+
 extern struct shim_fs_ops chroot_fs_ops;
 extern struct shim_d_ops chroot_d_ops;
 
@@ -695,6 +817,12 @@ extern struct shim_fs eventfd_builtin_fs;
 
 struct shim_fs* find_fs(const char* name);
 
+/* eventfd file system */
+int create_local_eventfd(struct shim_handle* hdl, uint64_t count, bool semaphore);
+/* Promotes the local eventfds in `map` to host eventfds; called with `map->lock` held when the map
+ * is checkpointed into a child process. */
+int __promote_local_eventfds(struct shim_handle_map* map);
+
 /* string-type file system */
 int str_add_dir(const char* path, mode_t mode, struct shim_dentry** dent);
 int str_add_file(const char* path, mode_t mode, struct shim_dentry** dent);
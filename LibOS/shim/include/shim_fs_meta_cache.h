@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Host metadata cache, used by the chroot filesystem.
+ *
+ * The dcache keeps positive dentries, but negative ones are dropped right after the lookup, so a
+ * program that probes many nonexistent paths (Python's `sys.path`, Java's classpath) pays a host
+ * round trip (an OCALL on SGX) for every probe. This cache remembers, per path relative to a mount,
+ * whether the path exists on the host. A directory can also be listed once: afterwards, every name
+ * missing from the listing is known not to exist, without asking the host.
+ *
+ * Entries expire after a per-mount TTL (`fs.mount.<name>.metadata_cache_ttl`). Changes made through
+ * the mount invalidate the affected entries, but changes made by other processes or directly on the
+ * host are seen only after the TTL expires, so the cache is disabled by default and should be
+ * enabled only for mounts that are not modified concurrently (e.g. `/usr`).
+ */
+
+#ifndef SHIM_FS_META_CACHE_H_
+#define SHIM_FS_META_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* TTL for entries that never expire */
+#define META_CACHE_TTL_INFINITE UINT64_MAX
+
+/* Maximum number of entries in a single cache; the whole cache is dropped when it is full. */
+#define META_CACHE_MAX_ENTRIES 16384
+
+/* Directories with more entries are not prefilled (their listings are not remembered). */
+#define META_CACHE_MAX_LISTING 2048
+
+enum meta_cache_state {
+    META_CACHE_UNKNOWN = 0,
+    META_CACHE_EXISTS,
+    META_CACHE_MISSING,
+};
+
+struct meta_cache;
+
+/*!
+ * \brief Create a metadata cache
+ *
+ * \param ttl_us          Time (in microseconds) after which entries expire, or
+ *                        META_CACHE_TTL_INFINITE.
+ * \param[out] out_cache  On success, contains the new cache.
+ */
+int meta_cache_create(uint64_t ttl_us, struct meta_cache** out_cache);
+
+void meta_cache_destroy(struct meta_cache* cache);
+
+/*!
+ * \brief Check whether a path is known to exist
+ *
+ * \param cache  The cache.
+ * \param path   Path relative to the mount (without leading '/'), not necessarily NUL-terminated.
+ * \param len    Length of `path`.
+ *
+ * Returns META_CACHE_MISSING also for paths not found in a remembered listing of their directory.
+ */
+enum meta_cache_state meta_cache_get(struct meta_cache* cache, const char* path, size_t len);
+
+/*!
+ * \brief Return the current generation of the cache
+ *
+ * Has to be called before querying the host, and passed to `meta_cache_set` and
+ * `meta_cache_set_listed` afterwards: the results are not remembered if anything was forgotten in
+ * the meantime, as they might describe the state from before a concurrent change.
+ */
+uint64_t meta_cache_gen(struct meta_cache* cache);
+
+/* Remember whether `path` exists on the host. */
+void meta_cache_set(struct meta_cache* cache, const char* path, size_t len, bool exists,
+                    uint64_t gen);
+
+/*!
+ * \brief Forget everything known about `path`
+ *
+ * Has to be called after every operation that creates, removes or renames `path`. Also forgets the
+ * listing of the parent directory.
+ */
+void meta_cache_forget(struct meta_cache* cache, const char* path, size_t len);
+
+/* Forget everything (e.g. after a directory was renamed, which changes paths of all its
+ * descendants). */
+void meta_cache_clear(struct meta_cache* cache);
+
+/*!
+ * \brief Remember that all entries of `dir` are in the cache
+ *
+ * The caller lists the directory and calls `meta_cache_set(..., exists=true, gen)` for every entry
+ * before calling this function (with the same `gen`).
+ */
+void meta_cache_set_listed(struct meta_cache* cache, const char* dir, size_t dir_len, uint64_t gen);
+
+/* Returns true if `dir` has no remembered listing (and was not found to be too big to list). */
+bool meta_cache_needs_listing(struct meta_cache* cache, const char* dir, size_t dir_len);
+
+/* Mark `dir` as too big to be listed, so that no listing is attempted until the entry expires. */
+void meta_cache_set_unlistable(struct meta_cache* cache, const char* dir, size_t dir_len);
+
+#endif /* SHIM_FS_META_CACHE_H_ */
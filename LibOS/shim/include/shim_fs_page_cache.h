@@ -0,0 +1,133 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Page cache of host files, used by the chroot filesystem.
+ *
+ * Without it, every read of a host file is a host round trip (an OCALL plus a re-verification of
+ * the file chunk on SGX), which makes programs doing many small reads (SQLite, RocksDB, Python
+ * loading modules, tailing logs) slow. The cache keeps the contents of files in pages shared by all
+ * handles of the file (the cache belongs to `struct shim_file_data` of the dentry):
+ *
+ * - Reads are served from the cache. A miss reads as many pages as the request needs in one host
+ *   read; when a handle reads sequentially, the reads also fetch pages ahead, with a window that
+ *   doubles up to PAGE_CACHE_READAHEAD_MAX pages.
+ * - In write-through mode, writes go to the host and update the cached pages. In write-back mode,
+ *   writes only fill the cache and the dirty pages are written to the host later, through a host
+ *   handle opened by the cache: when the file is flushed (`fsync`) or closed, before `fork`, at
+ *   process exit, before the file is renamed, deleted, truncated or mapped, and when too many pages
+ *   are dirty.
+ * - All caches share a memory budget (`fs.page_cache_size`); clean pages are evicted in LRU order.
+ *
+ * The cache is enabled per mount (`fs.mount.<name>.page_cache`). Changes made by other processes or
+ * directly on the host are not noticed (until the pages are evicted), so it should be used only for
+ * files that are not modified concurrently. In write-back mode, other processes see the writes only
+ * after they are written back.
+ */
+
+#ifndef SHIM_FS_PAGE_CACHE_H_
+#define SHIM_FS_PAGE_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pal.h"
+#include "shim_types.h"
+
+#define PAGE_CACHE_PAGE_SIZE 4096UL
+
+/* Maximum number of pages read from the host at once (also the maximum read-ahead window). */
+#define PAGE_CACHE_READAHEAD_MAX 32UL
+
+/* Reads of at least this size go directly to the host if the file has no dirty pages; large reads
+ * are usually not repeated and would only evict more useful pages. */
+#define PAGE_CACHE_BYPASS_SIZE (256 * 1024)
+
+/* Default value of `fs.page_cache_size`. */
+#define PAGE_CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+enum page_cache_mode {
+    PAGE_CACHE_DISABLED = 0,
+    PAGE_CACHE_WRITE_THROUGH,
+    PAGE_CACHE_WRITE_BACK,
+};
+
+struct page_cache;
+
+struct page_cache_stats {
+    uint64_t hits;            /* pages read from the cache */
+    uint64_t misses;          /* pages read from the host */
+    uint64_t readahead;       /* pages read from the host before they were requested */
+    uint64_t bypassed;        /* large reads which were not cached */
+    uint64_t evictions;
+    uint64_t writebacks;      /* dirty pages written to the host */
+    size_t pages;             /* pages in all caches */
+    size_t dirty_pages;
+    size_t budget_pages;
+};
+
+/* Reads `fs.page_cache_size`; called once at startup. */
+int init_page_cache(void);
+
+/*!
+ * \brief Create a page cache of a host file
+ *
+ * \param mode            PAGE_CACHE_WRITE_THROUGH or PAGE_CACHE_WRITE_BACK.
+ * \param uri             Host URI of the file, used to write back dirty pages.
+ * \param[out] out_cache  On success, contains the new cache.
+ */
+int page_cache_create(enum page_cache_mode mode, const char* uri, struct page_cache** out_cache);
+
+/* Writes back the dirty pages (errors are only logged) and frees the cache. */
+void page_cache_destroy(struct page_cache* cache);
+
+/* Returns false if the cache was disabled by `page_cache_disable`; the file has to be accessed
+ * directly then. */
+bool page_cache_enabled(struct page_cache* cache);
+
+/*!
+ * \brief Read from the file through the cache
+ *
+ * \param cache       The cache.
+ * \param pal_handle  Host handle of the file, used for reading missing pages.
+ * \param iov         Buffers to read into.
+ * \param iov_cnt     Number of buffers.
+ * \param pos         Position in the file.
+ * \param file_size   Current size of the file as known by LibOS; data between the end of the host
+ *                    file and this size (not written back yet) reads as zeros.
+ *
+ * Returns the number of bytes read (less than requested only at the end of the file) or a negative
+ * error code. Returns -ENOSYS for reads that should bypass the cache (see PAGE_CACHE_BYPASS_SIZE).
+ */
+ssize_t page_cache_read(struct page_cache* cache, PAL_HANDLE pal_handle, const struct iovec* iov,
+                        size_t iov_cnt, off_t pos, off_t file_size);
+
+/*!
+ * \brief Write to the file through the cache
+ *
+ * In write-through mode, writes the data to the host using `pal_handle` and updates the cached
+ * pages. In write-back mode, the data is written to the cache (or to the host, if the cache has no
+ * free pages). Parameters are the same as in `page_cache_read`.
+ *
+ * Returns the number of bytes written or a negative error code.
+ */
+ssize_t page_cache_write(struct page_cache* cache, PAL_HANDLE pal_handle, const struct iovec* iov,
+                         size_t iov_cnt, off_t pos, off_t file_size);
+
+/* Writes back all dirty pages of the file. */
+int page_cache_flush(struct page_cache* cache);
+
+/* Writes back all dirty pages of all files (before fork and at process exit). */
+int page_cache_flush_all(void);
+
+/* Drops all pages at or after position `from` (dirty pages are lost, so write them back first if
+ * needed). Used after the file was truncated, renamed or deleted, or written bypassing the cache. */
+void page_cache_invalidate(struct page_cache* cache, off_t from);
+
+/* Writes back and drops all pages and stops caching the file (e.g. when it is mapped into memory,
+ * as shared mappings are not coherent with the cache). */
+int page_cache_disable(struct page_cache* cache);
+
+void page_cache_get_stats(struct page_cache_stats* stats);
+
+#endif /* SHIM_FS_PAGE_CACHE_H_ */
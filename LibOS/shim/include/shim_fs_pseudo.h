@@ -15,7 +15,7 @@
  *
  * It can then be mounted by providing the root name ("proc" in the example):
  *
- *     ret = mount_fs("pseudo", "proc", "/proc");
+ *     ret = mount_fs("pseudo", "proc", "/proc", NULL);
  *
  * See the documentation of `pseudo_node` structure for details.
  *
@@ -170,6 +170,10 @@ extern struct shim_fs pseudo_builtin_fs;
 
 int init_procfs(void);
 int proc_meminfo_load(struct shim_dentry* dent, char** out_data, size_t* out_size);
+int proc_slabinfo_load(struct shim_dentry* dent, char** out_data, size_t* out_size);
+int proc_pal_stats_load(struct shim_dentry* dent, char** out_data, size_t* out_size);
+int proc_page_cache_load(struct shim_dentry* dent, char** out_data, size_t* out_size);
+int proc_sync_stats_load(struct shim_dentry* dent, char** out_data, size_t* out_size);
 int proc_cpuinfo_load(struct shim_dentry* dent, char** out_data, size_t* out_size);
 int proc_self_follow_link(struct shim_dentry* dent, char** out_target);
 bool proc_thread_pid_name_exists(struct shim_dentry* parent, const char* name);
@@ -56,6 +56,9 @@ enum shim_file_type {
     FILE_TTY,
 };
 
+/* page cache of a host file, see shim_fs_page_cache.h */
+struct page_cache;
+
 struct shim_file_data {
     struct shim_lock lock;
     struct atomic_int version;
@@ -67,6 +70,8 @@ struct shim_file_data {
     unsigned long mtime;
     unsigned long ctime;
     unsigned long nlink;
+    /* created at the first read or write if the mount has the `page_cache` option */
+    struct page_cache* page_cache;
 };
 
 struct shim_file_handle {
@@ -83,9 +88,24 @@ struct shim_file_handle {
 #define FILE_HANDLE_DATA(hdl)  ((hdl)->info.file.data)
 #define FILE_DENTRY_DATA(dent) ((struct shim_file_data*)(dent)->data)
 
+/* an end of a pipe or socketpair emulated inside the LibOS, see shim_local_pipe.h */
+struct shim_local_pipe_end;
+
 struct shim_pipe_handle {
     bool ready_for_ops; /* true for pipes, false for FIFOs that were mknod'ed but not open'ed */
     char name[PIPE_URI_SIZE];
+    /* not NULL if the pipe was created inside the LibOS; stays set after the pipe is promoted to a
+     * host pipe (then `pal_handle` is used) */
+    struct shim_local_pipe_end* local;
+};
+
+/* an eventfd emulated inside the LibOS, see fs/eventfd/fs.c */
+struct shim_local_eventfd;
+
+struct shim_eventfd_handle {
+    /* not NULL if the eventfd was created inside the LibOS; stays set after the eventfd is promoted
+     * to a host eventfd (then `pal_handle` is used) */
+    struct shim_local_eventfd* local;
 };
 
 #define SOCK_STREAM   1
@@ -159,6 +179,8 @@ struct shim_sock_handle {
         char uri[SOCK_URI_SIZE]; /* cached URI for recvfrom(udp_socket) case */
         char buf[];              /* peek buffer of size `size` */
     }* peek_buffer;
+
+    struct shim_local_pipe_end* local; /* socketpair created inside the LibOS, as in pipe handle */
 };
 
 struct shim_dir_handle {
@@ -191,13 +213,25 @@ struct shim_epoll_item {
     uint64_t data;
     unsigned int events;
     unsigned int revents;
+    bool ready;                      /* true if the item is on the `ready` list of the epoll */
+    /* PAL handle and events registered in the wait set of the epoll (NULL if not registered).
+     * Protected by the lock of `handle` (the item may also be unregistered under the epoll lock
+     * after being removed from the `epolls` list of `handle`). */
+    PAL_HANDLE pal_handle;
+    PAL_FLG pal_events;
+    /* `pal_handle` is the event from `poll_get` of the handle, which was called with `pal_events`
+     * (then the item is registered only for reading the event) */
+    bool poll_event;
+    bool dirty;                      /* the registration has to be updated (accessed atomically) */
     /* The two references below are not ref-counted (to prevent cycles). When a handle is dropped
      * (ref-count goes to 0) it is also removed from all epoll instances. When an epoll instance is
      * destroyed, all handles that it traced are removed from it. */
     struct shim_handle* handle;      /* reference to monitored object (socket, pipe, file, etc) */
     struct shim_handle* epoll;       /* reference to epoll object that monitors handle object */
+    struct shim_epoll_item* hash_next; /* next item in the same bucket of the epoll's FD index */
     LIST_TYPE(shim_epoll_item) list; /* list of shim_epoll_items, used by epoll object (via `fds`) */
     LIST_TYPE(shim_epoll_item) back; /* list of epolls, used by handle object (via `epolls`) */
+    LIST_TYPE(shim_epoll_item) ready_list; /* list of items with unreported events (via `ready`) */
 };
 
 struct shim_epoll_handle {
@@ -206,8 +240,25 @@ struct shim_epoll_handle {
     /* Number of items on fds list. */
     size_t fds_count;
 
+    /* Incremented whenever an item is removed (and freed). */
+    uint64_t gen;
+
     AEVENTTYPE event;
     LISTP_TYPE(shim_epoll_item) fds;
+
+    /* Items with events not reported to the user yet, in the order in which they became ready. */
+    LISTP_TYPE(shim_epoll_item) ready;
+
+    /* Index of `fds` by FD: hash table of `fd_buckets_cnt` chains (a power of two). Not
+     * checkpointed, rebuilt in the child. */
+    struct shim_epoll_item** fd_buckets;
+    size_t fd_buckets_cnt;
+
+    /* PAL wait set mirroring the items, plus the PAL handle of `event` (with `data` 0). Items are
+     * registered lazily by `epoll_wait`; `dirty` (accessed atomically) is set if any item is dirty.
+     * Not checkpointed, recreated in the child. */
+    PAL_HANDLE wait_set;
+    bool dirty;
 };
 
 struct shim_fs;
@@ -252,7 +303,7 @@ struct shim_handle {
         struct shim_sock_handle sock;    /* TYPE_SOCK */
 
         struct shim_epoll_handle epoll;  /* TYPE_EPOLL */
-        /* (no data) */                  /* TYPE_EVENTFD */
+        struct shim_eventfd_handle eventfd; /* TYPE_EVENTFD */
     } info;
 
     struct shim_dir_handle dir_info;
@@ -260,6 +311,10 @@ struct shim_handle {
     int flags; /* Linux' O_* flags */
     int acc_mode;
     struct shim_lock lock;
+
+    /* Link in the list of destroyed handles whose freeing is deferred until there are no lockless
+     * FD lookups (see `get_fd_handle`). */
+    struct shim_handle* retired_next;
 };
 
 /* allocating / manage handle */
@@ -278,6 +333,13 @@ struct shim_fd_handle {
     struct shim_handle* handle;
 };
 
+/*
+ * The FD table is read without `lock` by get_fd_handle(): `map` and `fd_size` are published with
+ * atomic stores (`map` first), `shim_fd_handle` objects are freed only together with the map and
+ * `handle` pointers inside them are updated atomically. Arrays replaced by a larger one and
+ * destroyed handles are freed only when no lookup is in progress. Writers still serialize on
+ * `lock`.
+ */
 struct shim_handle_map {
     /* the top of created file descriptors */
     FDTYPE fd_size;
@@ -160,6 +160,7 @@ long pal_to_unix_errno(long err);
 void warn_unsupported_syscall(unsigned long sysno);
 void debug_print_syscall_before(unsigned long sysno, ...);
 void debug_print_syscall_after(unsigned long sysno, ...);
+const char* get_syscall_name(unsigned long sysno);
 
 /*
  * These events have counting semaphore semantics:
@@ -296,6 +297,20 @@ static inline int64_t __ref_inc(REFTYPE* ref) {
 
 #define REF_INC(ref) __ref_inc(&(ref))
 
+/* Increments the reference count only if it is positive; used by lockless lookups that may race
+ * with the last REF_DEC() on an object whose memory stays type-stable after destruction. */
+static inline bool __ref_inc_not_zero(REFTYPE* ref) {
+    int64_t _c = __atomic_load_n(&ref->counter, __ATOMIC_SEQ_CST);
+    do {
+        if (_c <= 0)
+            return false;
+    } while (!__atomic_compare_exchange_n(&ref->counter, &_c, _c + 1, /*weak=*/false,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    return true;
+}
+
+#define REF_INC_NOT_ZERO(ref) __ref_inc_not_zero(&(ref))
+
 static inline int64_t __ref_dec(REFTYPE* ref) {
     int64_t _c;
     do {
@@ -330,6 +345,24 @@ void __system_free(void* addr, size_t size);
 #define system_malloc __system_malloc
 #define system_free   __system_free
 
+/* Returns the calling thread's cached free objects to the shared allocator. Must be called right
+ * before a thread exits, after its last malloc()/free(). */
+void destroy_thread_malloc_cache(void);
+
+struct shim_slab_stats {
+    size_t obj_size;          /* 0 for large (page-granular) objects */
+    uint64_t allocs;          /* malloc() calls served; per-thread counts are folded in batches */
+    uint64_t frees;
+    uint64_t slab_objs;       /* objects taken from the slab manager (in use or cached) */
+    uint64_t depot_magazines; /* full magazines currently in the shared depot */
+    uint64_t depot_gets;      /* magazines handed out to threads */
+    uint64_t depot_puts;      /* magazines returned by threads */
+};
+
+/* Fills at most `count` entries of `stats`, one per slab size class followed by one for large
+ * objects, and returns the number of filled entries. */
+size_t get_slab_stats(struct shim_slab_stats* stats, size_t count);
+
 extern void* migrated_memory_start;
 extern void* migrated_memory_end;
 
@@ -359,7 +392,11 @@ void set_rlimit_cur(int resource, uint64_t rlim);
 int object_wait_with_retry(PAL_HANDLE handle);
 
 void _update_epolls(struct shim_handle* handle);
+void _remove_pal_handle_from_epolls(struct shim_handle* handle);
 void delete_from_epoll_handles(struct shim_handle* handle);
+/* Rebuild the FD index, the ready list and the wait set of a restored epoll handle (after
+ * checkpoint). */
+int restore_epoll_handle(struct shim_handle* epoll_hdl);
 /*!
  * \brief Check if next `epoll_wait` with `EPOLLET` should trigger for this handle
  *
@@ -249,17 +249,40 @@ struct shim_ipc_pid_retmeta {
 int ipc_pid_getmeta(IDTYPE pid, enum pid_meta_code code, struct shim_ipc_pid_retmeta** data);
 int ipc_pid_getmeta_callback(IDTYPE src, void* data, uint64_t seq);
 
-/* SYNC_REQUEST_*, SYNC_CONFIRM_ */
+/* SYNC_REQUEST_*, SYNC_CONFIRM_*: `count` entries (for different handles), each of them a
+ * `struct shim_ipc_sync` followed by its data and padded to 8 bytes */
+struct shim_ipc_sync_batch {
+    uint64_t count;
+    unsigned char entries[];
+};
+
 struct shim_ipc_sync {
     uint64_t id;
     size_t data_size;
     int state;
+    uint32_t flags; /* SYNC_FLAG_* */
+    uint64_t uses;  /* CONFIRM_DOWNGRADE: how many times the client locked the handle */
     unsigned char data[];
 };
 
-int ipc_sync_client_send(int code, uint64_t id, int state, size_t data_size, void* data);
-int ipc_sync_server_send(IDTYPE dest, int code, uint64_t id, int state, size_t data_size,
+/* Messages with the same code for one process, sent as a single IPC message. */
+struct ipc_sync_batch {
+    int code;
+    uint64_t count;
+    size_t size;     /* of the message built so far */
+    size_t capacity; /* of the buffer of `msg` */
+    struct shim_ipc_msg* msg;
+};
+
+void ipc_sync_batch_init(struct ipc_sync_batch* batch, int code);
+int ipc_sync_batch_add(struct ipc_sync_batch* batch, uint64_t id, int state, uint32_t flags,
+                       uint64_t uses, size_t data_size, void* data);
+void ipc_sync_batch_destroy(struct ipc_sync_batch* batch);
+
+int ipc_sync_client_send(int code, uint64_t id, int state, uint64_t uses, size_t data_size,
                          void* data);
+int ipc_sync_client_send_batch(struct ipc_sync_batch* batch);
+int ipc_sync_server_send_batch(IDTYPE dest, struct ipc_sync_batch* batch);
 int ipc_sync_request_upgrade_callback(IDTYPE src, void* data, unsigned long seq);
 int ipc_sync_request_downgrade_callback(IDTYPE src, void* data, unsigned long seq);
 int ipc_sync_request_close_callback(IDTYPE src, void* data, unsigned long seq);
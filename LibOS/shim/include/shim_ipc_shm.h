@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Shared-memory transport for IPC messages.
+ *
+ * By default, IPC messages are written to the PAL pipe of the connection one by one, and the IPC
+ * worker of the receiving process reads each of them with a host call (or two) and copies its
+ * payload to a heap buffer. If `libos.ipc.shm_dir` is set, the sender of a connection instead
+ * creates a ring buffer in a host file in that directory, maps it in both processes and passes
+ * messages through it:
+ *
+ * - The sender copies the message into the ring and publishes it by advancing `head`. The pipe is
+ *   only used as a doorbell: a single byte is written to it if the receiver announced that it is
+ *   going to sleep (`receiver_waiting`), so a burst of messages costs at most one wakeup.
+ * - The IPC worker handles all messages present in the ring per wakeup. Callbacks get a pointer
+ *   into the ring (no copy); the space is released after the callback returns. Messages that do
+ *   not fit into the ring are split into parts and reassembled in a heap buffer.
+ *
+ * The ring is shared memory on the host, so it is not available on SGX (the mapping would be
+ * outside of the enclave and the messages would not be protected); there IPC keeps using the PAL
+ * pipes, which are encrypted and authenticated.
+ */
+
+#ifndef SHIM_IPC_SHM_H_
+#define SHIM_IPC_SHM_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pal.h"
+#include "shim_ipc.h"
+
+/* Default value of `libos.ipc.shm_ring_size`. */
+#define IPC_SHM_DEFAULT_RING_SIZE (256 * 1024)
+
+struct ipc_shm_ring;
+
+/* Reads `libos.ipc.shm_dir` and `libos.ipc.shm_ring_size`; called once at startup. */
+int init_ipc_shm(void);
+
+/*!
+ * \brief Set up the sending side of a new connection
+ *
+ * \param handle         Pipe of the connection (the IPC id of the process is already sent).
+ * \param[out] out_ring  On success, contains the ring to send messages through, or NULL if the
+ *                       connection uses only the pipe.
+ *
+ * Tells the receiver (`ipc_shm_accept`) which ring to map. Failing to create the ring is not an
+ * error, the connection then falls back to the pipe.
+ */
+int ipc_shm_connect(PAL_HANDLE handle, struct ipc_shm_ring** out_ring);
+
+/*!
+ * \brief Set up the receiving side of a new connection
+ *
+ * \param handle         Pipe of the connection (the IPC id of the sender is already received).
+ * \param[out] out_ring  On success, contains the ring to receive messages from, or NULL if the
+ *                       sender uses only the pipe.
+ */
+int ipc_shm_accept(PAL_HANDLE handle, struct ipc_shm_ring** out_ring);
+
+void ipc_shm_ring_destroy(struct ipc_shm_ring* ring);
+
+/*!
+ * \brief Send a message through the ring
+ *
+ * \param ring      The ring.
+ * \param doorbell  Pipe of the connection.
+ * \param msg       The message.
+ *
+ * Waits if the ring is full. The caller has to serialize calls for one ring.
+ */
+int ipc_shm_send(struct ipc_shm_ring* ring, PAL_HANDLE doorbell, struct shim_ipc_msg* msg);
+
+/*!
+ * \brief Announce that the receiver is going to wait for the doorbell
+ *
+ * Returns true if there are messages in the ring already; the receiver must not wait then.
+ */
+bool ipc_shm_arm(struct ipc_shm_ring* ring);
+
+/* Consumes the doorbell bytes available on the pipe of the connection. Returns 0 on success, 1 on
+ * EOF (the sender closed the connection) or a negative error code. */
+int ipc_shm_read_doorbell(PAL_HANDLE doorbell);
+
+/*!
+ * \brief Get the next message from the ring
+ *
+ * \param ring         The ring.
+ * \param[out] out_msg On success, contains the message. It stays valid (and its space in the ring
+ *                     reserved) until `ipc_shm_pop`.
+ *
+ * Returns 1 if there is a message, 0 if the ring is empty, or a negative error code if the ring
+ * contents are malformed.
+ */
+int ipc_shm_peek(struct ipc_shm_ring* ring, struct shim_ipc_msg** out_msg);
+
+/* Releases the message returned by the last `ipc_shm_peek`. */
+void ipc_shm_pop(struct ipc_shm_ring* ring);
+
+#endif /* SHIM_IPC_SHM_H_ */
@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Pipes and socketpairs emulated inside the LibOS ("local pipes").
+ *
+ * A host pipe costs three host pipe handles at creation (and a TLS handshake on SGX) and a host
+ * syscall for every read and write, although both ends of a pipe are usually used by the same
+ * process (self-pipes, event loops, hand-offs between threads). Instead, `pipe()` and
+ * `socketpair()` create two handles connected by in-process ring buffers, one per direction, each
+ * with the capacity of a Linux pipe. The rings are protected by a short per-pipe lock (any number
+ * of threads can share an end), and blocked readers and writers sleep on their thread events.
+ * Poll and epoll wait on per-end LibOS events (see `struct shim_poll_notifier`), which are created
+ * only when somebody polls the end.
+ *
+ * When the process forks, the pipes are promoted to host pipes (see `__promote_local_pipes`): the
+ * data buffered in the rings is moved to a new host pipe, and both ends continue to work on the
+ * host pipe from then on, in the parent and in the child.
+ */
+
+#ifndef SHIM_LOCAL_PIPE_H_
+#define SHIM_LOCAL_PIPE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pal.h"
+#include "shim_handle.h"
+
+/* Capacity of a single direction of a local pipe, same as the default capacity of a Linux pipe. */
+#define LOCAL_PIPE_CAPACITY (64 * 1024)
+
+/* Returned (negated) by the functions below if the pipe was promoted to a host pipe; the caller has
+ * to use `pal_handle` of the handle instead. Not a valid errno, never returned to the user. */
+#define ELOCALPIPEPROMOTED 1000
+
+struct shim_local_pipe_end;
+
+/* Connects `hdl0` and `hdl1` (of type TYPE_PIPE or TYPE_SOCK, without PAL handles). If `duplex` is
+ * false, `hdl0` is the read end and `hdl1` the write end of a pipe, otherwise both ends can read
+ * and write (socketpair). */
+int create_local_pipe(struct shim_handle* hdl0, struct shim_handle* hdl1, bool duplex);
+
+/* Read and write are allowed to be partial, except that writes of up to PIPE_BUF bytes are atomic
+ * (as with Linux pipes). Both return -EINTR if interrupted by a signal before any data was
+ * transferred. Reading an empty pipe whose peer cannot write anymore returns 0; writing to a pipe
+ * whose peer cannot read anymore returns -EPIPE (the caller sends SIGPIPE). */
+ssize_t local_pipe_read(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt,
+                        bool peek, bool nonblocking);
+ssize_t local_pipe_write(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt,
+                         bool nonblocking);
+/* Writes data read from host stream `src` at `src_pos`, for `write_from` of `struct shim_fs_ops`. */
+ssize_t local_pipe_write_from(struct shim_handle* hdl, PAL_HANDLE src, off_t src_pos,
+                              size_t count);
+
+/* Same semantics as `poll` of `struct shim_fs_ops`. */
+off_t local_pipe_poll(struct shim_handle* hdl, int poll_type);
+/* Implementations of `poll_get` and `poll_put` of `struct shim_fs_ops`; `poll_get` returns a NULL
+ * event if the pipe was promoted (the caller has to wait on `pal_handle` then). */
+int local_pipe_poll_get(struct shim_handle* hdl, PAL_FLG events, PAL_HANDLE* out_event);
+void local_pipe_poll_put(struct shim_handle* hdl, PAL_FLG events);
+
+int local_pipe_shutdown(struct shim_handle* hdl, bool shut_rd, bool shut_wr);
+/* Called when the handle is closed; the pipe is freed after both its ends are closed. */
+void local_pipe_close(struct shim_handle* hdl);
+
+/* Promotes all local pipes which have an end in `map` (directly or monitored by an epoll in `map`)
+ * to host pipes; called with `map->lock` held when the map is checkpointed into a child process, so
+ * that no local pipe can be created between the promotion and the checkpoint. Returns -EAGAIN if
+ * the buffered data does not fit into the host pipe. */
+int __promote_local_pipes(struct shim_handle_map* map);
+
+#endif /* SHIM_LOCAL_PIPE_H_ */
@@ -4,16 +4,38 @@
  *                    Borys Popławski <borysp@invisiblethingslab.com>
  */
 
+/*
+ * LibOS mutex.
+ *
+ * The lock is a futex-style state word: an uncontended `lock()`/`unlock()` pair is just two atomic
+ * operations and never leaves the LibOS. A contended `lock()` first spins for a bounded number of
+ * iterations (adapted per lock to how long acquiring it took recently) and only then goes to sleep
+ * on a PAL event, which is created on the first contention. `unlock()` signals the event only if
+ * some thread may be sleeping, so on Linux-SGX the host futex (and the enclave exit it requires) is
+ * used only under real contention, and locks which are never contended do not allocate any PAL or
+ * untrusted memory.
+ */
+
 #ifndef SHIM_LOCK_H_
 #define SHIM_LOCK_H_
 
 #include <stdbool.h>
 
+#include "api.h"
 #include "assert.h"
 #include "pal.h"
 #include "shim_thread.h"
 #include "shim_types.h"
 
+#if DEBUG_LOCK_STATS
+#include "cpu.h"
+#endif
+
+/* values of `shim_lock::state` */
+#define SHIM_LOCK_FREE      0
+#define SHIM_LOCK_LOCKED    1
+#define SHIM_LOCK_CONTENDED 2 /* locked, and there might be threads sleeping on the event */
+
 extern bool lock_enabled;
 
 static inline void enable_locking(void) {
@@ -21,22 +43,65 @@ static inline void enable_locking(void) {
         lock_enabled = true;
 }
 
+#if DEBUG_LOCK_STATS
+/* Statistics of all locks created at one place in the code (all times are in TSC cycles). */
+struct shim_lock_stats {
+    const char* site;
+    uint64_t acquired;
+    uint64_t contended;  /* acquisitions which had to wait */
+    uint64_t slept;      /* acquisitions which had to sleep on the event */
+    uint64_t wait_time;
+    uint64_t max_wait_time;
+    uint64_t hold_time;
+    uint64_t max_hold_time;
+};
+
+struct shim_lock_stats* get_lock_stats(const char* site);
+void record_lock_time(uint64_t* total, uint64_t* max, uint64_t time);
+
+#define LOCK_SITE __FILE__ ":" XSTRINGIFY(__LINE__)
+#else
+#define LOCK_SITE NULL
+#endif
+
+/* Prints the statistics collected with `DEBUG_LOCK_STATS`, does nothing otherwise. */
+void dump_lock_stats(void);
+
+/* Slow paths of `lock()` and `unlock()`, see `shim_lock.c`. */
+void lock_contended(struct shim_lock* l);
+void unlock_wake(struct shim_lock* l);
+
 static inline bool lock_created(struct shim_lock* l) {
-    return l->lock != NULL;
+    return l->created;
 }
 
 static inline void clear_lock(struct shim_lock* l) {
-    l->lock  = NULL;
-    l->owner = 0;
+    l->state   = SHIM_LOCK_FREE;
+    l->spins   = 0;
+    l->created = false;
+    l->owner   = 0;
+    l->event   = NULL;
+#if DEBUG_LOCK_STATS
+    l->stats = NULL;
+#endif
 }
 
-static inline bool create_lock(struct shim_lock* l) {
-    l->owner = 0;
-    return DkEventCreate(&l->lock, /*init_signaled=*/true, /*auto_clear=*/true) == 0;
+static inline bool __create_lock(struct shim_lock* l, const char* site) {
+    __UNUSED(site);
+    clear_lock(l);
+#if DEBUG_LOCK_STATS
+    l->stats = get_lock_stats(site);
+#endif
+    l->created = true;
+    return true;
 }
 
+#define create_lock(l) __create_lock(l, LOCK_SITE)
+
 static inline void destroy_lock(struct shim_lock* l) {
-    DkObjectClose(l->lock); // TODO: handle errors
+    assert(l->state == SHIM_LOCK_FREE || !lock_enabled);
+    if (l->event)
+        DkObjectClose(l->event); // TODO: handle errors
     clear_lock(l);
 }
 
@@ -45,12 +110,20 @@ static void lock(struct shim_lock* l) {
         return;
     }
 
-    assert(l->lock);
+    assert(l->created);
 
-    while (DkEventWait(l->lock, /*timeout=*/NULL) < 0)
-        /* nop */;
+    uint32_t expected = SHIM_LOCK_FREE;
+    if (!__atomic_compare_exchange_n(&l->state, &expected, SHIM_LOCK_LOCKED, /*weak=*/false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        lock_contended(l);
 
     l->owner = get_cur_tid();
+
+#if DEBUG_LOCK_STATS
+    if (l->stats)
+        __atomic_add_fetch(&l->stats->acquired, 1, __ATOMIC_RELAXED);
+    l->acquired_tsc = get_tsc();
+#endif
 }
 
 static inline void unlock(struct shim_lock* l) {
@@ -58,16 +131,24 @@ static inline void unlock(struct shim_lock* l) {
         return;
     }
 
-    assert(l->lock);
+    assert(l->created);
+
+#if DEBUG_LOCK_STATS
+    if (l->stats)
+        record_lock_time(&l->stats->hold_time, &l->stats->max_hold_time,
+                         get_tsc() - l->acquired_tsc);
+#endif
+
     l->owner = 0;
-    DkEventSet(l->lock);
+    if (__atomic_exchange_n(&l->state, SHIM_LOCK_FREE, __ATOMIC_RELEASE) == SHIM_LOCK_CONTENDED)
+        unlock_wake(l);
 }
 
 static inline bool locked(struct shim_lock* l) {
     if (!lock_enabled) {
         return true;
     }
-    if (!l->lock) {
+    if (!l->created) {
         return false;
     }
     return get_cur_tid() == l->owner;
@@ -99,17 +180,19 @@ extern struct shim_lock __master_lock;
     } while (0)
 #endif
 
-static inline bool create_lock_runtime(struct shim_lock* l) {
+static inline bool __create_lock_runtime(struct shim_lock* l, const char* site) {
     bool ret = true;
 
     if (!lock_created(l)) {
         MASTER_LOCK();
         if (!lock_created(l))
-            ret = create_lock(l);
+            ret = __create_lock(l, site);
         MASTER_UNLOCK();
     }
 
     return ret;
 }
 
+#define create_lock_runtime(l) __create_lock_runtime(l, LOCK_SITE)
+
 #endif // SHIM_LOCK_H_
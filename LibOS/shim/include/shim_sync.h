@@ -61,6 +61,21 @@
  * The sync engine is currently experimental. To enable it, set `libos.sync.enable = 1` in the
  * manifest. When it's not enabled, sync_lock() and sync_unlock() will function as regular, local
  * locks, and no remote communication will be performed.
+ *
+ * Further manifest options (all of them have effect only with `libos.sync.enable`):
+ *
+ * - `libos.sync.lease_time_us = [NUM]` (default: 0): minimum time a process keeps a handle after
+ *   getting it, even if another process needs it. A handle that is contested by several processes
+ *   then moves between them at most once per lease, instead of on every use. The process that
+ *   recently used a handle most gets leases SYNC_AFFINITY_FACTOR times longer. Read by the process
+ *   leader (which runs the server).
+ *
+ * - `libos.sync.prefetch = [true|false]` (default: true): when a process has to request a handle
+ *   from the server, it also requests (in the same message) other handles it used before and does
+ *   not hold anymore. The server grants these only if no other process holds or waits for them.
+ *
+ * Counters of the engine (e.g. how many sync_lock() calls needed a round trip to the server) can
+ * be read from `/proc/sync_stats`.
  */
 
 /*
@@ -103,12 +118,30 @@
  *    This is done by client for every handle it destroys, and should be done for all handles before
  *    process exit.
  *
+ * 4. Batching:
+ *
+ *    Messages with the same code are batched: one IPC message carries entries for several handles.
+ *    The client adds speculative upgrade requests (SYNC_FLAG_SPECULATIVE) for handles it is likely
+ *    to need to its REQUEST_UPGRADE messages, and the server sends all messages for one client
+ *    resulting from one request as a single message for each code (keeping their order).
+ *
+ * 5. Leases:
+ *
+ *    When the server grants a handle, the client gets a lease for `libos.sync.lease_time_us`. The
+ *    server does not send REQUEST_DOWNGRADE before the lease expires (it keeps a deadline, and the
+ *    IPC worker calls `sync_server_process_leases()` to send the deferred requests in time).
+ *    Clients report in CONFIRM_DOWNGRADE how many times they used a handle; the client with at
+ *    least 3/4 of the recent uses gets longer leases, so that the handle stays in the process that
+ *    uses it most.
+ *
  * Note that the request and confirmation aren't necessarily paired one-to-one. For example:
  *
  * - the client might send REQUEST_UPGRADE to SHARED state, then another one to EXCLUSIVE state,
  *   before the server replies with CONFIRM_UPGRADE to EXCLUSIVE
  * - the server might send REQUEST_DOWNGRADE to SHARED state, then another one to INVALID state,
  *   before the client replies with CONFIRM_DOWNGRADE to INVALID
+ * - a speculative REQUEST_UPGRADE gets no reply if the server does not grant it, and a regular
+ *   one gets none if the handle was already granted speculatively
  *
  * Here is an example interaction:
  *
@@ -169,6 +202,15 @@ enum {
     SYNC_STATE_NUM,
 };
 
+/* Flags of entries in sync messages. */
+enum {
+    /* REQUEST_UPGRADE: grant only if nobody else holds or waits for the handle, ignore otherwise */
+    SYNC_FLAG_SPECULATIVE = 0x1,
+};
+
+/* How much longer leases the process using a handle most gets. */
+#define SYNC_AFFINITY_FACTOR 4
+
 /* Lifecycle phase of a handle on client. */
 enum {
     /* New handle, not registered on the server yet */
@@ -222,6 +264,16 @@ struct sync_handle {
     /* Requested by server; always lower than cur_state, or NONE */
     int server_req_state;
 
+    /* Highest state the handle was locked in (by this process, or its parent before fork). If the
+     * handle is in a lower state, it is requested speculatively with other handles. */
+    int used_state;
+    /* Granted speculatively and not locked since; the data need to be passed to the user. */
+    bool prefetched;
+    /* Added to a speculative request that was not sent yet; REQUEST_CLOSE has to wait for it. */
+    bool prefetch_pending;
+    /* Number of sync_lock() calls since last downgrade, reported to the server. */
+    uint64_t uses;
+
     /* Reference count, used internally by sync client: the user of the handle just calls
      * `sync_create` / `sync_destroy`. */
     REFTYPE ref_count;
@@ -261,13 +313,36 @@ bool sync_lock(struct sync_handle* handle, int state, void* data, size_t data_si
 /* Release a handle, updating data associated with it. */
 void sync_unlock(struct sync_handle* handle, void* data, size_t data_size);
 
+/* Counters of the sync engine, see `/proc/sync_stats`. */
+struct sync_stats {
+    /* Client (this process) */
+    uint64_t locks;               /* sync_lock() calls */
+    uint64_t upgrade_requests;    /* sync_lock() calls that waited for the server */
+    uint64_t prefetch_requests;   /* handles requested speculatively */
+    uint64_t prefetch_hits;       /* sync_lock() calls served by a speculative grant */
+    uint64_t downgrades;          /* handles given up for other processes */
+
+    /* Server (process leader only) */
+    uint64_t deferred_downgrades; /* downgrades postponed until the end of a lease */
+    uint64_t extended_leases;     /* longer leases for the process using a handle most */
+};
+
+void sync_client_get_stats(struct sync_stats* stats);
+void sync_server_get_stats(struct sync_stats* stats);
+
 /*** Message handlers (called from IPC, see ipc/shim_ipc_sync.c) ***/
 
 struct shim_ipc_port;
 
 void sync_client_message_callback(int code, uint64_t id, int state, size_t data_size, void* data);
-void sync_server_message_callback(IDTYPE src, int code, uint64_t id, int state,
-                                  size_t data_size, void* data);
+void sync_server_message_callback(IDTYPE src, int code, uint64_t id, int state, uint32_t flags,
+                                  uint64_t uses, size_t data_size, void* data);
+/* Sends the messages resulting from the entries passed to `sync_server_message_callback`. */
+void sync_server_flush_messages(void);
 void sync_server_disconnect_callback(IDTYPE src);
 
+/* Sends the downgrade requests deferred until leases expire. Returns the time (in microseconds)
+ * until the next lease expires, or NO_TIMEOUT. Called by the IPC worker of the process leader. */
+PAL_NUM sync_server_process_leases(void);
+
 #endif /* SHIM_SYNC_H_ */
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Binary syscall trace (enabled by `libos.syscall_trace.file`).
+ *
+ * Every thread has a ring of fixed-size records, one per finished syscall, which is filled without
+ * any locking or formatting. A background thread periodically drains the rings of all threads into
+ * a per-process host file, which can be analyzed offline with `graphene-syscall-trace`. If a ring
+ * is full (the drain thread cannot keep up), records are dropped and the number of dropped records
+ * is written to the trace instead.
+ *
+ * Trace file layout (all integers little-endian):
+ *  - `struct syscall_trace_header`,
+ *  - a table of syscall names: for each syscall number below `syscall_names_cnt` a `uint16_t`
+ *    length followed by the name (without a terminating null byte, empty for unknown syscalls),
+ *  - a sequence of `struct syscall_trace_record`.
+ */
+
+#ifndef SHIM_SYSCALL_TRACE_H_
+#define SHIM_SYSCALL_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "pal.h"
+
+#define SYSCALL_TRACE_MAGIC   "GSCTRACE"
+#define SYSCALL_TRACE_VERSION 1
+
+struct syscall_trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t pid;
+    uint32_t syscall_names_cnt;
+    /* frequency of the timestamps; 0 if they are in microseconds (the TSC cannot be used) */
+    uint64_t tsc_hz;
+} __attribute__((packed));
+
+enum syscall_trace_record_type {
+    SYSCALL_TRACE_SYSCALL = 0,
+    SYSCALL_TRACE_DROPPED, /* `ret` holds the number of records dropped by thread `tid` */
+};
+
+struct syscall_trace_record {
+    uint16_t type;
+    uint16_t sysnr;
+    uint32_t tid;
+    uint64_t start;      /* timestamp of the syscall entry */
+    uint64_t duration;   /* in timestamp units */
+    int64_t ret;
+    uint64_t args_hash;  /* digest of the six raw syscall arguments */
+    /* PAL calls and host calls (e.g. OCALLs) made during the syscall; always 0 without
+     * `loader.enable_pal_stats` */
+    uint32_t pal_calls;
+    uint32_t host_calls;
+} __attribute__((packed));
+
+extern bool g_syscall_trace_enabled;
+
+int init_syscall_trace(void);
+/* Drains all rings and stops the drain thread; called at process exit. */
+void terminate_syscall_trace(void);
+/* Called by a thread right before it exits; its ring is freed after it is drained. */
+void syscall_trace_thread_exit(void);
+
+void do_syscall_trace_before(void);
+void do_syscall_trace_after(unsigned long sysnr, long ret, PAL_CONTEXT* context);
+
+static inline void syscall_trace_before(void) {
+    if (g_syscall_trace_enabled)
+        do_syscall_trace_before();
+}
+
+static inline void syscall_trace_after(unsigned long sysnr, long ret, PAL_CONTEXT* context) {
+    if (g_syscall_trace_enabled)
+        do_syscall_trace_after(sysnr, ret, context);
+}
+
+#endif /* SHIM_SYSCALL_TRACE_H_ */
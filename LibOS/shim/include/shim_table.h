@@ -178,6 +178,8 @@ long shim_do_ppoll(struct pollfd* fds, int nfds, struct timespec* tsp, const __s
                    size_t sigsetsize);
 long shim_do_set_robust_list(struct robust_list_head* head, size_t len);
 long shim_do_get_robust_list(pid_t pid, struct robust_list_head** head, size_t* len);
+long shim_do_splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len,
+                    unsigned int flags);
 long shim_do_epoll_pwait(int epfd, struct __kernel_epoll_event* events, int maxevents,
                          int timeout_ms, const __sigset_t* sigmask, size_t sigsetsize);
 long shim_do_accept4(int sockfd, struct sockaddr* addr, int* addrlen, int flags);
@@ -195,11 +197,18 @@ long shim_do_eventfd2(unsigned int count, int flags);
 long shim_do_eventfd(unsigned int count);
 long shim_do_getcpu(unsigned* cpu, unsigned* node, struct getcpu_cache* unused);
 long shim_do_getrandom(char* buf, size_t count, unsigned int flags);
+long shim_do_copy_file_range(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len,
+                             unsigned int flags);
 
 #define GRND_NONBLOCK 0x0001
 #define GRND_RANDOM   0x0002
 #define GRND_INSECURE 0x0004
 
+#define SPLICE_F_MOVE     0x01
+#define SPLICE_F_NONBLOCK 0x02
+#define SPLICE_F_MORE     0x04
+#define SPLICE_F_GIFT     0x08
+
 #ifndef MADV_FREE
 #define MADV_FREE 8
 #endif
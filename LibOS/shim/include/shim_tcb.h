@@ -33,6 +33,10 @@ struct shim_tcb {
      * an SGX enclave) we lack a way to restore all (or at least some) registers atomically. */
     void*               syscall_scratch_pc;
     void*               vma_cache;
+    /* Per-thread magazines of the LibOS-internal allocator, see shim_malloc.c. */
+    void*               malloc_cache;
+    /* Ring of the binary syscall trace, see shim_syscall_trace.c. */
+    void*               syscall_trace;
     char                log_prefix[32];
 };
 
@@ -344,9 +344,22 @@ typedef uint64_t HASHTYPE;
 
 typedef struct atomic_int REFTYPE;
 
+/* Set to 1 to collect per-lock contention statistics (see `dump_lock_stats`). */
+#define DEBUG_LOCK_STATS 0
+
+struct shim_lock_stats;
+
+/* Mutex built on an atomic state word, see `shim_lock.h`. */
 struct shim_lock {
-    PAL_HANDLE lock;
+    uint32_t state;
+    int32_t spins;    /* running estimate of the spin count needed to acquire the lock */
+    bool created;
     IDTYPE owner;
+    PAL_HANDLE event; /* created on the first contention, used only to sleep */
+#if DEBUG_LOCK_STATS
+    struct shim_lock_stats* stats;
+    uint64_t acquired_tsc;
+#endif
 };
 
 typedef struct shim_aevent {
@@ -6,11 +6,11 @@
 
 #include "api.h"
 #include "list.h"
+#include "manifest.h"
 #include "pal.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_types.h"
-#include "toml.h"
 
 struct shim_handle;
 
@@ -158,6 +158,10 @@ int vmid_to_uri(IDTYPE vmid, char* uri, size_t uri_len);
 /* create unique files/pipes */
 int create_pipe(char* name, char* uri, size_t size, PAL_HANDLE* hdl, struct shim_qstr* qstr,
                 bool use_vmid_for_name);
+/* Creates a connected pair of host pipe ends: `out_srv` is the accepted one, `out_cli` is opened
+ * with `pal_options`. `name` and `uri` are filled as in `create_pipe`. */
+int create_host_pipes(char* name, char* uri, size_t uri_size, int pal_options,
+                      PAL_HANDLE* out_srv, PAL_HANDLE* out_cli);
 
 /* Asynchronous event support */
 int init_async_worker(void);
@@ -165,11 +169,24 @@ int64_t install_async_event(PAL_HANDLE object, unsigned long time,
                             void (*callback)(IDTYPE caller, void* arg), void* arg);
 struct shim_thread* terminate_async_worker(void);
 
-extern const toml_table_t* g_manifest_root;
+extern const struct manifest* g_manifest_root;
 
 int read_exact(PAL_HANDLE handle, void* buf, size_t size);
 int write_exact(PAL_HANDLE handle, void* buf, size_t size);
 
+/* Read/write `iov` from/to `handle` at `offset` as a single PAL request (see DkStreamsBatchIo()),
+ * which PALs serve with one host call where possible. Returns the number of bytes transferred or
+ * a negative PAL error code. */
+int64_t pal_stream_iov_io(PAL_HANDLE handle, enum PAL_IO_OP op, uint64_t offset,
+                          const struct iovec* iov, size_t iov_cnt);
+
+static inline size_t iov_total_len(const struct iovec* iov, size_t iov_cnt) {
+    size_t len = 0;
+    for (size_t i = 0; i < iov_cnt; i++)
+        len += iov[i].iov_len;
+    return len;
+}
+
 static inline uint64_t timespec_to_us(const struct __kernel_timespec* ts) {
     return ts->tv_sec * TIME_US_IN_S + ts->tv_nsec / TIME_NS_IN_US;
 }
@@ -8,7 +8,80 @@
 #ifndef _SHIM_VDSO_H_
 #define _SHIM_VDSO_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu.h"
+
 extern const uint8_t vdso_so[];
 extern const size_t vdso_so_size;
 
+/* Size of the time page, which is mapped right before the vDSO image (see `vdso.lds`). */
+#define VDSO_TIME_PAGE_SIZE 4096
+
+/*
+ * Parameters for computing the time in the vDSO without entering LibOS, published by LibOS from
+ * `DkSystemTimeCalibration`. The page is read-only for the application. LibOS updates it like a
+ * seqlock: `seq` is odd while an update is in progress, and readers retry if it changed. A zero
+ * `tsc_hz` means that the vDSO has to fall back to the syscall. The published time never goes
+ * backwards: a new calibration that is behind the old one is slewed (see `update_vdso_time_page`).
+ */
+struct vdso_time_page {
+    uint32_t seq;
+    uint64_t tsc_hz;
+    uint64_t base_tsc;
+    uint64_t base_usec;
+    uint64_t max_delta_tsc;
+};
+
+/*
+ * Computes the current time (in microseconds) from the parameters published in `page`. Returns
+ * false if the parameters are not available or too old. Used both by the vDSO and by LibOS (to keep
+ * the syscalls consistent with the vDSO).
+ */
+static inline bool read_vdso_time_page(const struct vdso_time_page* page, uint64_t* out_usec) {
+    while (true) {
+        uint32_t seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            /* LibOS is updating the page */
+            CPU_RELAX();
+            continue;
+        }
+
+        uint64_t tsc_hz        = __atomic_load_n(&page->tsc_hz, __ATOMIC_RELAXED);
+        uint64_t base_tsc      = __atomic_load_n(&page->base_tsc, __ATOMIC_RELAXED);
+        uint64_t base_usec     = __atomic_load_n(&page->base_usec, __ATOMIC_RELAXED);
+        uint64_t max_delta_tsc = __atomic_load_n(&page->max_delta_tsc, __ATOMIC_RELAXED);
+
+        /* orders the loads above before the re-check of `seq` and keeps RDTSC from being executed
+         * early */
+        RMB();
+        uint64_t tsc = get_tsc();
+
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+
+        if (!tsc_hz)
+            return false;
+
+        uint64_t delta_tsc = tsc - base_tsc;
+        if (delta_tsc >= max_delta_tsc)
+            return false;
+
+        *out_usec = base_usec + delta_tsc * 1000000 / tsc_hz;
+        return true;
+    }
+}
+
+/* Starts publishing the time in `page`. */
+void init_vdso_time_page(struct vdso_time_page* page);
+
+/*
+ * Refreshes the published parameters if PAL recalibrated its clock in the meantime. `*usec` is the
+ * time just returned by `DkSystemTimeQuery`; it is raised to the time the vDSO currently computes,
+ * so that a syscall never returns an earlier time than the vDSO did.
+ */
+void update_vdso_time_page(uint64_t* usec);
+
 #endif /* _SHIM_VDSO_H_ */
@@ -290,7 +290,7 @@ shim_fp shim_table[LIBOS_SYSCALL_BOUND] = {
     [__NR_unshare]                = (shim_fp)0, // shim_do_unshare
     [__NR_set_robust_list]        = (shim_fp)shim_do_set_robust_list,
     [__NR_get_robust_list]        = (shim_fp)shim_do_get_robust_list,
-    [__NR_splice]                 = (shim_fp)0, // shim_do_splice
+    [__NR_splice]                 = (shim_fp)shim_do_splice,
     [__NR_tee]                    = (shim_fp)0, // shim_do_tee
     [__NR_sync_file_range]        = (shim_fp)0, // shim_do_sync_file_range
     [__NR_vmsplice]               = (shim_fp)0, // shim_do_vmsplice
@@ -341,7 +341,7 @@ shim_fp shim_table[LIBOS_SYSCALL_BOUND] = {
     [__NR_userfaultfd]            = (shim_fp)0, // shim_do_userfaultfd
     [__NR_membarrier]             = (shim_fp)0, // shim_do_membarrier
     [__NR_mlock2]                 = (shim_fp)0, // shim_do_mlock2
-    [__NR_copy_file_range]        = (shim_fp)0, // shim_do_copy_file_range
+    [__NR_copy_file_range]        = (shim_fp)shim_do_copy_file_range,
     [__NR_preadv2]                = (shim_fp)0, // shim_do_preadv2
     [__NR_pwritev2]               = (shim_fp)0, // shim_do_pwritev2
     [__NR_pkey_mprotect]          = (shim_fp)0, // shim_do_pkey_mprotect
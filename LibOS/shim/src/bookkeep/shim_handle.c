@@ -12,8 +12,10 @@
 #include "shim_fs_lock.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
+#include "shim_local_pipe.h"
 #include "shim_lock.h"
 #include "shim_thread.h"
+#include "spinlock.h"
 #include "stat.h"
 
 static struct shim_lock handle_mgr_lock;
@@ -29,6 +31,21 @@ static struct shim_lock handle_mgr_lock;
 
 static MEM_MGR handle_mgr = NULL;
 
+/* FD array replaced by a larger one, see `g_fd_readers` */
+struct shim_retired_fd_array {
+    struct shim_retired_fd_array* next;
+    struct shim_fd_handle** map;
+};
+
+/* Number of lockless FD lookups in progress (see `get_fd_handle`). Handles destroyed and FD arrays
+ * replaced while there are lookups are put on the retired lists instead of being freed, and the
+ * lists are freed when the number of lookups drops to zero. */
+static uint64_t g_fd_readers = 0;
+
+static spinlock_t g_retired_fd_lock = INIT_SPINLOCK_UNLOCKED;
+static struct shim_handle* g_retired_handles = NULL;
+static struct shim_retired_fd_array* g_retired_fd_arrays = NULL;
+
 #define INIT_HANDLE_MAP_SIZE 32
 
 //#define DEBUG_REF
@@ -101,7 +118,7 @@ static int init_exec_handle(void) {
 
     /* Initialize `g_process.exec` based on `libos.entrypoint` manifest key. */
     assert(g_manifest_root);
-    ret = toml_string_in(g_manifest_root, "libos.entrypoint", &entrypoint);
+    ret = manifest_string_in(g_manifest_root, "libos.entrypoint", &entrypoint);
     if (ret < 0) {
         log_error("Cannot parse 'libos.entrypoint'");
         ret = -EINVAL;
@@ -264,16 +281,109 @@ struct shim_handle* __get_fd_handle(FDTYPE fd, int* fd_flags, struct shim_handle
     return NULL;
 }
 
+static void free_retired_fd_objects(void) {
+    while (true) {
+        spinlock_lock(&g_retired_fd_lock);
+        struct shim_handle* handles = g_retired_handles;
+        struct shim_retired_fd_array* arrays = g_retired_fd_arrays;
+        g_retired_handles = NULL;
+        g_retired_fd_arrays = NULL;
+        spinlock_unlock(&g_retired_fd_lock);
+
+        if (!handles && !arrays)
+            return;
+
+        /* All objects on the lists were unreachable before we took them, so they are safe to free
+         * if there are no readers now. */
+        if (__atomic_load_n(&g_fd_readers, __ATOMIC_SEQ_CST) == 0) {
+            while (handles) {
+                struct shim_handle* next = handles->retired_next;
+                free_mem_obj_to_mgr(handle_mgr, handles);
+                handles = next;
+            }
+            while (arrays) {
+                struct shim_retired_fd_array* next = arrays->next;
+                free(arrays->map);
+                free(arrays);
+                arrays = next;
+            }
+            return;
+        }
+
+        spinlock_lock(&g_retired_fd_lock);
+        if (handles) {
+            struct shim_handle* last = handles;
+            while (last->retired_next)
+                last = last->retired_next;
+            last->retired_next = g_retired_handles;
+            g_retired_handles = handles;
+        }
+        if (arrays) {
+            struct shim_retired_fd_array* last = arrays;
+            while (last->next)
+                last = last->next;
+            last->next = g_retired_fd_arrays;
+            g_retired_fd_arrays = arrays;
+        }
+        spinlock_unlock(&g_retired_fd_lock);
+
+        /* if the last reader finished in the meantime, it saw empty lists */
+        if (__atomic_load_n(&g_fd_readers, __ATOMIC_SEQ_CST) != 0)
+            return;
+    }
+}
+
+static void end_fd_lockless_read(void) {
+    if (__atomic_sub_fetch(&g_fd_readers, 1, __ATOMIC_SEQ_CST) == 0
+            && (__atomic_load_n(&g_retired_handles, __ATOMIC_RELAXED)
+                || __atomic_load_n(&g_retired_fd_arrays, __ATOMIC_RELAXED)))
+        free_retired_fd_objects();
+}
+
+/*
+ * Lockless lookup, see the comment on `struct shim_handle_map`. While the lookup is counted in
+ * `g_fd_readers`, neither the FD array nor the handle it reads can be freed (or reused), so
+ * `REF_INC_NOT_ZERO` is safe even if the handle is concurrently closed and destroyed: we take
+ * a reference only if the handle is still alive and then check that the FD still maps to it.
+ */
 struct shim_handle* get_fd_handle(FDTYPE fd, int* fd_flags, struct shim_handle_map* map) {
     if (!map)
         map = get_thread_handle_map(NULL);
 
-    struct shim_handle* hdl = NULL;
-    lock(&map->lock);
-    if ((hdl = __get_fd_handle(fd, fd_flags, map)))
-        get_handle(hdl);
-    unlock(&map->lock);
-    return hdl;
+    while (true) {
+        struct shim_handle* hdl = NULL;
+        bool referenced = false;
+        bool mapped = false;
+
+        __atomic_add_fetch(&g_fd_readers, 1, __ATOMIC_SEQ_CST);
+
+        /* `map->map` is published before `map->fd_size`, so the array is at least that large */
+        FDTYPE fd_size = __atomic_load_n(&map->fd_size, __ATOMIC_ACQUIRE);
+        if (fd < fd_size) {
+            struct shim_fd_handle** fds = __atomic_load_n(&map->map, __ATOMIC_ACQUIRE);
+            struct shim_fd_handle* fd_handle = __atomic_load_n(&fds[fd], __ATOMIC_ACQUIRE);
+            if (fd_handle)
+                hdl = __atomic_load_n(&fd_handle->handle, __ATOMIC_ACQUIRE);
+
+            if (hdl && REF_INC_NOT_ZERO(hdl->ref_count)) {
+                referenced = true;
+                mapped = __atomic_load_n(&fd_handle->handle, __ATOMIC_ACQUIRE) == hdl;
+                if (mapped && fd_flags)
+                    *fd_flags = __atomic_load_n(&fd_handle->flags, __ATOMIC_RELAXED);
+            }
+        }
+
+        /* `put_handle` below may do a lot of work, so don't do it inside the read section */
+        end_fd_lockless_read();
+
+        if (!hdl || mapped)
+            return hdl;
+
+        /* handle is being destroyed, or the FD was closed or reassigned meanwhile */
+        if (referenced)
+            put_handle(hdl);
+        CPU_RELAX();
+    }
 }
 
 struct shim_handle* __detach_fd_handle(struct shim_fd_handle* fd, int* flags,
@@ -288,9 +398,10 @@ struct shim_handle* __detach_fd_handle(struct shim_fd_handle* fd, int* flags,
         if (flags)
             *flags = fd->flags;
 
-        fd->vfd    = FD_NULL;
-        fd->handle = NULL;
-        fd->flags  = 0;
+        fd->vfd = FD_NULL;
+        /* pairs with the check of `g_fd_readers` in `destroy_handle` */
+        __atomic_store_n(&fd->handle, NULL, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&fd->flags, 0, __ATOMIC_RELAXED);
 
         if (vfd == map->fd_top)
             do {
@@ -358,13 +469,15 @@ static int __init_handle(struct shim_fd_handle** fdhdl, FDTYPE fd, struct shim_h
         new_handle = malloc(sizeof(struct shim_fd_handle));
         if (!new_handle)
             return -ENOMEM;
-        *fdhdl = new_handle;
+        new_handle->handle = NULL;
+        /* publish only a fully initialized object to lockless readers */
+        __atomic_store_n(fdhdl, new_handle, __ATOMIC_RELEASE);
     }
 
-    new_handle->vfd   = fd;
-    new_handle->flags = fd_flags;
+    new_handle->vfd = fd;
+    __atomic_store_n(&new_handle->flags, fd_flags, __ATOMIC_RELAXED);
     get_handle(hdl);
-    new_handle->handle = hdl;
+    __atomic_store_n(&new_handle->handle, hdl, __ATOMIC_RELEASE);
     return 0;
 }
 
@@ -468,7 +581,21 @@ void get_handle(struct shim_handle* hdl) {
 static void destroy_handle(struct shim_handle* hdl) {
     destroy_lock(&hdl->lock);
 
-    free_mem_obj_to_mgr(handle_mgr, hdl);
+    /* `hdl` is not installed in any FD anymore, but lookups that started before it was detached
+     * might still be looking at it. Lookups that start after this check cannot find it (both sides
+     * use sequentially consistent accesses). */
+    if (__atomic_load_n(&g_fd_readers, __ATOMIC_SEQ_CST) == 0) {
+        free_mem_obj_to_mgr(handle_mgr, hdl);
+        return;
+    }
+
+    spinlock_lock(&g_retired_fd_lock);
+    hdl->retired_next = g_retired_handles;
+    g_retired_handles = hdl;
+    spinlock_unlock(&g_retired_fd_lock);
+
+    /* the last reader might have finished before we added `hdl` to the list */
+    free_retired_fd_objects();
 }
 
 void put_handle(struct shim_handle* hdl) {
@@ -579,10 +706,34 @@ static int __enlarge_handle_map(struct shim_handle_map* map, size_t size) {
     if (!new_map)
         return -ENOMEM;
 
+    struct shim_retired_fd_array* retired = NULL;
+    if (map->map) {
+        retired = malloc(sizeof(*retired));
+        if (!retired) {
+            free(new_map);
+            return -ENOMEM;
+        }
+        retired->map = map->map;
+    }
+
     memcpy(new_map, map->map, map->fd_size * sizeof(new_map[0]));
-    free(map->map);
-    map->map     = new_map;
-    map->fd_size = size;
+    __atomic_store_n(&map->map, new_map, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&map->fd_size, size, __ATOMIC_SEQ_CST);
+
+    if (retired) {
+        /* lockless readers may still use the old array, see `destroy_handle` */
+        if (__atomic_load_n(&g_fd_readers, __ATOMIC_SEQ_CST) == 0) {
+            free(retired->map);
+            free(retired);
+        } else {
+            spinlock_lock(&g_retired_fd_lock);
+            retired->next = g_retired_fd_arrays;
+            g_retired_fd_arrays = retired;
+            spinlock_unlock(&g_retired_fd_lock);
+
+            free_retired_fd_objects();
+        }
+    }
     return 0;
 }
 
@@ -701,6 +852,16 @@ BEGIN_CP_FUNC(handle) {
     size_t off = GET_FROM_CP_MAP(obj);
 
     if (!off) {
+        /* Local pipes are promoted to host pipes when checkpointing the handle map. A handle that
+         * the promotion did not reach would have neither the local state nor a PAL handle in the
+         * child, so fail the checkpoint instead. */
+        bool local = (hdl->type == TYPE_PIPE && hdl->info.pipe.local)
+                     || (hdl->type == TYPE_SOCK && hdl->info.sock.local);
+        if (local && !__atomic_load_n(&hdl->pal_handle, __ATOMIC_ACQUIRE)) {
+            log_error("Cannot checkpoint a pipe which was not promoted to a host pipe");
+            return -ENOSYS;
+        }
+
         off = ADD_CP_OFFSET(sizeof(struct shim_handle));
         ADD_TO_CP_MAP(obj, off);
         new_hdl = (struct shim_handle*)(base + off);
@@ -751,11 +912,26 @@ BEGIN_CP_FUNC(handle) {
                 DO_CP(epoll_item, &hdl->info.epoll.fds, &new_hdl->info.epoll.fds);
                 __atomic_store_n(&new_hdl->info.epoll.waiter_cnt, 0, __ATOMIC_RELAXED);
                 memset(&new_hdl->info.epoll.event, '\0', sizeof(new_hdl->info.epoll.event));
+                /* the FD index, the ready list and the wait set are rebuilt in the child */
+                INIT_LISTP(&new_hdl->info.epoll.ready);
+                new_hdl->info.epoll.fd_buckets     = NULL;
+                new_hdl->info.epoll.fd_buckets_cnt = 0;
+                new_hdl->info.epoll.wait_set       = NULL;
+                new_hdl->info.epoll.dirty          = false;
+                break;
+            case TYPE_PIPE:
+                /* local pipes are promoted to host pipes when checkpointing the handle map */
+                new_hdl->info.pipe.local = NULL;
+                break;
+            case TYPE_EVENTFD:
+                /* local eventfds are promoted to host eventfds when checkpointing the handle map */
+                new_hdl->info.eventfd.local = NULL;
                 break;
             case TYPE_SOCK:
                 /* no support for multiple processes sharing options/peek buffer of the socket */
                 new_hdl->info.sock.pending_options = NULL;
                 new_hdl->info.sock.peek_buffer     = NULL;
+                new_hdl->info.sock.local           = NULL;
                 break;
             default:
                 break;
@@ -805,6 +981,11 @@ BEGIN_RS_FUNC(handle) {
                 count++;
             }
             assert(hdl->info.epoll.fds_count == count);
+
+            ret = restore_epoll_handle(hdl);
+            if (ret < 0) {
+                return ret;
+            }
             break;
         }
         default:
@@ -851,6 +1032,17 @@ BEGIN_CP_FUNC(handle_map) {
     size_t off = GET_FROM_CP_MAP(obj);
 
     if (!off) {
+        /* The child cannot share the in-process state of local pipes and eventfds. They are
+         * promoted to host objects under the map lock, so that one created concurrently by another
+         * thread cannot end up in the checkpoint. */
+        int ret = __promote_local_pipes(handle_map);
+        if (!ret)
+            ret = __promote_local_eventfds(handle_map);
+        if (ret < 0) {
+            unlock(&handle_map->lock);
+            return ret;
+        }
+
         off            = ADD_CP_OFFSET(size);
         new_handle_map = (struct shim_handle_map*)(base + off);
 
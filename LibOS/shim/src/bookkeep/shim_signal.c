@@ -14,6 +14,7 @@
 #include <stdnoreturn.h>
 
 #include "cpu.h"
+#include "manifest.h"
 #include "pal.h"
 #include "shim_checkpoint.h"
 #include "shim_entry.h"
@@ -27,7 +28,6 @@
 #include "shim_types.h"
 #include "shim_utils.h"
 #include "shim_vma.h"
-#include "toml.h"
 
 static bool g_check_invalid_ptrs = true;
 
@@ -517,16 +517,16 @@ int init_signal_handling(void) {
         return -ENOMEM;
     }
 
-    int ret = toml_bool_in(g_manifest_root, "sys.enable_sigterm_injection", /*defaultval=*/false,
-                           &g_inject_host_signal_enabled);
+    int ret = manifest_bool_in(g_manifest_root, "sys.enable_sigterm_injection",
+                               /*defaultval=*/false, &g_inject_host_signal_enabled);
     if (ret < 0) {
         log_error("Cannot parse 'sys.enable_sigterm_injection' (the value must be `true` or "
                   "`false`)");
         return -EINVAL;
     }
 
-    ret = toml_bool_in(g_manifest_root, "libos.check_invalid_pointers", /*defaultval=*/true,
-                       &g_check_invalid_ptrs);
+    ret = manifest_bool_in(g_manifest_root, "libos.check_invalid_pointers", /*defaultval=*/true,
+                           &g_check_invalid_ptrs);
     if (ret < 0) {
         log_error("Cannot parse 'libos.check_invalid_pointers' (the value must be `true` or "
                   "`false`)");
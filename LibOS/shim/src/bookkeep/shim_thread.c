@@ -550,9 +550,10 @@ BEGIN_CP_FUNC(thread) {
             struct shim_tcb* new_tcb = new_thread->shim_tcb;
             *new_tcb = *thread->shim_tcb;
             /* don't export stale pointers */
-            new_tcb->self      = NULL;
-            new_tcb->tp        = NULL;
-            new_tcb->vma_cache = NULL;
+            new_tcb->self         = NULL;
+            new_tcb->tp           = NULL;
+            new_tcb->vma_cache    = NULL;
+            new_tcb->malloc_cache = NULL;
 
             new_tcb->log_prefix[0] = '\0';
 
@@ -616,7 +617,10 @@ BEGIN_RS_FUNC(thread) {
     CP_REBASE(thread->shim_tcb->context.regs);
 
     shim_tcb_t* tcb = shim_get_tcb();
+    /* this thread may have already used its allocator cache during initialization; keep it */
+    void* malloc_cache = tcb->malloc_cache;
     *tcb = *thread->shim_tcb;
+    tcb->malloc_cache = malloc_cache;
     __shim_tcb_init(tcb);
 
     assert(tcb->context.regs);
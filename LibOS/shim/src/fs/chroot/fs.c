@@ -15,6 +15,8 @@
 #include "pal_error.h"
 #include "shim_flags_conv.h"
 #include "shim_fs.h"
+#include "shim_fs_meta_cache.h"
+#include "shim_fs_page_cache.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_lock.h"
@@ -27,6 +29,12 @@ struct mount_data {
     size_t data_size;
     enum shim_file_type base_type;
     unsigned long dev;
+    /* TTL of the metadata cache (`metadata_cache_ttl` option), 0 if the cache is disabled */
+    uint64_t meta_cache_ttl_us;
+    /* not migrated, every process starts with an empty cache */
+    struct meta_cache* meta_cache;
+    /* `page_cache` option; the page caches themselves belong to the files */
+    enum page_cache_mode page_cache_mode;
     size_t root_uri_len;
     char root_uri[];
 };
@@ -55,7 +63,61 @@ static void file_sync_unlock(struct shim_file_handle* file) {
 
 #define DENTRY_MOUNT_DATA(d) ((struct mount_data*)(d)->mount->data)
 
-static int chroot_mount(const char* uri, void** mount_data) {
+/* Parses `metadata_cache_ttl`: time in seconds, 0 (the default) disables the cache, -1 means that
+ * entries never expire. */
+static int parse_meta_cache_ttl(const struct manifest_node* options, uint64_t* out_ttl_us) {
+    *out_ttl_us = 0;
+    if (!options)
+        return 0;
+
+    const char* key = "metadata_cache_ttl";
+    const struct manifest_node* node = manifest_table_get(g_manifest_root, options, key,
+                                                          strlen(key));
+    if (!node)
+        return 0;
+
+    int64_t ttl = (int64_t)node->value;
+    if (node->type != MANIFEST_NODE_INT || ttl < -1 || ttl > INT64_MAX / 1000000) {
+        log_error("Cannot parse '%s' option of mount '%s' (the value must be a number of seconds or"
+                  " -1)", key, manifest_node_key(g_manifest_root, options));
+        return -EINVAL;
+    }
+
+    *out_ttl_us = ttl == -1 ? META_CACHE_TTL_INFINITE : (uint64_t)ttl * 1000000;
+    return 0;
+}
+
+/* Parses `page_cache`: "none" (the default), "write-through" or "write-back". */
+static int parse_page_cache_mode(const struct manifest_node* options,
+                                 enum page_cache_mode* out_mode) {
+    *out_mode = PAGE_CACHE_DISABLED;
+    if (!options)
+        return 0;
+
+    const char* key = "page_cache";
+    const struct manifest_node* node = manifest_table_get(g_manifest_root, options, key,
+                                                          strlen(key));
+    if (!node)
+        return 0;
+
+    const char* mode = node->type == MANIFEST_NODE_STRING ? manifest_node_str(g_manifest_root, node)
+                                                          : NULL;
+    if (mode && !strcmp(mode, "none")) {
+        *out_mode = PAGE_CACHE_DISABLED;
+    } else if (mode && !strcmp(mode, "write-through")) {
+        *out_mode = PAGE_CACHE_WRITE_THROUGH;
+    } else if (mode && !strcmp(mode, "write-back")) {
+        *out_mode = PAGE_CACHE_WRITE_BACK;
+    } else {
+        log_error("Cannot parse '%s' option of mount '%s' (the value must be \"none\", "
+                  "\"write-through\" or \"write-back\")", key,
+                  manifest_node_key(g_manifest_root, options));
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int chroot_mount(const char* uri, const struct manifest_node* options, void** mount_data) {
     enum shim_file_type type;
 
     if (strstartswith(uri, URI_PREFIX_FILE)) {
@@ -73,23 +135,50 @@ static int chroot_mount(const char* uri, void** mount_data) {
     if (!(*uri))
         uri = ".";
 
+    uint64_t meta_cache_ttl_us;
+    int ret = parse_meta_cache_ttl(options, &meta_cache_ttl_us);
+    if (ret < 0)
+        return ret;
+    enum page_cache_mode page_cache_mode;
+    ret = parse_page_cache_mode(options, &page_cache_mode);
+    if (ret < 0)
+        return ret;
+    /* only regular host files and directories are cached */
+    if (type != FILE_UNKNOWN) {
+        meta_cache_ttl_us = 0;
+        page_cache_mode = PAGE_CACHE_DISABLED;
+    }
+
     size_t uri_len = strlen(uri);
     size_t data_size = uri_len + 1 + sizeof(struct mount_data);
 
     struct mount_data* mdata = (struct mount_data*)malloc(data_size);
+    if (!mdata)
+        return -ENOMEM;
 
-    mdata->data_size    = data_size;
-    mdata->base_type    = type;
-    mdata->dev          = hash_str(uri);
-    mdata->root_uri_len = uri_len;
+    mdata->data_size         = data_size;
+    mdata->base_type         = type;
+    mdata->dev               = hash_str(uri);
+    mdata->meta_cache_ttl_us = meta_cache_ttl_us;
+    mdata->meta_cache        = NULL;
+    mdata->page_cache_mode   = page_cache_mode;
+    mdata->root_uri_len      = uri_len;
     memcpy(mdata->root_uri, uri, uri_len + 1);
 
+    if (meta_cache_ttl_us && (ret = meta_cache_create(meta_cache_ttl_us, &mdata->meta_cache)) < 0) {
+        free(mdata);
+        return ret;
+    }
+
     *mount_data = mdata;
     return 0;
 }
 
 static int chroot_unmount(void* mount_data) {
-    free(mount_data);
+    struct mount_data* mdata = mount_data;
+    if (mdata->meta_cache)
+        meta_cache_destroy(mdata->meta_cache);
+    free(mdata);
     return 0;
 }
 
@@ -155,6 +244,8 @@ static struct shim_file_data* __create_data(void) {
 }
 
 static void __destroy_data(struct shim_file_data* data) {
+    if (data->page_cache)
+        page_cache_destroy(data->page_cache);
     qstrfree(&data->host_uri);
     destroy_lock(&data->lock);
     free(data);
@@ -273,7 +364,7 @@ static int __query_attr(struct shim_dentry* dent, struct shim_file_data* data,
         /* Move up the uri update; need to convert manifest-level file:
          * directives to 'dir:' uris */
         if (old_type != FILE_DIR) {
-            dent->state |= DENTRY_ISDIRECTORY;
+            dentry_update_state(dent, /*clear=*/0, DENTRY_ISDIRECTORY);
             if ((ret = make_uri(dent)) < 0)
                 return ret;
         }
@@ -357,8 +448,68 @@ static int chroot_stat(struct shim_dentry* dent, struct stat* statbuf) {
     return query_dentry(dent, NULL, NULL, statbuf);
 }
 
+static int list_dir_cached(struct mount_data* mdata, const char* dir, size_t dir_len,
+                           readdir_callback_t callback, void* arg);
+
 static int chroot_lookup(struct shim_dentry* dent) {
-    return query_dentry(dent, NULL, NULL, NULL);
+    struct mount_data* mdata = DENTRY_MOUNT_DATA(dent);
+    struct meta_cache* cache = mdata->meta_cache;
+    if (!cache)
+        return query_dentry(dent, NULL, NULL, NULL);
+
+    char* rel_path;
+    size_t rel_path_size;
+    int ret = dentry_rel_path(dent, &rel_path, &rel_path_size);
+    if (ret < 0)
+        return ret;
+    size_t len = rel_path_size - 1;
+
+    enum meta_cache_state state = meta_cache_get(cache, rel_path, len);
+    if (state == META_CACHE_UNKNOWN && len > 0) {
+        /* Instead of asking the host about this one name, list the whole directory: programs that
+         * probe for nonexistent files usually probe many names in the same directories. */
+        size_t dir_len = len;
+        while (dir_len > 0 && rel_path[dir_len - 1] != '/')
+            dir_len--;
+        if (dir_len > 0)
+            dir_len--; /* skip the '/' */
+        if (meta_cache_needs_listing(cache, rel_path, dir_len)) {
+            /* errors are not fatal, we will just ask the host about `dent` */
+            (void)list_dir_cached(mdata, rel_path, dir_len, /*callback=*/NULL, /*arg=*/NULL);
+            state = meta_cache_get(cache, rel_path, len);
+        }
+    }
+
+    if (state == META_CACHE_MISSING) {
+        ret = -ENOENT;
+        goto out;
+    }
+
+    /* attributes are not cached, only existence */
+    uint64_t gen = meta_cache_gen(cache);
+    ret = query_dentry(dent, NULL, NULL, NULL);
+    if (ret == 0 || ret == -ENOENT)
+        meta_cache_set(cache, rel_path, len, /*exists=*/ret == 0, gen);
+
+out:
+    free(rel_path);
+    return ret;
+}
+
+/* Forgets cached metadata of `dent`, after it was created, removed or renamed on the host. */
+static void forget_cached_metadata(struct shim_dentry* dent) {
+    struct meta_cache* cache = DENTRY_MOUNT_DATA(dent)->meta_cache;
+    if (!cache)
+        return;
+
+    char* rel_path;
+    size_t rel_path_size;
+    if (dentry_rel_path(dent, &rel_path, &rel_path_size) < 0) {
+        meta_cache_clear(cache);
+        return;
+    }
+    meta_cache_forget(cache, rel_path, rel_path_size - 1);
+    free(rel_path);
 }
 
 static int __chroot_open(struct shim_dentry* dent, const char* uri, int flags, mode_t mode,
@@ -457,7 +608,9 @@ static int chroot_creat(struct shim_handle* hdl, struct shim_dentry* dir, struct
     if ((ret = try_create_data(dent, NULL, 0, &data)) < 0)
         return ret;
 
-    if ((ret = __chroot_open(dent, NULL, flags | O_CREAT | O_EXCL, mode, hdl, data)) < 0)
+    ret = __chroot_open(dent, NULL, flags | O_CREAT | O_EXCL, mode, hdl, data);
+    forget_cached_metadata(dent);
+    if (ret < 0)
         return ret;
 
     if (!hdl)
@@ -494,6 +647,7 @@ static int chroot_mkdir(struct shim_dentry* dir, struct shim_dentry* dent, mode_
     }
 
     ret = __chroot_open(dent, NULL, O_CREAT | O_EXCL, mode, NULL, data);
+    forget_cached_metadata(dent);
 
     return ret;
 }
@@ -543,6 +697,50 @@ static inline bool check_version(struct shim_handle* hdl) {
            == hdl->info.file.version;
 }
 
+/* Returns the page cache of the file opened by `hdl` (creating it at the first use), or NULL if the
+ * file is not cached or the handle refers to a file which was renamed or deleted. */
+static struct page_cache* get_page_cache(struct shim_handle* hdl) {
+    if (!hdl->dentry || hdl->info.file.type != FILE_REGULAR || !check_version(hdl))
+        return NULL;
+
+    enum page_cache_mode mode = DENTRY_MOUNT_DATA(hdl->dentry)->page_cache_mode;
+    if (mode == PAGE_CACHE_DISABLED)
+        return NULL;
+
+    struct shim_file_data* data = FILE_HANDLE_DATA(hdl);
+    struct page_cache* cache = __atomic_load_n(&data->page_cache, __ATOMIC_ACQUIRE);
+    if (!cache) {
+        lock(&data->lock);
+        cache = data->page_cache;
+        if (!cache) {
+            int ret = page_cache_create(mode, qstrgetstr(&data->host_uri), &cache);
+            if (ret < 0) {
+                log_warning("Failed to create a page cache for %s: %d",
+                            qstrgetstr(&data->host_uri), ret);
+                cache = NULL;
+            } else {
+                __atomic_store_n(&data->page_cache, cache, __ATOMIC_RELEASE);
+            }
+        }
+        unlock(&data->lock);
+    }
+
+    return cache && page_cache_enabled(cache) ? cache : NULL;
+}
+
+/* Writes back the dirty pages of the file; the host file has to be up to date before it is renamed,
+ * deleted, truncated or mapped, or accessed through PAL directly. */
+static int flush_page_cache(struct shim_file_data* data) {
+    struct page_cache* cache = __atomic_load_n(&data->page_cache, __ATOMIC_ACQUIRE);
+    return cache ? page_cache_flush(cache) : 0;
+}
+
+static void invalidate_page_cache(struct shim_file_data* data, off_t from) {
+    struct page_cache* cache = __atomic_load_n(&data->page_cache, __ATOMIC_ACQUIRE);
+    if (cache)
+        page_cache_invalidate(cache, from);
+}
+
 static void chroot_update_size(struct shim_handle* hdl, struct shim_file_handle* file,
                                struct shim_file_data* data) {
     if (check_version(hdl)) {
@@ -581,16 +779,68 @@ static int chroot_hstat(struct shim_handle* hdl, struct stat* stat) {
 }
 
 static int chroot_flush(struct shim_handle* hdl) {
+    struct shim_file_data* data = FILE_HANDLE_DATA(hdl);
+    if (data && check_version(hdl)) {
+        int ret = flush_page_cache(data);
+        if (ret < 0)
+            return ret;
+    }
     return pal_to_unix_errno(DkStreamFlush(hdl->pal_handle));
 }
 
 static int chroot_close(struct shim_handle* hdl) {
-    __UNUSED(hdl);
+    /* other processes see the writes after close (like on NFS) */
+    struct shim_file_data* data = hdl->type == TYPE_FILE ? FILE_HANDLE_DATA(hdl) : NULL;
+    if (data && check_version(hdl))
+        return flush_page_cache(data);
     return 0;
 }
 
-static ssize_t chroot_read(struct shim_handle* hdl, void* buf, size_t count) {
+/* A single read or write; the data goes to/from `iov`, or is copied directly from PAL stream `src`
+ * (writes only) if it is not NULL. */
+struct chroot_io {
+    enum PAL_IO_OP op;
+    const struct iovec* iov;
+    size_t iov_cnt;
+    PAL_HANDLE src;
+    off_t src_pos;
+    size_t src_count;
+};
+
+static ssize_t chroot_pal_io(PAL_HANDLE pal_handle, struct chroot_io* io, off_t pos) {
+    size_t count;
+    int ret;
+
+    if (io->src) {
+        count = io->src_count;
+        ret = DkStreamTransfer(io->src, io->src_pos, pal_handle, pos, &count);
+    } else if (io->iov_cnt == 1) {
+        count = io->iov[0].iov_len;
+        ret = io->op == PAL_IO_WRITE
+              ? DkStreamWrite(pal_handle, pos, &count, io->iov[0].iov_base, NULL)
+              : DkStreamRead(pal_handle, pos, &count, io->iov[0].iov_base, NULL, 0);
+    } else {
+        int64_t iov_ret = pal_stream_iov_io(pal_handle, io->op, pos, io->iov, io->iov_cnt);
+        return iov_ret < 0 ? pal_to_unix_errno(iov_ret) : iov_ret;
+    }
+
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+
+    ssize_t done;
+    if (__builtin_add_overflow(count, 0, &done))
+        BUG();
+    return done;
+}
+
+/* Common part of all reads and writes: transfers the data at `*pos`, or at the current file position
+ * (which is then advanced) if `pos` is NULL. A single buffer goes through plain
+ * DkStreamRead/DkStreamWrite, several buffers are passed to PAL as one request. Regular files on
+ * mounts with the `page_cache` option go through the page cache. */
+static ssize_t chroot_do_io(struct shim_handle* hdl, struct chroot_io* io, const off_t* pos) {
     ssize_t ret = 0;
+    bool write = io->op == PAL_IO_WRITE;
+    size_t count = io->src ? io->src_count : iov_total_len(io->iov, io->iov_cnt);
 
     if (count == 0)
         goto out;
@@ -599,91 +849,107 @@ static ssize_t chroot_read(struct shim_handle* hdl, void* buf, size_t count) {
         goto out;
     }
 
-    if (!(hdl->acc_mode & MAY_READ)) {
+    if (!(hdl->acc_mode & (write ? MAY_WRITE : MAY_READ))) {
         ret = -EBADF;
         goto out;
     }
 
+    assert(hdl->type == TYPE_FILE);
     struct shim_file_handle* file = &hdl->info.file;
-
-    off_t dummy_off_t;
-    if (file->type != FILE_TTY && file->type != FILE_DEV &&
-            __builtin_add_overflow(file->marker, count, &dummy_off_t)) {
-        ret = -EFBIG;
-        goto out;
-    }
+    bool seekable = file->type != FILE_TTY && file->type != FILE_DEV;
 
     lock(&hdl->lock);
     file_sync_lock(file, SYNC_STATE_EXCLUSIVE);
 
-    ret = DkStreamRead(hdl->pal_handle, file->marker, &count, buf, NULL, 0);
-    if (ret < 0) {
-        ret = pal_to_unix_errno(ret);
+    off_t start = pos ? *pos : file->marker;
+    off_t end;
+    if (seekable && __builtin_add_overflow(start, count, &end)) {
+        ret = -EFBIG;
+        goto out_unlock;
+    }
+
+    struct page_cache* cache = seekable ? get_page_cache(hdl) : NULL;
+    if (cache && !io->src) {
+        /* `file->size` is stale if another handle truncated the file; the cache needs the real
+         * size, as the host file does not contain the data which was not written back yet */
+        off_t file_size = __atomic_load_n(&FILE_HANDLE_DATA(hdl)->size.counter, __ATOMIC_SEQ_CST);
+        file->size = file_size;
+        ret = write
+              ? page_cache_write(cache, hdl->pal_handle, io->iov, io->iov_cnt, start, file_size)
+              : page_cache_read(cache, hdl->pal_handle, io->iov, io->iov_cnt, start, file_size);
+        if (ret == -ENOSYS)
+            ret = chroot_pal_io(hdl->pal_handle, io, start);
+    } else if (cache) {
+        /* the data is copied by PAL, so the cached pages are written back and dropped */
+        ret = page_cache_flush(cache);
+        if (ret < 0)
+            goto out_unlock;
+        ret = chroot_pal_io(hdl->pal_handle, io, start);
+        page_cache_invalidate(cache, start);
     } else {
-        if (__builtin_add_overflow(count, 0, &ret)) {
-            BUG();
-        }
-        if (file->type != FILE_TTY && file->type != FILE_DEV &&
-                __builtin_add_overflow(file->marker, count, &file->marker)) {
-            BUG();
+        ret = chroot_pal_io(hdl->pal_handle, io, start);
+    }
+
+    if (ret >= 0 && seekable) {
+        end = start + ret;
+        if (!pos)
+            file->marker = end;
+        if (write && end > file->size) {
+            file->size = end;
+            chroot_update_size(hdl, file, FILE_HANDLE_DATA(hdl));
         }
     }
 
+out_unlock:
     file_sync_unlock(file);
     unlock(&hdl->lock);
 out:
     return ret;
 }
 
-static ssize_t chroot_write(struct shim_handle* hdl, const void* buf, size_t count) {
-    ssize_t ret;
-
-    if (count == 0)
-        return 0;
+static ssize_t chroot_iov_io(struct shim_handle* hdl, enum PAL_IO_OP op, const struct iovec* iov,
+                             size_t iov_cnt, const off_t* pos) {
+    struct chroot_io io = { .op = op, .iov = iov, .iov_cnt = iov_cnt };
+    return chroot_do_io(hdl, &io, pos);
+}
 
-    if (NEED_RECREATE(hdl) && (ret = chroot_recreate(hdl)) < 0) {
-        goto out;
-    }
+static ssize_t chroot_read(struct shim_handle* hdl, void* buf, size_t count) {
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    return chroot_iov_io(hdl, PAL_IO_READ, &iov, 1, /*pos=*/NULL);
+}
 
-    if (!(hdl->acc_mode & MAY_WRITE)) {
-        ret = -EBADF;
-        goto out;
-    }
+static ssize_t chroot_write(struct shim_handle* hdl, const void* buf, size_t count) {
+    struct iovec iov = { .iov_base = (void*)buf, .iov_len = count };
+    return chroot_iov_io(hdl, PAL_IO_WRITE, &iov, 1, /*pos=*/NULL);
+}
 
-    assert(hdl->type == TYPE_FILE);
-    struct shim_file_handle* file = &hdl->info.file;
+static ssize_t chroot_readv(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt) {
+    return chroot_iov_io(hdl, PAL_IO_READ, iov, iov_cnt, /*pos=*/NULL);
+}
 
-    off_t dummy_off_t;
-    if (file->type != FILE_TTY && file->type != FILE_DEV &&
-            __builtin_add_overflow(file->marker, count, &dummy_off_t)) {
-        ret = -EFBIG;
-        goto out;
-    }
+static ssize_t chroot_writev(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt) {
+    return chroot_iov_io(hdl, PAL_IO_WRITE, iov, iov_cnt, /*pos=*/NULL);
+}
 
-    lock(&hdl->lock);
-    file_sync_lock(file, SYNC_STATE_EXCLUSIVE);
+static ssize_t chroot_pread(struct shim_handle* hdl, void* buf, size_t count, off_t pos) {
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    return chroot_iov_io(hdl, PAL_IO_READ, &iov, 1, &pos);
+}
 
-    ret = DkStreamWrite(hdl->pal_handle, file->marker, &count, (void*)buf, NULL);
-    if (ret < 0) {
-        ret = pal_to_unix_errno(ret);
-    } else {
-        if (__builtin_add_overflow(count, 0, &ret)) {
-            BUG();
-        }
-        if (file->type != FILE_TTY && file->type != FILE_DEV &&
-                __builtin_add_overflow(file->marker, count, &file->marker)) {
-            BUG();
-        }
-        if (file->marker > file->size) {
-            file->size = file->marker;
-            chroot_update_size(hdl, file, FILE_HANDLE_DATA(hdl));
-        }
-    }
+static ssize_t chroot_pwrite(struct shim_handle* hdl, const void* buf, size_t count, off_t pos) {
+    struct iovec iov = { .iov_base = (void*)buf, .iov_len = count };
+    return chroot_iov_io(hdl, PAL_IO_WRITE, &iov, 1, &pos);
+}
 
-    file_sync_unlock(file);
-    unlock(&hdl->lock);
-out:
-    return ret;
+static ssize_t chroot_write_from(struct shim_handle* hdl, PAL_HANDLE src, off_t src_pos,
+                                 size_t count, const off_t* pos) {
+    struct chroot_io io = {
+        .op        = PAL_IO_WRITE,
+        .src       = src,
+        .src_pos   = src_pos,
+        .src_count = count,
+    };
+    return chroot_do_io(hdl, &io, pos);
 }
 
 static int chroot_mmap(struct shim_handle* hdl, void** addr, size_t size, int prot, int flags,
@@ -701,6 +967,15 @@ static int chroot_mmap(struct shim_handle* hdl, void** addr, size_t size, int pr
 #endif
         return -EINVAL;
 
+    struct page_cache* cache = get_page_cache(hdl);
+    if (cache) {
+        /* writes through a shared mapping would not be seen by the cache */
+        ret = (flags & MAP_SHARED) && (prot & PROT_WRITE) ? page_cache_disable(cache)
+                                                           : page_cache_flush(cache);
+        if (ret < 0)
+            return ret;
+    }
+
     return pal_to_unix_errno(DkStreamMap(hdl->pal_handle, addr, pal_prot, offset, size));
 }
 
@@ -766,6 +1041,16 @@ static int chroot_truncate(struct shim_handle* hdl, off_t len) {
     lock(&hdl->lock);
     file_sync_lock(file, SYNC_STATE_EXCLUSIVE);
 
+    struct page_cache* cache = get_page_cache(hdl);
+    if (cache) {
+        /* pages past the new end are dropped without writing them back; the rest has to be written
+         * before the host file is truncated, and the last (partial) page is then re-read */
+        page_cache_invalidate(cache, ALIGN_UP(len, PAGE_CACHE_PAGE_SIZE));
+        ret = page_cache_flush(cache);
+        if (ret < 0)
+            goto out;
+    }
+
     file->size = len;
 
     if (check_version(hdl)) {
@@ -774,6 +1059,8 @@ static int chroot_truncate(struct shim_handle* hdl, off_t len) {
     }
 
     ret = DkStreamSetLength(hdl->pal_handle, len);
+    if (cache)
+        page_cache_invalidate(cache, len);
     if (ret < 0) {
         ret = pal_to_unix_errno(ret);
         goto out;
@@ -799,17 +1086,13 @@ static int chroot_dput(struct shim_dentry* dent) {
     return 0;
 }
 
-static int chroot_readdir(struct shim_dentry* dent, readdir_callback_t callback, void* arg) {
-    struct shim_file_data* data = NULL;
+/* Lists a host directory (given by a "dir:" URI), calling `callback` for each entry. */
+static int list_host_dir(const char* uri, readdir_callback_t callback, void* arg) {
     int ret = 0;
     PAL_HANDLE pal_hdl = NULL;
     size_t buf_size = READDIR_BUF_SIZE;
     char* buf = NULL;
 
-    if ((ret = try_create_data(dent, NULL, 0, &data)) < 0)
-        return ret;
-
-    const char* uri = qstrgetstr(&data->host_uri);
     assert(strstartswith(uri, URI_PREFIX_DIR));
 
     ret = DkStreamOpen(uri, PAL_ACCESS_RDONLY, 0, 0, 0, &pal_hdl);
@@ -867,6 +1150,103 @@ out:
     return ret;
 }
 
+/* Directory listing that also populates the metadata cache */
+struct listing {
+    struct meta_cache* cache;
+    uint64_t gen;
+    size_t count;
+    char* path;                 /* buffer for "<dir>/<name>" */
+    size_t dir_len;             /* length of the "<dir>/" prefix in `path` */
+    readdir_callback_t callback;
+    void* arg;
+};
+
+static int listing_callback(const char* name, void* arg) {
+    struct listing* listing = arg;
+
+    size_t name_len = strlen(name);
+    if (name_len <= NAME_MAX && listing->count < META_CACHE_MAX_LISTING) {
+        memcpy(listing->path + listing->dir_len, name, name_len);
+        meta_cache_set(listing->cache, listing->path, listing->dir_len + name_len, /*exists=*/true,
+                       listing->gen);
+    }
+    listing->count++;
+
+    if (listing->callback)
+        return listing->callback(name, listing->arg);
+    if (listing->count > META_CACHE_MAX_LISTING)
+        return -E2BIG; /* only prefilling, no point in reading the rest */
+    return 0;
+}
+
+/* Lists directory `dir` (relative to the mount), calling `callback` (if not NULL) for each entry,
+ * and remembers the listing in the metadata cache. */
+static int list_dir_cached(struct mount_data* mdata, const char* dir, size_t dir_len,
+                           readdir_callback_t callback, void* arg) {
+    struct meta_cache* cache = mdata->meta_cache;
+    assert(cache);
+
+    char* uri = NULL;
+    size_t uri_len;
+    int ret = alloc_concat_uri(FILE_DIR, mdata->root_uri, mdata->root_uri_len, dir, dir_len, &uri,
+                               &uri_len);
+    if (ret < 0)
+        return ret;
+
+    struct listing listing = {
+        .cache    = cache,
+        .gen      = meta_cache_gen(cache),
+        .count    = 0,
+        .path     = malloc(dir_len + 1 + NAME_MAX),
+        .dir_len  = dir_len ? dir_len + 1 : 0,
+        .callback = callback,
+        .arg      = arg,
+    };
+    if (!listing.path) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    if (dir_len) {
+        memcpy(listing.path, dir, dir_len);
+        listing.path[dir_len] = '/';
+    }
+
+    ret = list_host_dir(uri, listing_callback, &listing);
+    if (listing.count > META_CACHE_MAX_LISTING) {
+        meta_cache_set_unlistable(cache, dir, dir_len);
+        if (ret == -E2BIG && !callback)
+            ret = 0;
+    } else if (ret == 0) {
+        meta_cache_set_listed(cache, dir, dir_len, listing.gen);
+    }
+
+out:
+    free(listing.path);
+    free(uri);
+    return ret;
+}
+
+static int chroot_readdir(struct shim_dentry* dent, readdir_callback_t callback, void* arg) {
+    struct shim_file_data* data = NULL;
+    int ret;
+
+    if ((ret = try_create_data(dent, NULL, 0, &data)) < 0)
+        return ret;
+
+    struct mount_data* mdata = DENTRY_MOUNT_DATA(dent);
+    if (!mdata->meta_cache)
+        return list_host_dir(qstrgetstr(&data->host_uri), callback, arg);
+
+    char* rel_path;
+    size_t rel_path_size;
+    if ((ret = dentry_rel_path(dent, &rel_path, &rel_path_size)) < 0)
+        return ret;
+
+    ret = list_dir_cached(mdata, rel_path, rel_path_size - 1, callback, arg);
+    free(rel_path);
+    return ret;
+}
+
 static void chroot_hput(struct shim_handle* hdl) {
     if (hdl->info.file.sync) {
         sync_destroy(hdl->info.file.sync);
@@ -910,8 +1290,18 @@ static int chroot_migrate(void* checkpoint, void** mount_data) {
         return -ENOMEM;
 
     memcpy(new_data, mdata, alloc_size);
-    *mount_data = new_data;
 
+    struct mount_data* new_mdata = new_data;
+    new_mdata->meta_cache = NULL;
+    if (new_mdata->meta_cache_ttl_us) {
+        int ret = meta_cache_create(new_mdata->meta_cache_ttl_us, &new_mdata->meta_cache);
+        if (ret < 0) {
+            free(new_data);
+            return ret;
+        }
+    }
+
+    *mount_data = new_data;
     return 0;
 }
 
@@ -923,6 +1313,10 @@ static int chroot_unlink(struct shim_dentry* dir, struct shim_dentry* dent) {
     if ((ret = try_create_data(dent, NULL, 0, &data)) < 0)
         return ret;
 
+    /* handles which keep the file open use the host file from now on */
+    if ((ret = flush_page_cache(data)) < 0)
+        return ret;
+
     PAL_HANDLE pal_hdl = NULL;
     ret = DkStreamOpen(qstrgetstr(&data->host_uri), 0, 0, 0, 0, &pal_hdl);
     if (ret < 0) {
@@ -931,9 +1325,11 @@ static int chroot_unlink(struct shim_dentry* dir, struct shim_dentry* dent) {
 
     ret = DkStreamDelete(pal_hdl, 0);
     DkObjectClose(pal_hdl);
+    forget_cached_metadata(dent);
     if (ret < 0) {
         return pal_to_unix_errno(ret);
     }
+    invalidate_page_cache(data, 0);
 
     data->queried = false;
 
@@ -991,6 +1387,10 @@ static int chroot_rename(struct shim_dentry* old, struct shim_dentry* new) {
         return ret;
     }
 
+    /* handles which keep the files open use the host files from now on */
+    if ((ret = flush_page_cache(old_data)) < 0 || (ret = flush_page_cache(new_data)) < 0)
+        return ret;
+
     PAL_HANDLE pal_hdl = NULL;
     ret = DkStreamOpen(qstrgetstr(&old_data->host_uri), 0, 0, 0, 0, &pal_hdl);
     if (ret < 0) {
@@ -998,6 +1398,15 @@ static int chroot_rename(struct shim_dentry* old, struct shim_dentry* new) {
     }
 
     ret = DkStreamChangeName(pal_hdl, qstrgetstr(&new_data->host_uri));
+    if (old->state & DENTRY_ISDIRECTORY) {
+        /* paths of all descendants changed */
+        struct meta_cache* cache = DENTRY_MOUNT_DATA(old)->meta_cache;
+        if (cache)
+            meta_cache_clear(cache);
+    } else {
+        forget_cached_metadata(old);
+        forget_cached_metadata(new);
+    }
     if (ret < 0) {
         DkObjectClose(pal_hdl);
         return pal_to_unix_errno(ret);
@@ -1008,6 +1417,8 @@ static int chroot_rename(struct shim_dentry* old, struct shim_dentry* new) {
     old_data->queried = false;
 
     DkObjectClose(pal_hdl);
+    invalidate_page_cache(old_data, 0);
+    invalidate_page_cache(new_data, 0);
 
     __atomic_add_fetch(&old_data->version.counter, 1, __ATOMIC_SEQ_CST);
     __atomic_store_n(&old_data->size.counter, 0, __ATOMIC_SEQ_CST);
@@ -1047,6 +1458,11 @@ struct shim_fs_ops chroot_fs_ops = {
     .close      = &chroot_close,
     .read       = &chroot_read,
     .write      = &chroot_write,
+    .readv      = &chroot_readv,
+    .writev     = &chroot_writev,
+    .pread      = &chroot_pread,
+    .pwrite     = &chroot_pwrite,
+    .write_from = &chroot_write_from,
     .mmap       = &chroot_mmap,
     .seek       = &chroot_seek,
     .hstat      = &chroot_hstat,
@@ -3,6 +3,13 @@
 
 /*
  * This file contains code for implementation of 'eventfd' filesystem.
+ *
+ * Eventfds are created inside the LibOS ("local eventfds"): the counter lives in LibOS memory,
+ * blocked readers and writers sleep on their thread events and poll/epoll wait on LibOS events
+ * (see `struct shim_poll_notifier`), so eventfd operations do not need the host. A host eventfd is
+ * used only if the eventfd is shared with a child process: the local eventfds of a process are
+ * promoted to host eventfds when it forks (see `__promote_local_eventfds`), which requires
+ * `sys.insecure__allow_eventfd` in the manifest.
  */
 
 #include <asm/fcntl.h>
@@ -10,16 +17,183 @@
 #include <errno.h>
 #include <linux/fcntl.h>
 
+#include "list.h"
+#include "manifest.h"
 #include "pal.h"
+#include "pal_error.h"
 #include "shim_fs.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_lock.h"
+#include "shim_thread.h"
+
+#define EVENTFD_MAX_COUNT (UINT64_MAX - 1)
+
+/* Returned (negated) by the local operations if the eventfd was promoted to a host eventfd; the
+ * caller has to use `pal_handle` of the handle instead. */
+#define ELOCALEVENTFDPROMOTED 1000
+
+DEFINE_LIST(local_eventfd_waiter);
+struct local_eventfd_waiter {
+    struct shim_thread* thread;
+    LIST_TYPE(local_eventfd_waiter) list;
+};
+DEFINE_LISTP(local_eventfd_waiter);
+
+struct shim_local_eventfd {
+    /* protects all fields below; never held while taking the lock of the handle */
+    struct shim_lock lock;
+    bool promoted;
+    bool semaphore;
+    uint64_t count;
+    /* threads blocked in read or write; all of them are woken on every change */
+    LISTP_TYPE(local_eventfd_waiter) waiters;
+    struct shim_poll_notifier notifier;
+};
+
+static PAL_FLG local_eventfd_state(struct shim_local_eventfd* efd) {
+    PAL_FLG state = 0;
+    if (efd->count)
+        state |= PAL_WAIT_READ;
+    if (efd->count < EVENTFD_MAX_COUNT)
+        state |= PAL_WAIT_WRITE;
+    return state;
+}
+
+/* Wakes up blocked readers and writers and pollers after a change of the counter. */
+static void local_eventfd_changed(struct shim_local_eventfd* efd) {
+    assert(locked(&efd->lock));
+
+    struct local_eventfd_waiter* waiter;
+    struct local_eventfd_waiter* tmp;
+    LISTP_FOR_EACH_ENTRY_SAFE(waiter, tmp, &efd->waiters, list) {
+        LISTP_DEL_INIT(waiter, &efd->waiters, list);
+        thread_wakeup(waiter->thread);
+    }
+
+    /* after promotion, pollers have to wait on the host eventfd */
+    poll_notifier_set_state(&efd->notifier,
+                            efd->promoted ? PAL_WAIT_ERROR : local_eventfd_state(efd));
+}
+
+/* Waits for the next change of the counter. The lock is released during the wait. */
+static int local_eventfd_wait(struct shim_local_eventfd* efd) {
+    assert(locked(&efd->lock));
+
+    thread_prepare_wait();
+
+    struct local_eventfd_waiter waiter = {.thread = get_cur_thread()};
+    INIT_LIST_HEAD(&waiter, list);
+    LISTP_ADD_TAIL(&waiter, &efd->waiters, list);
+
+    unlock(&efd->lock);
+    int ret = thread_wait(/*timeout_us=*/NULL, /*ignore_pending_signals=*/false);
+    lock(&efd->lock);
+
+    /* we are still on the list if we woke up because of a signal */
+    if (!LIST_EMPTY(&waiter, list))
+        LISTP_DEL_INIT(&waiter, &efd->waiters, list);
+    return ret;
+}
+
+int create_local_eventfd(struct shim_handle* hdl, uint64_t count, bool semaphore) {
+    assert(hdl->type == TYPE_EVENTFD);
+
+    struct shim_local_eventfd* efd = calloc(1, sizeof(*efd));
+    if (!efd)
+        return -ENOMEM;
+
+    if (!create_lock(&efd->lock)) {
+        free(efd);
+        return -ENOMEM;
+    }
+    efd->semaphore = semaphore;
+    efd->count = count;
+    INIT_LISTP(&efd->waiters);
+    efd->notifier.state = local_eventfd_state(efd);
+
+    hdl->info.eventfd.local = efd;
+    return 0;
+}
+
+static ssize_t local_eventfd_read(struct shim_handle* hdl, uint64_t* out_value) {
+    struct shim_local_eventfd* efd = hdl->info.eventfd.local;
+    ssize_t ret;
+
+    lock(&efd->lock);
+    while (true) {
+        if (efd->promoted) {
+            ret = -ELOCALEVENTFDPROMOTED;
+            break;
+        }
+        if (efd->count) {
+            *out_value = efd->semaphore ? 1 : efd->count;
+            efd->count -= *out_value;
+            local_eventfd_changed(efd);
+            ret = sizeof(uint64_t);
+            break;
+        }
+        if (hdl->flags & O_NONBLOCK) {
+            ret = -EAGAIN;
+            break;
+        }
+
+        ret = local_eventfd_wait(efd);
+        if (ret < 0)
+            break;
+    }
+    unlock(&efd->lock);
+    return ret;
+}
+
+static ssize_t local_eventfd_write(struct shim_handle* hdl, uint64_t value) {
+    struct shim_local_eventfd* efd = hdl->info.eventfd.local;
+    ssize_t ret;
+
+    lock(&efd->lock);
+    while (true) {
+        if (efd->promoted) {
+            ret = -ELOCALEVENTFDPROMOTED;
+            break;
+        }
+        if (value <= EVENTFD_MAX_COUNT - efd->count) {
+            efd->count += value;
+            if (value)
+                local_eventfd_changed(efd);
+            ret = sizeof(uint64_t);
+            break;
+        }
+        if (hdl->flags & O_NONBLOCK) {
+            ret = -EAGAIN;
+            break;
+        }
+
+        ret = local_eventfd_wait(efd);
+        if (ret < 0)
+            break;
+    }
+    unlock(&efd->lock);
+    return ret;
+}
 
 static ssize_t eventfd_read(struct shim_handle* hdl, void* buf, size_t count) {
     if (count < sizeof(uint64_t))
         return -EINVAL;
 
+    if (hdl->info.eventfd.local) {
+        uint64_t value;
+        ssize_t ret = local_eventfd_read(hdl, &value);
+        if (ret != -ELOCALEVENTFDPROMOTED) {
+            if (ret >= 0)
+                memcpy(buf, &value, sizeof(value));
+            maybe_epoll_et_trigger(hdl, ret < 0 ? ret : 0, /*in=*/true, /*was_partial=*/false);
+            return ret;
+        }
+    }
+
+    if (!hdl->pal_handle)
+        return -EBADF;
+
     size_t orig_count = count;
     int ret = DkStreamRead(hdl->pal_handle, 0, &count, buf, NULL, 0);
     ret = pal_to_unix_errno(ret);
@@ -35,6 +209,22 @@ static ssize_t eventfd_write(struct shim_handle* hdl, const void* buf, size_t co
     if (count < sizeof(uint64_t))
         return -EINVAL;
 
+    if (hdl->info.eventfd.local) {
+        uint64_t value;
+        memcpy(&value, buf, sizeof(value));
+        if (value == UINT64_MAX)
+            return -EINVAL;
+
+        ssize_t ret = local_eventfd_write(hdl, value);
+        if (ret != -ELOCALEVENTFDPROMOTED) {
+            maybe_epoll_et_trigger(hdl, ret < 0 ? ret : 0, /*in=*/false, /*was_partial=*/false);
+            return ret;
+        }
+    }
+
+    if (!hdl->pal_handle)
+        return -EBADF;
+
     size_t orig_count = count;
     int ret = DkStreamWrite(hdl->pal_handle, 0, &count, (void*)buf, NULL);
     ret = pal_to_unix_errno(ret);
@@ -46,9 +236,35 @@ static ssize_t eventfd_write(struct shim_handle* hdl, const void* buf, size_t co
     return (ssize_t)count;
 }
 
+static off_t local_eventfd_poll(struct shim_handle* hdl, int poll_type) {
+    struct shim_local_eventfd* efd = hdl->info.eventfd.local;
+    off_t ret = 0;
+
+    lock(&efd->lock);
+    if (efd->promoted) {
+        ret = -ELOCALEVENTFDPROMOTED;
+    } else if (poll_type == FS_POLL_SZ) {
+        ret = efd->count ? sizeof(uint64_t) : 0;
+    } else {
+        PAL_FLG state = local_eventfd_state(efd);
+        if ((poll_type & FS_POLL_RD) && (state & PAL_WAIT_READ))
+            ret |= FS_POLL_RD;
+        if ((poll_type & FS_POLL_WR) && (state & PAL_WAIT_WRITE))
+            ret |= FS_POLL_WR;
+    }
+    unlock(&efd->lock);
+    return ret;
+}
+
 static off_t eventfd_poll(struct shim_handle* hdl, int poll_type) {
     off_t ret = 0;
 
+    if (hdl->info.eventfd.local) {
+        ret = local_eventfd_poll(hdl, poll_type);
+        if (ret != -ELOCALEVENTFDPROMOTED)
+            return ret;
+    }
+
     lock(&hdl->lock);
 
     if (!hdl->pal_handle) {
@@ -81,10 +297,172 @@ out:
     return ret;
 }
 
+static int eventfd_poll_get(struct shim_handle* hdl, PAL_FLG events, PAL_HANDLE* out_event) {
+    assert(hdl->type == TYPE_EVENTFD);
+    struct shim_local_eventfd* efd = hdl->info.eventfd.local;
+    if (!efd) {
+        *out_event = NULL;
+        return 0;
+    }
+
+    int ret = 0;
+    lock(&efd->lock);
+    if (efd->promoted) {
+        *out_event = NULL;
+    } else {
+        ret = poll_notifier_get(&efd->notifier, events, out_event);
+    }
+    unlock(&efd->lock);
+    return ret;
+}
+
+static void eventfd_poll_put(struct shim_handle* hdl, PAL_FLG events) {
+    assert(hdl->type == TYPE_EVENTFD && hdl->info.eventfd.local);
+    struct shim_local_eventfd* efd = hdl->info.eventfd.local;
+
+    lock(&efd->lock);
+    poll_notifier_put(&efd->notifier, events);
+    unlock(&efd->lock);
+}
+
+static int eventfd_setflags(struct shim_handle* hdl, int flags) {
+    /* local eventfds check `hdl->flags` on each operation */
+    if (!hdl->pal_handle)
+        return 0;
+
+    PAL_STREAM_ATTR attr;
+    int ret = DkStreamAttributesQueryByHandle(hdl->pal_handle, &attr);
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+
+    bool nonblocking = !!(flags & O_NONBLOCK);
+    if (!!attr.nonblocking == nonblocking)
+        return 0;
+
+    attr.nonblocking = nonblocking ? PAL_TRUE : PAL_FALSE;
+    ret = DkStreamAttributesSetByHandle(hdl->pal_handle, &attr);
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+    return 0;
+}
+
+static int eventfd_close(struct shim_handle* hdl) {
+    assert(hdl->type == TYPE_EVENTFD);
+    struct shim_local_eventfd* efd = hdl->info.eventfd.local;
+    if (!efd)
+        return 0;
+
+    assert(LISTP_EMPTY(&efd->waiters));
+    poll_notifier_destroy(&efd->notifier);
+    destroy_lock(&efd->lock);
+    free(efd);
+    hdl->info.eventfd.local = NULL;
+    return 0;
+}
+
+static bool host_eventfd_allowed(void) {
+    assert(g_manifest_root);
+    bool allow_eventfd;
+    int ret = manifest_bool_in(g_manifest_root, "sys.insecure__allow_eventfd",
+                               /*defaultval=*/false, &allow_eventfd);
+    if (ret < 0) {
+        log_error("Cannot parse \'sys.insecure__allow_eventfd\' (the value must be `true` or "
+                  "`false`)");
+        return false;
+    }
+    return allow_eventfd;
+}
+
+/* Moves the counter of a local eventfd to a new host eventfd, which is used by the handle from now
+ * on (and can be sent to a child process). */
+static int promote_local_eventfd(struct shim_handle* hdl) {
+    struct shim_local_eventfd* efd = hdl->info.eventfd.local;
+    PAL_HANDLE host = NULL;
+    int ret;
+
+    lock(&efd->lock);
+    if (efd->promoted) {
+        unlock(&efd->lock);
+        return 0;
+    }
+
+    int options = hdl->flags & O_NONBLOCK ? PAL_OPTION_NONBLOCK : 0;
+    options |= efd->semaphore ? PAL_OPTION_EFD_SEMAPHORE : 0;
+    ret = DkStreamOpen(URI_PREFIX_EVENTFD, /*access=*/0, /*share_flags=*/0, /*create=*/0, options,
+                       &host);
+    if (ret < 0) {
+        ret = pal_to_unix_errno(ret);
+        goto out;
+    }
+
+    if (efd->count) {
+        /* the host eventfd is empty, so this does not block */
+        size_t size = sizeof(efd->count);
+        ret = DkStreamWrite(host, /*offset=*/0, &size, &efd->count, /*dest=*/NULL);
+        if (ret < 0) {
+            ret = pal_to_unix_errno(ret);
+            goto out;
+        }
+    }
+
+    __atomic_store_n(&hdl->pal_handle, host, __ATOMIC_RELEASE);
+    host = NULL;
+    efd->promoted = true;
+    local_eventfd_changed(efd);
+    ret = 0;
+
+out:
+    unlock(&efd->lock);
+    if (host)
+        DkObjectClose(host);
+
+    if (ret == 0) {
+        /* epoll items switch from the notifier events to the host eventfd */
+        lock(&hdl->lock);
+        _update_epolls(hdl);
+        unlock(&hdl->lock);
+    }
+    return ret;
+}
+
+int __promote_local_eventfds(struct shim_handle_map* map) {
+    assert(locked(&map->lock));
+
+    if (map->fd_top == FD_NULL)
+        return 0;
+
+    for (FDTYPE fd = 0; fd <= map->fd_top; fd++) {
+        if (!HANDLE_ALLOCATED(map->map[fd]))
+            continue;
+
+        struct shim_handle* hdl = map->map[fd]->handle;
+        if (hdl->type != TYPE_EVENTFD || !hdl->info.eventfd.local)
+            continue;
+
+        if (!host_eventfd_allowed()) {
+            /* the eventfd keeps working in this process, but the child cannot use it */
+            log_warning("eventfd is not shared with the child process (sharing requires "
+                        "'sys.insecure__allow_eventfd')");
+            continue;
+        }
+
+        int ret = promote_local_eventfd(hdl);
+        if (ret < 0) {
+            log_error("Failed to promote local eventfds to host eventfds: %d", ret);
+            return ret;
+        }
+    }
+    return 0;
+}
+
 struct shim_fs_ops eventfd_fs_ops = {
-    .read  = &eventfd_read,
-    .write = &eventfd_write,
-    .poll  = &eventfd_poll,
+    .read     = &eventfd_read,
+    .write    = &eventfd_write,
+    .close    = &eventfd_close,
+    .setflags = &eventfd_setflags,
+    .poll     = &eventfd_poll,
+    .poll_get = &eventfd_poll_get,
+    .poll_put = &eventfd_poll_put,
 };
 
 struct shim_fs eventfd_builtin_fs = {
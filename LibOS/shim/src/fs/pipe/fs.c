@@ -17,10 +17,12 @@
 #include "shim_fs.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
+#include "shim_local_pipe.h"
 #include "shim_lock.h"
 #include "shim_process.h"
 #include "shim_signal.h"
 #include "shim_thread.h"
+#include "shim_utils.h"
 #include "stat.h"
 
 static ssize_t pipe_read(struct shim_handle* hdl, void* buf, size_t count) {
@@ -28,6 +30,13 @@ static ssize_t pipe_read(struct shim_handle* hdl, void* buf, size_t count) {
     if (!hdl->info.pipe.ready_for_ops)
         return -EACCES;
 
+    if (hdl->info.pipe.local) {
+        struct iovec iov = {.iov_base = buf, .iov_len = count};
+        ssize_t ret = local_pipe_read(hdl, &iov, 1, /*peek=*/false, hdl->flags & O_NONBLOCK);
+        if (ret != -ELOCALPIPEPROMOTED)
+            return ret;
+    }
+
     size_t orig_count = count;
     int ret = DkStreamRead(hdl->pal_handle, 0, &count, buf, NULL, 0);
     ret = pal_to_unix_errno(ret);
@@ -39,26 +48,109 @@ static ssize_t pipe_read(struct shim_handle* hdl, void* buf, size_t count) {
     return (ssize_t)count;
 }
 
+static ssize_t pipe_readv(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt) {
+    assert(hdl->type == TYPE_PIPE);
+    if (!hdl->info.pipe.ready_for_ops)
+        return -EACCES;
+
+    if (hdl->info.pipe.local) {
+        ssize_t ret = local_pipe_read(hdl, iov, iov_cnt, /*peek=*/false, hdl->flags & O_NONBLOCK);
+        if (ret != -ELOCALPIPEPROMOTED)
+            return ret;
+    }
+
+    ssize_t ret = pal_stream_iov_io(hdl->pal_handle, PAL_IO_READ, /*offset=*/0, iov, iov_cnt);
+    if (ret < 0)
+        ret = pal_to_unix_errno(ret);
+    maybe_epoll_et_trigger(hdl, ret < 0 ? ret : 0, /*in=*/true,
+                           ret >= 0 ? (size_t)ret < iov_total_len(iov, iov_cnt) : false);
+    return ret;
+}
+
+static void pipe_write_failed(int err) {
+    if (err == -EPIPE) {
+        siginfo_t info = {
+            .si_signo = SIGPIPE,
+            .si_pid = g_process.pid,
+            .si_code = SI_USER,
+        };
+        if (kill_current_proc(&info) < 0) {
+            log_error("pipe_write: failed to deliver a signal");
+        }
+    }
+}
+
 static ssize_t pipe_write(struct shim_handle* hdl, const void* buf, size_t count) {
     assert(hdl->type == TYPE_PIPE);
     if (!hdl->info.pipe.ready_for_ops)
         return -EACCES;
 
+    if (hdl->info.pipe.local) {
+        struct iovec iov = {.iov_base = (void*)buf, .iov_len = count};
+        ssize_t ret = local_pipe_write(hdl, &iov, 1, hdl->flags & O_NONBLOCK);
+        if (ret != -ELOCALPIPEPROMOTED) {
+            pipe_write_failed(ret);
+            return ret;
+        }
+    }
+
     size_t orig_count = count;
     int ret = DkStreamWrite(hdl->pal_handle, 0, &count, (void*)buf, NULL);
     ret = pal_to_unix_errno(ret);
     maybe_epoll_et_trigger(hdl, ret, /*in=*/false, ret == 0 ? count < orig_count : false);
     if (ret < 0) {
-        if (ret == -EPIPE) {
-            siginfo_t info = {
-                .si_signo = SIGPIPE,
-                .si_pid = g_process.pid,
-                .si_code = SI_USER,
-            };
-            if (kill_current_proc(&info) < 0) {
-                log_error("pipe_write: failed to deliver a signal");
-            }
+        pipe_write_failed(ret);
+        return ret;
+    }
+
+    return (ssize_t)count;
+}
+
+static ssize_t pipe_writev(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt) {
+    assert(hdl->type == TYPE_PIPE);
+    if (!hdl->info.pipe.ready_for_ops)
+        return -EACCES;
+
+    if (hdl->info.pipe.local) {
+        ssize_t ret = local_pipe_write(hdl, iov, iov_cnt, hdl->flags & O_NONBLOCK);
+        if (ret != -ELOCALPIPEPROMOTED) {
+            pipe_write_failed(ret);
+            return ret;
         }
+    }
+
+    ssize_t ret = pal_stream_iov_io(hdl->pal_handle, PAL_IO_WRITE, /*offset=*/0, iov, iov_cnt);
+    if (ret < 0)
+        ret = pal_to_unix_errno(ret);
+    maybe_epoll_et_trigger(hdl, ret < 0 ? ret : 0, /*in=*/false,
+                           ret >= 0 ? (size_t)ret < iov_total_len(iov, iov_cnt) : false);
+    if (ret < 0)
+        pipe_write_failed(ret);
+    return ret;
+}
+
+static ssize_t pipe_write_from(struct shim_handle* hdl, PAL_HANDLE src, off_t src_pos,
+                               size_t count, const off_t* pos) {
+    assert(hdl->type == TYPE_PIPE);
+    assert(!pos);
+    __UNUSED(pos);
+    if (!hdl->info.pipe.ready_for_ops)
+        return -EACCES;
+
+    if (hdl->info.pipe.local) {
+        ssize_t ret = local_pipe_write_from(hdl, src, src_pos, count);
+        if (ret != -ELOCALPIPEPROMOTED) {
+            pipe_write_failed(ret);
+            return ret;
+        }
+    }
+
+    size_t orig_count = count;
+    int ret = DkStreamTransfer(src, src_pos, hdl->pal_handle, /*dst_offset=*/0, &count);
+    ret = pal_to_unix_errno(ret);
+    maybe_epoll_et_trigger(hdl, ret, /*in=*/false, ret == 0 ? count < orig_count : false);
+    if (ret < 0) {
+        pipe_write_failed(ret);
         return ret;
     }
 
@@ -70,10 +162,17 @@ static int pipe_hstat(struct shim_handle* hdl, struct stat* stat) {
      * Shouldn't we be using hdl to figure something out?
      * if stat is NULL, should we not return -EFAULT?
      */
-    __UNUSED(hdl);
     if (!stat)
         return 0;
 
+    off_t size = 0;
+    if (hdl->type == TYPE_PIPE && hdl->info.pipe.local) {
+        /* pending data, for FIONREAD */
+        size = local_pipe_poll(hdl, FS_POLL_SZ);
+        if (size < 0)
+            size = 0;
+    }
+
     struct shim_thread* thread = get_cur_thread();
 
     stat->st_dev     = (dev_t)0;           /* ID of device containing file */
@@ -82,7 +181,7 @@ static int pipe_hstat(struct shim_handle* hdl, struct stat* stat) {
     stat->st_uid     = (uid_t)thread->uid; /* user ID of owner */
     stat->st_gid     = (gid_t)thread->gid; /* group ID of owner */
     stat->st_rdev    = (dev_t)0;           /* device ID (if special file) */
-    stat->st_size    = (off_t)0;           /* total size, in bytes */
+    stat->st_size    = size;               /* total size, in bytes */
     stat->st_blksize = 0;                  /* blocksize for file system I/O */
     stat->st_blocks  = 0;                  /* number of 512B blocks allocated */
     stat->st_atime   = (time_t)0;          /* access time */
@@ -102,6 +201,12 @@ static off_t pipe_poll(struct shim_handle* hdl, int poll_type) {
 
     lock(&hdl->lock);
 
+    if (hdl->info.pipe.local) {
+        ret = local_pipe_poll(hdl, poll_type);
+        if (ret != -ELOCALPIPEPROMOTED)
+            goto out;
+    }
+
     if (!hdl->pal_handle) {
         ret = -EBADF;
         goto out;
@@ -132,6 +237,27 @@ out:
     return ret;
 }
 
+static int pipe_poll_get(struct shim_handle* hdl, PAL_FLG events, PAL_HANDLE* out_event) {
+    assert(hdl->type == TYPE_PIPE);
+    if (!hdl->info.pipe.local) {
+        *out_event = NULL;
+        return 0;
+    }
+    return local_pipe_poll_get(hdl, events, out_event);
+}
+
+static void pipe_poll_put(struct shim_handle* hdl, PAL_FLG events) {
+    assert(hdl->type == TYPE_PIPE && hdl->info.pipe.local);
+    local_pipe_poll_put(hdl, events);
+}
+
+static int pipe_close(struct shim_handle* hdl) {
+    assert(hdl->type == TYPE_PIPE);
+    if (hdl->info.pipe.local)
+        local_pipe_close(hdl);
+    return 0;
+}
+
 static int pipe_setflags(struct shim_handle* hdl, int flags) {
     if (!hdl->pal_handle)
         return 0;
@@ -237,18 +363,27 @@ static int fifo_open(struct shim_handle* hdl, struct shim_dentry* dent, int flag
 }
 
 static struct shim_fs_ops pipe_fs_ops = {
-    .read     = &pipe_read,
-    .write    = &pipe_write,
-    .hstat    = &pipe_hstat,
-    .poll     = &pipe_poll,
-    .setflags = &pipe_setflags,
+    .close      = &pipe_close,
+    .read       = &pipe_read,
+    .write      = &pipe_write,
+    .readv      = &pipe_readv,
+    .writev     = &pipe_writev,
+    .write_from = &pipe_write_from,
+    .hstat      = &pipe_hstat,
+    .poll       = &pipe_poll,
+    .poll_get   = &pipe_poll_get,
+    .poll_put   = &pipe_poll_put,
+    .setflags   = &pipe_setflags,
 };
 
 static struct shim_fs_ops fifo_fs_ops = {
-    .read     = &pipe_read,
-    .write    = &pipe_write,
-    .poll     = &pipe_poll,
-    .setflags = &pipe_setflags,
+    .read       = &pipe_read,
+    .write      = &pipe_write,
+    .readv      = &pipe_readv,
+    .writev     = &pipe_writev,
+    .write_from = &pipe_write_from,
+    .poll       = &pipe_poll,
+    .setflags   = &pipe_setflags,
 };
 
 static struct shim_d_ops fifo_d_ops = {
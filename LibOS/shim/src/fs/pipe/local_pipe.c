@@ -0,0 +1,640 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Pipes and socketpairs emulated inside the LibOS, see shim_local_pipe.h.
+ */
+
+#include <asm/fcntl.h>
+#include <errno.h>
+
+#include "list.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "shim_fs.h"
+#include "shim_handle.h"
+#include "shim_internal.h"
+#include "shim_local_pipe.h"
+#include "shim_lock.h"
+#include "shim_thread.h"
+#include "shim_utils.h"
+
+/* writes of up to this size are atomic (PIPE_BUF of Linux) */
+#define LOCAL_PIPE_ATOMIC_SIZE 4096
+
+struct local_pipe_ring {
+    char* buf;     /* LOCAL_PIPE_CAPACITY bytes, allocated on the first write */
+    uint64_t head; /* total number of bytes read from the ring */
+    uint64_t tail; /* total number of bytes written to the ring */
+};
+
+DEFINE_LIST(local_pipe_waiter);
+struct local_pipe_waiter {
+    struct shim_thread* thread;
+    LIST_TYPE(local_pipe_waiter) list;
+};
+DEFINE_LISTP(local_pipe_waiter);
+
+struct shim_local_pipe_end {
+    struct shim_local_pipe* pipe;
+    struct shim_handle* hdl;    /* not ref-counted; NULL after the end is closed */
+    struct local_pipe_ring* rx; /* NULL if this end cannot read */
+    struct local_pipe_ring* tx; /* NULL if this end cannot write */
+    bool shut_rd;
+    bool shut_wr;
+    struct shim_poll_notifier notifier;
+};
+
+struct shim_local_pipe {
+    /* protects all fields below; never held while taking the lock of a handle */
+    struct shim_lock lock;
+    bool promoted;
+    size_t open_ends;
+    struct local_pipe_ring rings[2];
+    struct shim_local_pipe_end ends[2];
+    /* threads blocked in read or write on any of the ends; all of them are woken on every change */
+    LISTP_TYPE(local_pipe_waiter) waiters;
+};
+
+static struct shim_local_pipe_end* get_end(struct shim_handle* hdl) {
+    assert(hdl->type == TYPE_PIPE || hdl->type == TYPE_SOCK);
+    return hdl->type == TYPE_PIPE ? hdl->info.pipe.local : hdl->info.sock.local;
+}
+
+static void set_end(struct shim_handle* hdl, struct shim_local_pipe_end* end) {
+    assert(hdl->type == TYPE_PIPE || hdl->type == TYPE_SOCK);
+    if (hdl->type == TYPE_PIPE) {
+        hdl->info.pipe.local = end;
+    } else {
+        hdl->info.sock.local = end;
+    }
+}
+
+static struct shim_local_pipe_end* get_peer(struct shim_local_pipe_end* end) {
+    struct shim_local_pipe* pipe = end->pipe;
+    return end == &pipe->ends[0] ? &pipe->ends[1] : &pipe->ends[0];
+}
+
+static size_t ring_used(struct local_pipe_ring* ring) {
+    return ring->tail - ring->head;
+}
+
+/* Nothing more can be received by `end` than what is already in its ring. */
+static bool rx_closed(struct shim_local_pipe_end* end) {
+    struct shim_local_pipe_end* peer = get_peer(end);
+    return end->shut_rd || !peer->hdl || peer->shut_wr;
+}
+
+/* Nothing can be sent by `end` anymore. */
+static bool tx_closed(struct shim_local_pipe_end* end) {
+    struct shim_local_pipe_end* peer = get_peer(end);
+    return end->shut_wr || !peer->hdl || peer->shut_rd;
+}
+
+static PAL_FLG end_state(struct shim_local_pipe_end* end) {
+    PAL_FLG state = 0;
+    if (end->rx && (ring_used(end->rx) || rx_closed(end)))
+        state |= PAL_WAIT_READ;
+    if (end->tx && (ring_used(end->tx) < LOCAL_PIPE_CAPACITY || tx_closed(end)))
+        state |= PAL_WAIT_WRITE;
+    if (!get_peer(end)->hdl)
+        state |= PAL_WAIT_ERROR;
+    return state;
+}
+
+/* Wakes up blocked readers and writers and pollers after any change of the pipe. */
+static void pipe_changed(struct shim_local_pipe* pipe) {
+    assert(locked(&pipe->lock));
+
+    struct local_pipe_waiter* waiter;
+    struct local_pipe_waiter* tmp;
+    LISTP_FOR_EACH_ENTRY_SAFE(waiter, tmp, &pipe->waiters, list) {
+        LISTP_DEL_INIT(waiter, &pipe->waiters, list);
+        thread_wakeup(waiter->thread);
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(pipe->ends); i++)
+        if (pipe->ends[i].hdl)
+            poll_notifier_set_state(&pipe->ends[i].notifier, end_state(&pipe->ends[i]));
+}
+
+/* Waits for the next change of the pipe. The pipe lock is released during the wait. */
+static int wait_for_change(struct shim_local_pipe* pipe) {
+    assert(locked(&pipe->lock));
+
+    thread_prepare_wait();
+
+    struct local_pipe_waiter waiter = {.thread = get_cur_thread()};
+    INIT_LIST_HEAD(&waiter, list);
+    LISTP_ADD_TAIL(&waiter, &pipe->waiters, list);
+
+    unlock(&pipe->lock);
+    int ret = thread_wait(/*timeout_us=*/NULL, /*ignore_pending_signals=*/false);
+    lock(&pipe->lock);
+
+    /* we are still on the list if we woke up because of a signal */
+    if (!LIST_EMPTY(&waiter, list))
+        LISTP_DEL_INIT(&waiter, &pipe->waiters, list);
+    return ret;
+}
+
+/* Copies `size` bytes between `buf` and the ring, starting at stream position `pos`. */
+static void ring_copy(struct local_pipe_ring* ring, uint64_t pos, char* buf, size_t size,
+                      bool to_ring) {
+    size_t off = pos % LOCAL_PIPE_CAPACITY;
+    size_t first = MIN(size, LOCAL_PIPE_CAPACITY - off);
+    if (to_ring) {
+        memcpy(ring->buf + off, buf, first);
+        memcpy(ring->buf, buf + first, size - first);
+    } else {
+        memcpy(buf, ring->buf + off, first);
+        memcpy(buf + first, ring->buf, size - first);
+    }
+}
+
+/* Copies `size` bytes between the ring (at stream position `pos`) and `iov`, skipping the first
+ * `skip` bytes of `iov`. */
+static void ring_copy_iov(struct local_pipe_ring* ring, uint64_t pos, const struct iovec* iov,
+                          size_t iov_cnt, size_t skip, size_t size, bool to_ring) {
+    for (size_t i = 0; i < iov_cnt && size; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        size_t n = MIN(iov[i].iov_len - skip, size);
+        ring_copy(ring, pos, (char*)iov[i].iov_base + skip, n, to_ring);
+        pos += n;
+        size -= n;
+        skip = 0;
+    }
+}
+
+int create_local_pipe(struct shim_handle* hdl0, struct shim_handle* hdl1, bool duplex) {
+    assert(!hdl0->pal_handle && !hdl1->pal_handle);
+
+    struct shim_local_pipe* pipe = calloc(1, sizeof(*pipe));
+    if (!pipe)
+        return -ENOMEM;
+
+    if (!create_lock(&pipe->lock)) {
+        free(pipe);
+        return -ENOMEM;
+    }
+    INIT_LISTP(&pipe->waiters);
+    pipe->open_ends = 2;
+
+    struct shim_handle* hdls[2] = {hdl0, hdl1};
+    for (size_t i = 0; i < ARRAY_SIZE(pipe->ends); i++) {
+        pipe->ends[i].pipe = pipe;
+        pipe->ends[i].hdl = hdls[i];
+    }
+
+    pipe->ends[0].rx = &pipe->rings[0];
+    pipe->ends[1].tx = &pipe->rings[0];
+    if (duplex) {
+        pipe->ends[1].rx = &pipe->rings[1];
+        pipe->ends[0].tx = &pipe->rings[1];
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(pipe->ends); i++) {
+        pipe->ends[i].notifier.state = end_state(&pipe->ends[i]);
+        set_end(hdls[i], &pipe->ends[i]);
+    }
+    return 0;
+}
+
+ssize_t local_pipe_read(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt,
+                        bool peek, bool nonblocking) {
+    struct shim_local_pipe_end* end = get_end(hdl);
+    struct shim_local_pipe* pipe = end->pipe;
+    size_t count = iov_total_len(iov, iov_cnt);
+    ssize_t ret;
+
+    lock(&pipe->lock);
+    while (true) {
+        if (pipe->promoted) {
+            ret = -ELOCALPIPEPROMOTED;
+            break;
+        }
+        if (!end->rx) {
+            ret = -EBADF;
+            break;
+        }
+
+        size_t size = MIN(ring_used(end->rx), count);
+        if (size || !count) {
+            ring_copy_iov(end->rx, end->rx->head, iov, iov_cnt, /*skip=*/0, size,
+                          /*to_ring=*/false);
+            if (!peek) {
+                end->rx->head += size;
+                pipe_changed(pipe);
+            }
+            ret = size;
+            break;
+        }
+
+        if (rx_closed(end)) {
+            ret = 0;
+            break;
+        }
+        if (nonblocking) {
+            ret = -EAGAIN;
+            break;
+        }
+
+        ret = wait_for_change(pipe);
+        if (ret < 0)
+            break;
+    }
+    unlock(&pipe->lock);
+
+    if (ret != -ELOCALPIPEPROMOTED)
+        maybe_epoll_et_trigger(hdl, ret < 0 ? ret : 0, /*in=*/true,
+                               ret >= 0 ? (size_t)ret < count : false);
+    return ret;
+}
+
+ssize_t local_pipe_write(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt,
+                         bool nonblocking) {
+    struct shim_local_pipe_end* end = get_end(hdl);
+    struct shim_local_pipe* pipe = end->pipe;
+    size_t count = iov_total_len(iov, iov_cnt);
+    size_t done = 0;
+    ssize_t ret;
+
+    lock(&pipe->lock);
+    while (true) {
+        if (pipe->promoted) {
+            /* the data written so far was moved to the host pipe */
+            ret = -ELOCALPIPEPROMOTED;
+            break;
+        }
+        if (!end->tx) {
+            ret = -EBADF;
+            break;
+        }
+        if (tx_closed(end)) {
+            ret = -EPIPE;
+            break;
+        }
+        if (done == count) {
+            ret = 0;
+            break;
+        }
+
+        struct local_pipe_ring* ring = end->tx;
+        size_t space = LOCAL_PIPE_CAPACITY - ring_used(ring);
+        size_t left = count - done;
+        if (space && (count > LOCAL_PIPE_ATOMIC_SIZE || space >= left)) {
+            if (!ring->buf) {
+                ring->buf = malloc(LOCAL_PIPE_CAPACITY);
+                if (!ring->buf) {
+                    ret = -ENOMEM;
+                    break;
+                }
+            }
+            size_t size = MIN(space, left);
+            ring_copy_iov(ring, ring->tail, iov, iov_cnt, /*skip=*/done, size, /*to_ring=*/true);
+            ring->tail += size;
+            done += size;
+            pipe_changed(pipe);
+            continue;
+        }
+
+        if (nonblocking) {
+            ret = -EAGAIN;
+            break;
+        }
+
+        ret = wait_for_change(pipe);
+        if (ret < 0)
+            break;
+    }
+    unlock(&pipe->lock);
+
+    if (done)
+        ret = done;
+    if (ret != -ELOCALPIPEPROMOTED)
+        maybe_epoll_et_trigger(hdl, ret < 0 ? ret : 0, /*in=*/false,
+                               ret >= 0 ? (size_t)ret < count : false);
+    return ret;
+}
+
+ssize_t local_pipe_write_from(struct shim_handle* hdl, PAL_HANDLE src, off_t src_pos,
+                              size_t count) {
+    /* `src` is read at an explicit position, so the data which do not fit into the pipe are simply
+     * read again by the next call */
+    size_t size = MIN(count, (size_t)LOCAL_PIPE_CAPACITY);
+    char* buf = malloc(size);
+    if (!buf)
+        return -ENOMEM;
+
+    ssize_t ret = DkStreamRead(src, src_pos, &size, buf, /*source=*/NULL, /*size=*/0);
+    if (ret < 0) {
+        ret = pal_to_unix_errno(ret);
+    } else if (size) {
+        struct iovec iov = {.iov_base = buf, .iov_len = size};
+        ret = local_pipe_write(hdl, &iov, 1, hdl->flags & O_NONBLOCK);
+    }
+    free(buf);
+    return ret;
+}
+
+off_t local_pipe_poll(struct shim_handle* hdl, int poll_type) {
+    struct shim_local_pipe_end* end = get_end(hdl);
+    struct shim_local_pipe* pipe = end->pipe;
+    off_t ret = 0;
+
+    lock(&pipe->lock);
+    if (pipe->promoted) {
+        ret = -ELOCALPIPEPROMOTED;
+    } else if (poll_type == FS_POLL_SZ) {
+        ret = end->rx ? ring_used(end->rx) : 0;
+    } else {
+        PAL_FLG state = end_state(end);
+        if (state & PAL_WAIT_ERROR)
+            ret |= FS_POLL_ER;
+        if ((poll_type & FS_POLL_RD) && (state & PAL_WAIT_READ))
+            ret |= FS_POLL_RD;
+        if ((poll_type & FS_POLL_WR) && (state & PAL_WAIT_WRITE))
+            ret |= FS_POLL_WR;
+    }
+    unlock(&pipe->lock);
+    return ret;
+}
+
+int local_pipe_poll_get(struct shim_handle* hdl, PAL_FLG events, PAL_HANDLE* out_event) {
+    struct shim_local_pipe_end* end = get_end(hdl);
+    struct shim_local_pipe* pipe = end->pipe;
+    int ret = 0;
+
+    lock(&pipe->lock);
+    if (pipe->promoted) {
+        *out_event = NULL;
+    } else {
+        ret = poll_notifier_get(&end->notifier, events, out_event);
+    }
+    unlock(&pipe->lock);
+    return ret;
+}
+
+void local_pipe_poll_put(struct shim_handle* hdl, PAL_FLG events) {
+    struct shim_local_pipe_end* end = get_end(hdl);
+    struct shim_local_pipe* pipe = end->pipe;
+
+    lock(&pipe->lock);
+    poll_notifier_put(&end->notifier, events);
+    unlock(&pipe->lock);
+}
+
+int local_pipe_shutdown(struct shim_handle* hdl, bool shut_rd, bool shut_wr) {
+    struct shim_local_pipe_end* end = get_end(hdl);
+    struct shim_local_pipe* pipe = end->pipe;
+    int ret = 0;
+
+    lock(&pipe->lock);
+    if (pipe->promoted) {
+        ret = -ELOCALPIPEPROMOTED;
+    } else {
+        end->shut_rd |= shut_rd;
+        end->shut_wr |= shut_wr;
+        pipe_changed(pipe);
+    }
+    unlock(&pipe->lock);
+    return ret;
+}
+
+void local_pipe_close(struct shim_handle* hdl) {
+    struct shim_local_pipe_end* end = get_end(hdl);
+    struct shim_local_pipe* pipe = end->pipe;
+
+    lock(&pipe->lock);
+    assert(end->hdl == hdl);
+    end->hdl = NULL;
+    poll_notifier_destroy(&end->notifier);
+    bool last = --pipe->open_ends == 0;
+    if (!last)
+        pipe_changed(pipe);
+    unlock(&pipe->lock);
+
+    if (last) {
+        for (size_t i = 0; i < ARRAY_SIZE(pipe->rings); i++)
+            free(pipe->rings[i].buf);
+        destroy_lock(&pipe->lock);
+        free(pipe);
+    }
+}
+
+static int set_host_nonblocking(PAL_HANDLE host, bool nonblocking) {
+    PAL_STREAM_ATTR attr;
+    int ret = DkStreamAttributesQueryByHandle(host, &attr);
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+    attr.nonblocking = nonblocking ? PAL_TRUE : PAL_FALSE;
+    ret = DkStreamAttributesSetByHandle(host, &attr);
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+    return 0;
+}
+
+/* Writes all data buffered in the ring to `host`, which must be non-blocking: nobody reads the
+ * other end yet, so a full host pipe fails the promotion with -EAGAIN instead of blocking forever.
+ * The ring itself is not modified, so on failure the pipe stays local with all its data. */
+static int flush_ring(struct local_pipe_ring* ring, PAL_HANDLE host) {
+    uint64_t pos = ring->head;
+    while (pos != ring->tail) {
+        size_t off = pos % LOCAL_PIPE_CAPACITY;
+        size_t size = MIN(ring->tail - pos, LOCAL_PIPE_CAPACITY - off);
+        int ret = DkStreamWrite(host, /*offset=*/0, &size, ring->buf + off, /*dest=*/NULL);
+        if (ret < 0) {
+            if (ret == -PAL_ERROR_INTERRUPTED)
+                continue;
+            return pal_to_unix_errno(ret);
+        }
+        pos += size;
+    }
+    return 0;
+}
+
+/* Applies the state of a local pipe end to the corresponding host pipe end. */
+static int setup_host_end(struct shim_local_pipe_end* end, PAL_HANDLE host) {
+    int ret;
+    if (end->shut_rd || end->shut_wr) {
+        ret = DkStreamDelete(host, end->shut_rd && end->shut_wr ? 0
+                                   : end->shut_rd ? PAL_DELETE_RD : PAL_DELETE_WR);
+        if (ret < 0)
+            return pal_to_unix_errno(ret);
+    }
+
+    /* the host end may still be non-blocking from `flush_ring` */
+    return set_host_nonblocking(host, end->hdl->flags & O_NONBLOCK);
+}
+
+static int promote_local_pipe(struct shim_local_pipe* pipe) {
+    PAL_HANDLE host[2] = {NULL, NULL};
+    struct shim_handle* pinned[2] = {NULL, NULL};
+    char name[PIPE_URI_SIZE];
+    char uri[PIPE_URI_SIZE];
+    int ret;
+
+    lock(&pipe->lock);
+    if (pipe->promoted) {
+        unlock(&pipe->lock);
+        return 0;
+    }
+
+    /* the accepted host end goes to end 0, which is the read end of a pipe (as in `pipe2`) */
+    ret = create_host_pipes(name, uri, sizeof(uri), /*pal_options=*/0, &host[0], &host[1]);
+    if (ret < 0) {
+        host[0] = host[1] = NULL;
+        goto out;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(pipe->ends); i++) {
+        struct shim_local_pipe_end* end = &pipe->ends[i];
+        if (end->tx && ring_used(end->tx)) {
+            ret = set_host_nonblocking(host[i], /*nonblocking=*/true);
+            if (ret < 0)
+                goto out;
+            ret = flush_ring(end->tx, host[i]);
+            if (ret < 0) {
+                if (ret == -EAGAIN)
+                    log_warning("Cannot move the data of a local pipe to a host pipe");
+                goto out;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(pipe->ends); i++) {
+        struct shim_local_pipe_end* end = &pipe->ends[i];
+        if (!end->hdl) {
+            /* the data written by a closed end is already in the host pipe, the peer gets EOF */
+            DkObjectClose(host[i]);
+            host[i] = NULL;
+            continue;
+        }
+        ret = setup_host_end(end, host[i]);
+        if (ret < 0)
+            goto out;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(pipe->ends); i++) {
+        struct shim_local_pipe_end* end = &pipe->ends[i];
+        if (!end->hdl)
+            continue;
+
+        /* The handle owns the host end from now on. Operations which find the pipe promoted (under
+         * the pipe lock) continue on `pal_handle`, so it is set here and not later under the
+         * handle lock. A handle that is being closed (the close is waiting for the pipe lock) does
+         * not need anything else. */
+        __atomic_store_n(&end->hdl->pal_handle, host[i], __ATOMIC_RELEASE);
+        host[i] = NULL;
+        if (REF_INC_NOT_ZERO(end->hdl->ref_count))
+            pinned[i] = end->hdl;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(pipe->rings); i++) {
+        free(pipe->rings[i].buf);
+        pipe->rings[i].buf = NULL;
+    }
+    pipe->promoted = true;
+    pipe_changed(pipe);
+    /* wake up all pollers, they have to wait on the host pipe now */
+    for (size_t i = 0; i < ARRAY_SIZE(pipe->ends); i++)
+        if (pipe->ends[i].hdl)
+            poll_notifier_set_state(&pipe->ends[i].notifier, PAL_WAIT_ERROR);
+    ret = 0;
+
+out:
+    unlock(&pipe->lock);
+
+    for (size_t i = 0; i < ARRAY_SIZE(host); i++)
+        if (host[i])
+            DkObjectClose(host[i]);
+
+    for (size_t i = 0; i < ARRAY_SIZE(pinned); i++) {
+        struct shim_handle* hdl = pinned[i];
+        if (!hdl)
+            continue;
+
+        lock(&hdl->lock);
+        if (hdl->type == TYPE_PIPE) {
+            memcpy(hdl->info.pipe.name, name, sizeof(hdl->info.pipe.name));
+        } else {
+            memcpy(hdl->info.sock.addr.un.name, name, sizeof(hdl->info.sock.addr.un.name));
+        }
+        qstrsetstr(&hdl->uri, uri, strlen(uri));
+        /* epoll items switch from the notifier events to the host pipe */
+        _update_epolls(hdl);
+        unlock(&hdl->lock);
+        put_handle(hdl);
+    }
+    return ret;
+}
+
+static struct shim_local_pipe_end* local_end_of(struct shim_handle* hdl) {
+    if (hdl->type != TYPE_PIPE && hdl->type != TYPE_SOCK)
+        return NULL;
+    return get_end(hdl);
+}
+
+/* Promotes the local pipes of handles monitored by `epoll_hdl`: the handles are checkpointed with
+ * the epoll even if their FDs are already closed. */
+static int promote_epoll_items(struct shim_handle* epoll_hdl) {
+    struct shim_epoll_handle* epoll = &epoll_hdl->info.epoll;
+    struct shim_handle** hdls = NULL;
+    size_t count = 0;
+
+    lock(&epoll_hdl->lock);
+    if (epoll->fds_count) {
+        hdls = malloc(epoll->fds_count * sizeof(*hdls));
+        if (!hdls) {
+            unlock(&epoll_hdl->lock);
+            return -ENOMEM;
+        }
+    }
+    struct shim_epoll_item* item;
+    LISTP_FOR_EACH_ENTRY(item, &epoll->fds, list) {
+        /* the handle is not referenced by the item, it might be being freed */
+        if (local_end_of(item->handle) && REF_INC_NOT_ZERO(item->handle->ref_count))
+            hdls[count++] = item->handle;
+    }
+    unlock(&epoll_hdl->lock);
+
+    /* the epoll lock cannot be held here: promotion takes the locks of the handles and then
+     * updates their epolls */
+    int ret = 0;
+    for (size_t i = 0; i < count; i++) {
+        struct shim_local_pipe_end* end = local_end_of(hdls[i]);
+        if (!ret && end)
+            ret = promote_local_pipe(end->pipe);
+        put_handle(hdls[i]);
+    }
+    free(hdls);
+    return ret;
+}
+
+int __promote_local_pipes(struct shim_handle_map* map) {
+    assert(locked(&map->lock));
+
+    if (map->fd_top == FD_NULL)
+        return 0;
+
+    for (FDTYPE fd = 0; fd <= map->fd_top; fd++) {
+        if (!HANDLE_ALLOCATED(map->map[fd]))
+            continue;
+
+        struct shim_handle* hdl = map->map[fd]->handle;
+        struct shim_local_pipe_end* end = local_end_of(hdl);
+        int ret = 0;
+        if (end) {
+            ret = promote_local_pipe(end->pipe);
+        } else if (hdl->type == TYPE_EPOLL) {
+            ret = promote_epoll_items(hdl);
+        }
+        if (ret < 0) {
+            log_error("Failed to promote local pipes to host pipes: %d", ret);
+            return ret;
+        }
+    }
+    return 0;
+}
@@ -48,6 +48,11 @@ int init_procfs(void) {
 
     pseudo_add_str(root, "meminfo", &proc_meminfo_load);
     pseudo_add_str(root, "cpuinfo", &proc_cpuinfo_load);
+    pseudo_add_str(root, "slabinfo", &proc_slabinfo_load);
+    if (g_pal_control->stats)
+        pseudo_add_str(root, "pal_stats", &proc_pal_stats_load);
+    pseudo_add_str(root, "page_cache", &proc_page_cache_load);
+    pseudo_add_str(root, "sync_stats", &proc_sync_stats_load);
 
     pseudo_add_link(root, "self", &proc_self_follow_link);
 
@@ -4,11 +4,14 @@
 /*!
  * \file
  *
- * This file contains the implementation of `/proc/meminfo` and `/proc/cpuinfo`.
+ * This file contains the implementation of `/proc/meminfo`, `/proc/cpuinfo`, `/proc/slabinfo`,
+ * `/proc/pal_stats`, `/proc/page_cache` and `/proc/sync_stats`.
  */
 
 #include "shim_fs.h"
+#include "shim_fs_page_cache.h"
 #include "shim_fs_pseudo.h"
+#include "shim_sync.h"
 #include "stat.h"
 
 int proc_meminfo_load(struct shim_dentry* dent, char** out_data, size_t* out_size) {
@@ -137,3 +140,194 @@ int proc_cpuinfo_load(struct shim_dentry* dent, char** out_data, size_t* out_siz
     *out_size = size;
     return 0;
 }
+
+/* Statistics of the LibOS-internal allocator, one line per size class (see shim_malloc.c). */
+int proc_slabinfo_load(struct shim_dentry* dent, char** out_data, size_t* out_size) {
+    __UNUSED(dent);
+
+    struct shim_slab_stats stats[16];
+    size_t count = get_slab_stats(stats, ARRAY_SIZE(stats));
+
+    size_t size = 0;
+    size_t max = 128;
+    char* str = malloc(max);
+    if (!str) {
+        return -ENOMEM;
+    }
+
+    int ret = print_to_str(&str, size, &max, "# name      <allocs> <frees> <slab_objs> "
+                           "<depot_magazines> <depot_gets> <depot_puts>\n");
+    if (ret < 0)
+        goto err;
+    size += ret;
+
+    for (size_t i = 0; i < count; i++) {
+        char name[16];
+        if (stats[i].obj_size)
+            snprintf(name, sizeof(name), "size-%lu", stats[i].obj_size);
+        else
+            snprintf(name, sizeof(name), "large");
+
+        ret = print_to_str(&str, size, &max, "%-10s %lu %lu %lu %lu %lu %lu\n", name,
+                           stats[i].allocs, stats[i].frees, stats[i].slab_objs,
+                           stats[i].depot_magazines, stats[i].depot_gets, stats[i].depot_puts);
+        if (ret < 0)
+            goto err;
+        size += ret;
+    }
+
+    *out_data = str;
+    *out_size = size;
+    return 0;
+
+err:
+    free(str);
+    return ret;
+}
+
+static int print_pal_stats_entries(char** str, size_t* size, size_t* max, const char* kind,
+                                   const PAL_STATS_ENTRY* entries, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        const PAL_STATS_ENTRY* entry = &entries[i];
+        uint64_t calls = __atomic_load_n(&entry->count, __ATOMIC_RELAXED);
+        if (!calls || !entry->name)
+            continue;
+
+        int ret = print_to_str(str, *size, max, "%s %s %lu %lu", kind, entry->name, calls,
+                               __atomic_load_n(&entry->cycles, __ATOMIC_RELAXED));
+        if (ret < 0)
+            return ret;
+        *size += ret;
+
+        for (size_t j = 0; j < PAL_STATS_HIST_SIZE; j++) {
+            ret = print_to_str(str, *size, max, " %lu",
+                               __atomic_load_n(&entry->hist[j], __ATOMIC_RELAXED));
+            if (ret < 0)
+                return ret;
+            *size += ret;
+        }
+
+        ret = print_to_str(str, *size, max, "\n");
+        if (ret < 0)
+            return ret;
+        *size += ret;
+    }
+    return 0;
+}
+
+int proc_pal_stats_load(struct shim_dentry* dent, char** out_data, size_t* out_size) {
+    __UNUSED(dent);
+
+    const PAL_STATS* stats = g_pal_control->stats;
+    assert(stats);
+
+    size_t size = 0;
+    size_t max = 128;
+    char* str = malloc(max);
+    if (!str) {
+        return -ENOMEM;
+    }
+
+    /* histogram bucket `i` counts calls shorter than 2^i TSC cycles, see `PAL_STATS_ENTRY` */
+    int ret = print_to_str(&str, size, &max, "# tsc_hz %lu\n"
+                           "# kind name <count> <cycles> <hist0> ... <hist%d>\n", stats->tsc_hz,
+                           PAL_STATS_HIST_SIZE - 1);
+    if (ret < 0)
+        goto err;
+    size += ret;
+
+    ret = print_pal_stats_entries(&str, &size, &max, "call", stats->calls, stats->calls_cnt);
+    if (ret < 0)
+        goto err;
+    ret = print_pal_stats_entries(&str, &size, &max, "host", stats->host_calls,
+                                  stats->host_calls_cnt);
+    if (ret < 0)
+        goto err;
+
+    *out_data = str;
+    *out_size = size;
+    return 0;
+
+err:
+    free(str);
+    return ret;
+}
+
+int proc_page_cache_load(struct shim_dentry* dent, char** out_data, size_t* out_size) {
+    __UNUSED(dent);
+
+    struct page_cache_stats stats;
+    page_cache_get_stats(&stats);
+
+    /* in hundredths of a percent */
+    uint64_t lookups = stats.hits + stats.misses;
+    uint64_t hit_rate = lookups ? stats.hits * 10000 / lookups : 0;
+
+    size_t max = 256;
+    char* str = malloc(max);
+    if (!str) {
+        return -ENOMEM;
+    }
+
+    int ret = print_to_str(&str, 0, &max,
+                           "hits %lu\n"
+                           "misses %lu\n"
+                           "readahead %lu\n"
+                           "bypassed %lu\n"
+                           "evictions %lu\n"
+                           "writebacks %lu\n"
+                           "pages %lu\n"
+                           "dirty_pages %lu\n"
+                           "budget_pages %lu\n"
+                           "hit_rate %lu.%02lu%%\n",
+                           stats.hits, stats.misses, stats.readahead, stats.bypassed,
+                           stats.evictions, stats.writebacks, stats.pages, stats.dirty_pages,
+                           stats.budget_pages, hit_rate / 100, hit_rate % 100);
+    if (ret < 0) {
+        free(str);
+        return ret;
+    }
+
+    *out_data = str;
+    *out_size = ret;
+    return 0;
+}
+
+int proc_sync_stats_load(struct shim_dentry* dent, char** out_data, size_t* out_size) {
+    __UNUSED(dent);
+
+    struct sync_stats stats = {0};
+    sync_client_get_stats(&stats);
+    sync_server_get_stats(&stats);
+
+    /* in thousandths */
+    uint64_t round_trips_per_lock = stats.locks ? stats.upgrade_requests * 1000 / stats.locks : 0;
+
+    size_t max = 256;
+    char* str = malloc(max);
+    if (!str) {
+        return -ENOMEM;
+    }
+
+    int ret = print_to_str(&str, 0, &max,
+                           "locks %lu\n"
+                           "upgrade_requests %lu\n"
+                           "prefetch_requests %lu\n"
+                           "prefetch_hits %lu\n"
+                           "downgrades %lu\n"
+                           "deferred_downgrades %lu\n"
+                           "extended_leases %lu\n"
+                           "round_trips_per_lock %lu.%03lu\n",
+                           stats.locks, stats.upgrade_requests, stats.prefetch_requests,
+                           stats.prefetch_hits, stats.downgrades, stats.deferred_downgrades,
+                           stats.extended_leases, round_trips_per_lock / 1000,
+                           round_trips_per_lock % 1000);
+    if (ret < 0) {
+        free(str);
+        return ret;
+    }
+
+    *out_data = str;
+    *out_size = ret;
+    return 0;
+}
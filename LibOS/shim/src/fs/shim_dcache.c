@@ -15,6 +15,7 @@
 #include "shim_internal.h"
 #include "shim_lock.h"
 #include "shim_types.h"
+#include "spinlock.h"
 #include "stat.h"
 
 static struct shim_lock dcache_mgr_lock;
@@ -34,6 +35,96 @@ static MEM_MGR dentry_mgr = NULL;
 
 struct shim_dentry* g_dentry_root = NULL;
 
+/* Number of active lockless readers (see `begin_dcache_lockless_read`). A dentry whose last
+ * reference is dropped while there are readers is put on `g_retired_dentries` instead of being
+ * freed, and the list is freed when the number of readers drops to zero. */
+static uint64_t g_dcache_readers = 0;
+
+static spinlock_t g_retired_dentries_lock = INIT_SPINLOCK_UNLOCKED;
+static struct shim_dentry* g_retired_dentries = NULL;
+
+/* Fibonacci hashing: `hash_name` is an additive hash, so its low bits alone are not uniform. */
+static size_t dentry_hash_bucket(struct shim_dentry_hash* hash, HASHTYPE name_hash) {
+    return (name_hash * 0x9e3779b97f4a7c15UL) >> (64 - hash->bits);
+}
+
+static struct shim_dentry_hash* alloc_dentry_hash(unsigned int bits) {
+    struct shim_dentry_hash* hash = calloc(1, sizeof(*hash)
+                                              + (1UL << bits) * sizeof(hash->buckets[0]));
+    if (!hash)
+        return NULL;
+    hash->bits = bits;
+    return hash;
+}
+
+static void free_dentry_hash(struct shim_dentry_hash* hash) {
+    while (hash) {
+        struct shim_dentry_hash* retired = hash->retired;
+        free(hash);
+        hash = retired;
+    }
+}
+
+/* Moves children of `dir` to a twice bigger hash table. Lockless readers of the old table may follow
+ * `hash_next` into a chain of the new one and miss a dentry, which only sends them to the slow
+ * path. */
+static void grow_dentry_hash(struct shim_dentry* dir) {
+    struct shim_dentry_hash* old_hash = dir->children_hash;
+    struct shim_dentry_hash* new_hash = alloc_dentry_hash(old_hash->bits + 1);
+    if (!new_hash) {
+        /* not fatal, the chains just get longer */
+        return;
+    }
+
+    for (size_t i = 0; i < (1UL << old_hash->bits); i++) {
+        struct shim_dentry* dent = old_hash->buckets[i];
+        while (dent) {
+            struct shim_dentry* next = dent->hash_next;
+            size_t bucket = dentry_hash_bucket(new_hash, dent->name_hash);
+            __atomic_store_n(&dent->hash_next, new_hash->buckets[bucket], __ATOMIC_RELEASE);
+            new_hash->buckets[bucket] = dent;
+            dent = next;
+        }
+    }
+
+    new_hash->retired = old_hash;
+    __atomic_store_n(&dir->children_hash, new_hash, __ATOMIC_RELEASE);
+}
+
+/* Makes sure `dir` has a hash table with room for one more child. The caller should hold
+ * `g_dcache_lock` (or be restoring from a checkpoint). */
+static int reserve_dentry_hash(struct shim_dentry* dir) {
+    if (!dir->children_hash) {
+        struct shim_dentry_hash* hash = alloc_dentry_hash(DCACHE_HASH_INIT_BITS);
+        if (!hash)
+            return -ENOMEM;
+        __atomic_store_n(&dir->children_hash, hash, __ATOMIC_RELEASE);
+    } else if (dir->nchildren >= (1UL << dir->children_hash->bits)) {
+        grow_dentry_hash(dir);
+    }
+    return 0;
+}
+
+/* Publishes a fully initialized `dent` to lookups in `dir`. The caller should have called
+ * `reserve_dentry_hash(dir)`. */
+static void add_dentry_to_hash(struct shim_dentry* dir, struct shim_dentry* dent) {
+    struct shim_dentry_hash* hash = dir->children_hash;
+    size_t bucket = dentry_hash_bucket(hash, dent->name_hash);
+    dent->hash_next = hash->buckets[bucket];
+    __atomic_store_n(&hash->buckets[bucket], dent, __ATOMIC_RELEASE);
+}
+
+static void del_dentry_from_hash(struct shim_dentry* dir, struct shim_dentry* dent) {
+    struct shim_dentry_hash* hash = dir->children_hash;
+    struct shim_dentry** link = &hash->buckets[dentry_hash_bucket(hash, dent->name_hash)];
+    while (*link != dent) {
+        assert(*link);
+        link = &(*link)->hash_next;
+    }
+    /* `dent->hash_next` stays intact, lockless readers standing at `dent` still need it */
+    __atomic_store_n(link, dent->hash_next, __ATOMIC_RELEASE);
+}
+
 static struct shim_dentry* alloc_dentry(void) {
     struct shim_dentry* dent =
         get_mem_obj_from_mgr_enlarge(dentry_mgr, size_align_up(DCACHE_MGR_ALLOC));
@@ -114,6 +205,8 @@ static void free_dentry(struct shim_dentry* dent) {
     assert(LISTP_EMPTY(&dent->children));
     assert(LIST_EMPTY(dent, siblings));
 
+    free_dentry_hash(dent->children_hash);
+
     if (dent->attached_mount) {
         put_mount(dent->attached_mount);
     }
@@ -126,6 +219,43 @@ static void free_dentry(struct shim_dentry* dent) {
     free_mem_obj_to_mgr(dentry_mgr, dent);
 }
 
+static void free_retired_dentries(void) {
+    while (true) {
+        spinlock_lock(&g_retired_dentries_lock);
+        struct shim_dentry* retired = g_retired_dentries;
+        g_retired_dentries = NULL;
+        spinlock_unlock(&g_retired_dentries_lock);
+
+        if (!retired)
+            return;
+
+        /* All dentries on the list were unlinked before we took it, so they are safe to free if
+         * there are no readers now. */
+        if (__atomic_load_n(&g_dcache_readers, __ATOMIC_SEQ_CST) == 0) {
+            while (retired) {
+                /* freeing might drop the last reference to the parent and retire it again */
+                struct shim_dentry* next = retired->retired_next;
+                free_dentry(retired);
+                retired = next;
+            }
+            return;
+        }
+
+        struct shim_dentry* last = retired;
+        while (last->retired_next)
+            last = last->retired_next;
+
+        spinlock_lock(&g_retired_dentries_lock);
+        last->retired_next = g_retired_dentries;
+        g_retired_dentries = retired;
+        spinlock_unlock(&g_retired_dentries_lock);
+
+        /* if the last reader finished in the meantime, it saw an empty list */
+        if (__atomic_load_n(&g_dcache_readers, __ATOMIC_SEQ_CST) != 0)
+            return;
+    }
+}
+
 void put_dentry(struct shim_dentry* dent) {
     int64_t count = REF_DEC(dent->ref_count);
 #ifdef DEBUG_REF
@@ -139,10 +269,35 @@ void put_dentry(struct shim_dentry* dent) {
     if (count == 0) {
         assert(LIST_EMPTY(dent, siblings));
         assert(LISTP_EMPTY(&dent->children));
-        free_dentry(dent);
+
+        /* `dent` is not reachable from the dcache anymore, but readers that started before it was
+         * unlinked might still be looking at it. Readers that start after this check cannot find
+         * it (both sides use sequentially consistent accesses). */
+        if (__atomic_load_n(&g_dcache_readers, __ATOMIC_SEQ_CST) == 0) {
+            free_dentry(dent);
+            return;
+        }
+
+        spinlock_lock(&g_retired_dentries_lock);
+        dent->retired_next = g_retired_dentries;
+        g_retired_dentries = dent;
+        spinlock_unlock(&g_retired_dentries_lock);
+
+        /* the last reader might have finished before we added `dent` to the list */
+        free_retired_dentries();
     }
 }
 
+void begin_dcache_lockless_read(void) {
+    __atomic_add_fetch(&g_dcache_readers, 1, __ATOMIC_SEQ_CST);
+}
+
+void end_dcache_lockless_read(void) {
+    if (__atomic_sub_fetch(&g_dcache_readers, 1, __ATOMIC_SEQ_CST) == 0
+            && __atomic_load_n(&g_retired_dentries, __ATOMIC_RELAXED))
+        free_retired_dentries();
+}
+
 void dentry_gc(struct shim_dentry* dent) {
     assert(locked(&g_dcache_lock));
     assert(dent->parent);
@@ -153,6 +308,7 @@ void dentry_gc(struct shim_dentry* dent) {
     if ((dent->state & DENTRY_VALID) && !(dent->state & DENTRY_NEGATIVE))
         return;
 
+    del_dentry_from_hash(dent->parent, dent);
     LISTP_DEL_INIT(dent, &dent->parent->children, siblings);
     dent->parent->nchildren--;
     /* This should delete `dent` */
@@ -174,12 +330,19 @@ struct shim_dentry* get_new_dentry(struct shim_mount* mount, struct shim_dentry*
         return NULL;
     }
 
+    dent->name_hash = hash_name_len(0, name, name_len);
+
     if (parent && parent->nchildren >= DENTRY_MAX_CHILDREN) {
         log_warning("get_new_dentry: nchildren limit reached");
         free_dentry(dent);
         return NULL;
     }
 
+    if (parent && reserve_dentry_hash(parent) < 0) {
+        free_dentry(dent);
+        return NULL;
+    }
+
     if (mount) {
         get_mount(mount);
         dent->mount = mount;
@@ -193,6 +356,7 @@ struct shim_dentry* get_new_dentry(struct shim_mount* mount, struct shim_dentry*
         get_dentry(dent);
         LISTP_ADD_TAIL(dent, &parent->children, siblings);
         parent->nchildren++;
+        add_dentry_to_hash(parent, dent);
     }
 
     return dent;
@@ -211,14 +375,41 @@ struct shim_dentry* lookup_dcache(struct shim_dentry* parent, const char* name,
     assert(parent);
     assert(name_len > 0);
 
-    struct shim_dentry* tmp;
-    struct shim_dentry* dent;
-    LISTP_FOR_EACH_ENTRY_SAFE(dent, tmp, &parent->children, siblings) {
-        if (qstrcmpstr(&dent->name, name, name_len) == 0) {
+    struct shim_dentry_hash* hash = parent->children_hash;
+    if (!hash)
+        return NULL;
+
+    HASHTYPE name_hash = hash_name_len(0, name, name_len);
+    struct shim_dentry* dent = hash->buckets[dentry_hash_bucket(hash, name_hash)];
+    while (dent) {
+        struct shim_dentry* next = dent->hash_next;
+        if (dent->name_hash == name_hash && qstrcmpstr(&dent->name, name, name_len) == 0) {
             get_dentry(dent);
             return dent;
         }
         dentry_gc(dent);
+        dent = next;
+    }
+
+    return NULL;
+}
+
+struct shim_dentry* lookup_dcache_lockless(struct shim_dentry* parent, const char* name,
+                                           size_t name_len) {
+    assert(__atomic_load_n(&g_dcache_readers, __ATOMIC_RELAXED) > 0);
+    assert(name_len > 0);
+
+    struct shim_dentry_hash* hash = __atomic_load_n(&parent->children_hash, __ATOMIC_ACQUIRE);
+    if (!hash)
+        return NULL;
+
+    HASHTYPE name_hash = hash_name_len(0, name, name_len);
+    struct shim_dentry* dent = __atomic_load_n(&hash->buckets[dentry_hash_bucket(hash, name_hash)],
+                                               __ATOMIC_ACQUIRE);
+    while (dent) {
+        if (dent->name_hash == name_hash && qstrcmpstr(&dent->name, name, name_len) == 0)
+            return dent;
+        dent = __atomic_load_n(&dent->hash_next, __ATOMIC_ACQUIRE);
     }
 
     return NULL;
@@ -442,6 +633,9 @@ BEGIN_CP_FUNC(dentry) {
         *new_dent = *dent;
         INIT_LISTP(&new_dent->children);
         INIT_LIST_HEAD(new_dent, siblings);
+        new_dent->children_hash = NULL;
+        new_dent->hash_next = NULL;
+        new_dent->retired_next = NULL;
         clear_lock(&new_dent->lock);
         REF_SET(new_dent->ref_count, 0);
 
@@ -504,9 +698,12 @@ BEGIN_RS_FUNC(dentry) {
      * fix up the children linked list.  Presumably the ref count and
      * child count is already correct in the checkpoint. */
     if (dent->parent) {
+        if (reserve_dentry_hash(dent->parent) < 0)
+            return -ENOMEM;
         get_dentry(dent->parent);
         get_dentry(dent);
         LISTP_ADD_TAIL(dent, &dent->parent->children, siblings);
+        add_dentry_to_hash(dent->parent, dent);
     }
 
     if (dent->attached_mount) {
@@ -9,16 +9,17 @@
 
 #include "api.h"
 #include "list.h"
+#include "manifest.h"
 #include "pal.h"
 #include "pal_error.h"
 #include "shim_checkpoint.h"
 #include "shim_fs.h"
+#include "shim_fs_page_cache.h"
 #include "shim_fs_pseudo.h"
 #include "shim_internal.h"
 #include "shim_lock.h"
 #include "shim_process.h"
 #include "shim_utils.h"
-#include "toml.h"
 
 struct shim_fs* builtin_fs[] = {
     &chroot_builtin_fs,
@@ -59,6 +60,8 @@ int init_fs(void) {
         goto err;
     }
 
+    if ((ret = init_page_cache()) < 0)
+        goto err;
     if ((ret = init_procfs()) < 0)
         goto err;
     if ((ret = init_devfs()) < 0)
@@ -94,14 +97,14 @@ static int __mount_root(void) {
 
     assert(g_manifest_root);
 
-    ret = toml_string_in(g_manifest_root, "fs.root.type", &fs_root_type);
+    ret = manifest_string_in(g_manifest_root, "fs.root.type", &fs_root_type);
     if (ret < 0) {
         log_error("Cannot parse 'fs.root.type' (the value must be put in double quotes!)");
         ret = -EINVAL;
         goto out;
     }
 
-    ret = toml_string_in(g_manifest_root, "fs.root.uri", &fs_root_uri);
+    ret = manifest_string_in(g_manifest_root, "fs.root.uri", &fs_root_uri);
     if (ret < 0) {
         log_error("Cannot parse 'fs.root.uri' (the value must be put in double quotes!)");
         ret = -EINVAL;
@@ -110,13 +113,14 @@ static int __mount_root(void) {
 
     if (fs_root_type && fs_root_uri) {
         log_debug("Mounting root as %s filesystem: from %s to /", fs_root_type, fs_root_uri);
-        if ((ret = mount_fs(fs_root_type, fs_root_uri, "/")) < 0) {
+        if ((ret = mount_fs(fs_root_type, fs_root_uri, "/",
+                            manifest_lookup(g_manifest_root, "fs.root"))) < 0) {
             log_error("Mounting root filesystem failed (%d)", ret);
             goto out;
         }
     } else {
         log_debug("Mounting root as chroot filesystem: from file:. to /");
-        if ((ret = mount_fs("chroot", URI_PREFIX_FILE, "/")) < 0) {
+        if ((ret = mount_fs("chroot", URI_PREFIX_FILE, "/", /*options=*/NULL)) < 0) {
             log_error("Mounting root filesystem failed (%d)", ret);
             goto out;
         }
@@ -133,25 +137,25 @@ static int __mount_sys(void) {
     int ret;
 
     log_debug("Mounting special proc filesystem: /proc");
-    if ((ret = mount_fs("pseudo", "proc", "/proc")) < 0) {
+    if ((ret = mount_fs("pseudo", "proc", "/proc", /*options=*/NULL)) < 0) {
         log_error("Mounting proc filesystem failed (%d)", ret);
         return ret;
     }
 
     log_debug("Mounting special dev filesystem: /dev");
-    if ((ret = mount_fs("pseudo", "dev", "/dev")) < 0) {
+    if ((ret = mount_fs("pseudo", "dev", "/dev", /*options=*/NULL)) < 0) {
         log_error("Mounting dev filesystem failed (%d)", ret);
         return ret;
     }
 
     log_debug("Mounting terminal device /dev/tty under /dev");
-    if ((ret = mount_fs("chroot", URI_PREFIX_DEV "tty", "/dev/tty")) < 0) {
+    if ((ret = mount_fs("chroot", URI_PREFIX_DEV "tty", "/dev/tty", /*options=*/NULL)) < 0) {
         log_error("Mounting terminal device /dev/tty failed (%d)", ret);
         return ret;
     }
 
     log_debug("Mounting special sys filesystem: /sys");
-    if ((ret = mount_fs("pseudo", "sys", "/sys")) < 0) {
+    if ((ret = mount_fs("pseudo", "sys", "/sys", /*options=*/NULL)) < 0) {
         log_error("Mounting sys filesystem failed (%d)", ret);
         return ret;
     }
@@ -159,54 +163,39 @@ static int __mount_sys(void) {
     return 0;
 }
 
-static int __mount_one_other(toml_table_t* mount) {
-    assert(mount);
-
-    int ret;
-    const char* key = toml_table_key(mount);
+static const char* mount_option(const struct manifest_node* mount, const char* name) {
+    const char* key = manifest_node_key(g_manifest_root, mount);
 
-    toml_raw_t mount_type_raw = toml_raw_in(mount, "type");
-    if (!mount_type_raw) {
-        log_error("Cannot find 'fs.mount.%s.type'", key);
-        return -EINVAL;
+    const struct manifest_node* option = manifest_table_get(g_manifest_root, mount, name,
+                                                            strlen(name));
+    if (!option || option->type == MANIFEST_NODE_TABLE || option->type == MANIFEST_NODE_ARRAY) {
+        log_error("Cannot find 'fs.mount.%s.%s'", key, name);
+        return NULL;
     }
 
-    toml_raw_t mount_path_raw = toml_raw_in(mount, "path");
-    if (!mount_path_raw) {
-        log_error("Cannot find 'fs.mount.%s.path'", key);
-        return -EINVAL;
-    }
-
-    toml_raw_t mount_uri_raw = toml_raw_in(mount, "uri");
-    if (!mount_uri_raw) {
-        log_error("Cannot find 'fs.mount.%s.uri'", key);
-        return -EINVAL;
+    const char* value = manifest_node_str(g_manifest_root, option);
+    if (!value) {
+        log_error("Cannot parse 'fs.mount.%s.%s' (the value must be put in double quotes!)", key,
+                  name);
+        return NULL;
     }
+    return value;
+}
 
-    char* mount_type = NULL;
-    char* mount_path = NULL;
-    char* mount_uri  = NULL;
+static int __mount_one_other(const struct manifest_node* mount) {
+    assert(mount);
 
-    ret = toml_rtos(mount_type_raw, &mount_type);
-    if (ret < 0) {
-        log_error("Cannot parse 'fs.mount.%s.type' (the value must be put in double quotes!)", key);
-        ret = -EINVAL;
-        goto out;
-    }
+    const char* mount_type = mount_option(mount, "type");
+    if (!mount_type)
+        return -EINVAL;
 
-    ret = toml_rtos(mount_path_raw, &mount_path);
-    if (ret < 0) {
-        log_error("Cannot parse 'fs.mount.%s.path' (the value must be put in double quotes!)", key);
-        ret = -EINVAL;
-        goto out;
-    }
+    const char* mount_path = mount_option(mount, "path");
+    if (!mount_path)
+        return -EINVAL;
 
-    ret = toml_rtos(mount_uri_raw, &mount_uri);
-    if (ret < 0) {
-        log_error("Cannot parse 'fs.mount.%s.uri' (the value must be put in double quotes!)", key);
-        ret = -EINVAL;
-        goto out;
-    }
+    const char* mount_uri = mount_option(mount, "uri");
+    if (!mount_uri)
+        return -EINVAL;
 
     log_debug("Mounting as %s filesystem: from %s to %s", mount_type, mount_uri, mount_path);
 
@@ -215,44 +204,33 @@ static int __mount_one_other(toml_table_t* mount) {
             "Root mount / already exists, verify that there are no duplicate mounts in manifest\n"
             "(note that root / is automatically mounted in Graphene and can be changed via "
             "'fs.root' manifest entry).\n");
-        ret = -EEXIST;
-        goto out;
+        return -EEXIST;
     }
 
     if (!strcmp(mount_path, ".") || !strcmp(mount_path, "..")) {
         log_error("Mount points '.' and '..' are not allowed, remove them from manifest.");
-        ret = -EINVAL;
-        goto out;
+        return -EINVAL;
     }
 
-    if ((ret = mount_fs(mount_type, mount_uri, mount_path)) < 0) {
+    int ret = mount_fs(mount_type, mount_uri, mount_path, mount);
+    if (ret < 0) {
         log_error("Mounting %s on %s (type=%s) failed (%d)", mount_uri, mount_path, mount_type,
                   -ret);
-        goto out;
+        return ret;
     }
-
-    ret = 0;
-out:
-    free(mount_type);
-    free(mount_path);
-    free(mount_uri);
-    return ret;
+    return 0;
 }
 
 static int __mount_others(void) {
     int ret = 0;
 
     assert(g_manifest_root);
-    toml_table_t* manifest_fs = toml_table_in(g_manifest_root, "fs");
-    if (!manifest_fs)
-        return 0;
-
-    toml_table_t* manifest_fs_mounts = toml_table_in(manifest_fs, "mount");
+    const struct manifest_node* manifest_fs_mounts = manifest_lookup(g_manifest_root, "fs.mount");
     if (!manifest_fs_mounts)
         return 0;
 
-    ssize_t mounts_cnt = toml_table_ntab(manifest_fs_mounts);
-    if (mounts_cnt <= 0)
+    size_t mounts_cnt = manifest_node_count(manifest_fs_mounts);
+    if (mounts_cnt == 0)
         return 0;
 
     /* *** Warning: A _very_ ugly hack below (hopefully only temporary) ***
@@ -273,39 +251,38 @@ static int __mount_others(void) {
      *
      * Corresponding issue: https://github.com/oscarlab/graphene/issues/2214.
      */
-    const char** keys = malloc(mounts_cnt * sizeof(*keys));
     size_t* lengths = malloc(mounts_cnt * sizeof(*lengths));
+    if (!lengths)
+        return -ENOMEM;
     size_t longest = 0;
-    for (ssize_t i = 0; i < mounts_cnt; i++) {
-        keys[i] = toml_key_in(manifest_fs_mounts, i);
-        assert(keys[i]);
-
-        toml_table_t* mount = toml_table_in(manifest_fs_mounts, keys[i]);
-        assert(mount);
-        char* mount_path;
-        ret = toml_string_in(mount, "path", &mount_path);
-        if (ret < 0 || !mount_path) {
-            if (!ret)
-                ret = -ENOENT;
+    for (size_t i = 0; i < mounts_cnt; i++) {
+        const struct manifest_node* mount = manifest_node_child(g_manifest_root,
+                                                                manifest_fs_mounts, i);
+        if (mount->type != MANIFEST_NODE_TABLE) {
+            /* not a mount description, skipped */
+            lengths[i] = SIZE_MAX;
+            continue;
+        }
+        const struct manifest_node* mount_path = manifest_table_get(g_manifest_root, mount, "path",
+                                                                    strlen("path"));
+        if (!mount_path || mount_path->type != MANIFEST_NODE_STRING) {
+            ret = mount_path ? -EINVAL : -ENOENT;
             goto out;
         }
-        lengths[i] = strlen(mount_path);
+        lengths[i] = mount_path->count;
         longest = MAX(longest, lengths[i]);
-        free(mount_path);
     }
 
     for (size_t i = 0; i <= longest; i++) {
-        for (ssize_t j = 0; j < mounts_cnt; j++) {
+        for (size_t j = 0; j < mounts_cnt; j++) {
             if (lengths[j] != i)
                 continue;
-            toml_table_t* mount = toml_table_in(manifest_fs_mounts, keys[j]);
-            ret = __mount_one_other(mount);
+            ret = __mount_one_other(manifest_node_child(g_manifest_root, manifest_fs_mounts, j));
             if (ret < 0)
                 goto out;
         }
     }
 out:
-    free(keys);
     free(lengths);
     return ret;
 }
@@ -337,7 +314,7 @@ int init_mount(void) {
     assert(g_manifest_root);
 
     char* fs_start_dir = NULL;
-    ret = toml_string_in(g_manifest_root, "fs.start_dir", &fs_start_dir);
+    ret = manifest_string_in(g_manifest_root, "fs.start_dir", &fs_start_dir);
     if (ret < 0) {
         log_error("Can't parse 'fs.start_dir' (note that the value must be put in double quotes)!");
         return ret;
@@ -372,6 +349,7 @@ struct shim_fs* find_fs(const char* name) {
 }
 
 static int mount_fs_at_dentry(const char* type, const char* uri, const char* mount_path,
+                              const struct manifest_node* options,
                               struct shim_dentry* mount_point) {
     assert(locked(&g_dcache_lock));
     assert(!mount_point->attached_mount);
@@ -387,7 +365,7 @@ static int mount_fs_at_dentry(const char* type, const char* uri, const char* mou
     void* mount_data = NULL;
 
     /* Call filesystem-specific mount operation */
-    if ((ret = fs->fs_ops->mount(uri, &mount_data)) < 0)
+    if ((ret = fs->fs_ops->mount(uri, options, &mount_data)) < 0)
         return ret;
 
     /* Allocate and set up `shim_mount` object */
@@ -472,7 +450,8 @@ err:
     return ret;
 }
 
-int mount_fs(const char* type, const char* uri, const char* mount_path) {
+int mount_fs(const char* type, const char* uri, const char* mount_path,
+             const struct manifest_node* options) {
     int ret;
     struct shim_dentry* mount_point = NULL;
 
@@ -484,7 +463,7 @@ int mount_fs(const char* type, const char* uri, const char* mount_path) {
         goto out;
     }
 
-    if ((ret = mount_fs_at_dentry(type, uri, mount_path, mount_point)) < 0)
+    if ((ret = mount_fs_at_dentry(type, uri, mount_path, options, mount_point)) < 0)
         goto out;
 
     ret = 0;
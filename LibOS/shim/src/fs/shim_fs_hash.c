@@ -8,12 +8,10 @@
 #include "shim_fs.h"
 #include "shim_internal.h"
 
-HASHTYPE hash_str(const char* p) {
+static HASHTYPE hash_str_len(const char* p, size_t len) {
     HASHTYPE hash = 0;
     HASHTYPE tmp;
 
-    size_t len = strlen(p);
-
     for (; len >= sizeof(hash); p += sizeof(hash), len -= sizeof(hash)) {
         memcpy(&tmp, p, sizeof(tmp)); /* avoid pointer alignment issues */
         hash += tmp;
@@ -33,8 +31,17 @@ HASHTYPE hash_str(const char* p) {
     return hash;
 }
 
+HASHTYPE hash_str(const char* p) {
+    return hash_str_len(p, strlen(p));
+}
+
 HASHTYPE hash_name(HASHTYPE parent_hbuf, const char* name) {
-    return (parent_hbuf + hash_str(name)) * 9;
+    return hash_name_len(parent_hbuf, name, strlen(name));
+}
+
+/* Same as `hash_name`, but `name` does not need to be null-terminated (e.g. a path component). */
+HASHTYPE hash_name_len(HASHTYPE parent_hbuf, const char* name, size_t name_len) {
+    return (parent_hbuf + hash_str_len(name, name_len)) * 9;
 }
 
 HASHTYPE hash_abs_path(struct shim_dentry* dent) {
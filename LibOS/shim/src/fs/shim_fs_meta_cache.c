@@ -0,0 +1,272 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Host metadata cache, see `shim_fs_meta_cache.h`.
+ *
+ * The cache is a hash table of paths. The following invariant makes negative answers from listings
+ * safe: if a directory entry is marked as `listed`, every existing child of that directory has an
+ * entry in the cache. Hence, whenever a child entry is removed (because it expired or was
+ * forgotten), the listing of its parent is dropped as well.
+ */
+
+#include "pal.h"
+#include "shim_fs.h"
+#include "shim_fs_meta_cache.h"
+#include "shim_internal.h"
+#include "shim_lock.h"
+
+#define META_CACHE_BUCKETS_BITS 10
+#define META_CACHE_BUCKETS      (1UL << META_CACHE_BUCKETS_BITS)
+
+struct meta_cache_entry {
+    struct meta_cache_entry* next;
+    HASHTYPE hash;
+    uint64_t expires;              /* in microseconds, UINT64_MAX if the entry never expires */
+    enum meta_cache_state state;
+    bool listed;                   /* directory: all existing children have entries */
+    bool unlistable;               /* directory: too big to be listed */
+    size_t len;
+    char path[];
+};
+
+struct meta_cache {
+    struct shim_lock lock;
+    uint64_t ttl_us;
+    uint64_t gen;                  /* incremented whenever an entry is removed */
+    size_t count;
+    struct meta_cache_entry* buckets[META_CACHE_BUCKETS];
+};
+
+static size_t bucket_of(HASHTYPE hash) {
+    return (hash * 0x9e3779b97f4a7c15UL) >> (64 - META_CACHE_BUCKETS_BITS);
+}
+
+static uint64_t expiry_time(struct meta_cache* cache) {
+    if (cache->ttl_us == META_CACHE_TTL_INFINITE)
+        return UINT64_MAX;
+
+    uint64_t now;
+    if (DkSystemTimeQuery(&now) < 0)
+        return 0; /* the entry will not be used */
+    return now + cache->ttl_us;
+}
+
+static bool is_expired(struct meta_cache_entry* entry, uint64_t* now) {
+    if (entry->expires == UINT64_MAX)
+        return false;
+    /* query the time at most once per operation */
+    if (*now == 0 && DkSystemTimeQuery(now) < 0)
+        return true;
+    return entry->expires <= *now;
+}
+
+/* Returns the length of the parent directory of `path` ("" for top-level names). */
+static size_t parent_len(const char* path, size_t len) {
+    while (len > 0 && path[len - 1] != '/')
+        len--;
+    return len > 0 ? len - 1 : 0;
+}
+
+static struct meta_cache_entry** find_link(struct meta_cache* cache, const char* path, size_t len,
+                                           HASHTYPE hash) {
+    struct meta_cache_entry** link = &cache->buckets[bucket_of(hash)];
+    while (*link) {
+        struct meta_cache_entry* entry = *link;
+        if (entry->hash == hash && entry->len == len && !memcmp(entry->path, path, len))
+            break;
+        link = &entry->next;
+    }
+    return link;
+}
+
+static void drop_listing(struct meta_cache* cache, const char* path, size_t len) {
+    if (len == 0)
+        return; /* the mount root has no parent */
+
+    size_t dir_len = parent_len(path, len);
+    struct meta_cache_entry** link = find_link(cache, path, dir_len,
+                                               hash_name_len(0, path, dir_len));
+    if (*link)
+        (*link)->listed = false;
+}
+
+static void remove_entry(struct meta_cache* cache, struct meta_cache_entry** link) {
+    struct meta_cache_entry* entry = *link;
+    *link = entry->next;
+    cache->count--;
+    cache->gen++;
+    drop_listing(cache, entry->path, entry->len);
+    free(entry);
+}
+
+/* Finds a non-expired entry; expired entries are removed. */
+static struct meta_cache_entry* find_entry(struct meta_cache* cache, const char* path, size_t len,
+                                           uint64_t* now) {
+    struct meta_cache_entry** link = find_link(cache, path, len, hash_name_len(0, path, len));
+    if (*link && is_expired(*link, now)) {
+        remove_entry(cache, link);
+        return NULL;
+    }
+    return *link;
+}
+
+static void clear_entries(struct meta_cache* cache) {
+    for (size_t i = 0; i < META_CACHE_BUCKETS; i++) {
+        struct meta_cache_entry* entry = cache->buckets[i];
+        while (entry) {
+            struct meta_cache_entry* next = entry->next;
+            free(entry);
+            entry = next;
+        }
+        cache->buckets[i] = NULL;
+    }
+    cache->count = 0;
+    cache->gen++;
+}
+
+static struct meta_cache_entry* get_or_add_entry(struct meta_cache* cache, const char* path,
+                                                 size_t len) {
+    HASHTYPE hash = hash_name_len(0, path, len);
+    struct meta_cache_entry** link = find_link(cache, path, len, hash);
+    if (*link)
+        return *link;
+
+    if (cache->count >= META_CACHE_MAX_ENTRIES)
+        clear_entries(cache);
+
+    struct meta_cache_entry* entry = malloc(sizeof(*entry) + len);
+    if (!entry)
+        return NULL;
+
+    memset(entry, 0, sizeof(*entry));
+    entry->hash = hash;
+    entry->len = len;
+    memcpy(entry->path, path, len);
+
+    size_t bucket = bucket_of(hash);
+    entry->next = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    cache->count++;
+    return entry;
+}
+
+int meta_cache_create(uint64_t ttl_us, struct meta_cache** out_cache) {
+    struct meta_cache* cache = calloc(1, sizeof(*cache));
+    if (!cache)
+        return -ENOMEM;
+
+    if (!create_lock(&cache->lock)) {
+        free(cache);
+        return -ENOMEM;
+    }
+    cache->ttl_us = ttl_us;
+
+    *out_cache = cache;
+    return 0;
+}
+
+void meta_cache_destroy(struct meta_cache* cache) {
+    clear_entries(cache);
+    destroy_lock(&cache->lock);
+    free(cache);
+}
+
+enum meta_cache_state meta_cache_get(struct meta_cache* cache, const char* path, size_t len) {
+    enum meta_cache_state state = META_CACHE_UNKNOWN;
+    uint64_t now = 0;
+
+    lock(&cache->lock);
+
+    struct meta_cache_entry* entry = find_entry(cache, path, len, &now);
+    if (entry) {
+        state = entry->state;
+    } else if (len > 0) {
+        struct meta_cache_entry* dir = find_entry(cache, path, parent_len(path, len), &now);
+        if (dir && dir->listed)
+            state = META_CACHE_MISSING;
+    }
+
+    unlock(&cache->lock);
+    return state;
+}
+
+uint64_t meta_cache_gen(struct meta_cache* cache) {
+    lock(&cache->lock);
+    uint64_t gen = cache->gen;
+    unlock(&cache->lock);
+    return gen;
+}
+
+void meta_cache_set(struct meta_cache* cache, const char* path, size_t len, bool exists,
+                    uint64_t gen) {
+    uint64_t expires = expiry_time(cache);
+
+    lock(&cache->lock);
+    if (cache->gen == gen) {
+        struct meta_cache_entry* entry = get_or_add_entry(cache, path, len);
+        if (entry) {
+            entry->state = exists ? META_CACHE_EXISTS : META_CACHE_MISSING;
+            entry->expires = expires;
+        }
+    }
+    unlock(&cache->lock);
+}
+
+void meta_cache_forget(struct meta_cache* cache, const char* path, size_t len) {
+    lock(&cache->lock);
+    struct meta_cache_entry** link = find_link(cache, path, len, hash_name_len(0, path, len));
+    if (*link) {
+        remove_entry(cache, link);
+    } else {
+        drop_listing(cache, path, len);
+    }
+    cache->gen++;
+    unlock(&cache->lock);
+}
+
+void meta_cache_clear(struct meta_cache* cache) {
+    lock(&cache->lock);
+    clear_entries(cache);
+    unlock(&cache->lock);
+}
+
+void meta_cache_set_listed(struct meta_cache* cache, const char* dir, size_t dir_len,
+                           uint64_t gen) {
+    uint64_t expires = expiry_time(cache);
+
+    lock(&cache->lock);
+    if (cache->gen == gen) {
+        struct meta_cache_entry* entry = get_or_add_entry(cache, dir, dir_len);
+        /* adding the entry could have cleared the whole cache */
+        if (entry && cache->gen == gen) {
+            entry->state = META_CACHE_EXISTS;
+            entry->listed = true;
+            entry->expires = expires;
+        }
+    }
+    unlock(&cache->lock);
+}
+
+bool meta_cache_needs_listing(struct meta_cache* cache, const char* dir, size_t dir_len) {
+    uint64_t now = 0;
+
+    lock(&cache->lock);
+    struct meta_cache_entry* entry = find_entry(cache, dir, dir_len, &now);
+    bool ret = !entry || !(entry->listed || entry->unlistable);
+    unlock(&cache->lock);
+    return ret;
+}
+
+void meta_cache_set_unlistable(struct meta_cache* cache, const char* dir, size_t dir_len) {
+    uint64_t expires = expiry_time(cache);
+
+    lock(&cache->lock);
+    struct meta_cache_entry* entry = get_or_add_entry(cache, dir, dir_len);
+    if (entry) {
+        if (entry->state == META_CACHE_UNKNOWN)
+            entry->state = META_CACHE_EXISTS;
+        entry->unlistable = true;
+        entry->expires = expires;
+    }
+    unlock(&cache->lock);
+}
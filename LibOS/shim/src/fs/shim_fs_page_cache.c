@@ -0,0 +1,773 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Page cache of host files, see `shim_fs_page_cache.h`.
+ *
+ * All caches are protected by one global lock, which is never held during host I/O: pages are read
+ * from and written to the host through bounce buffers. Every write to a cache increments its
+ * generation; pages read from the host are inserted only if the generation did not change during
+ * the read, as they might be older than the write.
+ *
+ * Page frames are allocated in chunks (LibOS malloc would do a host allocation for each page) and
+ * are never freed; once the budget is reached, frames of clean pages are reused in LRU order. Dirty
+ * pages are not on the LRU list, so they cannot be evicted before they are written back.
+ */
+
+#include "avl_tree.h"
+#include "list.h"
+#include "manifest.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "shim_fs_page_cache.h"
+#include "shim_internal.h"
+#include "shim_lock.h"
+#include "shim_utils.h"
+
+/* Frames are allocated in chunks of this many pages. */
+#define PAGE_CACHE_CHUNK_PAGES 64UL
+
+/* Initial read-ahead window (in pages), doubled by each sequential miss. */
+#define PAGE_CACHE_READAHEAD_MIN 4
+
+/* A file with more dirty pages than this is written back after the write. */
+#define PAGE_CACHE_FILE_DIRTY_MAX 256
+
+#define PAGE_CACHE_BOUNCE_SIZE (PAGE_CACHE_READAHEAD_MAX * PAGE_CACHE_PAGE_SIZE)
+
+DEFINE_LIST(page_cache_page);
+struct page_cache_page {
+    struct avl_tree_node node; /* in `cache->pages`, ordered by `index` */
+    LIST_TYPE(page_cache_page) lru; /* in `g_lru` if the page is clean */
+    struct page_cache* cache;
+    uint64_t index;
+    /* valid bytes; less than a page only at the end of the file */
+    size_t len;
+    bool dirty;
+    /* incremented on every modification, so that a write-back can tell whether the page was
+     * modified while it was being written */
+    uint64_t version;
+    char* frame;
+};
+DEFINE_LISTP(page_cache_page);
+
+DEFINE_LIST(page_cache);
+struct page_cache {
+    enum page_cache_mode mode;
+    bool disabled;
+    /* set by `page_cache_destroy`; the cache is freed when `refs` drops to 0 */
+    bool destroyed;
+    size_t refs;
+    uint64_t gen;
+    struct avl_tree pages;
+    size_t dirty_cnt;
+    LIST_TYPE(page_cache) dirty_list; /* in `g_dirty_caches` if `dirty_cnt` > 0 */
+    /* for detecting sequential reads: the page after the last page read from the host */
+    uint64_t ra_next;
+    size_t ra_window;
+    /* serializes write-backs of this cache; taken before `g_page_cache_lock` */
+    struct shim_lock flush_lock;
+    /* host handle used for write-back, opened at the first write */
+    PAL_HANDLE wb_handle;
+    char uri[];
+};
+DEFINE_LISTP(page_cache);
+
+static struct shim_lock g_page_cache_lock;
+/* clean pages of all caches, most recently used first */
+static LISTP_TYPE(page_cache_page) g_lru = LISTP_INIT;
+static LISTP_TYPE(page_cache) g_dirty_caches = LISTP_INIT;
+/* free frames and bounce buffers are linked through their first word */
+static void* g_free_frames;
+static void* g_free_bounces;
+static size_t g_frames_cnt;
+static size_t g_budget_pages;
+static struct page_cache_stats g_stats;
+
+static bool page_cmp(struct avl_tree_node* node_a, struct avl_tree_node* node_b) {
+    struct page_cache_page* a = container_of(node_a, struct page_cache_page, node);
+    struct page_cache_page* b = container_of(node_b, struct page_cache_page, node);
+    return a->index <= b->index;
+}
+
+static bool index_cmp(void* arg, struct avl_tree_node* node) {
+    return *(uint64_t*)arg <= container_of(node, struct page_cache_page, node)->index;
+}
+
+/* Returns the first cached page with index at least `idx`. */
+static struct page_cache_page* next_page(struct page_cache* cache, uint64_t idx) {
+    struct avl_tree_node* node = avl_tree_lower_bound_fn(&cache->pages, &idx, index_cmp);
+    return node ? container_of(node, struct page_cache_page, node) : NULL;
+}
+
+static struct page_cache_page* find_page(struct page_cache* cache, uint64_t idx) {
+    struct page_cache_page* page = next_page(cache, idx);
+    return page && page->index == idx ? page : NULL;
+}
+
+static struct page_cache_page* page_after(struct page_cache_page* page) {
+    struct avl_tree_node* node = avl_tree_next(&page->node);
+    return node ? container_of(node, struct page_cache_page, node) : NULL;
+}
+
+int init_page_cache(void) {
+    if (!create_lock(&g_page_cache_lock))
+        return -ENOMEM;
+
+    uint64_t size;
+    int ret = manifest_sizestring_in(g_manifest_root, "fs.page_cache_size",
+                                     PAGE_CACHE_DEFAULT_SIZE, &size);
+    if (ret < 0) {
+        log_error("Cannot parse 'fs.page_cache_size' (the value must be put in double quotes!)");
+        return -EINVAL;
+    }
+    g_budget_pages = size / PAGE_CACHE_PAGE_SIZE;
+    return 0;
+}
+
+static char* get_bounce(void) {
+    lock(&g_page_cache_lock);
+    char* buf = g_free_bounces;
+    if (buf)
+        g_free_bounces = *(void**)buf;
+    unlock(&g_page_cache_lock);
+
+    return buf ?: malloc(PAGE_CACHE_BOUNCE_SIZE);
+}
+
+static void put_bounce(char* buf) {
+    lock(&g_page_cache_lock);
+    *(void**)buf = g_free_bounces;
+    g_free_bounces = buf;
+    unlock(&g_page_cache_lock);
+}
+
+static void free_frame(char* frame) {
+    *(void**)frame = g_free_frames;
+    g_free_frames = frame;
+}
+
+static void set_dirty(struct page_cache_page* page) {
+    assert(locked(&g_page_cache_lock));
+    if (page->dirty)
+        return;
+
+    struct page_cache* cache = page->cache;
+    LISTP_DEL_INIT(page, &g_lru, lru);
+    page->dirty = true;
+    if (!cache->dirty_cnt++)
+        LISTP_ADD_TAIL(cache, &g_dirty_caches, dirty_list);
+    g_stats.dirty_pages++;
+}
+
+static void set_clean(struct page_cache_page* page) {
+    assert(locked(&g_page_cache_lock));
+    if (!page->dirty)
+        return;
+
+    struct page_cache* cache = page->cache;
+    page->dirty = false;
+    if (!--cache->dirty_cnt)
+        LISTP_DEL_INIT(cache, &g_dirty_caches, dirty_list);
+    g_stats.dirty_pages--;
+    LISTP_ADD(page, &g_lru, lru);
+}
+
+static void remove_page(struct page_cache_page* page) {
+    assert(locked(&g_page_cache_lock));
+
+    set_clean(page);
+    LISTP_DEL(page, &g_lru, lru);
+    avl_tree_delete(&page->cache->pages, &page->node);
+    g_stats.pages--;
+    free_frame(page->frame);
+    free(page);
+}
+
+static char* alloc_frame(void) {
+    assert(locked(&g_page_cache_lock));
+
+    if (!g_free_frames && g_frames_cnt < g_budget_pages) {
+        size_t cnt = MIN(PAGE_CACHE_CHUNK_PAGES, g_budget_pages - g_frames_cnt);
+        char* chunk = malloc(cnt * PAGE_CACHE_PAGE_SIZE);
+        if (chunk) {
+            for (size_t i = 0; i < cnt; i++)
+                free_frame(chunk + i * PAGE_CACHE_PAGE_SIZE);
+            g_frames_cnt += cnt;
+        }
+    }
+
+    if (!g_free_frames && !LISTP_EMPTY(&g_lru)) {
+        remove_page(LISTP_LAST_ENTRY(&g_lru, struct page_cache_page, lru));
+        g_stats.evictions++;
+    }
+
+    char* frame = g_free_frames;
+    if (frame)
+        g_free_frames = *(void**)frame;
+    return frame;
+}
+
+/* Inserts an empty clean page; returns NULL if there is no free frame. May evict any clean page,
+ * including one of `cache`. */
+static struct page_cache_page* insert_page(struct page_cache* cache, uint64_t idx) {
+    assert(locked(&g_page_cache_lock));
+
+    char* frame = alloc_frame();
+    if (!frame)
+        return NULL;
+
+    struct page_cache_page* page = malloc(sizeof(*page));
+    if (!page) {
+        free_frame(frame);
+        return NULL;
+    }
+    page->cache = cache;
+    page->index = idx;
+    page->len = 0;
+    page->dirty = false;
+    page->version = 0;
+    page->frame = frame;
+    INIT_LIST_HEAD(page, lru);
+    LISTP_ADD(page, &g_lru, lru);
+    avl_tree_insert(&cache->pages, &page->node);
+    g_stats.pages++;
+    return page;
+}
+
+static void touch_page(struct page_cache_page* page) {
+    if (!page->dirty) {
+        LISTP_DEL(page, &g_lru, lru);
+        LISTP_ADD(page, &g_lru, lru);
+    }
+}
+
+/* The file may be longer than the valid bytes of its last cached page (if it was extended by a
+ * write past its end); the bytes in between read as zeros. */
+static void extend_page(struct page_cache_page* page, off_t file_size) {
+    uint64_t start = page->index * PAGE_CACHE_PAGE_SIZE;
+    if (page->len < PAGE_CACHE_PAGE_SIZE && (uint64_t)file_size > start + page->len) {
+        size_t len = MIN(PAGE_CACHE_PAGE_SIZE, (uint64_t)file_size - start);
+        memset(page->frame + page->len, 0, len - page->len);
+        page->len = len;
+    }
+}
+
+/* Copies `size` bytes between `buf` and `iov`, starting at byte `skip` of `iov`. */
+static void copy_iov(const struct iovec* iov, size_t iov_cnt, size_t skip, char* buf, size_t size,
+                     bool to_iov) {
+    for (size_t i = 0; i < iov_cnt && size; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        size_t n = MIN(iov[i].iov_len - skip, size);
+        if (to_iov) {
+            memcpy((char*)iov[i].iov_base + skip, buf, n);
+        } else {
+            memcpy(buf, (char*)iov[i].iov_base + skip, n);
+        }
+        buf += n;
+        size -= n;
+        skip = 0;
+    }
+}
+
+/* Writes `size` bytes starting at byte `skip` of `iov` directly to the host. */
+static ssize_t host_write(PAL_HANDLE pal_handle, const struct iovec* iov, size_t iov_cnt,
+                          size_t skip, size_t size, off_t pos) {
+    struct iovec* slice = malloc(iov_cnt * sizeof(*slice));
+    if (!slice)
+        return -ENOMEM;
+
+    size_t slice_cnt = 0;
+    for (size_t i = 0; i < iov_cnt && size; i++) {
+        if (skip >= iov[i].iov_len) {
+            skip -= iov[i].iov_len;
+            continue;
+        }
+        size_t n = MIN(iov[i].iov_len - skip, size);
+        slice[slice_cnt].iov_base = (char*)iov[i].iov_base + skip;
+        slice[slice_cnt].iov_len = n;
+        slice_cnt++;
+        size -= n;
+        skip = 0;
+    }
+
+    int64_t ret = pal_stream_iov_io(pal_handle, PAL_IO_WRITE, pos, slice, slice_cnt);
+    free(slice);
+    return ret < 0 ? pal_to_unix_errno(ret) : ret;
+}
+
+/* Copies data written directly to the host into the pages which are already cached. */
+static void update_pages(struct page_cache* cache, const struct iovec* iov, size_t iov_cnt,
+                         size_t skip, size_t size, off_t pos) {
+    lock(&g_page_cache_lock);
+    cache->gen++;
+    uint64_t end = pos + size;
+    for (struct page_cache_page* page = next_page(cache, pos / PAGE_CACHE_PAGE_SIZE);
+         page && page->index * PAGE_CACHE_PAGE_SIZE < end; page = page_after(page)) {
+        uint64_t start = page->index * PAGE_CACHE_PAGE_SIZE;
+        size_t from = MAX(start, (uint64_t)pos) - start;
+        size_t to = MIN(start + PAGE_CACHE_PAGE_SIZE, end) - start;
+        if (from > page->len)
+            memset(page->frame + page->len, 0, from - page->len);
+        copy_iov(iov, iov_cnt, skip + (start + from - pos), page->frame + from, to - from,
+                 /*to_iov=*/false);
+        page->len = MAX(page->len, to);
+        page->version++;
+        /* a write-back in progress may overwrite the host data with the old contents */
+        if (cache->wb_handle)
+            set_dirty(page);
+    }
+    unlock(&g_page_cache_lock);
+}
+
+int page_cache_create(enum page_cache_mode mode, const char* uri, struct page_cache** out_cache) {
+    assert(mode != PAGE_CACHE_DISABLED);
+
+    size_t uri_len = strlen(uri);
+    struct page_cache* cache = calloc(1, sizeof(*cache) + uri_len + 1);
+    if (!cache)
+        return -ENOMEM;
+
+    if (!create_lock(&cache->flush_lock)) {
+        free(cache);
+        return -ENOMEM;
+    }
+    cache->mode = mode;
+    cache->pages.cmp = page_cmp;
+    INIT_LIST_HEAD(cache, dirty_list);
+    memcpy(cache->uri, uri, uri_len + 1);
+
+    *out_cache = cache;
+    return 0;
+}
+
+static void free_cache(struct page_cache* cache) {
+    assert(!cache->pages.root && !cache->dirty_cnt);
+    if (cache->wb_handle)
+        DkObjectClose(cache->wb_handle);
+    destroy_lock(&cache->flush_lock);
+    free(cache);
+}
+
+static void invalidate_pages(struct page_cache* cache, uint64_t idx) {
+    assert(locked(&g_page_cache_lock));
+
+    cache->gen++;
+    struct page_cache_page* page = next_page(cache, idx);
+    while (page) {
+        struct page_cache_page* next = page_after(page);
+        remove_page(page);
+        page = next;
+    }
+}
+
+void page_cache_destroy(struct page_cache* cache) {
+    int ret = page_cache_flush(cache);
+    if (ret < 0)
+        log_warning("Failed to write back cached pages of %s: %d", cache->uri, ret);
+
+    page_cache_invalidate(cache, 0);
+
+    lock(&g_page_cache_lock);
+    cache->destroyed = true;
+    bool free_it = !cache->refs;
+    unlock(&g_page_cache_lock);
+
+    if (free_it)
+        free_cache(cache);
+}
+
+bool page_cache_enabled(struct page_cache* cache) {
+    return !__atomic_load_n(&cache->disabled, __ATOMIC_ACQUIRE);
+}
+
+ssize_t page_cache_read(struct page_cache* cache, PAL_HANDLE pal_handle, const struct iovec* iov,
+                        size_t iov_cnt, off_t pos, off_t file_size) {
+    size_t count = iov_total_len(iov, iov_cnt);
+    size_t done = 0;
+    char* bounce = NULL;
+    ssize_t ret = 0;
+
+    lock(&g_page_cache_lock);
+    if (count >= PAGE_CACHE_BYPASS_SIZE && !cache->dirty_cnt) {
+        g_stats.bypassed++;
+        unlock(&g_page_cache_lock);
+        return -ENOSYS;
+    }
+
+    while (done < count) {
+        uint64_t cur = pos + done;
+        uint64_t idx = cur / PAGE_CACHE_PAGE_SIZE;
+        size_t off = cur % PAGE_CACHE_PAGE_SIZE;
+
+        struct page_cache_page* page = find_page(cache, idx);
+        if (page) {
+            g_stats.hits++;
+            extend_page(page, file_size);
+            touch_page(page);
+            if (page->len <= off)
+                break;
+            size_t n = MIN(page->len - off, count - done);
+            copy_iov(iov, iov_cnt, done, page->frame + off, n, /*to_iov=*/true);
+            done += n;
+            if (page->len < PAGE_CACHE_PAGE_SIZE)
+                break;
+            continue;
+        }
+
+        /* read all missing pages of the request (plus the read-ahead window if the reads are
+         * sequential) at once, up to the next cached page */
+        size_t needed = (off + count - done + PAGE_CACHE_PAGE_SIZE - 1) / PAGE_CACHE_PAGE_SIZE;
+        size_t cnt = needed;
+        if (idx == cache->ra_next) {
+            cache->ra_window = cache->ra_window
+                               ? MIN(cache->ra_window * 2, PAGE_CACHE_READAHEAD_MAX)
+                               : PAGE_CACHE_READAHEAD_MIN;
+            cnt = MAX(cnt, cache->ra_window);
+        } else {
+            cache->ra_window = 0;
+        }
+        cnt = MIN(cnt, PAGE_CACHE_READAHEAD_MAX);
+        struct page_cache_page* next = next_page(cache, idx);
+        if (next)
+            cnt = MIN(cnt, next->index - idx);
+        uint64_t gen = cache->gen;
+        unlock(&g_page_cache_lock);
+
+        if (!bounce && !(bounce = get_bounce())) {
+            ret = -ENOMEM;
+            goto out;
+        }
+        uint64_t start = idx * PAGE_CACHE_PAGE_SIZE;
+        size_t size = cnt * PAGE_CACHE_PAGE_SIZE;
+        int pal_ret = DkStreamRead(pal_handle, start, &size, bounce, NULL, 0);
+
+        lock(&g_page_cache_lock);
+        if (pal_ret < 0) {
+            ret = pal_to_unix_errno(pal_ret);
+            break;
+        }
+        if (cache->gen != gen) {
+            /* the file was written during the read, the data may be stale */
+            continue;
+        }
+        if ((uint64_t)file_size > start + size) {
+            size_t valid = MIN(cnt * PAGE_CACHE_PAGE_SIZE, (uint64_t)file_size - start);
+            memset(bounce + size, 0, valid - size);
+            size = valid;
+        }
+
+        for (size_t i = 0; i * PAGE_CACHE_PAGE_SIZE < size; i++) {
+            /* another reader may have inserted the page in the meantime */
+            if (find_page(cache, idx + i))
+                continue;
+            page = insert_page(cache, idx + i);
+            if (!page)
+                break;
+            page->len = MIN(PAGE_CACHE_PAGE_SIZE, size - i * PAGE_CACHE_PAGE_SIZE);
+            memcpy(page->frame, bounce + i * PAGE_CACHE_PAGE_SIZE, page->len);
+            if (i < needed) {
+                g_stats.misses++;
+            } else {
+                g_stats.readahead++;
+            }
+        }
+        cache->ra_next = idx + cnt;
+
+        if (size <= off)
+            break;
+        size_t n = MIN(size - off, count - done);
+        copy_iov(iov, iov_cnt, done, bounce + off, n, /*to_iov=*/true);
+        done += n;
+        if (size < cnt * PAGE_CACHE_PAGE_SIZE)
+            break;
+    }
+    unlock(&g_page_cache_lock);
+
+out:
+    if (bounce)
+        put_bounce(bounce);
+    return done ? (ssize_t)done : ret;
+}
+
+/* Reads a partially written page from the host, so that the write can be done in the cache. */
+static void fill_page(struct page_cache* cache, uint64_t idx, off_t file_size) {
+    lock(&g_page_cache_lock);
+    bool cached = find_page(cache, idx);
+    uint64_t gen = cache->gen;
+    unlock(&g_page_cache_lock);
+    if (cached)
+        return;
+
+    char* bounce = get_bounce();
+    if (!bounce)
+        return;
+
+    uint64_t start = idx * PAGE_CACHE_PAGE_SIZE;
+    size_t size = PAGE_CACHE_PAGE_SIZE;
+    int ret = DkStreamRead(cache->wb_handle, start, &size, bounce, NULL, 0);
+    if (ret == 0) {
+        if ((uint64_t)file_size > start + size) {
+            size_t valid = MIN(PAGE_CACHE_PAGE_SIZE, (uint64_t)file_size - start);
+            memset(bounce + size, 0, valid - size);
+            size = valid;
+        }
+
+        lock(&g_page_cache_lock);
+        struct page_cache_page* page;
+        if (cache->gen == gen && !find_page(cache, idx) && (page = insert_page(cache, idx))) {
+            page->len = size;
+            memcpy(page->frame, bounce, size);
+            g_stats.misses++;
+        }
+        unlock(&g_page_cache_lock);
+    }
+    put_bounce(bounce);
+}
+
+static int open_wb_handle(struct page_cache* cache) {
+    if (__atomic_load_n(&cache->wb_handle, __ATOMIC_ACQUIRE))
+        return 0;
+
+    PAL_HANDLE handle;
+    int ret = DkStreamOpen(cache->uri, PAL_ACCESS_RDWR, /*share_flags=*/0, /*create=*/0,
+                           /*options=*/0, &handle);
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+
+    lock(&g_page_cache_lock);
+    if (!cache->wb_handle) {
+        __atomic_store_n(&cache->wb_handle, handle, __ATOMIC_RELEASE);
+        handle = NULL;
+    }
+    unlock(&g_page_cache_lock);
+    if (handle)
+        DkObjectClose(handle);
+    return 0;
+}
+
+static ssize_t write_back_cached(struct page_cache* cache, PAL_HANDLE pal_handle,
+                                 const struct iovec* iov, size_t iov_cnt, off_t pos,
+                                 off_t file_size) {
+    size_t count = iov_total_len(iov, iov_cnt);
+
+    /* partially written pages which contain file data have to be read first */
+    uint64_t first = pos / PAGE_CACHE_PAGE_SIZE;
+    uint64_t last = (pos + count - 1) / PAGE_CACHE_PAGE_SIZE;
+    if (pos % PAGE_CACHE_PAGE_SIZE && (uint64_t)file_size > first * PAGE_CACHE_PAGE_SIZE)
+        fill_page(cache, first, file_size);
+    if ((pos + count) % PAGE_CACHE_PAGE_SIZE && last != first
+            && (uint64_t)file_size > pos + count)
+        fill_page(cache, last, file_size);
+
+    size_t done = 0;
+    lock(&g_page_cache_lock);
+    cache->gen++;
+    while (done < count) {
+        uint64_t cur = pos + done;
+        uint64_t idx = cur / PAGE_CACHE_PAGE_SIZE;
+        size_t off = cur % PAGE_CACHE_PAGE_SIZE;
+        size_t n = MIN(PAGE_CACHE_PAGE_SIZE - off, count - done);
+        uint64_t start = idx * PAGE_CACHE_PAGE_SIZE;
+
+        struct page_cache_page* page = find_page(cache, idx);
+        if (!page) {
+            /* without host data, a new page is correct only if the write determines all of it */
+            bool determined = start >= (uint64_t)file_size
+                              || (off == 0 && (n == PAGE_CACHE_PAGE_SIZE
+                                               || cur + n >= (uint64_t)file_size));
+            if (!determined || !(page = insert_page(cache, idx)))
+                break;
+        }
+
+        extend_page(page, file_size);
+        if (off > page->len)
+            memset(page->frame + page->len, 0, off - page->len);
+        copy_iov(iov, iov_cnt, done, page->frame + off, n, /*to_iov=*/false);
+        page->len = MAX(page->len, off + n);
+        page->version++;
+        set_dirty(page);
+        done += n;
+    }
+    bool flush_file = cache->dirty_cnt > PAGE_CACHE_FILE_DIRTY_MAX;
+    bool flush_all = g_stats.dirty_pages > g_budget_pages / 2;
+    unlock(&g_page_cache_lock);
+
+    ssize_t ret = done;
+    if (done < count) {
+        /* no free frame, or the page would have to be read: write the rest directly */
+        ssize_t host_ret = host_write(pal_handle, iov, iov_cnt, done, count - done, pos + done);
+        if (host_ret > 0) {
+            update_pages(cache, iov, iov_cnt, done, host_ret, pos + done);
+            ret += host_ret;
+        } else if (host_ret < 0 && !done) {
+            ret = host_ret;
+        }
+    }
+
+    int flush_ret = 0;
+    if (flush_all) {
+        flush_ret = page_cache_flush_all();
+    } else if (flush_file) {
+        flush_ret = page_cache_flush(cache);
+    }
+    if (flush_ret < 0)
+        log_warning("Failed to write back cached pages: %d", flush_ret);
+    return ret;
+}
+
+ssize_t page_cache_write(struct page_cache* cache, PAL_HANDLE pal_handle, const struct iovec* iov,
+                         size_t iov_cnt, off_t pos, off_t file_size) {
+    size_t count = iov_total_len(iov, iov_cnt);
+    if (!count)
+        return 0;
+
+    if (cache->mode == PAGE_CACHE_WRITE_BACK && open_wb_handle(cache) == 0)
+        return write_back_cached(cache, pal_handle, iov, iov_cnt, pos, file_size);
+
+    ssize_t ret = host_write(pal_handle, iov, iov_cnt, /*skip=*/0, count, pos);
+    if (ret > 0)
+        update_pages(cache, iov, iov_cnt, /*skip=*/0, ret, pos);
+    return ret;
+}
+
+int page_cache_flush(struct page_cache* cache) {
+    uint64_t versions[PAGE_CACHE_READAHEAD_MAX];
+    uint64_t idx = 0;
+    int ret = 0;
+
+    char* bounce = get_bounce();
+    if (!bounce)
+        return -ENOMEM;
+
+    lock(&cache->flush_lock);
+    while (true) {
+        lock(&g_page_cache_lock);
+        struct page_cache_page* page = cache->dirty_cnt ? next_page(cache, idx) : NULL;
+        while (page && !page->dirty)
+            page = page_after(page);
+        if (!page) {
+            unlock(&g_page_cache_lock);
+            break;
+        }
+
+        /* a run of consecutive dirty pages; only the last page of the file can be partial */
+        size_t cnt = 0;
+        size_t size = 0;
+        uint64_t start = page->index;
+        while (page && page->dirty && page->index == start + cnt && cnt < ARRAY_SIZE(versions)) {
+            memcpy(bounce + size, page->frame, page->len);
+            versions[cnt] = page->version;
+            size += page->len;
+            cnt++;
+            if (page->len < PAGE_CACHE_PAGE_SIZE)
+                break;
+            page = page_after(page);
+        }
+        PAL_HANDLE handle = cache->wb_handle;
+        unlock(&g_page_cache_lock);
+
+        /* the pages stay dirty (so they are not evicted and re-read from the host) until the write
+         * completes */
+        assert(handle);
+        size_t written = 0;
+        while (written < size) {
+            size_t n = size - written;
+            ret = DkStreamWrite(handle, start * PAGE_CACHE_PAGE_SIZE + written, &n,
+                                bounce + written, NULL);
+            if (ret < 0) {
+                ret = pal_to_unix_errno(ret);
+                break;
+            }
+            if (!n) {
+                ret = -EIO;
+                break;
+            }
+            written += n;
+        }
+        if (ret < 0)
+            break;
+
+        lock(&g_page_cache_lock);
+        for (size_t i = 0; i < cnt; i++) {
+            page = find_page(cache, start + i);
+            if (page && page->version == versions[i])
+                set_clean(page);
+        }
+        g_stats.writebacks += cnt;
+        unlock(&g_page_cache_lock);
+        idx = start + cnt;
+    }
+    unlock(&cache->flush_lock);
+
+    put_bounce(bounce);
+    return ret;
+}
+
+int page_cache_flush_all(void) {
+    int ret = 0;
+    size_t caches_cnt = 0;
+
+    lock(&g_page_cache_lock);
+    struct page_cache* cache;
+    LISTP_FOR_EACH_ENTRY(cache, &g_dirty_caches, dirty_list) {
+        caches_cnt++;
+    }
+    unlock(&g_page_cache_lock);
+
+    /* each flush removes a cache from the list (or fails), so this terminates even when other
+     * threads keep writing */
+    for (size_t i = 0; i < caches_cnt; i++) {
+        lock(&g_page_cache_lock);
+        if (LISTP_EMPTY(&g_dirty_caches)) {
+            unlock(&g_page_cache_lock);
+            break;
+        }
+        cache = LISTP_FIRST_ENTRY(&g_dirty_caches, struct page_cache, dirty_list);
+        /* move it to the end, so that a cache which fails to write back does not block others */
+        LISTP_DEL(cache, &g_dirty_caches, dirty_list);
+        LISTP_ADD_TAIL(cache, &g_dirty_caches, dirty_list);
+        cache->refs++;
+        unlock(&g_page_cache_lock);
+
+        int flush_ret = page_cache_flush(cache);
+        if (flush_ret < 0) {
+            log_warning("Failed to write back cached pages of %s: %d", cache->uri, flush_ret);
+            ret = flush_ret;
+        }
+
+        lock(&g_page_cache_lock);
+        bool free_it = !--cache->refs && cache->destroyed;
+        unlock(&g_page_cache_lock);
+        if (free_it)
+            free_cache(cache);
+    }
+    return ret;
+}
+
+void page_cache_invalidate(struct page_cache* cache, off_t from) {
+    lock(&cache->flush_lock);
+    lock(&g_page_cache_lock);
+    invalidate_pages(cache, from / PAGE_CACHE_PAGE_SIZE);
+    unlock(&g_page_cache_lock);
+    unlock(&cache->flush_lock);
+}
+
+int page_cache_disable(struct page_cache* cache) {
+    __atomic_store_n(&cache->disabled, true, __ATOMIC_RELEASE);
+
+    int ret = page_cache_flush(cache);
+    if (ret < 0)
+        return ret;
+    page_cache_invalidate(cache, 0);
+    return 0;
+}
+
+void page_cache_get_stats(struct page_cache_stats* stats) {
+    lock(&g_page_cache_lock);
+    *stats = g_stats;
+    stats->budget_pages = g_budget_pages;
+    unlock(&g_page_cache_lock);
+}
@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Readiness notification for objects emulated inside the LibOS, see `struct shim_poll_notifier`.
+ *
+ * The events are LibOS events (host pipes with at most one pending byte), so they can be waited on
+ * together with host streams. An event is set and cleared only on transitions between "its waiters
+ * would be woken" and "its waiters would not be woken", and only while it has waiters.
+ */
+
+#include "pal.h"
+#include "shim_fs.h"
+#include "shim_internal.h"
+
+static size_t event_index(PAL_FLG events) {
+    static_assert(PAL_WAIT_READ == 2 && PAL_WAIT_WRITE == 4, "unexpected PAL_WAIT_* values");
+    return (events & (PAL_WAIT_READ | PAL_WAIT_WRITE)) >> 1;
+}
+
+static int sync_event(struct shim_poll_notifier* notifier, size_t idx) {
+    if (!event_handle(&notifier->events[idx].event))
+        return 0;
+
+    PAL_FLG events = idx << 1;
+    bool set = notifier->events[idx].waiters
+               && (notifier->state & (events | PAL_WAIT_ERROR));
+    if (set == notifier->events[idx].set)
+        return 0;
+
+    int ret = set ? set_event(&notifier->events[idx].event, 1)
+                  : clear_event(&notifier->events[idx].event);
+    if (ret < 0)
+        return ret;
+    notifier->events[idx].set = set;
+    return 0;
+}
+
+int poll_notifier_get(struct shim_poll_notifier* notifier, PAL_FLG events, PAL_HANDLE* out_event) {
+    size_t idx = event_index(events);
+    if (!event_handle(&notifier->events[idx].event)) {
+        int ret = create_event(&notifier->events[idx].event);
+        if (ret < 0)
+            return ret;
+        notifier->events[idx].set = false;
+    }
+
+    notifier->events[idx].waiters++;
+    int ret = sync_event(notifier, idx);
+    if (ret < 0) {
+        notifier->events[idx].waiters--;
+        return ret;
+    }
+
+    *out_event = event_handle(&notifier->events[idx].event);
+    return 0;
+}
+
+void poll_notifier_put(struct shim_poll_notifier* notifier, PAL_FLG events) {
+    size_t idx = event_index(events);
+    assert(notifier->events[idx].waiters);
+    notifier->events[idx].waiters--;
+
+    /* a stale set event only causes a spurious wakeup of a later waiter, which checks the object
+     * anyway */
+    (void)sync_event(notifier, idx);
+}
+
+void poll_notifier_set_state(struct shim_poll_notifier* notifier, PAL_FLG state) {
+    notifier->state = state;
+    for (size_t i = 0; i < ARRAY_SIZE(notifier->events); i++) {
+        int ret = sync_event(notifier, i);
+        if (ret < 0)
+            log_warning("Failed to update a poll notifier: %d", ret);
+    }
+}
+
+void poll_notifier_destroy(struct shim_poll_notifier* notifier) {
+    for (size_t i = 0; i < ARRAY_SIZE(notifier->events); i++) {
+        assert(!notifier->events[i].waiters);
+        destroy_event(&notifier->events[i].event);
+    }
+}
@@ -90,8 +90,10 @@ out:
     return node;
 }
 
-static int pseudo_mount(const char* uri, void** mount_data) {
+static int pseudo_mount(const char* uri, const struct manifest_node* options,
+                        void** mount_data) {
     __UNUSED(uri);
+    __UNUSED(options);
     __UNUSED(mount_data);
     return 0;
 }
@@ -124,11 +124,11 @@ static int validate_dentry(struct shim_dentry* dent) {
         }
         dent->perm = mode & ~S_IFMT;
         dent->type = mode & S_IFMT;
-        dent->state |= DENTRY_VALID;
+        dentry_update_state(dent, /*clear=*/0, DENTRY_VALID);
         return 0;
     } else if (ret == -ENOENT) {
         /* File not found, mark dentry as negative */
-        dent->state |= DENTRY_VALID | DENTRY_NEGATIVE;
+        dentry_update_state(dent, /*clear=*/0, DENTRY_VALID | DENTRY_NEGATIVE);
         return 0;
     } else {
         /* Lookup failed, keep dentry as invalid */
@@ -275,14 +275,14 @@ static int lookup_enter_dentry(struct lookup* lookup) {
          * - otherwise, fail with -ENOENT.
          */
         if (lookup->flags & LOOKUP_MAKE_SYNTHETIC) {
-            lookup->dent->state &= ~DENTRY_NEGATIVE;
-            lookup->dent->state |= DENTRY_VALID | DENTRY_SYNTHETIC;
+            int state = DENTRY_VALID | DENTRY_SYNTHETIC;
             if (!is_final || has_slash) {
-                lookup->dent->state |= DENTRY_ISDIRECTORY;
+                state |= DENTRY_ISDIRECTORY;
                 lookup->dent->type = S_IFDIR;
             } else {
                 lookup->dent->type = S_IFREG;
             }
+            dentry_update_state(lookup->dent, DENTRY_NEGATIVE, state);
         } else if (is_final && (lookup->flags & LOOKUP_CREATE)) {
             /* proceed with a negative dentry */
         } else {
@@ -428,10 +428,128 @@ int _path_lookupat(struct shim_dentry* start, const char* path, int flags,
     return do_path_lookupat(start, path, flags, found, /*link_depth=*/0);
 }
 
+/* Lockless version of `lookup_enter_dentry`: handles only dentries that are already valid, and
+ * returns -EAGAIN if the slow path is needed (to validate a dentry, follow a symbolic link or return
+ * a negative dentry for LOOKUP_CREATE). */
+static int lookup_enter_dentry_lockless(struct shim_dentry** dent, bool is_final, bool has_slash,
+                                        int flags) {
+    struct shim_dentry* cur_dent = *dent;
+    int state = __atomic_load_n(&cur_dent->state, __ATOMIC_ACQUIRE);
+    if (!(state & DENTRY_VALID))
+        return -EAGAIN;
+
+    struct shim_mount* mount;
+    while ((mount = __atomic_load_n(&cur_dent->attached_mount, __ATOMIC_ACQUIRE))) {
+        cur_dent = mount->root;
+        state = __atomic_load_n(&cur_dent->state, __ATOMIC_ACQUIRE);
+        if (!(state & DENTRY_VALID))
+            return -EAGAIN;
+    }
+
+    if (state & DENTRY_NEGATIVE) {
+        if (is_final && (flags & LOOKUP_CREATE))
+            return -EAGAIN;
+        return -ENOENT;
+    }
+
+    if (state & DENTRY_ISLINK) {
+        if (!is_final || has_slash || (flags & LOOKUP_FOLLOW))
+            return -EAGAIN;
+    } else if (!(state & DENTRY_ISDIRECTORY)) {
+        if (!is_final || has_slash || (flags & LOOKUP_DIRECTORY))
+            return -ENOTDIR;
+    }
+
+    *dent = cur_dent;
+    return 0;
+}
+
+/*
+ * Fast path of `path_lookupat` for paths that are fully cached: walks the dcache in a lockless read
+ * section, without `g_dcache_lock` and without references to intermediate dentries, and takes
+ * a reference only to the final dentry. Returns -EAGAIN if the lookup has to be retried with
+ * `_path_lookupat`; other results (including errors) are the same as `_path_lookupat` would return.
+ *
+ * The traversed memory stays valid because of the dcache's own reclamation (see
+ * `begin_dcache_lockless_read`): a dentry whose last reference is dropped during a read section is
+ * retired and freed only after the count of readers drops to zero, and hash tables of children
+ * replaced by bigger ones stay chained to the new table until the directory itself is freed.
+ */
+static int path_lookupat_lockless(struct shim_dentry* start, const char* path, int flags,
+                                  struct shim_dentry** found) {
+    if (flags & LOOKUP_MAKE_SYNTHETIC)
+        return -EAGAIN;
+
+    if (*path == '\0')
+        return -ENOENT;
+
+    size_t path_len = strlen(path);
+    bool has_slash = path[path_len - 1] == '/';
+    const char* name = eat_slashes(path);
+
+    begin_dcache_lockless_read();
+
+    /* `g_process.root` and `g_process.cwd` are replaced before the old dentry is put, so we can
+     * read them without `g_process.fs_lock` */
+    struct shim_dentry* dent;
+    if (*path == '/') {
+        dent = __atomic_load_n(&g_process.root, __ATOMIC_ACQUIRE) ?: g_dentry_root;
+    } else if (!start) {
+        dent = __atomic_load_n(&g_process.cwd, __ATOMIC_ACQUIRE);
+    } else {
+        dent = start;
+    }
+
+    int ret = dent ? lookup_enter_dentry_lockless(&dent, *name == '\0', has_slash, flags) : -EAGAIN;
+    while (ret == 0 && *name != '\0') {
+        const char* name_end = name;
+        while (*name_end != '\0' && *name_end != '/')
+            name_end++;
+        size_t name_len = name_end - name;
+
+        if (name_len > NAME_MAX) {
+            ret = -ENAMETOOLONG;
+            break;
+        }
+
+        if (name_len == 1 && name[0] == '.') {
+            /* stay in `dent` */
+        } else if (name_len == 2 && name[0] == '.' && name[1] == '.') {
+            dent = dentry_up(dent) ?: dent;
+        } else {
+            dent = lookup_dcache_lockless(dent, name, name_len);
+            if (!dent) {
+                ret = -EAGAIN;
+                break;
+            }
+        }
+
+        name = eat_slashes(name_end);
+        ret = lookup_enter_dentry_lockless(&dent, *name == '\0', has_slash, flags);
+    }
+
+    /* the final dentry might have just been removed from the dcache */
+    if (ret == 0 && !REF_INC_NOT_ZERO(dent->ref_count))
+        ret = -EAGAIN;
+
+    end_dcache_lockless_read();
+
+    if (ret == 0)
+        *found = dent;
+    return ret;
+}
+
 int path_lookupat(struct shim_dentry* start, const char* path, int flags,
                    struct shim_dentry** found) {
+    int ret = path_lookupat_lockless(start, path, flags, found);
+    if (ret != -EAGAIN) {
+        if (ret < 0)
+            *found = NULL;
+        return ret;
+    }
+
     lock(&g_dcache_lock);
-    int ret = do_path_lookupat(start, path, flags, found, /*link_depth=*/0);
+    ret = do_path_lookupat(start, path, flags, found, /*link_depth=*/0);
     unlock(&g_dcache_lock);
     return ret;
 }
@@ -535,11 +653,19 @@ int open_namei(struct shim_handle* hdl, struct shim_dentry* start, const char* p
     if (hdl)
         assert(!hdl->dentry);
 
+    /* Without O_CREAT, the path is walked without `g_dcache_lock` if all of it is cached. The
+     * checks and the open below still run under the lock: the dentry can become negative (e.g.
+     * after a concurrent unlink) once the walk is finished. */
+    ret = -EAGAIN;
+    if (!(flags & O_CREAT))
+        ret = path_lookupat_lockless(start, path, lookup_flags, &dent);
     lock(&g_dcache_lock);
-
-    ret = _path_lookupat(start, path, lookup_flags, &dent);
-    if (ret < 0)
+    if (ret == -EAGAIN)
+        ret = _path_lookupat(start, path, lookup_flags, &dent);
+    if (ret < 0) {
+        dent = NULL;
         goto err;
+    }
 
     assert(dent->state & DENTRY_VALID);
 
@@ -591,9 +717,8 @@ int open_namei(struct shim_handle* hdl, struct shim_dentry* start, const char* p
             ret = dir->fs->d_ops->mkdir(dir, dent, mode);
             if (ret < 0)
                 goto err;
-            dent->state &= ~DENTRY_NEGATIVE;
-            dent->state |= DENTRY_ISDIRECTORY;
             dent->type = S_IFDIR;
+            dentry_update_state(dent, DENTRY_NEGATIVE, DENTRY_ISDIRECTORY);
         } else {
             if (!dir->fs->d_ops->creat) {
                 ret = -EINVAL;
@@ -602,7 +727,7 @@ int open_namei(struct shim_handle* hdl, struct shim_dentry* start, const char* p
             ret = dir->fs->d_ops->creat(hdl, dir, dent, flags, mode);
             if (ret < 0)
                 goto err;
-            dent->state &= ~DENTRY_NEGATIVE;
+            dentry_update_state(dent, DENTRY_NEGATIVE, /*set=*/0);
             assoc_handle_with_dentry(hdl, dent, flags);
             need_open = false;
         }
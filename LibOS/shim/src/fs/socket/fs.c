@@ -15,47 +15,80 @@
 #include "pal_error.h"
 #include "shim_fs.h"
 #include "shim_internal.h"
+#include "shim_local_pipe.h"
 #include "shim_lock.h"
 #include "shim_process.h"
 #include "shim_signal.h"
+#include "shim_utils.h"
 #include "stat.h"
 
 static int socket_close(struct shim_handle* hdl) {
-    /* XXX: Shouldn't this do something? */
-    __UNUSED(hdl);
+    if (hdl->info.sock.local)
+        local_pipe_close(hdl);
     return 0;
 }
 
-static ssize_t socket_read(struct shim_handle* hdl, void* buf, size_t count) {
+/* Checks that the socket is connected, so that read/write without an address make sense. */
+static int socket_check_connected(struct shim_handle* hdl) {
     assert(hdl->type == TYPE_SOCK);
     struct shim_sock_handle* sock = &hdl->info.sock;
+    int ret = 0;
 
     lock(&hdl->lock);
 
     if (sock->sock_type == SOCK_STREAM && sock->sock_state != SOCK_ACCEPTED &&
         sock->sock_state != SOCK_CONNECTED && sock->sock_state != SOCK_BOUNDCONNECTED) {
         sock->error = ENOTCONN;
-        unlock(&hdl->lock);
-        return -ENOTCONN;
+        ret = -ENOTCONN;
+    } else if (sock->sock_type == SOCK_DGRAM && sock->sock_state != SOCK_CONNECTED &&
+               sock->sock_state != SOCK_BOUNDCONNECTED) {
+        sock->error = EDESTADDRREQ;
+        ret = -EDESTADDRREQ;
     }
 
-    if (sock->sock_type == SOCK_DGRAM && sock->sock_state != SOCK_CONNECTED &&
-        sock->sock_state != SOCK_BOUNDCONNECTED) {
-        sock->error = EDESTADDRREQ;
-        unlock(&hdl->lock);
-        return -EDESTADDRREQ;
+    unlock(&hdl->lock);
+    return ret;
+}
+
+static void socket_io_failed(struct shim_handle* hdl, int err, bool write) {
+    if (write && err == -EPIPE) {
+        siginfo_t info = {
+            .si_signo = SIGPIPE,
+            .si_pid = g_process.pid,
+            .si_code = SI_USER,
+        };
+        if (kill_current_proc(&info) < 0) {
+            log_error("socket_write: failed to deliver a signal");
+        }
     }
 
+    lock(&hdl->lock);
+    hdl->info.sock.error = -err;
     unlock(&hdl->lock);
+}
+
+static ssize_t socket_read(struct shim_handle* hdl, void* buf, size_t count) {
+    int ret = socket_check_connected(hdl);
+    if (ret < 0)
+        return ret;
+
+    if (hdl->info.sock.local) {
+        struct iovec iov = {.iov_base = buf, .iov_len = count};
+        ssize_t local_ret = local_pipe_read(hdl, &iov, 1, /*peek=*/false,
+                                            hdl->flags & O_NONBLOCK);
+        if (local_ret != -ELOCALPIPEPROMOTED) {
+            if (local_ret < 0)
+                socket_io_failed(hdl, local_ret, /*write=*/false);
+            return local_ret;
+        }
+    }
 
     size_t orig_count = count;
-    int ret = DkStreamRead(hdl->pal_handle, 0, &count, buf, NULL, 0);
+    ret = DkStreamRead(hdl->pal_handle, 0, &count, buf, NULL, 0);
     ret = pal_to_unix_errno(ret);
     maybe_epoll_et_trigger(hdl, ret, /*in=*/true, ret == 0 ? count < orig_count : false);
     if (ret < 0) {
-        lock(&hdl->lock);
-        sock->error = -ret;
-        unlock(&hdl->lock);
+        socket_io_failed(hdl, ret, /*write=*/false);
         return ret;
     }
 
@@ -63,67 +96,119 @@ static ssize_t socket_read(struct shim_handle* hdl, void* buf, size_t count) {
 }
 
 static ssize_t socket_write(struct shim_handle* hdl, const void* buf, size_t count) {
-    assert(hdl->type == TYPE_SOCK);
-    struct shim_sock_handle* sock = &hdl->info.sock;
-
-    lock(&hdl->lock);
+    int ret = socket_check_connected(hdl);
+    if (ret < 0)
+        return ret;
 
-    if (sock->sock_type == SOCK_STREAM && sock->sock_state != SOCK_ACCEPTED &&
-        sock->sock_state != SOCK_CONNECTED && sock->sock_state != SOCK_BOUNDCONNECTED) {
-        sock->error = ENOTCONN;
-        unlock(&hdl->lock);
-        return -ENOTCONN;
+    if (hdl->info.sock.local) {
+        struct iovec iov = {.iov_base = (void*)buf, .iov_len = count};
+        ssize_t local_ret = local_pipe_write(hdl, &iov, 1, hdl->flags & O_NONBLOCK);
+        if (local_ret != -ELOCALPIPEPROMOTED) {
+            if (local_ret < 0)
+                socket_io_failed(hdl, local_ret, /*write=*/true);
+            return local_ret;
+        }
     }
 
-    if (sock->sock_type == SOCK_DGRAM && sock->sock_state != SOCK_CONNECTED &&
-        sock->sock_state != SOCK_BOUNDCONNECTED) {
-        sock->error = EDESTADDRREQ;
-        unlock(&hdl->lock);
-        return -EDESTADDRREQ;
+    size_t orig_count = count;
+    ret = DkStreamWrite(hdl->pal_handle, 0, &count, (void*)buf, NULL);
+    ret = pal_to_unix_errno(ret);
+    maybe_epoll_et_trigger(hdl, ret, /*in=*/false, ret == 0 ? count < orig_count : false);
+    if (ret < 0) {
+        socket_io_failed(hdl, ret, /*write=*/true);
+        return ret;
     }
 
-    unlock(&hdl->lock);
+    return (ssize_t)count;
+}
+
+static ssize_t socket_write_from(struct shim_handle* hdl, PAL_HANDLE src, off_t src_pos,
+                                 size_t count, const off_t* pos) {
+    assert(!pos);
+    __UNUSED(pos);
+    int ret = socket_check_connected(hdl);
+    if (ret < 0)
+        return ret;
+
+    if (hdl->info.sock.local) {
+        ssize_t local_ret = local_pipe_write_from(hdl, src, src_pos, count);
+        if (local_ret != -ELOCALPIPEPROMOTED) {
+            if (local_ret < 0)
+                socket_io_failed(hdl, local_ret, /*write=*/true);
+            return local_ret;
+        }
+    }
 
     size_t orig_count = count;
-    int ret = DkStreamWrite(hdl->pal_handle, 0, &count, (void*)buf, NULL);
+    ret = DkStreamTransfer(src, src_pos, hdl->pal_handle, /*dst_offset=*/0, &count);
     ret = pal_to_unix_errno(ret);
     maybe_epoll_et_trigger(hdl, ret, /*in=*/false, ret == 0 ? count < orig_count : false);
     if (ret < 0) {
-        if (ret == -EPIPE) {
-            siginfo_t info = {
-                .si_signo = SIGPIPE,
-                .si_pid = g_process.pid,
-                .si_code = SI_USER,
-            };
-            if (kill_current_proc(&info) < 0) {
-                log_error("socket_write: failed to deliver a signal");
-            }
-        }
-
-        lock(&hdl->lock);
-        sock->error = -ret;
-        unlock(&hdl->lock);
+        socket_io_failed(hdl, ret, /*write=*/true);
         return ret;
     }
 
     return (ssize_t)count;
 }
 
+static ssize_t socket_iov_io(struct shim_handle* hdl, enum PAL_IO_OP op, const struct iovec* iov,
+                             size_t iov_cnt) {
+    int check_ret = socket_check_connected(hdl);
+    if (check_ret < 0)
+        return check_ret;
+
+    ssize_t ret;
+    if (hdl->info.sock.local) {
+        bool nonblocking = hdl->flags & O_NONBLOCK;
+        ret = op == PAL_IO_READ
+              ? local_pipe_read(hdl, iov, iov_cnt, /*peek=*/false, nonblocking)
+              : local_pipe_write(hdl, iov, iov_cnt, nonblocking);
+        if (ret != -ELOCALPIPEPROMOTED) {
+            if (ret < 0)
+                socket_io_failed(hdl, ret, /*write=*/op == PAL_IO_WRITE);
+            return ret;
+        }
+    }
+
+    ret = pal_stream_iov_io(hdl->pal_handle, op, /*offset=*/0, iov, iov_cnt);
+    if (ret < 0)
+        ret = pal_to_unix_errno(ret);
+    maybe_epoll_et_trigger(hdl, ret < 0 ? ret : 0, /*in=*/op == PAL_IO_READ,
+                           ret >= 0 ? (size_t)ret < iov_total_len(iov, iov_cnt) : false);
+    if (ret < 0)
+        socket_io_failed(hdl, ret, /*write=*/op == PAL_IO_WRITE);
+    return ret;
+}
+
+static ssize_t socket_readv(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt) {
+    return socket_iov_io(hdl, PAL_IO_READ, iov, iov_cnt);
+}
+
+static ssize_t socket_writev(struct shim_handle* hdl, const struct iovec* iov, size_t iov_cnt) {
+    return socket_iov_io(hdl, PAL_IO_WRITE, iov, iov_cnt);
+}
+
 static int socket_hstat(struct shim_handle* hdl, struct stat* stat) {
     if (!stat)
         return 0;
 
-    PAL_STREAM_ATTR attr;
+    off_t size = -ELOCALPIPEPROMOTED;
+    if (hdl->info.sock.local)
+        size = local_pipe_poll(hdl, FS_POLL_SZ);
 
-    int ret = DkStreamAttributesQueryByHandle(hdl->pal_handle, &attr);
-    if (ret < 0) {
-        return pal_to_unix_errno(ret);
+    if (size == -ELOCALPIPEPROMOTED) {
+        PAL_STREAM_ATTR attr;
+        int ret = DkStreamAttributesQueryByHandle(hdl->pal_handle, &attr);
+        if (ret < 0) {
+            return pal_to_unix_errno(ret);
+        }
+        size = attr.pending_size;
     }
 
     memset(stat, 0, sizeof(struct stat));
 
     stat->st_ino  = 0;
-    stat->st_size = (off_t)attr.pending_size;
+    stat->st_size = size;
     stat->st_mode = S_IFSOCK;
 
     return 0;
@@ -166,6 +251,12 @@ static off_t socket_poll(struct shim_handle* hdl, int poll_type) {
         }
     }
 
+    if (sock->local) {
+        ret = local_pipe_poll(hdl, poll_type);
+        if (ret != -ELOCALPIPEPROMOTED)
+            goto out;
+    }
+
     if (!hdl->pal_handle) {
         ret = -EBADF;
         goto out;
@@ -201,6 +292,19 @@ out:
     return ret;
 }
 
+static int socket_poll_get(struct shim_handle* hdl, PAL_FLG events, PAL_HANDLE* out_event) {
+    if (!hdl->info.sock.local) {
+        *out_event = NULL;
+        return 0;
+    }
+    return local_pipe_poll_get(hdl, events, out_event);
+}
+
+static void socket_poll_put(struct shim_handle* hdl, PAL_FLG events) {
+    assert(hdl->info.sock.local);
+    local_pipe_poll_put(hdl, events);
+}
+
 static int socket_setflags(struct shim_handle* hdl, int flags) {
     if (!hdl->pal_handle)
         return 0;
@@ -233,12 +337,17 @@ static int socket_setflags(struct shim_handle* hdl, int flags) {
 }
 
 struct shim_fs_ops socket_fs_ops = {
-    .close    = &socket_close,
-    .read     = &socket_read,
-    .write    = &socket_write,
-    .hstat    = &socket_hstat,
-    .poll     = &socket_poll,
-    .setflags = &socket_setflags,
+    .close      = &socket_close,
+    .read       = &socket_read,
+    .write      = &socket_write,
+    .readv      = &socket_readv,
+    .writev     = &socket_writev,
+    .write_from = &socket_write_from,
+    .hstat      = &socket_hstat,
+    .poll       = &socket_poll,
+    .poll_get   = &socket_poll_get,
+    .poll_put   = &socket_poll_put,
+    .setflags   = &socket_setflags,
 };
 
 struct shim_fs socket_builtin_fs = {
@@ -38,8 +38,10 @@ struct shim_tmpfs_data {
     unsigned long nlink;
 };
 
-static int tmpfs_mount(const char* uri, void** mount_data) {
+static int tmpfs_mount(const char* uri, const struct manifest_node* options,
+                       void** mount_data) {
     __UNUSED(uri);
+    __UNUSED(options);
     __UNUSED(mount_data);
     return 0;
 }
@@ -497,7 +499,7 @@ static int tmpfs_rename(struct shim_dentry* old, struct shim_dentry* new) {
     tmpfs_data->ctime = time / 1000000;
 
     /* mark old file as non-existing now, after renaming */
-    old->state |= DENTRY_NEGATIVE;
+    dentry_update_state(old, /*clear=*/0, DENTRY_NEGATIVE);
     return 0;
 }
 
@@ -18,6 +18,7 @@
 #include "shim_checkpoint.h"
 #include "shim_internal.h"
 #include "shim_ipc.h"
+#include "shim_ipc_shm.h"
 #include "shim_lock.h"
 #include "shim_thread.h"
 #include "shim_types.h"
@@ -29,8 +30,10 @@ struct shim_ipc_connection {
     int seen_error;
     REFTYPE ref_count;
     PAL_HANDLE handle;
-    /* This lock guards concurrent accesses to `handle` and `seen_error`. If you need both this lock
-     * and `g_ipc_connections_lock`, take the latter first. */
+    /* If not NULL, messages are sent through this ring and `handle` is only used as a doorbell. */
+    struct ipc_shm_ring* ring;
+    /* This lock guards concurrent accesses to `handle`, `ring` and `seen_error`. If you need both
+     * this lock and `g_ipc_connections_lock`, take the latter first. */
     struct shim_lock lock;
 };
 
@@ -71,6 +74,11 @@ int init_ipc(void) {
         return -ENOMEM;
     }
 
+    int ret = init_ipc_shm();
+    if (ret < 0) {
+        return ret;
+    }
+
     return init_ipc_ids();
 }
 
@@ -82,6 +90,9 @@ static void put_ipc_connection(struct shim_ipc_connection* conn) {
     int64_t ref_count = REF_DEC(conn->ref_count);
 
     if (!ref_count) {
+        if (conn->ring) {
+            ipc_shm_ring_destroy(conn->ring);
+        }
         DkObjectClose(conn->handle);
         destroy_lock(&conn->lock);
         free(conn);
@@ -127,6 +138,10 @@ static int ipc_connect(IDTYPE dest, struct shim_ipc_connection** conn_ptr) {
         if (ret < 0) {
             goto out;
         }
+        ret = ipc_shm_connect(conn->handle, &conn->ring);
+        if (ret < 0) {
+            goto out;
+        }
 
         conn->vmid = dest;
         REF_SET(conn->ref_count, 1);
@@ -216,7 +231,11 @@ static int ipc_send_message_to_conn(struct shim_ipc_connection* conn, struct shi
         goto out;
     }
 
-    ret = write_exact(conn->handle, msg,  GET_UNALIGNED(msg->header.size));
+    if (conn->ring) {
+        ret = ipc_shm_send(conn->ring, conn->handle, msg);
+    } else {
+        ret = write_exact(conn->handle, msg, GET_UNALIGNED(msg->header.size));
+    }
     if (ret < 0) {
         log_error("Failed to send IPC msg to %u: %d", conn->vmid, ret);
         conn->seen_error = ret;
@@ -0,0 +1,563 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Shared-memory transport for IPC messages, see `shim_ipc_shm.h`.
+ *
+ * The ring is a power-of-two sized data area following a header in a host file mapped by both
+ * processes. `head` and `tail` count the bytes ever produced and consumed, so the ring is empty if
+ * they are equal. Records are 8-byte aligned and never wrap around: if a record does not fit before
+ * the end of the data area, the sender fills the rest with a skip record. A message record keeps
+ * the message at such an offset that its payload is 8-byte aligned, as callbacks read it in place.
+ *
+ * The doorbell uses the store-fence-load pattern on both sides: the receiver sets
+ * `receiver_waiting` and then checks `head`, the sender advances `head` and then checks
+ * `receiver_waiting`. At least one of them sees the store of the other, so either the receiver does
+ * not go to sleep or the sender rings.
+ */
+
+#include <stdalign.h>
+
+#include "api.h"
+#include "assert.h"
+#include "hex.h"
+#include "manifest.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "shim_internal.h"
+#include "shim_ipc.h"
+#include "shim_ipc_shm.h"
+#include "shim_utils.h"
+#include "shim_vma.h"
+
+#define IPC_SHM_MAGIC 0x474e495243504921UL
+
+#define IPC_SHM_MIN_RING_SIZE (64 * 1024UL)
+#define IPC_SHM_MAX_RING_SIZE (1024 * 1024 * 1024UL)
+
+/* Longest ring URI accepted from a sender. */
+#define IPC_SHM_URI_MAX 4096
+
+/* How long a sender waits (in microseconds) before checking again whether a full ring has space. */
+#define IPC_SHM_FULL_WAIT_US 100
+
+/* Offset of the message in a message record (and in the reassembly buffer), chosen so that the
+ * payload is 8-byte aligned. */
+#define IPC_SHM_MSG_OFFSET (32 - sizeof(struct ipc_msg_header))
+
+enum {
+    IPC_SHM_RECORD_SKIP = 1, /* unused space up to the end of the data area */
+    IPC_SHM_RECORD_MSG,      /* whole message, at IPC_SHM_MSG_OFFSET */
+    IPC_SHM_RECORD_PART,     /* part of a message too large for the ring, right after the record */
+};
+
+struct ipc_shm_record {
+    uint32_t size; /* size of the record without the padding to 8 bytes */
+    uint32_t type;
+};
+
+struct ipc_shm_header {
+    uint64_t magic;
+    uint64_t data_size;
+    uint32_t attached;         /* set by the receiver after it mapped the ring */
+    alignas(64) uint64_t head; /* written by the sender */
+    alignas(64) uint64_t tail; /* written by the receiver */
+    uint32_t receiver_waiting; /* set by the receiver, cleared by the sender when it rings */
+    alignas(64) char data[];
+};
+
+struct ipc_shm_ring {
+    struct ipc_shm_header* shared;
+    size_t map_size;
+    size_t data_size;
+    /* Sender only: the host file, deleted on destroy if the receiver never attached. */
+    PAL_HANDLE file;
+
+    /* Receiver only. */
+    uint64_t tail;         /* local copy of `shared->tail` */
+    size_t cur_size;       /* size of the record returned by `ipc_shm_peek` */
+    char* part_buf;        /* message being reassembled from parts, at IPC_SHM_MSG_OFFSET */
+    size_t part_size;
+    size_t part_received;
+    bool part_ready;       /* `part_buf` was returned by `ipc_shm_peek` */
+};
+
+static_assert(sizeof(struct ipc_msg_header) <= 32 - sizeof(struct ipc_shm_record),
+              "IPC message header does not fit into a ring record");
+
+/* URI of the host directory for rings, NULL if the transport is disabled. */
+static char* g_shm_dir = NULL;
+static size_t g_ring_size = 0;
+
+int init_ipc_shm(void) {
+    assert(g_manifest_root);
+    char* dir = NULL;
+    int ret = manifest_string_in(g_manifest_root, "libos.ipc.shm_dir", &dir);
+    if (ret < 0) {
+        log_error("Cannot parse 'libos.ipc.shm_dir'");
+        return -EINVAL;
+    }
+    if (!dir)
+        return 0;
+
+    if (!strstartswith(dir, URI_PREFIX_FILE)) {
+        log_error("'libos.ipc.shm_dir' must start with \"" URI_PREFIX_FILE "\"");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    if (!strcmp(g_pal_control->host_type, "Linux-SGX")) {
+        log_warning("'libos.ipc.shm_dir' is ignored on SGX: IPC messages are sent only through "
+                    "encrypted pipes");
+        ret = 0;
+        goto out;
+    }
+
+    uint64_t ring_size;
+    ret = manifest_sizestring_in(g_manifest_root, "libos.ipc.shm_ring_size",
+                                 IPC_SHM_DEFAULT_RING_SIZE, &ring_size);
+    if (ret < 0 || ring_size < IPC_SHM_MIN_RING_SIZE || ring_size > IPC_SHM_MAX_RING_SIZE
+            || !IS_POWER_OF_2(ring_size)) {
+        log_error("Cannot parse 'libos.ipc.shm_ring_size' (the value must be a power of two "
+                  "between 64K and 1G)");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    g_ring_size = ring_size;
+    g_shm_dir = dir;
+    dir = NULL;
+    ret = 0;
+out:
+    free(dir);
+    return ret;
+}
+
+static int map_ring(PAL_HANDLE file, size_t map_size, struct ipc_shm_header** out_shared) {
+    void* addr = NULL;
+    int ret = bkeep_mmap_any(map_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | VMA_INTERNAL, NULL, 0, "ipc_shm_ring",
+                             &addr);
+    if (ret < 0)
+        return ret;
+
+    /* Without PAL_PROT_WRITECOPY, the host file is mapped shared. */
+    ret = DkStreamMap(file, &addr, PAL_PROT_READ | PAL_PROT_WRITE, /*offset=*/0, map_size);
+    if (ret < 0) {
+        void* tmp_vma = NULL;
+        if (bkeep_munmap(addr, map_size, /*is_internal=*/true, &tmp_vma) < 0) {
+            BUG();
+        }
+        bkeep_remove_tmp_vma(tmp_vma);
+        return pal_to_unix_errno(ret);
+    }
+
+    *out_shared = addr;
+    return 0;
+}
+
+static void unmap_ring(struct ipc_shm_header* shared, size_t map_size) {
+    void* tmp_vma = NULL;
+    if (bkeep_munmap(shared, map_size, /*is_internal=*/true, &tmp_vma) < 0) {
+        BUG();
+    }
+    if (DkStreamUnmap(shared, map_size) < 0) {
+        BUG();
+    }
+    bkeep_remove_tmp_vma(tmp_vma);
+}
+
+static int create_ring(struct ipc_shm_ring** out_ring, char** out_uri) {
+    uint8_t random[16];
+    int ret = DkRandomBitsRead(&random, sizeof(random));
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+
+    char name[sizeof(random) * 2 + 1];
+    BYTES2HEXSTR(random, name, sizeof(name));
+    char* uri = alloc_concat3(g_shm_dir, -1, "/graphene_ipc_", -1, name, -1);
+    if (!uri)
+        return -ENOMEM;
+
+    struct ipc_shm_ring* ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    ring->data_size = g_ring_size;
+    ring->map_size = ALLOC_ALIGN_UP(sizeof(struct ipc_shm_header) + ring->data_size);
+
+    ret = DkStreamOpen(uri, PAL_ACCESS_RDWR, PAL_SHARE_OWNER_R | PAL_SHARE_OWNER_W,
+                       PAL_CREATE_ALWAYS, /*options=*/0, &ring->file);
+    if (ret < 0) {
+        ret = pal_to_unix_errno(ret);
+        goto out;
+    }
+
+    ret = DkStreamSetLength(ring->file, ring->map_size);
+    if (ret < 0) {
+        ret = pal_to_unix_errno(ret);
+        goto out;
+    }
+
+    ret = map_ring(ring->file, ring->map_size, &ring->shared);
+    if (ret < 0)
+        goto out;
+
+    /* The file is new, so the rest of the header is zeroed. */
+    ring->shared->magic = IPC_SHM_MAGIC;
+    ring->shared->data_size = ring->data_size;
+
+    *out_ring = ring;
+    *out_uri = uri;
+    ring = NULL;
+    uri = NULL;
+    ret = 0;
+out:
+    if (ring) {
+        if (ring->file) {
+            (void)DkStreamDelete(ring->file, /*access=*/0);
+            DkObjectClose(ring->file);
+        }
+        free(ring);
+    }
+    free(uri);
+    return ret;
+}
+
+static int attach_ring(const char* uri, struct ipc_shm_ring** out_ring) {
+    PAL_HANDLE file = NULL;
+    int ret = DkStreamOpen(uri, PAL_ACCESS_RDWR, /*share_flags=*/0, /*create=*/0, /*options=*/0,
+                           &file);
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+
+    struct ipc_shm_ring* ring = NULL;
+
+    PAL_STREAM_ATTR attr;
+    ret = DkStreamAttributesQueryByHandle(file, &attr);
+    if (ret < 0) {
+        ret = pal_to_unix_errno(ret);
+        goto out;
+    }
+    if (attr.pending_size < sizeof(struct ipc_shm_header)
+            || attr.pending_size != ALLOC_ALIGN_UP(attr.pending_size)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    ring->map_size = attr.pending_size;
+
+    ret = map_ring(file, ring->map_size, &ring->shared);
+    if (ret < 0)
+        goto out;
+
+    ring->data_size = ring->shared->data_size;
+    if (ring->shared->magic != IPC_SHM_MAGIC || !IS_POWER_OF_2(ring->data_size)
+            || ring->data_size < IPC_SHM_MIN_RING_SIZE
+            || sizeof(struct ipc_shm_header) + ring->data_size > ring->map_size) {
+        unmap_ring(ring->shared, ring->map_size);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    /* Both processes have the ring mapped now, the file is not needed anymore. */
+    ret = DkStreamDelete(file, /*access=*/0);
+    if (ret < 0)
+        log_debug("Deleting IPC ring %s failed: %ld", uri, pal_to_unix_errno(ret));
+    __atomic_store_n(&ring->shared->attached, 1, __ATOMIC_RELEASE);
+
+    ring->tail = __atomic_load_n(&ring->shared->tail, __ATOMIC_RELAXED);
+    *out_ring = ring;
+    ring = NULL;
+    ret = 0;
+out:
+    free(ring);
+    DkObjectClose(file);
+    return ret;
+}
+
+int ipc_shm_connect(PAL_HANDLE handle, struct ipc_shm_ring** out_ring) {
+    struct ipc_shm_ring* ring = NULL;
+    char* uri = NULL;
+    int ret;
+
+    if (g_shm_dir) {
+        ret = create_ring(&ring, &uri);
+        if (ret < 0)
+            log_warning("Creating IPC ring in %s failed (%d), using the pipe", g_shm_dir, ret);
+    }
+
+    uint32_t uri_size = uri ? strlen(uri) : 0;
+    ret = write_exact(handle, &uri_size, sizeof(uri_size));
+    if (ret == 0 && uri_size)
+        ret = write_exact(handle, uri, uri_size);
+    free(uri);
+    if (ret < 0) {
+        if (ring)
+            ipc_shm_ring_destroy(ring);
+        return ret;
+    }
+
+    *out_ring = ring;
+    return 0;
+}
+
+int ipc_shm_accept(PAL_HANDLE handle, struct ipc_shm_ring** out_ring) {
+    uint32_t uri_size;
+    int ret = read_exact(handle, &uri_size, sizeof(uri_size));
+    if (ret < 0)
+        return ret;
+
+    if (!uri_size) {
+        *out_ring = NULL;
+        return 0;
+    }
+    if (uri_size > IPC_SHM_URI_MAX)
+        return -EINVAL;
+
+    char* uri = malloc(uri_size + 1);
+    if (!uri)
+        return -ENOMEM;
+    ret = read_exact(handle, uri, uri_size);
+    if (ret < 0)
+        goto out;
+    uri[uri_size] = '\0';
+
+    ret = attach_ring(uri, out_ring);
+    if (ret < 0)
+        log_error("Attaching IPC ring %s failed: %d", uri, ret);
+out:
+    free(uri);
+    return ret;
+}
+
+void ipc_shm_ring_destroy(struct ipc_shm_ring* ring) {
+    if (ring->file) {
+        if (!__atomic_load_n(&ring->shared->attached, __ATOMIC_ACQUIRE)) {
+            /* The receiver never mapped the ring (and deleted the file). */
+            (void)DkStreamDelete(ring->file, /*access=*/0);
+        }
+        DkObjectClose(ring->file);
+    }
+    unmap_ring(ring->shared, ring->map_size);
+    free(ring->part_buf);
+    free(ring);
+}
+
+static int ring_doorbell(struct ipc_shm_ring* ring, PAL_HANDLE doorbell) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&ring->shared->receiver_waiting, __ATOMIC_RELAXED))
+        return 0;
+    if (!__atomic_exchange_n(&ring->shared->receiver_waiting, 0, __ATOMIC_ACQ_REL))
+        return 0;
+
+    char byte = 0;
+    return write_exact(doorbell, &byte, sizeof(byte));
+}
+
+static int wait_for_space(struct ipc_shm_ring* ring, PAL_HANDLE doorbell, uint64_t head,
+                          size_t size) {
+    while (head + size - __atomic_load_n(&ring->shared->tail, __ATOMIC_ACQUIRE) > ring->data_size) {
+        /* The ring is full. The receiver is awake (the doorbell was rung when the records were
+         * published, if needed), so just wait for it to make some space. The receiver never writes
+         * to the pipe, so the pipe becomes readable only when the receiver closes it. */
+        PAL_FLG events = PAL_WAIT_READ;
+        PAL_FLG ret_events = 0;
+        int ret = DkStreamsWaitEvents(1, &doorbell, &events, &ret_events, IPC_SHM_FULL_WAIT_US);
+        if (ret == 0)
+            return -EPIPE;
+        if (ret != -PAL_ERROR_TRYAGAIN && ret != -PAL_ERROR_INTERRUPTED)
+            return pal_to_unix_errno(ret);
+    }
+    return 0;
+}
+
+/* Writes a record with `size` bytes of `buf` at `offset` into the ring and publishes it. */
+static int put_record(struct ipc_shm_ring* ring, PAL_HANDLE doorbell, uint32_t type,
+                      size_t offset, const void* buf, size_t size) {
+    struct ipc_shm_header* shared = ring->shared;
+    size_t record_size = ALIGN_UP(offset + size, 8);
+    assert(record_size <= ring->data_size / 2);
+
+    uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_RELAXED);
+    size_t pos = head & (ring->data_size - 1);
+    size_t skip = ring->data_size - pos < record_size ? ring->data_size - pos : 0;
+
+    int ret = wait_for_space(ring, doorbell, head, skip + record_size);
+    if (ret < 0)
+        return ret;
+
+    struct ipc_shm_record* record;
+    if (skip) {
+        record = (struct ipc_shm_record*)&shared->data[pos];
+        record->size = skip;
+        record->type = IPC_SHM_RECORD_SKIP;
+        head += skip;
+        pos = 0;
+    }
+
+    record = (struct ipc_shm_record*)&shared->data[pos];
+    record->size = offset + size;
+    record->type = type;
+    memcpy((char*)record + offset, buf, size);
+
+    __atomic_store_n(&shared->head, head + record_size, __ATOMIC_RELEASE);
+    return ring_doorbell(ring, doorbell);
+}
+
+int ipc_shm_send(struct ipc_shm_ring* ring, PAL_HANDLE doorbell, struct shim_ipc_msg* msg) {
+    size_t size = GET_UNALIGNED(msg->header.size);
+    size_t max_record_size = ring->data_size / 2;
+
+    if (IPC_SHM_MSG_OFFSET + size <= max_record_size)
+        return put_record(ring, doorbell, IPC_SHM_RECORD_MSG, IPC_SHM_MSG_OFFSET, msg, size);
+
+    /* Too large for the ring, send it in parts. The receiver learns the size of the whole message
+     * from the message header at the beginning of the first part. */
+    const char* buf = (const char*)msg;
+    while (size) {
+        size_t part_size = MIN(size, max_record_size - sizeof(struct ipc_shm_record));
+        int ret = put_record(ring, doorbell, IPC_SHM_RECORD_PART, sizeof(struct ipc_shm_record),
+                             buf, part_size);
+        if (ret < 0)
+            return ret;
+        buf += part_size;
+        size -= part_size;
+    }
+    return 0;
+}
+
+bool ipc_shm_arm(struct ipc_shm_ring* ring) {
+    struct ipc_shm_header* shared = ring->shared;
+    __atomic_store_n(&shared->receiver_waiting, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&shared->head, __ATOMIC_ACQUIRE) == ring->tail)
+        return false;
+
+    /* There are messages already, no need for the doorbell. */
+    __atomic_store_n(&shared->receiver_waiting, 0, __ATOMIC_RELAXED);
+    return true;
+}
+
+int ipc_shm_read_doorbell(PAL_HANDLE doorbell) {
+    /* Each byte is a wakeup; one call consumes all of them, the messages are taken from the ring
+     * later anyway. */
+    char buf[64];
+    size_t size = sizeof(buf);
+    int ret = DkStreamRead(doorbell, /*offset=*/0, &size, buf, NULL, 0);
+    if (ret < 0) {
+        if (ret == -PAL_ERROR_INTERRUPTED || ret == -PAL_ERROR_TRYAGAIN)
+            return 0;
+        return pal_to_unix_errno(ret);
+    }
+    return size == 0 ? 1 : 0;
+}
+
+static void advance_tail(struct ipc_shm_ring* ring, size_t size) {
+    ring->tail += size;
+    __atomic_store_n(&ring->shared->tail, ring->tail, __ATOMIC_RELEASE);
+}
+
+static int add_part(struct ipc_shm_ring* ring, const char* buf, size_t size) {
+    if (!ring->part_buf) {
+        /* The first part starts with the message header. */
+        if (size < sizeof(struct ipc_msg_header))
+            return -EINVAL;
+        size_t msg_size = GET_UNALIGNED(((struct ipc_msg_header*)buf)->size);
+        if (msg_size < size)
+            return -EINVAL;
+
+        ring->part_buf = malloc(IPC_SHM_MSG_OFFSET + msg_size);
+        if (!ring->part_buf)
+            return -ENOMEM;
+        ring->part_size = msg_size;
+        ring->part_received = 0;
+    }
+
+    if (size > ring->part_size - ring->part_received)
+        return -EINVAL;
+    memcpy(ring->part_buf + IPC_SHM_MSG_OFFSET + ring->part_received, buf, size);
+    ring->part_received += size;
+    return 0;
+}
+
+int ipc_shm_peek(struct ipc_shm_ring* ring, struct shim_ipc_msg** out_msg) {
+    struct ipc_shm_header* shared = ring->shared;
+    assert(!ring->cur_size && !ring->part_ready);
+
+    while (true) {
+        uint64_t head = __atomic_load_n(&shared->head, __ATOMIC_ACQUIRE);
+        if (head == ring->tail)
+            return 0;
+
+        size_t pos = ring->tail & (ring->data_size - 1);
+        struct ipc_shm_record* record = (struct ipc_shm_record*)&shared->data[pos];
+        uint32_t size = __atomic_load_n(&record->size, __ATOMIC_RELAXED);
+        uint32_t type = __atomic_load_n(&record->type, __ATOMIC_RELAXED);
+        size_t record_size = ALIGN_UP(size, 8);
+        if (size < sizeof(*record) || record_size > ring->data_size - pos
+                || record_size > head - ring->tail)
+            goto malformed;
+
+        switch (type) {
+            case IPC_SHM_RECORD_SKIP:
+                advance_tail(ring, record_size);
+                break;
+
+            case IPC_SHM_RECORD_MSG: {
+                if (size < IPC_SHM_MSG_OFFSET + sizeof(struct ipc_msg_header))
+                    goto malformed;
+                struct shim_ipc_msg* msg =
+                    (struct shim_ipc_msg*)((char*)record + IPC_SHM_MSG_OFFSET);
+                if (GET_UNALIGNED(msg->header.size) != size - IPC_SHM_MSG_OFFSET)
+                    goto malformed;
+                ring->cur_size = record_size;
+                *out_msg = msg;
+                return 1;
+            }
+
+            case IPC_SHM_RECORD_PART: {
+                int ret = add_part(ring, (const char*)record + sizeof(*record),
+                                   size - sizeof(*record));
+                if (ret < 0) {
+                    if (ret != -ENOMEM)
+                        goto malformed;
+                    return ret;
+                }
+                /* The part is copied, so its space can be reused right away. */
+                advance_tail(ring, record_size);
+                if (ring->part_received == ring->part_size) {
+                    ring->part_ready = true;
+                    *out_msg = (struct shim_ipc_msg*)(ring->part_buf + IPC_SHM_MSG_OFFSET);
+                    return 1;
+                }
+                break;
+            }
+
+            default:
+                goto malformed;
+        }
+    }
+
+malformed:
+    log_error("Malformed record in IPC ring");
+    return -EINVAL;
+}
+
+void ipc_shm_pop(struct ipc_shm_ring* ring) {
+    if (ring->part_ready) {
+        free(ring->part_buf);
+        ring->part_buf = NULL;
+        ring->part_ready = false;
+        return;
+    }
+
+    assert(ring->cur_size);
+    advance_tail(ring, ring->cur_size);
+    ring->cur_size = 0;
+}
@@ -6,6 +6,8 @@
 /*
  * IPC glue code for the sync engine. These functions handle IPC_MSG_SYNC_* messages, but delegate
  * the actual logic to sync_server_* and sync_client_* functions.
+ *
+ * Each message carries a batch of entries, which are passed to the callbacks one by one.
  */
 
 #include "shim_internal.h"
@@ -27,57 +29,154 @@ static const char* sync_message_names[IPC_MSG_CODE_BOUND] = {
     [IPC_MSG_SYNC_CONFIRM_CLOSE]     = "CONFIRM_CLOSE",
 };
 
-static inline void sync_log(const char* prefix, int code, uint64_t id, int state) {
-    log_trace("%s: %s(0x%lx, %s)", prefix, sync_message_names[code], id, sync_state_names[state]);
+static inline void sync_log(const char* prefix, int code, struct shim_ipc_sync* entry) {
+    log_trace("%s: %s(0x%lx, %s%s)", prefix, sync_message_names[code], entry->id,
+              sync_state_names[entry->state],
+              (entry->flags & SYNC_FLAG_SPECULATIVE) ? ", speculative" : "");
 }
 
-static int sync_msg_send(IDTYPE dest, int code, uint64_t id, int state, size_t data_size,
-                         void* data) {
-    struct shim_ipc_sync msgin = {
+static size_t entry_size(size_t data_size) {
+    return ALIGN_UP(sizeof(struct shim_ipc_sync) + data_size, 8);
+}
+
+static struct shim_ipc_sync* next_entry(struct shim_ipc_sync* entry) {
+    return (struct shim_ipc_sync*)((char*)entry + entry_size(entry->data_size));
+}
+
+static void log_batch(const char* prefix, struct ipc_sync_batch* batch) {
+    char* buf = (char*)&batch->msg->data + sizeof(batch->count);
+    for (uint64_t i = 0; i < batch->count; i++) {
+        struct shim_ipc_sync entry;
+        memcpy(&entry, buf, sizeof(entry));
+        sync_log(prefix, batch->code, &entry);
+        buf += entry_size(entry.data_size);
+    }
+}
+
+void ipc_sync_batch_init(struct ipc_sync_batch* batch, int code) {
+    batch->code = code;
+    batch->count = 0;
+    batch->size = get_ipc_msg_size(sizeof(struct shim_ipc_sync_batch));
+    batch->capacity = 0;
+    batch->msg = NULL;
+}
+
+int ipc_sync_batch_add(struct ipc_sync_batch* batch, uint64_t id, int state, uint32_t flags,
+                       uint64_t uses, size_t data_size, void* data) {
+    size_t size = batch->size + entry_size(data_size);
+    if (size > batch->capacity) {
+        size_t capacity = MAX(size, MAX(batch->capacity * 2, (size_t)256));
+        struct shim_ipc_msg* msg = malloc(capacity);
+        if (!msg)
+            return -ENOMEM;
+        if (batch->msg) {
+            memcpy(msg, batch->msg, batch->size);
+            free(batch->msg);
+        }
+        batch->msg = msg;
+        batch->capacity = capacity;
+    }
+
+    struct shim_ipc_sync entry = {
         .id = id,
-        .state = state,
         .data_size = data_size,
+        .state = state,
+        .flags = flags,
+        .uses = uses,
     };
+    /* The message header is packed, so the entries are not aligned here. */
+    char* buf = (char*)batch->msg + batch->size;
+    memcpy(buf, &entry, sizeof(entry));
+    if (data_size > 0)
+        memcpy(buf + sizeof(entry), data, data_size);
+
+    batch->count++;
+    batch->size = size;
+    return 0;
+}
 
-    size_t total_msg_size = get_ipc_msg_size(sizeof(struct shim_ipc_sync) + data_size);
-    struct shim_ipc_msg* msg = __alloca(total_msg_size);
-    init_ipc_msg(msg, code, total_msg_size);
+void ipc_sync_batch_destroy(struct ipc_sync_batch* batch) {
+    free(batch->msg);
+    batch->msg = NULL;
+    batch->capacity = 0;
+}
+
+static int sync_batch_send(const char* prefix, IDTYPE dest, struct ipc_sync_batch* batch) {
+    if (!batch->count)
+        return 0;
 
-    memcpy(&msg->data, &msgin, sizeof(msgin));
-    memcpy(&((struct shim_ipc_sync*)&msg->data)->data, data, data_size);
+    struct shim_ipc_msg* msg = batch->msg;
+    init_ipc_msg(msg, batch->code, batch->size);
+    memcpy(&msg->data, &batch->count, sizeof(batch->count));
 
+    log_batch(prefix, batch);
     return ipc_send_message(dest, msg);
 }
 
-int ipc_sync_client_send(int code, uint64_t id, int state, size_t data_size, void* data) {
-    sync_log("sync client", code, id, state);
-    IDTYPE dest = g_process_ipc_ids.leader_vmid ?: g_process_ipc_ids.self_vmid;
-    return sync_msg_send(dest, code, id, state, data_size, data);
+static IDTYPE sync_server_vmid(void) {
+    return g_process_ipc_ids.leader_vmid ?: g_process_ipc_ids.self_vmid;
+}
+
+int ipc_sync_client_send(int code, uint64_t id, int state, uint64_t uses, size_t data_size,
+                         void* data) {
+    size_t total_msg_size = get_ipc_msg_size(sizeof(struct shim_ipc_sync_batch)
+                                             + entry_size(data_size));
+    struct shim_ipc_msg* msg = __alloca(total_msg_size);
+    init_ipc_msg(msg, code, total_msg_size);
+
+    uint64_t count = 1;
+    struct shim_ipc_sync entry = {
+        .id = id,
+        .data_size = data_size,
+        .state = state,
+        .uses = uses,
+    };
+    char* buf = (char*)&msg->data;
+    memcpy(buf, &count, sizeof(count));
+    memcpy(buf + sizeof(count), &entry, sizeof(entry));
+    if (data_size > 0)
+        memcpy(buf + sizeof(count) + sizeof(entry), data, data_size);
+
+    sync_log("sync client", code, &entry);
+    return ipc_send_message(sync_server_vmid(), msg);
+}
+
+int ipc_sync_client_send_batch(struct ipc_sync_batch* batch) {
+    return sync_batch_send("sync client", sync_server_vmid(), batch);
 }
 
-int ipc_sync_server_send(IDTYPE dest, int code, uint64_t id, int state,
-                         size_t data_size, void* data) {
-    sync_log("sync server", code, id, state);
-    return sync_msg_send(dest, code, id, state, data_size, data);
+int ipc_sync_server_send_batch(IDTYPE dest, struct ipc_sync_batch* batch) {
+    return sync_batch_send("sync server", dest, batch);
 }
 
 static int ipc_sync_client_callback(int code, IDTYPE src, void* data, unsigned long seq) {
-    struct shim_ipc_sync* msgin = data;
+    struct shim_ipc_sync_batch* msgin = data;
     __UNUSED(src);
     __UNUSED(seq);
 
-    sync_log("sync client callback", code, msgin->id, msgin->state);
-    sync_client_message_callback(code, msgin->id, msgin->state, msgin->data_size, &msgin->data);
+    struct shim_ipc_sync* entry = (struct shim_ipc_sync*)&msgin->entries;
+    for (uint64_t i = 0; i < msgin->count; i++) {
+        sync_log("sync client callback", code, entry);
+        sync_client_message_callback(code, entry->id, entry->state, entry->data_size,
+                                     &entry->data);
+        entry = next_entry(entry);
+    }
     return 0;
 }
 
 static int ipc_sync_server_callback(int code, IDTYPE src, void* data, unsigned long seq) {
-    struct shim_ipc_sync* msgin = data;
+    struct shim_ipc_sync_batch* msgin = data;
     __UNUSED(seq);
 
-    sync_log("sync server callback", code, msgin->id, msgin->state);
-    sync_server_message_callback(src, code, msgin->id, msgin->state, msgin->data_size,
-                                 &msgin->data);
+    struct shim_ipc_sync* entry = (struct shim_ipc_sync*)&msgin->entries;
+    for (uint64_t i = 0; i < msgin->count; i++) {
+        sync_log("sync server callback", code, entry);
+        sync_server_message_callback(src, code, entry->id, entry->state, entry->flags,
+                                     entry->uses, entry->data_size, &entry->data);
+        entry = next_entry(entry);
+    }
+    /* Replies to the whole batch go out together. */
+    sync_server_flush_messages();
     return 0;
 }
 
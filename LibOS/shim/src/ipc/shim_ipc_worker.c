@@ -16,6 +16,7 @@
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_ipc.h"
+#include "shim_ipc_shm.h"
 #include "shim_lock.h"
 #include "shim_thread.h"
 #include "shim_types.h"
@@ -28,6 +29,8 @@ DEFINE_LISTP(shim_ipc_connection);
 struct shim_ipc_connection {
     LIST_TYPE(shim_ipc_connection) list;
     PAL_HANDLE handle;
+    /* If not NULL, messages come through this ring and `handle` is only used as a doorbell. */
+    struct ipc_shm_ring* ring;
     IDTYPE vmid;
 };
 
@@ -94,13 +97,14 @@ static void disconnect_callbacks(struct shim_ipc_connection* conn) {
     remove_outgoing_ipc_connection(conn->vmid);
 }
 
-static int add_ipc_connection(PAL_HANDLE handle, IDTYPE id) {
+static int add_ipc_connection(PAL_HANDLE handle, struct ipc_shm_ring* ring, IDTYPE id) {
     struct shim_ipc_connection* conn = malloc(sizeof(*conn));
     if (!conn) {
         return -ENOMEM;
     }
 
     conn->handle = handle;
+    conn->ring = ring;
     conn->vmid = id;
 
     LISTP_ADD(conn, &g_ipc_connections, list);
@@ -112,11 +116,28 @@ static void del_ipc_connection(struct shim_ipc_connection* conn) {
     LISTP_DEL(conn, &g_ipc_connections, list);
     g_ipc_connections_cnt--;
 
+    if (conn->ring) {
+        ipc_shm_ring_destroy(conn->ring);
+    }
     DkObjectClose(conn->handle);
 
     free(conn);
 }
 
+/* Runs the callback of a received message. The callback takes ownership of `data` if the message
+ * is a response. */
+static void handle_ipc_message(IDTYPE src, unsigned char code, uint64_t seq, void* data) {
+    if (code < ARRAY_SIZE(ipc_callbacks) && ipc_callbacks[code]) {
+        int ret = ipc_callbacks[code](src, data, seq);
+        if (ret < 0) {
+            log_error(LOG_PREFIX "error running IPC callback %u: %d", code, ret);
+            DkProcessExit(1);
+        }
+    } else {
+        log_error(LOG_PREFIX "received unknown IPC msg type: %u", code);
+    }
+}
+
 /*
  * Receive and handle some (possibly many) messages from IPC connection `conn`.
  * Returns `0` on success, `1` on EOF (connection closed on a message boundary), negative error
@@ -195,16 +216,7 @@ static int receive_ipc_messages(struct shim_ipc_connection* conn) {
         log_debug(LOG_PREFIX "received IPC message from %u: code=%d size=%lu seq=%lu", conn->vmid,
                   msg_code, msg_size, msg_seq);
 
-        int ret = 0;
-        if (msg_code < ARRAY_SIZE(ipc_callbacks) && ipc_callbacks[msg_code]) {
-            ret = ipc_callbacks[msg_code](conn->vmid, msg_data, msg_seq);
-            if (ret < 0) {
-                log_error(LOG_PREFIX "error running IPC callback %u: %d", msg_code, ret);
-                DkProcessExit(1);
-            }
-        } else {
-            log_error(LOG_PREFIX "received unknown IPC msg type: %u", msg_code);
-        }
+        handle_ipc_message(conn->vmid, msg_code, msg_seq, msg_data);
 
         if (msg_code != IPC_MSG_RESP) {
             free(msg_data);
@@ -214,6 +226,41 @@ static int receive_ipc_messages(struct shim_ipc_connection* conn) {
     return 0;
 }
 
+/*
+ * Handle all messages in the ring of connection `conn`. Callbacks get the payload in place (in the
+ * ring), except for responses, which are handed over to the waiting thread and so need a copy.
+ * Returns `0` on success, negative error code on failures.
+ */
+static int receive_ring_messages(struct shim_ipc_connection* conn) {
+    while (true) {
+        struct shim_ipc_msg* msg;
+        int ret = ipc_shm_peek(conn->ring, &msg);
+        if (ret <= 0) {
+            return ret;
+        }
+
+        size_t msg_size = GET_UNALIGNED(msg->header.size);
+        size_t data_size = msg_size - sizeof(struct ipc_msg_header);
+        unsigned char msg_code = GET_UNALIGNED(msg->header.code);
+        unsigned long msg_seq = GET_UNALIGNED(msg->header.seq);
+
+        log_debug(LOG_PREFIX "received IPC message from %u: code=%d size=%lu seq=%lu", conn->vmid,
+                  msg_code, msg_size, msg_seq);
+
+        void* msg_data = msg->data;
+        if (msg_code == IPC_MSG_RESP) {
+            msg_data = malloc(data_size);
+            if (!msg_data) {
+                return -ENOMEM;
+            }
+            memcpy(msg_data, msg->data, data_size);
+        }
+
+        handle_ipc_message(conn->vmid, msg_code, msg_seq, msg_data);
+        ipc_shm_pop(conn->ring);
+    }
+}
+
 static noreturn void ipc_worker_main(void) {
     /* TODO: If we had a global array of connections (instead of a list) we wouldn't have to gather
      * them all here in every loop iteration, but then deletion would be slower (but deletion should
@@ -255,6 +302,13 @@ static noreturn void ipc_worker_main(void) {
         handles[1] = g_self_ipc_handle;
         events[1] = PAL_WAIT_READ;
 
+        PAL_NUM timeout = NO_TIMEOUT;
+        if (!g_process_ipc_ids.leader_vmid) {
+            /* Wake up when the next sync lease expires. */
+            timeout = sync_server_process_leases();
+        }
+
+        /* If a ring already has messages, only check for events and handle them right away. */
         struct shim_ipc_connection* conn;
         size_t i = reserved_slots;
         LISTP_FOR_EACH_ENTRY(conn, &g_ipc_connections, list) {
@@ -262,19 +316,26 @@ static noreturn void ipc_worker_main(void) {
             handles[i] = conn->handle;
             events[i] = PAL_WAIT_READ;
             /* `ret_events[i]` already cleared. */
+            if (conn->ring && ipc_shm_arm(conn->ring)) {
+                timeout = 0;
+            }
             i++;
         }
 
-        int ret = DkStreamsWaitEvents(items_cnt, handles, events, ret_events, NO_TIMEOUT);
+        int ret = DkStreamsWaitEvents(items_cnt, handles, events, ret_events, timeout);
         if (ret < 0) {
             if (ret == -PAL_ERROR_INTERRUPTED) {
                 /* Generally speaking IPC worker should not be interrupted, but this happens with
                  * SGX exitless feature. */
                 continue;
             }
-            ret = pal_to_unix_errno(ret);
-            log_error(LOG_PREFIX "DkStreamsWaitEvents failed: %d", ret);
-            goto out_die;
+            if (ret != -PAL_ERROR_TRYAGAIN || timeout == NO_TIMEOUT) {
+                ret = pal_to_unix_errno(ret);
+                log_error(LOG_PREFIX "DkStreamsWaitEvents failed: %d", ret);
+                goto out_die;
+            }
+            /* No events: some rings have messages, or a sync lease expired. */
+            memset(ret_events, 0, items_cnt * sizeof(*ret_events));
         }
 
         if (ret_events[0]) {
@@ -296,6 +357,7 @@ static noreturn void ipc_worker_main(void) {
             cur_thread->shim_tcb->tp = NULL;
             put_thread(cur_thread);
 
+            destroy_thread_malloc_cache();
             DkThreadExit(&g_clear_on_worker_exit);
             /* Unreachable. */
         }
@@ -314,12 +376,16 @@ static noreturn void ipc_worker_main(void) {
                 goto out_die;
             }
             IDTYPE new_id = 0;
+            struct ipc_shm_ring* ring = NULL;
             ret = read_exact(new_handle, &new_id, sizeof(new_id));
             if (ret < 0) {
                 log_error(LOG_PREFIX "receiving id failed: %d", ret);
                 DkObjectClose(new_handle);
+            } else if ((ret = ipc_shm_accept(new_handle, &ring)) < 0) {
+                log_error(LOG_PREFIX "setting up connection from %u failed: %d", new_id, ret);
+                DkObjectClose(new_handle);
             } else {
-                ret = add_ipc_connection(new_handle, new_id);
+                ret = add_ipc_connection(new_handle, ring, new_id);
                 if (ret < 0) {
                     log_error(LOG_PREFIX "add_ipc_connection failed: %d", ret);
                     goto out_die;
@@ -329,7 +395,29 @@ static noreturn void ipc_worker_main(void) {
 
         for (i = reserved_slots; i < items_cnt; i++) {
             conn = connections[i];
-            if (ret_events[i] & PAL_WAIT_READ) {
+            if (conn->ring) {
+                /* The pipe only carries doorbells. Handle the messages in the ring even if the
+                 * connection was closed - the peer might have sent some right before closing it. */
+                ret = 0;
+                if (ret_events[i] & PAL_WAIT_READ) {
+                    ret = ipc_shm_read_doorbell(conn->handle);
+                }
+                int recv_ret = receive_ring_messages(conn);
+                if (ret == 0 && recv_ret < 0) {
+                    ret = recv_ret;
+                }
+                if (ret == 1) {
+                    /* Connection closed. */
+                    disconnect_callbacks(conn);
+                    del_ipc_connection(conn);
+                    continue;
+                }
+                if (ret < 0) {
+                    log_error(LOG_PREFIX "failed to receive an IPC message from %u: %d",
+                              conn->vmid, ret);
+                    ret_events[i] = PAL_WAIT_ERROR;
+                }
+            } else if (ret_events[i] & PAL_WAIT_READ) {
                 ret = receive_ipc_messages(conn);
                 if (ret == 1) {
                     /* Connection closed. */
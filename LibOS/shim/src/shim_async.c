@@ -155,6 +155,7 @@ static void shim_async_worker(void* arg) {
 
     if (notme) {
         put_thread(self);
+        destroy_thread_malloc_cache();
         DkThreadExit(/*clear_child_tid=*/NULL);
         /* UNREACHABLE */
     }
@@ -359,6 +360,7 @@ static void shim_async_worker(void* arg) {
     free(pals);
     free(pal_events);
 
+    destroy_thread_malloc_cache();
     DkThreadExit(/*clear_child_tid=*/NULL);
     /* UNREACHABLE */
 
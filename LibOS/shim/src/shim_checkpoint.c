@@ -213,51 +213,312 @@ BEGIN_RS_FUNC(qstr) {
 }
 END_RS_FUNC(qstr)
 
-static int send_memory_on_stream(PAL_HANDLE stream, struct shim_cp_store* store) {
-    int ret = 0;
+/*
+ * Memory entries are sent page by page. Pages which contain only zeroes are not sent at all, the
+ * child finds out which pages have data from a bitmap sent ahead of the memory. Pages with data
+ * are numbered in the order of memory entries and split into contiguous slices, one per stream.
+ */
+#define CP_MEM_STREAMS_MAX      4UL
+#define CP_MEM_STREAM_MIN_SIZE  (64 * 1024 * 1024UL)
+
+struct cp_mem_plan {
+    size_t pages_cnt;       /* pages of all memory entries */
+    size_t data_pages_cnt;  /* pages which contain some non-zero bytes */
+    size_t bitmap_size;
+    uint8_t* bitmap;        /* bit set for each page with data */
+};
+
+/*
+ * Helper threads used while forking: the parent creates the child process while building the
+ * checkpoint, and memory of large processes is sent over several streams in parallel. In the parent
+ * these are LibOS internal threads; in the child they run before LibOS threading is initialized, so
+ * they are plain PAL threads (`thread` is NULL) which only read from their stream.
+ */
+struct cp_worker {
+    int (*func)(struct cp_worker* worker);
+    int ret;
+    struct shim_thread* thread;
+    PAL_HANDLE pal_thread; /* only for plain PAL threads, otherwise owned by `thread` */
+    PAL_HANDLE done_event;
+    int clear_on_exit; /* cleared by PAL once the thread does not use its stack anymore */
+
+    /* arguments of `func` */
+    PAL_HANDLE stream;
+    struct shim_mem_entry* mem_entries;
+    const struct cp_mem_plan* plan;
+    size_t first_page;
+    size_t end_page;
+};
 
-    struct shim_mem_entry* entry = store->first_mem_entry;
-    while (entry) {
-        size_t mem_size = entry->size;
-        void* mem_addr  = entry->addr;
-        int mem_prot    = entry->prot;
+static void cp_worker_wrapper(void* arg) {
+    struct cp_worker* worker = arg;
 
-        if (!(mem_prot & PAL_PROT_READ) && mem_size > 0) {
-            /* make the area readable */
-            ret = DkVirtualMemoryProtect(mem_addr, mem_size, mem_prot | PAL_PROT_READ);
-            if (ret < 0) {
-                return pal_to_unix_errno(ret);
+    if (worker->thread) {
+        shim_tcb_init();
+        set_cur_thread(worker->thread);
+    }
+
+    worker->ret = worker->func(worker);
+    DkEventSet(worker->done_event);
+
+    if (worker->thread) {
+        struct shim_thread* cur_thread = get_cur_thread();
+        cur_thread->shim_tcb->tp = NULL;
+        put_thread(cur_thread);
+        destroy_thread_malloc_cache();
+    }
+    DkThreadExit(&worker->clear_on_exit);
+    /* UNREACHABLE */
+}
+
+/* Runs `worker->func` in a new thread, or synchronously if the thread cannot be created. */
+static void start_cp_worker(struct cp_worker* worker, bool internal_thread) {
+    worker->thread = NULL;
+    worker->pal_thread = NULL;
+    worker->done_event = NULL;
+    worker->clear_on_exit = 0;
+
+    if (internal_thread) {
+        worker->thread = get_new_internal_thread();
+        if (!worker->thread)
+            goto run_inline;
+    }
+
+    if (DkEventCreate(&worker->done_event, /*init_signaled=*/false, /*auto_clear=*/false) < 0)
+        goto run_inline;
+
+    worker->clear_on_exit = 1;
+    PAL_HANDLE handle = NULL;
+    if (DkThreadCreate(cp_worker_wrapper, worker, &handle) < 0) {
+        worker->clear_on_exit = 0;
+        goto run_inline;
+    }
+    if (worker->thread) {
+        worker->thread->pal_handle = handle;
+    } else {
+        worker->pal_thread = handle;
+    }
+    return;
+
+run_inline:
+    if (worker->done_event) {
+        DkObjectClose(worker->done_event);
+        worker->done_event = NULL;
+    }
+    if (worker->thread) {
+        put_thread(worker->thread);
+        worker->thread = NULL;
+    }
+    worker->ret = worker->func(worker);
+}
+
+static int wait_cp_worker(struct cp_worker* worker) {
+    if (worker->done_event) {
+        while (DkEventWait(worker->done_event, /*timeout=*/NULL) < 0)
+            ;
+        /* the thread is about to exit, wait until it does not use its stack anymore */
+        while (__atomic_load_n(&worker->clear_on_exit, __ATOMIC_RELAXED))
+            CPU_RELAX();
+        DkObjectClose(worker->done_event);
+        worker->done_event = NULL;
+    }
+    if (worker->pal_thread) {
+        DkObjectClose(worker->pal_thread);
+        worker->pal_thread = NULL;
+    }
+    if (worker->thread) {
+        put_thread(worker->thread);
+        worker->thread = NULL;
+    }
+    return worker->ret;
+}
+
+static size_t mem_entry_pages(struct shim_mem_entry* entry) {
+    return ALIGN_UP(entry->size, PAGE_SIZE) / PAGE_SIZE;
+}
+
+static bool is_zero_page(const void* addr, size_t size) {
+    const uint64_t* words = addr;
+    for (size_t i = 0; i < size / sizeof(*words); i++)
+        if (words[i])
+            return false;
+    for (size_t i = ALIGN_DOWN(size, sizeof(*words)); i < size; i++)
+        if (((const uint8_t*)addr)[i])
+            return false;
+    return true;
+}
+
+static int alloc_mem_plan(struct shim_mem_entry* entries, struct cp_mem_plan* plan) {
+    plan->pages_cnt = 0;
+    plan->data_pages_cnt = 0;
+    for (struct shim_mem_entry* entry = entries; entry; entry = entry->next)
+        plan->pages_cnt += mem_entry_pages(entry);
+
+    plan->bitmap_size = ALIGN_UP(plan->pages_cnt, 8) / 8;
+    plan->bitmap = calloc(1, plan->bitmap_size ?: 1);
+    if (!plan->bitmap)
+        return -ENOMEM;
+    return 0;
+}
+
+/* Returns the slice of data pages sent over the `idx`-th of `cnt` streams. */
+static void mem_plan_slice(const struct cp_mem_plan* plan, size_t idx, size_t cnt,
+                           size_t* out_first, size_t* out_end) {
+    *out_first = plan->data_pages_cnt * idx / cnt;
+    *out_end   = plan->data_pages_cnt * (idx + 1) / cnt;
+}
+
+static int transfer_mem_run(PAL_HANDLE stream, char* addr, size_t size, bool send) {
+    if (!size)
+        return 0;
+    return send ? write_exact(stream, addr, size) : read_exact(stream, addr, size);
+}
+
+/* Sends or receives data pages [first_page, end_page); consecutive pages are transferred at once. */
+static int transfer_mem_pages(PAL_HANDLE stream, struct shim_mem_entry* entries,
+                              const struct cp_mem_plan* plan, size_t first_page, size_t end_page,
+                              bool send) {
+    int ret;
+    size_t page = 0;
+    size_t data_page = 0;
+
+    for (struct shim_mem_entry* entry = entries; entry && data_page < end_page;
+             entry = entry->next) {
+        char* run_addr = entry->addr;
+        size_t run_size = 0;
+
+        for (size_t i = 0; i < mem_entry_pages(entry); i++, page++) {
+            if (!(plan->bitmap[page / 8] & (1 << (page % 8))))
+                continue;
+
+            bool take = first_page <= data_page && data_page < end_page;
+            data_page++;
+            if (!take)
+                continue;
+
+            char* addr = (char*)entry->addr + i * PAGE_SIZE;
+            size_t size = MIN(PAGE_SIZE, entry->size - i * PAGE_SIZE);
+            if (run_addr + run_size == addr) {
+                run_size += size;
+                continue;
             }
+
+            ret = transfer_mem_run(stream, run_addr, run_size, send);
+            if (ret < 0)
+                return ret;
+            run_addr = addr;
+            run_size = size;
         }
 
-        ret = write_exact(stream, mem_addr, mem_size);
+        ret = transfer_mem_run(stream, run_addr, run_size, send);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int cp_worker_transfer_mem(struct cp_worker* worker, bool send) {
+    return transfer_mem_pages(worker->stream, worker->mem_entries, worker->plan,
+                              worker->first_page, worker->end_page, send);
+}
+
+static int cp_worker_send_mem(struct cp_worker* worker) {
+    return cp_worker_transfer_mem(worker, /*send=*/true);
+}
+
+static int cp_worker_receive_mem(struct cp_worker* worker) {
+    return cp_worker_transfer_mem(worker, /*send=*/false);
+}
+
+/* Makes all memory entries readable (if `readable`) or restores their original protections. */
+static int set_mem_entries_readable(struct shim_mem_entry* entries, bool readable) {
+    int ret = 0;
+    for (struct shim_mem_entry* entry = entries; entry; entry = entry->next) {
+        if ((entry->prot & PAL_PROT_READ) || !entry->size)
+            continue;
+        int ret2 = DkVirtualMemoryProtect(entry->addr, entry->size,
+                                          entry->prot | (readable ? PAL_PROT_READ : 0));
+        if (ret2 < 0 && !ret)
+            ret = pal_to_unix_errno(ret2);
+    }
+    return ret;
+}
+
+/* Finds the pages with data; memory entries have to be readable. */
+static int prepare_mem_plan(struct shim_cp_store* store, struct cp_mem_plan* plan) {
+    int ret = alloc_mem_plan(store->first_mem_entry, plan);
+    if (ret < 0)
+        return ret;
 
-        if (!(mem_prot & PAL_PROT_READ) && mem_size > 0) {
-            /* the area was made readable above; revert to original permissions */
-            int ret2 = DkVirtualMemoryProtect(mem_addr, mem_size, mem_prot);
-            if (ret2 < 0 && !ret) {
-                ret = pal_to_unix_errno(ret2);
+    size_t page = 0;
+    for (struct shim_mem_entry* entry = store->first_mem_entry; entry; entry = entry->next) {
+        for (size_t i = 0; i < mem_entry_pages(entry); i++, page++) {
+            if (!is_zero_page((char*)entry->addr + i * PAGE_SIZE,
+                              MIN(PAGE_SIZE, entry->size - i * PAGE_SIZE))) {
+                plan->bitmap[page / 8] |= 1 << (page % 8);
+                plan->data_pages_cnt++;
             }
         }
+    }
+    return 0;
+}
+
+static size_t mem_streams_cnt(const struct cp_mem_plan* plan) {
+    size_t cnt = plan->data_pages_cnt * PAGE_SIZE / CP_MEM_STREAM_MIN_SIZE;
+    cnt = MIN(cnt, (size_t)g_pal_control->cpu_info.online_logical_cores);
+    cnt = MIN(cnt, CP_MEM_STREAMS_MAX);
+    return cnt ?: 1;
+}
 
+/* Accepts connections of the child to the streams server; each connection starts with its index. */
+static int accept_mem_streams(PAL_HANDLE server, PAL_HANDLE* streams, size_t cnt) {
+    for (size_t i = 1; i < cnt; i++) {
+        PAL_HANDLE stream = NULL;
+        int ret = DkStreamWaitForClient(server, &stream);
+        if (ret < 0)
+            return pal_to_unix_errno(ret);
+
+        uint8_t idx = 0;
+        ret = read_exact(stream, &idx, sizeof(idx));
+        if (ret >= 0 && (idx == 0 || idx >= cnt || streams[idx]))
+            ret = -EINVAL;
         if (ret < 0) {
+            DkObjectClose(stream);
             return ret;
         }
-
-        entry = entry->next;
+        streams[idx] = stream;
     }
-
     return 0;
 }
 
-static int send_checkpoint_on_stream(PAL_HANDLE stream, struct shim_cp_store* store) {
-    /* first send non-memory entries found at [store->base, store->base + store->offset) */
-    int ret = write_exact(stream, (void*)store->base, store->offset);
-    if (ret < 0) {
+/* Sends the pages bitmap and the memory; `streams[0]` is the process stream. */
+static int send_memory_on_streams(PAL_HANDLE* streams, size_t streams_cnt,
+                                  struct shim_cp_store* store, const struct cp_mem_plan* plan) {
+    int ret = write_exact(streams[0], plan->bitmap, plan->bitmap_size);
+    if (ret < 0)
         return ret;
+
+    struct cp_worker workers[CP_MEM_STREAMS_MAX];
+    for (size_t i = 0; i < streams_cnt; i++) {
+        workers[i].func = cp_worker_send_mem;
+        workers[i].stream = streams[i];
+        workers[i].mem_entries = store->first_mem_entry;
+        workers[i].plan = plan;
+        mem_plan_slice(plan, i, streams_cnt, &workers[i].first_page, &workers[i].end_page);
     }
 
-    return send_memory_on_stream(stream, store);
+    for (size_t i = 1; i < streams_cnt; i++)
+        start_cp_worker(&workers[i], /*internal_thread=*/true);
+
+    ret = cp_worker_send_mem(&workers[0]);
+
+    for (size_t i = 1; i < streams_cnt; i++) {
+        int ret2 = wait_cp_worker(&workers[i]);
+        if (ret2 < 0 && !ret)
+            ret = ret2;
+    }
+    return ret;
 }
 
 static int send_handles_on_stream(PAL_HANDLE stream, struct shim_cp_store* store) {
@@ -296,43 +557,113 @@ out:
     return ret;
 }
 
+static int connect_mem_streams(struct checkpoint_hdr* hdr, PAL_HANDLE* streams) {
+    for (size_t i = 1; i < hdr->mem_streams_cnt; i++) {
+        int ret = DkStreamOpen(hdr->mem_streams_uri, 0, 0, 0, 0, &streams[i]);
+        if (ret < 0)
+            return pal_to_unix_errno(ret);
+
+        uint8_t idx = i;
+        ret = write_exact(streams[i], &idx, sizeof(idx));
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
 static int receive_memory_on_stream(PAL_HANDLE handle, struct checkpoint_hdr* hdr, uintptr_t base) {
     ssize_t rebase = base - (uintptr_t)hdr->addr;
 
-    if (hdr->mem_entries_cnt) {
-        struct shim_mem_entry* entry = (struct shim_mem_entry*)(base + hdr->mem_offset);
+    if (!hdr->mem_entries_cnt)
+        return 0;
 
-        for (; entry; entry = entry->next) {
-            CP_REBASE(entry->next);
+    if (hdr->mem_streams_cnt < 1 || hdr->mem_streams_cnt > CP_MEM_STREAMS_MAX)
+        return -EINVAL;
 
-            log_debug("memory entry [%p]: %p-%p", entry, entry->addr, entry->addr + entry->size);
+    struct shim_mem_entry* entries = (struct shim_mem_entry*)(base + hdr->mem_offset);
 
-            PAL_PTR addr = ALLOC_ALIGN_DOWN_PTR(entry->addr);
-            PAL_NUM size = (char*)ALLOC_ALIGN_UP_PTR(entry->addr + entry->size) - (char*)addr;
-            PAL_FLG prot = entry->prot;
+    /* allocate all the memory first, parts of it are then received in parallel */
+    for (struct shim_mem_entry* entry = entries; entry; entry = entry->next) {
+        CP_REBASE(entry->next);
 
-            int ret = DkVirtualMemoryAlloc(&addr, size, 0, prot | PAL_PROT_WRITE);
-            if (ret < 0) {
-                log_error("failed allocating %p-%p", addr, addr + size);
-                return pal_to_unix_errno(ret);
-            }
+        log_debug("memory entry [%p]: %p-%p", entry, entry->addr, entry->addr + entry->size);
 
-            ret = read_exact(handle, entry->addr, entry->size);
-            if (ret < 0) {
-                return ret;
-            }
+        PAL_PTR addr = ALLOC_ALIGN_DOWN_PTR(entry->addr);
+        PAL_NUM size = (char*)ALLOC_ALIGN_UP_PTR(entry->addr + entry->size) - (char*)addr;
 
-            if (!(prot & PAL_PROT_WRITE)) {
-                ret = DkVirtualMemoryProtect(addr, size, prot);
-                if (ret < 0) {
-                    log_error("failed protecting %p-%p", addr, addr + size);
-                    return pal_to_unix_errno(ret);
-                }
-            }
+        int ret = DkVirtualMemoryAlloc(&addr, size, 0, entry->prot | PAL_PROT_WRITE);
+        if (ret < 0) {
+            log_error("failed allocating %p-%p", addr, addr + size);
+            return pal_to_unix_errno(ret);
         }
     }
 
-    return 0;
+    struct cp_mem_plan plan;
+    int ret = alloc_mem_plan(entries, &plan);
+    if (ret < 0)
+        return ret;
+
+    PAL_HANDLE streams[CP_MEM_STREAMS_MAX] = { handle };
+    struct cp_worker workers[CP_MEM_STREAMS_MAX];
+    size_t streams_cnt = hdr->mem_streams_cnt;
+
+    ret = connect_mem_streams(hdr, streams);
+    if (ret < 0)
+        goto out;
+
+    ret = read_exact(handle, plan.bitmap, plan.bitmap_size);
+    if (ret < 0)
+        goto out;
+
+    for (size_t page = 0; page < plan.pages_cnt; page++)
+        if (plan.bitmap[page / 8] & (1 << (page % 8)))
+            plan.data_pages_cnt++;
+
+    log_debug("receiving %lu of %lu memory pages over %lu streams", plan.data_pages_cnt,
+              plan.pages_cnt, streams_cnt);
+
+    for (size_t i = 0; i < streams_cnt; i++) {
+        workers[i].func = cp_worker_receive_mem;
+        workers[i].stream = streams[i];
+        workers[i].mem_entries = entries;
+        workers[i].plan = &plan;
+        mem_plan_slice(&plan, i, streams_cnt, &workers[i].first_page, &workers[i].end_page);
+    }
+
+    /* LibOS threading is not initialized yet, so these are plain PAL threads */
+    for (size_t i = 1; i < streams_cnt; i++)
+        start_cp_worker(&workers[i], /*internal_thread=*/false);
+
+    ret = cp_worker_receive_mem(&workers[0]);
+
+    for (size_t i = 1; i < streams_cnt; i++) {
+        int ret2 = wait_cp_worker(&workers[i]);
+        if (ret2 < 0 && !ret)
+            ret = ret2;
+    }
+    if (ret < 0)
+        goto out;
+
+    for (struct shim_mem_entry* entry = entries; entry; entry = entry->next) {
+        if (entry->prot & PAL_PROT_WRITE)
+            continue;
+
+        PAL_PTR addr = ALLOC_ALIGN_DOWN_PTR(entry->addr);
+        PAL_NUM size = (char*)ALLOC_ALIGN_UP_PTR(entry->addr + entry->size) - (char*)addr;
+        int ret2 = DkVirtualMemoryProtect(addr, size, entry->prot);
+        if (ret2 < 0) {
+            log_error("failed protecting %p-%p", addr, addr + size);
+            ret = pal_to_unix_errno(ret2);
+            goto out;
+        }
+    }
+
+out:
+    for (size_t i = 1; i < streams_cnt; i++)
+        if (streams[i])
+            DkObjectClose(streams[i]);
+    free(plan.bitmap);
+    return ret;
 }
 
 static int restore_checkpoint(struct checkpoint_hdr* hdr, uintptr_t base) {
@@ -458,6 +789,10 @@ static void* cp_alloc(void* addr, size_t size) {
     return addr;
 }
 
+static int cp_worker_create_process(struct cp_worker* worker) {
+    return DkProcessCreate(/*args=*/NULL, &worker->stream);
+}
+
 int create_process_and_send_checkpoint(migrate_func_t migrate_func,
                                        struct shim_child_process* child_process,
                                        struct shim_process* process_description,
@@ -465,15 +800,18 @@ int create_process_and_send_checkpoint(migrate_func_t migrate_func,
     assert(child_process);
 
     int ret = 0;
-
-    /* FIXME: Child process requires some time to initialize before starting to receive checkpoint
-     * data. Parallelizing process creation and checkpointing could improve latency of forking. */
     PAL_HANDLE pal_process = NULL;
-    ret = DkProcessCreate(/*args=*/NULL, &pal_process);
-    if (ret < 0) {
-        ret = pal_to_unix_errno(ret);
-        goto out;
-    }
+    PAL_HANDLE streams_server = NULL;
+    PAL_HANDLE streams[CP_MEM_STREAMS_MAX] = { NULL };
+    size_t streams_cnt = 1;
+    struct cp_mem_plan plan = { .bitmap = NULL };
+    bool mem_readable = false;
+
+    /* Child process requires some time to initialize before it can receive checkpoint data, so it
+     * is created in parallel with checkpointing. */
+    struct cp_worker creator = { .func = cp_worker_create_process, .stream = NULL };
+    bool creator_done = false;
+    start_cp_worker(&creator, /*internal_thread=*/true);
 
     /* allocate a space for dumping the checkpoint data */
     struct shim_cp_store cpstore;
@@ -523,13 +861,44 @@ int create_process_and_send_checkpoint(migrate_func_t migrate_func,
     if (cpstore.mem_entries_cnt) {
         hdr.mem_offset      = (uintptr_t)cpstore.first_mem_entry - cpstore.base;
         hdr.mem_entries_cnt = cpstore.mem_entries_cnt;
+
+        /* memory stays readable until it is sent */
+        mem_readable = true;
+        ret = set_mem_entries_readable(cpstore.first_mem_entry, /*readable=*/true);
+        if (ret < 0)
+            goto out;
+
+        ret = prepare_mem_plan(&cpstore, &plan);
+        if (ret < 0)
+            goto out;
+
+        streams_cnt = mem_streams_cnt(&plan);
+        if (streams_cnt > 1) {
+            ret = create_pipe(/*name=*/NULL, hdr.mem_streams_uri, sizeof(hdr.mem_streams_uri),
+                              &streams_server, /*qstr=*/NULL, /*use_vmid_for_name=*/false);
+            if (ret < 0) {
+                log_warning("failed creating memory streams (ret = %d), using a single one", ret);
+                streams_cnt = 1;
+            }
+        }
+        log_debug("sending %lu of %lu memory pages over %lu streams", plan.data_pages_cnt,
+                  plan.pages_cnt, streams_cnt);
     }
+    hdr.mem_streams_cnt = streams_cnt;
 
     if (cpstore.palhdl_entries_cnt) {
         hdr.palhdl_offset      = (uintptr_t)cpstore.last_palhdl_entry - cpstore.base;
         hdr.palhdl_entries_cnt = cpstore.palhdl_entries_cnt;
     }
 
+    creator_done = true;
+    ret = wait_cp_worker(&creator);
+    pal_process = creator.stream;
+    if (ret < 0) {
+        ret = pal_to_unix_errno(ret);
+        goto out;
+    }
+
     /* send a checkpoint header to child process to notify it to start receiving checkpoint */
     ret = write_exact(pal_process, &hdr, sizeof(hdr));
     if (ret < 0) {
@@ -537,12 +906,33 @@ int create_process_and_send_checkpoint(migrate_func_t migrate_func,
         goto out;
     }
 
-    ret = send_checkpoint_on_stream(pal_process, &cpstore);
+    /* first send non-memory entries found at [cpstore.base, cpstore.base + cpstore.offset) */
+    ret = write_exact(pal_process, (void*)cpstore.base, cpstore.offset);
     if (ret < 0) {
         log_error("failed sending checkpoint (ret = %d)", ret);
         goto out;
     }
 
+    if (cpstore.mem_entries_cnt) {
+        streams[0] = pal_process;
+        ret = accept_mem_streams(streams_server, streams, streams_cnt);
+        if (ret < 0) {
+            log_error("failed accepting memory streams (ret = %d)", ret);
+            goto out;
+        }
+
+        ret = send_memory_on_streams(streams, streams_cnt, &cpstore, &plan);
+        if (ret < 0) {
+            log_error("failed sending checkpoint memory (ret = %d)", ret);
+            goto out;
+        }
+
+        mem_readable = false;
+        ret = set_mem_entries_readable(cpstore.first_mem_entry, /*readable=*/false);
+        if (ret < 0)
+            goto out;
+    }
+
     ret = send_handles_on_stream(pal_process, &cpstore);
     if (ret < 0) {
         log_error("failed sending PAL handles as part of checkpoint (ret = %d)", ret);
@@ -587,6 +977,19 @@ int create_process_and_send_checkpoint(migrate_func_t migrate_func,
 
     ret = 0;
 out:
+    if (!creator_done) {
+        (void)wait_cp_worker(&creator);
+        pal_process = creator.stream;
+    }
+    if (mem_readable)
+        (void)set_mem_entries_readable(cpstore.first_mem_entry, /*readable=*/false);
+    free(plan.bitmap);
+
+    for (size_t i = 1; i < streams_cnt; i++)
+        if (streams[i])
+            DkObjectClose(streams[i]);
+    if (streams_server)
+        DkObjectClose(streams_server);
     if (pal_process)
         DkObjectClose(pal_process);
 
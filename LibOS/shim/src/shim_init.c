@@ -11,6 +11,7 @@
 
 #include "api.h"
 #include "hex.h"
+#include "manifest.h"
 #include "pal.h"
 #include "pal_error.h"
 #include "shim_checkpoint.h"
@@ -24,18 +25,18 @@
 #include "shim_lock.h"
 #include "shim_process.h"
 #include "shim_sync.h"
+#include "shim_syscall_trace.h"
 #include "shim_table.h"
 #include "shim_tcb.h"
 #include "shim_thread.h"
 #include "shim_utils.h"
 #include "shim_vdso.h"
 #include "shim_vma.h"
-#include "toml.h"
 
 static_assert(sizeof(shim_tcb_t) <= PAL_LIBOS_TCB_SIZE,
               "shim_tcb_t does not fit into PAL_TCB; please increase PAL_LIBOS_TCB_SIZE");
 
-const toml_table_t* g_manifest_root = NULL;
+const struct manifest* g_manifest_root = NULL;
 const PAL_CONTROL* g_pal_control = NULL;
 
 /* This function is used by stack protector's __stack_chk_fail(), _FORTIFY_SOURCE's *_chk()
@@ -290,8 +291,8 @@ int init_stack(const char** argv, const char** envp, const char*** out_argp,
 
     assert(g_manifest_root);
     uint64_t stack_size;
-    ret = toml_sizestring_in(g_manifest_root, "sys.stack.size", get_rlimit_cur(RLIMIT_STACK),
-                             &stack_size);
+    ret = manifest_sizestring_in(g_manifest_root, "sys.stack.size", get_rlimit_cur(RLIMIT_STACK),
+                                 &stack_size);
     if (ret < 0) {
         log_error("Cannot parse \'sys.stack.size\' (the value must be put in double quotes!)");
         return -EINVAL;
@@ -418,6 +419,11 @@ noreturn void* shim_init(int argc, void* args) {
         struct checkpoint_hdr hdr;
 
         int ret = read_exact(g_pal_control->parent_process, &hdr, sizeof(hdr));
+        if (ret == -ENODATA) {
+            /* the parent exited without using this child (e.g. from its pool of children) */
+            log_debug("shim_init: parent closed the stream before sending a checkpoint");
+            DkProcessExit(0);
+        }
         if (ret < 0) {
             log_error("shim_init: failed to read the whole checkpoint header: %d", ret);
             DkProcessExit(1);
@@ -440,6 +446,7 @@ noreturn void* shim_init(int argc, void* args) {
     log_setprefix(shim_get_tcb());
 
     RUN_INIT(init_async_worker);
+    RUN_INIT(init_syscall_trace);
 
     const char** new_argp;
     elf_auxv_t* new_auxv;
@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Slow paths of the LibOS mutex, see `shim_lock.h`.
+ *
+ * Contended acquisition follows the classic three-state futex mutex: a waiter which cannot take the
+ * lock by spinning marks it as SHIM_LOCK_CONTENDED and sleeps on the lock's PAL event; the owner
+ * signals the event when it releases a lock in that state. The event is auto-clearing, so it acts
+ * as a binary semaphore and a wakeup sent before the waiter actually sleeps is not lost. A woken
+ * waiter takes the lock again as SHIM_LOCK_CONTENDED, since other threads might still be sleeping.
+ *
+ * The spin limit is adapted per lock (similarly to glibc's PTHREAD_MUTEX_ADAPTIVE_NP): it tracks
+ * how many iterations recent acquisitions needed, so locks held only briefly are taken by spinning,
+ * while waiters for locks held across long operations go to sleep almost immediately.
+ */
+
+#include "api.h"
+#include "cpu.h"
+#include "pal.h"
+#include "shim_internal.h"
+#include "shim_lock.h"
+#include "spinlock.h"
+
+#define LOCK_MAX_SPINS 128
+
+/* Spinning is pointless if the lock owner cannot run in parallel. */
+static bool can_spin(void) {
+    return g_pal_control->cpu_info.online_logical_cores > 1;
+}
+
+static bool spin_for_lock(struct shim_lock* l) {
+    int32_t spins = __atomic_load_n(&l->spins, __ATOMIC_RELAXED);
+    int32_t max_spins = MIN(LOCK_MAX_SPINS, spins * 2 + 10);
+    int32_t count = 0;
+    bool acquired = false;
+
+    while (count < max_spins) {
+        count++;
+        CPU_RELAX();
+        if (__atomic_load_n(&l->state, __ATOMIC_RELAXED) != SHIM_LOCK_FREE)
+            continue;
+        uint32_t expected = SHIM_LOCK_FREE;
+        if (__atomic_compare_exchange_n(&l->state, &expected, SHIM_LOCK_LOCKED, /*weak=*/false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            acquired = true;
+            break;
+        }
+    }
+
+    /* The estimate is only a heuristic, concurrent updates may be lost. */
+    __atomic_store_n(&l->spins, spins + (count - spins) / 8, __ATOMIC_RELAXED);
+    return acquired;
+}
+
+/* Returns the event to sleep on, creating it if needed, or NULL if it could not be created. */
+static PAL_HANDLE get_lock_event(struct shim_lock* l) {
+    PAL_HANDLE event = __atomic_load_n(&l->event, __ATOMIC_ACQUIRE);
+    if (event)
+        return event;
+
+    if (DkEventCreate(&event, /*init_signaled=*/false, /*auto_clear=*/true) < 0)
+        return NULL;
+
+    PAL_HANDLE expected = NULL;
+    if (!__atomic_compare_exchange_n(&l->event, &expected, event, /*weak=*/false,
+                                     __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        /* some other waiter was faster */
+        DkObjectClose(event);
+        event = expected;
+    }
+    return event;
+}
+
+void lock_contended(struct shim_lock* l) {
+#if DEBUG_LOCK_STATS
+    uint64_t start = get_tsc();
+    bool slept = false;
+#endif
+
+    if (!can_spin() || !spin_for_lock(l)) {
+        PAL_HANDLE event = get_lock_event(l);
+        /* The event has to be published before the state says there are sleepers, see
+         * `unlock_wake`. */
+        while (__atomic_exchange_n(&l->state, SHIM_LOCK_CONTENDED, __ATOMIC_ACQ_REL)
+                   != SHIM_LOCK_FREE) {
+#if DEBUG_LOCK_STATS
+            slept = true;
+#endif
+            if (event) {
+                /* errors (e.g. interruptions) just cause another try */
+                (void)DkEventWait(event, /*timeout=*/NULL);
+            } else {
+                /* out of memory, fall back to polling */
+                DkThreadYieldExecution();
+            }
+        }
+    }
+
+#if DEBUG_LOCK_STATS
+    if (l->stats) {
+        __atomic_add_fetch(&l->stats->contended, 1, __ATOMIC_RELAXED);
+        if (slept)
+            __atomic_add_fetch(&l->stats->slept, 1, __ATOMIC_RELAXED);
+        record_lock_time(&l->stats->wait_time, &l->stats->max_wait_time, get_tsc() - start);
+    }
+#endif
+}
+
+void unlock_wake(struct shim_lock* l) {
+    /* The exchange in `unlock` synchronizes with the one in `lock_contended`, so the event of any
+     * sleeping waiter is visible here. */
+    PAL_HANDLE event = __atomic_load_n(&l->event, __ATOMIC_ACQUIRE);
+    if (event)
+        DkEventSet(event);
+}
+
+#if DEBUG_LOCK_STATS
+
+/* Locks are grouped by the place where they were created; sites beyond the table limit are not
+ * tracked. */
+#define LOCK_STATS_MAX_SITES 256
+
+static struct shim_lock_stats g_lock_stats[LOCK_STATS_MAX_SITES];
+static size_t g_lock_stats_count = 0;
+static spinlock_t g_lock_stats_lock = INIT_SPINLOCK_UNLOCKED;
+
+struct shim_lock_stats* get_lock_stats(const char* site) {
+    struct shim_lock_stats* stats = NULL;
+
+    spinlock_lock(&g_lock_stats_lock);
+    for (size_t i = 0; i < g_lock_stats_count; i++) {
+        if (g_lock_stats[i].site == site || !strcmp(g_lock_stats[i].site, site)) {
+            stats = &g_lock_stats[i];
+            goto out;
+        }
+    }
+    if (g_lock_stats_count < LOCK_STATS_MAX_SITES) {
+        stats = &g_lock_stats[g_lock_stats_count++];
+        stats->site = site;
+    }
+out:
+    spinlock_unlock(&g_lock_stats_lock);
+    return stats;
+}
+
+void record_lock_time(uint64_t* total, uint64_t* max, uint64_t time) {
+    __atomic_add_fetch(total, time, __ATOMIC_RELAXED);
+    uint64_t old_max = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (time > old_max && !__atomic_compare_exchange_n(max, &old_max, time, /*weak=*/true,
+                                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void dump_lock_stats(void) {
+    spinlock_lock(&g_lock_stats_lock);
+    log_always("lock statistics (times in TSC cycles):");
+    log_always("%-48s %10s %10s %10s %14s %12s %14s %12s", "site", "acquired", "contended",
+               "slept", "wait", "max wait", "hold", "max hold");
+    for (size_t i = 0; i < g_lock_stats_count; i++) {
+        struct shim_lock_stats* stats = &g_lock_stats[i];
+        if (!__atomic_load_n(&stats->acquired, __ATOMIC_RELAXED))
+            continue;
+        log_always("%-48s %10lu %10lu %10lu %14lu %12lu %14lu %12lu", stats->site,
+                   __atomic_load_n(&stats->acquired, __ATOMIC_RELAXED),
+                   __atomic_load_n(&stats->contended, __ATOMIC_RELAXED),
+                   __atomic_load_n(&stats->slept, __ATOMIC_RELAXED),
+                   __atomic_load_n(&stats->wait_time, __ATOMIC_RELAXED),
+                   __atomic_load_n(&stats->max_wait_time, __ATOMIC_RELAXED),
+                   __atomic_load_n(&stats->hold_time, __ATOMIC_RELAXED),
+                   __atomic_load_n(&stats->max_hold_time, __ATOMIC_RELAXED));
+    }
+    spinlock_unlock(&g_lock_stats_lock);
+}
+
+#else /* DEBUG_LOCK_STATS */
+
+void dump_lock_stats(void) {}
+
+#endif /* DEBUG_LOCK_STATS */
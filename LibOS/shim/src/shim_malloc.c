@@ -2,8 +2,16 @@
 /* Copyright (C) 2014 Stony Brook University */
 
 /*
- * This file implements page allocation for the library OS-internal SLAB memory allocator. The slab
- * allocator is in common/include/slabmgr.h.
+ * This file implements the library OS-internal memory allocator. Objects come from the SLAB
+ * allocator in common/include/slabmgr.h, with a per-thread magazine layer on top of it.
+ *
+ * Each thread caches free objects of every size class in two magazines (chains of at most
+ * MAGAZINE_SIZE objects), kept in its TCB: `loaded` serves malloc() and free(), `previous` is either
+ * empty or full. Only when both are exhausted (or both full) does the thread exchange a whole
+ * magazine with the per-size-class depot, which takes a short depot spinlock. The depot in turn
+ * refills from and drains to the slab manager a magazine at a time, so `slab_mgr_lock` is taken
+ * once per MAGAZINE_SIZE objects at most. Objects are linked through their first word while cached,
+ * and depot magazines through the second one (slab objects are at least 16 bytes).
  *
  * When existing slabs are not sufficient, or a large (4k or greater) allocation is requested, it
  * ends up here (__system_alloc and __system_free).
@@ -15,8 +23,10 @@
 #include "shim_checkpoint.h"
 #include "shim_internal.h"
 #include "shim_lock.h"
+#include "shim_tcb.h"
 #include "shim_utils.h"
 #include "shim_vma.h"
+#include "spinlock.h"
 
 static struct shim_lock slab_mgr_lock;
 
@@ -31,6 +41,220 @@ static struct shim_lock slab_mgr_lock;
 
 static SLAB_MGR slab_mgr = NULL;
 
+#define MAGAZINE_SIZE       32
+/* Full magazines kept in the depot per size class; the excess goes back to the slab manager. */
+#define DEPOT_MAX_MAGAZINES 16
+/* Per-thread operation counts are folded into the global statistics in batches of this size. */
+#define STATS_BATCH         256
+
+#define OBJ_NEXT(obj) (((void**)(obj))[0])
+#define MAG_NEXT(mag) (((void**)(mag))[1])
+
+struct malloc_level_cache {
+    void* loaded;        /* chain of `loaded_cnt` free objects */
+    void* previous;      /* NULL or a full magazine */
+    uint32_t loaded_cnt;
+    uint32_t allocs;     /* not yet folded into `g_slab_stats` */
+    uint32_t frees;
+};
+
+struct malloc_thread_cache {
+    struct malloc_level_cache levels[SLAB_LEVEL];
+};
+
+struct malloc_depot {
+    spinlock_t lock;
+    void* full;          /* stack of `full_cnt` full magazines */
+    size_t full_cnt;
+    /* statistics, protected by `lock` */
+    uint64_t slab_objs;  /* objects currently taken from the slab manager */
+    uint64_t gets;       /* magazines handed out to threads */
+    uint64_t puts;       /* magazines taken back from threads */
+} __attribute__((aligned(64)));
+
+static struct malloc_depot g_depots[SLAB_LEVEL];
+
+/* malloc()/free() counts, updated atomically; per size class, plus large objects at the end */
+static struct {
+    uint64_t allocs;
+    uint64_t frees;
+} g_slab_stats[SLAB_LEVEL + 1];
+
+static void fold_stats(struct malloc_level_cache* lc, size_t level) {
+    if (lc->allocs) {
+        __atomic_add_fetch(&g_slab_stats[level].allocs, lc->allocs, __ATOMIC_RELAXED);
+        lc->allocs = 0;
+    }
+    if (lc->frees) {
+        __atomic_add_fetch(&g_slab_stats[level].frees, lc->frees, __ATOMIC_RELAXED);
+        lc->frees = 0;
+    }
+}
+
+static struct malloc_thread_cache* get_thread_cache(void) {
+    struct malloc_thread_cache* cache = SHIM_TCB_GET(malloc_cache);
+    if (cache)
+        return cache;
+
+    /* Bypass the caches: this thread has none yet. */
+    cache = slab_alloc(slab_mgr, sizeof(*cache));
+    if (!cache)
+        return NULL;
+    memset(cache, 0, sizeof(*cache));
+    SHIM_TCB_SET(malloc_cache, cache);
+    return cache;
+}
+
+/* Loads a full magazine from the depot, or a new one from the slab manager, into `lc`. */
+static bool depot_get(struct malloc_level_cache* lc, size_t level) {
+    struct malloc_depot* depot = &g_depots[level];
+    assert(!lc->loaded_cnt);
+
+    spinlock_lock(&depot->lock);
+    if (depot->full) {
+        lc->loaded = depot->full;
+        lc->loaded_cnt = MAGAZINE_SIZE;
+        depot->full = MAG_NEXT(depot->full);
+        depot->full_cnt--;
+        depot->gets++;
+        spinlock_unlock(&depot->lock);
+        return true;
+    }
+    spinlock_unlock(&depot->lock);
+
+    void* chain;
+    size_t cnt = slab_alloc_chain(slab_mgr, level, MAGAZINE_SIZE, &chain);
+    if (!cnt)
+        return false;
+
+    spinlock_lock(&depot->lock);
+    depot->slab_objs += cnt;
+    depot->gets++;
+    spinlock_unlock(&depot->lock);
+
+    lc->loaded = chain;
+    lc->loaded_cnt = cnt;
+    return true;
+}
+
+/* Returns a chain of `cnt` objects to the depot; anything but a full magazine that fits in the
+ * depot goes directly back to the slab manager. */
+static void depot_put(void* chain, size_t cnt, size_t level) {
+    struct malloc_depot* depot = &g_depots[level];
+
+    spinlock_lock(&depot->lock);
+    depot->puts++;
+    if (cnt == MAGAZINE_SIZE && depot->full_cnt < DEPOT_MAX_MAGAZINES) {
+        MAG_NEXT(chain) = depot->full;
+        depot->full = chain;
+        depot->full_cnt++;
+        spinlock_unlock(&depot->lock);
+        return;
+    }
+    depot->slab_objs -= cnt;
+    spinlock_unlock(&depot->lock);
+
+    slab_free_chain(slab_mgr, level, chain);
+}
+
+static void* cache_alloc(size_t level) {
+    struct malloc_thread_cache* cache = get_thread_cache();
+    if (!cache)
+        return NULL;
+
+    struct malloc_level_cache* lc = &cache->levels[level];
+    if (!lc->loaded_cnt) {
+        if (lc->previous) {
+            lc->loaded = lc->previous;
+            lc->loaded_cnt = MAGAZINE_SIZE;
+            lc->previous = NULL;
+        } else {
+            fold_stats(lc, level);
+            if (!depot_get(lc, level))
+                return NULL;
+        }
+    }
+
+    void* obj = lc->loaded;
+    lc->loaded = OBJ_NEXT(obj);
+    lc->loaded_cnt--;
+
+    if (++lc->allocs == STATS_BATCH)
+        fold_stats(lc, level);
+    return obj;
+}
+
+static void cache_free(void* obj, size_t level) {
+    struct malloc_thread_cache* cache = get_thread_cache();
+    if (!cache) {
+        /* can only happen on the very first free() of a thread under memory pressure */
+        void* chain = obj;
+        OBJ_NEXT(chain) = NULL;
+        __atomic_add_fetch(&g_slab_stats[level].frees, 1, __ATOMIC_RELAXED);
+        depot_put(chain, 1, level);
+        return;
+    }
+
+    struct malloc_level_cache* lc = &cache->levels[level];
+    if (lc->loaded_cnt == MAGAZINE_SIZE) {
+        if (lc->previous) {
+            fold_stats(lc, level);
+            depot_put(lc->previous, MAGAZINE_SIZE, level);
+        }
+        lc->previous = lc->loaded;
+        lc->loaded = NULL;
+        lc->loaded_cnt = 0;
+    }
+
+    OBJ_NEXT(obj) = lc->loaded;
+    lc->loaded = obj;
+    lc->loaded_cnt++;
+
+    if (++lc->frees == STATS_BATCH)
+        fold_stats(lc, level);
+}
+
+void destroy_thread_malloc_cache(void) {
+    struct malloc_thread_cache* cache = SHIM_TCB_GET(malloc_cache);
+    if (!cache)
+        return;
+    SHIM_TCB_SET(malloc_cache, NULL);
+
+    for (size_t level = 0; level < SLAB_LEVEL; level++) {
+        struct malloc_level_cache* lc = &cache->levels[level];
+        fold_stats(lc, level);
+        if (lc->loaded_cnt)
+            depot_put(lc->loaded, lc->loaded_cnt, level);
+        if (lc->previous)
+            depot_put(lc->previous, MAGAZINE_SIZE, level);
+    }
+
+    slab_free(slab_mgr, cache);
+}
+
+size_t get_slab_stats(struct shim_slab_stats* stats, size_t count) {
+    size_t i;
+    for (i = 0; i < count && i <= SLAB_LEVEL; i++) {
+        memset(&stats[i], 0, sizeof(stats[i]));
+        stats[i].allocs = __atomic_load_n(&g_slab_stats[i].allocs, __ATOMIC_RELAXED);
+        stats[i].frees  = __atomic_load_n(&g_slab_stats[i].frees, __ATOMIC_RELAXED);
+        if (i == SLAB_LEVEL) {
+            /* large objects */
+            continue;
+        }
+
+        struct malloc_depot* depot = &g_depots[i];
+        stats[i].obj_size = slab_levels[i];
+        spinlock_lock(&depot->lock);
+        stats[i].slab_objs       = depot->slab_objs;
+        stats[i].depot_magazines = depot->full_cnt;
+        stats[i].depot_gets      = depot->gets;
+        stats[i].depot_puts      = depot->puts;
+        spinlock_unlock(&depot->lock);
+    }
+    return i;
+}
+
 /* Returns NULL on failure */
 void* __system_malloc(size_t size) {
     size_t alloc_size = ALLOC_ALIGN_UP(size);
@@ -75,11 +299,23 @@ int init_slab(void) {
     if (!slab_mgr) {
         return -ENOMEM;
     }
+    for (size_t i = 0; i < SLAB_LEVEL; i++) {
+        spinlock_init(&g_depots[i].lock);
+    }
     return 0;
 }
 
 void* malloc(size_t size) {
-    void* mem = slab_alloc(slab_mgr, size);
+    void* mem;
+    size_t level = slab_size_to_level(size);
+
+    if (level == (size_t)-1) {
+        mem = slab_alloc(slab_mgr, size);
+        if (mem)
+            __atomic_add_fetch(&g_slab_stats[SLAB_LEVEL].allocs, 1, __ATOMIC_RELAXED);
+    } else {
+        mem = cache_alloc(level);
+    }
 
     if (!mem) {
         /*
@@ -142,6 +378,29 @@ void free(void* mem) {
     if (memory_migrated(mem)) {
         return;
     }
+    if (!mem)
+        return;
+
+    unsigned char level = RAW_TO_LEVEL(mem);
+    if (level == (unsigned char)-1) {
+        __atomic_add_fetch(&g_slab_stats[SLAB_LEVEL].frees, 1, __ATOMIC_RELAXED);
+        slab_free(slab_mgr, mem);
+        return;
+    }
+
+    if (level >= SLAB_LEVEL) {
+        log_always("Heap corruption detected: invalid heap level %u", level);
+        abort();
+    }
+
+#ifdef SLAB_CANARY
+    unsigned long* m = (unsigned long*)(mem + slab_levels[level]);
+    __UNUSED(m);
+    assert(*m == SLAB_CANARY_STRING);
+#endif
+#ifdef DEBUG
+    memset(mem, 0xCC, slab_levels[level]);
+#endif
 
-    slab_free(slab_mgr, mem);
+    cache_free(mem, level);
 }
@@ -503,7 +503,9 @@ struct parser_table {
                               parse_pointer_arg, parse_pointer_arg}},
     [__NR_get_robust_list] = {.slow = false, .name = "get_robust_list", .parser = {parse_long_arg,
                               parse_integer_arg, parse_pointer_arg, parse_pointer_arg}},
-    [__NR_splice] = {.slow = false, .name = "splice", .parser = {NULL}},
+    [__NR_splice] = {.slow = true, .name = "splice", .parser = {parse_long_arg, parse_integer_arg,
+                     parse_pointer_arg, parse_integer_arg, parse_pointer_arg, parse_pointer_arg,
+                     parse_integer_arg}},
     [__NR_tee] = {.slow = false, .name = "tee", .parser = {NULL}},
     [__NR_sync_file_range] = {.slow = false, .name = "sync_file_range", .parser = {NULL}},
     [__NR_vmsplice] = {.slow = false, .name = "vmsplice", .parser = {NULL}},
@@ -563,7 +565,9 @@ struct parser_table {
     [__NR_userfaultfd] = {.slow = false, .name = "userfaultfd", .parser = {NULL}},
     [__NR_membarrier] = {.slow = false, .name = "membarrier", .parser = {NULL}},
     [__NR_mlock2] = {.slow = false, .name = "mlock2", .parser = {NULL}},
-    [__NR_copy_file_range] = {.slow = false, .name = "copy_file_range", .parser = {NULL}},
+    [__NR_copy_file_range] = {.slow = true, .name = "copy_file_range", .parser = {parse_long_arg,
+                              parse_integer_arg, parse_pointer_arg, parse_integer_arg,
+                              parse_pointer_arg, parse_pointer_arg, parse_integer_arg}},
     [__NR_preadv2] = {.slow = false, .name = "preadv2", .parser = {NULL}},
     [__NR_pwritev2] = {.slow = false, .name = "pwritev2", .parser = {NULL}},
     [__NR_pkey_mprotect] = {.slow = false, .name = "pkey_mprotect", .parser = {NULL}},
@@ -1558,6 +1562,12 @@ static int buf_write_all(const char* str, size_t size, void* arg) {
     return 0;
 }
 
+const char* get_syscall_name(unsigned long sysno) {
+    if (sysno >= ARRAY_SIZE(syscall_parser_table))
+        return NULL;
+    return syscall_parser_table[sysno].name;
+}
+
 void debug_print_syscall_before(unsigned long sysno, ...) {
     if (g_log_level < LOG_LEVEL_TRACE)
         return;
@@ -819,30 +819,49 @@ static int vdso_map_init(void) {
      * In host child process, LibOS may or may not be loaded at the same address.
      * When LibOS is loaded at different address, it may overlap with the old vDSO
      * area.
+     *
+     * The vDSO image is preceded by the (read-only) time page, which it accesses at a fixed offset
+     * from its code.
      */
+    size_t time_size = ALLOC_ALIGN_UP(VDSO_TIME_PAGE_SIZE);
+    size_t vdso_size = ALLOC_ALIGN_UP(vdso_so_size);
     void* addr = NULL;
-    int ret = bkeep_mmap_any_aslr(ALLOC_ALIGN_UP(vdso_so_size), PROT_READ | PROT_EXEC,
+    int ret = bkeep_mmap_any_aslr(time_size + vdso_size, PROT_READ | PROT_EXEC,
                                   MAP_PRIVATE | MAP_ANONYMOUS, NULL, 0, LINUX_VDSO_FILENAME,
                                   &addr);
     if (ret < 0) {
         return ret;
     }
 
-    ret = DkVirtualMemoryAlloc(&addr, ALLOC_ALIGN_UP(vdso_so_size), /*alloc_type=*/0,
+    ret = bkeep_mprotect(addr, time_size, PROT_READ, /*is_internal=*/false);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = DkVirtualMemoryAlloc(&addr, time_size + vdso_size, /*alloc_type=*/0,
                                PAL_PROT_READ | PAL_PROT_WRITE);
     if (ret < 0) {
         return pal_to_unix_errno(ret);
     }
 
-    memcpy(addr, &vdso_so, vdso_so_size);
-    memset(addr + vdso_so_size, 0, ALLOC_ALIGN_UP(vdso_so_size) - vdso_so_size);
+    void* vdso = addr + time_size;
+    memset(addr, 0, time_size);
+    memcpy(vdso, &vdso_so, vdso_so_size);
+    memset(vdso + vdso_so_size, 0, vdso_size - vdso_so_size);
 
-    ret = DkVirtualMemoryProtect(addr, ALLOC_ALIGN_UP(vdso_so_size), PAL_PROT_READ | PAL_PROT_EXEC);
+    ret = DkVirtualMemoryProtect(addr, time_size, PAL_PROT_READ);
     if (ret < 0) {
         return pal_to_unix_errno(ret);
     }
 
-    vdso_addr = addr;
+    ret = DkVirtualMemoryProtect(vdso, vdso_size, PAL_PROT_READ | PAL_PROT_EXEC);
+    if (ret < 0) {
+        return pal_to_unix_errno(ret);
+    }
+
+    init_vdso_time_page(vdso - VDSO_TIME_PAGE_SIZE);
+
+    vdso_addr = vdso;
     return 0;
 }
 
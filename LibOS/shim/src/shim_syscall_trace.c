@@ -0,0 +1,388 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Binary syscall trace, see `shim_syscall_trace.h`.
+ *
+ * Each ring has a single producer (the owning thread) and a single consumer (the drain thread), so
+ * records are passed without locks: the owner publishes a record by advancing `head`, the drain
+ * thread frees the space by advancing `tail`. The list of rings is protected by `g_rings_lock`.
+ */
+
+#include "api.h"
+#include "cpu.h"
+#include "list.h"
+#include "pal.h"
+#include "shim_internal.h"
+#include "shim_lock.h"
+#include "shim_process.h"
+#include "shim_syscall_trace.h"
+#include "shim_table.h"
+#include "shim_tcb.h"
+#include "shim_thread.h"
+#include "shim_utils.h"
+
+#define DEFAULT_RING_RECORDS 4096
+#define DRAIN_INTERVAL_US    100000
+
+DEFINE_LIST(syscall_trace_ring);
+DEFINE_LISTP(syscall_trace_ring);
+struct syscall_trace_ring {
+    LIST_TYPE(syscall_trace_ring) list;
+    IDTYPE tid;
+    uint64_t head;             /* next record to fill, advanced by the owner */
+    uint64_t tail;             /* next record to drain, advanced by the drain thread */
+    uint64_t dropped;          /* records dropped because the ring was full, owner only */
+    uint64_t dropped_reported; /* drain thread only */
+    bool exited;               /* the owner exited and will not touch the ring anymore */
+
+    /* state of the current syscall, owner only */
+    uint64_t start;
+    uint64_t pal_calls_start;
+    uint64_t host_calls_start;
+
+    struct syscall_trace_record records[];
+};
+
+bool g_syscall_trace_enabled = false;
+
+static size_t g_ring_records;   /* power of two */
+static uint64_t g_tsc_hz;       /* 0 if timestamps are in microseconds */
+
+static struct shim_lock g_rings_lock;
+static LISTP_TYPE(syscall_trace_ring) g_rings = LISTP_INIT;
+
+/* trace file, protected by `g_rings_lock` */
+static PAL_HANDLE g_trace_handle;
+static uint64_t g_trace_offset;
+
+static struct shim_thread* g_drain_thread;
+static PAL_HANDLE g_drain_exit_event;
+static int g_clear_on_drain_exit = 1;
+
+static uint64_t trace_timestamp(void) {
+    if (g_tsc_hz)
+        return get_tsc();
+
+    uint64_t usec = 0;
+    (void)DkSystemTimeQuery(&usec);
+    return usec;
+}
+
+static int trace_write(const void* buf, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        size_t count = size - written;
+        int ret = DkStreamWrite(g_trace_handle, g_trace_offset, &count, (char*)buf + written,
+                                NULL);
+        if (ret < 0) {
+            if (ret == -PAL_ERROR_INTERRUPTED || ret == -PAL_ERROR_TRYAGAIN)
+                continue;
+            return pal_to_unix_errno(ret);
+        }
+        if (count == 0)
+            return -EIO;
+        written += count;
+        g_trace_offset += count;
+    }
+    return 0;
+}
+
+static int drain_ring(struct syscall_trace_ring* ring) {
+    int ret;
+    uint64_t tail = ring->tail;
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    while (tail != head) {
+        size_t idx = tail & (g_ring_records - 1);
+        size_t cnt = MIN(head - tail, g_ring_records - idx);
+        ret = trace_write(&ring->records[idx], cnt * sizeof(ring->records[0]));
+        if (ret < 0)
+            return ret;
+        tail += cnt;
+    }
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+    uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    if (dropped != ring->dropped_reported) {
+        struct syscall_trace_record record = {
+            .type = SYSCALL_TRACE_DROPPED,
+            .tid = ring->tid,
+            .ret = dropped - ring->dropped_reported,
+        };
+        ret = trace_write(&record, sizeof(record));
+        if (ret < 0)
+            return ret;
+        ring->dropped_reported = dropped;
+    }
+    return 0;
+}
+
+static void drain_rings(void) {
+    struct syscall_trace_ring* ring;
+    struct syscall_trace_ring* tmp;
+
+    lock(&g_rings_lock);
+    if (!g_trace_handle) {
+        unlock(&g_rings_lock);
+        return;
+    }
+
+    LISTP_FOR_EACH_ENTRY_SAFE(ring, tmp, &g_rings, list) {
+        /* all records of an exited owner are visible once `exited` is */
+        bool exited = __atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE);
+        int ret = drain_ring(ring);
+        if (ret < 0) {
+            log_error("syscall trace: writing the trace file failed (%d), tracing stopped", ret);
+            DkObjectClose(g_trace_handle);
+            g_trace_handle = NULL;
+            break;
+        }
+        if (exited) {
+            LISTP_DEL(ring, &g_rings, list);
+            free(ring);
+        }
+    }
+    unlock(&g_rings_lock);
+}
+
+static void drain_thread_main(void* arg) {
+    __UNUSED(arg);
+    assert(g_drain_thread);
+
+    shim_tcb_init();
+    set_cur_thread(g_drain_thread);
+
+    while (true) {
+        uint64_t timeout_us = DRAIN_INTERVAL_US;
+        int ret = DkEventWait(g_drain_exit_event, &timeout_us);
+        drain_rings();
+        if (ret == 0)
+            break;
+    }
+
+    struct shim_thread* cur_thread = get_cur_thread();
+    cur_thread->shim_tcb->tp = NULL;
+    put_thread(cur_thread);
+
+    destroy_thread_malloc_cache();
+    DkThreadExit(&g_clear_on_drain_exit);
+    /* UNREACHABLE */
+}
+
+static int write_trace_header(void) {
+    struct syscall_trace_header header = {
+        .version = SYSCALL_TRACE_VERSION,
+        .record_size = sizeof(struct syscall_trace_record),
+        .pid = g_process.pid,
+        .syscall_names_cnt = LIBOS_SYSCALL_BOUND,
+        .tsc_hz = g_tsc_hz,
+    };
+    memcpy(header.magic, SYSCALL_TRACE_MAGIC, sizeof(header.magic));
+
+    int ret = trace_write(&header, sizeof(header));
+    if (ret < 0)
+        return ret;
+
+    for (unsigned long sysnr = 0; sysnr < LIBOS_SYSCALL_BOUND; sysnr++) {
+        const char* name = get_syscall_name(sysnr);
+        uint16_t len = name ? strlen(name) : 0;
+        ret = trace_write(&len, sizeof(len));
+        if (ret < 0)
+            return ret;
+        if (len) {
+            ret = trace_write(name, len);
+            if (ret < 0)
+                return ret;
+        }
+    }
+    return 0;
+}
+
+int init_syscall_trace(void) {
+    int ret;
+
+    assert(g_manifest_root);
+    char* path = NULL;
+    ret = manifest_string_in(g_manifest_root, "libos.syscall_trace.file", &path);
+    if (ret < 0) {
+        log_error("Cannot parse 'libos.syscall_trace.file'");
+        return -EINVAL;
+    }
+    if (!path)
+        return 0;
+
+    int64_t ring_records;
+    ret = manifest_int_in(g_manifest_root, "libos.syscall_trace.ring_records",
+                          DEFAULT_RING_RECORDS, &ring_records);
+    if (ret < 0 || ring_records <= 0 || !IS_POWER_OF_2(ring_records)) {
+        log_error("Cannot parse 'libos.syscall_trace.ring_records' (the value must be a power of "
+                  "two)");
+        ret = -EINVAL;
+        goto out;
+    }
+    g_ring_records = ring_records;
+
+    PAL_TIME_CALIBRATION calib;
+    g_tsc_hz = DkSystemTimeCalibration(&calib) == 0 ? calib.tsc_hz : 0;
+
+    if (!create_lock(&g_rings_lock)) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    /* every process writes its own file */
+    char pid_suffix[16];
+    snprintf(pid_suffix, sizeof(pid_suffix), ".%u", g_process.pid);
+    char* uri = alloc_concat3(URI_PREFIX_FILE, static_strlen(URI_PREFIX_FILE), path, -1,
+                              pid_suffix, -1);
+    if (!uri) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    ret = DkStreamOpen(uri, PAL_ACCESS_WRONLY, PAL_SHARE_OWNER_R | PAL_SHARE_OWNER_W,
+                       PAL_CREATE_TRY, PAL_OPTION_CLOEXEC, &g_trace_handle);
+    if (ret < 0) {
+        log_error("Cannot open the syscall trace file %s: %d", uri, ret);
+        free(uri);
+        ret = pal_to_unix_errno(ret);
+        goto out;
+    }
+    free(uri);
+    ret = DkStreamSetLength(g_trace_handle, 0);
+    if (ret < 0) {
+        ret = pal_to_unix_errno(ret);
+        goto out_close;
+    }
+
+    ret = write_trace_header();
+    if (ret < 0)
+        goto out_close;
+
+    ret = DkEventCreate(&g_drain_exit_event, /*init_signaled=*/false, /*auto_clear=*/false);
+    if (ret < 0) {
+        ret = pal_to_unix_errno(ret);
+        goto out_close;
+    }
+
+    g_drain_thread = get_new_internal_thread();
+    if (!g_drain_thread) {
+        ret = -ENOMEM;
+        goto out_close;
+    }
+
+    PAL_HANDLE handle = NULL;
+    ret = DkThreadCreate(drain_thread_main, NULL, &handle);
+    if (ret < 0) {
+        put_thread(g_drain_thread);
+        g_drain_thread = NULL;
+        ret = pal_to_unix_errno(ret);
+        goto out_close;
+    }
+    g_drain_thread->pal_handle = handle;
+
+    g_syscall_trace_enabled = true;
+    ret = 0;
+    goto out;
+
+out_close:
+    DkObjectClose(g_trace_handle);
+    g_trace_handle = NULL;
+out:
+    free(path);
+    return ret;
+}
+
+void terminate_syscall_trace(void) {
+    if (!g_syscall_trace_enabled)
+        return;
+
+    DkEventSet(g_drain_exit_event);
+    while (__atomic_load_n(&g_clear_on_drain_exit, __ATOMIC_ACQUIRE))
+        CPU_RELAX();
+    put_thread(g_drain_thread);
+    g_drain_thread = NULL;
+
+    /* records of the current thread */
+    drain_rings();
+
+    lock(&g_rings_lock);
+    if (g_trace_handle) {
+        DkObjectClose(g_trace_handle);
+        g_trace_handle = NULL;
+    }
+    unlock(&g_rings_lock);
+}
+
+static struct syscall_trace_ring* create_ring(void) {
+    struct syscall_trace_ring* ring = malloc(sizeof(*ring)
+                                             + g_ring_records * sizeof(ring->records[0]));
+    if (!ring)
+        return NULL;
+
+    memset(ring, 0, sizeof(*ring));
+    struct shim_thread* cur_thread = get_cur_thread();
+    ring->tid = cur_thread ? cur_thread->tid : 0;
+    INIT_LIST_HEAD(ring, list);
+
+    lock(&g_rings_lock);
+    LISTP_ADD_TAIL(ring, &g_rings, list);
+    unlock(&g_rings_lock);
+    return ring;
+}
+
+void syscall_trace_thread_exit(void) {
+    struct syscall_trace_ring* ring = SHIM_TCB_GET(syscall_trace);
+    if (!ring)
+        return;
+
+    SHIM_TCB_SET(syscall_trace, NULL);
+    __atomic_store_n(&ring->exited, true, __ATOMIC_RELEASE);
+}
+
+void do_syscall_trace_before(void) {
+    struct syscall_trace_ring* ring = SHIM_TCB_GET(syscall_trace);
+    if (!ring) {
+        ring = create_ring();
+        if (!ring)
+            return; /* this thread is not traced */
+        SHIM_TCB_SET(syscall_trace, ring);
+    }
+
+    PAL_TCB* pal_tcb = pal_get_tcb();
+    ring->pal_calls_start  = pal_tcb->pal_calls_cnt;
+    ring->host_calls_start = pal_tcb->host_calls_cnt;
+    ring->start = trace_timestamp();
+}
+
+void do_syscall_trace_after(unsigned long sysnr, long ret, PAL_CONTEXT* context) {
+    struct syscall_trace_ring* ring = SHIM_TCB_GET(syscall_trace);
+    if (!ring)
+        return;
+
+    uint64_t end = trace_timestamp();
+    PAL_TCB* pal_tcb = pal_get_tcb();
+
+    uint64_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == g_ring_records) {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    arch_syscall_arg_t args[] = { ALL_SYSCALL_ARGS(context) };
+    uint64_t args_hash = 0;
+    for (size_t i = 0; i < ARRAY_SIZE(args); i++)
+        args_hash = hash64(args_hash ^ (uint64_t)args[i]);
+
+    struct syscall_trace_record* record = &ring->records[head & (g_ring_records - 1)];
+    record->type       = SYSCALL_TRACE_SYSCALL;
+    record->sysnr      = sysnr;
+    record->tid        = ring->tid;
+    record->start      = ring->start;
+    record->duration   = end - ring->start;
+    record->ret        = ret;
+    record->args_hash  = args_hash;
+    record->pal_calls  = pal_tcb->pal_calls_cnt - ring->pal_calls_start;
+    record->host_calls = pal_tcb->host_calls_cnt - ring->host_calls_start;
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
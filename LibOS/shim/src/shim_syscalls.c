@@ -5,6 +5,7 @@
 
 #include "shim_defs.h"
 #include "shim_internal.h"
+#include "shim_syscall_trace.h"
 #include "shim_table.h"
 #include "shim_tcb.h"
 #include "shim_types.h"
@@ -19,6 +20,7 @@ typedef arch_syscall_arg_t (*six_args_syscall_t)(arch_syscall_arg_t, arch_syscal
  */
 noreturn void shim_emulate_syscall(PAL_CONTEXT* context) {
     SHIM_TCB_SET(context.regs, context);
+    syscall_trace_before();
 
     unsigned long sysnr = pal_context_get_syscall(context);
     arch_syscall_arg_t ret = 0;
@@ -37,6 +39,7 @@ noreturn void shim_emulate_syscall(PAL_CONTEXT* context) {
     debug_print_syscall_after(sysnr, ret, ALL_SYSCALL_ARGS(context));
 
 out:
+    syscall_trace_after(sysnr, ret, context);
     pal_context_set_retval(context, ret);
 
     /* Some syscalls e.g. `sigreturn` could have changed context and in reality we might be not
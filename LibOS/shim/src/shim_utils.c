@@ -42,3 +42,21 @@ int write_exact(PAL_HANDLE handle, void* buf, size_t size) {
     }
     return 0;
 }
+
+int64_t pal_stream_iov_io(PAL_HANDLE handle, enum PAL_IO_OP op, uint64_t offset,
+                          const struct iovec* iov, size_t iov_cnt) {
+    static_assert(sizeof(PAL_IOVEC) == sizeof(struct iovec) &&
+                  offsetof(PAL_IOVEC, buffer) == offsetof(struct iovec, iov_base) &&
+                  offsetof(PAL_IOVEC, count) == offsetof(struct iovec, iov_len),
+                  "PAL_IOVEC must be layout-compatible with struct iovec");
+
+    PAL_IO_REQUEST req = {
+        .handle  = handle,
+        .op      = op,
+        .offset  = offset,
+        .iov     = (PAL_IOVEC*)iov,
+        .iov_cnt = iov_cnt,
+    };
+    int ret = DkStreamsBatchIo(1, &req);
+    return ret < 0 ? ret : req.result;
+}
@@ -21,7 +21,13 @@
         DkProcessExit(1);                               \
     } while (0)
 
+/* Maximum number of handles requested speculatively in one message. */
+#define SYNC_PREFETCH_MAX 16
+
 static bool g_sync_enabled = false;
+static bool g_sync_prefetch = true;
+
+static struct sync_stats g_stats = {0};
 
 static struct sync_handle* g_client_handles = NULL;
 static uint32_t g_client_counter = 1;
@@ -103,10 +109,12 @@ static void sync_downgrade(struct sync_handle* handle) {
         data_size = 0;
     }
     if (ipc_sync_client_send(IPC_MSG_SYNC_CONFIRM_DOWNGRADE, handle->id, handle->server_req_state,
-                             data_size, handle->data) < 0)
+                             handle->uses, data_size, handle->data) < 0)
         FATAL("sending CONFIRM_DOWNGRADE");
     handle->cur_state = handle->server_req_state;
     handle->server_req_state = SYNC_STATE_NONE;
+    handle->uses = 0;
+    __atomic_add_fetch(&g_stats.downgrades, 1, __ATOMIC_RELAXED);
 }
 
 static void update_handle_data(struct sync_handle* handle, size_t data_size, void* data) {
@@ -128,8 +136,8 @@ int init_sync_client(void) {
 
     assert(g_manifest_root);
     bool sync_enable = false;
-    int ret = toml_bool_in(g_manifest_root, "libos.sync.enable", /*defaultval=*/false,
-                           &sync_enable);
+    int ret = manifest_bool_in(g_manifest_root, "libos.sync.enable", /*defaultval=*/false,
+                               &sync_enable);
     if (ret < 0) {
         log_error("Cannot parse 'libos.sync.enable' (the value must be `true` or `false`)");
         return -EINVAL;
@@ -138,6 +146,13 @@ int init_sync_client(void) {
         log_debug("Enabling sync client");
         g_sync_enabled = true;
     }
+
+    ret = manifest_bool_in(g_manifest_root, "libos.sync.prefetch", /*defaultval=*/true,
+                           &g_sync_prefetch);
+    if (ret < 0) {
+        log_error("Cannot parse 'libos.sync.prefetch' (the value must be `true` or `false`)");
+        return -EINVAL;
+    }
     return 0;
 }
 
@@ -170,6 +185,10 @@ static int sync_init(struct sync_handle* handle, uint64_t id) {
     handle->cur_state = SYNC_STATE_INVALID;
     handle->client_req_state = SYNC_STATE_NONE;
     handle->server_req_state = SYNC_STATE_NONE;
+    handle->used_state = SYNC_STATE_INVALID;
+    handle->prefetched = false;
+    handle->prefetch_pending = false;
+    handle->uses = 0;
     handle->used = false;
 
     REF_SET(handle->ref_count, 1);
@@ -230,7 +249,7 @@ static int send_request_close(struct sync_handle* handle) {
     }
 
     return ipc_sync_client_send(IPC_MSG_SYNC_REQUEST_CLOSE, handle->id,
-                                handle->cur_state, data_size, handle->data);
+                                handle->cur_state, /*uses=*/0, data_size, handle->data);
 }
 
 void sync_destroy(struct sync_handle* handle) {
@@ -240,6 +259,10 @@ void sync_destroy(struct sync_handle* handle) {
     assert(!handle->used);
     assert(handle->n_waiters == 0);
 
+    /* a speculative request for the handle must reach the server before REQUEST_CLOSE */
+    while (handle->prefetch_pending)
+        sync_wait_without_lock(handle);
+
     if (g_sync_enabled && handle->phase == SYNC_PHASE_OPEN) {
         if (send_request_close(handle) < 0)
             FATAL("sending REQUEST_CLOSE");
@@ -248,6 +271,9 @@ void sync_destroy(struct sync_handle* handle) {
         do {
             sync_wait_without_lock(handle);
         } while (handle->phase != SYNC_PHASE_CLOSED);
+    } else {
+        /* Make sure the handle is not requested speculatively anymore. */
+        handle->phase = SYNC_PHASE_CLOSED;
     }
     unlock(&handle->prop_lock);
 
@@ -261,6 +287,104 @@ void sync_destroy(struct sync_handle* handle) {
     put_sync_handle(handle);
 }
 
+/* Adds speculative upgrade requests for handles that this process used before, but does not hold
+ * anymore, to `batch`. The handles are likely to be needed soon, and requesting them together with
+ * another handle saves round trips to the server.
+ *
+ * Expects `g_client_lock` to be held. The handles are returned in `prefetched` with a reference
+ * taken and `prefetch_pending` set, so that no REQUEST_CLOSE for them is sent before the batch; the
+ * caller has to call `finish_prefetch_requests` after sending it. */
+static size_t add_prefetch_requests(struct ipc_sync_batch* batch, struct sync_handle* except,
+                                    struct sync_handle** prefetched) {
+    assert(locked(&g_client_lock));
+    size_t count = 0;
+
+    struct sync_handle* handle;
+    struct sync_handle* tmp;
+    HASH_ITER(hh, g_client_handles, handle, tmp) {
+        if (handle == except)
+            continue;
+
+        lock(&handle->prop_lock);
+        if ((handle->phase == SYNC_PHASE_NEW || handle->phase == SYNC_PHASE_OPEN) && !handle->used
+                && !handle->prefetch_pending
+                && handle->client_req_state == SYNC_STATE_NONE
+                && handle->cur_state < handle->used_state
+                && ipc_sync_batch_add(batch, handle->id, handle->used_state,
+                                      SYNC_FLAG_SPECULATIVE, /*uses=*/0, /*data_size=*/0,
+                                      /*data=*/NULL) == 0) {
+            /* The server registers the handle even if it does not grant it. */
+            handle->phase = SYNC_PHASE_OPEN;
+            handle->prefetch_pending = true;
+            get_sync_handle(handle);
+            prefetched[count++] = handle;
+        }
+        unlock(&handle->prop_lock);
+
+        if (count == SYNC_PREFETCH_MAX)
+            break;
+    }
+
+    __atomic_add_fetch(&g_stats.prefetch_requests, count, __ATOMIC_RELAXED);
+    return count;
+}
+
+/* Called after the batch built by `add_prefetch_requests` was sent. */
+static void finish_prefetch_requests(struct sync_handle** prefetched, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        struct sync_handle* handle = prefetched[i];
+        lock(&handle->prop_lock);
+        handle->prefetch_pending = false;
+        sync_notify(handle);
+        unlock(&handle->prop_lock);
+        put_sync_handle(handle);
+    }
+}
+
+/* Sends REQUEST_UPGRADE for `handle` (if still needed), possibly with speculative requests for
+ * other handles. This function expects handle->prop_lock to be held, and temporarily releases
+ * it.
+ *
+ * The message is built under the locks, but sent without any of them: sending blocks if the
+ * connection to the server is full, and the IPC worker of this process needs `g_client_lock` and
+ * `prop_lock` to process the messages from the server. */
+static void request_upgrade(struct sync_handle* handle, int state) {
+    assert(locked(&handle->prop_lock));
+
+    struct ipc_sync_batch batch;
+    ipc_sync_batch_init(&batch, IPC_MSG_SYNC_REQUEST_UPGRADE);
+
+    struct sync_handle* prefetched[SYNC_PREFETCH_MAX];
+    size_t prefetched_count = 0;
+    if (g_sync_prefetch) {
+        /* Locks have to be taken in the `g_client_lock`, `prop_lock` order. */
+        unlock(&handle->prop_lock);
+        lock_client();
+        prefetched_count = add_prefetch_requests(&batch, handle, prefetched);
+        unlock_client();
+        lock(&handle->prop_lock);
+    }
+
+    /* The handle might have been granted speculatively in the meantime. */
+    if (handle->cur_state < state && handle->client_req_state < state) {
+        if (ipc_sync_batch_add(&batch, handle->id, state, /*flags=*/0, /*uses=*/0,
+                               /*data_size=*/0, /*data=*/NULL) < 0)
+            FATAL("Cannot allocate REQUEST_UPGRADE");
+        handle->client_req_state = state;
+        handle->phase = SYNC_PHASE_OPEN;
+        __atomic_add_fetch(&g_stats.upgrade_requests, 1, __ATOMIC_RELAXED);
+    }
+    unlock(&handle->prop_lock);
+
+    /* `handle` is in use by this thread, so no other message about it can be sent meanwhile */
+    if (ipc_sync_client_send_batch(&batch) < 0)
+        FATAL("sending REQUEST_UPGRADE");
+    ipc_sync_batch_destroy(&batch);
+
+    finish_prefetch_requests(prefetched, prefetched_count);
+    lock(&handle->prop_lock);
+}
+
 bool sync_lock(struct sync_handle* handle, int state, void* data, size_t data_size) {
     assert(state == SYNC_STATE_SHARED || state == SYNC_STATE_EXCLUSIVE);
 
@@ -268,34 +392,44 @@ bool sync_lock(struct sync_handle* handle, int state, void* data, size_t data_si
     if (!g_sync_enabled)
         return false;
 
+    __atomic_add_fetch(&g_stats.locks, 1, __ATOMIC_RELAXED);
+
     lock(&handle->prop_lock);
     assert(!handle->used);
     handle->used = true;
+    handle->uses++;
+    if (handle->used_state < state)
+        handle->used_state = state;
 
-    bool updated = false;
+    /* Set if the data were received with a speculative grant and not passed to the user yet. */
+    bool new_data = handle->prefetched;
+    handle->prefetched = false;
 
     if (handle->cur_state < state) {
-        do {
+        while (handle->cur_state < state) {
             if (handle->phase == SYNC_PHASE_CLOSING || handle->phase == SYNC_PHASE_CLOSED)
                 FATAL("sync_lock() on a closed handle");
 
             if (handle->client_req_state < state) {
-                if (ipc_sync_client_send(IPC_MSG_SYNC_REQUEST_UPGRADE, handle->id, state,
-                                         /*data_size=*/0, /*data=*/NULL) < 0)
-                    FATAL("sending REQUEST_UPGRADE");
-                handle->client_req_state = state;
-                handle->phase = SYNC_PHASE_OPEN;
+                request_upgrade(handle, state);
+                continue;
             }
             sync_wait_without_lock(handle);
-        } while (handle->cur_state < state);
+        }
+        /* The handle might have been granted speculatively while `prop_lock` was released. */
+        handle->prefetched = false;
+        new_data = true;
+    } else if (new_data) {
+        __atomic_add_fetch(&g_stats.prefetch_hits, 1, __ATOMIC_RELAXED);
+    }
 
-        if (data_size > 0 && handle->data_size > 0) {
-            if (data_size != handle->data_size)
-                FATAL("handle data size mismatch");
+    bool updated = false;
+    if (new_data && data_size > 0 && handle->data_size > 0) {
+        if (data_size != handle->data_size)
+            FATAL("handle data size mismatch");
 
-            memcpy(data, handle->data, data_size);
-            updated = true;
-        }
+        memcpy(data, handle->data, data_size);
+        updated = true;
     }
 
     unlock(&handle->prop_lock);
@@ -328,18 +462,28 @@ int shutdown_sync_client(void) {
     /* Send REQUEST_CLOSE for all open handles. At this point, no threads using the sync engine
      * should be running (except for the IPC helper), so no handles will be created or upgraded. */
     log_debug("sync client shutdown: closing handles");
+    struct ipc_sync_batch batch;
+    ipc_sync_batch_init(&batch, IPC_MSG_SYNC_REQUEST_CLOSE);
     struct sync_handle* handle;
     struct sync_handle* tmp;
     HASH_ITER(hh, g_client_handles, handle, tmp) {
         lock(&handle->prop_lock);
+        while (handle->prefetch_pending)
+            sync_wait_without_lock(handle);
         if (g_sync_enabled && handle->phase == SYNC_PHASE_OPEN) {
-            if (send_request_close(handle) < 0)
-                FATAL("sending REQUEST_CLOSE");
+            size_t data_size = handle->cur_state == SYNC_STATE_EXCLUSIVE ? handle->data_size : 0;
+            if (ipc_sync_batch_add(&batch, handle->id, handle->cur_state, /*flags=*/0,
+                                   /*uses=*/0, data_size, handle->data) < 0)
+                FATAL("Cannot allocate REQUEST_CLOSE");
             handle->phase = SYNC_PHASE_CLOSING;
             handle->cur_state = SYNC_STATE_INVALID;
         }
         unlock(&handle->prop_lock);
     }
+    /* All handles are closed with a single message. */
+    if (ipc_sync_client_send_batch(&batch) < 0)
+        FATAL("sending REQUEST_CLOSE");
+    ipc_sync_batch_destroy(&batch);
 
     /* Wait for server to confirm the handles are closed. */
     log_debug("sync client shutdown: waiting for confirmation");
@@ -396,8 +540,13 @@ static void do_confirm_upgrade(uint64_t id, int state, size_t data_size, void* d
 
     lock(&handle->prop_lock);
     if (handle->phase == SYNC_PHASE_OPEN && handle->cur_state < state) {
+        /* Not requested (or not anymore): granted speculatively. */
+        if (handle->client_req_state == SYNC_STATE_NONE)
+            handle->prefetched = true;
+
         handle->cur_state = state;
-        handle->client_req_state = SYNC_STATE_NONE;
+        if (handle->client_req_state <= state)
+            handle->client_req_state = SYNC_STATE_NONE;
         sync_notify(handle);
     }
 
@@ -439,6 +588,14 @@ void sync_client_message_callback(int code, uint64_t id, int state, size_t data_
     }
 }
 
+void sync_client_get_stats(struct sync_stats* stats) {
+    stats->locks = __atomic_load_n(&g_stats.locks, __ATOMIC_RELAXED);
+    stats->upgrade_requests = __atomic_load_n(&g_stats.upgrade_requests, __ATOMIC_RELAXED);
+    stats->prefetch_requests = __atomic_load_n(&g_stats.prefetch_requests, __ATOMIC_RELAXED);
+    stats->prefetch_hits = __atomic_load_n(&g_stats.prefetch_hits, __ATOMIC_RELAXED);
+    stats->downgrades = __atomic_load_n(&g_stats.downgrades, __ATOMIC_RELAXED);
+}
+
 BEGIN_CP_FUNC(sync_handle) {
     assert(size == sizeof(struct sync_handle));
 
@@ -449,9 +606,11 @@ BEGIN_CP_FUNC(sync_handle) {
     size_t off = ADD_CP_OFFSET(size);
     struct sync_handle* new_handle = (struct sync_handle*)(base + off);
 
-    /* We need to only transfer handle ID; the rest will be re-initialized on the remote side. */
+    /* We need to only transfer handle ID (and the state the handle was used in, so that the child
+     * can prefetch it); the rest will be re-initialized on the remote side. */
     memset(new_handle, 0, sizeof(*new_handle));
     new_handle->id = handle->id;
+    new_handle->used_state = __atomic_load_n(&handle->used_state, __ATOMIC_RELAXED);
     ADD_CP_FUNC_ENTRY(off);
 
     if (objp)
@@ -464,8 +623,10 @@ BEGIN_RS_FUNC(sync_handle) {
     __UNUSED(offset);
     __UNUSED(rebase);
 
+    int used_state = handle->used_state;
     int ret = sync_init(handle, handle->id);
     if (ret < 0)
         return ret;
+    handle->used_state = used_state;
 }
 END_RS_FUNC(sync_handle)
@@ -10,12 +10,14 @@
  * (IPC helper). With high volume of requests, this might be a performance bottleneck.
  */
 
+#include "manifest.h"
 #include "pal.h"
 #include "shim_ipc.h"
 #include "shim_internal.h"
 #include "shim_lock.h"
 #include "shim_sync.h"
 #include "shim_thread.h"
+#include "shim_utils.h"
 
 #define FATAL(fmt...)                                   \
     do {                                                \
@@ -23,8 +25,16 @@
         DkProcessExit(1);                               \
     } while(0)
 
+/* The client with at least 3/4 of the recent uses of a handle (and at least this many of them)
+ * gets longer leases. */
+#define SYNC_AFFINITY_MIN_USES 16
+/* Uses of a handle are halved when there are more of them, so that recent ones count more. */
+#define SYNC_AFFINITY_MAX_USES 1024
+
 DEFINE_LIST(server_lease);
 DEFINE_LISTP(server_lease);
+DEFINE_LIST(server_handle);
+DEFINE_LISTP(server_handle);
 
 /* Handle (stored in a per-id hash table) */
 struct server_handle {
@@ -34,6 +44,14 @@ struct server_handle {
 
     LISTP_TYPE(server_lease) leases;
 
+    /* Sum of `uses` of the leases */
+    uint64_t uses;
+
+    /* When the first lease blocking a downgrade expires (0 if no downgrade is deferred), and the
+     * entry in `g_deferred_handles` */
+    uint64_t deadline;
+    LIST_TYPE(server_handle) list_deferred;
+
     UT_hash_handle hh;
 };
 
@@ -56,6 +74,11 @@ struct server_lease {
     /* Requested by server; always lower than cur_state, or NONE */
     int server_req_state;
 
+    /* Until when the client keeps the handle even if others need it (0 if there is no lease) */
+    uint64_t lease_end;
+    /* How many times the client used the handle (as reported by it, with older uses decaying) */
+    uint64_t uses;
+
     LIST_TYPE(server_lease) list_client;
     LIST_TYPE(server_lease) list_handle;
 };
@@ -64,12 +87,48 @@ static struct server_handle* g_server_handles = NULL;
 static struct server_client* g_server_clients = NULL;
 static struct shim_lock g_server_lock;
 
+/* Handles with downgrades deferred until a lease expires. Modified only by the IPC worker. */
+static LISTP_TYPE(server_handle) g_deferred_handles = LISTP_INIT;
+
+/* Messages to clients, collected while handling a batch of requests and sent together by
+ * `sync_server_flush_messages`. */
+struct pending_batch {
+    IDTYPE dest;
+    struct ipc_sync_batch batch;
+};
+static struct pending_batch* g_pending = NULL;
+static size_t g_pending_count = 0;
+static size_t g_pending_capacity = 0;
+
+static uint64_t g_lease_time_us = 0;
+
+static struct sync_stats g_stats = {0};
+
 int init_sync_server(void) {
     if (!create_lock(&g_server_lock))
         return -ENOMEM;
+
+    assert(g_manifest_root);
+    int64_t lease_time_us;
+    int ret = manifest_int_in(g_manifest_root, "libos.sync.lease_time_us", /*defaultval=*/0,
+                              &lease_time_us);
+    if (ret < 0 || lease_time_us < 0) {
+        log_error("Cannot parse 'libos.sync.lease_time_us' (the value must be a non-negative "
+                  "number of microseconds)");
+        return -EINVAL;
+    }
+    g_lease_time_us = lease_time_us;
     return 0;
 }
 
+static uint64_t get_time_us(void) {
+    uint64_t time_us;
+    int ret = DkSystemTimeQuery(&time_us);
+    if (ret < 0)
+        FATAL("Cannot query system time: %ld\n", pal_to_unix_errno(ret));
+    return time_us;
+}
+
 static struct server_handle* find_handle(uint64_t id, bool create) {
     assert(locked(&g_server_lock));
 
@@ -88,6 +147,9 @@ static struct server_handle* find_handle(uint64_t id, bool create) {
     handle->data_size = 0;
     handle->data = NULL;
     INIT_LISTP(&handle->leases);
+    handle->uses = 0;
+    handle->deadline = 0;
+    INIT_LIST_HEAD(handle, list_deferred);
     HASH_ADD(hh, g_server_handles, id, sizeof(id), handle);
 
     return handle;
@@ -139,6 +201,8 @@ static struct server_lease* find_lease(struct server_handle* handle, IDTYPE vmid
     lease->cur_state = SYNC_STATE_INVALID;
     lease->client_req_state = SYNC_STATE_NONE;
     lease->server_req_state = SYNC_STATE_NONE;
+    lease->lease_end = 0;
+    lease->uses = 0;
 
     LISTP_ADD_TAIL(lease, &handle->leases, list_handle);
     LISTP_ADD_TAIL(lease, &client->leases, list_client);
@@ -146,25 +210,135 @@ static struct server_lease* find_lease(struct server_handle* handle, IDTYPE vmid
     return lease;
 }
 
+/* Queues a message for `vmid`. Messages are appended to the last batch for the client if it has
+ * the same code, and to a new batch otherwise, so that the client receives them in order. */
+static int queue_message(IDTYPE vmid, int code, uint64_t id, int state, size_t data_size,
+                         void* data) {
+    assert(locked(&g_server_lock));
+
+    struct ipc_sync_batch* batch = NULL;
+    for (size_t i = g_pending_count; i > 0; i--) {
+        if (g_pending[i - 1].dest == vmid) {
+            if (g_pending[i - 1].batch.code == code)
+                batch = &g_pending[i - 1].batch;
+            break;
+        }
+    }
+
+    if (!batch) {
+        if (g_pending_count == g_pending_capacity) {
+            size_t capacity = MAX(g_pending_capacity * 2, (size_t)8);
+            struct pending_batch* pending = malloc(capacity * sizeof(*pending));
+            if (!pending)
+                return -ENOMEM;
+            if (g_pending) {
+                memcpy(pending, g_pending, g_pending_count * sizeof(*pending));
+                free(g_pending);
+            }
+            g_pending = pending;
+            g_pending_capacity = capacity;
+        }
+        g_pending[g_pending_count].dest = vmid;
+        batch = &g_pending[g_pending_count].batch;
+        ipc_sync_batch_init(batch, code);
+        g_pending_count++;
+    }
+
+    return ipc_sync_batch_add(batch, id, state, /*flags=*/0, /*uses=*/0, data_size, data);
+}
+
+void sync_server_flush_messages(void) {
+    lock(&g_server_lock);
+    for (size_t i = 0; i < g_pending_count; i++) {
+        int ret = ipc_sync_server_send_batch(g_pending[i].dest, &g_pending[i].batch);
+        if (ret < 0)
+            FATAL("Error messaging clients: %d\n", ret);
+        ipc_sync_batch_destroy(&g_pending[i].batch);
+    }
+    g_pending_count = 0;
+    unlock(&g_server_lock);
+}
+
 static int send_confirm_upgrade(struct server_handle* handle, IDTYPE vmid, int state) {
     assert(locked(&g_server_lock));
 
-    return ipc_sync_server_send(vmid, IPC_MSG_SYNC_CONFIRM_UPGRADE, handle->id, state,
-                                handle->data_size, handle->data);
+    return queue_message(vmid, IPC_MSG_SYNC_CONFIRM_UPGRADE, handle->id, state, handle->data_size,
+                         handle->data);
 }
 
 static int send_request_downgrade(struct server_handle* handle, IDTYPE vmid, int state) {
     assert(locked(&g_server_lock));
 
-    return ipc_sync_server_send(vmid, IPC_MSG_SYNC_REQUEST_DOWNGRADE, handle->id, state,
-                                /*data_size=*/0, /*data=*/NULL);
+    return queue_message(vmid, IPC_MSG_SYNC_REQUEST_DOWNGRADE, handle->id, state,
+                         /*data_size=*/0, /*data=*/NULL);
 }
 
 static int send_confirm_close(struct server_handle* handle, IDTYPE vmid) {
     assert(locked(&g_server_lock));
 
-    return ipc_sync_server_send(vmid, IPC_MSG_SYNC_CONFIRM_CLOSE, handle->id, SYNC_STATE_INVALID,
-                                /*data_size=*/0, /*data=*/NULL);
+    return queue_message(vmid, IPC_MSG_SYNC_CONFIRM_CLOSE, handle->id, SYNC_STATE_INVALID,
+                         /*data_size=*/0, /*data=*/NULL);
+}
+
+static void add_uses(struct server_handle* handle, struct server_lease* lease, uint64_t uses) {
+    assert(locked(&g_server_lock));
+
+    lease->uses += uses;
+    handle->uses += uses;
+    if (handle->uses > SYNC_AFFINITY_MAX_USES) {
+        handle->uses = 0;
+        struct server_lease* other;
+        LISTP_FOR_EACH_ENTRY(other, &handle->leases, list_handle) {
+            other->uses /= 2;
+            handle->uses += other->uses;
+        }
+    }
+}
+
+/* Grants `state` to a client, starting its lease. */
+static int grant_lease(struct server_handle* handle, struct server_lease* lease, int state,
+                       uint64_t now) {
+    assert(locked(&g_server_lock));
+
+    int ret = send_confirm_upgrade(handle, lease->client->vmid, state);
+    if (ret < 0)
+        return ret;
+
+    lease->cur_state = state;
+    lease->client_req_state = SYNC_STATE_NONE;
+    lease->lease_end = 0;
+    if (g_lease_time_us) {
+        uint64_t lease_time_us = g_lease_time_us;
+        if (handle->uses >= SYNC_AFFINITY_MIN_USES && lease->uses * 4 >= handle->uses * 3) {
+            /* The client uses the handle most: let it keep the handle longer. */
+            lease_time_us *= SYNC_AFFINITY_FACTOR;
+            __atomic_add_fetch(&g_stats.extended_leases, 1, __ATOMIC_RELAXED);
+        }
+        lease->lease_end = now + lease_time_us;
+    }
+    return 0;
+}
+
+/* Returns true if the client keeps the handle until the end of its lease; updates `*deadline` to
+ * the earliest such lease end. */
+static bool lease_held(struct server_lease* lease, uint64_t now, uint64_t* deadline) {
+    if (lease->lease_end <= now)
+        return false;
+    if (!*deadline || lease->lease_end < *deadline)
+        *deadline = lease->lease_end;
+    return true;
+}
+
+static void set_deadline(struct server_handle* handle, uint64_t deadline) {
+    assert(locked(&g_server_lock));
+
+    if (deadline && !handle->deadline) {
+        LISTP_ADD_TAIL(handle, &g_deferred_handles, list_deferred);
+        __atomic_add_fetch(&g_stats.deferred_downgrades, 1, __ATOMIC_RELAXED);
+    } else if (!deadline && handle->deadline) {
+        LISTP_DEL_INIT(handle, &g_deferred_handles, list_deferred);
+    }
+    handle->deadline = deadline;
 }
 
 /* Process handle information after state change */
@@ -176,6 +350,8 @@ static int process_handle(struct server_handle* handle) {
     struct server_lease* lease;
     int ret;
 
+    uint64_t now = g_lease_time_us ? get_time_us() : 0;
+
     LISTP_FOR_EACH_ENTRY(lease, &handle->leases, list_handle) {
         if (lease->cur_state == SYNC_STATE_SHARED)
             n_shared++;
@@ -193,45 +369,41 @@ static int process_handle(struct server_handle* handle) {
         if (lease->client_req_state == SYNC_STATE_SHARED && n_exclusive == 0) {
             /* Upgrade from INVALID to SHARED */
             assert(lease->cur_state == SYNC_STATE_INVALID);
-            if ((ret = send_confirm_upgrade(handle, lease->client->vmid, SYNC_STATE_SHARED)) < 0)
+            if ((ret = grant_lease(handle, lease, SYNC_STATE_SHARED, now)) < 0)
                 return ret;
 
-            lease->cur_state = SYNC_STATE_SHARED;
-            lease->client_req_state = SYNC_STATE_NONE;
             want_shared--;
             n_shared++;
         } else if (lease->client_req_state == SYNC_STATE_EXCLUSIVE && n_exclusive == 0
                    && n_shared == 0) {
             /* Upgrade from INVALID to EXCLUSIVE */
             assert(lease->cur_state == SYNC_STATE_INVALID);
-            if ((ret = send_confirm_upgrade(handle, lease->client->vmid, SYNC_STATE_EXCLUSIVE)) < 0)
+            if ((ret = grant_lease(handle, lease, SYNC_STATE_EXCLUSIVE, now)) < 0)
                 return ret;
 
-            lease->cur_state = SYNC_STATE_EXCLUSIVE;
-            lease->client_req_state = SYNC_STATE_NONE;
             want_exclusive--;
             n_exclusive++;
         } else if (lease->client_req_state == SYNC_STATE_EXCLUSIVE && n_exclusive == 0
                    && n_shared == 1 && lease->cur_state == SYNC_STATE_SHARED) {
             /* Upgrade from SHARED to EXCLUSIVE */
-            if ((ret = send_confirm_upgrade(handle, lease->client->vmid, SYNC_STATE_EXCLUSIVE)) < 0)
+            if ((ret = grant_lease(handle, lease, SYNC_STATE_EXCLUSIVE, now)) < 0)
                 return ret;
 
-            lease->cur_state = SYNC_STATE_EXCLUSIVE;
-            lease->client_req_state = SYNC_STATE_NONE;
             want_exclusive--;
             n_exclusive++;
             n_shared--;
         }
     }
 
-    /* Issue downgrade requests, if necessary */
+    /* Issue downgrade requests, if necessary (and if the leases allow it) */
 
+    uint64_t deadline = 0;
     if (want_exclusive) {
         /* Some clients wait for EXCLUSIVE, try to downgrade SHARED/EXCLUSIVE to INVALID */
         LISTP_FOR_EACH_ENTRY(lease, &handle->leases, list_handle) {
             if ((lease->cur_state == SYNC_STATE_SHARED || lease->cur_state == SYNC_STATE_EXCLUSIVE)
-                    && lease->server_req_state != SYNC_STATE_INVALID) {
+                    && lease->server_req_state != SYNC_STATE_INVALID
+                    && !lease_held(lease, now, &deadline)) {
                 if ((ret = send_request_downgrade(handle, lease->client->vmid,
                                                   SYNC_STATE_INVALID)) < 0)
                     return ret;
@@ -243,7 +415,8 @@ static int process_handle(struct server_handle* handle) {
         LISTP_FOR_EACH_ENTRY(lease, &handle->leases, list_handle) {
             if (lease->cur_state == SYNC_STATE_EXCLUSIVE
                     && lease->server_req_state != SYNC_STATE_SHARED
-                    && lease->server_req_state != SYNC_STATE_INVALID) {
+                    && lease->server_req_state != SYNC_STATE_INVALID
+                    && !lease_held(lease, now, &deadline)) {
                 if ((ret = send_request_downgrade(handle, lease->client->vmid,
                                                   SYNC_STATE_SHARED)) < 0)
                     return ret;
@@ -251,11 +424,30 @@ static int process_handle(struct server_handle* handle) {
             }
         }
     }
+    set_deadline(handle, deadline);
 
     return 0;
 }
 
-static void do_request_upgrade(IDTYPE vmid, uint64_t id, int state) {
+/* Returns true if `state` can be granted to `lease` without downgrading (or delaying) anyone. */
+static bool can_grant_now(struct server_handle* handle, struct server_lease* lease, int state) {
+    assert(locked(&g_server_lock));
+
+    struct server_lease* other;
+    LISTP_FOR_EACH_ENTRY(other, &handle->leases, list_handle) {
+        if (other == lease)
+            continue;
+        if (other->client_req_state != SYNC_STATE_NONE)
+            return false;
+        if (other->cur_state == SYNC_STATE_EXCLUSIVE)
+            return false;
+        if (state == SYNC_STATE_EXCLUSIVE && other->cur_state == SYNC_STATE_SHARED)
+            return false;
+    }
+    return true;
+}
+
+static void do_request_upgrade(IDTYPE vmid, uint64_t id, int state, uint32_t flags) {
     assert(state == SYNC_STATE_SHARED || state == SYNC_STATE_EXCLUSIVE);
 
     lock(&g_server_lock);
@@ -268,19 +460,28 @@ static void do_request_upgrade(IDTYPE vmid, uint64_t id, int state) {
     if ((!(lease = find_lease(handle, vmid, /*create=*/true))))
         FATAL("Cannot create a new handle client\n");
 
-    assert(lease->cur_state < state);
-    lease->client_req_state = state;
+    int ret;
+    if (lease->cur_state >= state) {
+        /* Already granted speculatively, the client will get the confirmation. */
+    } else if (flags & SYNC_FLAG_SPECULATIVE) {
+        if (lease->client_req_state == SYNC_STATE_NONE && can_grant_now(handle, lease, state)) {
+            uint64_t now = g_lease_time_us ? get_time_us() : 0;
+            if ((ret = grant_lease(handle, lease, state, now)) < 0)
+                FATAL("Error messaging clients: %d\n", ret);
+        }
+    } else {
+        lease->client_req_state = state;
 
-    /* Move the client to the end of the list, so that new requests are handled in FIFO
-     * order. */
-    if (LISTP_NEXT_ENTRY(lease, &handle->leases, list_handle) != NULL) {
-        LISTP_DEL(lease, &handle->leases, list_handle);
-        LISTP_ADD_TAIL(lease, &handle->leases, list_handle);
-    }
+        /* Move the client to the end of the list, so that new requests are handled in FIFO
+         * order. */
+        if (LISTP_NEXT_ENTRY(lease, &handle->leases, list_handle) != NULL) {
+            LISTP_DEL(lease, &handle->leases, list_handle);
+            LISTP_ADD_TAIL(lease, &handle->leases, list_handle);
+        }
 
-    int ret;
-    if ((ret = process_handle(handle)) < 0)
-        FATAL("Error messaging clients: %d\n", ret);
+        if ((ret = process_handle(handle)) < 0)
+            FATAL("Error messaging clients: %d\n", ret);
+    }
 
     unlock(&g_server_lock);
 }
@@ -301,8 +502,8 @@ static void update_handle_data(struct server_handle* handle, size_t data_size, v
         memcpy(handle->data, data, data_size);
 }
 
-static void do_confirm_downgrade(IDTYPE vmid, uint64_t id, int state, size_t data_size,
-                                 void* data) {
+static void do_confirm_downgrade(IDTYPE vmid, uint64_t id, int state, uint64_t uses,
+                                 size_t data_size, void* data) {
     assert(state == SYNC_STATE_INVALID || state == SYNC_STATE_SHARED);
 
     lock(&g_server_lock);
@@ -326,6 +527,7 @@ static void do_confirm_downgrade(IDTYPE vmid, uint64_t id, int state, size_t dat
     lease->cur_state = state;
     if (state <= lease->server_req_state)
         lease->server_req_state = SYNC_STATE_NONE;
+    add_uses(handle, lease, uses);
 
     int ret;
     if ((ret = process_handle(handle)) < 0)
@@ -361,6 +563,7 @@ static void do_request_close(IDTYPE vmid, uint64_t id, int cur_state, size_t dat
 
     LISTP_DEL(lease, &client->leases, list_client);
     LISTP_DEL(lease, &handle->leases, list_handle);
+    handle->uses -= lease->uses;
     free(lease);
 
     if (LISTP_EMPTY(&client->leases)) {
@@ -371,6 +574,7 @@ static void do_request_close(IDTYPE vmid, uint64_t id, int cur_state, size_t dat
 
     if (LISTP_EMPTY(&handle->leases)) {
         log_trace("sync server: deleting unused handle: 0x%lx", handle->id);
+        set_deadline(handle, 0);
         HASH_DELETE(hh, g_server_handles, handle);
         free(handle->data);
         free(handle);
@@ -384,15 +588,15 @@ static void do_request_close(IDTYPE vmid, uint64_t id, int cur_state, size_t dat
 }
 
 
-void sync_server_message_callback(IDTYPE src, int code, uint64_t id, int state,
-                                  size_t data_size, void* data) {
+void sync_server_message_callback(IDTYPE src, int code, uint64_t id, int state, uint32_t flags,
+                                  uint64_t uses, size_t data_size, void* data) {
     switch (code) {
         case IPC_MSG_SYNC_REQUEST_UPGRADE:
             assert(data_size == 0);
-            do_request_upgrade(src, id, state);
+            do_request_upgrade(src, id, state, flags);
             break;
         case IPC_MSG_SYNC_CONFIRM_DOWNGRADE:
-            do_confirm_downgrade(src, id, state, data_size, data);
+            do_confirm_downgrade(src, id, state, uses, data_size, data);
             break;
         case IPC_MSG_SYNC_REQUEST_CLOSE:
             do_request_close(src, id, state, data_size, data);
@@ -420,3 +624,41 @@ void sync_server_disconnect_callback(IDTYPE src) {
 
     unlock(&g_server_lock);
 }
+
+PAL_NUM sync_server_process_leases(void) {
+    /* Only the IPC worker modifies the list, so it can be checked without the lock (which might not
+     * be created yet). */
+    if (LISTP_EMPTY(&g_deferred_handles))
+        return NO_TIMEOUT;
+
+    lock(&g_server_lock);
+
+    uint64_t now = get_time_us();
+    struct server_handle* handle;
+    struct server_handle* tmp;
+    LISTP_FOR_EACH_ENTRY_SAFE(handle, tmp, &g_deferred_handles, list_deferred) {
+        if (handle->deadline <= now) {
+            /* Sends the downgrade requests, or sets a new deadline. */
+            int ret = process_handle(handle);
+            if (ret < 0)
+                FATAL("Error messaging clients: %d\n", ret);
+        }
+    }
+
+    PAL_NUM timeout = NO_TIMEOUT;
+    LISTP_FOR_EACH_ENTRY(handle, &g_deferred_handles, list_deferred) {
+        uint64_t wait_us = handle->deadline > now ? handle->deadline - now : 0;
+        if (timeout == NO_TIMEOUT || wait_us < timeout)
+            timeout = wait_us;
+    }
+
+    unlock(&g_server_lock);
+
+    sync_server_flush_messages();
+    return timeout;
+}
+
+void sync_server_get_stats(struct sync_stats* stats) {
+    stats->deferred_downgrades = __atomic_load_n(&g_stats.deferred_downgrades, __ATOMIC_RELAXED);
+    stats->extended_leases = __atomic_load_n(&g_stats.extended_leases, __ATOMIC_RELAXED);
+}
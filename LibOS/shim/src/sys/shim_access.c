@@ -35,17 +35,16 @@ long shim_do_faccessat(int dfd, const char* filename, mode_t mode) {
     if (*filename != '/' && (ret = get_dirfd_dentry(dfd, &dir)) < 0)
         return ret;
 
-    lock(&g_dcache_lock);
-
-    ret = _path_lookupat(dir, filename, LOOKUP_FOLLOW, &dent);
+    ret = path_lookupat(dir, filename, LOOKUP_FOLLOW, &dent);
     if (ret < 0)
         goto out;
 
+    /* the dentry could have become negative since the lookup, so check it under the lock */
+    lock(&g_dcache_lock);
     ret = check_permissions(dent, mode);
-
-out:
     unlock(&g_dcache_lock);
 
+out:
     if (dir)
         put_dentry(dir);
     if (dent) {
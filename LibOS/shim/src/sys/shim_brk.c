@@ -9,6 +9,7 @@
 
 #include <sys/mman.h>
 
+#include "manifest.h"
 #include "pal.h"
 #include "shim_checkpoint.h"
 #include "shim_internal.h"
@@ -16,7 +17,6 @@
 #include "shim_table.h"
 #include "shim_utils.h"
 #include "shim_vma.h"
-#include "toml.h"
 
 static struct {
     size_t data_segment_size;
@@ -45,8 +45,8 @@ int init_brk_region(void* brk_start, size_t data_segment_size) {
 
     assert(g_manifest_root);
     size_t brk_max_size;
-    ret = toml_sizestring_in(g_manifest_root, "sys.brk.max_size", DEFAULT_BRK_MAX_SIZE,
-                             &brk_max_size);
+    ret = manifest_sizestring_in(g_manifest_root, "sys.brk.max_size", DEFAULT_BRK_MAX_SIZE,
+                                 &brk_max_size);
     if (ret < 0) {
         log_error("Cannot parse \'sys.brk.max_size\' (the value must be put in double quotes!)");
         return -EINVAL;
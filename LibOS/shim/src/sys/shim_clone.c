@@ -14,6 +14,7 @@
 #include "shim_checkpoint.h"
 #include "shim_context.h"
 #include "shim_fs.h"
+#include "shim_fs_page_cache.h"
 #include "shim_internal.h"
 #include "shim_ipc.h"
 #include "shim_lock.h"
@@ -193,6 +194,10 @@ static long do_clone_new_vm(unsigned long flags, struct shim_thread* thread, uns
     child_process->child_termination_signal = flags & CSIGNAL;
     child_process->uid = thread->uid;
     long ret = ipc_get_new_vmid(&child_process->vmid);
+    if (!ret) {
+        /* the child reads the files from the host */
+        ret = page_cache_flush_all();
+    }
     if (!ret) {
         ret = create_process_and_send_checkpoint(&migrate_fork, child_process, &process_description,
                                                  thread);
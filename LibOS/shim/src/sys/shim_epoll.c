@@ -3,6 +3,16 @@
 
 /*
  * Implementation of system calls "epoll_create", "epoll_create1", "epoll_ctl" and "epoll_wait".
+ *
+ * Registered FDs are indexed by a hash table, so `epoll_ctl` does not depend on the number of FDs.
+ * Items with events that were detected but not yet reported are kept on a ready list, which
+ * `epoll_wait` reports from; items not reported because of `maxevents` stay at its head and are
+ * reported first by the next call.
+ *
+ * The items are mirrored in a PAL wait set (backed by a host epoll instance), so the host does not
+ * see the whole set on every wait and returns only the ready handles. Items whose registration may
+ * have changed (e.g. their handle got a new PAL handle, or `EPOLLET` events were reported) are
+ * marked dirty and updated by the next `epoll_wait`.
  */
 
 #include <errno.h>
@@ -29,11 +39,32 @@
 #define EPOLLRDHUP  0x2000
 #endif
 
-/* TODO: 1024 handles/FDs is a small number for high-load servers (e.g., Linux has ~3M) */
-#define MAX_EPOLL_HANDLES 1024
+/* initial number of buckets of the FD index, grown to keep at most one item per bucket on average */
+#define EPOLL_MIN_FD_BUCKETS 64
+
+/* maximum number of ready PAL handles fetched by one wait */
+#define EPOLL_WAIT_BATCH 64
+
+/* `data` of the PAL handle of the epoll's update event in the wait set (items use their address) */
+#define EPOLL_EVENT_DATA 0
 
 struct shim_fs epoll_builtin_fs;
 
+static int create_wait_set(struct shim_epoll_handle* epoll) {
+    int ret = DkWaitSetCreate(&epoll->wait_set);
+    if (ret < 0)
+        return pal_to_unix_errno(ret);
+
+    ret = DkWaitSetCtl(epoll->wait_set, PAL_WAIT_SET_ADD, EPOLL_EVENT_DATA,
+                       event_handle(&epoll->event), PAL_WAIT_READ);
+    if (ret < 0) {
+        DkObjectClose(epoll->wait_set);
+        epoll->wait_set = NULL;
+        return pal_to_unix_errno(ret);
+    }
+    return 0;
+}
+
 long shim_do_epoll_create1(int flags) {
     if ((flags & ~EPOLL_CLOEXEC))
         return -EINVAL;
@@ -47,8 +78,14 @@ long shim_do_epoll_create1(int flags) {
 
     struct shim_epoll_handle* epoll = &hdl->info.epoll;
     epoll->fds_count = 0;
+    epoll->gen = 0;
     __atomic_store_n(&epoll->waiter_cnt, 0, __ATOMIC_RELAXED);
     INIT_LISTP(&epoll->fds);
+    INIT_LISTP(&epoll->ready);
+    epoll->fd_buckets = NULL;
+    epoll->fd_buckets_cnt = 0;
+    epoll->wait_set = NULL;
+    epoll->dirty = false;
 
     int ret = create_event(&epoll->event);
     if (ret < 0) {
@@ -56,6 +93,12 @@ long shim_do_epoll_create1(int flags) {
         return ret;
     }
 
+    ret = create_wait_set(epoll);
+    if (ret < 0) {
+        put_handle(hdl);
+        return ret;
+    }
+
     int vfd = set_new_fd_handle(hdl, (flags & EPOLL_CLOEXEC) ? FD_CLOEXEC : 0, NULL);
     put_handle(hdl);
     return vfd;
@@ -82,15 +125,278 @@ static void notify_epoll_waiters(struct shim_epoll_handle* epoll) {
     }
 }
 
+static struct shim_epoll_item** fd_bucket(struct shim_epoll_handle* epoll, FDTYPE fd) {
+    return &epoll->fd_buckets[fd & (epoll->fd_buckets_cnt - 1)];
+}
+
+static struct shim_epoll_item* find_epoll_item(struct shim_epoll_handle* epoll, FDTYPE fd) {
+    if (!epoll->fd_buckets)
+        return NULL;
+
+    struct shim_epoll_item* epoll_item = *fd_bucket(epoll, fd);
+    while (epoll_item && epoll_item->fd != fd)
+        epoll_item = epoll_item->hash_next;
+    return epoll_item;
+}
+
+/* Grows the FD index (if needed) to fit `fds_count` items; all items on the `fds` list are
+ * re-indexed. */
+static int reserve_fd_index(struct shim_epoll_handle* epoll, size_t fds_count) {
+    if (epoll->fd_buckets && fds_count <= epoll->fd_buckets_cnt)
+        return 0;
+
+    size_t buckets_cnt = MAX(epoll->fd_buckets_cnt, (size_t)EPOLL_MIN_FD_BUCKETS);
+    while (buckets_cnt < fds_count)
+        buckets_cnt *= 2;
+
+    struct shim_epoll_item** buckets = calloc(buckets_cnt, sizeof(*buckets));
+    if (!buckets)
+        return -ENOMEM;
+
+    free(epoll->fd_buckets);
+    epoll->fd_buckets = buckets;
+    epoll->fd_buckets_cnt = buckets_cnt;
+
+    struct shim_epoll_item* epoll_item;
+    LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
+        struct shim_epoll_item** bucket = fd_bucket(epoll, epoll_item->fd);
+        epoll_item->hash_next = *bucket;
+        *bucket = epoll_item;
+    }
+    return 0;
+}
+
+static void mark_epoll_item_dirty(struct shim_epoll_item* epoll_item) {
+    __atomic_store_n(&epoll_item->dirty, true, __ATOMIC_RELEASE);
+    __atomic_store_n(&epoll_item->epoll->info.epoll.dirty, true, __ATOMIC_RELEASE);
+}
+
+/* Marks all epoll items of `handle` dirty. */
+static void mark_handle_epolls_dirty(struct shim_handle* handle) {
+    assert(locked(&handle->lock));
+
+    struct shim_epoll_item* epoll_item;
+    LISTP_FOR_EACH_ENTRY(epoll_item, &handle->epolls, back) {
+        mark_epoll_item_dirty(epoll_item);
+    }
+}
+
+static void unregister_epoll_item(struct shim_epoll_item* epoll_item) {
+    if (!epoll_item->pal_handle)
+        return;
+
+    /* can fail only if the item is not in the wait set, nothing to do then */
+    (void)DkWaitSetCtl(epoll_item->epoll->info.epoll.wait_set, PAL_WAIT_SET_DEL,
+                       (uintptr_t)epoll_item, NULL, 0);
+    if (epoll_item->poll_event) {
+        struct shim_handle* hdl = epoll_item->handle;
+        hdl->fs->fs_ops->poll_put(hdl, epoll_item->pal_events);
+    }
+    epoll_item->pal_handle = NULL;
+    epoll_item->pal_events = 0;
+    epoll_item->poll_event = false;
+}
+
+/* Adds an item to the `fds` list and to the FD index (which must have room for it). */
+static void add_epoll_item(struct shim_epoll_handle* epoll, struct shim_epoll_item* epoll_item) {
+    assert(epoll->fd_buckets && epoll->fds_count < epoll->fd_buckets_cnt);
+
+    INIT_LIST_HEAD(epoll_item, list);
+    LISTP_ADD_TAIL(epoll_item, &epoll->fds, list);
+    epoll->fds_count++;
+
+    struct shim_epoll_item** bucket = fd_bucket(epoll, epoll_item->fd);
+    epoll_item->hash_next = *bucket;
+    *bucket = epoll_item;
+
+    INIT_LIST_HEAD(epoll_item, ready_list);
+    epoll_item->ready = false;
+
+    epoll_item->pal_handle = NULL;
+    epoll_item->pal_events = 0;
+    epoll_item->poll_event = false;
+    mark_epoll_item_dirty(epoll_item);
+}
+
+/* Removes an item from the `fds` list, the FD index and the ready list (but not from the `epolls`
+ * list of its handle). The caller frees the item. */
+static void del_epoll_item(struct shim_epoll_handle* epoll, struct shim_epoll_item* epoll_item) {
+    LISTP_DEL(epoll_item, &epoll->fds, list);
+    epoll->fds_count--;
+    epoll->gen++;
+
+    struct shim_epoll_item** link = fd_bucket(epoll, epoll_item->fd);
+    while (*link != epoll_item)
+        link = &(*link)->hash_next;
+    *link = epoll_item->hash_next;
+
+    if (epoll_item->ready) {
+        LISTP_DEL(epoll_item, &epoll->ready, ready_list);
+        epoll_item->ready = false;
+    }
+
+    unregister_epoll_item(epoll_item);
+}
+
+/* Registers the current PAL handle of an item in the wait set, or updates its events. */
+static int sync_epoll_item(struct shim_epoll_handle* epoll, struct shim_epoll_item* epoll_item) {
+    struct shim_handle* hdl = epoll_item->handle;
+    int ret = 0;
+
+    PAL_FLG events = 0;
+    if (epoll_item->events & (EPOLLIN | EPOLLRDNORM))
+        events |= PAL_WAIT_READ;
+    if (epoll_item->events & (EPOLLOUT | EPOLLWRNORM))
+        events |= PAL_WAIT_WRITE;
+    if (epoll_item->events & EPOLLET) {
+        if (!__atomic_load_n(&hdl->needs_et_poll_in, __ATOMIC_ACQUIRE))
+            events &= ~PAL_WAIT_READ;
+        if (!__atomic_load_n(&hdl->needs_et_poll_out, __ATOMIC_ACQUIRE))
+            events &= ~PAL_WAIT_WRITE;
+    }
+
+    lock(&hdl->lock);
+    /* handles emulated in LibOS (e.g. local pipes) provide an event to wait on instead */
+    PAL_HANDLE poll_event = NULL;
+    if (events && hdl->fs && hdl->fs->fs_ops && hdl->fs->fs_ops->poll_get) {
+        ret = hdl->fs->fs_ops->poll_get(hdl, events, &poll_event);
+        if (ret < 0) {
+            unlock(&hdl->lock);
+            return ret;
+        }
+    }
+
+    /* note that pipe and socket may not have pal_handle yet (e.g. before bind()) */
+    PAL_HANDLE pal_handle = events ? (poll_event ?: hdl->pal_handle) : NULL;
+    if (!pal_handle)
+        events = 0;
+
+    if (pal_handle != epoll_item->pal_handle || events != epoll_item->pal_events) {
+        if (!pal_handle) {
+            unregister_epoll_item(epoll_item);
+        } else {
+            ret = DkWaitSetCtl(epoll->wait_set,
+                               epoll_item->pal_handle ? PAL_WAIT_SET_MOD : PAL_WAIT_SET_ADD,
+                               (uintptr_t)epoll_item, pal_handle,
+                               poll_event ? PAL_WAIT_READ : events);
+            if (ret == 0) {
+                /* release the event of the previous registration */
+                if (epoll_item->poll_event)
+                    hdl->fs->fs_ops->poll_put(hdl, epoll_item->pal_events);
+                epoll_item->pal_handle = pal_handle;
+                epoll_item->pal_events = events;
+                epoll_item->poll_event = !!poll_event;
+                poll_event = NULL;
+            }
+        }
+    }
+
+    /* the registration did not change (or could not be changed), the item keeps its old event */
+    if (poll_event)
+        hdl->fs->fs_ops->poll_put(hdl, events);
+    unlock(&hdl->lock);
+    return pal_to_unix_errno(ret);
+}
+
+/* Updates the registrations of dirty items in the wait set. */
+static int sync_wait_set(struct shim_epoll_handle* epoll) {
+    if (!__atomic_exchange_n(&epoll->dirty, false, __ATOMIC_ACQ_REL))
+        return 0;
+
+    struct shim_epoll_item* epoll_item;
+    LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
+        if (!__atomic_exchange_n(&epoll_item->dirty, false, __ATOMIC_ACQ_REL))
+            continue;
+
+        int ret = sync_epoll_item(epoll, epoll_item);
+        if (ret < 0) {
+            mark_epoll_item_dirty(epoll_item);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static void mark_epoll_item_ready(struct shim_epoll_handle* epoll,
+                                  struct shim_epoll_item* epoll_item) {
+    if (!epoll_item->ready) {
+        LISTP_ADD_TAIL(epoll_item, &epoll->ready, ready_list);
+        epoll_item->ready = true;
+    }
+}
+
+/* Updates `revents` of an item registered with the event from `poll_get` of its handle; returns
+ * true if some events were found. */
+static bool update_poll_event_revents(struct shim_epoll_item* epoll_item) {
+    struct shim_handle* hdl = epoll_item->handle;
+
+    int shim_events = 0;
+    if (epoll_item->pal_events & PAL_WAIT_READ)
+        shim_events |= FS_POLL_RD;
+    if (epoll_item->pal_events & PAL_WAIT_WRITE)
+        shim_events |= FS_POLL_WR;
+
+    off_t shim_revents = hdl->fs->fs_ops->poll(hdl, shim_events);
+    if (shim_revents < 0 || (shim_revents & FS_POLL_ER))
+        epoll_item->revents |= EPOLLERR | EPOLLHUP | EPOLLRDHUP;
+    if (shim_revents > 0 && (shim_revents & FS_POLL_RD))
+        epoll_item->revents |= EPOLLIN | EPOLLRDNORM;
+    if (shim_revents > 0 && (shim_revents & FS_POLL_WR))
+        epoll_item->revents |= EPOLLOUT | EPOLLWRNORM;
+    return shim_revents < 0 || (shim_revents & (FS_POLL_ER | FS_POLL_RD | FS_POLL_WR));
+}
+
+int restore_epoll_handle(struct shim_handle* epoll_hdl) {
+    assert(epoll_hdl->type == TYPE_EPOLL);
+    struct shim_epoll_handle* epoll = &epoll_hdl->info.epoll;
+
+    int ret = reserve_fd_index(epoll, epoll->fds_count);
+    if (ret < 0)
+        return ret;
+
+    ret = create_wait_set(epoll);
+    if (ret < 0)
+        return ret;
+
+    INIT_LISTP(&epoll->ready);
+    struct shim_epoll_item* epoll_item;
+    LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
+        INIT_LIST_HEAD(epoll_item, ready_list);
+        epoll_item->ready = false;
+        if (epoll_item->revents)
+            mark_epoll_item_ready(epoll, epoll_item);
+
+        epoll_item->pal_handle = NULL;
+        epoll_item->pal_events = 0;
+        epoll_item->poll_event = false;
+        mark_epoll_item_dirty(epoll_item);
+    }
+    return 0;
+}
+
 void _update_epolls(struct shim_handle* handle) {
     assert(locked(&handle->lock));
 
     struct shim_epoll_item* epoll_item;
     LISTP_FOR_EACH_ENTRY(epoll_item, &handle->epolls, back) {
+        mark_epoll_item_dirty(epoll_item);
         notify_epoll_waiters(&epoll_item->epoll->info.epoll);
     }
 }
 
+/* Removes the PAL handle of `handle` from all wait sets; has to be called before the PAL handle is
+ * closed (e.g. when a socket is reconnected). The items are re-registered with the new PAL handle
+ * after `_update_epolls`. */
+void _remove_pal_handle_from_epolls(struct shim_handle* handle) {
+    assert(locked(&handle->lock));
+
+    struct shim_epoll_item* epoll_item;
+    LISTP_FOR_EACH_ENTRY(epoll_item, &handle->epolls, back) {
+        unregister_epoll_item(epoll_item);
+        mark_epoll_item_dirty(epoll_item);
+    }
+}
+
 void delete_from_epoll_handles(struct shim_handle* handle) {
     /* handle may be registered in several epolls, delete it from all of them via handle->epolls */
     while (1) {
@@ -114,8 +420,7 @@ void delete_from_epoll_handles(struct shim_handle* handle) {
         struct shim_epoll_handle* epoll = &hdl->info.epoll;
 
         lock(&hdl->lock);
-        LISTP_DEL(epoll_item, &epoll->fds, list);
-        epoll->fds_count--;
+        del_epoll_item(epoll, epoll_item);
         notify_epoll_waiters(epoll);
         unlock(&hdl->lock);
 
@@ -166,11 +471,9 @@ long shim_do_epoll_ctl(int epfd, int op, int fd, struct __kernel_epoll_event* ev
 
     switch (op) {
         case EPOLL_CTL_ADD: {
-            LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
-                if (epoll_item->fd == fd) {
-                    ret = -EEXIST;
-                    goto out;
-                }
+            if (find_epoll_item(epoll, fd)) {
+                ret = -EEXIST;
+                goto out;
             }
 
             struct shim_handle* hdl = get_fd_handle(fd, NULL, cur->handle_map);
@@ -184,8 +487,8 @@ long shim_do_epoll_ctl(int epfd, int op, int fd, struct __kernel_epoll_event* ev
                 put_handle(hdl);
                 goto out;
             }
-            if (epoll->fds_count == MAX_EPOLL_HANDLES) {
-                ret = -ENOSPC;
+            ret = reserve_fd_index(epoll, epoll->fds_count + 1);
+            if (ret < 0) {
                 put_handle(hdl);
                 goto out;
             }
@@ -214,14 +517,14 @@ long shim_do_epoll_ctl(int epfd, int op, int fd, struct __kernel_epoll_event* ev
              * - bind hdl to epoll-item via the `back` list
              * - bind epoll-item to epoll via the `list` list */
             lock(&hdl->lock);
+            if (epoll_item->events & EPOLLET)
+                mark_handle_epolls_dirty(hdl);
             INIT_LIST_HEAD(epoll_item, back);
             LISTP_ADD_TAIL(epoll_item, &hdl->epolls, back);
             unlock(&hdl->lock);
 
             /* note that we already grabbed epoll_hdl->lock so can safely update epoll */
-            INIT_LIST_HEAD(epoll_item, list);
-            LISTP_ADD_TAIL(epoll_item, &epoll->fds, list);
-            epoll->fds_count++;
+            add_epoll_item(epoll, epoll_item);
             notify_epoll_waiters(epoll);
 
             put_handle(hdl);
@@ -229,51 +532,53 @@ long shim_do_epoll_ctl(int epfd, int op, int fd, struct __kernel_epoll_event* ev
         }
 
         case EPOLL_CTL_MOD: {
-            LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
-                if (epoll_item->fd == fd) {
-                    epoll_item->events = event->events;
-                    epoll_item->data   = event->data;
-
-                    if (epoll_item->events & EPOLLET) {
-                        struct shim_handle* handle = epoll_item->handle;
-                        __atomic_store_n(&handle->needs_et_poll_in, true, __ATOMIC_RELEASE);
-                        __atomic_store_n(&handle->needs_et_poll_out, true, __ATOMIC_RELEASE);
-                    }
-
-                    log_debug("modified fd %d at epoll handle %p", fd, epoll);
-                    notify_epoll_waiters(epoll);
-                    goto out;
-                }
+            epoll_item = find_epoll_item(epoll, fd);
+            if (!epoll_item) {
+                ret = -ENOENT;
+                break;
+            }
+
+            epoll_item->events = event->events;
+            epoll_item->data   = event->data;
+
+            struct shim_handle* handle = epoll_item->handle;
+            if (epoll_item->events & EPOLLET) {
+                __atomic_store_n(&handle->needs_et_poll_in, true, __ATOMIC_RELEASE);
+                __atomic_store_n(&handle->needs_et_poll_out, true, __ATOMIC_RELEASE);
+                lock(&handle->lock);
+                mark_handle_epolls_dirty(handle);
+                unlock(&handle->lock);
+            } else {
+                mark_epoll_item_dirty(epoll_item);
             }
 
-            ret = -ENOENT;
+            log_debug("modified fd %d at epoll handle %p", fd, epoll);
+            notify_epoll_waiters(epoll);
             break;
         }
 
         case EPOLL_CTL_DEL: {
-            LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
-                if (epoll_item->fd == fd) {
-                    struct shim_handle* hdl = epoll_item->handle;
-                    log_debug("delete fd %d (handle %p) from epoll handle %p", fd, hdl, epoll);
-
-                    /* unregister hdl (corresponding to FD) in epoll (corresponding to EPFD):
-                     * - unbind hdl from epoll-item via the `back` list
-                     * - unbind epoll-item from epoll via the `list` list */
-                    lock(&hdl->lock);
-                    LISTP_DEL(epoll_item, &hdl->epolls, back);
-                    unlock(&hdl->lock);
-
-                    /* note that we already grabbed epoll_hdl->lock so we can safely update epoll */
-                    LISTP_DEL(epoll_item, &epoll->fds, list);
-                    epoll->fds_count--;
-                    notify_epoll_waiters(epoll);
-
-                    free(epoll_item);
-                    goto out;
-                }
+            epoll_item = find_epoll_item(epoll, fd);
+            if (!epoll_item) {
+                ret = -ENOENT;
+                break;
             }
 
-            ret = -ENOENT;
+            struct shim_handle* hdl = epoll_item->handle;
+            log_debug("delete fd %d (handle %p) from epoll handle %p", fd, hdl, epoll);
+
+            /* unregister hdl (corresponding to FD) in epoll (corresponding to EPFD):
+             * - unbind hdl from epoll-item via the `back` list
+             * - unbind epoll-item from epoll via the `list` list */
+            lock(&hdl->lock);
+            LISTP_DEL(epoll_item, &hdl->epolls, back);
+            unlock(&hdl->lock);
+
+            /* note that we already grabbed epoll_hdl->lock so we can safely update epoll */
+            del_epoll_item(epoll, epoll_item);
+            notify_epoll_waiters(epoll);
+
+            free(epoll_item);
             break;
         }
 
@@ -307,136 +612,95 @@ long shim_do_epoll_wait(int epfd, struct __kernel_epoll_event* events, int maxev
     assert(epoll_hdl->type == TYPE_EPOLL);
     struct shim_epoll_handle* epoll = &epoll_hdl->info.epoll;
 
+    long ret;
     lock(&epoll_hdl->lock);
 
     /* loop to retry on interrupted epoll waits (due to epoll being concurrently updated) */
     while (1) {
-        /* wait on epoll's PAL handles + one "event" handle that signals epoll updates */
-        PAL_HANDLE* pal_handles = malloc((epoll->fds_count + 1) * sizeof(PAL_HANDLE));
-        if (!pal_handles) {
-            unlock(&epoll_hdl->lock);
-            put_handle(epoll_hdl);
-            return -ENOMEM;
-        }
-
-        /* allocate one memory region to hold two PAL_FLG arrays: events and revents */
-        PAL_FLG* pal_events = malloc((epoll->fds_count + 1) * sizeof(PAL_FLG) * 2);
-        if (!pal_events) {
-            free(pal_handles);
-            unlock(&epoll_hdl->lock);
-            put_handle(epoll_hdl);
-            return -ENOMEM;
-        }
-        PAL_FLG* ret_events = pal_events + (epoll->fds_count + 1);
-
-        /* populate pal_events with read/write events from user-supplied epoll items */
-        size_t pal_cnt = 0;
-        struct shim_epoll_item* epoll_item;
-        LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
-            assert(epoll_item->handle != NULL);
-            if (!epoll_item->handle->pal_handle)
-                continue;
-
-            pal_handles[pal_cnt] = epoll_item->handle->pal_handle;
-            pal_events[pal_cnt] = (epoll_item->events & (EPOLLIN | EPOLLRDNORM))
-                                  ? PAL_WAIT_READ
-                                  : 0;
-            pal_events[pal_cnt] |= (epoll_item->events & (EPOLLOUT | EPOLLWRNORM))
-                                   ? PAL_WAIT_WRITE
-                                   : 0;
-            ret_events[pal_cnt] = 0;
+        ret = sync_wait_set(epoll);
+        if (ret < 0)
+            goto out;
 
-            if (epoll_item->events & EPOLLET) {
-                if (!__atomic_load_n(&epoll_item->handle->needs_et_poll_in, __ATOMIC_ACQUIRE)) {
-                    pal_events[pal_cnt] &= ~PAL_WAIT_READ;
-                }
-                if (!__atomic_load_n(&epoll_item->handle->needs_et_poll_out, __ATOMIC_ACQUIRE)) {
-                    pal_events[pal_cnt] &= ~PAL_WAIT_WRITE;
-                }
-            }
-
-            pal_cnt++;
-        }
-
-        assert(pal_cnt <= epoll->fds_count);
-
-        /* populate "event" handle so it waits on read (meaning epoll-update signal arrived);
-         * note that we don't increment pal_cnt because this is a special not-user-supplied item */
-        pal_handles[pal_cnt] = epoll->event.event;
-        pal_events[pal_cnt]  = PAL_WAIT_READ;
-        ret_events[pal_cnt]  = 0;
+        /* if some events are already pending, only check for new ones without blocking */
+        bool have_ready = !LISTP_EMPTY(&epoll->ready);
+        uint64_t gen = epoll->gen;
 
         /* mark epoll as being waited on (so epoll-update signal is sent) */
         __atomic_add_fetch(&epoll->waiter_cnt, 1, __ATOMIC_RELAXED);
         unlock(&epoll_hdl->lock);
 
+        /* the wait set contains epoll's PAL handles + one "event" handle that signals epoll
+         * updates; it reports only the ready ones, with the items as `data` */
+        PAL_NUM ret_data[EPOLL_WAIT_BATCH];
+        PAL_FLG ret_events[EPOLL_WAIT_BATCH];
+        PAL_NUM ret_count = 0;
         /* TODO: Timeout must be updated in case of retries; otherwise, we may wait for too long */
-        long error = DkStreamsWaitEvents(pal_cnt + 1, pal_handles, pal_events, ret_events,
-                                         timeout_ms * 1000);
+        long error = DkWaitSetWait(epoll->wait_set, EPOLL_WAIT_BATCH, ret_data, ret_events,
+                                   &ret_count, have_ready ? 0 : timeout_ms * 1000);
         bool polled = error == 0;
         error = pal_to_unix_errno(error);
 
         lock(&epoll_hdl->lock);
         __atomic_sub_fetch(&epoll->waiter_cnt, 1, __ATOMIC_RELAXED);
 
+        /* items could have been freed in the meantime if the epoll was updated */
+        bool updated = epoll->gen != gen;
+        for (size_t i = 0; polled && i < ret_count; i++)
+            if (ret_data[i] == EPOLL_EVENT_DATA)
+                updated = true;
+
         /* update user-supplied epoll items' revents with ret_events of polled PAL handles */
-        if (!ret_events[pal_cnt] && polled) {
-            /* only if epoll was not updated concurrently and something was actually polled */
-            /* TODO: This loop is wrong. If there are 2 epoll_items with the same pal_handle (e.g.
-             * due to dup-ed fd), only the first will be updated.
-             * GH issue: https://github.com/oscarlab/graphene/issues/1848 */
-            for (size_t i = 0; i < pal_cnt; i++) {
-                LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
-                    assert(epoll_item->handle != NULL);
-                    if (!epoll_item->handle->pal_handle)
-                        continue;
-                    if (epoll_item->handle->pal_handle != pal_handles[i])
-                        continue;
-
-                    if (ret_events[i] & PAL_WAIT_ERROR) {
-                        epoll_item->revents  |= EPOLLERR | EPOLLHUP | EPOLLRDHUP;
-                    }
-                    if (ret_events[i] & PAL_WAIT_READ)
-                        epoll_item->revents |= EPOLLIN | EPOLLRDNORM;
-                    if (ret_events[i] & PAL_WAIT_WRITE)
-                        epoll_item->revents |= EPOLLOUT | EPOLLWRNORM;
-                    break;
+        if (!updated && polled) {
+            for (size_t i = 0; i < ret_count; i++) {
+                struct shim_epoll_item* epoll_item = (struct shim_epoll_item*)ret_data[i];
+                if (epoll_item->poll_event) {
+                    /* the event only says that the handle may be ready, ask the handle itself */
+                    if (update_poll_event_revents(epoll_item))
+                        mark_epoll_item_ready(epoll, epoll_item);
+                    continue;
                 }
+                if (ret_events[i] & PAL_WAIT_ERROR)
+                    epoll_item->revents |= EPOLLERR | EPOLLHUP | EPOLLRDHUP;
+                if (ret_events[i] & PAL_WAIT_READ)
+                    epoll_item->revents |= EPOLLIN | EPOLLRDNORM;
+                if (ret_events[i] & PAL_WAIT_WRITE)
+                    epoll_item->revents |= EPOLLOUT | EPOLLWRNORM;
+                mark_epoll_item_ready(epoll, epoll_item);
             }
         }
 
-        PAL_FLG event_handle_update = ret_events[pal_cnt];
-        free(pal_handles);
-        free(pal_events);
-
-        if (error && error != -EAGAIN) {
-            unlock(&epoll_hdl->lock);
-            put_handle(epoll_hdl);
-            if (error == -EINTR) {
-                /* `epoll_wait` and `epoll_pwait` are not restarted after being interrupted by
-                 * a signal handler. */
-                error = -ERESTARTNOHAND;
-            }
-            return error;
-        } else if (event_handle_update) {
+        if (have_ready) {
+            /* report the pending events, even if the epoll was updated in the meantime */
+            break;
+        } else if (error && error != -EAGAIN) {
+            /* `epoll_wait` and `epoll_pwait` are not restarted after being interrupted by
+             * a signal handler. */
+            ret = error == -EINTR ? -ERESTARTNOHAND : error;
+            goto out;
+        } else if (updated) {
             /* retry if epoll was updated concurrently (similar to Linux semantics) */
             unlock(&epoll_hdl->lock);
-            int ret = wait_event(&epoll->event);
+            ret = wait_event(&epoll->event);
             if (ret < 0) {
                 put_handle(epoll_hdl);
                 return ret;
             }
             lock(&epoll_hdl->lock);
+        } else if (polled && ret_count && LISTP_EMPTY(&epoll->ready) && timeout_ms != 0) {
+            /* only events from `poll_get` fired, but their handles were not ready anymore */
+            continue;
         } else {
             /* no need to retry, exit the while loop */
             break;
         }
     }
 
-    /* update user-supplied events array with all events detected till now on epoll */
+    /* update user-supplied events array with events of ready items; items that do not fit stay on
+     * the ready list and are reported first next time */
     int nevents = 0;
     struct shim_epoll_item* epoll_item;
-    LISTP_FOR_EACH_ENTRY(epoll_item, &epoll->fds, list) {
+    struct shim_epoll_item* tmp_epoll_item;
+    LISTP_FOR_EACH_ENTRY_SAFE(epoll_item, tmp_epoll_item, &epoll->ready, ready_list) {
         if (nevents == maxevents)
             break;
 
@@ -450,14 +714,25 @@ long shim_do_epoll_wait(int epfd, struct __kernel_epoll_event* events, int maxev
             if (events[nevents].events & (EPOLLOUT | EPOLLWRNORM)) {
                 __atomic_store_n(&epoll_item->handle->needs_et_poll_out, false, __ATOMIC_RELEASE);
             }
+            if (epoll_item->events & EPOLLET) {
+                /* stop waiting for the reported events */
+                lock(&epoll_item->handle->lock);
+                mark_handle_epolls_dirty(epoll_item->handle);
+                unlock(&epoll_item->handle->lock);
+            }
             epoll_item->revents &= ~epoll_item->events; /* informed user about revents, may clear */
             nevents++;
         }
+
+        LISTP_DEL(epoll_item, &epoll->ready, ready_list);
+        epoll_item->ready = false;
     }
+    ret = nevents;
 
+out:
     unlock(&epoll_hdl->lock);
     put_handle(epoll_hdl);
-    return nevents;
+    return ret;
 }
 
 long shim_do_epoll_pwait(int epfd, struct __kernel_epoll_event* events, int maxevents,
@@ -483,11 +758,18 @@ static int epoll_close(struct shim_handle* epoll_hdl) {
         LISTP_DEL(epoll_item, &hdl->epolls, back);
         unlock(&hdl->lock);
 
-        LISTP_DEL(epoll_item, &epoll->fds, list);
-        epoll->fds_count--;
+        del_epoll_item(epoll, epoll_item);
         free(epoll_item);
     }
 
+    free(epoll->fd_buckets);
+    epoll->fd_buckets = NULL;
+    epoll->fd_buckets_cnt = 0;
+    if (epoll->wait_set) {
+        DkObjectClose(epoll->wait_set);
+        epoll->wait_set = NULL;
+    }
+
     unlock(&epoll_hdl->lock);
 
     destroy_event(&epoll->event);
@@ -525,6 +807,8 @@ BEGIN_CP_FUNC(epoll_item) {
         new_epoll_item->events    = epoll_item->events;
         new_epoll_item->data      = epoll_item->data;
         new_epoll_item->revents   = epoll_item->revents;
+        new_epoll_item->pal_handle = NULL; // Registered in the new wait set by RS_FUNC
+        new_epoll_item->poll_event = false;
         new_epoll_item->epoll     = NULL; // To be filled by epoll handle RS_FUNC
 
         LISTP_ADD(new_epoll_item, new_list, list);
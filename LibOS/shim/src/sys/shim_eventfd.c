@@ -2,61 +2,23 @@
 /* Copyright (C) 2019 Intel Corporation */
 
 /*
- * Implementation of system calls "eventfd" and "eventfd2". Since eventfd emulation currently relies
- * on the host, these system calls are disallowed by default due to security concerns. To use them,
- * they must be explicitly allowed through the "sys.insecure__allow_eventfd" manifest key.
+ * Implementation of system calls "eventfd" and "eventfd2". Eventfds are emulated inside the LibOS
+ * (see fs/eventfd/fs.c); a host eventfd is used only for eventfds shared with a child process,
+ * which must be explicitly allowed through the "sys.insecure__allow_eventfd" manifest key.
  */
 
 #include <asm/fcntl.h>
 #include <sys/eventfd.h>
 
-#include "pal.h"
-#include "pal_error.h"
 #include "shim_fs.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_table.h"
-#include "shim_utils.h"
-#include "toml.h"
-
-static int create_eventfd(PAL_HANDLE* efd, unsigned count, int flags) {
-    int ret;
-
-    assert(g_manifest_root);
-    bool allow_eventfd;
-    ret = toml_bool_in(g_manifest_root, "sys.insecure__allow_eventfd", /*defaultval=*/false,
-                       &allow_eventfd);
-    if (ret < 0) {
-        log_error("Cannot parse \'sys.insecure__allow_eventfd\' (the value must be `true` or "
-                  "`false`)");
-        return -ENOSYS;
-    }
-
-    if (!allow_eventfd) {
-        /* eventfd is not explicitly allowed in manifest */
-        return -ENOSYS;
-    }
-
-    PAL_HANDLE hdl = NULL;
-    int pal_flags  = 0;
-
-    pal_flags |= flags & EFD_NONBLOCK ? PAL_OPTION_NONBLOCK : 0;
-    pal_flags |= flags & EFD_CLOEXEC ? PAL_OPTION_CLOEXEC : 0;
-    pal_flags |= flags & EFD_SEMAPHORE ? PAL_OPTION_EFD_SEMAPHORE : 0;
-
-    /* eventfd() requires count (aka initval) but PAL's DkStreamOpen() doesn't have such an
-     * argument. Using create arg as a work-around (note: initval is uint32 but create is int32). */
-    ret = DkStreamOpen(URI_PREFIX_EVENTFD, 0, 0, count, pal_flags, &hdl);
-    if (ret < 0) {
-        log_error("eventfd open failure");
-        return pal_to_unix_errno(ret);
-    }
-
-    *efd = hdl;
-    return 0;
-}
 
 long shim_do_eventfd2(unsigned int count, int flags) {
+    if (flags & ~(EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE))
+        return -EINVAL;
+
     int ret = 0;
     struct shim_handle* hdl = get_new_handle();
 
@@ -67,10 +29,10 @@ long shim_do_eventfd2(unsigned int count, int flags) {
 
     hdl->type = TYPE_EVENTFD;
     hdl->fs = &eventfd_builtin_fs;
-    hdl->flags = O_RDWR;
+    hdl->flags = O_RDWR | (flags & EFD_NONBLOCK ? O_NONBLOCK : 0);
     hdl->acc_mode = MAY_READ | MAY_WRITE;
 
-    if ((ret = create_eventfd(&hdl->pal_handle, count, flags)) < 0)
+    if ((ret = create_local_eventfd(hdl, count, flags & EFD_SEMAPHORE)) < 0)
         goto out;
 
     flags = flags & EFD_CLOEXEC ? FD_CLOEXEC : 0;
@@ -9,12 +9,14 @@
 #include "pal.h"
 #include "pal_error.h"
 #include "shim_fs_lock.h"
+#include "shim_fs_page_cache.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_ipc.h"
 #include "shim_lock.h"
 #include "shim_process.h"
 #include "shim_signal.h"
+#include "shim_syscall_trace.h"
 #include "shim_table.h"
 #include "shim_thread.h"
 #include "shim_utils.h"
@@ -26,7 +28,12 @@ static noreturn void libos_clean_and_exit(int exit_code) {
      * 2) wait for them to exit here, before we terminate the IPC helper
      */
 
+    int ret = page_cache_flush_all();
+    if (ret < 0)
+        log_warning("Failed to write back cached file data: %d", ret);
+
     shutdown_sync_client();
+    terminate_syscall_trace();
 
     struct shim_thread* async_thread = terminate_async_worker();
     if (async_thread) {
@@ -58,6 +65,8 @@ static noreturn void libos_clean_and_exit(int exit_code) {
 
     log_debug("process %u exited with status %d", g_process_ipc_ids.self_vmid, exit_code);
 
+    dump_lock_stats();
+
     /* TODO: We exit whole libos, but there are some objects that might need cleanup - we should do
      * a proper cleanup of everything. */
     DkProcessExit(exit_code);
@@ -87,10 +96,14 @@ noreturn void thread_exit(int error_code, int term_signal) {
             /* `cleanup_thread` did not get this reference, clean it. We have to be careful, as
              * this is most likely the last reference and will free this `cur_thread`. */
             put_thread(cur_thread);
+            syscall_trace_thread_exit();
+            destroy_thread_malloc_cache();
             DkThreadExit(NULL);
             /* UNREACHABLE */
         }
 
+        syscall_trace_thread_exit();
+        destroy_thread_malloc_cache();
         DkThreadExit(&cur_thread->clear_child_tid_pal);
         /* UNREACHABLE */
     }
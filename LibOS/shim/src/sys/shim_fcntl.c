@@ -163,7 +163,7 @@ long shim_do_fcntl(int fd, int cmd, unsigned long arg) {
         case F_SETFD:
             lock(&handle_map->lock);
             if (HANDLE_ALLOCATED(handle_map->map[fd]))
-                handle_map->map[fd]->flags = arg & FD_CLOEXEC;
+                __atomic_store_n(&handle_map->map[fd]->flags, arg & FD_CLOEXEC, __ATOMIC_RELAXED);
             unlock(&handle_map->lock);
             ret = 0;
             break;
@@ -3,7 +3,7 @@
 
 /*
  * Implementation of system calls "unlink", "unlinkat", "mkdir", "mkdirat", "rmdir", "umask",
- * "chmod", "fchmod", "fchmodat", "rename", "renameat" and "sendfile".
+ * "chmod", "fchmod", "fchmodat", "rename", "renameat", "sendfile", "splice" and "copy_file_range".
  */
 
 #include <asm/mman.h>
@@ -13,6 +13,7 @@
 #include "pal.h"
 #include "pal_error.h"
 #include "shim_fs.h"
+#include "shim_fs_page_cache.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_lock.h"
@@ -21,7 +22,8 @@
 #include "shim_utils.h"
 #include "stat.h"
 
-#define BUF_SIZE 4096 /* read/write in 4KB chunks for sendfile() */
+/* chunk size of sendfile(), splice() and copy_file_range() if the data goes through LibOS */
+#define TRANSFER_BUF_SIZE (128 * 1024UL)
 
 /* The kernel would look up the parent directory, and remove the child from the inode. But we are
  * working with the PAL, so we open the file, truncate and close it. */
@@ -71,10 +73,7 @@ long shim_do_unlinkat(int dfd, const char* pathname, int flag) {
         dent->state |= DENTRY_PERSIST;
     }
 
-    if (flag & AT_REMOVEDIR)
-        dent->state &= ~DENTRY_ISDIRECTORY;
-
-    dent->state |= DENTRY_NEGATIVE;
+    dentry_update_state(dent, (flag & AT_REMOVEDIR) ? DENTRY_ISDIRECTORY : 0, DENTRY_NEGATIVE);
 out:
     if (dir)
         put_dentry(dir);
@@ -133,8 +132,7 @@ long shim_do_rmdir(const char* pathname) {
         dent->state |= DENTRY_PERSIST;
     }
 
-    dent->state &= ~DENTRY_ISDIRECTORY;
-    dent->state |= DENTRY_NEGATIVE;
+    dentry_update_state(dent, DENTRY_ISDIRECTORY, DENTRY_NEGATIVE);
 out:
     put_dentry(dent);
     return ret;
@@ -283,7 +281,7 @@ static int do_rename(struct shim_dentry* old_dent, struct shim_dentry* new_dent)
         } else {
             /* destination is a negative dentry and needs to be marked as a directory, since source
              * is a directory */
-            new_dent->state |= DENTRY_ISDIRECTORY;
+            dentry_update_state(new_dent, /*clear=*/0, DENTRY_ISDIRECTORY);
         }
     } else if (new_dent->state & DENTRY_ISDIRECTORY) {
         return -EISDIR;
@@ -297,8 +295,8 @@ static int do_rename(struct shim_dentry* old_dent, struct shim_dentry* new_dent)
 
     int ret = old_dent->fs->d_ops->rename(old_dent, new_dent);
     if (!ret) {
-        old_dent->state |= DENTRY_NEGATIVE;
-        new_dent->state &= ~DENTRY_NEGATIVE;
+        dentry_update_state(old_dent, /*clear=*/0, DENTRY_NEGATIVE);
+        dentry_update_state(new_dent, DENTRY_NEGATIVE, /*set=*/0);
     }
 
     return ret;
@@ -358,12 +356,147 @@ out:
     return ret;
 }
 
+/* Host regular files are read at explicit positions and can be passed to PAL as transfer sources. */
+static bool is_host_file(struct shim_handle* hdl) {
+    return hdl->type == TYPE_FILE && hdl->info.file.type == FILE_REGULAR && !hdl->is_dir;
+}
+
+static bool is_seekable(struct shim_handle* hdl) {
+    return hdl->fs->fs_ops->pread || hdl->fs->fs_ops->seek;
+}
+
+/* Reads at `*pos` (or at the file position if `pos` is NULL); filesystems without positional reads
+ * temporarily move the file position. */
+static ssize_t read_at(struct shim_handle* hdl, void* buf, size_t count, const off_t* pos) {
+    struct shim_fs_ops* fs_ops = hdl->fs->fs_ops;
+    if (!pos)
+        return fs_ops->read(hdl, buf, count);
+    if (fs_ops->pread)
+        return fs_ops->pread(hdl, buf, count, *pos);
+
+    off_t old_pos = fs_ops->seek(hdl, 0, SEEK_CUR);
+    if (old_pos < 0)
+        return old_pos;
+    ssize_t ret = fs_ops->seek(hdl, *pos, SEEK_SET);
+    if (ret < 0)
+        return ret;
+    ret = fs_ops->read(hdl, buf, count);
+    off_t seek_ret = fs_ops->seek(hdl, old_pos, SEEK_SET);
+    return seek_ret < 0 ? seek_ret : ret;
+}
+
+static ssize_t write_at(struct shim_handle* hdl, const void* buf, size_t count, const off_t* pos) {
+    struct shim_fs_ops* fs_ops = hdl->fs->fs_ops;
+    if (!pos)
+        return fs_ops->write(hdl, buf, count);
+    if (fs_ops->pwrite)
+        return fs_ops->pwrite(hdl, buf, count, *pos);
+
+    off_t old_pos = fs_ops->seek(hdl, 0, SEEK_CUR);
+    if (old_pos < 0)
+        return old_pos;
+    ssize_t ret = fs_ops->seek(hdl, *pos, SEEK_SET);
+    if (ret < 0)
+        return ret;
+    ret = fs_ops->write(hdl, buf, count);
+    off_t seek_ret = fs_ops->seek(hdl, old_pos, SEEK_SET);
+    return seek_ret < 0 ? seek_ret : ret;
+}
+
+static ssize_t copy_through_buffer(struct shim_handle* out_hdl, off_t* out_pos,
+                                   struct shim_handle* in_hdl, off_t* in_pos, size_t count) {
+    size_t buf_size = MIN(count, TRANSFER_BUF_SIZE);
+    char* buf = malloc(buf_size);
+    if (!buf)
+        return -ENOMEM;
+
+    ssize_t ret = 0;
+    size_t done = 0;
+    while (done < count) {
+        ret = read_at(in_hdl, buf, MIN(count - done, buf_size), in_pos);
+        if (ret <= 0)
+            break;
+
+        size_t chunk = ret;
+        ret = write_at(out_hdl, buf, chunk, out_pos);
+        if (ret < 0)
+            break;
+        assert((size_t)ret <= chunk);
+
+        /* a positional input is advanced only by what was written, so nothing is lost on a short
+         * write; data read from a non-seekable input is lost, as in any read+write emulation */
+        done += ret;
+        if (in_pos)
+            *in_pos += ret;
+        if (out_pos)
+            *out_pos += ret;
+        if ((size_t)ret < chunk)
+            break;
+    }
+
+    free(buf);
+    return done ? (ssize_t)done : ret;
+}
+
+/* Common part of sendfile, splice and copy_file_range: copies up to `count` bytes from `in_hdl` to
+ * `out_hdl`. Positions `in_pos` and `out_pos`, if not NULL, are used instead of the file positions
+ * of the handles and are advanced by the number of bytes copied.
+ *
+ * If the input is a host file and the output supports `write_from`, PAL copies the data directly
+ * between the streams (in the host kernel, if possible). Otherwise, the data goes through a buffer
+ * in LibOS. */
+static ssize_t transfer_data(struct shim_handle* out_hdl, off_t* out_pos,
+                             struct shim_handle* in_hdl, off_t* in_pos, size_t count) {
+    struct shim_fs_ops* in_ops = in_hdl->fs->fs_ops;
+    struct shim_fs_ops* out_ops = out_hdl->fs->fs_ops;
+
+    if (!in_ops->read || !out_ops->write)
+        return -EINVAL;
+
+    if (!count)
+        return 0;
+
+    /* Host files are always read at explicit positions, so that the file position is moved only by
+     * the number of bytes which were actually written. As with concurrent read() calls on a shared
+     * handle, other users of the file position may observe it only after the whole copy. */
+    off_t file_pos;
+    bool use_file_pos = !in_pos && is_host_file(in_hdl) && in_ops->seek;
+    if (use_file_pos) {
+        file_pos = in_ops->seek(in_hdl, 0, SEEK_CUR);
+        if (file_pos < 0)
+            return file_pos;
+        in_pos = &file_pos;
+    }
+
+    ssize_t ret;
+    if (in_pos && is_host_file(in_hdl) && in_hdl->pal_handle && (in_hdl->acc_mode & MAY_READ) &&
+            out_ops->write_from) {
+        /* PAL reads the host file, which has to contain the data written to the page cache */
+        struct shim_file_data* data = in_hdl->info.file.data;
+        struct page_cache* cache = data ? __atomic_load_n(&data->page_cache, __ATOMIC_ACQUIRE)
+                                        : NULL;
+        if (cache && (ret = page_cache_flush(cache)) < 0)
+            return ret;
+        ret = out_ops->write_from(out_hdl, in_hdl->pal_handle, *in_pos, count, out_pos);
+        if (ret > 0) {
+            *in_pos += ret;
+            if (out_pos)
+                *out_pos += ret;
+        }
+    } else {
+        ret = copy_through_buffer(out_hdl, out_pos, in_hdl, in_pos, count);
+    }
+
+    if (use_file_pos && ret > 0) {
+        off_t seek_ret = in_ops->seek(in_hdl, file_pos, SEEK_SET);
+        if (seek_ret < 0)
+            return seek_ret;
+    }
+    return ret;
+}
+
 long shim_do_sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
     long ret;
-    char* buf = NULL;
-
-    size_t read_from_in  = 0;
-    size_t copied_to_out = 0;
 
     if (offset && !is_user_memory_writable(offset, sizeof(*offset)))
         return -EFAULT;
@@ -389,96 +522,161 @@ long shim_do_sendfile(int out_fd, int in_fd, off_t* offset, size_t count) {
         goto out;
     }
 
-    /* FIXME: This sendfile() emulation is very simple and not particularly efficient: it reads from
-     *        input FD in BUF_SIZE chunks and writes into output FD. Mmap-based emulation may be
-     *        more efficient but adds complexity (not all handle types provide mmap callback).
-     *
-     *        Also, since this emulation relies on the `read()` callback, performing sendfile from
-     *        one thread and reads from another thread will lead to discrepancies in copied data.
-     *        For proper emulation, a `read()` callback with explicit offsets is needed. */
-    buf = malloc(BUF_SIZE);
-    if (!buf) {
-        ret = -ENOMEM;
-        goto out;
+    off_t pos = 0;
+    if (offset) {
+        if (!is_seekable(in_hdl)) {
+            ret = -ESPIPE;
+            goto out;
+        }
+        if (*offset < 0) {
+            ret = -EINVAL;
+            goto out;
+        }
+        pos = *offset;
+    }
+
+    /* manpage: "if offset != NULL, then sendfile() does not modify file offset of in_fd, and the
+     * file offset will be updated by the call" */
+    ret = transfer_data(out_hdl, /*out_pos=*/NULL, in_hdl, offset ? &pos : NULL, count);
+    if (offset)
+        *offset = pos;
+
+out:
+    put_handle(in_hdl);
+    put_handle(out_hdl);
+    return ret;
+}
+
+long shim_do_splice(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len,
+                    unsigned int flags) {
+    long ret;
+
+    /* SPLICE_F_MOVE and SPLICE_F_GIFT are only hints, SPLICE_F_MORE is ignored like MSG_MORE; there
+     * is no separate non-blocking mode for the pipe, the O_NONBLOCK flag of the fds decides */
+    if (flags & ~(SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT))
+        return -EINVAL;
+
+    if (off_in && !is_user_memory_writable(off_in, sizeof(*off_in)))
+        return -EFAULT;
+    if (off_out && !is_user_memory_writable(off_out, sizeof(*off_out)))
+        return -EFAULT;
+
+    struct shim_handle* in_hdl = get_fd_handle(fd_in, NULL, NULL);
+    if (!in_hdl)
+        return -EBADF;
+
+    struct shim_handle* out_hdl = get_fd_handle(fd_out, NULL, NULL);
+    if (!out_hdl) {
+        put_handle(in_hdl);
+        return -EBADF;
     }
 
-    if (!count) {
-        ret = 0;
+    if (!in_hdl->fs || !in_hdl->fs->fs_ops || !out_hdl->fs || !out_hdl->fs->fs_ops) {
+        ret = -EINVAL;
         goto out;
     }
 
-    off_t old_offset = 0;
+    /* at least one end has to be a pipe, and pipes have no offsets */
+    if (in_hdl->type != TYPE_PIPE && out_hdl->type != TYPE_PIPE) {
+        ret = -EINVAL;
+        goto out;
+    }
+    if ((off_in && (in_hdl->type == TYPE_PIPE || !is_seekable(in_hdl))) ||
+            (off_out && (out_hdl->type == TYPE_PIPE || !is_seekable(out_hdl)))) {
+        ret = -ESPIPE;
+        goto out;
+    }
 
-    if (offset) {
-        if (!in_hdl->fs->fs_ops->seek) {
-            ret = -ESPIPE;
-            goto out;
-        }
+    if (out_hdl->flags & O_APPEND) {
+        ret = -EINVAL;
+        goto out;
+    }
 
-        old_offset = in_hdl->fs->fs_ops->seek(in_hdl, 0, SEEK_CUR);
-        if (old_offset < 0) {
-            ret = old_offset;
-            goto out;
-        }
+    off_t in_pos  = off_in ? *off_in : 0;
+    off_t out_pos = off_out ? *off_out : 0;
+    if (in_pos < 0 || out_pos < 0) {
+        ret = -EINVAL;
+        goto out;
+    }
 
-        ret = in_hdl->fs->fs_ops->seek(in_hdl, *offset, SEEK_SET);
-        if (ret < 0) {
-            goto out;
-        }
+    ret = transfer_data(out_hdl, off_out ? &out_pos : NULL, in_hdl, off_in ? &in_pos : NULL, len);
+    if (ret > 0) {
+        if (off_in)
+            *off_in = in_pos;
+        if (off_out)
+            *off_out = out_pos;
     }
 
-    while (copied_to_out < count) {
-        size_t to_copy = count - copied_to_out > BUF_SIZE ? BUF_SIZE : count - copied_to_out;
+out:
+    put_handle(in_hdl);
+    put_handle(out_hdl);
+    return ret;
+}
 
-        ssize_t x = in_hdl->fs->fs_ops->read(in_hdl, buf, to_copy);
-        if (x < 0) {
-            ret = x;
-            goto out;
-        }
-        assert(x <= (ssize_t)to_copy);
+long shim_do_copy_file_range(int fd_in, loff_t* off_in, int fd_out, loff_t* off_out, size_t len,
+                             unsigned int flags) {
+    long ret;
 
-        read_from_in += x;
+    if (flags)
+        return -EINVAL;
 
-        if (x == 0) {
-            /* no more data in input FD, let's return however many bytes copied_to_out up until now */
-            break;
-        }
+    if (off_in && !is_user_memory_writable(off_in, sizeof(*off_in)))
+        return -EFAULT;
+    if (off_out && !is_user_memory_writable(off_out, sizeof(*off_out)))
+        return -EFAULT;
 
-        ssize_t y = out_hdl->fs->fs_ops->write(out_hdl, buf, x);
-        if (y < 0) {
-            ret = y;
-            goto out;
-        }
-        assert(y <= x);
+    struct shim_handle* in_hdl = get_fd_handle(fd_in, NULL, NULL);
+    if (!in_hdl)
+        return -EBADF;
 
-        copied_to_out += y;
+    struct shim_handle* out_hdl = get_fd_handle(fd_out, NULL, NULL);
+    if (!out_hdl) {
+        put_handle(in_hdl);
+        return -EBADF;
+    }
 
-        if (y < x) {
-            /* written less bytes to output fd than read from input fd -> out of sync now; don't try
-             * to be smart and simply return however many bytes we copied_to_out up until now */
-            /* TODO: need to revert in_fd's file position to (read_from_in - x + y) from original
-             *       offset and maybe continue this loop */
-            break;
-        }
+    if (!in_hdl->fs || !in_hdl->fs->fs_ops || !out_hdl->fs || !out_hdl->fs->fs_ops) {
+        ret = -EINVAL;
+        goto out;
     }
 
-    if (offset) {
-        /* manpage: "if offset != NULL, then sendfile() does not modify file offset of in_fd..." */
-        ret = in_hdl->fs->fs_ops->seek(in_hdl, old_offset, SEEK_SET);
-        if (ret < 0) {
-            goto out;
-        }
+    if (!(in_hdl->acc_mode & MAY_READ) || !(out_hdl->acc_mode & MAY_WRITE) ||
+            (out_hdl->flags & O_APPEND)) {
+        ret = -EBADF;
+        goto out;
+    }
+
+    if (in_hdl->is_dir || out_hdl->is_dir) {
+        ret = -EISDIR;
+        goto out;
+    }
+
+    /* both ends have to be regular files */
+    if (!is_seekable(in_hdl) || !is_seekable(out_hdl)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    off_t in_pos  = off_in ? *off_in : 0;
+    off_t out_pos = off_out ? *off_out : 0;
+    if (in_pos < 0 || out_pos < 0) {
+        ret = -EINVAL;
+        goto out;
+    }
 
-        /* "...and the file offset will be updated by the call" */
-        *offset = *offset + read_from_in;
+    /* without `off_out`, the write itself advances the output file position */
+    ret = transfer_data(out_hdl, off_out ? &out_pos : NULL, in_hdl, off_in ? &in_pos : NULL, len);
+    if (ret > 0) {
+        if (off_in)
+            *off_in = in_pos;
+        if (off_out)
+            *off_out = out_pos;
     }
 
-    ret = 0;
 out:
-    free(buf);
     put_handle(in_hdl);
     put_handle(out_hdl);
-    return copied_to_out ? (long)copied_to_out : ret;
+    return ret;
 }
 
 long shim_do_chroot(const char* filename) {
@@ -493,8 +691,10 @@ long shim_do_chroot(const char* filename) {
     }
 
     lock(&g_process.fs_lock);
-    put_dentry(g_process.root);
-    g_process.root = dent;
+    struct shim_dentry* old_root = g_process.root;
+    /* lockless lookups read `root` without `fs_lock`, see `path_lookupat` */
+    __atomic_store_n(&g_process.root, dent, __ATOMIC_RELEASE);
+    put_dentry(old_root);
     unlock(&g_process.fs_lock);
 out:
     return ret;
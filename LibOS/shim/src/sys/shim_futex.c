@@ -13,6 +13,10 @@
  * Current implementation is limited to one process i.e. threads calling futex syscall on the same
  * futex word must reside in the same process.
  * As a result we can distinguish futexes by their virtual address.
+ *
+ * Similarly to Linux, waiters are kept in a hash table indexed by the futex address, with a lock
+ * per bucket, so operations on unrelated futexes do not contend on a single lock. There are no
+ * per-futex objects: a bucket holds the waiters of all futexes hashed to it.
  */
 
 #include <linux/futex.h>
@@ -21,7 +25,6 @@
 
 #include "api.h"
 #include "assert.h"
-#include "avl_tree.h"
 #include "list.h"
 #include "pal.h"
 #include "shim_internal.h"
@@ -32,340 +35,158 @@
 #include "shim_utils.h"
 #include "spinlock.h"
 
-struct shim_futex;
-struct futex_waiter;
+#define FUTEX_HASH_BITS    8
+#define FUTEX_HASH_BUCKETS (1UL << FUTEX_HASH_BITS)
+
+struct futex_bucket;
 
 DEFINE_LIST(futex_waiter);
 DEFINE_LISTP(futex_waiter);
 struct futex_waiter {
     struct shim_thread* thread;
+    uint32_t* uaddr;
     uint32_t bitset;
     LIST_TYPE(futex_waiter) list;
-    /* futex field is guarded by g_futex_tree_lock, do not use it without taking that lock first.
-     * This is needed to ensure that a waiter knows what futex they were sleeping on, after they
-     * wake-up (because they could have been requeued to another futex).*/
-    struct shim_futex* futex;
+    /* Bucket on which this waiter is queued. Changes (together with `uaddr`) when the waiter is
+     * requeued to a futex in another bucket, so it can be relied upon only after taking the lock of
+     * the bucket and checking that it still points there (see `lock_waiter_bucket`). */
+    struct futex_bucket* bucket;
 };
 
-struct shim_futex {
-    uint32_t* uaddr;
-    LISTP_TYPE(futex_waiter) waiters;
-    struct avl_tree_node tree_node;
-    bool in_tree;
-    /* This lock guards every access to *uaddr (futex word value) and waiters (above).
-     * Always take g_futex_tree_lock before taking this lock. */
+struct futex_bucket {
+    /* Guards `waiters` and every access to the futex words hashed to this bucket, which are done
+     * under the lock (e.g. FUTEX_WAIT checking the value). */
     spinlock_t lock;
-    REFTYPE _ref_count;
-};
-
-static bool futex_tree_cmp(struct avl_tree_node* node_a, struct avl_tree_node* node_b) {
-    struct shim_futex* a = container_of(node_a, struct shim_futex, tree_node);
-    struct shim_futex* b = container_of(node_b, struct shim_futex, tree_node);
-
-    return (uintptr_t)a->uaddr <= (uintptr_t)b->uaddr;
-}
-
-static struct avl_tree g_futex_tree = { .cmp = futex_tree_cmp };
-
-static spinlock_t g_futex_tree_lock = INIT_SPINLOCK_UNLOCKED;
-
-static void get_futex(struct shim_futex* futex) {
-    REF_INC(futex->_ref_count);
-}
-
-static void put_futex(struct shim_futex* futex) {
-    if (!REF_DEC(futex->_ref_count)) {
-        free(futex);
-    }
-}
+    LISTP_TYPE(futex_waiter) waiters;
+} __attribute__((aligned(64)));
 
-/* Since we distinguish futexes by their virtual address, we can as well create a total ordering
- * based on it. */
-static int cmp_futexes(struct shim_futex* futex1, struct shim_futex* futex2) {
-    uintptr_t f1 = (uintptr_t)futex1->uaddr;
-    uintptr_t f2 = (uintptr_t)futex2->uaddr;
+/* zeroed memory is an empty bucket with an unlocked lock, see INIT_SPINLOCK_UNLOCKED */
+static struct futex_bucket g_futex_buckets[FUTEX_HASH_BUCKETS];
 
-    if (f1 < f2) {
-        return -1;
-    } else if (f1 == f2) {
-        return 0;
-    } else {
-        return 1;
-    }
+static struct futex_bucket* get_futex_bucket(uint32_t* uaddr) {
+    uint64_t hash = ((uintptr_t)uaddr >> 2) * 0x9e3779b97f4a7c15UL;
+    return &g_futex_buckets[hash >> (64 - FUTEX_HASH_BITS)];
 }
 
 /*
- * Locks two futexes in ascending order (defined by cmp_futexes).
- * If a futex is NULL, it is just skipped.
+ * Locks two buckets in ascending order of their addresses (to avoid deadlocks). If both are the
+ * same, takes just one lock.
  */
-static void lock_two_futexes(struct shim_futex* futex1, struct shim_futex* futex2) {
-    if (!futex1 && !futex2) {
-        return;
-    } else if (futex1 && !futex2) {
-        spinlock_lock(&futex1->lock);
-        return;
-    } else if (!futex1 && futex2) {
-        spinlock_lock(&futex2->lock);
-        return;
-    }
-    /* Both are not NULL. */
-
-    /* To avoid deadlocks we always take the locks in ascending order of futexes.
-     * If both futexes are equal, just take one lock. */
-    int cmp = cmp_futexes(futex1, futex2);
-    if (cmp < 0) {
-        spinlock_lock(&futex1->lock);
-        spinlock_lock(&futex2->lock);
-    } else if (cmp == 0) {
-        spinlock_lock(&futex1->lock);
+static void lock_two_buckets(struct futex_bucket* bucket1, struct futex_bucket* bucket2) {
+    if (bucket1 == bucket2) {
+        spinlock_lock(&bucket1->lock);
+    } else if (bucket1 < bucket2) {
+        spinlock_lock(&bucket1->lock);
+        spinlock_lock(&bucket2->lock);
     } else {
-        spinlock_lock(&futex2->lock);
-        spinlock_lock(&futex1->lock);
+        spinlock_lock(&bucket2->lock);
+        spinlock_lock(&bucket1->lock);
     }
 }
 
-static void unlock_two_futexes(struct shim_futex* futex1, struct shim_futex* futex2) {
-    if (!futex1 && !futex2) {
-        return;
-    } else if (futex1 && !futex2) {
-        spinlock_unlock(&futex1->lock);
-        return;
-    } else if (!futex1 && futex2) {
-        spinlock_unlock(&futex2->lock);
-        return;
+static void unlock_two_buckets(struct futex_bucket* bucket1, struct futex_bucket* bucket2) {
+    spinlock_unlock(&bucket1->lock);
+    if (bucket1 != bucket2) {
+        spinlock_unlock(&bucket2->lock);
     }
-    /* Both are not NULL. */
-
-    /* For unlocking order does not matter. */
-    int cmp = cmp_futexes(futex1, futex2);
-    if (cmp) {
-        spinlock_unlock(&futex1->lock);
-        spinlock_unlock(&futex2->lock);
-    } else {
-        spinlock_unlock(&futex1->lock);
-    }
-}
-
-/*
- * Adds `futex` to `g_futex_tree`.
- *
- * `g_futex_tree_lock` should be held while calling this function and you must ensure that nobody
- * is using `futex` (e.g. you have just created it).
- */
-static void enqueue_futex(struct shim_futex* futex) {
-    assert(spinlock_is_locked(&g_futex_tree_lock));
-
-    get_futex(futex);
-    avl_tree_insert(&g_futex_tree, &futex->tree_node);
-    futex->in_tree = true;
 }
 
 /*
- * Checks whether `futex` has no waiters and is on `g_futex_tree`.
- *
- * This requires only `futex->lock` to be held.
+ * Locks the bucket on which `waiter` is currently queued (or was queued last, if it was already
+ * woken).
  */
-static bool check_dequeue_futex(struct shim_futex* futex) {
-    assert(spinlock_is_locked(&futex->lock));
-
-    return LISTP_EMPTY(&futex->waiters) && futex->in_tree;
-}
-
-static void _maybe_dequeue_futex(struct shim_futex* futex) {
-    assert(spinlock_is_locked(&futex->lock));
-    assert(spinlock_is_locked(&g_futex_tree_lock));
-
-    if (check_dequeue_futex(futex)) {
-        avl_tree_delete(&g_futex_tree, &futex->tree_node);
-        futex->in_tree = false;
-        /* We still hold this futex reference (in the caller), so this won't call free. */
-        put_futex(futex);
-    }
-}
-
-/*
- * If `futex` has no waiters and is on `g_futex_tree`, takes it off that tree.
- *
- * Neither `g_futex_tree_lock` nor `futex->lock` should be held while calling this,
- * it acquires these locks itself.
- */
-static void maybe_dequeue_futex(struct shim_futex* futex) {
-    spinlock_lock(&g_futex_tree_lock);
-    spinlock_lock(&futex->lock);
-    _maybe_dequeue_futex(futex);
-    spinlock_unlock(&futex->lock);
-    spinlock_unlock(&g_futex_tree_lock);
-}
-
-/*
- * Same as `maybe_dequeue_futex`, but works for two futexes, any of which might be NULL.
- */
-static void maybe_dequeue_two_futexes(struct shim_futex* futex1, struct shim_futex* futex2) {
-    spinlock_lock(&g_futex_tree_lock);
-    lock_two_futexes(futex1, futex2);
-    if (futex1) {
-        _maybe_dequeue_futex(futex1);
-    }
-    if (futex2) {
-        _maybe_dequeue_futex(futex2);
+static struct futex_bucket* lock_waiter_bucket(struct futex_waiter* waiter) {
+    while (1) {
+        struct futex_bucket* bucket = __atomic_load_n(&waiter->bucket, __ATOMIC_RELAXED);
+        spinlock_lock(&bucket->lock);
+        if (__atomic_load_n(&waiter->bucket, __ATOMIC_RELAXED) == bucket) {
+            return bucket;
+        }
+        /* We were requeued in the meantime. */
+        spinlock_unlock(&bucket->lock);
     }
-    unlock_two_futexes(futex1, futex2);
-    spinlock_unlock(&g_futex_tree_lock);
 }
 
 /*
- * Adds `waiter` to `futex` waiters list.
- * You need to make sure that this futex is still on `g_futex_tree`, but in most cases it follows
- * from the program control flow.
+ * Adds `waiter` (of the current thread) to the waiters of `uaddr`.
  *
- * `futex->lock` needs to be held.
+ * `bucket->lock` needs to be held.
  */
-static void add_futex_waiter(struct futex_waiter* waiter, struct shim_futex* futex,
-                             uint32_t bitset) {
-    assert(spinlock_is_locked(&futex->lock));
+static void add_futex_waiter(struct futex_waiter* waiter, struct futex_bucket* bucket,
+                             uint32_t* uaddr, uint32_t bitset) {
+    assert(spinlock_is_locked(&bucket->lock));
 
     waiter->thread = get_cur_thread();
     get_thread(waiter->thread);
 
     INIT_LIST_HEAD(waiter, list);
+    waiter->uaddr = uaddr;
     waiter->bitset = bitset;
-    get_futex(futex);
-    waiter->futex = futex;
-    LISTP_ADD_TAIL(waiter, &futex->waiters, list);
+    __atomic_store_n(&waiter->bucket, bucket, __ATOMIC_RELAXED);
+    LISTP_ADD_TAIL(waiter, &bucket->waiters, list);
 }
 
 /*
  * Ownership of the `waiter->thread` is passed to the caller; we do not change its refcount because
- * we take it of `futex->waiters` list (-1) and give it to caller (+1).
+ * we take it of `bucket->waiters` list (-1) and give it to caller (+1).
  *
- * `futex->lock` needs to be held.
+ * `bucket->lock` needs to be held.
  */
 static struct shim_thread* remove_futex_waiter(struct futex_waiter* waiter,
-                                               struct shim_futex* futex) {
-    assert(spinlock_is_locked(&futex->lock));
+                                               struct futex_bucket* bucket) {
+    assert(spinlock_is_locked(&bucket->lock));
 
-    LISTP_DEL_INIT(waiter, &futex->waiters, list);
+    LISTP_DEL_INIT(waiter, &bucket->waiters, list);
     return waiter->thread;
 }
 
 /*
- * Moves waiter from `futex1` to `futex2`.
- * As in `add_futex_waiter`, `futex2` needs to be on `g_futex_tree`.
+ * Moves waiter from futex `bucket1` to futex `uaddr2` (in `bucket2`).
  *
- * `futex1->lock` and `futex2->lock` need to be held.
- */
-static void move_futex_waiter(struct futex_waiter* waiter, struct shim_futex* futex1,
-                              struct shim_futex* futex2) {
-    assert(spinlock_is_locked(&futex1->lock));
-    assert(spinlock_is_locked(&futex2->lock));
-
-    LISTP_DEL_INIT(waiter, &futex1->waiters, list);
-    get_futex(futex2);
-    put_futex(waiter->futex);
-    waiter->futex = futex2;
-    LISTP_ADD_TAIL(waiter, &futex2->waiters, list);
-}
-
-/*
- * Creates a new futex.
- * Sets the new futex refcount to 1.
+ * `bucket1->lock` and `bucket2->lock` need to be held.
  */
-static struct shim_futex* create_new_futex(uint32_t* uaddr) {
-    struct shim_futex* futex;
+static void move_futex_waiter(struct futex_waiter* waiter, struct futex_bucket* bucket1,
+                              struct futex_bucket* bucket2, uint32_t* uaddr2) {
+    assert(spinlock_is_locked(&bucket1->lock));
+    assert(spinlock_is_locked(&bucket2->lock));
 
-    futex = calloc(1, sizeof(*futex));
-    if (!futex) {
-        return NULL;
+    waiter->uaddr = uaddr2;
+    if (bucket1 != bucket2) {
+        LISTP_DEL_INIT(waiter, &bucket1->waiters, list);
+        __atomic_store_n(&waiter->bucket, bucket2, __ATOMIC_RELAXED);
+        LISTP_ADD_TAIL(waiter, &bucket2->waiters, list);
     }
-
-    REF_SET(futex->_ref_count, 1);
-
-    futex->uaddr = uaddr;
-    futex->in_tree = false;
-    INIT_LISTP(&futex->waiters);
-    spinlock_init(&futex->lock);
-
-    return futex;
-}
-
-/*
- * Finds a futex in `g_futex_tree`.
- * Must be called with `g_futex_tree_lock` held.
- * Increases refcount of futex by 1.
- */
-static struct shim_futex* find_futex(uint32_t* uaddr) {
-    assert(spinlock_is_locked(&g_futex_tree_lock));
-    struct shim_futex* futex = NULL;
-    struct shim_futex cmp_arg = {
-        .uaddr = uaddr
-    };
-    struct avl_tree_node* node = avl_tree_find(&g_futex_tree, &cmp_arg.tree_node);
-    if (!node) {
-        return NULL;
-    }
-
-    futex = container_of(node, struct shim_futex, tree_node);
-    get_futex(futex);
-    return futex;
 }
 
 static int futex_wait(uint32_t* uaddr, uint32_t val, uint64_t timeout, uint32_t bitset) {
     int ret = 0;
-    struct shim_futex* futex = NULL;
     struct shim_thread* thread = NULL;
-    struct shim_futex* tmp = NULL;
-
-    spinlock_lock(&g_futex_tree_lock);
-    futex = find_futex(uaddr);
-    if (!futex) {
-        spinlock_unlock(&g_futex_tree_lock);
-        tmp = create_new_futex(uaddr);
-        if (!tmp) {
-            return -ENOMEM;
-        }
-        spinlock_lock(&g_futex_tree_lock);
-        futex = find_futex(uaddr);
-        if (!futex) {
-            enqueue_futex(tmp);
-            futex = tmp;
-            tmp = NULL;
-        }
-    }
-    spinlock_lock(&futex->lock);
-    spinlock_unlock(&g_futex_tree_lock);
+    struct futex_bucket* bucket = get_futex_bucket(uaddr);
+
+    spinlock_lock(&bucket->lock);
 
     if (__atomic_load_n(uaddr, __ATOMIC_RELAXED) != val) {
-        ret = -EAGAIN;
-        goto out_with_futex_lock;
+        spinlock_unlock(&bucket->lock);
+        return -EAGAIN;
     }
 
     thread_prepare_wait();
 
     struct futex_waiter waiter = {0};
-    add_futex_waiter(&waiter, futex, bitset);
+    add_futex_waiter(&waiter, bucket, uaddr, bitset);
 
-    spinlock_unlock(&futex->lock);
-
-    /* Give up this futex reference - we have no idea what futex we will be on once we wake up
-     * (due to possible requeues). */
-    put_futex(futex);
-    futex = NULL;
+    spinlock_unlock(&bucket->lock);
 
     ret = thread_wait(timeout != NO_TIMEOUT ? &timeout : NULL, /*ignore_pending_signals=*/false);
 
-    spinlock_lock(&g_futex_tree_lock);
-    /* We might have been requeued. Grab the (possibly new) futex reference. */
-    futex = waiter.futex;
-    assert(futex);
-    get_futex(futex);
-    spinlock_lock(&futex->lock);
-    spinlock_unlock(&g_futex_tree_lock);
+    /* We might have been requeued, possibly to another bucket. */
+    bucket = lock_waiter_bucket(&waiter);
 
     if (!LIST_EMPTY(&waiter, list)) {
         /* If we woke up due to time out or a signal, we were not removed from the waiters list
          * (opposite of when another thread calls FUTEX_WAKE, which would remove us from the list).
          */
-        thread = remove_futex_waiter(&waiter, futex);
+        thread = remove_futex_waiter(&waiter, bucket);
 
         if (ret == 0 || ret == -EINTR) {
             ret = -ERESTARTSYS;
@@ -374,57 +195,42 @@ static int futex_wait(uint32_t* uaddr, uint32_t val, uint64_t timeout, uint32_t
         ret = 0;
     }
 
-    /* At this point we are done using the `waiter` struct and need to give up the futex reference
-     * it was holding.
-     * NB: actually `futex` and this point to the same futex, so this won't call free. */
-    put_futex(waiter.futex);
-
-out_with_futex_lock:; // C is awesome!
-    /* Because dequeuing a futex requires `g_futex_tree_lock` which we do not hold at this moment,
-     * we check if we actually need to do it now (locks acquisition and dequeuing). */
-    bool needs_dequeue = check_dequeue_futex(futex);
-
-    spinlock_unlock(&futex->lock);
-
-    if (needs_dequeue) {
-        maybe_dequeue_futex(futex);
-    }
+    /* After this unlock nobody references `waiter` anymore. */
+    spinlock_unlock(&bucket->lock);
 
     if (thread) {
         put_thread(thread);
     }
-
-    put_futex(futex);
-    if (tmp) {
-        put_futex(tmp);
-    }
     return ret;
 }
 
 /*
- * Moves at most `to_wake` waiters from futex to wake queue;
+ * Moves at most `to_wake` waiters of `uaddr` from `bucket` to wake queue;
  * In the Linux kernel the number of waiters to wake has type `int` and we follow that here.
  * Normally `bitset` has to be non-zero, here zero means: do not even check it.
  *
- * Must be called with `futex->lock` held.
+ * Must be called with `bucket->lock` held.
  *
  * Returns number of threads woken.
  */
-static int move_to_wake_queue(struct shim_futex* futex, uint32_t bitset, int to_wake,
-                              struct wake_queue_head* queue) {
-    assert(spinlock_is_locked(&futex->lock));
+static int move_to_wake_queue(struct futex_bucket* bucket, uint32_t* uaddr, uint32_t bitset,
+                              int to_wake, struct wake_queue_head* queue) {
+    assert(spinlock_is_locked(&bucket->lock));
 
     struct futex_waiter* waiter;
     struct futex_waiter* wtmp;
     struct shim_thread* thread;
     int woken = 0;
 
-    LISTP_FOR_EACH_ENTRY_SAFE(waiter, wtmp, &futex->waiters, list) {
+    LISTP_FOR_EACH_ENTRY_SAFE(waiter, wtmp, &bucket->waiters, list) {
+        if (waiter->uaddr != uaddr) {
+            continue;
+        }
         if (bitset && !(waiter->bitset & bitset)) {
             continue;
         }
 
-        thread = remove_futex_waiter(waiter, futex);
+        thread = remove_futex_waiter(waiter, bucket);
         add_thread_to_queue(queue, thread);
         put_thread(thread);
 
@@ -439,7 +245,7 @@ static int move_to_wake_queue(struct shim_futex* futex, uint32_t bitset, int to_
 }
 
 static int futex_wake(uint32_t* uaddr, int to_wake, uint32_t bitset) {
-    struct shim_futex* futex;
+    struct futex_bucket* bucket = get_futex_bucket(uaddr);
     struct wake_queue_head queue = {.first = WAKE_QUEUE_TAIL};
     int woken = 0;
 
@@ -447,32 +253,14 @@ static int futex_wake(uint32_t* uaddr, int to_wake, uint32_t bitset) {
         return -EINVAL;
     }
 
-    spinlock_lock(&g_futex_tree_lock);
-    futex = find_futex(uaddr);
-    if (!futex) {
-        spinlock_unlock(&g_futex_tree_lock);
-        return 0;
-    }
-    spinlock_lock(&futex->lock);
-    spinlock_unlock(&g_futex_tree_lock);
-
-    woken = move_to_wake_queue(futex, bitset, to_wake, &queue);
-
-    bool needs_dequeue = check_dequeue_futex(futex);
-
-    spinlock_unlock(&futex->lock);
-
-    if (needs_dequeue) {
-        maybe_dequeue_futex(futex);
-    }
+    spinlock_lock(&bucket->lock);
+    woken = move_to_wake_queue(bucket, uaddr, bitset, to_wake, &queue);
+    spinlock_unlock(&bucket->lock);
 
     wake_queue(&queue);
 
-    put_futex(futex);
-
     return woken;
 }
-
 /*
  * Sign-extends 12 bit argument to 32 bits.
  */
@@ -485,19 +273,12 @@ static int wakeop_arg_extend(int x) {
 
 static int futex_wake_op(uint32_t* uaddr1, uint32_t* uaddr2, int to_wake1, int to_wake2,
                          uint32_t val3) {
-    struct shim_futex* futex1 = NULL;
-    struct shim_futex* futex2 = NULL;
+    struct futex_bucket* bucket1 = get_futex_bucket(uaddr1);
+    struct futex_bucket* bucket2 = get_futex_bucket(uaddr2);
     struct wake_queue_head queue = {.first = WAKE_QUEUE_TAIL};
     int ret = 0;
-    bool needs_dequeue1 = false;
-    bool needs_dequeue2 = false;
-
-    spinlock_lock(&g_futex_tree_lock);
-    futex1 = find_futex(uaddr1);
-    futex2 = find_futex(uaddr2);
 
-    lock_two_futexes(futex1, futex2);
-    spinlock_unlock(&g_futex_tree_lock);
+    lock_two_buckets(bucket1, bucket2);
 
     unsigned int op = (val3 >> 28) & 0x7; // highest bit is for FUTEX_OP_OPARG_SHIFT
     unsigned int cmp = (val3 >> 24) & 0xf;
@@ -565,40 +346,25 @@ static int futex_wake_op(uint32_t* uaddr1, uint32_t* uaddr2, int to_wake1, int t
             goto out_unlock;
     }
 
-    if (futex1) {
-        ret += move_to_wake_queue(futex1, 0, to_wake1, &queue);
-        needs_dequeue1 = check_dequeue_futex(futex1);
-    }
-    if (futex2 && cmpval) {
-        ret += move_to_wake_queue(futex2, 0, to_wake2, &queue);
-        needs_dequeue2 = check_dequeue_futex(futex2);
+    ret += move_to_wake_queue(bucket1, uaddr1, 0, to_wake1, &queue);
+    if (cmpval) {
+        ret += move_to_wake_queue(bucket2, uaddr2, 0, to_wake2, &queue);
     }
 
 out_unlock:
-    unlock_two_futexes(futex1, futex2);
-
-    if (needs_dequeue1 || needs_dequeue2) {
-        maybe_dequeue_two_futexes(futex1, futex2);
-    }
+    unlock_two_buckets(bucket1, bucket2);
 
     if (ret > 0) {
         wake_queue(&queue);
     }
 
-    if (futex1) {
-        put_futex(futex1);
-    }
-    if (futex2) {
-        put_futex(futex2);
-    }
     return ret;
 }
 
 static int futex_requeue(uint32_t* uaddr1, uint32_t* uaddr2, int to_wake, int to_requeue,
                          uint32_t* val) {
-    struct shim_futex* futex1 = NULL;
-    struct shim_futex* futex2 = NULL;
-    struct shim_futex* tmp = NULL;
+    struct futex_bucket* bucket1 = get_futex_bucket(uaddr1);
+    struct futex_bucket* bucket2 = get_futex_bucket(uaddr2);
     struct wake_queue_head queue = {.first = WAKE_QUEUE_TAIL};
     int ret = 0;
     int woken = 0;
@@ -606,35 +372,12 @@ static int futex_requeue(uint32_t* uaddr1, uint32_t* uaddr2, int to_wake, int to
     struct futex_waiter* waiter;
     struct futex_waiter* wtmp;
     struct shim_thread* thread;
-    bool needs_dequeue1 = false;
-    bool needs_dequeue2 = false;
 
     if (to_wake < 0 || to_requeue < 0) {
         return -EINVAL;
     }
 
-    spinlock_lock(&g_futex_tree_lock);
-    futex2 = find_futex(uaddr2);
-    if (!futex2) {
-        spinlock_unlock(&g_futex_tree_lock);
-        tmp = create_new_futex(uaddr2);
-        if (!tmp) {
-            return -ENOMEM;
-        }
-        needs_dequeue2 = true;
-
-        spinlock_lock(&g_futex_tree_lock);
-        futex2 = find_futex(uaddr2);
-        if (!futex2) {
-            enqueue_futex(tmp);
-            futex2 = tmp;
-            tmp = NULL;
-        }
-    }
-    futex1 = find_futex(uaddr1);
-
-    lock_two_futexes(futex1, futex2);
-    spinlock_unlock(&g_futex_tree_lock);
+    lock_two_buckets(bucket1, bucket2);
 
     if (val != NULL) {
         if (__atomic_load_n(uaddr1, __ATOMIC_RELAXED) != *val) {
@@ -643,51 +386,37 @@ static int futex_requeue(uint32_t* uaddr1, uint32_t* uaddr2, int to_wake, int to
         }
     }
 
-    if (futex1) {
-        /* We cannot call move_to_wake_queue here, as this function wakes at least 1 thread,
-         * (even if to_wake is 0) and here we want to wake-up exactly to_wake threads.
-         * I guess it's better to be compatible and replicate these weird corner cases. */
-        LISTP_FOR_EACH_ENTRY_SAFE(waiter, wtmp, &futex1->waiters, list) {
-            if (woken < to_wake) {
-                thread = remove_futex_waiter(waiter, futex1);
-                add_thread_to_queue(&queue, thread);
-                put_thread(thread);
-                ++woken;
-            } else if (requeued < to_requeue) {
-                move_futex_waiter(waiter, futex1, futex2);
-                ++requeued;
-            } else {
-                break;
-            }
+    /* We cannot call move_to_wake_queue here, as this function wakes at least 1 thread,
+     * (even if to_wake is 0) and here we want to wake-up exactly to_wake threads.
+     * I guess it's better to be compatible and replicate these weird corner cases.
+     * If both futexes hash to the same bucket, requeued waiters stay in place (with the new
+     * `uaddr`), so this loop does not visit them again. */
+    LISTP_FOR_EACH_ENTRY_SAFE(waiter, wtmp, &bucket1->waiters, list) {
+        if (waiter->uaddr != uaddr1) {
+            continue;
+        }
+        if (woken < to_wake) {
+            thread = remove_futex_waiter(waiter, bucket1);
+            add_thread_to_queue(&queue, thread);
+            put_thread(thread);
+            ++woken;
+        } else if (requeued < to_requeue) {
+            move_futex_waiter(waiter, bucket1, bucket2, uaddr2);
+            ++requeued;
+        } else {
+            break;
         }
-
-        needs_dequeue1 = check_dequeue_futex(futex1);
-        needs_dequeue2 = check_dequeue_futex(futex2);
-
-        ret = woken + requeued;
     }
 
-out_unlock:
-    unlock_two_futexes(futex1, futex2);
+    ret = woken + requeued;
 
-    if (needs_dequeue1 || needs_dequeue2) {
-        maybe_dequeue_two_futexes(futex1, futex2);
-    }
+out_unlock:
+    unlock_two_buckets(bucket1, bucket2);
 
     if (woken > 0) {
         wake_queue(&queue);
     }
 
-    if (futex1) {
-        put_futex(futex1);
-    }
-    assert(futex2);
-    put_futex(futex2);
-
-    if (tmp) {
-        put_futex(tmp);
-    }
-
     return ret;
 }
 
@@ -73,8 +73,10 @@ long shim_do_chdir(const char* filename) {
         return -ENOENT;
 
     lock(&g_process.fs_lock);
-    put_dentry(g_process.cwd);
-    g_process.cwd = dent;
+    struct shim_dentry* old_cwd = g_process.cwd;
+    /* lockless lookups read `cwd` without `fs_lock`, see `path_lookupat` */
+    __atomic_store_n(&g_process.cwd, dent, __ATOMIC_RELEASE);
+    put_dentry(old_cwd);
     unlock(&g_process.fs_lock);
     return 0;
 }
@@ -98,8 +100,9 @@ long shim_do_fchdir(int fd) {
 
     lock(&g_process.fs_lock);
     get_dentry(dent);
-    put_dentry(g_process.cwd);
-    g_process.cwd = dent;
+    struct shim_dentry* old_cwd = g_process.cwd;
+    __atomic_store_n(&g_process.cwd, dent, __ATOMIC_RELEASE);
+    put_dentry(old_cwd);
     unlock(&g_process.fs_lock);
     put_handle(hdl);
     return 0;
@@ -266,6 +266,11 @@ long shim_do_pread64(int fd, char* buf, size_t count, loff_t pos) {
     if (hdl->is_dir)
         goto out;
 
+    if (fs->fs_ops->pread) {
+        ret = fs->fs_ops->pread(hdl, buf, count, pos);
+        goto out;
+    }
+
     int offset = fs->fs_ops->seek(hdl, 0, SEEK_CUR);
     if (offset < 0) {
         ret = offset;
@@ -316,6 +321,11 @@ long shim_do_pwrite64(int fd, char* buf, size_t count, loff_t pos) {
     if (hdl->is_dir)
         goto out;
 
+    if (fs->fs_ops->pwrite) {
+        ret = fs->fs_ops->pwrite(hdl, buf, count, pos);
+        goto out;
+    }
+
     int offset = fs->fs_ops->seek(hdl, 0, SEEK_CUR);
     if (offset < 0) {
         ret = offset;
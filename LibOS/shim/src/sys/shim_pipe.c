@@ -15,27 +15,27 @@
 #include "shim_fs.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
+#include "shim_local_pipe.h"
 #include "shim_table.h"
 #include "shim_types.h"
 #include "shim_utils.h"
 #include "stat.h"
 
-static int create_pipes(struct shim_handle* srv, struct shim_handle* cli, int flags, char* name,
-                        struct shim_qstr* qstr) {
+int create_host_pipes(char* name, char* uri, size_t uri_size, int pal_options,
+                      PAL_HANDLE* out_srv, PAL_HANDLE* out_cli) {
     int ret = 0;
-    char uri[PIPE_URI_SIZE];
 
     PAL_HANDLE hdl0 = NULL; /* server pipe (temporary, waits for connect from hdl2) */
     PAL_HANDLE hdl1 = NULL; /* one pipe end (accepted connect from hdl2) */
     PAL_HANDLE hdl2 = NULL; /* other pipe end (connects to hdl0 and talks to hdl1) */
 
-    if ((ret = create_pipe(name, uri, PIPE_URI_SIZE, &hdl0, qstr,
+    if ((ret = create_pipe(name, uri, uri_size, &hdl0, /*qstr=*/NULL,
                            /*use_vmid_for_name=*/false)) < 0) {
         log_error("pipe creation failure");
         return ret;
     }
 
-    ret = DkStreamOpen(uri, 0, 0, 0, LINUX_OPEN_FLAGS_TO_PAL_OPTIONS(flags), &hdl2);
+    ret = DkStreamOpen(uri, 0, 0, 0, pal_options, &hdl2);
     if (ret < 0) {
         ret = pal_to_unix_errno(ret);
         log_error("pipe connection failure");
@@ -49,20 +49,8 @@ static int create_pipes(struct shim_handle* srv, struct shim_handle* cli, int fl
         goto out;
     }
 
-    PAL_HANDLE tmp = srv->pal_handle;
-    srv->pal_handle = hdl1;
-
-    if (flags & O_NONBLOCK) {
-        /* `cli` - `hdl2` - has this flag already set by the call to `DkStreamOpen`. */
-        ret = set_handle_nonblocking(srv, /*on=*/true);
-        if (ret < 0) {
-            /* Restore original handle, if any. */
-            srv->pal_handle = tmp;
-            goto out;
-        }
-    }
-
-    cli->pal_handle = hdl2;
+    *out_srv = hdl1;
+    *out_cli = hdl2;
     ret = 0;
 
 out:
@@ -77,6 +65,23 @@ out:
     return ret;
 }
 
+/* Connects FIFO ends `srv` (read end) and `cli` (write end) with a host pipe. */
+static int create_fifo_pipes(struct shim_handle* srv, struct shim_handle* cli, char* name,
+                             struct shim_qstr* qstr) {
+    char uri[PIPE_URI_SIZE];
+    PAL_HANDLE srv_hdl;
+    PAL_HANDLE cli_hdl;
+
+    int ret = create_host_pipes(name, uri, sizeof(uri), /*pal_options=*/0, &srv_hdl, &cli_hdl);
+    if (ret < 0)
+        return ret;
+
+    srv->pal_handle = srv_hdl;
+    cli->pal_handle = cli_hdl;
+    qstrsetstr(qstr, uri, strlen(uri));
+    return 0;
+}
+
 static void undo_set_fd_handle(int fd) {
     if (fd >= 0) {
         struct shim_handle* hdl = detach_fd_handle(fd, NULL, NULL);
@@ -124,13 +129,16 @@ long shim_do_pipe2(int* filedes, int flags) {
     hdl1->info.pipe.ready_for_ops = true;
     hdl2->info.pipe.ready_for_ops = true;
 
-    ret = create_pipes(hdl1, hdl2, flags, hdl1->info.pipe.name, &hdl1->uri);
+    if (flags & O_NONBLOCK) {
+        hdl1->flags |= O_NONBLOCK;
+        hdl2->flags |= O_NONBLOCK;
+    }
+
+    /* both ends are in this process, so the pipe is emulated in LibOS until the process forks */
+    ret = create_local_pipe(hdl1, hdl2, /*duplex=*/false);
     if (ret < 0)
         goto out;
 
-    memcpy(hdl2->info.pipe.name, hdl1->info.pipe.name, sizeof(hdl2->info.pipe.name));
-    qstrcopy(&hdl2->uri, &hdl1->uri);
-
     vfd1 = set_new_fd_handle(hdl1, flags & O_CLOEXEC ? FD_CLOEXEC : 0, NULL);
     if (vfd1 < 0) {
         ret = vfd1;
@@ -209,14 +217,15 @@ long shim_do_socketpair(int domain, int type, int protocol, int* sv) {
     sock2->protocol   = protocol;
     sock2->sock_state = SOCK_CONNECTED;
 
-    ret = create_pipes(hdl1, hdl2, type & SOCK_NONBLOCK ? O_NONBLOCK : 0, sock1->addr.un.name,
-                       &hdl1->uri);
+    if (type & SOCK_NONBLOCK) {
+        hdl1->flags |= O_NONBLOCK;
+        hdl2->flags |= O_NONBLOCK;
+    }
+
+    ret = create_local_pipe(hdl1, hdl2, /*duplex=*/true);
     if (ret < 0)
         goto out;
 
-    memcpy(sock2->addr.un.name, sock1->addr.un.name, sizeof(sock2->addr.un.name));
-    qstrcopy(&hdl2->uri, &hdl1->uri);
-
     vfd1 = set_new_fd_handle(hdl1, type & SOCK_CLOEXEC ? FD_CLOEXEC : 0, NULL);
     if (vfd1 < 0) {
         ret = vfd1;
@@ -326,7 +335,7 @@ long shim_do_mknodat(int dirfd, const char* pathname, mode_t mode, dev_t dev) {
 
     /* FIFO pipes are created in blocking mode; they will be changed to non-blocking if open()'ed
      * in non-blocking mode later (see fifo_open) */
-    ret = create_pipes(hdl1, hdl2, /*flags=*/0, hdl1->info.pipe.name, &hdl1->uri);
+    ret = create_fifo_pipes(hdl1, hdl2, hdl1->info.pipe.name, &hdl1->uri);
     if (ret < 0)
         goto out;
 
@@ -349,8 +358,7 @@ long shim_do_mknodat(int dirfd, const char* pathname, mode_t mode, dev_t dev) {
     }
 
     /* mark pseudo entry in file system as valid and stash FDs in data */
-    dent->state &= ~DENTRY_NEGATIVE;
-    dent->state |= DENTRY_VALID;
+    dentry_update_state(dent, DENTRY_NEGATIVE, DENTRY_VALID);
 
     static_assert(sizeof(vfd1) == sizeof(uint32_t) && sizeof(vfd2) == sizeof(uint32_t),
                   "FDs must be 4B in size");
@@ -62,6 +62,10 @@ static long _shim_do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms) {
     struct fds_mapping_t {
         struct shim_handle* hdl; /* NULL if no mapping (handle is not used in polling) */
         nfds_t idx;              /* index from fds array to pals array */
+        /* the handle is waited on through the event from `poll_get`, which was called with
+         * `poll_events` */
+        bool poll_event;
+        PAL_FLG poll_events;
     };
     struct fds_mapping_t* fds_mapping = malloc(nfds * sizeof(struct fds_mapping_t));
     if (!fds_mapping) {
@@ -81,8 +85,6 @@ static long _shim_do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms) {
     nfds_t pal_cnt  = 0;
     nfds_t nrevents = 0;
 
-    lock(&map->lock);
-
     /* collect PAL handles that correspond to user-supplied FDs (only those that can be polled) */
     for (nfds_t i = 0; i < nfds; i++) {
         fds[i].revents = 0;
@@ -93,10 +95,13 @@ static long _shim_do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms) {
             continue;
         }
 
-        struct shim_handle* hdl = __get_fd_handle(fds[i].fd, NULL, map);
+        /* lockless lookup, so that polling doesn't serialize with FD operations of other threads */
+        struct shim_handle* hdl = get_fd_handle(fds[i].fd, NULL, map);
         if (!hdl || !hdl->fs || !hdl->fs->fs_ops) {
             /* The corresponding handle doesn't exist or doesn't provide FS-like semantics; do not
              * include it in handles-to-poll array but notify user about invalid request. */
+            if (hdl)
+                put_handle(hdl);
             fds[i].revents = POLLNVAL;
             nrevents++;
             continue;
@@ -124,12 +129,7 @@ static long _shim_do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms) {
 
             if (fds[i].revents)
                 nrevents++;
-            continue;
-        }
-
-        if (!hdl->pal_handle) {
-            fds[i].revents = POLLNVAL;
-            nrevents++;
+            put_handle(hdl);
             continue;
         }
 
@@ -143,20 +143,40 @@ static long _shim_do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms) {
             /* If user requested read/write events but they are not allowed on this handle, ignore
              * this handle (but note that user may only be interested in errors, and this is a valid
              * request). */
+            put_handle(hdl);
             continue;
         }
 
-        get_handle(hdl);
+        /* handles emulated in LibOS (e.g. local pipes) provide an event to wait on */
+        PAL_HANDLE poll_event = NULL;
+        if (hdl->fs->fs_ops->poll_get) {
+            int ret = hdl->fs->fs_ops->poll_get(hdl, allowed_events, &poll_event);
+            if (ret < 0) {
+                put_handle(hdl);
+                fds[i].revents = POLLERR;
+                nrevents++;
+                continue;
+            }
+        }
+
+        if (!poll_event && !hdl->pal_handle) {
+            put_handle(hdl);
+            fds[i].revents = POLLNVAL;
+            nrevents++;
+            continue;
+        }
+
+        /* reference taken by get_fd_handle() is dropped after polling */
         fds_mapping[i].hdl = hdl;
         fds_mapping[i].idx = pal_cnt;
-        pals[pal_cnt] = hdl->pal_handle;
-        pal_events[pal_cnt] = allowed_events;
+        fds_mapping[i].poll_event = !!poll_event;
+        fds_mapping[i].poll_events = allowed_events;
+        pals[pal_cnt] = poll_event ?: hdl->pal_handle;
+        pal_events[pal_cnt] = poll_event ? PAL_WAIT_READ : allowed_events;
         ret_events[pal_cnt] = 0;
         pal_cnt++;
     }
 
-    unlock(&map->lock);
-
     bool polled = false;
     long error = 0;
     if (pal_cnt) {
@@ -169,6 +189,35 @@ static long _shim_do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms) {
         if (!fds_mapping[i].hdl)
             continue;
 
+        struct shim_handle* hdl = fds_mapping[i].hdl;
+        if (fds_mapping[i].poll_event) {
+            hdl->fs->fs_ops->poll_put(hdl, fds_mapping[i].poll_events);
+
+            /* the event only says that the handle may be ready, ask the handle itself */
+            if (polled && (ret_events[fds_mapping[i].idx] & (PAL_WAIT_READ | PAL_WAIT_ERROR))) {
+                int shim_events = 0;
+                if (fds_mapping[i].poll_events & PAL_WAIT_READ)
+                    shim_events |= FS_POLL_RD;
+                if (fds_mapping[i].poll_events & PAL_WAIT_WRITE)
+                    shim_events |= FS_POLL_WR;
+
+                off_t shim_revents = hdl->fs->fs_ops->poll(hdl, shim_events);
+
+                fds[i].revents = 0;
+                if (shim_revents < 0 || (shim_revents & FS_POLL_ER))
+                    fds[i].revents |= POLLERR | POLLHUP;
+                if (shim_revents > 0 && (shim_revents & FS_POLL_RD))
+                    fds[i].revents |= fds[i].events & (POLLIN | POLLRDNORM);
+                if (shim_revents > 0 && (shim_revents & FS_POLL_WR))
+                    fds[i].revents |= fds[i].events & (POLLOUT | POLLWRNORM);
+
+                if (fds[i].revents)
+                    nrevents++;
+            }
+            put_handle(hdl);
+            continue;
+        }
+
         /* update fds.revents, but only if something was actually polled */
         if (polled) {
             fds[i].revents = 0;
@@ -183,7 +232,7 @@ static long _shim_do_poll(struct pollfd* fds, nfds_t nfds, int timeout_ms) {
                 nrevents++;
         }
 
-        put_handle(fds_mapping[i].hdl);
+        put_handle(hdl);
     }
 
     free(pals);
@@ -264,17 +313,17 @@ long shim_do_select(int nfds, fd_set* readfds, fd_set* writefds, fd_set* errorfd
     /* select()/pselect() return -EBADF if invalid FD was given by user in readfds/writefds;
      * note that poll()/ppoll() don't have this error code, so we return this code only here */
     struct shim_handle_map* map = get_cur_thread()->handle_map;
-    lock(&map->lock);
     for (nfds_t i = 0; i < nfds_poll; i++) {
-        struct shim_handle* hdl = __get_fd_handle(fds_poll[i].fd, NULL, map);
-        if (!hdl || !hdl->fs || !hdl->fs->fs_ops) {
+        struct shim_handle* hdl = get_fd_handle(fds_poll[i].fd, NULL, map);
+        bool valid = hdl && hdl->fs && hdl->fs->fs_ops;
+        if (hdl)
+            put_handle(hdl);
+        if (!valid) {
             /* the corresponding handle doesn't exist or doesn't provide FS-like semantics */
             free(fds_poll);
-            unlock(&map->lock);
             return -EBADF;
         }
     }
-    unlock(&map->lock);
 
     uint64_t timeout_ms = tsv ? tsv->tv_sec * 1000ULL + tsv->tv_usec / 1000 : POLL_NOTIMEOUT;
     long ret = _shim_do_poll(fds_poll, nfds_poll, timeout_ms);
@@ -23,6 +23,7 @@
 #include "shim_ipc.h"
 #include "shim_lock.h"
 #include "shim_process.h"
+#include "shim_syscall_trace.h"
 #include "shim_table.h"
 #include "shim_thread.h"
 #include "shim_utils.h"
@@ -216,6 +217,7 @@ long shim_do_rt_sigsuspend(const __sigset_t* mask_ptr, size_t setsize) {
     pal_context_set_retval(context, ret);
 
     debug_print_syscall_after(__NR_rt_sigsuspend, ret, ALL_SYSCALL_ARGS(context));
+    syscall_trace_after(__NR_rt_sigsuspend, ret, context);
 
     if (!handle_signal(context, &old)) {
         restart_syscall(context, __NR_rt_sigsuspend);
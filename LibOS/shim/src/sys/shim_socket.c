@@ -21,6 +21,7 @@
 #include "shim_fs.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
+#include "shim_local_pipe.h"
 #include "shim_lock.h"
 #include "shim_process.h"
 #include "shim_signal.h"
@@ -517,11 +518,12 @@ long shim_do_bind(int sockfd, struct sockaddr* addr, int _addrlen) {
     if (sock->domain == AF_UNIX) {
         struct shim_dentry* dent = sock->addr.un.dentry;
 
-        dent->state ^= DENTRY_NEGATIVE;
-        dent->state |= DENTRY_VALID;
         dent->fs   = &socket_builtin_fs;
         dent->type = S_IFSOCK;
         dent->perm = PERM_rw_______;
+        /* a single store for lockless lookups, see `dentry_update_state` */
+        __atomic_store_n(&dent->state, (dent->state ^ DENTRY_NEGATIVE) | DENTRY_VALID,
+                         __ATOMIC_RELEASE);
         dent->data = NULL;
     }
 
@@ -713,6 +715,7 @@ long shim_do_connect(int sockfd, struct sockaddr* addr, int _addrlen) {
             sock->sock_state = SOCK_CREATED;
             if (sock->sock_type == SOCK_STREAM && hdl->pal_handle) {
                 DkStreamDelete(hdl->pal_handle, 0); // TODO: handle errors
+                _remove_pal_handle_from_epolls(hdl);
                 DkObjectClose(hdl->pal_handle);
                 hdl->pal_handle = NULL;
                 pal_handle_updated = true;
@@ -761,6 +764,7 @@ long shim_do_connect(int sockfd, struct sockaddr* addr, int _addrlen) {
         /* if the socket is bound, the stream needs to be shut and rebound. */
         assert(hdl->pal_handle);
         DkStreamDelete(hdl->pal_handle, 0); // TODO: handle errors
+        _remove_pal_handle_from_epolls(hdl);
         DkObjectClose(hdl->pal_handle);
         hdl->pal_handle = NULL;
         pal_handle_updated = true;
@@ -793,11 +797,12 @@ long shim_do_connect(int sockfd, struct sockaddr* addr, int _addrlen) {
     if (sock->domain == AF_UNIX) {
         struct shim_dentry* dent = sock->addr.un.dentry;
         lock(&dent->lock);
-        dent->state ^= DENTRY_NEGATIVE;
-        dent->state |= DENTRY_VALID;
         dent->fs   = &socket_builtin_fs;
         dent->type = S_IFSOCK;
         dent->perm = PERM_rw_______;
+        /* a single store for lockless lookups, see `dentry_update_state` */
+        __atomic_store_n(&dent->state, (dent->state ^ DENTRY_NEGATIVE) | DENTRY_VALID,
+                         __ATOMIC_RELEASE);
         dent->data = NULL;
         unlock(&dent->lock);
     }
@@ -1019,6 +1024,17 @@ long shim_do_accept4(int fd, struct sockaddr* addr, int* addrlen, int flags) {
     return ret;
 }
 
+static void send_sigpipe(void) {
+    siginfo_t info = {
+        .si_signo = SIGPIPE,
+        .si_pid = g_process.pid,
+        .si_code = SI_USER,
+    };
+    if (kill_current_proc(&info) < 0) {
+        log_error("do_sendmsg: failed to deliver a signal");
+    }
+}
+
 static ssize_t do_sendmsg(int fd, struct iovec* bufs, int nbufs, int flags,
                           const struct sockaddr* addr, int addrlen) {
     struct shim_handle* hdl = get_fd_handle(fd, NULL, NULL);
@@ -1047,8 +1063,10 @@ static ssize_t do_sendmsg(int fd, struct iovec* bufs, int nbufs, int flags,
 
     lock(&hdl->lock);
 
+    /* local socketpairs support MSG_DONTWAIT */
+    bool nonblocking = (hdl->flags & O_NONBLOCK) || (flags & MSG_DONTWAIT);
     if (flags & MSG_DONTWAIT) {
-        if (!(hdl->flags & O_NONBLOCK)) {
+        if (!(hdl->flags & O_NONBLOCK) && !sock->local) {
             log_warning("MSG_DONTWAIT on blocking socket is ignored, may lead to a write that "
                         "unexpectedly blocks.");
         }
@@ -1119,25 +1137,43 @@ static ssize_t do_sendmsg(int fd, struct iovec* bufs, int nbufs, int flags,
         log_debug("next packet send to %s", uri);
     }
 
+    if (sock->local) {
+        ret = local_pipe_write(hdl, bufs, nbufs, nonblocking);
+        if (ret != -ELOCALPIPEPROMOTED) {
+            if (ret == -EPIPE && !(flags & MSG_NOSIGNAL))
+                send_sigpipe();
+            if (ret < 0) {
+                lock(&hdl->lock);
+                goto out_locked;
+            }
+            goto out;
+        }
+        pal_hdl = hdl->pal_handle;
+    }
+
     int bytes = 0;
     ret = 0;
 
-    for (int i = 0; i < nbufs; i++) {
-        size_t this_size = bufs[i].iov_len;
-        ret = DkStreamWrite(pal_hdl, 0, &this_size, bufs[i].iov_base, uri);
+    /* connected socket: send all buffers with a single PAL request (one host call) */
+    bool vectored = !uri && nbufs > 1 && nbufs <= PAL_IO_MAX_IOV;
+
+    for (int i = 0; i < (vectored ? 1 : nbufs); i++) {
+        size_t this_size;
+        size_t expected_size;
+        if (vectored) {
+            expected_size = iov_total_len(bufs, nbufs);
+            int64_t sent = pal_stream_iov_io(pal_hdl, PAL_IO_WRITE, /*offset=*/0, bufs, nbufs);
+            this_size = sent < 0 ? 0 : sent;
+            ret = sent < 0 ? sent : 0;
+        } else {
+            expected_size = this_size = bufs[i].iov_len;
+            ret = DkStreamWrite(pal_hdl, 0, &this_size, bufs[i].iov_base, uri);
+        }
         ret = ret == -PAL_ERROR_STREAMEXIST ? -ECONNABORTED : pal_to_unix_errno(ret);
-        maybe_epoll_et_trigger(hdl, ret, /*in=*/false, !ret ? this_size < bufs[i].iov_len : false);
+        maybe_epoll_et_trigger(hdl, ret, /*in=*/false, !ret ? this_size < expected_size : false);
         if (ret < 0) {
-            if (ret == -EPIPE && !(flags & MSG_NOSIGNAL)) {
-                siginfo_t info = {
-                    .si_signo = SIGPIPE,
-                    .si_pid = g_process.pid,
-                    .si_code = SI_USER,
-                };
-                if (kill_current_proc(&info) < 0) {
-                    log_error("do_sendmsg: failed to deliver a signal");
-                }
-            }
+            if (ret == -EPIPE && !(flags & MSG_NOSIGNAL))
+                send_sigpipe();
             break;
         }
 
@@ -1305,8 +1341,10 @@ static ssize_t do_recvmsg(int fd, struct iovec* bufs, size_t nbufs, int flags,
         flags &= ~MSG_WAITALL;
     }
 
+    /* local socketpairs support MSG_DONTWAIT */
+    bool nonblocking = (hdl->flags & O_NONBLOCK) || (flags & MSG_DONTWAIT);
     if (flags & MSG_DONTWAIT) {
-        if (!(hdl->flags & O_NONBLOCK)) {
+        if (!(hdl->flags & O_NONBLOCK) && !sock->local) {
             log_warning("MSG_DONTWAIT on blocking socket is ignored, may lead to a read that "
                         "unexpectedly blocks.");
         }
@@ -1341,6 +1379,24 @@ static ssize_t do_recvmsg(int fd, struct iovec* bufs, size_t nbufs, int flags,
 
     unlock(&hdl->lock);
 
+    if (sock->local) {
+        assert(!peek_buffer);
+        ret = local_pipe_read(hdl, bufs, nbufs, flags & MSG_PEEK, nonblocking);
+        if (ret != -ELOCALPIPEPROMOTED) {
+            if (ret < 0) {
+                lock(&hdl->lock);
+                goto out_locked;
+            }
+            if (addr) {
+                /* the peer of a socketpair is unnamed */
+                addr->sa_family = AF_UNIX;
+                *addrlen = sizeof(addr->sa_family);
+            }
+            goto out;
+        }
+        pal_hdl = hdl->pal_handle;
+    }
+
     if (flags & MSG_PEEK) {
         if (!peek_buffer) {
             /* create new peek buffer with expected read size */
@@ -1393,6 +1449,7 @@ static ssize_t do_recvmsg(int fd, struct iovec* bufs, size_t nbufs, int flags,
 
     bool address_received = false;
     size_t total_bytes    = 0;
+    bool vectored = !peek_buffer && !uri && nbufs > 1 && nbufs <= PAL_IO_MAX_IOV;
 
     for (size_t i = 0; i < nbufs; i++) {
         size_t iov_bytes = 0;
@@ -1403,6 +1460,17 @@ static ssize_t do_recvmsg(int fd, struct iovec* bufs, size_t nbufs, int flags,
             memcpy(bufs[i].iov_base, &peek_buffer->buf[peek_buffer->start + total_bytes],
                    iov_bytes);
             uri = peek_buffer->uri;
+        } else if (vectored) {
+            /* connected socket: receive into all buffers with a single PAL request */
+            int64_t received = pal_stream_iov_io(pal_hdl, PAL_IO_READ, /*offset=*/0, bufs, nbufs);
+            ret = received < 0 ? received : 0;
+            ret = ret == -PAL_ERROR_STREAMNOTEXIST ? -ECONNABORTED : pal_to_unix_errno(ret);
+            maybe_epoll_et_trigger(hdl, ret, /*in=*/true,
+                                   ret == 0 ? (size_t)received < expected_size : false);
+            if (ret < 0) {
+                break;
+            }
+            iov_bytes = received;
         } else {
             size_t read_size = bufs[i].iov_len;
             ret = DkStreamRead(pal_hdl, 0, &read_size, bufs[i].iov_base, uri,
@@ -1451,6 +1519,10 @@ static ssize_t do_recvmsg(int fd, struct iovec* bufs, size_t nbufs, int flags,
             address_received = true;
         }
 
+        /* the whole iovec was read at once */
+        if (vectored)
+            break;
+
         /* gap in iovecs is not allowed, return a partial read to user; it is the responsibility of
          * user application to deal with partial reads */
         if (iov_bytes < bufs[i].iov_len)
@@ -1612,6 +1684,21 @@ long shim_do_shutdown(int sockfd, int how) {
         goto out_locked;
     }
 
+    if (sock->local && (how == SHUT_RD || how == SHUT_WR || how == SHUT_RDWR)) {
+        ret = local_pipe_shutdown(hdl, /*shut_rd=*/how != SHUT_WR, /*shut_wr=*/how != SHUT_RD);
+        if (ret != -ELOCALPIPEPROMOTED) {
+            if (ret < 0)
+                goto out_locked;
+            if (how == SHUT_RDWR) {
+                hdl->acc_mode    = 0;
+                sock->sock_state = SOCK_SHUTDOWN;
+            } else {
+                hdl->acc_mode &= how == SHUT_RD ? ~MAY_READ : ~MAY_WRITE;
+            }
+            goto out_locked;
+        }
+    }
+
     switch (how) {
         case SHUT_RD:
             ret = DkStreamDelete(hdl->pal_handle, PAL_DELETE_RD);
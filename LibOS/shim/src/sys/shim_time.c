@@ -2,17 +2,93 @@
 /* Copyright (C) 2014 Stony Brook University */
 
 /*
- * Implementation of system calls "gettimeofday", "time" and "clock_gettime".
+ * Implementation of system calls "gettimeofday", "time" and "clock_gettime", and of the time page
+ * used by their vDSO versions.
  */
 
 #include <errno.h>
 
 #include "pal.h"
 #include "pal_error.h"
+#include "shim_checkpoint.h"
 #include "shim_fs.h"
 #include "shim_handle.h"
 #include "shim_internal.h"
 #include "shim_table.h"
+#include "shim_thread.h"
+#include "shim_vdso.h"
+#include "spinlock.h"
+
+static struct vdso_time_page* g_vdso_time_page __attribute_migratable = NULL;
+/* serializes updates of the time page */
+static spinlock_t g_vdso_time_lock = INIT_SPINLOCK_UNLOCKED;
+
+static void publish_vdso_time_calibration(struct vdso_time_page* page,
+                                          const PAL_TIME_CALIBRATION* calib) {
+    /* the page is read-only, so that the application cannot corrupt it; only LibOS makes it
+     * writable for the (rare) updates */
+    void* page_start = ALLOC_ALIGN_DOWN_PTR(page);
+    spinlock_lock(&g_vdso_time_lock);
+    if (calib->base_tsc > page->base_tsc
+            && DkVirtualMemoryProtect(page_start, ALLOC_ALIGNMENT,
+                                      PAL_PROT_READ | PAL_PROT_WRITE) == 0) {
+        uint64_t tsc_hz    = calib->tsc_hz;
+        uint64_t base_usec = calib->base_usec;
+        if (page->tsc_hz) {
+            /* latest time the vDSO could have computed from the old parameters before `base_tsc` */
+            uint64_t old_delta_tsc = MIN(calib->base_tsc - page->base_tsc, page->max_delta_tsc);
+            uint64_t old_usec = page->base_usec + old_delta_tsc * 1000000 / page->tsc_hz;
+
+            /* The extrapolation ran ahead of the PAL clock. Instead of jumping back, continue from
+             * `old_usec` at a slower rate, so that the published time meets the PAL clock at the
+             * end of the new calibration period. Large differences (e.g. the host clock was set
+             * back) are not smoothed out. */
+            uint64_t period_usec = calib->max_delta_tsc * 1000000 / calib->tsc_hz;
+            if (old_usec > base_usec && old_usec - base_usec < period_usec / 2) {
+                tsc_hz = calib->tsc_hz * period_usec / (period_usec - (old_usec - base_usec));
+                base_usec = old_usec;
+            }
+        }
+
+        __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+        WMB();
+        __atomic_store_n(&page->tsc_hz, tsc_hz, __ATOMIC_RELAXED);
+        __atomic_store_n(&page->base_tsc, calib->base_tsc, __ATOMIC_RELAXED);
+        __atomic_store_n(&page->base_usec, base_usec, __ATOMIC_RELAXED);
+        __atomic_store_n(&page->max_delta_tsc, calib->max_delta_tsc, __ATOMIC_RELAXED);
+        WMB();
+        __atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+
+        if (DkVirtualMemoryProtect(page_start, ALLOC_ALIGNMENT, PAL_PROT_READ) < 0)
+            log_warning("cannot make the vDSO time page read-only again");
+    }
+    spinlock_unlock(&g_vdso_time_lock);
+}
+
+void init_vdso_time_page(struct vdso_time_page* page) {
+    __atomic_store_n(&g_vdso_time_page, page, __ATOMIC_RELEASE);
+    uint64_t usec = 0;
+    update_vdso_time_page(&usec);
+}
+
+void update_vdso_time_page(uint64_t* usec) {
+    struct vdso_time_page* page = __atomic_load_n(&g_vdso_time_page, __ATOMIC_ACQUIRE);
+    if (!page)
+        return;
+
+    PAL_TIME_CALIBRATION calib;
+    if (DkSystemTimeCalibration(&calib) < 0) {
+        /* the page stays zeroed, the vDSO always uses syscalls */
+        return;
+    }
+
+    if (calib.base_tsc > __atomic_load_n(&page->base_tsc, __ATOMIC_RELAXED))
+        publish_vdso_time_calibration(page, &calib);
+
+    uint64_t vdso_usec;
+    if (read_vdso_time_page(page, &vdso_usec) && vdso_usec > *usec)
+        *usec = vdso_usec;
+}
 
 long shim_do_gettimeofday(struct __kernel_timeval* tv, struct __kernel_timezone* tz) {
     if (!tv)
@@ -29,6 +105,7 @@ long shim_do_gettimeofday(struct __kernel_timeval* tv, struct __kernel_timezone*
     if (ret < 0) {
         return pal_to_unix_errno(ret);
     }
+    update_vdso_time_page(&time);
 
     tv->tv_sec  = time / 1000000;
     tv->tv_usec = time % 1000000;
@@ -44,6 +121,7 @@ long shim_do_time(time_t* tloc) {
     if (ret < 0) {
         return pal_to_unix_errno(ret);
     }
+    update_vdso_time_page(&time);
 
     time_t t = time / 1000000;
 
@@ -69,6 +147,7 @@ long shim_do_clock_gettime(clockid_t which_clock, struct timespec* tp) {
     if (ret < 0) {
         return pal_to_unix_errno(ret);
     }
+    update_vdso_time_page(&time);
 
     tp->tv_sec  = time / 1000000;
     tp->tv_nsec = (time % 1000000) * 1000;
@@ -15,6 +15,18 @@
 #include "shim_table.h"
 #include "shim_utils.h"
 
+/* Whether the whole `vec` can be passed to a readv/writev fs op at once: NULL buffers are skipped
+ * by the per-buffer fallback, and PAL limits the number of buffers in a single request. */
+static bool iov_vectorizable(const struct iovec* vec, unsigned long vlen) {
+    if (vlen < 2 || vlen > PAL_IO_MAX_IOV)
+        return false;
+
+    for (size_t i = 0; i < vlen; i++)
+        if (!vec[i].iov_base)
+            return false;
+    return true;
+}
+
 long shim_do_readv(unsigned long fd, const struct iovec* vec, unsigned long vlen) {
     if (!is_user_memory_readable(vec, sizeof(*vec) * vlen))
         return -EINVAL;
@@ -39,6 +51,11 @@ long shim_do_readv(unsigned long fd, const struct iovec* vec, unsigned long vlen
         goto out;
     }
 
+    if (hdl->fs->fs_ops->readv && iov_vectorizable(vec, vlen)) {
+        ret = hdl->fs->fs_ops->readv(hdl, vec, vlen);
+        goto out;
+    }
+
     ssize_t bytes = 0;
 
     for (size_t i = 0; i < vlen; i++) {
@@ -102,6 +119,11 @@ long shim_do_writev(unsigned long fd, const struct iovec* vec, unsigned long vle
         goto out;
     }
 
+    if (hdl->fs->fs_ops->writev && iov_vectorizable(vec, vlen)) {
+        ret = hdl->fs->fs_ops->writev(hdl, vec, vlen);
+        goto out;
+    }
+
     ssize_t bytes = 0;
 
     for (size_t i = 0; i < vlen; i++) {
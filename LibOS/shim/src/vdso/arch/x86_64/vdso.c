@@ -7,7 +7,9 @@
  */
 
 #include <asm/unistd.h>
+#include <linux/time.h>
 
+#include "shim_vdso.h"
 #include "vdso.h"
 #include "vdso_syscall.h"
 
@@ -20,17 +22,56 @@
 #define EXPORT_WEAK_SYMBOL(name) \
     __typeof__(__vdso_##name) name __attribute__((weak, alias("__vdso_" #name)))
 
+/* Placed by the linker script right before the vDSO image; hidden, so that it is accessed
+ * RIP-relative, without relocations. */
+extern const struct vdso_time_page vdso_time_page __attribute__((visibility("hidden")));
+
+/* Returns false if the time page cannot be used, in which case the caller falls back to the syscall
+ * (which also makes LibOS refresh the page). */
+static bool get_time_usec(uint64_t* out_usec) {
+    return read_vdso_time_page(&vdso_time_page, out_usec);
+}
+
 int __vdso_clock_gettime(clockid_t clock, struct timespec* t) {
+    /* LibOS implements all clocks in the same way, so the fast path is taken for the commonly used
+     * ones */
+    uint64_t usec;
+    switch (clock) {
+        case CLOCK_REALTIME:
+        case CLOCK_MONOTONIC:
+        case CLOCK_REALTIME_COARSE:
+        case CLOCK_MONOTONIC_COARSE:
+            if (t && get_time_usec(&usec)) {
+                t->tv_sec  = usec / 1000000;
+                t->tv_nsec = (usec % 1000000) * 1000;
+                return 0;
+            }
+            break;
+    }
     return vdso_arch_syscall(__NR_clock_gettime, (long)clock, (long)t);
 }
 EXPORT_WEAK_SYMBOL(clock_gettime);
 
 int __vdso_gettimeofday(struct timeval* tv, struct timezone* tz) {
+    uint64_t usec;
+    if (tv && get_time_usec(&usec)) {
+        /* `tz` is not filled by the syscall either */
+        tv->tv_sec  = usec / 1000000;
+        tv->tv_usec = usec % 1000000;
+        return 0;
+    }
     return vdso_arch_syscall(__NR_gettimeofday, (long)tv, (long)tz);
 }
 EXPORT_WEAK_SYMBOL(gettimeofday);
 
 time_t __vdso_time(time_t* t) {
+    uint64_t usec;
+    if (get_time_usec(&usec)) {
+        time_t sec = usec / 1000000;
+        if (t)
+            *t = sec;
+        return sec;
+    }
     return vdso_arch_syscall(__NR_time, (long)t, 0);
 }
 EXPORT_WEAK_SYMBOL(time);
@@ -89,6 +89,21 @@ void sendfile_fd(const char* input_path, const char* output_path, int fi, int fo
     }
 }
 
+void copy_file_range_fd(const char* input_path, const char* output_path, int fi, int fo,
+                        size_t size) {
+    loff_t in_offset = 0;
+    loff_t out_offset = 0;
+    while (size > 0) {
+        ssize_t ret = copy_file_range(fi, &in_offset, fo, &out_offset, size, /*flags=*/0);
+        if (ret < 0)
+            fatal_error("Failed to copy_file_range from %s to %s: %s\n", input_path, output_path,
+                        strerror(errno));
+        if (ret == 0)
+            fatal_error("Unexpected end of file %s\n", input_path);
+        size -= ret;
+    }
+}
+
 void close_fd(const char* path, int fd) {
     if (fd >= 0 && close(fd) != 0)
         fatal_error("Failed to close file %s: %s\n", path, strerror(errno));
@@ -263,6 +263,8 @@ class TC_00_FileSystem(RegressionTestCase):
                 self.assertIn('write_fd(' + size + ') output OK', stdout)
             if executable == 'copy_sendfile':
                 self.assertIn('sendfile_fd(' + size + ') OK', stdout)
+            if executable == 'copy_file_range':
+                self.assertIn('copy_file_range_fd(' + size + ') OK', stdout)
             if size != '0':
                 if 'copy_mmap' in executable:
                     self.assertIn('mmap_fd(' + size + ') input OK', stdout)
@@ -295,6 +297,9 @@ class TC_00_FileSystem(RegressionTestCase):
     def test_203_copy_dir_sendfile(self):
         self.do_copy_test('copy_sendfile', 60)
 
+    def test_207_copy_dir_file_range(self):
+        self.do_copy_test('copy_file_range', 60)
+
     @expectedFailureIf(HAS_SGX)
     def test_204_copy_dir_mmap_whole(self):
         self.do_copy_test('copy_mmap_whole', 30)
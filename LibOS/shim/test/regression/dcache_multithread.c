@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Path lookups in a large directory from multiple threads: every thread repeatedly stat()s and
+ * access()es all files in the directory (mostly served by lockless dcache lookups), while the main
+ * thread keeps unlinking and re-creating half of the files. Files that are never touched must
+ * always be found; the other ones must be either found or reported as missing (ENOENT). Prints
+ * lookup throughput for 1, 2, 4 and 8 threads.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 8
+#define FILES_NO    2000
+#define ROUNDS      20
+
+static const char* g_dir;
+static atomic_bool g_stop_churn;
+
+static void file_path(char* buf, size_t size, unsigned int i) {
+    snprintf(buf, size, "%s/file_%04u", g_dir, i);
+}
+
+static void create_file(unsigned int i) {
+    char path[256];
+    file_path(path, sizeof(path), i);
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    if (fd < 0)
+        err(1, "open %s", path);
+    if (close(fd) < 0)
+        err(1, "close");
+}
+
+static void* lookup_thread(void* arg) {
+    (void)arg;
+    char path[256];
+    struct stat st;
+
+    for (unsigned int round = 0; round < ROUNDS; round++) {
+        for (unsigned int i = 0; i < FILES_NO; i++) {
+            file_path(path, sizeof(path), i);
+            bool stable = i % 2 == 0;
+
+            if (stat(path, &st) < 0) {
+                if (stable || errno != ENOENT)
+                    err(1, "stat %s", path);
+            } else if (!S_ISREG(st.st_mode)) {
+                errx(1, "%s is not a regular file", path);
+            }
+
+            if (access(path, R_OK) < 0 && (stable || errno != ENOENT))
+                err(1, "access %s", path);
+        }
+    }
+    return NULL;
+}
+
+static void* churn_thread(void* arg) {
+    (void)arg;
+    char path[256];
+
+    while (!atomic_load(&g_stop_churn)) {
+        for (unsigned int i = 1; i < FILES_NO; i += 2) {
+            file_path(path, sizeof(path), i);
+            if (unlink(path) < 0)
+                err(1, "unlink %s", path);
+            create_file(i);
+        }
+    }
+    return NULL;
+}
+
+static uint64_t time_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        err(1, "clock_gettime");
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+    setbuf(stdout, NULL);
+
+    if (argc != 2)
+        errx(1, "Usage: %s tmp_folder_name", argv[0]);
+    g_dir = argv[1];
+
+    if (mkdir(g_dir, 0755) < 0 && errno != EEXIST)
+        err(1, "mkdir");
+    for (unsigned int i = 0; i < FILES_NO; i++)
+        create_file(i);
+
+    pthread_t churn;
+    if (pthread_create(&churn, NULL, churn_thread, NULL) != 0)
+        errx(1, "pthread_create");
+
+    for (unsigned int nthreads = 1; nthreads <= MAX_THREADS; nthreads *= 2) {
+        pthread_t threads[MAX_THREADS];
+
+        uint64_t start = time_ns();
+        for (unsigned int i = 0; i < nthreads; i++)
+            if (pthread_create(&threads[i], NULL, lookup_thread, NULL) != 0)
+                errx(1, "pthread_create");
+        for (unsigned int i = 0; i < nthreads; i++)
+            if (pthread_join(threads[i], NULL) != 0)
+                errx(1, "pthread_join");
+        uint64_t end = time_ns();
+
+        uint64_t lookups = 2UL * nthreads * ROUNDS * FILES_NO;
+        printf("%u threads: %lu lookups/s\n", nthreads,
+               lookups * 1000000000UL / (end - start ?: 1));
+    }
+
+    atomic_store(&g_stop_churn, true);
+    if (pthread_join(churn, NULL) != 0)
+        errx(1, "pthread_join");
+
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,95 @@
+/* Registers more than 1024 FDs (dups of a single readable pipe) in one epoll instance and checks
+ * that `epoll_wait` with a small `maxevents` reports all of them in a round-robin fashion. */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define FDS_COUNT  2000
+#define MAX_EVENTS 100
+
+static int g_fds[FDS_COUNT];
+static bool g_seen[FDS_COUNT];
+
+int main(void) {
+    struct rlimit rlim = { .rlim_cur = FDS_COUNT + 100, .rlim_max = FDS_COUNT + 100 };
+    if (setrlimit(RLIMIT_NOFILE, &rlim) < 0)
+        err(1, "setrlimit");
+
+    int p[2];
+    if (pipe2(p, O_NONBLOCK) < 0)
+        err(1, "pipe2");
+    if (write(p[1], "a", 1) != 1)
+        err(1, "write");
+
+    int efd = epoll_create1(EPOLL_CLOEXEC);
+    if (efd < 0)
+        err(1, "epoll_create1");
+
+    for (int i = 0; i < FDS_COUNT; i++) {
+        g_fds[i] = dup(p[0]);
+        if (g_fds[i] < 0)
+            err(1, "dup");
+
+        struct epoll_event event = { .events = EPOLLIN, .data.u32 = i };
+        if (epoll_ctl(efd, EPOLL_CTL_ADD, g_fds[i], &event) < 0)
+            err(1, "EPOLL_CTL_ADD %d", i);
+    }
+
+    struct epoll_event event = { .events = EPOLLIN };
+    if (epoll_ctl(efd, EPOLL_CTL_ADD, g_fds[0], &event) != -1 || errno != EEXIST)
+        errx(1, "adding a registered FD did not fail with EEXIST");
+
+    /* all FDs are readable, level-triggered events of each are reported in turn */
+    size_t seen_count = 0;
+    for (int round = 0; round < 2 * FDS_COUNT / MAX_EVENTS && seen_count < FDS_COUNT; round++) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(efd, events, MAX_EVENTS, 1000);
+        if (n != MAX_EVENTS)
+            errx(1, "epoll_wait returned %d (expected %d)", n, MAX_EVENTS);
+
+        for (int i = 0; i < n; i++) {
+            unsigned int idx = events[i].data.u32;
+            if (idx >= FDS_COUNT || events[i].events != EPOLLIN)
+                errx(1, "unexpected event 0x%x for %u", events[i].events, idx);
+            if (!g_seen[idx]) {
+                g_seen[idx] = true;
+                seen_count++;
+            }
+        }
+    }
+    if (seen_count != FDS_COUNT)
+        errx(1, "only %zu FDs were reported", seen_count);
+
+    /* remove every other FD, the rest must still be reported */
+    for (int i = 0; i < FDS_COUNT; i += 2) {
+        if (epoll_ctl(efd, EPOLL_CTL_DEL, g_fds[i], NULL) < 0)
+            err(1, "EPOLL_CTL_DEL %d", i);
+    }
+    if (epoll_ctl(efd, EPOLL_CTL_DEL, g_fds[0], NULL) != -1 || errno != ENOENT)
+        errx(1, "removing an unregistered FD did not fail with ENOENT");
+
+    struct epoll_event events[MAX_EVENTS];
+    int n = epoll_wait(efd, events, MAX_EVENTS, 1000);
+    if (n != MAX_EVENTS)
+        errx(1, "epoll_wait returned %d (expected %d)", n, MAX_EVENTS);
+    for (int i = 0; i < n; i++) {
+        if (events[i].data.u32 % 2 == 0)
+            errx(1, "removed FD %u was reported", events[i].data.u32);
+    }
+
+    for (int i = 0; i < FDS_COUNT; i++)
+        close(g_fds[i]);
+    close(efd);
+    close(p[0]);
+    close(p[1]);
+
+    puts("TEST OK");
+    return 0;
+}
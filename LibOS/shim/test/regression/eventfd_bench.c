@@ -0,0 +1,137 @@
+/* Measures wake-up latency of eventfds: ping-pong between two threads through two eventfds, with
+ * blocking reads and with epoll, plus the cost of a write/read pair without any waiting. */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PING_PONG_ITERS 20000
+#define WRITE_READ_ITERS 200000
+
+struct channel {
+    int ping; /* written by the main thread, read by the echo thread */
+    int pong; /* written by the echo thread, read by the main thread */
+    bool use_epoll;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        err(1, "clock_gettime");
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void signal_efd(int efd) {
+    uint64_t value = 1;
+    while (write(efd, &value, sizeof(value)) != sizeof(value))
+        if (errno != EINTR)
+            err(1, "eventfd write");
+}
+
+static void wait_efd(int efd, int epfd) {
+    while (true) {
+        if (epfd >= 0) {
+            struct epoll_event event;
+            int ret = epoll_wait(epfd, &event, 1, -1);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret != 1)
+                err(1, "epoll_wait");
+        }
+
+        uint64_t value;
+        ssize_t ret = read(efd, &value, sizeof(value));
+        if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (ret != sizeof(value))
+            err(1, "eventfd read");
+        if (value != 1)
+            errx(1, "eventfd read returned %lu instead of 1", value);
+        return;
+    }
+}
+
+static int create_epoll(int fd) {
+    int epfd = epoll_create1(0);
+    if (epfd < 0)
+        err(1, "epoll_create1");
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+        err(1, "epoll_ctl");
+    return epfd;
+}
+
+static void* echo_thread(void* arg) {
+    struct channel* ch = arg;
+    int epfd = ch->use_epoll ? create_epoll(ch->ping) : -1;
+
+    for (int i = 0; i < PING_PONG_ITERS; i++) {
+        wait_efd(ch->ping, epfd);
+        signal_efd(ch->pong);
+    }
+
+    if (epfd >= 0)
+        close(epfd);
+    return NULL;
+}
+
+/* Returns the average round-trip time in nanoseconds. */
+static double ping_pong(struct channel* ch) {
+    int epfd = ch->use_epoll ? create_epoll(ch->pong) : -1;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, echo_thread, ch))
+        errx(1, "pthread_create failed");
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < PING_PONG_ITERS; i++) {
+        signal_efd(ch->ping);
+        wait_efd(ch->pong, epfd);
+    }
+    uint64_t end = now_ns();
+
+    if (pthread_join(thread, NULL))
+        errx(1, "pthread_join failed");
+    if (epfd >= 0)
+        close(epfd);
+    return (double)(end - start) / PING_PONG_ITERS;
+}
+
+/* Returns the average time of a write followed by a read in nanoseconds. */
+static double write_read(int efd) {
+    uint64_t start = now_ns();
+    for (int i = 0; i < WRITE_READ_ITERS; i++) {
+        signal_efd(efd);
+        wait_efd(efd, -1);
+    }
+    uint64_t end = now_ns();
+    return (double)(end - start) / WRITE_READ_ITERS;
+}
+
+int main(void) {
+    struct channel ch = {
+        .ping = eventfd(0, 0),
+        .pong = eventfd(0, 0),
+    };
+    if (ch.ping < 0 || ch.pong < 0)
+        err(1, "eventfd");
+
+    printf("write+read:            %8.0f ns\n", write_read(ch.ping));
+    printf("ping-pong:             %8.0f ns/round-trip\n", ping_pong(&ch));
+    ch.use_epoll = true;
+    printf("ping-pong (epoll):     %8.0f ns/round-trip\n", ping_pong(&ch));
+
+    close(ch.ping);
+    close(ch.pong);
+
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,129 @@
+/* Measures throughput of futex operations by number of threads: uncontended (each thread uses its
+ * own futex word, so only the futex table is shared) and contended (all threads use one
+ * futex-based mutex). */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS        16
+#define UNCONTENDED_ITERS  100000
+#define CONTENDED_ITERS    20000
+
+static int futex(uint32_t* uaddr, int futex_op, uint32_t val) {
+    return syscall(SYS_futex, uaddr, futex_op | FUTEX_PRIVATE_FLAG, val, NULL, NULL, 0);
+}
+
+/* futex words of different threads are on separate cache lines */
+static struct {
+    uint32_t word;
+} __attribute__((aligned(64))) g_words[MAX_THREADS];
+
+static uint32_t g_mutex;
+static uint64_t g_counter;
+static pthread_barrier_t g_barrier;
+
+/* mutex from "Futexes Are Tricky" by Ulrich Drepper: 0 - unlocked, 1 - locked, 2 - contended */
+static void mutex_lock(uint32_t* m) {
+    uint32_t c = 0;
+    if (__atomic_compare_exchange_n(m, &c, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return;
+    if (c != 2)
+        c = __atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE);
+    while (c != 0) {
+        futex(m, FUTEX_WAIT, 2);
+        c = __atomic_exchange_n(m, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+static void mutex_unlock(uint32_t* m) {
+    if (__atomic_fetch_sub(m, 1, __ATOMIC_RELEASE) != 1) {
+        __atomic_store_n(m, 0, __ATOMIC_RELEASE);
+        futex(m, FUTEX_WAKE, 1);
+    }
+}
+
+static void* uncontended_thread(void* arg) {
+    uint32_t* word = &g_words[(uintptr_t)arg].word;
+
+    pthread_barrier_wait(&g_barrier);
+    for (int i = 0; i < UNCONTENDED_ITERS; i++) {
+        /* value mismatch: returns EAGAIN right after the check */
+        if (futex(word, FUTEX_WAIT, 1) != -1 || errno != EAGAIN)
+            errx(1, "FUTEX_WAIT did not fail with EAGAIN");
+        if (futex(word, FUTEX_WAKE, 1) != 0)
+            errx(1, "FUTEX_WAKE woke a thread");
+    }
+    return NULL;
+}
+
+static void* contended_thread(void* arg) {
+    (void)arg;
+    pthread_barrier_wait(&g_barrier);
+    for (int i = 0; i < CONTENDED_ITERS; i++) {
+        mutex_lock(&g_mutex);
+        g_counter++;
+        mutex_unlock(&g_mutex);
+    }
+    return NULL;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        err(1, "clock_gettime");
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* Returns operations per second. */
+static double run(void* (*func)(void*), size_t threads_cnt, uint64_t ops) {
+    pthread_t threads[MAX_THREADS];
+
+    if (pthread_barrier_init(&g_barrier, NULL, threads_cnt + 1))
+        errx(1, "pthread_barrier_init failed");
+    for (size_t i = 0; i < threads_cnt; i++)
+        if (pthread_create(&threads[i], NULL, func, (void*)i))
+            errx(1, "pthread_create failed");
+
+    uint64_t start = now_ns();
+    pthread_barrier_wait(&g_barrier);
+    for (size_t i = 0; i < threads_cnt; i++)
+        if (pthread_join(threads[i], NULL))
+            errx(1, "pthread_join failed");
+    uint64_t end = now_ns();
+
+    pthread_barrier_destroy(&g_barrier);
+    return ops * 1e9 / (end - start + 1);
+}
+
+int main(int argc, char** argv) {
+    size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10) : 8;
+    if (max_threads < 1 || max_threads > MAX_THREADS)
+        errx(1, "number of threads must be between 1 and %d", MAX_THREADS);
+
+    for (size_t threads_cnt = 1; threads_cnt <= max_threads; threads_cnt *= 2) {
+        double uncontended = run(uncontended_thread, threads_cnt,
+                                 2ULL * UNCONTENDED_ITERS * threads_cnt);
+
+        g_counter = 0;
+        double contended = run(contended_thread, threads_cnt,
+                               (uint64_t)CONTENDED_ITERS * threads_cnt);
+        if (g_counter != (uint64_t)CONTENDED_ITERS * threads_cnt)
+            errx(1, "mutex is broken: counter is %lu", g_counter);
+
+        printf("threads: %2zu  uncontended: %10.0f ops/s  contended: %10.0f lock/unlock/s\n",
+               threads_cnt, uncontended, contended);
+    }
+
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,114 @@
+/* Measures the latency of IPC round trips between Graphene processes: the parent holds a POSIX lock,
+ * and a child queries it with `fcntl(F_GETLK)`, which the child (not being the IPC leader) forwards
+ * to the parent. Queries are issued from one thread (round-trip latency) and then from several
+ * threads at once (throughput; the messages of concurrent queries are handled in batches). Run with
+ * `ipc_bench_shm.manifest` to use the shared-memory transport. */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_FILE "tmp/ipc_bench_file"
+
+#define ROUND_TRIP_ITERS 5000
+#define THREADS 4
+#define THREAD_ITERS 2000
+
+static int g_fd;
+static pid_t g_parent_pid;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        err(1, "clock_gettime");
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void query_lock(void) {
+    struct flock fl = {
+        .l_type = F_WRLCK,
+        .l_whence = SEEK_SET,
+        .l_start = 0,
+        .l_len = 1,
+    };
+    if (fcntl(g_fd, F_GETLK, &fl) < 0)
+        err(1, "fcntl(F_GETLK)");
+    if (fl.l_type != F_WRLCK || fl.l_pid != g_parent_pid)
+        errx(1, "F_GETLK did not report the lock of the parent (type %d, pid %d)", fl.l_type,
+             fl.l_pid);
+}
+
+static void* query_thread(void* arg) {
+    (void)arg;
+    for (int i = 0; i < THREAD_ITERS; i++)
+        query_lock();
+    return NULL;
+}
+
+static void child(void) {
+    for (int i = 0; i < 100; i++)
+        query_lock();
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < ROUND_TRIP_ITERS; i++)
+        query_lock();
+    uint64_t end = now_ns();
+    printf("round trip: %.1f us\n", (double)(end - start) / ROUND_TRIP_ITERS / 1000);
+
+    pthread_t threads[THREADS];
+    start = now_ns();
+    for (int i = 0; i < THREADS; i++)
+        if (pthread_create(&threads[i], NULL, query_thread, NULL))
+            errx(1, "pthread_create failed");
+    for (int i = 0; i < THREADS; i++)
+        if (pthread_join(threads[i], NULL))
+            errx(1, "pthread_join failed");
+    end = now_ns();
+    printf("%d threads: %.0f round trips/s\n", THREADS,
+           (double)THREADS * THREAD_ITERS * 1000000000 / (end - start));
+}
+
+int main(void) {
+    setbuf(stdout, NULL);
+    g_parent_pid = getpid();
+
+    g_fd = open(TEST_FILE, O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (g_fd < 0)
+        err(1, "open");
+
+    struct flock fl = {
+        .l_type = F_WRLCK,
+        .l_whence = SEEK_SET,
+        .l_start = 0,
+        .l_len = 1,
+    };
+    if (fcntl(g_fd, F_SETLK, &fl) < 0)
+        err(1, "fcntl(F_SETLK)");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        err(1, "fork");
+    if (pid == 0) {
+        child();
+        return 0;
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        err(1, "waitpid");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        errx(1, "child failed (status: %d)", status);
+
+    close(g_fd);
+    if (unlink(TEST_FILE) < 0)
+        err(1, "unlink");
+
+    puts("TEST OK");
+    return 0;
+}
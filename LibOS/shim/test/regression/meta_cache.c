@@ -0,0 +1,98 @@
+/* Checks that the metadata cache of a chroot mount (see `meta_cache.manifest.template`) sees all
+ * changes made through the mount. */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TEST_DIR "/cached/meta_cache_test"
+
+static bool exists(const char* path) {
+    struct stat st;
+    if (stat(path, &st) == 0)
+        return true;
+    if (errno != ENOENT)
+        err(1, "stat %s", path);
+    return false;
+}
+
+static void expect(const char* path, bool expected) {
+    /* ask twice, the second answer may come from the cache */
+    for (int i = 0; i < 2; i++) {
+        if (exists(path) != expected)
+            errx(1, "%s: expected %s", path, expected ? "to exist" : "not to exist");
+    }
+}
+
+static bool listed(const char* dir_path, const char* name) {
+    DIR* dir = opendir(dir_path);
+    if (!dir)
+        err(1, "opendir %s", dir_path);
+
+    bool found = false;
+    struct dirent* dent;
+    while ((dent = readdir(dir))) {
+        if (!strcmp(dent->d_name, name))
+            found = true;
+    }
+    closedir(dir);
+    return found;
+}
+
+static void create_file(const char* path) {
+    int fd = open(path, O_CREAT | O_EXCL | O_WRONLY, 0600);
+    if (fd < 0)
+        err(1, "open %s", path);
+    if (close(fd) < 0)
+        err(1, "close %s", path);
+}
+
+int main(void) {
+    if (mkdir(TEST_DIR, 0700) < 0 && errno != EEXIST)
+        err(1, "mkdir %s", TEST_DIR);
+
+    /* the listing of an empty directory answers negative lookups */
+    expect(TEST_DIR "/a", false);
+    if (listed(TEST_DIR, "a"))
+        errx(1, "unexpected entry in " TEST_DIR);
+
+    create_file(TEST_DIR "/a");
+    expect(TEST_DIR "/a", true);
+    if (!listed(TEST_DIR, "a"))
+        errx(1, "created file not listed");
+
+    if (rename(TEST_DIR "/a", TEST_DIR "/b") < 0)
+        err(1, "rename");
+    expect(TEST_DIR "/a", false);
+    expect(TEST_DIR "/b", true);
+
+    if (unlink(TEST_DIR "/b") < 0)
+        err(1, "unlink");
+    expect(TEST_DIR "/b", false);
+
+    /* renaming a directory changes paths of its children */
+    if (mkdir(TEST_DIR "/d", 0700) < 0)
+        err(1, "mkdir");
+    expect(TEST_DIR "/d/x", false);
+    create_file(TEST_DIR "/d/x");
+    expect(TEST_DIR "/d/x", true);
+
+    if (rename(TEST_DIR "/d", TEST_DIR "/e") < 0)
+        err(1, "rename directory");
+    expect(TEST_DIR "/d/x", false);
+    expect(TEST_DIR "/e/x", true);
+
+    if (unlink(TEST_DIR "/e/x") < 0 || rmdir(TEST_DIR "/e") < 0 || rmdir(TEST_DIR) < 0)
+        err(1, "cleanup");
+    expect(TEST_DIR, false);
+
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,178 @@
+/* Checks that files on a chroot mount with a write-back page cache (see
+ * `page_cache.manifest.template`) read back what was written: small and unaligned reads and
+ * writes, holes, truncation, a second descriptor, a child process, a mapping, and a file larger
+ * than the cache. Prints the cache statistics. */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define TEST_FILE "/cached/page_cache_test"
+
+/* larger than `fs.page_cache_size` in the manifest */
+#define MAX_SIZE (3 * 1024 * 1024)
+
+static char g_expected[MAX_SIZE];
+static size_t g_size;
+static char g_buf[MAX_SIZE];
+
+static void pwrite_exact(int fd, const void* buf, size_t size, off_t pos) {
+    while (size) {
+        ssize_t ret = pwrite(fd, buf, size, pos);
+        if (ret < 0)
+            err(1, "pwrite");
+        buf = (const char*)buf + ret;
+        size -= ret;
+        pos += ret;
+    }
+}
+
+/* Writes random data and updates the expected contents. */
+static void write_random(int fd, size_t size, off_t pos) {
+    for (size_t i = 0; i < size; i++)
+        g_buf[i] = rand();
+    pwrite_exact(fd, g_buf, size, pos);
+
+    if (pos > (off_t)g_size)
+        memset(g_expected + g_size, 0, pos - g_size);
+    memcpy(g_expected + pos, g_buf, size);
+    if (pos + size > g_size)
+        g_size = pos + size;
+}
+
+static void check_read(int fd, size_t size, off_t pos) {
+    ssize_t ret = pread(fd, g_buf, size, pos);
+    if (ret < 0)
+        err(1, "pread");
+    size_t expected = pos >= (off_t)g_size ? 0 : g_size - pos;
+    if (expected > size)
+        expected = size;
+    if ((size_t)ret != expected)
+        errx(1, "pread(%zu, %ld) returned %zd instead of %zu", size, pos, ret, expected);
+    if (memcmp(g_buf, g_expected + pos, ret))
+        errx(1, "pread(%zu, %ld) returned wrong data", size, pos);
+}
+
+static void check_contents(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        err(1, "fstat");
+    if ((size_t)st.st_size != g_size)
+        errx(1, "size is %ld instead of %zu", st.st_size, g_size);
+
+    /* sequential small reads (read-ahead), then random ones */
+    for (off_t pos = 0; pos < (off_t)g_size + 200; pos += 100)
+        check_read(fd, 100, pos);
+    for (int i = 0; i < 1000; i++)
+        check_read(fd, rand() % 10000, rand() % (g_size + 1));
+    /* large reads bypass the cache */
+    check_read(fd, g_size, 0);
+}
+
+static void check_child(void) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        err(1, "fork");
+    if (pid == 0) {
+        /* the pages written by the parent were written back before fork */
+        int fd = open(TEST_FILE, O_RDONLY);
+        if (fd < 0)
+            err(1, "child: open");
+        check_contents(fd);
+        close(fd);
+        exit(0);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        err(1, "waitpid");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        errx(1, "child failed (status: %d)", status);
+}
+
+static void check_mmap(int fd) {
+    char* addr = mmap(NULL, g_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+        err(1, "mmap");
+    if (memcmp(addr, g_expected, g_size))
+        errx(1, "mapping has wrong data");
+    if (munmap(addr, g_size) < 0)
+        err(1, "munmap");
+}
+
+static void print_stats(void) {
+    FILE* f = fopen("/proc/page_cache", "r");
+    if (!f)
+        err(1, "fopen /proc/page_cache");
+    char line[128];
+    while (fgets(line, sizeof(line), f))
+        printf("%s", line);
+    fclose(f);
+}
+
+int main(void) {
+    srand(1);
+
+    int fd = open(TEST_FILE, O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd < 0)
+        err(1, "open");
+
+    /* small unaligned writes, overwrites and a hole */
+    for (off_t pos = 0; pos < 20000; pos += 700)
+        write_random(fd, 700, pos);
+    write_random(fd, 5000, 3000);
+    write_random(fd, 10, 50000);
+    check_contents(fd);
+
+    /* a second descriptor shares the cache */
+    int fd2 = open(TEST_FILE, O_RDWR);
+    if (fd2 < 0)
+        err(1, "open");
+    write_random(fd2, 300, 4000);
+    check_contents(fd);
+
+    /* shrinking and growing */
+    if (ftruncate(fd, 10000) < 0)
+        err(1, "ftruncate");
+    g_size = 10000;
+    check_contents(fd2);
+    if (ftruncate(fd, 30000) < 0)
+        err(1, "ftruncate");
+    memset(g_expected + g_size, 0, 30000 - g_size);
+    g_size = 30000;
+    check_contents(fd2);
+    close(fd2);
+
+    write_random(fd, 1000, 12000);
+    check_child();
+    check_mmap(fd);
+
+    /* more than the cache can hold */
+    for (off_t pos = 30000; pos < MAX_SIZE - 10000; pos += 8000)
+        write_random(fd, 8000, pos);
+    check_contents(fd);
+
+    if (fsync(fd) < 0)
+        err(1, "fsync");
+    close(fd);
+    fd = open(TEST_FILE, O_RDONLY);
+    if (fd < 0)
+        err(1, "open");
+    check_contents(fd);
+    close(fd);
+
+    if (unlink(TEST_FILE) < 0)
+        err(1, "unlink");
+
+    print_stats();
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,233 @@
+/* Measures latency and throughput of pipes and socketpairs used inside a single process (ping-pong
+ * between two threads, blocking and with epoll), and checks that data buffered in a pipe before
+ * fork() can be read by the child. */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PING_PONG_ITERS  20000
+#define THROUGHPUT_BYTES (64 * 1024 * 1024)
+#define CHUNK_SIZE       (64 * 1024)
+
+/* For a socketpair, `rx` and `tx` of one side are the same descriptor; for pipes, the two
+ * directions use two different pipes. */
+struct channel {
+    int main_rx, main_tx;
+    int echo_rx, echo_tx;
+    bool use_epoll;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        err(1, "clock_gettime");
+    return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void wait_readable(int epfd) {
+    struct epoll_event event;
+    int ret;
+    do {
+        ret = epoll_wait(epfd, &event, 1, -1);
+    } while (ret < 0 && errno == EINTR);
+    if (ret != 1)
+        err(1, "epoll_wait");
+}
+
+static void read_exact(int fd, void* buf, size_t size, int epfd) {
+    while (size) {
+        if (epfd >= 0)
+            wait_readable(epfd);
+        ssize_t ret = read(fd, buf, size);
+        if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+        if (ret < 0)
+            err(1, "read");
+        if (ret == 0)
+            errx(1, "unexpected EOF");
+        buf = (char*)buf + ret;
+        size -= ret;
+    }
+}
+
+static void write_exact(int fd, const void* buf, size_t size) {
+    while (size) {
+        ssize_t ret = write(fd, buf, size);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0)
+            err(1, "write");
+        buf = (const char*)buf + ret;
+        size -= ret;
+    }
+}
+
+static int create_epoll(int fd) {
+    int epfd = epoll_create1(0);
+    if (epfd < 0)
+        err(1, "epoll_create1");
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = fd};
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+        err(1, "epoll_ctl");
+    return epfd;
+}
+
+static void* echo_thread(void* arg) {
+    struct channel* ch = arg;
+    int epfd = ch->use_epoll ? create_epoll(ch->echo_rx) : -1;
+
+    for (int i = 0; i < PING_PONG_ITERS; i++) {
+        char c;
+        read_exact(ch->echo_rx, &c, 1, epfd);
+        write_exact(ch->echo_tx, &c, 1);
+    }
+
+    if (epfd >= 0)
+        close(epfd);
+    return NULL;
+}
+
+/* Returns the average round-trip time in nanoseconds. */
+static double ping_pong(struct channel* ch) {
+    int epfd = ch->use_epoll ? create_epoll(ch->main_rx) : -1;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, echo_thread, ch))
+        errx(1, "pthread_create failed");
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < PING_PONG_ITERS; i++) {
+        char c = (char)i;
+        write_exact(ch->main_tx, &c, 1);
+        read_exact(ch->main_rx, &c, 1, epfd);
+        if (c != (char)i)
+            errx(1, "ping-pong: got wrong byte");
+    }
+    uint64_t end = now_ns();
+
+    if (pthread_join(thread, NULL))
+        errx(1, "pthread_join failed");
+    if (epfd >= 0)
+        close(epfd);
+    return (double)(end - start) / PING_PONG_ITERS;
+}
+
+static void* writer_thread(void* arg) {
+    int fd = *(int*)arg;
+    static char buf[CHUNK_SIZE];
+    memset(buf, 'a', sizeof(buf));
+
+    for (size_t written = 0; written < THROUGHPUT_BYTES; written += sizeof(buf))
+        write_exact(fd, buf, sizeof(buf));
+    return NULL;
+}
+
+/* Returns the throughput in MB/s. */
+static double throughput(void) {
+    int fds[2];
+    if (pipe(fds) < 0)
+        err(1, "pipe");
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_thread, &fds[1]))
+        errx(1, "pthread_create failed");
+
+    static char buf[CHUNK_SIZE];
+    uint64_t start = now_ns();
+    for (size_t done = 0; done < THROUGHPUT_BYTES; done += sizeof(buf))
+        read_exact(fds[0], buf, sizeof(buf), -1);
+    uint64_t end = now_ns();
+
+    if (pthread_join(thread, NULL))
+        errx(1, "pthread_join failed");
+    close(fds[0]);
+    close(fds[1]);
+    return THROUGHPUT_BYTES / 1e6 / ((end - start + 1) / 1e9);
+}
+
+static void check_fork(void) {
+    const char msg[] = "buffered before fork";
+    int fds[2];
+    if (pipe(fds) < 0)
+        err(1, "pipe");
+    write_exact(fds[1], msg, sizeof(msg));
+
+    /* the child must not print what the parent buffered */
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        err(1, "fork");
+    if (pid == 0) {
+        char buf[sizeof(msg)];
+        close(fds[1]);
+        read_exact(fds[0], buf, sizeof(buf), -1);
+        if (memcmp(buf, msg, sizeof(msg)))
+            errx(1, "child read wrong data");
+        char c;
+        if (read(fds[0], &c, 1) != 0)
+            errx(1, "child did not get EOF");
+        exit(0);
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        err(1, "waitpid");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        errx(1, "child failed (status: %d)", status);
+}
+
+int main(void) {
+    int to_echo[2];
+    int to_main[2];
+    if (pipe(to_echo) < 0 || pipe(to_main) < 0)
+        err(1, "pipe");
+    struct channel pipe_ch = {
+        .main_rx = to_main[0],
+        .main_tx = to_echo[1],
+        .echo_rx = to_echo[0],
+        .echo_tx = to_main[1],
+    };
+    printf("pipe ping-pong:               %8.0f ns/round-trip\n", ping_pong(&pipe_ch));
+    pipe_ch.use_epoll = true;
+    printf("pipe ping-pong (epoll):       %8.0f ns/round-trip\n", ping_pong(&pipe_ch));
+    for (int i = 0; i < 2; i++) {
+        close(to_echo[i]);
+        close(to_main[i]);
+    }
+
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+        err(1, "socketpair");
+    struct channel sock_ch = {
+        .main_rx = sv[0],
+        .main_tx = sv[0],
+        .echo_rx = sv[1],
+        .echo_tx = sv[1],
+    };
+    printf("socketpair ping-pong:         %8.0f ns/round-trip\n", ping_pong(&sock_ch));
+    sock_ch.use_epoll = true;
+    printf("socketpair ping-pong (epoll): %8.0f ns/round-trip\n", ping_pong(&sock_ch));
+    close(sv[0]);
+    close(sv[1]);
+
+    printf("pipe throughput:              %8.0f MB/s\n", throughput());
+
+    check_fork();
+
+    puts("TEST OK");
+    return 0;
+}
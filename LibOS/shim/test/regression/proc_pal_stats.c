@@ -0,0 +1,27 @@
+/* Prints `/proc/pal_stats` (available only with `loader.enable_pal_stats = true`). */
+
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+int main(void) {
+    int fd = open("/proc/pal_stats", O_RDONLY);
+    if (fd < 0)
+        err(1, "open");
+
+    char buf[4096];
+    ssize_t ret;
+    while ((ret = read(fd, buf, sizeof(buf))) > 0) {
+        if (fwrite(buf, ret, 1, stdout) != 1)
+            errx(1, "fwrite failed");
+    }
+    if (ret < 0)
+        err(1, "read");
+
+    if (close(fd) < 0)
+        err(1, "close");
+
+    printf("TEST OK\n");
+    return 0;
+}
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Multithreaded read/write microbenchmark: every thread writes to and reads from its own pipe, so
+ * the only thing the threads share is the FD table. Meanwhile, a separate thread keeps dup'ing and
+ * closing FDs (growing the FD table), which exercises lockless FD lookups racing with FD table
+ * updates. Prints throughput for 1, 2, 4 and 8 threads.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_THREADS 8
+#define ITERATIONS  20000
+
+/* FDs dup'ed by the churn thread go up to this number (below the default RLIMIT_NOFILE of 900),
+ * forcing the FD table to grow */
+#define CHURN_FD_MAX 850
+
+static atomic_bool g_stop_churn;
+
+static void* rw_thread(void* arg) {
+    int fds[2];
+    uint32_t id = (uint32_t)(uintptr_t)arg;
+
+    if (pipe(fds) < 0)
+        err(1, "pipe");
+
+    for (uint32_t i = 0; i < ITERATIONS; i++) {
+        uint32_t val = id * ITERATIONS + i;
+        if (write(fds[1], &val, sizeof(val)) != sizeof(val))
+            err(1, "write");
+
+        uint32_t got;
+        if (read(fds[0], &got, sizeof(got)) != sizeof(got))
+            err(1, "read");
+        if (got != val)
+            errx(1, "thread %u: read %u, expected %u", id, got, val);
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    return NULL;
+}
+
+static void* churn_thread(void* arg) {
+    (void)arg;
+    int fd = 100;
+    while (!atomic_load(&g_stop_churn)) {
+        if (dup2(STDERR_FILENO, fd) < 0)
+            err(1, "dup2");
+        if (close(fd) < 0)
+            err(1, "close");
+        fd = fd >= CHURN_FD_MAX ? 100 : fd + 50;
+    }
+    return NULL;
+}
+
+static double run(size_t threads_cnt) {
+    pthread_t threads[MAX_THREADS];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < threads_cnt; i++)
+        if (pthread_create(&threads[i], NULL, rw_thread, (void*)(uintptr_t)i) != 0)
+            errx(1, "pthread_create failed");
+    for (size_t i = 0; i < threads_cnt; i++)
+        if (pthread_join(threads[i], NULL) != 0)
+            errx(1, "pthread_join failed");
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    /* one write and one read per iteration */
+    return 2.0 * ITERATIONS * threads_cnt / secs;
+}
+
+int main(void) {
+    pthread_t churn;
+
+    setbuf(stdout, NULL);
+
+    if (pthread_create(&churn, NULL, churn_thread, NULL) != 0)
+        errx(1, "pthread_create failed");
+
+    for (size_t threads_cnt = 1; threads_cnt <= MAX_THREADS; threads_cnt *= 2)
+        printf("%zu threads: %.0f ops/s\n", threads_cnt, run(threads_cnt));
+
+    atomic_store(&g_stop_churn, true);
+    if (pthread_join(churn, NULL) != 0)
+        errx(1, "pthread_join failed");
+
+    puts("TEST OK");
+    return 0;
+}
@@ -0,0 +1,146 @@
+/* Checks that the sync engine keeps the file position shared between a parent and a child process
+ * (see `sync_shared_file*.manifest.template`). Both processes append records to two files through
+ * the file descriptors inherited from the parent, so each write has to see the position left by the
+ * other process. Afterwards, the parent checks that no record was lost or overwritten, and both
+ * processes print the counters from `/proc/sync_stats`. */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NUM_FILES   2
+#define NUM_RECORDS 500
+#define RECORD_SIZE 16
+
+static const char* g_paths[NUM_FILES] = {
+    "tmp/sync_shared_file_a",
+    "tmp/sync_shared_file_b",
+};
+
+static void write_records(const int* fds, char tag) {
+    for (int i = 0; i < NUM_RECORDS; i++) {
+        for (int j = 0; j < NUM_FILES; j++) {
+            char record[RECORD_SIZE + 1];
+            snprintf(record, sizeof(record), "%c %013d\n", tag, i);
+
+            ssize_t ret = write(fds[j], record, RECORD_SIZE);
+            if (ret < 0)
+                err(1, "write %s", g_paths[j]);
+            if (ret != RECORD_SIZE)
+                errx(1, "write %s: short write (%zd bytes)", g_paths[j], ret);
+        }
+    }
+}
+
+static void check_records(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        err(1, "open %s", path);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        err(1, "fstat %s", path);
+    if (st.st_size != 2 * NUM_RECORDS * RECORD_SIZE)
+        errx(1, "%s: wrong size %ld, expected %d", path, (long)st.st_size,
+             2 * NUM_RECORDS * RECORD_SIZE);
+
+    /* records of each process have to appear in the order in which they were written */
+    int next_parent = 0;
+    int next_child = 0;
+    for (int i = 0; i < 2 * NUM_RECORDS; i++) {
+        char record[RECORD_SIZE + 1] = {0};
+        ssize_t ret = read(fd, record, RECORD_SIZE);
+        if (ret < 0)
+            err(1, "read %s", path);
+        if (ret != RECORD_SIZE)
+            errx(1, "read %s: short read (%zd bytes)", path, ret);
+
+        char tag;
+        int seq;
+        if (sscanf(record, "%c %d", &tag, &seq) != 2 || record[RECORD_SIZE - 1] != '\n')
+            errx(1, "%s: malformed record %d: \"%s\"", path, i, record);
+
+        int* next = tag == 'P' ? &next_parent : tag == 'C' ? &next_child : NULL;
+        if (!next)
+            errx(1, "%s: malformed record %d: \"%s\"", path, i, record);
+        if (seq != *next)
+            errx(1, "%s: record %d is %c %d, expected %c %d", path, i, tag, seq, tag, *next);
+        (*next)++;
+    }
+
+    if (close(fd) < 0)
+        err(1, "close %s", path);
+}
+
+static void print_sync_stats(const char* role) {
+    FILE* f = fopen("/proc/sync_stats", "r");
+    if (!f)
+        err(1, "fopen /proc/sync_stats");
+
+    char line[128];
+    while (fgets(line, sizeof(line), f))
+        printf("%s: %s", role, line);
+    if (ferror(f))
+        err(1, "fgets /proc/sync_stats");
+
+    fclose(f);
+    fflush(stdout);
+}
+
+int main(void) {
+    setbuf(stdout, NULL);
+
+    int fds[NUM_FILES];
+    for (int j = 0; j < NUM_FILES; j++) {
+        fds[j] = open(g_paths[j], O_CREAT | O_TRUNC | O_WRONLY, 0600);
+        if (fds[j] < 0)
+            err(1, "open %s", g_paths[j]);
+    }
+
+    /* the child starts writing only after it is up, so that the writes of both processes overlap */
+    int start_pipe[2];
+    if (pipe(start_pipe) < 0)
+        err(1, "pipe");
+
+    pid_t pid = fork();
+    if (pid < 0)
+        err(1, "fork");
+
+    if (pid == 0) {
+        if (close(start_pipe[0]) < 0)
+            err(1, "close");
+        if (write(start_pipe[1], "x", 1) != 1)
+            err(1, "write to pipe");
+        write_records(fds, 'C');
+        print_sync_stats("child");
+        exit(0);
+    }
+
+    if (close(start_pipe[1]) < 0)
+        err(1, "close");
+    char c;
+    if (read(start_pipe[0], &c, 1) != 1)
+        err(1, "read from pipe");
+    write_records(fds, 'P');
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        err(1, "waitpid");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        errx(1, "child died with status: %#x", status);
+
+    for (int j = 0; j < NUM_FILES; j++) {
+        if (close(fds[j]) < 0)
+            err(1, "close %s", g_paths[j]);
+        check_records(g_paths[j]);
+    }
+
+    print_sync_stats("parent");
+    printf("TEST OK\n");
+    return 0;
+}
@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 
+import json
 import os
 import re
 import shutil
@@ -7,6 +8,7 @@ import signal
 import subprocess
 import unittest
 
+from graphenelibos import syscall_trace
 from regression import (
     HAS_SGX,
     ON_X86,
@@ -149,6 +151,12 @@ class TC_01_Bootstrap(RegressionTestCase):
         self.assertIn('TEST OK', stdout)
         self.assertNotIn('grandchild', stderr)
 
+    @unittest.skipIf(HAS_SGX, 'The pool of pre-created processes is not supported on SGX PAL')
+    def test_206_double_fork_pool(self):
+        stdout, stderr = self.run_binary(['double_fork_pool'])
+        self.assertIn('TEST OK', stdout)
+        self.assertNotIn('grandchild', stderr)
+
     def test_210_exec_invalid_args(self):
         stdout, _ = self.run_binary(['exec_invalid_args'])
 
@@ -246,6 +254,24 @@ class TC_01_Bootstrap(RegressionTestCase):
 
         self._verify_debug_log(log)
 
+    def test_702_syscall_trace(self):
+        for name in os.listdir('tmp'):
+            if name.startswith('syscall_trace.'):
+                os.remove(os.path.join('tmp', name))
+
+        stdout, _ = self.run_binary(['syscall_trace'])
+        self.assertIn('256 Threads Created', stdout)
+
+        trace_files = [name for name in os.listdir('tmp') if name.startswith('syscall_trace.')]
+        self.assertEqual(len(trace_files), 1)
+        with open(os.path.join('tmp', trace_files[0]), 'rb') as file:
+            trace = syscall_trace.Trace(file)
+
+        names = [record.name for record in trace.records]
+        self.assertGreaterEqual(names.count('clone'), 256)
+        self.assertIn('write', names)
+        self.assertTrue(any(record.pal_calls > 0 for record in trace.records))
+
     def _verify_debug_log(self, log: str):
         self.assertIn('Host:', log)
         self.assertIn('Shim process initialized', log)
@@ -408,6 +434,50 @@ class TC_30_Syscall(RegressionTestCase):
         stdout, _ = self.run_binary(['host_root_fs'])
         self.assertIn('Test was successful', stdout)
 
+    def test_025_meta_cache(self):
+        stdout, _ = self.run_binary(['meta_cache'])
+        self.assertIn('TEST OK', stdout)
+
+    def test_026_page_cache(self):
+        stdout, _ = self.run_binary(['page_cache'], timeout=60)
+        self.assertIn('TEST OK', stdout)
+
+    def run_sync_shared_file(self, manifest):
+        stdout, _ = self.run_binary([manifest], timeout=60)
+        self.assertIn('TEST OK', stdout)
+
+        # `/proc/sync_stats` of both processes, e.g. `parent: locks 1000`
+        stats = {'parent': {}, 'child': {}}
+        for line in stdout.splitlines():
+            match = re.match(r'^(parent|child): (\w+) (\d+)(\.\d+)?$', line)
+            if match:
+                stats[match.group(1)][match.group(2)] = int(match.group(3))
+
+        for role in ('parent', 'child'):
+            role_stats = stats[role]
+            # every write (500 records to each of the 2 files) locks the file handle
+            self.assertGreaterEqual(role_stats['locks'], 2 * 500, role)
+            self.assertLessEqual(role_stats['prefetch_hits'], role_stats['prefetch_requests'],
+                                 role)
+        # the child does not hold the handles after fork, so it has to ask the server for them
+        self.assertGreater(stats['child']['upgrade_requests'], 0)
+        return stats
+
+    def test_027_sync_shared_file(self):
+        stats = self.run_sync_shared_file('sync_shared_file')
+        # without leases, the server (in the parent) never postpones a downgrade
+        self.assertEqual(stats['parent']['deferred_downgrades'], 0)
+        self.assertEqual(stats['parent']['extended_leases'], 0)
+
+    def test_028_sync_shared_file_lease(self):
+        self.run_sync_shared_file('sync_shared_file_lease')
+
+    def test_029_sync_shared_file_no_prefetch(self):
+        stats = self.run_sync_shared_file('sync_shared_file_no_prefetch')
+        for role in ('parent', 'child'):
+            self.assertEqual(stats[role]['prefetch_requests'], 0, role)
+            self.assertEqual(stats[role]['prefetch_hits'], 0, role)
+
     def test_030_fopen(self):
         if os.path.exists("tmp/filecreatedbygraphene"):
             os.remove("tmp/filecreatedbygraphene")
@@ -451,6 +521,12 @@ class TC_30_Syscall(RegressionTestCase):
 
         self.assertIn('Test successful!', stdout)
 
+    def test_044_futex_bench(self):
+        stdout, _ = self.run_binary(['futex_bench', '8'], timeout=60)
+
+        self.assertIn('threads:  8', stdout)
+        self.assertIn('TEST OK', stdout)
+
     def test_050_mmap(self):
         stdout, _ = self.run_binary(['mmap_file'], timeout=60)
 
@@ -531,6 +607,11 @@ class TC_30_Syscall(RegressionTestCase):
         self.assertIn('eventfd_using_various_flags completed successfully', stdout)
         self.assertIn('eventfd_using_fork completed successfully', stdout)
 
+    def test_071_eventfd_bench(self):
+        stdout, _ = self.run_binary(['eventfd_bench'], timeout=60)
+        self.assertIn('ping-pong (epoll)', stdout)
+        self.assertIn('TEST OK', stdout)
+
     def test_080_sched(self):
         stdout, _ = self.run_binary(['sched'])
 
@@ -591,6 +672,15 @@ class TC_30_Syscall(RegressionTestCase):
         stdout, _ = self.run_binary(['gettimeofday'])
         self.assertIn('TEST OK', stdout)
 
+    def test_104_rw_multithread(self):
+        stdout, _ = self.run_binary(['rw_multithread'], timeout=60)
+        self.assertIn('8 threads:', stdout)
+        self.assertIn('TEST OK', stdout)
+
+    def test_105_vdso_time(self):
+        stdout, _ = self.run_binary(['vdso_time'])
+        self.assertIn('TEST OK', stdout)
+
     def test_110_fcntl_lock(self):
         try:
             stdout, _ = self.run_binary(['fcntl_lock'])
@@ -599,6 +689,16 @@ class TC_30_Syscall(RegressionTestCase):
                 os.remove('tmp/lock_file')
         self.assertIn('TEST OK', stdout)
 
+    def test_111_ipc_bench(self):
+        stdout, _ = self.run_binary(['ipc_bench'], timeout=60)
+        self.assertIn('round trip:', stdout)
+        self.assertIn('TEST OK', stdout)
+
+    def test_112_ipc_bench_shm(self):
+        stdout, _ = self.run_binary(['ipc_bench_shm'], timeout=60)
+        self.assertIn('round trip:', stdout)
+        self.assertIn('TEST OK', stdout)
+
 class TC_31_Syscall(RegressionTestCase):
     @unittest.skipUnless(HAS_SGX,
         'This test is only meaningful on SGX PAL because only SGX catches raw '
@@ -625,6 +725,7 @@ class TC_40_FileSystem(RegressionTestCase):
 
         self.assertIn('/proc/meminfo: file', lines)
         self.assertIn('/proc/cpuinfo: file', lines)
+        self.assertIn('/proc/slabinfo: file', lines)
 
         # /proc/self, /proc/[pid]
         self.assertIn('/proc/self: link: 2', lines)
@@ -683,10 +784,36 @@ class TC_40_FileSystem(RegressionTestCase):
         # proc/cpuinfo Linux-based formatting
         self.assertIn('cpuinfo test passed', stdout)
 
+    def test_021_pal_stats(self):
+        stdout, stderr = self.run_binary(['pal_stats'])
+        self.assertIn('TEST OK', stdout)
+
+        # live statistics from `/proc/pal_stats`
+        lines = stdout.splitlines()
+        self.assertTrue(lines[0].startswith('# tsc_hz '))
+        open_stats = [line.split() for line in lines if line.startswith('call DkStreamOpen ')]
+        self.assertEqual(len(open_stats), 1)
+        self.assertGreater(int(open_stats[0][2]), 0)
+
+        # statistics dumped at exit
+        dump = [json.loads(line.split('pal_stats: ', 1)[1])
+                for line in stderr.splitlines() if 'pal_stats: ' in line]
+        self.assertIn('process', [entry['kind'] for entry in dump])
+        self.assertIn('DkStreamOpen', [entry['name'] for entry in dump if entry['kind'] == 'call'])
+        if HAS_SGX:
+            self.assertTrue(any(entry['kind'] == 'host' for entry in dump))
+
     def test_030_fdleak(self):
         stdout, _ = self.run_binary(['fdleak'], timeout=10)
         self.assertIn("Test succeeded.", stdout)
 
+    def test_031_dcache_multithread(self):
+        if os.path.exists('tmp/dcache_dir'):
+            shutil.rmtree('tmp/dcache_dir')
+        stdout, _ = self.run_binary(['dcache_multithread', 'tmp/dcache_dir'], timeout=120)
+        self.assertIn('8 threads:', stdout)
+        self.assertIn('TEST OK', stdout)
+
     def get_num_cache_levels(self):
         cpu0 = '/sys/devices/system/cpu/cpu0/'
         self.assertTrue(os.path.exists(f'{cpu0}/cache/'))
@@ -823,6 +950,10 @@ class TC_80_Socket(RegressionTestCase):
         stdout, _ = self.run_binary(['epoll_epollet', 'EMULATE_GRAPHENE_BUG'])
         self.assertIn('TEST OK', stdout)
 
+    def test_012_epoll_many_fds(self):
+        stdout, _ = self.run_binary(['epoll_many_fds'])
+        self.assertIn('TEST OK', stdout)
+
     def test_020_poll(self):
         try:
             stdout, _ = self.run_binary(['poll'])
@@ -873,6 +1004,11 @@ class TC_80_Socket(RegressionTestCase):
         stdout, _ = self.run_binary(['pipe_ocloexec'])
         self.assertIn('TEST OK', stdout)
 
+    def test_093_pipe_bench(self):
+        stdout, _ = self.run_binary(['pipe_bench'], timeout=60)
+        self.assertIn('socketpair ping-pong (epoll)', stdout)
+        self.assertIn('TEST OK', stdout)
+
     def test_095_mkfifo(self):
         try:
             stdout, _ = self.run_binary(['mkfifo'], timeout=60)
@@ -0,0 +1,57 @@
+/* Checks the time functions, which glibc calls through the vDSO. */
+
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/auxv.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define ITERATIONS 100000
+
+static uint64_t get_usec(clockid_t clock) {
+    struct timespec ts;
+    if (clock_gettime(clock, &ts) < 0)
+        err(1, "clock_gettime(%d)", clock);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+int main(void) {
+    if (!getauxval(AT_SYSINFO_EHDR))
+        errx(1, "no vDSO");
+
+    static const clockid_t clocks[] = {CLOCK_REALTIME, CLOCK_MONOTONIC, CLOCK_REALTIME_COARSE,
+                                       CLOCK_MONOTONIC_COARSE};
+    for (size_t i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++) {
+        uint64_t prev = get_usec(clocks[i]);
+        for (size_t j = 0; j < ITERATIONS; j++) {
+            uint64_t now = get_usec(clocks[i]);
+            /* LibOS slews recalibrations of the vDSO time, so the time must never go back */
+            if (now < prev)
+                errx(1, "clock %d went back from %lu to %lu", clocks[i], prev, now);
+            prev = now;
+        }
+    }
+
+    uint64_t start = get_usec(CLOCK_REALTIME);
+
+    struct timeval tv;
+    if (gettimeofday(&tv, NULL) < 0)
+        err(1, "gettimeofday");
+    uint64_t tv_usec = tv.tv_sec * 1000000UL + tv.tv_usec;
+
+    time_t t1;
+    time_t t2 = time(&t1);
+    if (t1 != t2)
+        errx(1, "time() returned %ld but stored %ld", t2, t1);
+
+    uint64_t end = get_usec(CLOCK_REALTIME);
+    if (tv_usec < start || tv_usec > end)
+        errx(1, "gettimeofday() returned %lu, not between %lu and %lu", tv_usec, start, end);
+    if ((uint64_t)t2 < start / 1000000 || (uint64_t)t2 > end / 1000000)
+        errx(1, "time() returned %ld, not between %lu and %lu", t2, start, end);
+
+    puts("TEST OK");
+    return 0;
+}
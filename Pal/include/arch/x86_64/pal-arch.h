@@ -44,6 +44,10 @@ typedef struct pal_tcb {
     uint64_t stack_protector_canary;
     /* uint64_t for alignment */
     uint64_t libos_tcb[(PAL_LIBOS_TCB_SIZE + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+    /* numbers of PAL API calls and host calls (e.g. OCALLs) made by this thread; counted only with
+     * `loader.enable_pal_stats`, only differences between two readings are meaningful */
+    uint64_t pal_calls_cnt;
+    uint64_t host_calls_cnt;
     /* data private to PAL implementation follows this struct. */
 } PAL_TCB;
 
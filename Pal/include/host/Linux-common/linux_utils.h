@@ -17,6 +17,8 @@ int read_all(int fd, void* buf, size_t size);
 int write_all(int fd, const void* buf, size_t size);
 
 int read_text_file_to_cstr(const char* path, char** out);
+/* Maps the whole file read-only; `*out_addr` is NULL for an empty file. */
+int map_file_readonly(const char* path, void** out_addr, size_t* out_size);
 
 /* Returns current time + `addend_ns` nanoseconds in `ts`. */
 void time_get_now_plus_ns(struct timespec* ts, uint64_t addend_ns);
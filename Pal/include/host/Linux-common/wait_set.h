@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Wait sets (`_DkWaitSet*`) are implemented in "Linux-common/wait_set.c" on top of a host epoll
+ * instance. Each PAL provides the functions below to reach the host epoll; they return the host
+ * result or a negative UNIX error code, like the syscalls.
+ */
+
+#ifndef WAIT_SET_H_
+#define WAIT_SET_H_
+
+#include <linux/eventpoll.h>
+#include <stdint.h>
+
+int host_epoll_create(void);
+int host_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event);
+/* A negative `timeout_us` means no timeout. */
+int host_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int64_t timeout_us);
+void host_epoll_close(int epfd);
+
+#endif // WAIT_SET_H_
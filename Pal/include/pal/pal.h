@@ -15,7 +15,7 @@
 #include <stdint.h>
 #include <stdnoreturn.h>
 
-#include "toml.h"
+#include "manifest.h"
 
 #if defined(__i386__) || defined(__x86_64__)
 #include "cpu.h"
@@ -108,6 +108,7 @@ enum {
     pal_type_thread,
     pal_type_event,
     pal_type_eventfd,
+    pal_type_waitset,
     PAL_HANDLE_TYPE_BOUND,
 };
 
@@ -124,6 +125,30 @@ typedef struct PAL_MEM_INFO_ {
     PAL_NUM mem_total;
 } PAL_MEM_INFO;
 
+/*! number of buckets in the latency histograms of #PAL_STATS_ENTRY */
+#define PAL_STATS_HIST_SIZE 32
+
+/*! statistics of a single PAL API call or a single kind of host call */
+typedef struct PAL_STATS_ENTRY_ {
+    const char* name;
+    PAL_NUM count;  /*!< number of calls */
+    PAL_NUM cycles; /*!< total time spent in the calls, in TSC cycles */
+    /*!
+     * Latency histogram: bucket `i` counts calls which took less than `2^i` TSC cycles (and at least
+     * `2^(i-1)`), the last bucket counts all longer calls. Unused if the TSC frequency is unknown.
+     */
+    PAL_NUM hist[PAL_STATS_HIST_SIZE];
+} PAL_STATS_ENTRY;
+
+/*! runtime statistics of PAL calls, enabled by `loader.enable_pal_stats` */
+typedef struct PAL_STATS_ {
+    PAL_NUM tsc_hz;                    /*!< TSC frequency, 0 if unknown (no times are recorded) */
+    PAL_STATS_ENTRY* calls;            /*!< PAL API calls */
+    size_t calls_cnt;
+    PAL_STATS_ENTRY* host_calls;       /*!< host-specific calls, e.g. OCALLs on SGX */
+    size_t host_calls_cnt;
+} PAL_STATS;
+
 /********** PAL APIs **********/
 typedef struct PAL_CONTROL_ {
     PAL_STR host_type;
@@ -132,10 +157,10 @@ typedef struct PAL_CONTROL_ {
      * Handles and executables
      */
 
-    toml_table_t* manifest_root; /*!< program manifest */
-    PAL_HANDLE parent_process;   /*!< handle of parent process */
-    PAL_HANDLE first_thread;     /*!< handle of first thread */
-    int log_level;               /*!< what log messages to enable */
+    const struct manifest* manifest_root; /*!< program manifest (compiled) */
+    PAL_HANDLE parent_process;            /*!< handle of parent process */
+    PAL_HANDLE first_thread;              /*!< handle of first thread */
+    int log_level;                        /*!< what log messages to enable */
 
     /*
      * Memory layout
@@ -166,6 +191,11 @@ typedef struct PAL_CONTROL_ {
     PAL_CPU_INFO cpu_info; /*!< CPU information (only required ones) */
     PAL_MEM_INFO mem_info; /*!< memory information (only required ones) */
     PAL_TOPO_INFO topo_info; /*!< Topology information (only required ones) */
+
+    /*
+     * Statistics
+     */
+    const PAL_STATS* stats; /*!< PAL call statistics, NULL if disabled; updated concurrently */
 } PAL_CONTROL;
 
 const PAL_CONTROL* DkGetPalControl(void);
@@ -383,6 +413,73 @@ int DkStreamRead(PAL_HANDLE handle, PAL_NUM offset, PAL_NUM* count, PAL_PTR buff
  */
 int DkStreamWrite(PAL_HANDLE handle, PAL_NUM offset, PAL_NUM* count, PAL_PTR buffer, PAL_STR dest);
 
+/*! maximum number of buffers in a single #PAL_IO_REQUEST (same as Linux `IOV_MAX`) */
+#define PAL_IO_MAX_IOV 1024
+
+/*! maximum number of requests that can be passed to #DkStreamsBatchIo in a single call */
+#define PAL_IO_MAX_BATCH 1024
+
+enum PAL_IO_OP {
+    PAL_IO_READ  = 0, /*!< read (scatter) from the stream */
+    PAL_IO_WRITE = 1, /*!< write (gather) to the stream */
+};
+
+/*! a buffer of a #PAL_IO_REQUEST; layout-compatible with `struct iovec` */
+typedef struct _PAL_IOVEC {
+    PAL_PTR buffer;
+    PAL_NUM count;
+} PAL_IOVEC;
+
+/*! a single I/O operation submitted via #DkStreamsBatchIo */
+typedef struct _PAL_IO_REQUEST {
+    PAL_HANDLE handle;  /*!< stream to operate on */
+    PAL_FLG    op;      /*!< one of #PAL_IO_OP */
+    PAL_NUM    offset;  /*!< offset in the stream (ignored for non-seekable streams) */
+    PAL_IOVEC* iov;     /*!< buffers to read into or write from, processed in order */
+    PAL_NUM    iov_cnt; /*!< number of elements in \a iov, at most #PAL_IO_MAX_IOV */
+    int64_t    result;  /*!< [out] number of bytes transferred or negative PAL error code */
+} PAL_IO_REQUEST;
+
+/*!
+ * \brief Submit a batch of reads and writes and wait for all of them to complete.
+ *
+ * \param count number of requests in \p reqs, at most #PAL_IO_MAX_BATCH.
+ * \param[in,out] reqs array of requests; on return, `result` of each request is filled in.
+ *
+ * \return 0 if the batch was processed (even if some requests failed; check their `result`),
+ *         negative error code if the batch itself is invalid.
+ *
+ * Each request behaves like a single `preadv`/`pwritev` (or `readv`/`writev` for non-seekable
+ * streams) on its handle: a short transfer does not continue into the remaining buffers. Requests
+ * on different handles may be executed concurrently and complete in any order, so the batch must
+ * not contain requests that depend on each other. Hosts submit the whole batch to the host kernel
+ * at once where possible (e.g. a single enclave exit on Linux-SGX, io_uring for regular files on
+ * Linux); other streams transparently fall back to one #DkStreamRead / #DkStreamWrite per buffer.
+ */
+int DkStreamsBatchIo(PAL_NUM count, PAL_IO_REQUEST* reqs);
+
+/*!
+ * \brief Copy data from one open stream to another without passing it through the caller.
+ *
+ * \param src stream to read from.
+ * \param src_offset offset to read at (ignored if \p src is not a seekable file).
+ * \param dst stream to write to.
+ * \param dst_offset offset to write at (ignored if \p dst is not a seekable file).
+ * \param[in,out] count on function call should contain the number of bytes to copy. On successful
+ *                return contains the number of bytes copied; 0 means end of \p src.
+ *
+ * \return 0 on success, negative error code on failure.
+ *
+ * Behaves like a read from \p src followed by a write to \p dst, so the call may copy fewer bytes
+ * than requested. Hosts let the host kernel move the data directly where both streams pass it
+ * through unmodified (`sendfile`, `splice` or `copy_file_range` on Linux, `sendfile` from allowed
+ * files to TCP sockets on Linux-SGX); otherwise the data is copied in large chunks through a PAL
+ * buffer, which is where it gets verified or decrypted. In the latter case, data already read from
+ * a non-seekable \p src is lost if writing it to \p dst fails.
+ */
+int DkStreamTransfer(PAL_HANDLE src, PAL_NUM src_offset, PAL_HANDLE dst, PAL_NUM dst_offset,
+                     PAL_NUM* count);
+
 enum PAL_DELETE {
     PAL_DELETE_RD = 1, /*!< shut down the read side only */
     PAL_DELETE_WR = 2, /*!< shut down the write side only */
@@ -678,6 +775,61 @@ enum PAL_WAIT {
 int DkStreamsWaitEvents(PAL_NUM count, PAL_HANDLE* handle_array, PAL_FLG* events,
                         PAL_FLG* ret_events, PAL_NUM timeout_us);
 
+/*!
+ * \brief Create a wait set
+ *
+ * \param[out] handle on success contains the wait set handle
+ *
+ * A wait set is a persistent set of handles to wait on: unlike #DkStreamsWaitEvents, the set is
+ * passed to the host only when it changes, and a wait returns only the ready handles. Each entry is
+ * identified by a caller-chosen `data` value; the same handle may be added several times (with
+ * different `data`). Handles must stay open while they are in the set. The set is destroyed with
+ * #DkObjectClose.
+ */
+int DkWaitSetCreate(PAL_HANDLE* handle);
+
+enum PAL_WAIT_SET_OP {
+    PAL_WAIT_SET_ADD,
+    PAL_WAIT_SET_MOD,
+    PAL_WAIT_SET_DEL,
+};
+
+/*!
+ * \brief Add, modify or remove an entry of a wait set
+ *
+ * \param wait_set the wait set
+ * \param op       #PAL_WAIT_SET_ADD, #PAL_WAIT_SET_MOD or #PAL_WAIT_SET_DEL
+ * \param data     identifier of the entry, reported by #DkWaitSetWait
+ * \param handle   the handle to wait on (ignored for #PAL_WAIT_SET_DEL)
+ * \param events   #PAL_WAIT_READ and/or #PAL_WAIT_WRITE (ignored for #PAL_WAIT_SET_DEL)
+ *
+ * \return 0 on success, #PAL_ERROR_STREAMEXIST if adding an existing `data`,
+ *         #PAL_ERROR_STREAMNOTEXIST if modifying or removing a nonexistent one, negative error code
+ *         otherwise
+ *
+ * #PAL_WAIT_SET_MOD may also change the handle of the entry.
+ */
+int DkWaitSetCtl(PAL_HANDLE wait_set, enum PAL_WAIT_SET_OP op, PAL_NUM data, PAL_HANDLE handle,
+                 PAL_FLG events);
+
+/*!
+ * \brief Wait for events on the entries of a wait set
+ *
+ * \param wait_set        the wait set
+ * \param max_count       size of \p ret_data and \p ret_events (must be non-zero)
+ * \param[out] ret_data   `data` of the ready entries
+ * \param[out] ret_events events of the ready entries (#PAL_WAIT_ERROR is always reported)
+ * \param[out] ret_count  number of ready entries
+ * \param timeout_us      the maximum time to wait (in microseconds), or `NO_TIMEOUT`
+ *
+ * \return 0 if at least one entry is ready, #PAL_ERROR_TRYAGAIN on timeout, negative error code
+ *         otherwise
+ *
+ * Events are level-triggered: an entry is reported by every wait as long as its handle is ready.
+ */
+int DkWaitSetWait(PAL_HANDLE wait_set, PAL_NUM max_count, PAL_NUM* ret_data, PAL_FLG* ret_events,
+                  PAL_NUM* ret_count, PAL_NUM timeout_us);
+
 /*!
  * \brief Close (deallocate) a PAL handle.
  */
@@ -704,6 +856,32 @@ int DkDebugLog(PAL_PTR buffer, PAL_NUM size);
  */
 int DkSystemTimeQuery(PAL_NUM* time);
 
+/*! parameters for computing the current time from the TSC, see #DkSystemTimeCalibration */
+typedef struct _PAL_TIME_CALIBRATION {
+    PAL_NUM tsc_hz;        /*!< TSC frequency */
+    PAL_NUM base_tsc;      /*!< TSC value at the time `base_usec` */
+    PAL_NUM base_usec;     /*!< time (as returned by #DkSystemTimeQuery) at `base_tsc` */
+    PAL_NUM max_delta_tsc; /*!< how long after `base_tsc` (in cycles) the extrapolation is valid */
+} PAL_TIME_CALIBRATION;
+
+/*!
+ * \brief Get parameters for computing the current time without calling into PAL
+ *
+ * \param[out] calib  on success holds the current calibration
+ *
+ * For as long as `TSC - calib->base_tsc < calib->max_delta_tsc`, the time (in microseconds) can be
+ * computed as `calib->base_usec + (TSC - calib->base_tsc) * 1000000 / calib->tsc_hz`. Afterwards
+ * the caller has to call #DkSystemTimeQuery and then query the calibration again.
+ *
+ * The computed time may slightly drift from #DkSystemTimeQuery between calibrations (e.g. Linux
+ * PAL reads the host clock directly), so a new calibration may be behind the time extrapolated
+ * from the previous one. Callers that need a monotonic clock have to account for that.
+ *
+ * \return 0 on success, #PAL_ERROR_NOTSUPPORT if the TSC cannot be used to compute the time (e.g.
+ *         it is not invariant or its frequency is unknown).
+ */
+int DkSystemTimeCalibration(PAL_TIME_CALIBRATION* calib);
+
 /*!
  * \brief Cryptographically secure random.
  *
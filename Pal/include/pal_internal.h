@@ -14,10 +14,10 @@
 
 #include "api.h"
 #include "log.h"
+#include "manifest.h"
 #include "pal.h"
 #include "pal_defs.h"
 #include "pal_error.h"
-#include "toml.h"
 
 #ifndef IN_PAL
 #error "pal_internal.h can only be included in PAL"
@@ -121,8 +121,8 @@ struct pal_internal_state {
 
     PAL_HANDLE      parent_process;
 
-    const char*     raw_manifest_data;
-    toml_table_t*   manifest_root;
+    /* compiled manifest; the image is sent as-is to child processes */
+    const struct manifest* manifest_root;
 
     /* May not be the same as page size, e.g. SYSTEM_INFO::dwAllocationGranularity on Windows */
     size_t          alloc_align;
@@ -182,6 +182,12 @@ int64_t _DkStreamSetLength(PAL_HANDLE handle, uint64_t length);
 int _DkStreamFlush(PAL_HANDLE handle);
 int _DkStreamGetName(PAL_HANDLE handle, char* buf, size_t size);
 const char* _DkStreamRealpath(PAL_HANDLE hdl);
+int _DkStreamsBatchIo(size_t count, PAL_IO_REQUEST* reqs);
+int64_t _DkStreamIoRequest(PAL_IO_REQUEST* req);
+int64_t _DkStreamTransfer(PAL_HANDLE src, uint64_t src_offset, PAL_HANDLE dst, uint64_t dst_offset,
+                          uint64_t count);
+int64_t _DkStreamTransferCopy(PAL_HANDLE src, uint64_t src_offset, PAL_HANDLE dst,
+                              uint64_t dst_offset, uint64_t count);
 int _DkSendHandle(PAL_HANDLE hdl, PAL_HANDLE cargo);
 int _DkReceiveHandle(PAL_HANDLE hdl, PAL_HANDLE* cargo);
 
@@ -210,12 +216,18 @@ int _DkVirtualMemoryProtect(void* addr, uint64_t size, int prot);
 int _DkObjectClose(PAL_HANDLE objectHandle);
 int _DkStreamsWaitEvents(size_t count, PAL_HANDLE* handle_array, PAL_FLG* events,
                          PAL_FLG* ret_events, int64_t timeout_us);
+int _DkWaitSetCreate(PAL_HANDLE* handle);
+int _DkWaitSetCtl(PAL_HANDLE wait_set, enum PAL_WAIT_SET_OP op, PAL_NUM data, PAL_HANDLE handle,
+                  PAL_FLG events);
+int _DkWaitSetWait(PAL_HANDLE wait_set, size_t max_count, PAL_NUM* ret_data, PAL_FLG* ret_events,
+                   size_t* ret_count, int64_t timeout_us);
 
 /* DkException calls & structures */
 PAL_EVENT_HANDLER _DkGetExceptionHandler(PAL_NUM event_num);
 
 /* other DK calls */
 int _DkSystemTimeQuery(uint64_t* out_usec);
+int _DkSystemTimeCalibration(PAL_TIME_CALIBRATION* calib);
 
 /*
  * Cryptographically secure random.
@@ -232,6 +244,99 @@ int _DkAttestationQuote(PAL_PTR user_report_data, PAL_NUM user_report_data_size,
                         PAL_NUM* quote_size);
 int _DkSetProtectedFilesKey(PAL_PTR pf_key_hex);
 
+/* PAL call statistics, see pal_stats.c */
+
+/* PAL API calls which are counted (all except the ones which never return and trivial getters) */
+#define PAL_STATS_CALLS(X)             \
+    X(VirtualMemoryAlloc)              \
+    X(VirtualMemoryFree)               \
+    X(VirtualMemoryProtect)            \
+    X(ThreadCreate)                    \
+    X(ThreadYieldExecution)            \
+    X(ThreadResume)                    \
+    X(ThreadSetCpuAffinity)            \
+    X(ThreadGetCpuAffinity)            \
+    X(EventCreate)                     \
+    X(EventSet)                        \
+    X(EventClear)                      \
+    X(EventWait)                       \
+    X(StreamsWaitEvents)               \
+    X(WaitSetCreate)                   \
+    X(WaitSetCtl)                      \
+    X(WaitSetWait)                     \
+    X(StreamOpen)                      \
+    X(StreamRead)                      \
+    X(StreamWrite)                     \
+    X(StreamsBatchIo)                  \
+    X(StreamTransfer)                  \
+    X(StreamMap)                       \
+    X(StreamUnmap)                     \
+    X(StreamSetLength)                 \
+    X(StreamFlush)                     \
+    X(StreamDelete)                    \
+    X(SendHandle)                      \
+    X(ReceiveHandle)                   \
+    X(StreamWaitForClient)             \
+    X(StreamGetName)                   \
+    X(StreamAttributesQueryByHandle)   \
+    X(StreamAttributesQuery)           \
+    X(StreamAttributesSetByHandle)     \
+    X(StreamChangeName)                \
+    X(ProcessCreate)                   \
+    X(SystemTimeQuery)                 \
+    X(SystemTimeCalibration)           \
+    X(RandomBitsRead)                  \
+    X(CpuIdRetrieve)                   \
+    X(ObjectClose)                     \
+    X(SegmentRegisterGet)              \
+    X(SegmentRegisterSet)              \
+    X(MemoryAvailableQuota)            \
+    X(AttestationReport)               \
+    X(AttestationQuote)                \
+    X(SetProtectedFilesKey)
+
+enum pal_stats_call {
+#define PAL_STATS_ENUM(call) PAL_STATS_##call,
+    PAL_STATS_CALLS(PAL_STATS_ENUM)
+#undef PAL_STATS_ENUM
+    PAL_STATS_CALLS_CNT
+};
+
+extern bool g_pal_stats_enabled;
+extern PAL_STATS_ENTRY g_pal_stats_calls[PAL_STATS_CALLS_CNT];
+
+int init_pal_stats(void);
+/* Must be called before `pal_main`; `entries` must have names set and stay valid forever. */
+void pal_stats_set_host_calls(PAL_STATS_ENTRY* entries, size_t cnt);
+void pal_stats_dump(void);
+/* Returns the start time for `pal_stats_record`; callers check `g_pal_stats_enabled` first. */
+uint64_t pal_stats_start(void);
+void pal_stats_record(PAL_STATS_ENTRY* entry, uint64_t start);
+
+struct pal_stats_scope {
+    PAL_STATS_ENTRY* entry;
+    uint64_t start;
+};
+
+static inline struct pal_stats_scope pal_stats_scope_begin(enum pal_stats_call call) {
+    if (!g_pal_stats_enabled)
+        return (struct pal_stats_scope){ .entry = NULL };
+    pal_get_tcb()->pal_calls_cnt++;
+    return (struct pal_stats_scope){ .entry = &g_pal_stats_calls[call],
+                                     .start = pal_stats_start() };
+}
+
+static inline void pal_stats_scope_end(struct pal_stats_scope* scope) {
+    if (scope->entry)
+        pal_stats_record(scope->entry, scope->start);
+}
+
+/* Counts the current PAL API call, which ends when the enclosing scope is left (on any return
+ * path). Must be the first statement of the `Dk*` function. */
+#define PAL_STATS_CALL(call)                                                                    \
+    __attribute__((cleanup(pal_stats_scope_end))) struct pal_stats_scope _pal_stats_scope       \
+        = pal_stats_scope_begin(PAL_STATS_##call)
+
 #define INIT_FAIL(exitcode, reason)                                                              \
     do {                                                                                         \
         log_error("PAL failed at " __FILE__ ":%s:%u (exitcode = %u, reason=%s)", __FUNCTION__,   \
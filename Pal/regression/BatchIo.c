@@ -0,0 +1,188 @@
+#include "api.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_regression.h"
+
+#define CHUNK_SIZE  4096
+#define CHUNKS      16
+#define BENCH_ROUNDS 1000
+
+static char g_wbuf[CHUNKS][CHUNK_SIZE];
+static char g_rbuf[CHUNKS][CHUNK_SIZE];
+
+static int test_file(PAL_HANDLE file) {
+    PAL_IOVEC iov[CHUNKS][2];
+    PAL_IO_REQUEST reqs[CHUNKS];
+
+    for (int i = 0; i < CHUNKS; i++) {
+        memset(g_wbuf[i], 'a' + i, CHUNK_SIZE);
+        /* each request writes one chunk from two buffers, in reverse order of offsets */
+        iov[i][0] = (PAL_IOVEC){ .buffer = g_wbuf[i], .count = CHUNK_SIZE / 2 };
+        iov[i][1] = (PAL_IOVEC){ .buffer = g_wbuf[i] + CHUNK_SIZE / 2, .count = CHUNK_SIZE / 2 };
+        reqs[i] = (PAL_IO_REQUEST){ .handle = file, .op = PAL_IO_WRITE,
+                                    .offset = (CHUNKS - 1 - i) * CHUNK_SIZE,
+                                    .iov = iov[i], .iov_cnt = 2 };
+    }
+
+    int ret = DkStreamsBatchIo(CHUNKS, reqs);
+    if (ret < 0) {
+        pal_printf("DkStreamsBatchIo (file write) failed: %d\n", ret);
+        return -1;
+    }
+    for (int i = 0; i < CHUNKS; i++) {
+        if (reqs[i].result != CHUNK_SIZE) {
+            pal_printf("File batch write %d returned %ld\n", i, reqs[i].result);
+            return -1;
+        }
+    }
+    pal_printf("File Batch Write OK\n");
+
+    for (int i = 0; i < CHUNKS; i++) {
+        iov[i][0] = (PAL_IOVEC){ .buffer = g_rbuf[i], .count = CHUNK_SIZE };
+        reqs[i] = (PAL_IO_REQUEST){ .handle = file, .op = PAL_IO_READ, .offset = i * CHUNK_SIZE,
+                                    .iov = iov[i], .iov_cnt = 1 };
+    }
+    /* one request past the end of the file must return a short read */
+    char tail[CHUNK_SIZE];
+    PAL_IOVEC tail_iov = { .buffer = tail, .count = sizeof(tail) };
+    PAL_IO_REQUEST all_reqs[CHUNKS + 1];
+    memcpy(all_reqs, reqs, sizeof(reqs));
+    all_reqs[CHUNKS] = (PAL_IO_REQUEST){ .handle = file, .op = PAL_IO_READ,
+                                         .offset = CHUNKS * CHUNK_SIZE - 10,
+                                         .iov = &tail_iov, .iov_cnt = 1 };
+
+    ret = DkStreamsBatchIo(CHUNKS + 1, all_reqs);
+    if (ret < 0) {
+        pal_printf("DkStreamsBatchIo (file read) failed: %d\n", ret);
+        return -1;
+    }
+    for (int i = 0; i < CHUNKS; i++) {
+        if (all_reqs[i].result != CHUNK_SIZE ||
+                memcmp(g_rbuf[i], g_wbuf[CHUNKS - 1 - i], CHUNK_SIZE)) {
+            pal_printf("File batch read %d returned wrong data (%ld)\n", i, all_reqs[i].result);
+            return -1;
+        }
+    }
+    if (all_reqs[CHUNKS].result != 10) {
+        pal_printf("File batch short read returned %ld\n", all_reqs[CHUNKS].result);
+        return -1;
+    }
+    pal_printf("File Batch Read OK\n");
+    return 0;
+}
+
+static int test_pipe(void) {
+    PAL_HANDLE pipe;
+    int ret = DkStreamOpen("pipe:", PAL_ACCESS_RDWR, 0, 0, 0, &pipe);
+    if (ret < 0) {
+        pal_printf("DkStreamOpen(pipe:) failed: %d\n", ret);
+        return -1;
+    }
+
+    char hello[] = "Hello ";
+    char world[] = "World";
+    PAL_IOVEC wiov[2] = {
+        { .buffer = hello, .count = strlen(hello) },
+        { .buffer = world, .count = strlen(world) + 1 },
+    };
+    PAL_IO_REQUEST req = { .handle = pipe, .op = PAL_IO_WRITE, .iov = wiov, .iov_cnt = 2 };
+    ret = DkStreamsBatchIo(1, &req);
+    if (ret < 0 || req.result != (int64_t)sizeof("Hello World")) {
+        pal_printf("Pipe batch write failed: %d, %ld\n", ret, req.result);
+        goto out;
+    }
+
+    /* a read into more buffers than there is data must return what is available */
+    char buf1[4];
+    char buf2[64];
+    char buf3[64];
+    PAL_IOVEC riov[3] = {
+        { .buffer = buf1, .count = sizeof(buf1) },
+        { .buffer = buf2, .count = sizeof(buf2) },
+        { .buffer = buf3, .count = sizeof(buf3) },
+    };
+    req = (PAL_IO_REQUEST){ .handle = pipe, .op = PAL_IO_READ, .iov = riov, .iov_cnt = 3 };
+    ret = DkStreamsBatchIo(1, &req);
+    if (ret < 0 || req.result != (int64_t)sizeof("Hello World")) {
+        pal_printf("Pipe batch read failed: %d, %ld\n", ret, req.result);
+        goto out;
+    }
+    if (memcmp(buf1, "Hell", 4) || strcmp(buf2, "o World")) {
+        pal_printf("Pipe batch read returned wrong data\n");
+        ret = -1;
+        goto out;
+    }
+    pal_printf("Pipe Batch OK\n");
+    ret = 0;
+
+out:
+    DkObjectClose(pipe);
+    return ret < 0 ? -1 : 0;
+}
+
+/* Compares reading CHUNKS chunks with one DkStreamRead per chunk against one DkStreamsBatchIo. */
+static int bench_file(PAL_HANDLE file) {
+    PAL_NUM start, end;
+    int ret;
+
+    DkSystemTimeQuery(&start);
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < CHUNKS; i++) {
+            PAL_NUM size = CHUNK_SIZE;
+            ret = DkStreamRead(file, i * CHUNK_SIZE, &size, g_rbuf[i], NULL, 0);
+            if (ret < 0 || size != CHUNK_SIZE)
+                return -1;
+        }
+    }
+    DkSystemTimeQuery(&end);
+    pal_printf("Single reads: %lu us\n", end - start);
+
+    PAL_IOVEC iov[CHUNKS];
+    PAL_IO_REQUEST reqs[CHUNKS];
+    DkSystemTimeQuery(&start);
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int i = 0; i < CHUNKS; i++) {
+            iov[i] = (PAL_IOVEC){ .buffer = g_rbuf[i], .count = CHUNK_SIZE };
+            reqs[i] = (PAL_IO_REQUEST){ .handle = file, .op = PAL_IO_READ,
+                                        .offset = i * CHUNK_SIZE, .iov = &iov[i], .iov_cnt = 1 };
+        }
+        ret = DkStreamsBatchIo(CHUNKS, reqs);
+        if (ret < 0)
+            return -1;
+        for (int i = 0; i < CHUNKS; i++)
+            if (reqs[i].result != CHUNK_SIZE)
+                return -1;
+    }
+    DkSystemTimeQuery(&end);
+    pal_printf("Batched reads: %lu us\n", end - start);
+    return 0;
+}
+
+int main(int argc, char** argv, char** envp) {
+    PAL_HANDLE file;
+    int ret = DkStreamOpen("file:batch_io.tmp", PAL_ACCESS_RDWR,
+                           PAL_SHARE_OWNER_R | PAL_SHARE_OWNER_W, PAL_CREATE_TRY, 0, &file);
+    if (ret < 0) {
+        pal_printf("DkStreamOpen(batch_io.tmp) failed: %d\n", ret);
+        return 1;
+    }
+
+    PAL_IOVEC iov = { .buffer = g_rbuf[0], .count = 1 };
+    PAL_IO_REQUEST bad = { .handle = file, .op = 42, .iov = &iov, .iov_cnt = 1 };
+    if (DkStreamsBatchIo(1, &bad) != -PAL_ERROR_INVAL) {
+        pal_printf("DkStreamsBatchIo accepted an invalid request\n");
+        return 1;
+    }
+
+    if (test_file(file) < 0 || test_pipe() < 0)
+        return 1;
+
+    if (bench_file(file) < 0) {
+        pal_printf("Benchmark failed\n");
+        return 1;
+    }
+
+    DkObjectClose(file);
+    pal_printf("TEST OK\n");
+    return 0;
+}
@@ -22,6 +22,8 @@ int main(int argc, char** argv, char** envp) {
     PRINT_SYMBOL(DkStreamWaitForClient);
     PRINT_SYMBOL(DkStreamRead);
     PRINT_SYMBOL(DkStreamWrite);
+    PRINT_SYMBOL(DkStreamsBatchIo);
+    PRINT_SYMBOL(DkStreamTransfer);
     PRINT_SYMBOL(DkStreamDelete);
     PRINT_SYMBOL(DkStreamMap);
     PRINT_SYMBOL(DkStreamUnmap);
@@ -35,6 +37,9 @@ int main(int argc, char** argv, char** envp) {
     PRINT_SYMBOL(DkStreamGetName);
     PRINT_SYMBOL(DkStreamChangeName);
     PRINT_SYMBOL(DkStreamsWaitEvents);
+    PRINT_SYMBOL(DkWaitSetCreate);
+    PRINT_SYMBOL(DkWaitSetCtl);
+    PRINT_SYMBOL(DkWaitSetWait);
 
     PRINT_SYMBOL(DkThreadCreate);
     PRINT_SYMBOL(DkThreadYieldExecution);
@@ -51,6 +56,7 @@ int main(int argc, char** argv, char** envp) {
     PRINT_SYMBOL(DkObjectClose);
 
     PRINT_SYMBOL(DkSystemTimeQuery);
+    PRINT_SYMBOL(DkSystemTimeCalibration);
     PRINT_SYMBOL(DkRandomBitsRead);
 #if defined(__x86_64__)
     PRINT_SYMBOL(DkSegmentRegisterGet);
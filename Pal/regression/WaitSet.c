@@ -0,0 +1,133 @@
+#include "api.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_regression.h"
+
+#define PIPES 32
+
+/* Waits with a zero timeout and checks that exactly the entries in `expected` are reported. */
+static int check_ready(PAL_HANDLE set, const char* what, PAL_NUM expected_data,
+                       PAL_FLG expected_events, PAL_NUM expected_count) {
+    PAL_NUM data[PIPES];
+    PAL_FLG events[PIPES];
+    PAL_NUM count = 0;
+
+    int ret = DkWaitSetWait(set, PIPES, data, events, &count, 0);
+    if (expected_count == 0) {
+        if (ret != -PAL_ERROR_TRYAGAIN) {
+            pal_printf("%s: expected a timeout, got %d (%lu entries)\n", what, ret, count);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (ret < 0 || count != expected_count) {
+        pal_printf("%s: DkWaitSetWait returned %d, %lu entries\n", what, ret, count);
+        return -1;
+    }
+    for (PAL_NUM i = 0; i < count; i++) {
+        if ((expected_data != (PAL_NUM)-1 && data[i] != expected_data)
+                || events[i] != expected_events) {
+            pal_printf("%s: unexpected entry %lu (events %d)\n", what, data[i], events[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char** argv, char** envp) {
+    PAL_HANDLE pipes[PIPES];
+    PAL_HANDLE set;
+
+    for (int i = 0; i < PIPES; i++) {
+        int ret = DkStreamOpen("pipe:", PAL_ACCESS_RDWR, 0, 0, 0, &pipes[i]);
+        if (ret < 0) {
+            pal_printf("DkStreamOpen(pipe:) failed: %d\n", ret);
+            return 1;
+        }
+    }
+
+    int ret = DkWaitSetCreate(&set);
+    if (ret < 0) {
+        pal_printf("DkWaitSetCreate failed: %d\n", ret);
+        return 1;
+    }
+
+    for (int i = 0; i < PIPES; i++) {
+        ret = DkWaitSetCtl(set, PAL_WAIT_SET_ADD, 100 + i, pipes[i], PAL_WAIT_READ);
+        if (ret < 0) {
+            pal_printf("DkWaitSetCtl(ADD) failed: %d\n", ret);
+            return 1;
+        }
+    }
+    if (DkWaitSetCtl(set, PAL_WAIT_SET_ADD, 100, pipes[1], PAL_WAIT_READ)
+            != -PAL_ERROR_STREAMEXIST) {
+        pal_printf("DkWaitSetCtl added an existing entry\n");
+        return 1;
+    }
+    if (DkWaitSetCtl(set, PAL_WAIT_SET_DEL, 1, NULL, 0) != -PAL_ERROR_STREAMNOTEXIST) {
+        pal_printf("DkWaitSetCtl removed a nonexistent entry\n");
+        return 1;
+    }
+
+    if (check_ready(set, "Empty pipes", 0, 0, 0) < 0)
+        return 1;
+
+    PAL_NUM timeout_start, timeout_end;
+    PAL_NUM data;
+    PAL_FLG events;
+    PAL_NUM count;
+    DkSystemTimeQuery(&timeout_start);
+    ret = DkWaitSetWait(set, 1, &data, &events, &count, 10000);
+    DkSystemTimeQuery(&timeout_end);
+    if (ret != -PAL_ERROR_TRYAGAIN || timeout_end - timeout_start < 10000) {
+        pal_printf("Timed wait returned %d after %lu us\n", ret, timeout_end - timeout_start);
+        return 1;
+    }
+    pal_printf("Wait Set Timeout OK\n");
+
+    char c = 'x';
+    PAL_NUM size = 1;
+    ret = DkStreamWrite(pipes[7], 0, &size, &c, NULL);
+    if (ret < 0 || size != 1) {
+        pal_printf("DkStreamWrite failed: %d\n", ret);
+        return 1;
+    }
+    if (check_ready(set, "One readable pipe", 107, PAL_WAIT_READ, 1) < 0)
+        return 1;
+
+    /* the same handle added twice is reported once per entry */
+    ret = DkWaitSetCtl(set, PAL_WAIT_SET_ADD, 1000, pipes[7], PAL_WAIT_READ);
+    if (ret < 0 || check_ready(set, "Duplicated pipe", (PAL_NUM)-1, PAL_WAIT_READ, 2) < 0)
+        return 1;
+    ret = DkWaitSetCtl(set, PAL_WAIT_SET_DEL, 107, NULL, 0);
+    if (ret < 0 || check_ready(set, "Removed duplicate", 1000, PAL_WAIT_READ, 1) < 0)
+        return 1;
+    pal_printf("Wait Set Read OK\n");
+
+    /* move the entry to another handle, waiting for writability */
+    ret = DkWaitSetCtl(set, PAL_WAIT_SET_MOD, 1000, pipes[0], PAL_WAIT_WRITE);
+    if (ret < 0 || check_ready(set, "Writable pipe", 1000, PAL_WAIT_WRITE, 1) < 0)
+        return 1;
+    ret = DkWaitSetCtl(set, PAL_WAIT_SET_MOD, 1000, pipes[0], PAL_WAIT_READ);
+    if (ret < 0 || check_ready(set, "Modified entry", 0, 0, 0) < 0)
+        return 1;
+    pal_printf("Wait Set Modify OK\n");
+
+    for (int i = 0; i < PIPES; i++) {
+        if (i != 7 && DkWaitSetCtl(set, PAL_WAIT_SET_DEL, 100 + i, NULL, 0) < 0) {
+            pal_printf("DkWaitSetCtl(DEL) failed\n");
+            return 1;
+        }
+    }
+    if (DkWaitSetCtl(set, PAL_WAIT_SET_DEL, 1000, NULL, 0) < 0
+            || check_ready(set, "Empty set", 0, 0, 0) < 0)
+        return 1;
+
+    DkObjectClose(set);
+    for (int i = 0; i < PIPES; i++)
+        DkObjectClose(pipes[i]);
+
+    pal_printf("TEST OK\n");
+    return 0;
+}
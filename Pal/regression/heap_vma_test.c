@@ -0,0 +1,270 @@
+#include "heap_vma.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "api.h"
+#include "assert.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_regression.h"
+
+#define FAIL(fmt, ...)                                                  \
+    do {                                                                \
+        pal_printf("Line %u: " fmt "\n", __LINE__, ##__VA_ARGS__);      \
+        DkProcessExit(1);                                               \
+    } while (0)
+
+/* The heap is never touched, so any address range works. */
+#define HEAP_PAGES   (1UL << 18)
+#define HEAP_BOTTOM  ((void*)0x100000000000UL)
+#define HEAP_TOP     (HEAP_BOTTOM + HEAP_PAGES * PAGE_SIZE)
+#define POOL_SIZE    (1UL << 17)
+
+#define TRACE_OPS    200000
+#define CHECK_PERIOD 4096
+#define BENCH_VMAS   100000
+
+static uint32_t _seed;
+
+static void srand(uint32_t seed) {
+    _seed = seed;
+}
+
+/* source: https://elixir.bootlin.com/glibc/glibc-2.31/source/stdlib/rand_r.c */
+static int32_t rand(void) {
+    int32_t result;
+
+    _seed *= 1103515245;
+    _seed += 12345;
+    result = (uint32_t)(_seed / 65536) % 2048;
+
+    _seed *= 1103515245;
+    _seed += 12345;
+    result <<= 10;
+    result ^= (uint32_t)(_seed / 65536) % 1024;
+
+    _seed *= 1103515245;
+    _seed += 12345;
+    result <<= 10;
+    result ^= (uint32_t)(_seed / 65536) % 1024;
+
+    return result;
+}
+
+static struct heap_vma g_pool[POOL_SIZE];
+static struct heap_vma_mgr g_mgr;
+
+/* Reference model of the heap: one entry per page. */
+enum { PAGE_FREE = 0, PAGE_NORMAL, PAGE_INTERNAL };
+static unsigned char g_pages[HEAP_PAGES];
+
+static void* page_addr(size_t page) {
+    return HEAP_BOTTOM + page * PAGE_SIZE;
+}
+
+static size_t addr_page(void* addr) {
+    return (addr - HEAP_BOTTOM) / PAGE_SIZE;
+}
+
+static unsigned char page_kind(bool is_pal_internal) {
+    return is_pal_internal ? PAGE_INTERNAL : PAGE_NORMAL;
+}
+
+/* Returns the first page of the highest free run of `count` pages in the model, or -1. */
+static ssize_t model_find_free(size_t count) {
+    size_t run = 0;
+    for (size_t page = HEAP_PAGES; page > 0; page--) {
+        run = g_pages[page - 1] == PAGE_FREE ? run + 1 : 0;
+        if (run == count)
+            return page - 1;
+    }
+    return -1;
+}
+
+static void check_against_model(void) {
+    if (!debug_heap_vma_mgr_is_consistent(&g_mgr))
+        FAIL("inconsistent heap VMA bookkeeping");
+
+    size_t page = 0;
+    for (struct avl_tree_node* node = avl_tree_first(&g_mgr.vmas); node;
+            node = avl_tree_next(node)) {
+        struct heap_vma* vma = container_of(node, struct heap_vma, node);
+        for (; page < addr_page(vma->bottom); page++)
+            if (g_pages[page] != PAGE_FREE)
+                FAIL("page %lu should be free", page);
+        for (; page < addr_page(vma->top); page++)
+            if (g_pages[page] != page_kind(vma->is_pal_internal))
+                FAIL("page %lu has wrong kind", page);
+    }
+    for (; page < HEAP_PAGES; page++)
+        if (g_pages[page] != PAGE_FREE)
+            FAIL("page %lu should be free", page);
+
+    size_t top = HEAP_PAGES;
+    while (top > 0 && g_pages[top - 1] != PAGE_FREE)
+        top--;
+    if (heap_vma_get_free_top(&g_mgr) != page_addr(top))
+        FAIL("wrong free top");
+}
+
+static void trace_alloc_any(size_t op) {
+    size_t count = 1 + rand() % 16;
+    bool is_pal_internal = rand() % 8 == 0;
+    size_t allocated;
+
+    void* addr = heap_vma_alloc(&g_mgr, NULL, count * PAGE_SIZE, is_pal_internal, &allocated);
+    if (!addr) {
+        if (model_find_free(count) >= 0)
+            FAIL("allocation of %lu pages failed", count);
+        return;
+    }
+
+    size_t first = addr_page(addr);
+    /* finding the highest fitting area in the model is slow, so check it only once in a while */
+    if (op % 64 == 0 && model_find_free(count) != (ssize_t)first)
+        FAIL("allocation of %lu pages is not at the highest free area", count);
+    if (allocated != count * PAGE_SIZE)
+        FAIL("allocated %lu bytes instead of %lu", allocated, count * PAGE_SIZE);
+    for (size_t page = first; page < first + count; page++) {
+        if (g_pages[page] != PAGE_FREE)
+            FAIL("page %lu is already allocated", page);
+        g_pages[page] = page_kind(is_pal_internal);
+    }
+}
+
+static void trace_alloc_fixed(void) {
+    size_t first = rand() % HEAP_PAGES;
+    size_t count = MIN(1 + (size_t)rand() % 16, HEAP_PAGES - first);
+    bool is_pal_internal = rand() % 8 == 0;
+    size_t allocated;
+
+    bool conflict = false;
+    size_t expected = 0;
+    for (size_t page = first; page < first + count; page++) {
+        if (g_pages[page] == PAGE_FREE)
+            expected += PAGE_SIZE;
+        else if (g_pages[page] != page_kind(is_pal_internal))
+            conflict = true;
+    }
+
+    void* addr = heap_vma_alloc(&g_mgr, page_addr(first), count * PAGE_SIZE, is_pal_internal,
+                                &allocated);
+    if (conflict) {
+        if (addr)
+            FAIL("allocation over pages of the other kind succeeded");
+        return;
+    }
+    if (addr != page_addr(first))
+        FAIL("fixed allocation failed");
+    if (allocated != expected)
+        FAIL("allocated %lu bytes instead of %lu", allocated, expected);
+    for (size_t page = first; page < first + count; page++)
+        g_pages[page] = page_kind(is_pal_internal);
+}
+
+static void trace_free(void) {
+    size_t first = rand() % HEAP_PAGES;
+    size_t count = MIN(1 + (size_t)rand() % 32, HEAP_PAGES - first);
+
+    bool seen[PAGE_INTERNAL + 1] = { false };
+    size_t expected = 0;
+    for (size_t page = first; page < first + count; page++) {
+        seen[g_pages[page]] = true;
+        if (g_pages[page] != PAGE_FREE)
+            expected += PAGE_SIZE;
+    }
+
+    size_t freed;
+    bool is_pal_internal;
+    int ret = heap_vma_free(&g_mgr, page_addr(first), count * PAGE_SIZE, &freed,
+                            &is_pal_internal);
+    if (seen[PAGE_NORMAL] && seen[PAGE_INTERNAL]) {
+        if (ret != -PAL_ERROR_INVAL)
+            FAIL("freeing pages of both kinds returned %d", ret);
+        return;
+    }
+    if (ret < 0)
+        FAIL("free failed: %d", ret);
+    if (freed != expected)
+        FAIL("freed %lu bytes instead of %lu", freed, expected);
+    if (expected && is_pal_internal != seen[PAGE_INTERNAL])
+        FAIL("freed pages of wrong kind");
+    for (size_t page = first; page < first + count; page++)
+        g_pages[page] = PAGE_FREE;
+}
+
+static void test_random_trace(void) {
+    heap_vma_mgr_init(&g_mgr, HEAP_BOTTOM, HEAP_TOP, g_pool, POOL_SIZE);
+    srand(1337);
+
+    size_t max_vmas = 0;
+    for (size_t op = 0; op < TRACE_OPS; op++) {
+        int r = rand() % 100;
+        if (r < 45) {
+            trace_alloc_any(op);
+        } else if (r < 55) {
+            trace_alloc_fixed();
+        } else {
+            trace_free();
+        }
+
+        max_vmas = MAX(max_vmas, g_mgr.vma_count);
+        if (op % CHECK_PERIOD == 0)
+            check_against_model();
+    }
+    check_against_model();
+
+    pal_printf("Random trace OK (%u operations, up to %lu VMAs)\n", TRACE_OPS, max_vmas);
+}
+
+static uint64_t time_us(void) {
+    PAL_NUM time;
+    if (DkSystemTimeQuery(&time) < 0)
+        FAIL("DkSystemTimeQuery failed");
+    return time;
+}
+
+/* Single-page VMAs of alternating kinds cannot be merged, so each allocation adds a VMA. */
+static void bench(void) {
+    heap_vma_mgr_init(&g_mgr, HEAP_BOTTOM, HEAP_TOP, g_pool, POOL_SIZE);
+    size_t allocated;
+    size_t freed;
+    bool is_pal_internal;
+
+    uint64_t start = time_us();
+    for (size_t i = 0; i < BENCH_VMAS; i++) {
+        if (!heap_vma_alloc(&g_mgr, NULL, PAGE_SIZE, i % 2, &allocated))
+            FAIL("allocation %lu failed", i);
+    }
+    uint64_t end = time_us();
+    pal_printf("Allocated %u VMAs in %lu us\n", BENCH_VMAS, end - start);
+
+    /* punch a hole every 3 pages, then fill the holes again */
+    void* addr = heap_vma_get_free_top(&g_mgr);
+    start = time_us();
+    for (size_t i = 0; i < BENCH_VMAS; i += 3) {
+        if (heap_vma_free(&g_mgr, addr + i * PAGE_SIZE, PAGE_SIZE, &freed, &is_pal_internal) < 0)
+            FAIL("free %lu failed", i);
+    }
+    end = time_us();
+    pal_printf("Freed %u VMAs in %lu us\n", (BENCH_VMAS + 2) / 3, end - start);
+
+    start = time_us();
+    for (size_t i = 0; i < BENCH_VMAS; i += 3) {
+        if (!heap_vma_alloc(&g_mgr, NULL, PAGE_SIZE, /*is_pal_internal=*/false, &allocated))
+            FAIL("reallocation %lu failed", i);
+    }
+    end = time_us();
+    pal_printf("Reallocated %u VMAs in %lu us\n", (BENCH_VMAS + 2) / 3, end - start);
+
+    if (!debug_heap_vma_mgr_is_consistent(&g_mgr))
+        FAIL("inconsistent heap VMA bookkeeping");
+}
+
+int main(void) {
+    test_random_trace();
+    bench();
+    pal_printf("TEST OK\n");
+    return 0;
+}
@@ -33,6 +33,11 @@ class TC_00_Basic(RegressionTestCase):
     def test_002_avl_tree(self):
         _, _ = self.run_binary(['avl_tree_test'])
 
+    def test_003_heap_vma(self):
+        stdout, _ = self.run_binary(['heap_vma_test'])
+        self.assertIn('Random trace OK', stdout)
+        self.assertIn('TEST OK', stdout)
+
 
 @unittest.skipIf(HAS_SGX, "Not yet tested on SGX")
 class TC_00_BasicSet2(RegressionTestCase):
@@ -184,6 +189,8 @@ class TC_02_Symbols(RegressionTestCase):
         'DkStreamWaitForClient',
         'DkStreamRead',
         'DkStreamWrite',
+        'DkStreamsBatchIo',
+        'DkStreamTransfer',
         'DkStreamDelete',
         'DkStreamMap',
         'DkStreamUnmap',
@@ -206,8 +213,12 @@ class TC_02_Symbols(RegressionTestCase):
         'DkEventClear',
         'DkEventWait',
         'DkStreamsWaitEvents',
+        'DkWaitSetCreate',
+        'DkWaitSetCtl',
+        'DkWaitSetWait',
         'DkObjectClose',
         'DkSystemTimeQuery',
+        'DkSystemTimeCalibration',
         'DkRandomBitsRead',
         'DkMemoryAvailableQuota',
     ]
@@ -328,6 +339,26 @@ class TC_20_SingleProcess(RegressionTestCase):
         # File Deletion
         self.assertFalse(pathlib.Path('file_delete.tmp').exists())
 
+    def test_101_batch_io(self):
+        try:
+            pathlib.Path('batch_io.tmp').unlink()
+        except FileNotFoundError:
+            pass
+
+        _, stderr = self.run_binary(['BatchIo'])
+        self.assertIn('File Batch Write OK', stderr)
+        self.assertIn('File Batch Read OK', stderr)
+        self.assertIn('Pipe Batch OK', stderr)
+        self.assertIn('Batched reads:', stderr)
+        self.assertIn('TEST OK', stderr)
+
+    def test_102_wait_set(self):
+        _, stderr = self.run_binary(['WaitSet'])
+        self.assertIn('Wait Set Timeout OK', stderr)
+        self.assertIn('Wait Set Read OK', stderr)
+        self.assertIn('Wait Set Modify OK', stderr)
+        self.assertIn('TEST OK', stderr)
+
     def test_110_directory(self):
         for path in ['dir_exist.tmp', 'dir_nonexist.tmp', 'dir_delete.tmp']:
             try:
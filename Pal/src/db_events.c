@@ -8,21 +8,29 @@
 #include "pal_internal.h"
 
 int DkEventCreate(PAL_HANDLE* handle, bool init_signaled, bool auto_clear) {
+    PAL_STATS_CALL(EventCreate);
+
     *handle = NULL;
     return _DkEventCreate(handle, init_signaled, auto_clear);
 }
 
 void DkEventSet(PAL_HANDLE handle) {
+    PAL_STATS_CALL(EventSet);
+
     assert(handle && IS_HANDLE_TYPE(handle, event));
     _DkEventSet(handle);
 }
 
 void DkEventClear(PAL_HANDLE handle) {
+    PAL_STATS_CALL(EventClear);
+
     assert(handle && IS_HANDLE_TYPE(handle, event));
     _DkEventClear(handle);
 }
 
 int DkEventWait(PAL_HANDLE handle, uint64_t* timeout_us) {
+    PAL_STATS_CALL(EventWait);
+
     assert(handle && IS_HANDLE_TYPE(handle, event));
     return _DkEventWait(handle, timeout_us);
 }
@@ -10,13 +10,13 @@
 
 #include "api.h"
 #include "elf/elf.h"
+#include "manifest.h"
 #include "pal.h"
 #include "pal_defs.h"
 #include "pal_error.h"
 #include "pal_internal.h"
 #include "pal_rtld.h"
 #include "sysdeps/generic/ldsodefs.h"
-#include "toml.h"
 
 PAL_CONTROL g_pal_control = {
     /* Enable log to catch early initialization errors; it will be overwritten in pal_main(). */
@@ -35,7 +35,7 @@ static void load_libraries(void) {
 
     /* FIXME: rewrite to use array-of-strings TOML syntax */
     /* string with preload libs: can be multiple URIs separated by commas */
-    ret = toml_string_in(g_pal_state.manifest_root, "loader.preload", &preload_str);
+    ret = manifest_string_in(g_pal_state.manifest_root, "loader.preload", &preload_str);
     if (ret < 0)
         INIT_FAIL_MANIFEST(PAL_ERROR_INVAL, "Cannot parse 'loader.preload'");
 
@@ -67,19 +67,24 @@ static void load_libraries(void) {
 /* This function leaks memory on failure (and this is non-trivial to fix), but the assumption is
  * that its failure finishes the execution of the whole process right away. */
 static int insert_envs_from_manifest(const char*** envpp) {
-    int ret;
     assert(envpp);
 
-    toml_table_t* toml_loader = toml_table_in(g_pal_state.manifest_root, "loader");
-    if (!toml_loader)
-        return 0;
-
-    toml_table_t* toml_envs = toml_table_in(toml_loader, "env");
-    if (!toml_envs)
+    const struct manifest* manifest = g_pal_state.manifest_root;
+    const struct manifest_node* manifest_envs = manifest_lookup(manifest, "loader.env");
+    if (!manifest_envs || manifest_envs->type != MANIFEST_NODE_TABLE)
         return 0;
 
-    ssize_t toml_envs_cnt = toml_table_nkval(toml_envs);
-    if (toml_envs_cnt <= 0) {
+    /* envs are string values, subtables are skipped */
+    size_t manifest_envs_cnt = 0;
+    for (size_t i = 0; i < manifest_node_count(manifest_envs); i++) {
+        const struct manifest_node* env = manifest_node_child(manifest, manifest_envs, i);
+        if (env->type == MANIFEST_NODE_TABLE || env->type == MANIFEST_NODE_ARRAY)
+            continue;
+        if (env->type != MANIFEST_NODE_STRING)
+            return -PAL_ERROR_INVAL;
+        manifest_envs_cnt++;
+    }
+    if (manifest_envs_cnt == 0) {
         /* no env entries found in the manifest */
         return 0;
     }
@@ -91,16 +96,15 @@ static int insert_envs_from_manifest(const char*** envpp) {
         if (!orig_env_key_end)
             return -PAL_ERROR_INVAL;
 
-        *orig_env_key_end = '\0';
-        toml_raw_t toml_env_raw = toml_raw_in(toml_envs, *orig_env);
-        if (toml_env_raw) {
+        const struct manifest_node* env = manifest_table_get(manifest, manifest_envs, *orig_env,
+                                                             orig_env_key_end - *orig_env);
+        if (env && env->type == MANIFEST_NODE_STRING) {
             /* found the original-env key in manifest (i.e., loader.env.<key> exists) */
             overwrite_cnt++;
         }
-        *orig_env_key_end = '=';
     }
 
-    size_t total_envs_cnt = orig_envs_cnt + toml_envs_cnt - overwrite_cnt;
+    size_t total_envs_cnt = orig_envs_cnt + manifest_envs_cnt - overwrite_cnt;
     const char** new_envp = calloc(total_envs_cnt + 1, sizeof(const char*));
     if (!new_envp)
         return -PAL_ERROR_NOMEM;
@@ -112,11 +116,10 @@ static int insert_envs_from_manifest(const char*** envpp) {
     for (const char** orig_env = *envpp; *orig_env; orig_env++) {
         char* orig_env_key_end = strchr(*orig_env, '=');
 
-        *orig_env_key_end = '\0';
-        toml_raw_t toml_env_raw = toml_raw_in(toml_envs, *orig_env);
-        if (!toml_env_raw) {
+        const struct manifest_node* env = manifest_table_get(manifest, manifest_envs, *orig_env,
+                                                             orig_env_key_end - *orig_env);
+        if (!env || env->type != MANIFEST_NODE_STRING) {
             /* this original env is not found in manifest (i.e., not overwritten) */
-            *orig_env_key_end = '=';
             new_envp[idx] = malloc_copy(*orig_env, strlen(*orig_env) + 1);
             if (!new_envp[idx]) {
                 /* don't care about proper memory cleanup since will terminate anyway */
@@ -124,27 +127,22 @@ static int insert_envs_from_manifest(const char*** envpp) {
             }
             idx++;
         }
-        *orig_env_key_end = '=';
     }
     assert(idx < total_envs_cnt);
 
-    for (ssize_t i = 0; i < toml_envs_cnt; i++) {
-        const char* toml_env_key = toml_key_in(toml_envs, i);
-        assert(toml_env_key);
-        toml_raw_t toml_env_value_raw = toml_raw_in(toml_envs, toml_env_key);
-        assert(toml_env_value_raw);
+    for (size_t i = 0; i < manifest_node_count(manifest_envs); i++) {
+        const struct manifest_node* env = manifest_node_child(manifest, manifest_envs, i);
+        const char* env_value = manifest_node_str(manifest, env);
+        if (!env_value)
+            continue;
 
-        char* toml_env_value = NULL;
-        ret = toml_rtos(toml_env_value_raw, &toml_env_value);
-        if (ret < 0) {
+        char* final_env = alloc_concat3(manifest_node_key(manifest, env), env->key_len, "=", 1,
+                                        env_value, env->count);
+        if (!final_env) {
             /* don't care about proper memory cleanup since will terminate anyway */
             return -PAL_ERROR_NOMEM;
         }
-
-        char* final_env = alloc_concat3(toml_env_key, strlen(toml_env_key), "=", 1, toml_env_value,
-                                        strlen(toml_env_value));
         new_envp[idx++] = final_env;
-        free(toml_env_value);
     }
     assert(idx == total_envs_cnt);
 
@@ -157,7 +155,7 @@ static void configure_logging(void) {
     int log_level = PAL_LOG_DEFAULT_LEVEL;
 
     char* debug_type = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "loader.debug_type", &debug_type);
+    ret = manifest_string_in(g_pal_state.manifest_root, "loader.debug_type", &debug_type);
     if (ret < 0)
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.debug_type'");
     if (debug_type) {
@@ -167,7 +165,7 @@ static void configure_logging(void) {
     }
 
     char* log_level_str = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "loader.log_level", &log_level_str);
+    ret = manifest_string_in(g_pal_state.manifest_root, "loader.log_level", &log_level_str);
     if (ret < 0)
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.log_level'");
 
@@ -191,7 +189,7 @@ static void configure_logging(void) {
     free(log_level_str);
 
     char* log_file = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "loader.log_file", &log_file);
+    ret = manifest_string_in(g_pal_state.manifest_root, "loader.log_file", &log_file);
     if (ret < 0)
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.log_file'");
 
@@ -290,15 +288,15 @@ noreturn void pal_main(uint64_t instance_id,       /* current instance id */
     configure_logging();
 
     char* dummy_exec_str = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "loader.exec", &dummy_exec_str);
+    ret = manifest_string_in(g_pal_state.manifest_root, "loader.exec", &dummy_exec_str);
     if (ret < 0 || dummy_exec_str)
         INIT_FAIL(PAL_ERROR_INVAL, "loader.exec is not supported anymore. Please update your "
                                    "manifest according to the current documentation.");
     free(dummy_exec_str);
 
     bool disable_aslr;
-    ret = toml_bool_in(g_pal_state.manifest_root, "loader.insecure__disable_aslr",
-                       /*defaultval=*/false, &disable_aslr);
+    ret = manifest_bool_in(g_pal_state.manifest_root, "loader.insecure__disable_aslr",
+                           /*defaultval=*/false, &disable_aslr);
     if (ret < 0) {
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.insecure__disable_aslr' "
                                              "(the value must be `true` or `false`)");
@@ -312,7 +310,7 @@ noreturn void pal_main(uint64_t instance_id,       /* current instance id */
      */
     bool argv0_overridden = false;
     char* argv0_override = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "loader.argv0_override", &argv0_override);
+    ret = manifest_string_in(g_pal_state.manifest_root, "loader.argv0_override", &argv0_override);
     if (ret < 0)
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.argv0_override'");
 
@@ -328,8 +326,8 @@ noreturn void pal_main(uint64_t instance_id,       /* current instance id */
     }
 
     bool use_cmdline_argv;
-    ret = toml_bool_in(g_pal_state.manifest_root, "loader.insecure__use_cmdline_argv",
-                       /*defaultval=*/false, &use_cmdline_argv);
+    ret = manifest_bool_in(g_pal_state.manifest_root, "loader.insecure__use_cmdline_argv",
+                           /*defaultval=*/false, &use_cmdline_argv);
     if (ret < 0) {
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.insecure__use_cmdline_argv' "
                                              "(the value must be `true` or `false`)");
@@ -344,7 +342,7 @@ noreturn void pal_main(uint64_t instance_id,       /* current instance id */
     } else {
         char* argv_src_file = NULL;
 
-        ret = toml_string_in(g_pal_state.manifest_root, "loader.argv_src_file", &argv_src_file);
+        ret = manifest_string_in(g_pal_state.manifest_root, "loader.argv_src_file", &argv_src_file);
         if (ret < 0)
             INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.argv_src_file'");
 
@@ -367,8 +365,8 @@ noreturn void pal_main(uint64_t instance_id,       /* current instance id */
     }
 
     bool use_host_env;
-    ret = toml_bool_in(g_pal_state.manifest_root, "loader.insecure__use_host_env",
-                       /*defaultval=*/false, &use_host_env);
+    ret = manifest_bool_in(g_pal_state.manifest_root, "loader.insecure__use_host_env",
+                           /*defaultval=*/false, &use_host_env);
     if (ret < 0) {
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.insecure__use_host_env' "
                                              "(the value must be `true` or `false`)");
@@ -389,7 +387,7 @@ noreturn void pal_main(uint64_t instance_id,       /* current instance id */
     }
 
     char* env_src_file = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "loader.env_src_file", &env_src_file);
+    ret = manifest_string_in(g_pal_state.manifest_root, "loader.env_src_file", &env_src_file);
     if (ret < 0)
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.env_src_file'");
 
@@ -418,7 +416,7 @@ noreturn void pal_main(uint64_t instance_id,       /* current instance id */
     // TODO: This is just an ugly, temporary hack for PAL regression tests and should only be used
     // there until we clean up the way LibOS is loaded.
     char* entrypoint;
-    ret = toml_string_in(g_pal_state.manifest_root, "pal.entrypoint", &entrypoint);
+    ret = manifest_string_in(g_pal_state.manifest_root, "pal.entrypoint", &entrypoint);
     if (ret < 0)
         INIT_FAIL_MANIFEST(PAL_ERROR_INVAL, "Cannot parse 'pal.entrypoint'");
     if (entrypoint) {
@@ -426,6 +424,11 @@ noreturn void pal_main(uint64_t instance_id,       /* current instance id */
             INIT_FAIL(PAL_ERROR_INVAL, "'pal.entrypoint' is missing 'file:' prefix");
     }
 
+    ret = init_pal_stats();
+    if (ret < 0)
+        INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, "Cannot parse 'loader.enable_pal_stats' "
+                                             "(the value must be `true` or `false`)");
+
     g_pal_control.host_type       = XSTRINGIFY(HOST_TYPE);
     g_pal_control.manifest_root   = g_pal_state.manifest_root;
     g_pal_control.parent_process  = parent_process;
@@ -12,6 +12,8 @@
 #include "pal_internal.h"
 
 int DkVirtualMemoryAlloc(PAL_PTR* addr, PAL_NUM size, PAL_FLG alloc_type, PAL_FLG prot) {
+    PAL_STATS_CALL(VirtualMemoryAlloc);
+
     assert(addr);
     void* map_addr = *addr;
 
@@ -35,6 +37,8 @@ int DkVirtualMemoryAlloc(PAL_PTR* addr, PAL_NUM size, PAL_FLG alloc_type, PAL_FL
 }
 
 int DkVirtualMemoryFree(PAL_PTR addr, PAL_NUM size) {
+    PAL_STATS_CALL(VirtualMemoryFree);
+
     if (!addr || !size) {
         return -PAL_ERROR_INVAL;
     }
@@ -51,6 +55,8 @@ int DkVirtualMemoryFree(PAL_PTR addr, PAL_NUM size) {
 }
 
 int DkVirtualMemoryProtect(PAL_PTR addr, PAL_NUM size, PAL_FLG prot) {
+    PAL_STATS_CALL(VirtualMemoryProtect);
+
     if (!addr || !size) {
         return -PAL_ERROR_INVAL;
     }
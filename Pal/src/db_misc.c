@@ -12,24 +12,40 @@
 #include "pal_internal.h"
 
 int DkSystemTimeQuery(PAL_NUM* time) {
+    PAL_STATS_CALL(SystemTimeQuery);
+
     return _DkSystemTimeQuery(time);
 }
 
+int DkSystemTimeCalibration(PAL_TIME_CALIBRATION* calib) {
+    PAL_STATS_CALL(SystemTimeCalibration);
+
+    return _DkSystemTimeCalibration(calib);
+}
+
 int DkRandomBitsRead(PAL_PTR buffer, PAL_NUM size) {
+    PAL_STATS_CALL(RandomBitsRead);
+
     return _DkRandomBitsRead((void*)buffer, size);
 }
 
 #if defined(__x86_64__)
 int DkSegmentRegisterGet(PAL_FLG reg, PAL_PTR* addr) {
+    PAL_STATS_CALL(SegmentRegisterGet);
+
     return _DkSegmentRegisterGet(reg, addr);
 }
 
 int DkSegmentRegisterSet(PAL_FLG reg, PAL_PTR addr) {
+    PAL_STATS_CALL(SegmentRegisterSet);
+
     return _DkSegmentRegisterSet(reg, addr);
 }
 #endif
 
 PAL_NUM DkMemoryAvailableQuota(void) {
+    PAL_STATS_CALL(MemoryAvailableQuota);
+
     long quota = _DkMemoryAvailableQuota();
     if (quota < 0)
         quota = 0;
@@ -38,6 +54,8 @@ PAL_NUM DkMemoryAvailableQuota(void) {
 }
 
 int DkCpuIdRetrieve(PAL_IDX leaf, PAL_IDX subleaf, PAL_IDX values[4]) {
+    PAL_STATS_CALL(CpuIdRetrieve);
+
     unsigned int vals[4];
     int ret = _DkCpuIdRetrieve(leaf, subleaf, vals);
     if (ret < 0) {
@@ -55,15 +73,21 @@ int DkCpuIdRetrieve(PAL_IDX leaf, PAL_IDX subleaf, PAL_IDX values[4]) {
 int DkAttestationReport(PAL_PTR user_report_data, PAL_NUM* user_report_data_size,
                         PAL_PTR target_info, PAL_NUM* target_info_size, PAL_PTR report,
                         PAL_NUM* report_size) {
+    PAL_STATS_CALL(AttestationReport);
+
     return _DkAttestationReport(user_report_data, user_report_data_size, target_info,
                                 target_info_size, report, report_size);
 }
 
 int DkAttestationQuote(PAL_PTR user_report_data, PAL_NUM user_report_data_size, PAL_PTR quote,
                        PAL_NUM* quote_size) {
+    PAL_STATS_CALL(AttestationQuote);
+
     return _DkAttestationQuote(user_report_data, user_report_data_size, quote, quote_size);
 }
 
 int DkSetProtectedFilesKey(PAL_PTR pf_key_hex) {
+    PAL_STATS_CALL(SetProtectedFilesKey);
+
     return _DkSetProtectedFilesKey(pf_key_hex);
 }
@@ -42,6 +42,8 @@ int _DkObjectClose(PAL_HANDLE objectHandle) {
  */
 /* PAL call DkObjectClose: Close the given object handle. */
 void DkObjectClose(PAL_HANDLE objectHandle) {
+    PAL_STATS_CALL(ObjectClose);
+
     assert(objectHandle);
 
     _DkObjectClose(objectHandle);
@@ -52,6 +54,8 @@ void DkObjectClose(PAL_HANDLE objectHandle) {
  * error code otherwise. */
 int DkStreamsWaitEvents(PAL_NUM count, PAL_HANDLE* handle_array, PAL_FLG* events,
                         PAL_FLG* ret_events, PAL_NUM timeout_us) {
+    PAL_STATS_CALL(StreamsWaitEvents);
+
     for (PAL_NUM i = 0; i < count; i++) {
         if (UNKNOWN_HANDLE(handle_array[i])) {
             return -PAL_ERROR_INVAL;
@@ -60,3 +64,43 @@ int DkStreamsWaitEvents(PAL_NUM count, PAL_HANDLE* handle_array, PAL_FLG* events
 
     return _DkStreamsWaitEvents(count, handle_array, events, ret_events, timeout_us);
 }
+
+int DkWaitSetCreate(PAL_HANDLE* handle) {
+    PAL_STATS_CALL(WaitSetCreate);
+
+    *handle = NULL;
+    return _DkWaitSetCreate(handle);
+}
+
+int DkWaitSetCtl(PAL_HANDLE wait_set, enum PAL_WAIT_SET_OP op, PAL_NUM data, PAL_HANDLE handle,
+                 PAL_FLG events) {
+    PAL_STATS_CALL(WaitSetCtl);
+
+    if (!wait_set || !IS_HANDLE_TYPE(wait_set, waitset))
+        return -PAL_ERROR_BADHANDLE;
+
+    if (op != PAL_WAIT_SET_DEL) {
+        if (!handle || UNKNOWN_HANDLE(handle) || IS_HANDLE_TYPE(handle, waitset))
+            return -PAL_ERROR_INVAL;
+        if (!(events & (PAL_WAIT_READ | PAL_WAIT_WRITE)))
+            return -PAL_ERROR_INVAL;
+    }
+
+    return _DkWaitSetCtl(wait_set, op, data, handle, events & (PAL_WAIT_READ | PAL_WAIT_WRITE));
+}
+
+int DkWaitSetWait(PAL_HANDLE wait_set, PAL_NUM max_count, PAL_NUM* ret_data, PAL_FLG* ret_events,
+                  PAL_NUM* ret_count, PAL_NUM timeout_us) {
+    PAL_STATS_CALL(WaitSetWait);
+
+    if (!wait_set || !IS_HANDLE_TYPE(wait_set, waitset))
+        return -PAL_ERROR_BADHANDLE;
+
+    if (!max_count || !ret_data || !ret_events || !ret_count)
+        return -PAL_ERROR_INVAL;
+
+    size_t count = 0;
+    int ret = _DkWaitSetWait(wait_set, max_count, ret_data, ret_events, &count, timeout_us);
+    *ret_count = count;
+    return ret;
+}
@@ -16,11 +16,14 @@
 #include "pal_internal.h"
 
 int DkProcessCreate(PAL_STR* args, PAL_HANDLE* handle) {
+    PAL_STATS_CALL(ProcessCreate);
+
     *handle = NULL;
     return _DkProcessCreate(handle, args);
 }
 
 noreturn void DkProcessExit(PAL_NUM exitcode) {
+    pal_stats_dump();
     _DkProcessExit(exitcode);
     die_or_inf_loop();
 }
@@ -25,6 +25,7 @@ extern struct handle_ops g_thread_ops;
 extern struct handle_ops g_proc_ops;
 extern struct handle_ops g_event_ops;
 extern struct handle_ops g_eventfd_ops;
+extern struct handle_ops g_waitset_ops;
 
 const struct handle_ops* g_pal_handle_ops[PAL_HANDLE_TYPE_BOUND] = {
     [pal_type_file]    = &g_file_ops,
@@ -42,6 +43,7 @@ const struct handle_ops* g_pal_handle_ops[PAL_HANDLE_TYPE_BOUND] = {
     [pal_type_thread]  = &g_thread_ops,
     [pal_type_event]   = &g_event_ops,
     [pal_type_eventfd] = &g_eventfd_ops,
+    [pal_type_waitset] = &g_waitset_ops,
 };
 
 /* parse_stream_uri scan the uri, seperate prefix and search for
@@ -161,6 +163,8 @@ int _DkStreamOpen(PAL_HANDLE* handle, const char* uri, int access, int share, in
  */
 int DkStreamOpen(PAL_STR uri, PAL_FLG access, PAL_FLG share, PAL_FLG create, PAL_FLG options,
                  PAL_HANDLE* handle) {
+    PAL_STATS_CALL(StreamOpen);
+
     *handle = NULL;
     return _DkStreamOpen(handle, uri, access, share, create, options);
 }
@@ -180,6 +184,8 @@ static int _DkStreamWaitForClient(PAL_HANDLE handle, PAL_HANDLE* client) {
 }
 
 int DkStreamWaitForClient(PAL_HANDLE handle, PAL_HANDLE* client) {
+    PAL_STATS_CALL(StreamWaitForClient);
+
     *client = NULL;
     return _DkStreamWaitForClient(handle, client);
 }
@@ -202,6 +208,8 @@ int _DkStreamDelete(PAL_HANDLE handle, int access) {
 }
 
 int DkStreamDelete(PAL_HANDLE handle, PAL_FLG access) {
+    PAL_STATS_CALL(StreamDelete);
+
     if (!handle) {
         return -PAL_ERROR_INVAL;
     }
@@ -237,6 +245,8 @@ int64_t _DkStreamRead(PAL_HANDLE handle, uint64_t offset, uint64_t count, void*
 
 int DkStreamRead(PAL_HANDLE handle, PAL_NUM offset, PAL_NUM* count, PAL_PTR buffer, PAL_PTR source,
                  PAL_NUM size) {
+    PAL_STATS_CALL(StreamRead);
+
     if (!handle || !buffer) {
         return -PAL_ERROR_INVAL;
     }
@@ -279,6 +289,8 @@ int64_t _DkStreamWrite(PAL_HANDLE handle, uint64_t offset, uint64_t count, const
 }
 
 int DkStreamWrite(PAL_HANDLE handle, PAL_NUM offset, PAL_NUM* count, PAL_PTR buffer, PAL_STR dest) {
+    PAL_STATS_CALL(StreamWrite);
+
     if (!handle || !buffer) {
         return -PAL_ERROR_INVAL;
     }
@@ -294,6 +306,126 @@ int DkStreamWrite(PAL_HANDLE handle, PAL_NUM offset, PAL_NUM* count, PAL_PTR buf
     return 0;
 }
 
+/* Generic implementation of a single batched I/O request, used by hosts for streams which they
+ * cannot submit to the host kernel in one go. Issues one read/write per buffer and stops at the
+ * first short transfer, like LibOS readv/writev emulation does. Only files are seekable, other
+ * streams require zero offset. */
+int64_t _DkStreamIoRequest(PAL_IO_REQUEST* req) {
+    bool seekable = IS_HANDLE_TYPE(req->handle, file);
+    int64_t done = 0;
+
+    for (size_t i = 0; i < req->iov_cnt; i++) {
+        if (!req->iov[i].count)
+            continue;
+
+        uint64_t offset = seekable ? req->offset + done : 0;
+        int64_t ret;
+        if (req->op == PAL_IO_READ) {
+            ret = _DkStreamRead(req->handle, offset, req->iov[i].count, req->iov[i].buffer,
+                                /*addr=*/NULL, /*addrlen=*/0);
+        } else {
+            ret = _DkStreamWrite(req->handle, offset, req->iov[i].count, req->iov[i].buffer,
+                                 /*addr=*/NULL, /*addrlen=*/0);
+        }
+
+        if (ret < 0)
+            return done ? done : ret;
+
+        done += ret;
+        if ((uint64_t)ret < req->iov[i].count)
+            break;
+    }
+
+    return done;
+}
+
+int DkStreamsBatchIo(PAL_NUM count, PAL_IO_REQUEST* reqs) {
+    PAL_STATS_CALL(StreamsBatchIo);
+
+    if (!count || count > PAL_IO_MAX_BATCH || !reqs)
+        return -PAL_ERROR_INVAL;
+
+    for (size_t i = 0; i < count; i++) {
+        PAL_IO_REQUEST* req = &reqs[i];
+        if (!req->handle || UNKNOWN_HANDLE(req->handle) || req->iov_cnt > PAL_IO_MAX_IOV ||
+                (req->iov_cnt && !req->iov) ||
+                (req->op != PAL_IO_READ && req->op != PAL_IO_WRITE))
+            return -PAL_ERROR_INVAL;
+
+        uint64_t total = 0;
+        for (size_t j = 0; j < req->iov_cnt; j++) {
+            if (req->iov[j].count && !req->iov[j].buffer)
+                return -PAL_ERROR_INVAL;
+            if (__builtin_add_overflow(total, req->iov[j].count, &total) || total > INT64_MAX)
+                return -PAL_ERROR_INVAL;
+        }
+        req->result = 0;
+    }
+
+    return _DkStreamsBatchIo(count, reqs);
+}
+
+/* Generic implementation of a transfer, used by hosts for pairs of streams which they cannot pass to
+ * the host kernel. Copies the data through a bounce buffer in chunks of at most
+ * TRANSFER_CHUNK_SIZE; only files are seekable, like in _DkStreamIoRequest. */
+#define TRANSFER_CHUNK_SIZE (128 * 1024UL)
+
+int64_t _DkStreamTransferCopy(PAL_HANDLE src, uint64_t src_offset, PAL_HANDLE dst,
+                              uint64_t dst_offset, uint64_t count) {
+    bool src_seekable = IS_HANDLE_TYPE(src, file);
+    bool dst_seekable = IS_HANDLE_TYPE(dst, file);
+    size_t buf_size = MIN(count, TRANSFER_CHUNK_SIZE);
+
+    char* buf = malloc(buf_size);
+    if (!buf)
+        return -PAL_ERROR_NOMEM;
+
+    int64_t ret = 0;
+    uint64_t done = 0;
+    while (done < count) {
+        ret = _DkStreamRead(src, src_seekable ? src_offset + done : 0, MIN(count - done, buf_size),
+                            buf, /*addr=*/NULL, /*addrlen=*/0);
+        if (ret <= 0)
+            break;
+
+        uint64_t chunk = ret;
+        uint64_t written = 0;
+        while (written < chunk) {
+            ret = _DkStreamWrite(dst, dst_seekable ? dst_offset + done + written : 0,
+                                 chunk - written, buf + written, /*addr=*/NULL, /*addrlen=*/0);
+            if (ret <= 0)
+                break;
+            written += ret;
+        }
+
+        done += written;
+        if (written < chunk)
+            break;
+    }
+
+    free(buf);
+    return done ? (int64_t)done : ret;
+}
+
+int DkStreamTransfer(PAL_HANDLE src, PAL_NUM src_offset, PAL_HANDLE dst, PAL_NUM dst_offset,
+                     PAL_NUM* count) {
+    PAL_STATS_CALL(StreamTransfer);
+
+    if (!src || !dst || UNKNOWN_HANDLE(src) || UNKNOWN_HANDLE(dst) || !count)
+        return -PAL_ERROR_INVAL;
+
+    if (!*count)
+        return 0;
+
+    int64_t ret = _DkStreamTransfer(src, src_offset, dst, dst_offset,
+                                    MIN(*count, (PAL_NUM)INT64_MAX));
+    if (ret < 0)
+        return ret;
+
+    *count = ret;
+    return 0;
+}
+
 /* _DkStreamAttributesQuery of internal use. The function query attribute
    of streams by their URI */
 int _DkStreamAttributesQuery(const char* uri, PAL_STREAM_ATTR* attr) {
@@ -316,6 +448,8 @@ out:
 }
 
 int DkStreamAttributesQuery(PAL_STR uri, PAL_STREAM_ATTR* attr) {
+    PAL_STATS_CALL(StreamAttributesQuery);
+
     if (!uri || !attr) {
         return -PAL_ERROR_INVAL;
     }
@@ -347,6 +481,8 @@ int _DkStreamAttributesQueryByHandle(PAL_HANDLE hdl, PAL_STREAM_ATTR* attr) {
 }
 
 int DkStreamAttributesQueryByHandle(PAL_HANDLE handle, PAL_STREAM_ATTR* attr) {
+    PAL_STATS_CALL(StreamAttributesQueryByHandle);
+
     if (!handle || !attr) {
         return -PAL_ERROR_INVAL;
     }
@@ -355,6 +491,8 @@ int DkStreamAttributesQueryByHandle(PAL_HANDLE handle, PAL_STREAM_ATTR* attr) {
 }
 
 int DkStreamAttributesSetByHandle(PAL_HANDLE handle, PAL_STREAM_ATTR* attr) {
+    PAL_STATS_CALL(StreamAttributesSetByHandle);
+
     if (!handle || !attr) {
         return -PAL_ERROR_INVAL;
     }
@@ -390,6 +528,8 @@ int _DkStreamGetName(PAL_HANDLE handle, char* buffer, size_t size) {
 }
 
 int DkStreamGetName(PAL_HANDLE handle, PAL_PTR buffer, PAL_NUM size) {
+    PAL_STATS_CALL(StreamGetName);
+
     if (!handle || !buffer || !size) {
         return -PAL_ERROR_INVAL;
     }
@@ -422,6 +562,8 @@ int _DkStreamMap(PAL_HANDLE handle, void** paddr, int prot, uint64_t offset, uin
 }
 
 int DkStreamMap(PAL_HANDLE handle, PAL_PTR* addr, PAL_FLG prot, PAL_NUM offset, PAL_NUM size) {
+    PAL_STATS_CALL(StreamMap);
+
     assert(addr);
     void* map_addr = *addr;
 
@@ -447,6 +589,8 @@ int DkStreamMap(PAL_HANDLE handle, PAL_PTR* addr, PAL_FLG prot, PAL_NUM offset,
 }
 
 int DkStreamUnmap(PAL_PTR addr, PAL_NUM size) {
+    PAL_STATS_CALL(StreamUnmap);
+
     if (!addr || !IS_ALLOC_ALIGNED_PTR(addr) || !size || !IS_ALLOC_ALIGNED(size)) {
         return -PAL_ERROR_INVAL;
     }
@@ -473,6 +617,8 @@ int64_t _DkStreamSetLength(PAL_HANDLE handle, uint64_t length) {
 }
 
 int DkStreamSetLength(PAL_HANDLE handle, PAL_NUM length) {
+    PAL_STATS_CALL(StreamSetLength);
+
     if (!handle) {
         return -PAL_ERROR_INVAL;
     }
@@ -505,6 +651,8 @@ int _DkStreamFlush(PAL_HANDLE handle) {
 }
 
 int DkStreamFlush(PAL_HANDLE handle) {
+    PAL_STATS_CALL(StreamFlush);
+
     if (!handle) {
         return -PAL_ERROR_INVAL;
     }
@@ -513,6 +661,8 @@ int DkStreamFlush(PAL_HANDLE handle) {
 }
 
 int DkSendHandle(PAL_HANDLE handle, PAL_HANDLE cargo) {
+    PAL_STATS_CALL(SendHandle);
+
     // Return error if any of the handle is NULL
     if (!handle || !cargo) {
         return -PAL_ERROR_INVAL;
@@ -522,6 +672,8 @@ int DkSendHandle(PAL_HANDLE handle, PAL_HANDLE cargo) {
 }
 
 int DkReceiveHandle(PAL_HANDLE handle, PAL_HANDLE* cargo) {
+    PAL_STATS_CALL(ReceiveHandle);
+
     // return error if any of the handle is NULL
     if (!handle) {
         return -PAL_ERROR_INVAL;
@@ -532,6 +684,8 @@ int DkReceiveHandle(PAL_HANDLE handle, PAL_HANDLE* cargo) {
 }
 
 int DkStreamChangeName(PAL_HANDLE hdl, PAL_STR uri) {
+    PAL_STATS_CALL(StreamChangeName);
+
     struct handle_ops* ops = NULL;
     char* type = NULL;
     int ret;
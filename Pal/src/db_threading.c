@@ -13,12 +13,16 @@
 
 /* PAL call DkThreadCreate: create a thread inside the current process */
 int DkThreadCreate(PAL_PTR addr, PAL_PTR param, PAL_HANDLE* handle) {
+    PAL_STATS_CALL(ThreadCreate);
+
     *handle = NULL;
     return _DkThreadCreate(handle, (int (*)(void*))addr, (const void*)param);
 }
 
 /* PAL call DkThreadYieldExecution. Yield the execution of the current thread. */
 void DkThreadYieldExecution(void) {
+    PAL_STATS_CALL(ThreadYieldExecution);
+
     _DkThreadYieldExecution();
 }
 
@@ -30,6 +34,8 @@ noreturn void DkThreadExit(PAL_PTR clear_child_tid) {
 
 /* PAL call DkThreadResume: resume the execution of a thread which is delayed before */
 int DkThreadResume(PAL_HANDLE threadHandle) {
+    PAL_STATS_CALL(ThreadResume);
+
     if (!threadHandle || !IS_HANDLE_TYPE(threadHandle, thread)) {
         return -PAL_ERROR_INVAL;
     }
@@ -38,9 +44,13 @@ int DkThreadResume(PAL_HANDLE threadHandle) {
 }
 
 int DkThreadSetCpuAffinity(PAL_HANDLE thread, PAL_NUM cpumask_size, PAL_PTR cpu_mask) {
+    PAL_STATS_CALL(ThreadSetCpuAffinity);
+
     return _DkThreadSetCpuAffinity(thread, cpumask_size, cpu_mask);
 }
 
 int DkThreadGetCpuAffinity(PAL_HANDLE thread, PAL_NUM cpumask_size, PAL_PTR cpu_mask) {
+    PAL_STATS_CALL(ThreadGetCpuAffinity);
+
     return _DkThreadGetCpuAffinity(thread, cpumask_size, cpu_mask);
 }
@@ -19,6 +19,7 @@
 #include "ecall_types.h"
 #include "elf/elf.h"
 #include "enclave_pages.h"
+#include "manifest.h"
 #include "pal.h"
 #include "pal_defs.h"
 #include "pal_error.h"
@@ -28,7 +29,6 @@
 #include "pal_security.h"
 #include "protected_files.h"
 #include "sysdeps/generic/ldsodefs.h"
-#include "toml.h"
 
 #define RTLD_BOOTSTRAP
 #define _ENTRY enclave_entry
@@ -673,21 +673,21 @@ noreturn void pal_linux_main(char* uptr_libpal_uri, size_t libpal_uri_len, char*
         ocall_exit(1, /*is_exitgroup=*/true);
     }
 
-    /* parse manifest */
+    /* parse (compile) manifest; a compiled manifest is used in place */
+    static struct manifest manifest;
     char errbuf[256];
-    toml_table_t* manifest_root = toml_parse(manifest_addr, errbuf, sizeof(errbuf));
-    if (!manifest_root) {
+    ret = manifest_init(&manifest, manifest_addr, manifest_size, errbuf, sizeof(errbuf));
+    if (ret < 0) {
         log_error("PAL failed at parsing the manifest: %s\n"
                   "  Graphene switched to the TOML format recently, please update the manifest\n"
                   "  (in particular, string values must be put in double quotes)", errbuf);
         ocall_exit(1, /*is_exitgroup=*/true);
     }
-    g_pal_state.raw_manifest_data = manifest_addr;
-    g_pal_state.manifest_root = manifest_root;
+    g_pal_state.manifest_root = &manifest;
 
     bool preheat_enclave;
-    ret = toml_bool_in(g_pal_state.manifest_root, "sgx.preheat_enclave", /*defaultval=*/false,
-                       &preheat_enclave);
+    ret = manifest_bool_in(g_pal_state.manifest_root, "sgx.preheat_enclave", /*defaultval=*/false,
+                           &preheat_enclave);
     if (ret < 0) {
         log_error("Cannot parse \'sgx.preheat_enclave\' (the value must be `true` or `false`)");
         ocall_exit(1, true);
@@ -697,8 +697,8 @@ noreturn void pal_linux_main(char* uptr_libpal_uri, size_t libpal_uri_len, char*
             READ_ONCE(*(size_t*)i);
     }
 
-    ret = toml_sizestring_in(g_pal_state.manifest_root, "loader.pal_internal_mem_size",
-                             /*defaultval=*/0, &g_pal_internal_mem_size);
+    ret = manifest_sizestring_in(g_pal_state.manifest_root, "loader.pal_internal_mem_size",
+                                 /*defaultval=*/0, &g_pal_internal_mem_size);
     if (ret < 0) {
         log_error("Cannot parse \'loader.pal_internal_mem_size\' "
                   "(the value must be put in double quotes!)");
@@ -744,6 +744,8 @@ noreturn void pal_linux_main(char* uptr_libpal_uri, size_t libpal_uri_len, char*
     assert(!g_pal_sec.enclave_flags); /* currently only PAL_ENCLAVE_INITIALIZED */
     g_pal_sec.enclave_flags |= PAL_ENCLAVE_INITIALIZED;
 
+    init_ocall_stats();
+
     /* call main function */
     pal_main(instance_id, parent, first_thread, arguments, environments);
 }
@@ -14,6 +14,7 @@
 #include "gsgx.h"
 #include "hex.h"
 #include "linux_utils.h"
+#include "manifest.h"
 #include "pal.h"
 #include "pal_defs.h"
 #include "pal_error.h"
@@ -25,7 +26,6 @@
 #include "sgx_api.h"
 #include "sgx_attest.h"
 #include "spinlock.h"
-#include "toml.h"
 
 #define TSC_REFINE_INIT_TIMEOUT_USECS 10000000
 
@@ -43,6 +43,15 @@ void init_tsc(void) {
     }
 }
 
+static void get_tsc_baseline(uint64_t* start_tsc, uint64_t* start_usec) {
+    uint32_t seq;
+    do {
+        seq = read_seqbegin(&g_tsc_lock);
+        *start_tsc  = g_start_tsc;
+        *start_usec = g_start_usec;
+    } while (read_seqretry(&g_tsc_lock, seq));
+}
+
 /* TODO: result comes from the untrusted host, introduce some schielding */
 int _DkSystemTimeQuery(uint64_t* out_usec) {
     int ret;
@@ -52,14 +61,9 @@ int _DkSystemTimeQuery(uint64_t* out_usec) {
         return ocall_gettime(out_usec);
     }
 
-    uint32_t seq;
     uint64_t start_tsc;
     uint64_t start_usec;
-    do {
-        seq = read_seqbegin(&g_tsc_lock);
-        start_tsc  = g_start_tsc;
-        start_usec = g_start_usec;
-    } while (read_seqretry(&g_tsc_lock, seq));
+    get_tsc_baseline(&start_tsc, &start_usec);
 
     uint64_t usec = 0;
     if (start_tsc > 0 && start_usec > 0) {
@@ -110,6 +114,34 @@ int _DkSystemTimeQuery(uint64_t* out_usec) {
     return 0;
 }
 
+int _DkSystemTimeCalibration(PAL_TIME_CALIBRATION* calib) {
+    uint64_t tsc_hz = g_tsc_hz;
+    if (!tsc_hz)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    uint64_t start_tsc;
+    uint64_t start_usec;
+    get_tsc_baseline(&start_tsc, &start_usec);
+    if (!start_tsc || !start_usec) {
+        /* the baseline TSC/usec pair was not initialized yet */
+        uint64_t usec;
+        int ret = _DkSystemTimeQuery(&usec);
+        if (ret < 0)
+            return ret;
+        get_tsc_baseline(&start_tsc, &start_usec);
+        if (!start_tsc || !start_usec)
+            return -PAL_ERROR_NOTSUPPORT;
+    }
+
+    calib->tsc_hz    = tsc_hz;
+    calib->base_tsc  = start_tsc;
+    calib->base_usec = start_usec;
+    /* same limits as in `_DkSystemTimeQuery` */
+    calib->max_delta_tsc = MIN(TSC_REFINE_INIT_TIMEOUT_USECS * tsc_hz / 1000000,
+                               UINT64_MAX / 1000000);
+    return 0;
+}
+
 #define CPUID_CACHE_SIZE 64 /* cache only 64 distinct CPUID entries; sufficient for most apps */
 static struct pal_cpuid {
     unsigned int leaf, subleaf;
@@ -488,7 +520,7 @@ int _DkAttestationQuote(const PAL_PTR user_report_data, PAL_NUM user_report_data
 
     /* read sgx.ra_client_spid from manifest (must be hex string) */
     char* ra_client_spid_str = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "sgx.ra_client_spid", &ra_client_spid_str);
+    ret = manifest_string_in(g_pal_state.manifest_root, "sgx.ra_client_spid", &ra_client_spid_str);
     if (ret < 0) {
         log_error("Cannot parse \'sgx.ra_client_spid\' (the value must be put in double quotes!)");
         return -PAL_ERROR_INVAL;
@@ -522,8 +554,8 @@ int _DkAttestationQuote(const PAL_PTR user_report_data, PAL_NUM user_report_data
         }
 
         /* read sgx.ra_client_linkable from manifest */
-        ret = toml_bool_in(g_pal_state.manifest_root, "sgx.ra_client_linkable",
-                           /*defaultval=*/false, &linkable);
+        ret = manifest_bool_in(g_pal_state.manifest_root, "sgx.ra_client_linkable",
+                               /*defaultval=*/false, &linkable);
         if (ret < 0) {
             log_error("Cannot parse \'sgx.ra_client_linkable\' (the value must be `true` or "
                       "`false`)");
@@ -2,9 +2,11 @@
 /* Copyright (C) 2014 Stony Brook University */
 
 /*
- * This file contains APIs for waiting on PAL handles (polling).
+ * This file contains APIs for waiting on PAL handles (polling) and the host epoll functions used by
+ * wait sets (see "Linux-common/wait_set.c").
  */
 
+#include <linux/eventpoll.h>
 #include <linux/poll.h>
 #include <linux/time.h>
 #include <linux/wait.h>
@@ -17,6 +19,7 @@
 #include "pal_linux.h"
 #include "pal_linux_defs.h"
 #include "pal_linux_error.h"
+#include "wait_set.h"
 
 /* TODO: this should take into account `handle->pipe.handshake_done`. For more details see
  * "Pal/src/host/Linux-SGX/db_pipes.c". */
@@ -123,3 +126,20 @@ out:
     free(offsets);
     return ret;
 }
+
+int host_epoll_create(void) {
+    return ocall_epoll_create();
+}
+
+int host_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+    return ocall_epoll_ctl(epfd, op, fd, event);
+}
+
+/* The OCALL checks that the untrusted host did not return more than `maxevents` events. */
+int host_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int64_t timeout_us) {
+    return ocall_epoll_wait(epfd, events, maxevents, timeout_us);
+}
+
+void host_epoll_close(int epfd) {
+    ocall_close(epfd);
+}
@@ -19,6 +19,7 @@
 #include "api.h"
 #include "crypto.h"
 #include "enclave_pages.h"
+#include "ocall_types.h"
 #include "pal.h"
 #include "pal_defs.h"
 #include "pal_error.h"
@@ -425,3 +426,91 @@ int _DkDebugLog(const void* buf, size_t size) {
     }
     return 0;
 }
+
+/* Returns the host operation (BATCH_IO_*) for a request whose data is passed to the host as is, or
+ * -1 if the request must go through the generic per-buffer path (protected and trusted files are
+ * encrypted/verified inside the enclave, pipes are TLS-encrypted). */
+static int batch_io_host_op(PAL_IO_REQUEST* req, int* fd) {
+    PAL_HANDLE handle = req->handle;
+    bool read = req->op == PAL_IO_READ;
+
+    switch (PAL_GET_TYPE(handle)) {
+        case pal_type_file:
+            if (handle->file.chunk_hashes || find_protected_file_handle(handle))
+                return -1;
+            *fd = handle->file.fd;
+            if (handle->file.seekable)
+                return read ? BATCH_IO_PREAD : BATCH_IO_PWRITE;
+            return read ? BATCH_IO_READ : BATCH_IO_WRITE;
+        case pal_type_dev:
+            if (req->offset || handle->dev.fd == PAL_IDX_POISON ||
+                    !(HANDLE_HDR(handle)->flags & (read ? RFD(0) : WFD(0))))
+                return -1;
+            *fd = handle->dev.fd;
+            return read ? BATCH_IO_READ : BATCH_IO_WRITE;
+        case pal_type_tcp:
+            if (req->offset || !handle->sock.conn || handle->sock.fd == PAL_IDX_POISON)
+                return -1;
+            *fd = handle->sock.fd;
+            return read ? BATCH_IO_RECV : BATCH_IO_SEND;
+        default:
+            return -1;
+    }
+}
+
+/* Requests on plain host streams are executed with one OCALL per up to OCALL_BATCH_IO_MAX
+ * requests; the rest take the generic path. A chunk is re-run through the generic path only if
+ * ocall_batch_io() failed before reaching the host; otherwise some requests may already have been
+ * executed, so their results (-PAL_ERROR_INTERRUPTED for the ones cut off by a signal) are
+ * reported as is. */
+int _DkStreamsBatchIo(size_t count, PAL_IO_REQUEST* reqs) {
+    PAL_IO_REQUEST* host_reqs[OCALL_BATCH_IO_MAX];
+    int fds[OCALL_BATCH_IO_MAX];
+    int ops[OCALL_BATCH_IO_MAX];
+    size_t host_cnt = 0;
+
+    for (size_t i = 0; i <= count; i++) {
+        if (i < count) {
+            int op = batch_io_host_op(&reqs[i], &fds[host_cnt]);
+            if (op < 0) {
+                reqs[i].result = _DkStreamIoRequest(&reqs[i]);
+                continue;
+            }
+            ops[host_cnt] = op;
+            host_reqs[host_cnt++] = &reqs[i];
+            if (host_cnt < OCALL_BATCH_IO_MAX)
+                continue;
+        }
+
+        if (!host_cnt)
+            continue;
+
+        int ret = ocall_batch_io(host_cnt, host_reqs, fds, ops);
+        for (size_t j = 0; j < host_cnt; j++) {
+            if (ret < 0) {
+                host_reqs[j]->result = _DkStreamIoRequest(host_reqs[j]);
+            } else if (host_reqs[j]->result < 0) {
+                host_reqs[j]->result = unix_to_pal_error(host_reqs[j]->result);
+            }
+        }
+        host_cnt = 0;
+    }
+    return 0;
+}
+
+/* Only allowed files are passed to the host kernel, and only to TCP sockets, whose data is not
+ * protected by the PAL either. Trusted and protected files must be verified or decrypted inside the
+ * enclave, so they (and all other streams) go through the generic chunked copy. */
+int64_t _DkStreamTransfer(PAL_HANDLE src, uint64_t src_offset, PAL_HANDLE dst, uint64_t dst_offset,
+                          uint64_t count) {
+    if (!IS_HANDLE_TYPE(src, file) || !src->file.seekable || src->file.chunk_hashes ||
+            find_protected_file_handle(src) || !IS_HANDLE_TYPE(dst, tcp) || !dst->sock.conn ||
+            dst->sock.fd == PAL_IDX_POISON)
+        return _DkStreamTransferCopy(src, src_offset, dst, dst_offset, count);
+
+    ssize_t ret = ocall_sendfile(dst->sock.fd, src->file.fd, src_offset, MIN(count, 0x7ffff000UL));
+    if (ret == -EINVAL || ret == -ENOSYS)
+        return _DkStreamTransferCopy(src, src_offset, dst, dst_offset, count);
+
+    return ret < 0 ? unix_to_pal_error(ret) : ret;
+}
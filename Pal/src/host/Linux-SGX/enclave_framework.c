@@ -5,6 +5,7 @@
 #include "enclave_pages.h"
 #include "hex.h"
 #include "list.h"
+#include "manifest.h"
 #include "pal_error.h"
 #include "pal_internal.h"
 #include "pal_linux.h"
@@ -12,7 +13,6 @@
 #include "pal_security.h"
 #include "sgx_arch.h"
 #include "spinlock.h"
-#include "toml.h"
 
 void* g_enclave_base;
 void* g_enclave_top;
@@ -638,28 +638,26 @@ static int register_trusted_file(const char* uri, const char* checksum_str, bool
     return 0;
 }
 
-static int init_trusted_file(const char* key, const char* uri) {
+static int init_trusted_file(const char* key, size_t key_len, const char* uri) {
     int ret;
     char* normpath = NULL;
 
     /* read sgx.trusted_checksum.<key> entry from manifest */
-    char* fullkey = alloc_concat3("sgx.trusted_checksum.\"", -1, key, -1, "\"", -1);
-    if (!fullkey)
-        return -PAL_ERROR_NOMEM;
-
     /* NOTE: sgx.trusted_checksum entries are actually SHA-256 hashes, so the better name would be
      * sgx.trusted_hash but we don't want to break old manifests so we keep the legacy name */
-    char* trusted_checksum_str = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, fullkey, &trusted_checksum_str);
-    if (ret < 0) {
-        log_error("Cannot parse '%s'", fullkey);
-        ret = -PAL_ERROR_INVAL;
-        goto out;
+    const struct manifest* manifest = g_pal_state.manifest_root;
+    const struct manifest_node* checksums = manifest_lookup(manifest, "sgx.trusted_checksum");
+    const struct manifest_node* checksum = NULL;
+    if (checksums)
+        checksum = manifest_table_get(manifest, checksums, key, key_len);
+    if (!checksum) {
+        log_error("Missing 'sgx.trusted_checksum.\"%s\"' entry", key);
+        return -PAL_ERROR_INVAL;
     }
+    const char* trusted_checksum_str = manifest_node_str(manifest, checksum);
     if (!trusted_checksum_str) {
-        log_error("Missing '%s' entry", fullkey);
-        ret = -PAL_ERROR_INVAL;
-        goto out;
+        log_error("Cannot parse 'sgx.trusted_checksum.\"%s\"'", key);
+        return -PAL_ERROR_INVAL;
     }
 
     /* Normalize the uri */
@@ -687,8 +685,6 @@ static int init_trusted_file(const char* key, const char* uri) {
     ret = register_trusted_file(normpath, trusted_checksum_str, /*check_duplicates=*/false);
 out:
     free(normpath);
-    free(trusted_checksum_str);
-    free(fullkey);
     return ret;
 }
 
@@ -697,7 +693,7 @@ int init_trusted_files(void) {
 
     /* read loader.preload string from manifest and register its files as trusted */
     char* preload_str = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "loader.preload", &preload_str);
+    ret = manifest_string_in(g_pal_state.manifest_root, "loader.preload", &preload_str);
     if (ret < 0) {
         log_error("Cannot parse \'loader.preload\' "
                   "(the value must be put in double quotes!)");
@@ -720,7 +716,7 @@ int init_trusted_files(void) {
                 uri[end - start] = 0;
                 snprintf(key, 20, "preload%d", npreload++);
 
-                ret = init_trusted_file(key, uri);
+                ret = init_trusted_file(key, strlen(key), uri);
                 if (ret < 0) {
                     free(preload_str);
                     return ret;
@@ -732,54 +728,31 @@ int init_trusted_files(void) {
     }
 
     /* read sgx.trusted_files entries from manifest and register them */
-    toml_table_t* manifest_sgx = toml_table_in(g_pal_state.manifest_root, "sgx");
-    if (!manifest_sgx)
-        goto no_trusted;
-
-    toml_table_t* toml_trusted_files = toml_table_in(manifest_sgx, "trusted_files");
-    if (!toml_trusted_files)
-        goto no_trusted;
-
-    ssize_t toml_trusted_files_cnt = toml_table_nkval(toml_trusted_files);
-    if (toml_trusted_files_cnt <= 0)
-        goto no_trusted;
-
-    for (ssize_t i = 0; i < toml_trusted_files_cnt; i++) {
-        const char* toml_trusted_file_key = toml_key_in(toml_trusted_files, i);
-        assert(toml_trusted_file_key);
-        toml_raw_t toml_trusted_file_raw = toml_raw_in(toml_trusted_files, toml_trusted_file_key);
-        assert(toml_trusted_file_raw);
-
-        char* toml_trusted_file_str = NULL;
-        ret = toml_rtos(toml_trusted_file_raw, &toml_trusted_file_str);
-        if (ret < 0) {
-            log_error("Invalid trusted file in manifest: \'%s\'", toml_trusted_file_key);
+    const struct manifest* manifest = g_pal_state.manifest_root;
+    const struct manifest_node* trusted_files = manifest_lookup(manifest, "sgx.trusted_files");
+    for (size_t i = 0; trusted_files && i < manifest_node_count(trusted_files); i++) {
+        const struct manifest_node* trusted_file = manifest_node_child(manifest, trusted_files, i);
+        const char* trusted_file_key = manifest_node_key(manifest, trusted_file);
+        if (trusted_file->type == MANIFEST_NODE_TABLE || trusted_file->type == MANIFEST_NODE_ARRAY)
             continue;
-        }
 
-        ret = init_trusted_file(toml_trusted_file_key, toml_trusted_file_str);
-        if (ret < 0) {
-            free(toml_trusted_file_str);
-            return ret;
+        const char* trusted_file_str = manifest_node_str(manifest, trusted_file);
+        if (!trusted_file_str) {
+            log_error("Invalid trusted file in manifest: \'%s\'", trusted_file_key);
+            continue;
         }
 
-        free(toml_trusted_file_str);
+        ret = init_trusted_file(trusted_file_key, trusted_file->key_len, trusted_file_str);
+        if (ret < 0)
+            return ret;
     }
 
-no_trusted:
     ret = 0;
     char* norm_path = NULL;
 
     /* read sgx.allowed_files entries from manifest and register them */
-    if (!manifest_sgx)
-        goto no_allowed;
-
-    toml_table_t* toml_allowed_files = toml_table_in(manifest_sgx, "allowed_files");
-    if (!toml_allowed_files)
-        goto no_allowed;
-
-    ssize_t toml_allowed_files_cnt = toml_table_nkval(toml_allowed_files);
-    if (toml_allowed_files_cnt <= 0)
+    const struct manifest_node* allowed_files = manifest_lookup(manifest, "sgx.allowed_files");
+    if (!allowed_files || !manifest_node_count(allowed_files))
         goto no_allowed;
 
     const size_t norm_path_size = URI_MAX;
@@ -789,23 +762,21 @@ no_trusted:
         goto no_allowed;
     }
 
-    for (ssize_t i = 0; i < toml_allowed_files_cnt; i++) {
-        const char* toml_allowed_file_key = toml_key_in(toml_allowed_files, i);
-        assert(toml_allowed_file_key);
-        toml_raw_t toml_allowed_file_raw = toml_raw_in(toml_allowed_files, toml_allowed_file_key);
-        assert(toml_allowed_file_raw);
+    for (size_t i = 0; i < manifest_node_count(allowed_files); i++) {
+        const struct manifest_node* allowed_file = manifest_node_child(manifest, allowed_files, i);
+        const char* allowed_file_key = manifest_node_key(manifest, allowed_file);
+        if (allowed_file->type == MANIFEST_NODE_TABLE || allowed_file->type == MANIFEST_NODE_ARRAY)
+            continue;
 
-        char* toml_allowed_file_str = NULL;
-        ret = toml_rtos(toml_allowed_file_raw, &toml_allowed_file_str);
-        if (ret < 0) {
-            log_error("Invalid allowed file in manifest: \'%s\'", toml_allowed_file_key);
+        const char* allowed_file_str = manifest_node_str(manifest, allowed_file);
+        if (!allowed_file_str) {
+            log_error("Invalid allowed file in manifest: \'%s\'", allowed_file_key);
             continue;
         }
 
-        if (!strstartswith(toml_allowed_file_str, URI_PREFIX_FILE)) {
+        if (!strstartswith(allowed_file_str, URI_PREFIX_FILE)) {
             log_error("Invalid URI [%s]: Allowed files must start with 'file:'",
-                      toml_allowed_file_str);
-            free(toml_allowed_file_str);
+                      allowed_file_str);
             ret = -PAL_ERROR_INVAL;
             goto no_allowed;
         }
@@ -814,16 +785,14 @@ no_trusted:
 
         size_t norm_path_len = norm_path_size - URI_PREFIX_FILE_LEN;
 
-        ret = get_norm_path(toml_allowed_file_str + URI_PREFIX_FILE_LEN,
+        ret = get_norm_path(allowed_file_str + URI_PREFIX_FILE_LEN,
                             norm_path + URI_PREFIX_FILE_LEN, &norm_path_len);
 
         if (ret < 0) {
             log_error("Path (%s) normalization failed: %s",
-                      toml_allowed_file_str + URI_PREFIX_FILE_LEN, pal_strerror(ret));
-            free(toml_allowed_file_str);
+                      allowed_file_str + URI_PREFIX_FILE_LEN, pal_strerror(ret));
             goto no_allowed;
         }
-        free(toml_allowed_file_str);
 
         register_trusted_file(norm_path, NULL, /*check_duplicates=*/false);
     }
@@ -839,8 +808,8 @@ int init_file_check_policy(void) {
     int ret;
 
     char* file_check_policy_str = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "sgx.file_check_policy",
-                         &file_check_policy_str);
+    ret = manifest_string_in(g_pal_state.manifest_root, "sgx.file_check_policy",
+                             &file_check_policy_str);
     if (ret < 0) {
         log_error("Cannot parse \'sgx.file_check_policy\' "
                   "(the value must be put in double quotes!)");
@@ -44,15 +44,100 @@
  * size of 8MB. Thus, 512KB limit also works well for the main thread. */
 #define MAX_UNTRUSTED_STACK_BUF (THREAD_STACK_SIZE / 4)
 
-/* global pointer to a single untrusted queue, all accesses must be protected by g_rpc_queue->lock
- */
+/* global pointer to the untrusted sharded RPC queue; the queue is lock-free, each enclave thread
+ * enqueues into its own ring (see rpc_queue.h) */
 rpc_queue_t* g_rpc_queue;
 
-static long sgx_exitless_ocall(uint64_t code, void* ms) {
+/* index of the RPC ring used by current enclave thread; TCS pages are laid out contiguously, so
+ * the first RPC_QUEUE_RINGS enclave threads get distinct rings */
+static inline size_t rpc_ring_index(void) {
+    return (GET_ENCLAVE_TLS(tcs_offset) / PRESET_PAGESIZE) & (RPC_QUEUE_RINGS - 1);
+}
+
+/* OCALL statistics (see pal_stats.c): one entry per OCALL, plus entries counting how the OCALLs
+ * were performed (via the RPC queue or with an enclave exit) */
+#define OCALL_STATS_EXITLESS OCALL_NR
+#define OCALL_STATS_EEXIT    (OCALL_NR + 1)
+
+static PAL_STATS_ENTRY g_ocall_stats[OCALL_NR + 2] = {
+    [OCALL_EXIT] = { .name = "ocall_exit" },
+    [OCALL_MMAP_UNTRUSTED] = { .name = "ocall_mmap_untrusted" },
+    [OCALL_MUNMAP_UNTRUSTED] = { .name = "ocall_munmap_untrusted" },
+    [OCALL_CPUID] = { .name = "ocall_cpuid" },
+    [OCALL_OPEN] = { .name = "ocall_open" },
+    [OCALL_CLOSE] = { .name = "ocall_close" },
+    [OCALL_READ] = { .name = "ocall_read" },
+    [OCALL_WRITE] = { .name = "ocall_write" },
+    [OCALL_PREAD] = { .name = "ocall_pread" },
+    [OCALL_PWRITE] = { .name = "ocall_pwrite" },
+    [OCALL_FSTAT] = { .name = "ocall_fstat" },
+    [OCALL_FIONREAD] = { .name = "ocall_fionread" },
+    [OCALL_FSETNONBLOCK] = { .name = "ocall_fsetnonblock" },
+    [OCALL_FCHMOD] = { .name = "ocall_fchmod" },
+    [OCALL_FSYNC] = { .name = "ocall_fsync" },
+    [OCALL_FTRUNCATE] = { .name = "ocall_ftruncate" },
+    [OCALL_MKDIR] = { .name = "ocall_mkdir" },
+    [OCALL_GETDENTS] = { .name = "ocall_getdents" },
+    [OCALL_RESUME_THREAD] = { .name = "ocall_resume_thread" },
+    [OCALL_SCHED_SETAFFINITY] = { .name = "ocall_sched_setaffinity" },
+    [OCALL_SCHED_GETAFFINITY] = { .name = "ocall_sched_getaffinity" },
+    [OCALL_CLONE_THREAD] = { .name = "ocall_clone_thread" },
+    [OCALL_CREATE_PROCESS] = { .name = "ocall_create_process" },
+    [OCALL_FUTEX] = { .name = "ocall_futex" },
+    [OCALL_SOCKETPAIR] = { .name = "ocall_socketpair" },
+    [OCALL_LISTEN] = { .name = "ocall_listen" },
+    [OCALL_ACCEPT] = { .name = "ocall_accept" },
+    [OCALL_CONNECT] = { .name = "ocall_connect" },
+    [OCALL_RECV] = { .name = "ocall_recv" },
+    [OCALL_SEND] = { .name = "ocall_send" },
+    [OCALL_SETSOCKOPT] = { .name = "ocall_setsockopt" },
+    [OCALL_SHUTDOWN] = { .name = "ocall_shutdown" },
+    [OCALL_GETTIME] = { .name = "ocall_gettime" },
+    [OCALL_SCHED_YIELD] = { .name = "ocall_sched_yield" },
+    [OCALL_POLL] = { .name = "ocall_poll" },
+    [OCALL_RENAME] = { .name = "ocall_rename" },
+    [OCALL_DELETE] = { .name = "ocall_delete" },
+    [OCALL_DEBUG_MAP_ADD] = { .name = "ocall_debug_map_add" },
+    [OCALL_DEBUG_MAP_REMOVE] = { .name = "ocall_debug_map_remove" },
+    [OCALL_EVENTFD] = { .name = "ocall_eventfd" },
+    [OCALL_GET_QUOTE] = { .name = "ocall_get_quote" },
+    [OCALL_BATCH_IO] = { .name = "ocall_batch_io" },
+    [OCALL_EPOLL_CREATE] = { .name = "ocall_epoll_create" },
+    [OCALL_EPOLL_CTL] = { .name = "ocall_epoll_ctl" },
+    [OCALL_EPOLL_WAIT] = { .name = "ocall_epoll_wait" },
+    [OCALL_SENDFILE] = { .name = "ocall_sendfile" },
+    [OCALL_STATS_EXITLESS] = { .name = "exitless" },
+    [OCALL_STATS_EEXIT] = { .name = "eexit" },
+};
+
+void init_ocall_stats(void) {
+    pal_stats_set_host_calls(g_ocall_stats, ARRAY_SIZE(g_ocall_stats));
+}
+
+static void record_ocall_stats(uint64_t code, bool exitless, uint64_t start) {
+    pal_get_tcb()->host_calls_cnt++;
+    pal_stats_record(&g_ocall_stats[code], start);
+    pal_stats_record(&g_ocall_stats[exitless ? OCALL_STATS_EXITLESS : OCALL_STATS_EEXIT], start);
+}
+
+/* OCALL with enclave exit, for OCALLs which are never exitless */
+static long ocall_eexit(uint64_t code, void* ms) {
+    if (!g_pal_stats_enabled)
+        return sgx_ocall(code, ms);
+
+    uint64_t start = pal_stats_start();
+    long ret = sgx_ocall(code, ms);
+    record_ocall_stats(code, /*exitless=*/false, start);
+    return ret;
+}
+
+static long do_exitless_ocall(uint64_t code, void* ms, bool* out_exitless) {
     /* perform OCALL with enclave exit if no RPC queue (i.e., no exitless); no need for atomics
      * because this pointer is set only once at enclave initialization */
-    if (!g_rpc_queue)
+    if (!g_rpc_queue) {
+        *out_exitless = false;
         return sgx_ocall(code, ms);
+    }
 
     /* allocate request in a new stack frame on OCALL stack; note that request's lock is used in
      * futex() and must be aligned to at least 4B */
@@ -72,13 +157,14 @@ static long sgx_exitless_ocall(uint64_t code, void* ms) {
      * of the lock */
     spinlock_lock(&req->lock);
 
-    /* enqueue OCALL request into RPC queue; some RPC thread will dequeue it, issue a syscall
-     * and, after syscall is finished, release the request's spinlock */
-    bool enqueued = rpc_enqueue(g_rpc_queue, req);
+    /* enqueue OCALL request into this thread's ring of RPC queue; some RPC thread will dequeue
+     * it, issue a syscall and, after syscall is finished, release the request's spinlock */
+    bool enqueued = rpc_enqueue(g_rpc_queue, rpc_ring_index(), req);
     if (!enqueued) {
         /* no space in queue: all RPC threads are busy with outstanding ocalls; fallback to normal
          * syscall path with enclave exit */
         sgx_reset_ustack(old_ustack);
+        *out_exitless = false;
         return sgx_ocall(code, ms);
     }
 
@@ -140,6 +226,17 @@ static long sgx_exitless_ocall(uint64_t code, void* ms) {
     return READ_ONCE(req->result);
 }
 
+static long sgx_exitless_ocall(uint64_t code, void* ms) {
+    bool exitless = true;
+    if (!g_pal_stats_enabled)
+        return do_exitless_ocall(code, ms, &exitless);
+
+    uint64_t start = pal_stats_start();
+    long ret = do_exitless_ocall(code, ms, &exitless);
+    record_ocall_stats(code, exitless, start);
+    return ret;
+}
+
 noreturn void ocall_exit(int exitcode, int is_exitgroup) {
     ms_ocall_exit_t* ms;
 
@@ -340,7 +437,7 @@ int ocall_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int values[4])
 
     do {
         /* cpuid must be retrieved in the context of current logical core, cannot use exitless */
-        retval = sgx_ocall(OCALL_CPUID, ms);
+        retval = ocall_eexit(OCALL_CPUID, ms);
     } while (retval == -EINTR);
 
     if (!retval) {
@@ -864,7 +961,7 @@ int ocall_clone_thread(void) {
         /* clone must happen in the context of current (enclave) thread, cannot use exitless;
          * in particular, the new (enclave) thread must have the same signal mask as the current
          * enclave thread (and NOT signal mask of the RPC thread) */
-        retval = sgx_ocall(OCALL_CLONE_THREAD, dummy);
+        retval = ocall_eexit(OCALL_CLONE_THREAD, dummy);
     } while (retval == -EINTR);
     return retval;
 }
@@ -934,7 +1031,7 @@ int ocall_futex(uint32_t* futex, int op, int val, uint64_t* timeout_us) {
     if (op == FUTEX_WAIT) {
         /* With `FUTEX_WAIT` this thread is most likely going to sleep, so there is no point in
          * doing an exitless ocall. */
-        retval = sgx_ocall(OCALL_FUTEX, ms);
+        retval = ocall_eexit(OCALL_FUTEX, ms);
     } else {
         assert(op == FUTEX_WAKE);
         retval = sgx_exitless_ocall(OCALL_FUTEX, ms);
@@ -1380,7 +1477,7 @@ void ocall_sched_yield(void) {
     void* old_ustack = sgx_prepare_ustack();
 
     /* NOTE: no reason to use exitless for `sched_yield` and it always succeeds. */
-    (void)sgx_ocall(OCALL_SCHED_YIELD, NULL);
+    (void)ocall_eexit(OCALL_SCHED_YIELD, NULL);
 
     sgx_reset_ustack(old_ustack);
 }
@@ -1565,6 +1662,117 @@ int ocall_eventfd(unsigned int initval, int flags) {
     return retval;
 }
 
+int ocall_epoll_create(void) {
+    int retval = 0;
+    ms_ocall_epoll_create_t* ms;
+
+    void* old_ustack = sgx_prepare_ustack();
+    ms = sgx_alloc_on_ustack_aligned(sizeof(*ms), alignof(*ms));
+    if (!ms) {
+        sgx_reset_ustack(old_ustack);
+        return -EPERM;
+    }
+
+    WRITE_ONCE(ms->ms_flags, EPOLL_CLOEXEC);
+
+    do {
+        retval = sgx_exitless_ocall(OCALL_EPOLL_CREATE, ms);
+    } while (retval == -EINTR);
+
+    sgx_reset_ustack(old_ustack);
+    return retval;
+}
+
+int ocall_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+    int retval = 0;
+    ms_ocall_epoll_ctl_t* ms;
+
+    void* old_ustack = sgx_prepare_ustack();
+    ms = sgx_alloc_on_ustack_aligned(sizeof(*ms), alignof(*ms));
+    if (!ms) {
+        sgx_reset_ustack(old_ustack);
+        return -EPERM;
+    }
+
+    WRITE_ONCE(ms->ms_epfd, epfd);
+    WRITE_ONCE(ms->ms_op, op);
+    WRITE_ONCE(ms->ms_fd, fd);
+    WRITE_ONCE(ms->ms_event.events, event->events);
+    WRITE_ONCE(ms->ms_event.data, event->data);
+
+    do {
+        retval = sgx_exitless_ocall(OCALL_EPOLL_CTL, ms);
+    } while (retval == -EINTR);
+
+    sgx_reset_ustack(old_ustack);
+    return retval;
+}
+
+int ocall_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int64_t timeout_us) {
+    int retval = 0;
+    size_t events_bytes = maxevents * sizeof(*events);
+    ms_ocall_epoll_wait_t* ms;
+
+    void* old_ustack = sgx_prepare_ustack();
+    ms = sgx_alloc_on_ustack_aligned(sizeof(*ms), alignof(*ms));
+    if (!ms) {
+        retval = -EPERM;
+        goto out;
+    }
+
+    void* untrusted_events = sgx_alloc_on_ustack_aligned(events_bytes, alignof(*events));
+    if (!untrusted_events) {
+        retval = -EPERM;
+        goto out;
+    }
+
+    WRITE_ONCE(ms->ms_epfd, epfd);
+    WRITE_ONCE(ms->ms_events, untrusted_events);
+    WRITE_ONCE(ms->ms_maxevents, maxevents);
+    WRITE_ONCE(ms->ms_timeout_us, timeout_us);
+
+    retval = sgx_exitless_ocall(OCALL_EPOLL_WAIT, ms);
+    if (retval > 0) {
+        if (retval > maxevents) {
+            retval = -EPERM;
+            goto out;
+        }
+        size_t ret_bytes = retval * sizeof(*events);
+        if (!sgx_copy_to_enclave(events, ret_bytes, untrusted_events, ret_bytes)) {
+            retval = -EPERM;
+            goto out;
+        }
+    }
+
+out:
+    sgx_reset_ustack(old_ustack);
+    return retval;
+}
+
+ssize_t ocall_sendfile(int out_fd, int in_fd, off_t offset, size_t count) {
+    ssize_t retval = 0;
+    ms_ocall_sendfile_t* ms;
+
+    void* old_ustack = sgx_prepare_ustack();
+    ms = sgx_alloc_on_ustack_aligned(sizeof(*ms), alignof(*ms));
+    if (!ms) {
+        sgx_reset_ustack(old_ustack);
+        return -EPERM;
+    }
+
+    WRITE_ONCE(ms->ms_out_fd, out_fd);
+    WRITE_ONCE(ms->ms_in_fd, in_fd);
+    WRITE_ONCE(ms->ms_offset, offset);
+    WRITE_ONCE(ms->ms_count, count);
+
+    retval = sgx_exitless_ocall(OCALL_SENDFILE, ms);
+    if (retval > 0 && (size_t)retval > count)
+        retval = -EPERM;
+
+    sgx_reset_ustack(old_ustack);
+    return retval;
+}
+
 int ocall_get_quote(const sgx_spid_t* spid, bool linkable, const sgx_report_t* report,
                     const sgx_quote_nonce_t* nonce, char** quote, size_t* quote_len) {
     int retval;
@@ -1722,3 +1930,115 @@ int ocall_sched_getaffinity(void* tcs, size_t cpumask_size, void* cpu_mask) {
     sgx_reset_ustack(old_ustack);
     return retval;
 }
+
+static size_t io_request_size(PAL_IO_REQUEST* req) {
+    size_t size = 0;
+    for (size_t i = 0; i < req->iov_cnt; i++)
+        size += req->iov[i].count;
+    return size;
+}
+
+int ocall_batch_io(size_t count, PAL_IO_REQUEST** reqs, const int* fds, const int* ops) {
+    long retval = 0;
+    ms_ocall_batch_io_t* ms;
+    ms_ocall_batch_io_req_t* ms_reqs;
+    void* obuf = NULL;
+    char* ubuf;
+    bool need_munmap = false;
+
+    assert(count <= OCALL_BATCH_IO_MAX);
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (__builtin_add_overflow(total, io_request_size(reqs[i]), &total))
+            return -EINVAL;
+    }
+
+    void* old_ustack = sgx_prepare_ustack();
+    ms = sgx_alloc_on_ustack_aligned(sizeof(*ms), alignof(*ms));
+    ms_reqs = sgx_alloc_on_ustack_aligned(count * sizeof(*ms_reqs), alignof(*ms_reqs));
+    if (!ms || !ms_reqs) {
+        sgx_reset_ustack(old_ustack);
+        return -EPERM;
+    }
+
+    if (total > MAX_UNTRUSTED_STACK_BUF) {
+        retval = ocall_mmap_untrusted_cache(ALLOC_ALIGN_UP(total), &obuf, &need_munmap);
+        if (retval < 0) {
+            sgx_reset_ustack(old_ustack);
+            return retval;
+        }
+        ubuf = obuf;
+    } else {
+        ubuf = sgx_alloc_on_ustack(total);
+        if (!ubuf) {
+            retval = -EPERM;
+            goto out;
+        }
+    }
+
+    size_t pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        PAL_IO_REQUEST* req = reqs[i];
+        size_t size = io_request_size(req);
+
+        if (ops[i] == BATCH_IO_WRITE || ops[i] == BATCH_IO_PWRITE || ops[i] == BATCH_IO_SEND) {
+            size_t off = 0;
+            for (size_t j = 0; j < req->iov_cnt; j++) {
+                memcpy(ubuf + pos + off, req->iov[j].buffer, req->iov[j].count);
+                off += req->iov[j].count;
+            }
+        }
+
+        WRITE_ONCE(ms_reqs[i].ms_fd, fds[i]);
+        WRITE_ONCE(ms_reqs[i].ms_op, ops[i]);
+        WRITE_ONCE(ms_reqs[i].ms_offset, req->offset);
+        WRITE_ONCE(ms_reqs[i].ms_buf, ubuf + pos);
+        WRITE_ONCE(ms_reqs[i].ms_count, size);
+        /* requests not reached by the host before an -EINTR keep this result */
+        WRITE_ONCE(ms_reqs[i].ms_result, -EINTR);
+        pos += size;
+    }
+
+    WRITE_ONCE(ms->ms_count, count);
+    WRITE_ONCE(ms->ms_reqs, ms_reqs);
+
+    /* Not restarted on -EINTR: some requests may already have been executed. Whatever the OCALL
+     * returns, the requests were (possibly partially) submitted to the host, so per-request results
+     * are always reported and the caller must not re-run the batch. */
+    sgx_exitless_ocall(OCALL_BATCH_IO, ms);
+
+    pos = 0;
+    for (size_t i = 0; i < count; i++) {
+        PAL_IO_REQUEST* req = reqs[i];
+        size_t size = io_request_size(req);
+        long res = READ_ONCE(ms_reqs[i].ms_result);
+
+        if (res > 0 && (size_t)res > size) {
+            res = -EPERM;
+        } else if (res > 0 && (ops[i] == BATCH_IO_READ || ops[i] == BATCH_IO_PREAD ||
+                               ops[i] == BATCH_IO_RECV)) {
+            size_t off = 0;
+            for (size_t j = 0; j < req->iov_cnt && off < (size_t)res; j++) {
+                size_t chunk = MIN(req->iov[j].count, (size_t)res - off);
+                if (!sgx_copy_to_enclave(req->iov[j].buffer, chunk, ubuf + pos + off, chunk)) {
+                    res = -EPERM;
+                    break;
+                }
+                off += chunk;
+            }
+        } else if (res < 0 && !IS_UNIX_ERR(res)) {
+            res = -EPERM;
+        }
+
+        req->result = res;
+        pos += size;
+    }
+    retval = 0;
+
+out:
+    sgx_reset_ustack(old_ustack);
+    if (obuf)
+        ocall_munmap_untrusted_cache(obuf, ALLOC_ALIGN_UP(total), need_munmap);
+    return retval;
+}
@@ -3,14 +3,18 @@
  */
 
 #include <asm/stat.h>
+#include <linux/eventpoll.h>
 #include <linux/poll.h>
 #include <linux/socket.h>
 #include <sys/types.h>
 
 #include "linux_types.h"
+#include "pal.h"
 #include "pal_linux.h"
 #include "sgx_attest.h"
 
+void init_ocall_stats(void);
+
 noreturn void ocall_exit(int exitcode, int is_exitgroup);
 
 int ocall_mmap_untrusted(void** addrptr, size_t size, int prot, int flags, int fd, off_t offset);
@@ -96,6 +100,14 @@ int ocall_debug_map_remove(void* addr);
 
 int ocall_eventfd(unsigned int initval, int flags);
 
+int ocall_epoll_create(void);
+
+int ocall_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event);
+
+int ocall_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int64_t timeout_us);
+
+ssize_t ocall_sendfile(int out_fd, int in_fd, off_t offset, size_t count);
+
 /*!
  * \brief Execute untrusted code in PAL to obtain a quote from the Quoting Enclave.
  *
@@ -114,3 +126,24 @@ int ocall_eventfd(unsigned int initval, int flags);
  */
 int ocall_get_quote(const sgx_spid_t* spid, bool linkable, const sgx_report_t* report,
                     const sgx_quote_nonce_t* nonce, char** quote, size_t* quote_len);
+
+/*!
+ * \brief Execute a batch of reads/writes with a single OCALL.
+ *
+ * \param count  Number of requests, at most #OCALL_BATCH_IO_MAX.
+ * \param reqs   Requests; on success their `result` holds a Linux return value (number of bytes
+ *               transferred or negative Linux error code).
+ * \param fds    Host file descriptor of each request.
+ * \param ops    Host operation of each request (one of `BATCH_IO_*`).
+ * \return       0 if the batch was passed to the host, negative Linux error code if it failed
+ *               before the OCALL (then no request was executed).
+ *
+ * Once the OCALL is issued, its requests must not be re-executed: requests that the host did not
+ * reach because of a host signal report -EINTR in their `result`.
+ *
+ * Data is staged in one contiguous untrusted buffer, so each request is executed by the host as
+ * a single plain read or write.
+ */
+int ocall_batch_io(size_t count, PAL_IO_REQUEST** reqs, const int* fds, const int* ops);
+
+#define OCALL_BATCH_IO_MAX 64
@@ -7,11 +7,11 @@
 
 #include "crypto.h"
 #include "hex.h"
+#include "manifest.h"
 #include "pal_internal.h"
 #include "pal_linux.h"
 #include "pal_linux_error.h"
 #include "spinlock.h"
-#include "toml.h"
 
 /* Wrap key for protected files, either hard-coded in manifest, provisioned during attestation, or
  * inherited from the parent process. We don't use synchronization on them since they are only set
@@ -148,6 +148,110 @@ static pf_status_t cb_random(uint8_t* buffer, size_t size) {
     return PF_STATUS_SUCCESS;
 }
 
+/* Maximum value of `sgx.protected_files_threads` */
+#define PF_MAX_WORKERS 16
+
+/*
+ * Worker threads for parallel encryption/decryption of PF nodes (`sgx.protected_files_threads`).
+ * Workers are started on first use and run forever. One batch of jobs runs at a time; a thread that
+ * finds the pool busy (another file is being flushed) runs its jobs alone. The dispatching thread
+ * takes part in its batch, workers join it after `start_event` is set.
+ */
+static struct {
+    spinlock_t lock;            /* held by the thread dispatching a batch */
+    size_t workers;             /* number of worker threads (configured, then started) */
+    bool started;
+    PAL_HANDLE start_event;     /* set while a batch is running */
+    bool running;               /* batch accepts workers, accessed atomically */
+    size_t busy;                /* workers inside the batch, accessed atomically */
+    size_t next;                /* next job index, accessed atomically */
+    pf_job_f job;
+    void* arg;
+    size_t count;
+} g_pf_workers = { .lock = INIT_SPINLOCK_UNLOCKED };
+
+static void run_pf_jobs(pf_job_f job, void* arg, size_t count) {
+    size_t index;
+    while ((index = __atomic_fetch_add(&g_pf_workers.next, 1, __ATOMIC_RELAXED)) < count)
+        job(arg, index);
+}
+
+static int pf_worker(void* unused) {
+    __UNUSED(unused);
+
+    while (true) {
+        if (_DkEventWait(g_pf_workers.start_event, /*timeout_us=*/NULL) < 0)
+            continue;
+
+        /* the dispatcher does not modify the batch while any worker is busy with it */
+        __atomic_add_fetch(&g_pf_workers.busy, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&g_pf_workers.running, __ATOMIC_SEQ_CST))
+            run_pf_jobs(g_pf_workers.job, g_pf_workers.arg, g_pf_workers.count);
+        __atomic_sub_fetch(&g_pf_workers.busy, 1, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/* must be called with `g_pf_workers.lock` held */
+static void start_pf_workers(void) {
+    g_pf_workers.started = true;
+
+    int ret = _DkEventCreate(&g_pf_workers.start_event, /*init_signaled=*/false,
+                             /*auto_clear=*/false);
+    if (ret < 0) {
+        log_warning("Cannot create PF workers event: %d, PF crypto will not be parallel", ret);
+        g_pf_workers.workers = 0;
+        return;
+    }
+
+    for (size_t i = 0; i < g_pf_workers.workers; i++) {
+        PAL_HANDLE thread_hdl;
+        ret = _DkThreadCreate(&thread_hdl, pf_worker, /*param=*/NULL);
+        if (ret < 0) {
+            log_warning("Cannot create PF worker thread (not enough TCSs?): %d, using %lu workers",
+                        ret, i);
+            g_pf_workers.workers = i;
+            return;
+        }
+    }
+}
+
+static void cb_parallel(pf_job_f job, void* arg, size_t count) {
+    if (spinlock_trylock(&g_pf_workers.lock)) {
+        /* another batch is running, don't wait for it */
+        for (size_t i = 0; i < count; i++)
+            job(arg, i);
+        return;
+    }
+
+    if (!g_pf_workers.started)
+        start_pf_workers();
+
+    if (g_pf_workers.workers == 0) {
+        for (size_t i = 0; i < count; i++)
+            job(arg, i);
+        spinlock_unlock(&g_pf_workers.lock);
+        return;
+    }
+
+    g_pf_workers.job = job;
+    g_pf_workers.arg = arg;
+    g_pf_workers.count = count;
+    __atomic_store_n(&g_pf_workers.next, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&g_pf_workers.running, true, __ATOMIC_SEQ_CST);
+    _DkEventSet(g_pf_workers.start_event);
+
+    run_pf_jobs(job, arg, count);
+
+    /* all jobs are taken, wait for the workers still running some */
+    _DkEventClear(g_pf_workers.start_event);
+    __atomic_store_n(&g_pf_workers.running, false, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&g_pf_workers.busy, __ATOMIC_ACQUIRE) > 0)
+        CPU_RELAX();
+
+    spinlock_unlock(&g_pf_workers.lock);
+}
+
 /* Collection of registered protected files */
 static struct protected_file* g_protected_files = NULL;
 
@@ -426,41 +530,28 @@ out:
 
 /* Read PF paths from manifest and register them */
 static int register_protected_files(void) {
-    int ret;
-    toml_table_t* manifest_sgx = toml_table_in(g_pal_state.manifest_root, "sgx");
-    if (!manifest_sgx)
+    const struct manifest* manifest = g_pal_state.manifest_root;
+    const struct manifest_node* pfs = manifest_lookup(manifest, "sgx.protected_files");
+    if (!pfs)
         return 0;
 
-    toml_table_t* toml_pfs = toml_table_in(manifest_sgx, "protected_files");
-    if (!toml_pfs)
-        return 0;
-
-    ssize_t toml_pfs_cnt = toml_table_nkval(toml_pfs);
-    if (toml_pfs_cnt <= 0) {
-        /* no PF entries found in the manifest */
-        return 0;
-    }
-
-    for (ssize_t i = 0; i < toml_pfs_cnt; i++) {
-        const char* toml_pf_key = toml_key_in(toml_pfs, i);
-        assert(toml_pf_key);
-        toml_raw_t toml_pf_value_raw = toml_raw_in(toml_pfs, toml_pf_key);
-        assert(toml_pf_value_raw);
+    for (size_t i = 0; i < manifest_node_count(pfs); i++) {
+        const struct manifest_node* pf = manifest_node_child(manifest, pfs, i);
+        if (pf->type == MANIFEST_NODE_TABLE || pf->type == MANIFEST_NODE_ARRAY)
+            continue;
 
-        char* toml_pf_value = NULL;
-        ret = toml_rtos(toml_pf_value_raw, &toml_pf_value);
-        if (ret < 0) {
-            log_error("Invalid PF entry in manifest: \'%s\'", toml_pf_key);
+        const char* pf_value = manifest_node_str(manifest, pf);
+        if (!pf_value) {
+            log_error("Invalid PF entry in manifest: \'%s\'", manifest_node_key(manifest, pf));
             continue;
         }
 
-        if (!strstartswith(toml_pf_value, URI_PREFIX_FILE)) {
+        if (!strstartswith(pf_value, URI_PREFIX_FILE)) {
             log_error("Invalid URI [%s]: URIs of protected files must start with \'"
-                      URI_PREFIX_FILE "\'\n", toml_pf_value);
+                      URI_PREFIX_FILE "\'\n", pf_value);
         } else {
-            register_protected_path(toml_pf_value, NULL);
+            register_protected_path(pf_value, NULL);
         }
-        free(toml_pf_value);
     }
 
     pf_lock();
@@ -479,14 +570,25 @@ int init_protected_files(void) {
     debug_callback = cb_debug;
 #endif
 
+    int64_t workers;
+    ret = manifest_int_in(g_pal_state.manifest_root, "sgx.protected_files_threads", /*defaultval=*/0,
+                          &workers);
+    if (ret < 0 || workers < 0 || workers > PF_MAX_WORKERS) {
+        log_error("Cannot parse \'sgx.protected_files_threads\' (the value must be between 0 and "
+                  "%d)", PF_MAX_WORKERS);
+        return -PAL_ERROR_INVAL;
+    }
+    g_pf_workers.workers = workers;
+
     pf_set_callbacks(cb_read, cb_write, cb_truncate, cb_aes_cmac, cb_aes_gcm_encrypt,
-                     cb_aes_gcm_decrypt, cb_random, debug_callback);
+                     cb_aes_gcm_decrypt, cb_random, workers > 0 ? cb_parallel : NULL,
+                     debug_callback);
 
     /* if wrap key is not hard-coded in the manifest, assume that it was received from parent or
      * it will be provisioned after local/remote attestation; otherwise read it from manifest */
     char* protected_files_key_str = NULL;
-    ret = toml_string_in(g_pal_state.manifest_root, "sgx.protected_files_key",
-                         &protected_files_key_str);
+    ret = manifest_string_in(g_pal_state.manifest_root, "sgx.protected_files_key",
+                             &protected_files_key_str);
     if (ret < 0) {
         log_error("Cannot parse \'sgx.protected_files_key\' "
                   "(the value must be put in double quotes!)");
@@ -515,6 +617,21 @@ int init_protected_files(void) {
         g_pf_wrap_key_set = true;
     }
 
+    uint64_t cache_size;
+    ret = manifest_sizestring_in(g_pal_state.manifest_root, "sgx.protected_files_cache_size",
+                                 PF_DEFAULT_CACHE_SIZE, &cache_size);
+    if (ret < 0) {
+        log_error("Cannot parse \'sgx.protected_files_cache_size\' "
+                  "(the value must be put in double quotes!)");
+        return -PAL_ERROR_INVAL;
+    }
+
+    if (PF_FAILURE(pf_set_cache_size(cache_size))) {
+        log_error("\'sgx.protected_files_cache_size\' must be at least %uK",
+                  PF_MIN_CACHE_SIZE / 1024);
+        return -PAL_ERROR_INVAL;
+    }
+
     if (register_protected_files() < 0) {
         log_error("Malformed protected files found in manifest");
     }
@@ -3,6 +3,7 @@
  */
 
 #include <stdbool.h>
+#include <linux/eventpoll.h>
 #include <stddef.h>
 #include <sys/types.h>
 
@@ -10,6 +11,7 @@
 #include "pal.h"
 #include "sgx_arch.h"
 #include "sgx_attest.h"
+#include "spinlock.h"
 
 /*
  * GCC's structure padding may cause leaking from uninialized
@@ -63,6 +65,11 @@ enum {
     OCALL_DEBUG_MAP_REMOVE,
     OCALL_EVENTFD,
     OCALL_GET_QUOTE,
+    OCALL_BATCH_IO,
+    OCALL_EPOLL_CREATE,
+    OCALL_EPOLL_CTL,
+    OCALL_EPOLL_WAIT,
+    OCALL_SENDFILE,
     OCALL_NR,
 };
 
@@ -304,4 +311,62 @@ typedef struct {
     size_t            ms_quote_len;
 } ms_ocall_get_quote_t;
 
+enum {
+    BATCH_IO_READ = 0,
+    BATCH_IO_WRITE,
+    BATCH_IO_PREAD,
+    BATCH_IO_PWRITE,
+    BATCH_IO_RECV,
+    BATCH_IO_SEND,
+};
+
+typedef struct {
+    int ms_fd;
+    int ms_op;
+    off_t ms_offset;
+    void* ms_buf;
+    size_t ms_count;
+    long ms_result;
+} ms_ocall_batch_io_req_t;
+
+typedef struct {
+    size_t ms_count;
+    ms_ocall_batch_io_req_t* ms_reqs;
+} ms_ocall_batch_io_t;
+
+typedef struct {
+    int ms_flags;
+} ms_ocall_epoll_create_t;
+
+typedef struct {
+    int ms_epfd;
+    int ms_op;
+    int ms_fd;
+    struct epoll_event ms_event;
+} ms_ocall_epoll_ctl_t;
+
+typedef struct {
+    int ms_epfd;
+    struct epoll_event* ms_events;
+    int ms_maxevents;
+    int64_t ms_timeout_us;
+} ms_ocall_epoll_wait_t;
+
+typedef struct {
+    int ms_out_fd;
+    int ms_in_fd;
+    off_t ms_offset;
+    size_t ms_count;
+} ms_ocall_sendfile_t;
+
 #pragma pack(pop)
+
+/* Exitless OCALL request, allocated on the untrusted stack of the enclave thread and passed to RPC
+ * threads through the RPC queue (see rpc_queue.h). Not packed: `lock` is used as a futex word and
+ * must be naturally aligned. */
+typedef struct rpc_request {
+    spinlock_t lock; /* can be UNLOCKED / LOCKED_NO_WAITERS / LOCKED_WITH_WAITERS */
+    long result;
+    uint64_t ocall_index;
+    void* buffer;
+} rpc_request_t;
@@ -137,6 +137,11 @@ typedef struct pal_handle {
              * word on the untrusted host. */
             uint32_t* signaled_untrusted;
         } event;
+
+        struct {
+            PAL_IDX fd;                 /* host epoll instance */
+            struct pal_wait_set* set;
+        } waitset;
     };
 }* PAL_HANDLE;
 
@@ -40,6 +40,7 @@ static pf_aes_cmac_f        g_cb_aes_cmac        = NULL;
 static pf_aes_gcm_encrypt_f g_cb_aes_gcm_encrypt = NULL;
 static pf_aes_gcm_decrypt_f g_cb_aes_gcm_decrypt = NULL;
 static pf_random_f          g_cb_random          = NULL;
+static pf_parallel_f        g_cb_parallel        = NULL;
 
 #ifdef DEBUG
 #define PF_DEBUG_PRINT_SIZE_MAX 4096
@@ -70,6 +71,7 @@ static pf_random_f          g_cb_random          = NULL;
 
 static pf_iv_t g_empty_iv = {0};
 static bool g_initialized = false;
+static size_t g_cache_max_nodes = PF_DEFAULT_CACHE_SIZE / PF_NODE_SIZE;
 
 static const char* g_pf_error_list[] = {
     [PF_STATUS_SUCCESS] = "Success",
@@ -193,6 +195,11 @@ static bool ipf_init_fields(pf_context_t* pf) {
     pf->last_error     = PF_STATUS_SUCCESS;
     pf->real_file_size = 0;
 
+    pf->max_cache_nodes = g_cache_max_nodes;
+    pf->request_end     = 0;
+    pf->readahead_next  = 0;
+    pf->readahead_nodes = 0;
+
     pf->cache = lruc_create();
     return true;
 }
@@ -272,11 +279,9 @@ out:
     return pf;
 }
 
-static bool ipf_read_node(pf_context_t* pf, pf_handle_t handle, uint64_t node_number, void* buffer,
-                          uint32_t node_size) {
-    uint64_t offset = node_number * node_size;
-
-    pf_status_t status = g_cb_read(handle, buffer, offset, node_size);
+static bool ipf_read_file(pf_context_t* pf, pf_handle_t handle, uint64_t offset, void* buffer,
+                          size_t size) {
+    pf_status_t status = g_cb_read(handle, buffer, offset, size);
     if (PF_FAILURE(status)) {
         pf->last_error = status;
         return false;
@@ -285,8 +290,13 @@ static bool ipf_read_node(pf_context_t* pf, pf_handle_t handle, uint64_t node_nu
     return true;
 }
 
+static bool ipf_read_node(pf_context_t* pf, pf_handle_t handle, uint64_t node_number, void* buffer,
+                          uint32_t node_size) {
+    return ipf_read_file(pf, handle, node_number * node_size, buffer, node_size);
+}
+
 static bool ipf_write_file(pf_context_t* pf, pf_handle_t handle, uint64_t offset, void* buffer,
-                           uint32_t size) {
+                           size_t size) {
     pf_status_t status = g_cb_write(handle, buffer, offset, size);
     if (PF_FAILURE(status)) {
         pf->last_error = status;
@@ -463,6 +473,7 @@ static void swap_nodes(file_node_t** data, size_t idx1, size_t idx2) {
     data[idx2] = tmp;
 }
 
+// sorts by physical node number, which for MHT nodes also orders them by (logical) node number
 // TODO: better sort?
 static size_t partition(file_node_t** data, size_t low, size_t high) {
     assert(low <= high);
@@ -471,9 +482,9 @@ static size_t partition(file_node_t** data, size_t low, size_t high) {
     size_t j = high;
 
     while (true) {
-        while (data[i]->node_number < pivot->node_number)
+        while (data[i]->physical_node_number < pivot->physical_node_number)
             i++;
-        while (data[j]->node_number > pivot->node_number)
+        while (data[j]->physical_node_number > pivot->physical_node_number)
             j--;
         if (i >= j)
             return j;
@@ -485,7 +496,7 @@ static size_t partition(file_node_t** data, size_t low, size_t high) {
 
 static void sort_nodes(file_node_t** data, size_t low, size_t high) {
     if (high - low == 1) {
-        if (data[low]->node_number > data[high]->node_number)
+        if (data[low]->physical_node_number > data[high]->physical_node_number)
             swap_nodes(data, low, high);
         return;
     }
@@ -497,105 +508,179 @@ static void sort_nodes(file_node_t** data, size_t low, size_t high) {
     }
 }
 
-static bool ipf_update_all_data_and_mht_nodes(pf_context_t* pf) {
-    bool ret = false;
-    file_node_t** mht_array = NULL;
-    file_node_t* file_mht_node;
-    pf_status_t status;
-    void* data = lruc_get_first(pf->cache);
+// returns the key and gmac of a data or (non-root) MHT node, which are stored in its parent
+static gcm_crypto_data_t* ipf_node_crypto(file_node_t* file_node) {
+    if (file_node->type == FILE_DATA_NODE_TYPE)
+        return &file_node->parent->decrypted.mht
+                    .data_nodes_crypto[file_node->node_number % ATTACHED_DATA_NODES_COUNT];
 
-    // 1. encrypt the changed data
-    // 2. set the IV+GMAC in the parent MHT
-    // [3. set the need_writing flag for all the parents]
-    while (data != NULL) {
-        if (((file_node_t*)data)->type == FILE_DATA_NODE_TYPE) {
-            file_node_t* data_node = (file_node_t*)data;
-
-            if (data_node->need_writing) {
-                gcm_crypto_data_t* gcm_crypto_data =
-                    &data_node->parent->decrypted.mht
-                         .data_nodes_crypto[data_node->node_number % ATTACHED_DATA_NODES_COUNT];
-
-                if (!ipf_generate_random_key(pf, &gcm_crypto_data->key))
-                    goto out;
-
-                // encrypt the data, this also saves the gmac of the operation in the mht crypto
-                // node
-                status = g_cb_aes_gcm_encrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,  // aad
-                                              data_node->decrypted.data.data, PF_NODE_SIZE,
-                                              data_node->encrypted.cipher, &gcm_crypto_data->gmac);
-                if (PF_FAILURE(status)) {
-                    pf->last_error = status;
-                    goto out;
-                }
-
-                file_mht_node = data_node->parent;
-#ifdef DEBUG
-                // this loop should do nothing, add it here just to be safe
-                while (file_mht_node->node_number != 0) {
-                    assert(file_mht_node->need_writing == true);
-                    file_mht_node = file_mht_node->parent;
-                }
-#endif
-            }
+    assert(file_node->node_number > 0);
+    return &file_node->parent->decrypted.mht
+                .mht_nodes_crypto[(file_node->node_number - 1) % CHILD_MHT_NODES_COUNT];
+}
+
+// depth of an MHT node in the tree, 0 for the root
+static size_t ipf_mht_level(uint64_t mht_node_number) {
+    size_t level = 0;
+    while (mht_node_number != 0) {
+        mht_node_number = (mht_node_number - 1) / CHILD_MHT_NODES_COUNT;
+        level++;
+    }
+    return level;
+}
+
+// nodes encrypted or decrypted by one (possibly parallel) batch of jobs
+struct crypt_batch {
+    file_node_t** nodes;
+    pf_status_t* statuses;
+};
+
+// encrypts a node with the key stored in its parent, also stores the gmac in the parent
+static void ipf_encrypt_node_job(void* arg, size_t index) {
+    struct crypt_batch* batch = arg;
+    file_node_t* file_node = batch->nodes[index];
+    gcm_crypto_data_t* gcm_crypto_data = ipf_node_crypto(file_node);
+
+    batch->statuses[index] = g_cb_aes_gcm_encrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,
+                                                  &file_node->decrypted, PF_NODE_SIZE,
+                                                  file_node->encrypted.cipher,
+                                                  &gcm_crypto_data->gmac);
+}
+
+// decrypts a node _and_ checks its integrity against the gmac stored in its parent
+static void ipf_decrypt_node_job(void* arg, size_t index) {
+    struct crypt_batch* batch = arg;
+    file_node_t* file_node = batch->nodes[index];
+    gcm_crypto_data_t* gcm_crypto_data = ipf_node_crypto(file_node);
+
+    batch->statuses[index] = g_cb_aes_gcm_decrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,
+                                                  file_node->encrypted.cipher, PF_NODE_SIZE,
+                                                  &file_node->decrypted, &gcm_crypto_data->gmac);
+}
+
+// runs `job` for all indices in [0, count), on several threads if the host supports it
+static void ipf_run_jobs(pf_job_f job, void* arg, size_t count) {
+    if (g_cb_parallel && count >= MIN_PARALLEL_NODES) {
+        g_cb_parallel(job, arg, count);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+        job(arg, i);
+}
+
+// encrypts independent nodes (no node is an ancestor of another); their keys must be already set
+static bool ipf_encrypt_nodes(pf_context_t* pf, file_node_t** nodes, size_t count) {
+    if (count == 0)
+        return true;
+
+    struct crypt_batch batch = {
+        .nodes = nodes,
+        .statuses = malloc(count * sizeof(*batch.statuses)),
+    };
+    if (!batch.statuses) {
+        pf->last_error = PF_STATUS_NO_MEMORY;
+        return false;
+    }
+
+    ipf_run_jobs(ipf_encrypt_node_job, &batch, count);
+
+    bool ret = true;
+    for (size_t i = 0; i < count; i++) {
+        if (PF_FAILURE(batch.statuses[i])) {
+            pf->last_error = batch.statuses[i];
+            ret = false;
+            break;
         }
-        data = lruc_get_next(pf->cache);
     }
 
-    size_t dirty_count = 0;
+    free(batch.statuses);
+    return ret;
+}
+
+static bool ipf_update_all_data_and_mht_nodes(pf_context_t* pf) {
+    bool ret = false;
+    file_node_t** dirty_nodes = NULL;
+    file_node_t* file_node;
+    pf_status_t status;
+    size_t data_count = 0;
+    size_t mht_count = 0;
+    void* data;
 
-    // count dirty mht nodes
-    data = lruc_get_first(pf->cache);
-    while (data != NULL) {
-        if (((file_node_t*)data)->type == FILE_MHT_NODE_TYPE) {
-            if (((file_node_t*)data)->need_writing)
-                dirty_count++;
+    for (data = lruc_get_first(pf->cache); data != NULL; data = lruc_get_next(pf->cache)) {
+        file_node = (file_node_t*)data;
+        if (file_node->need_writing) {
+            if (file_node->type == FILE_DATA_NODE_TYPE)
+                data_count++;
+            else
+                mht_count++;
         }
-        data = lruc_get_next(pf->cache);
     }
 
-    // add all the mht nodes that needs writing to a list
-    mht_array = malloc(dirty_count * sizeof(*mht_array));
-    if (!mht_array) {
+    // dirty data nodes first, then dirty mht nodes
+    dirty_nodes = malloc(MAX(data_count + mht_count, 1U) * sizeof(*dirty_nodes));
+    if (!dirty_nodes) {
         pf->last_error = PF_STATUS_NO_MEMORY;
         goto out;
     }
 
-    data = lruc_get_first(pf->cache);
-    uint64_t dirty_idx = 0;
-    while (data != NULL) {
-        if (((file_node_t*)data)->type == FILE_MHT_NODE_TYPE) {
-            file_mht_node = (file_node_t*)data;
-
-            if (file_mht_node->need_writing)
-                mht_array[dirty_idx++] = file_mht_node;
+    file_node_t** data_nodes = dirty_nodes;
+    file_node_t** mht_nodes = dirty_nodes + data_count;
+    size_t data_idx = 0;
+    size_t mht_idx = 0;
+    for (data = lruc_get_first(pf->cache); data != NULL; data = lruc_get_next(pf->cache)) {
+        file_node = (file_node_t*)data;
+        if (file_node->need_writing) {
+            if (file_node->type == FILE_DATA_NODE_TYPE)
+                data_nodes[data_idx++] = file_node;
+            else
+                mht_nodes[mht_idx++] = file_node;
         }
-
-        data = lruc_get_next(pf->cache);
     }
+    assert(data_idx == data_count && mht_idx == mht_count);
 
-    if (dirty_count > 0)
-        sort_nodes(mht_array, 0, dirty_count - 1);
+    // 1. encrypt the changed data
+    // 2. set the IV+GMAC in the parent MHT
+    // [3. set the need_writing flag for all the parents]
+    // keys are generated serially (the random callback doesn't have to be thread-safe), the
+    // encryption of different nodes is independent and may run in parallel
+    for (size_t i = 0; i < data_count; i++) {
+        if (!ipf_generate_random_key(pf, &ipf_node_crypto(data_nodes[i])->key))
+            goto out;
 
-    // update the gmacs in the parents from last node to first (bottom layers first)
-    for (dirty_idx = dirty_count; dirty_idx > 0; dirty_idx--) {
-        file_mht_node = mht_array[dirty_idx - 1];
+#ifdef DEBUG
+        // this loop should do nothing, add it here just to be safe
+        file_node = data_nodes[i]->parent;
+        while (file_node->node_number != 0) {
+            assert(file_node->need_writing == true);
+            file_node = file_node->parent;
+        }
+#endif
+    }
 
-        gcm_crypto_data_t* gcm_crypto_data =
-            &file_mht_node->parent->decrypted.mht
-                 .mht_nodes_crypto[(file_mht_node->node_number - 1) % CHILD_MHT_NODES_COUNT];
+    if (!ipf_encrypt_nodes(pf, data_nodes, data_count))
+        goto out;
+
+    // update the gmacs in the parents from last node to first (bottom layers first); nodes on the
+    // same level of the tree are independent
+    if (mht_count > 0)
+        sort_nodes(mht_nodes, 0, mht_count - 1);
 
-        if (!ipf_generate_random_key(pf, &gcm_crypto_data->key)) {
+    for (size_t i = 0; i < mht_count; i++) {
+        if (!ipf_generate_random_key(pf, &ipf_node_crypto(mht_nodes[i])->key))
             goto out;
-        }
+    }
 
-        status = g_cb_aes_gcm_encrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,
-                                      &file_mht_node->decrypted.mht, PF_NODE_SIZE,
-                                      &file_mht_node->encrypted.cipher, &gcm_crypto_data->gmac);
-        if (PF_FAILURE(status)) {
-            pf->last_error = status;
+    size_t level_end = mht_count;
+    while (level_end > 0) {
+        size_t level = ipf_mht_level(mht_nodes[level_end - 1]->node_number);
+        size_t level_start = level_end - 1;
+        while (level_start > 0 && ipf_mht_level(mht_nodes[level_start - 1]->node_number) == level)
+            level_start--;
+
+        if (!ipf_encrypt_nodes(pf, &mht_nodes[level_start], level_end - level_start))
             goto out;
-        }
+        level_end = level_start;
     }
 
     // update mht root gmac in the meta data node
@@ -615,7 +700,7 @@ static bool ipf_update_all_data_and_mht_nodes(pf_context_t* pf) {
     ret = true;
 
 out:
-    free(mht_array);
+    free(dirty_nodes);
     return ret;
 }
 
@@ -641,36 +726,89 @@ static bool ipf_update_metadata_node(pf_context_t* pf) {
     return true;
 }
 
-static bool ipf_write_all_changes_to_disk(pf_context_t* pf) {
-    if (pf->encrypted_part_plain.size > MD_USER_DATA_SIZE && pf->root_mht.need_writing) {
-        void* data = NULL;
-        uint8_t* data_to_write;
-        uint64_t node_number;
-        file_node_t* file_node;
+// writes `count` nodes with consecutive physical numbers, using one write if there is more of them
+static bool ipf_write_node_run(pf_context_t* pf, file_node_t** nodes, size_t count,
+                               uint8_t* buffer) {
+    if (count == 1) {
+        return ipf_write_node(pf, pf->file, nodes[0]->physical_node_number,
+                              &nodes[0]->encrypted, PF_NODE_SIZE);
+    }
 
-        for (data = lruc_get_first(pf->cache); data != NULL; data = lruc_get_next(pf->cache)) {
-            file_node = (file_node_t*)data;
-            if (!file_node->need_writing)
-                continue;
+    for (size_t i = 0; i < count; i++)
+        memcpy(buffer + i * PF_NODE_SIZE, &nodes[i]->encrypted, PF_NODE_SIZE);
 
-            data_to_write = (uint8_t*)&file_node->encrypted;
-            node_number = file_node->physical_node_number;
+    return ipf_write_file(pf, pf->file, nodes[0]->physical_node_number * PF_NODE_SIZE, buffer,
+                          count * PF_NODE_SIZE);
+}
 
-            if (!ipf_write_node(pf, pf->file, node_number, data_to_write, PF_NODE_SIZE)) {
-                return false;
-            }
+// writes all dirty data and MHT nodes (including the root MHT node), sorted by their position in the
+// file, so that adjacent nodes can be written together
+static bool ipf_write_dirty_nodes(pf_context_t* pf) {
+    bool ret = false;
+    file_node_t** dirty_nodes = NULL;
+    uint8_t* buffer = NULL;
+    size_t dirty_count = 1; // the root MHT node, which is not in the cache
+    void* data;
+
+    for (data = lruc_get_first(pf->cache); data != NULL; data = lruc_get_next(pf->cache)) {
+        if (((file_node_t*)data)->need_writing)
+            dirty_count++;
+    }
+
+    dirty_nodes = malloc(dirty_count * sizeof(*dirty_nodes));
+    if (!dirty_nodes) {
+        pf->last_error = PF_STATUS_NO_MEMORY;
+        goto out;
+    }
+
+    size_t dirty_idx = 0;
+    dirty_nodes[dirty_idx++] = &pf->root_mht;
+    for (data = lruc_get_first(pf->cache); data != NULL; data = lruc_get_next(pf->cache)) {
+        if (((file_node_t*)data)->need_writing)
+            dirty_nodes[dirty_idx++] = (file_node_t*)data;
+    }
+    assert(dirty_idx == dirty_count);
+
+    sort_nodes(dirty_nodes, 0, dirty_count - 1);
+
+    size_t start = 0;
+    while (start < dirty_count) {
+        size_t end = start + 1;
+        while (end < dirty_count && end - start < MAX_NODES_PER_WRITE
+                && dirty_nodes[end]->physical_node_number
+                       == dirty_nodes[end - 1]->physical_node_number + 1)
+            end++;
 
-            file_node->need_writing = false;
-            file_node->new_node = false;
+        if (end - start > 1 && !buffer) {
+            buffer = malloc(MAX_NODES_PER_WRITE * PF_NODE_SIZE);
+            if (!buffer) {
+                pf->last_error = PF_STATUS_NO_MEMORY;
+                goto out;
+            }
         }
 
-        if (!ipf_write_node(pf, pf->file, /*node_number=*/1, &pf->root_mht.encrypted,
-                            PF_NODE_SIZE)) {
-            return false;
+        if (!ipf_write_node_run(pf, &dirty_nodes[start], end - start, buffer))
+            goto out;
+
+        for (size_t i = start; i < end; i++) {
+            dirty_nodes[i]->need_writing = false;
+            dirty_nodes[i]->new_node = false;
         }
+        start = end;
+    }
 
-        pf->root_mht.need_writing = false;
-        pf->root_mht.new_node = false;
+    ret = true;
+
+out:
+    free(buffer);
+    free(dirty_nodes);
+    return ret;
+}
+
+static bool ipf_write_all_changes_to_disk(pf_context_t* pf) {
+    if (pf->encrypted_part_plain.size > MD_USER_DATA_SIZE && pf->root_mht.need_writing) {
+        if (!ipf_write_dirty_nodes(pf))
+            return false;
     }
 
     if (!ipf_write_node(pf, pf->file, /*node_number=*/0, &pf->file_metadata, PF_NODE_SIZE)) {
@@ -764,6 +902,7 @@ static size_t ipf_write(pf_context_t* pf, const void* ptr, size_t size) {
     }
 
     const unsigned char* data_to_write = (const unsigned char*)ptr;
+    pf->request_end = pf->offset + size;
 
     // the first block of user data is written in the meta-data encrypted part
     if (pf->offset < MD_USER_DATA_SIZE) {
@@ -850,6 +989,7 @@ static size_t ipf_read(pf_context_t* pf, void* ptr, size_t size) {
 
     // used at the end to return how much we actually read
     size_t data_attempted_to_read = data_left_to_read;
+    pf->request_end = pf->offset + data_left_to_read;
 
     unsigned char* out_buffer = (unsigned char*)ptr;
 
@@ -935,6 +1075,15 @@ static void get_node_numbers(uint64_t offset, uint64_t* mht_node_number, uint64_
         *physical_data_node_number = _physical_data_node_number;
 }
 
+// moves `file_mht_node` and its ancestors to the head of the LRU list; a node must never be evicted
+// before its children, which point to it
+static void ipf_bump_mht_nodes(pf_context_t* pf, file_node_t* file_mht_node) {
+    while (file_mht_node->node_number != 0) {
+        lruc_get(pf->cache, file_mht_node->physical_node_number);
+        file_mht_node = file_mht_node->parent;
+    }
+}
+
 static file_node_t* ipf_get_data_node(pf_context_t* pf) {
     file_node_t* file_data_node = NULL;
 
@@ -953,17 +1102,11 @@ static file_node_t* ipf_get_data_node(pf_context_t* pf) {
     }
 
     // bump all the parents mht to reside before the data node in the cache
-    if (file_data_node != NULL) {
-        file_node_t* file_mht_node = file_data_node->parent;
-        while (file_mht_node->node_number != 0) {
-            // bump the mht node to the head of the lru
-            lruc_get(pf->cache, file_mht_node->physical_node_number);
-            file_mht_node = file_mht_node->parent;
-        }
-    }
+    if (file_data_node != NULL)
+        ipf_bump_mht_nodes(pf, file_data_node->parent);
 
     // even if we didn't get the required data_node, we might have read other nodes in the process
-    while (lruc_size(pf->cache) > MAX_PAGES_IN_CACHE) {
+    while (lruc_size(pf->cache) > pf->max_cache_nodes) {
         void* data = lruc_get_last(pf->cache);
         assert(data != NULL);
         // for production -
@@ -1021,6 +1164,51 @@ static file_node_t* ipf_append_data_node(pf_context_t* pf) {
     return new_file_data_node;
 }
 
+// returns the number of data nodes to read from disk, starting with the missing `data_node_number`:
+// all nodes needed by the current request, and more if the file is read sequentially
+static size_t ipf_readahead_count(pf_context_t* pf, uint64_t data_node_number) {
+    size_t max_nodes = MIN(MAX_READAHEAD_NODES, pf->max_cache_nodes / 4);
+
+    if (data_node_number == pf->readahead_next) {
+        // sequential access: grow the window
+        size_t nodes = MAX(pf->readahead_nodes * 2, MIN_READAHEAD_NODES);
+        pf->readahead_nodes = MIN(nodes, max_nodes);
+    } else {
+        pf->readahead_nodes = 0;
+    }
+
+    assert(pf->request_end > MD_USER_DATA_SIZE);
+    uint64_t last_requested = (pf->request_end - MD_USER_DATA_SIZE - 1) / PF_NODE_SIZE;
+    uint64_t requested = last_requested >= data_node_number
+                         ? last_requested - data_node_number + 1 : 1;
+
+    size_t count = MIN(MAX(requested, pf->readahead_nodes), max_nodes);
+
+    // data nodes are adjacent on disk only up to the next MHT node
+    count = MIN(count, ATTACHED_DATA_NODES_COUNT - data_node_number % ATTACHED_DATA_NODES_COUNT);
+
+    // don't read past the end of the file
+    assert(pf->encrypted_part_plain.size > MD_USER_DATA_SIZE);
+    uint64_t last_node_number = (pf->encrypted_part_plain.size - MD_USER_DATA_SIZE - 1)
+                                / PF_NODE_SIZE;
+    assert(last_node_number >= data_node_number);
+    count = MIN(count, last_node_number - data_node_number + 1);
+
+    // stop at the first node that is already cached (it may be newer than the disk contents)
+    uint64_t physical_node_number;
+    get_node_numbers(MD_USER_DATA_SIZE + data_node_number * PF_NODE_SIZE, NULL, NULL, NULL,
+                     &physical_node_number);
+    for (size_t i = 1; i < count; i++) {
+        if (lruc_find(pf->cache, physical_node_number + i)) {
+            count = i;
+            break;
+        }
+    }
+
+    pf->readahead_next = data_node_number + count;
+    return count;
+}
+
 static file_node_t* ipf_read_data_node(pf_context_t* pf) {
     uint64_t data_node_number;
     uint64_t physical_node_number;
@@ -1039,33 +1227,63 @@ static file_node_t* ipf_read_data_node(pf_context_t* pf) {
     if (file_mht_node == NULL) // some error happened
         return NULL;
 
-    file_data_node = calloc(1, sizeof(*file_data_node));
-    if (!file_data_node) {
+    // the following nodes (attached to the same MHT node) needed by this request or by a sequential
+    // reader are read with a single host read
+    size_t count = ipf_readahead_count(pf, data_node_number);
+    uint8_t* buffer = malloc(count * PF_NODE_SIZE);
+    if (!buffer) {
         pf->last_error = PF_STATUS_NO_MEMORY;
         return NULL;
     }
 
-    file_data_node->type = FILE_DATA_NODE_TYPE;
-    file_data_node->node_number = data_node_number;
-    file_data_node->physical_node_number = physical_node_number;
-    file_data_node->parent = file_mht_node;
-
-    if (!ipf_read_node(pf, pf->file, file_data_node->physical_node_number,
-                       file_data_node->encrypted.cipher, PF_NODE_SIZE)) {
-        free(file_data_node);
+    if (!ipf_read_file(pf, pf->file, physical_node_number * PF_NODE_SIZE, buffer,
+                       count * PF_NODE_SIZE)) {
+        free(buffer);
         return NULL;
     }
 
-    gcm_crypto_data_t* gcm_crypto_data =
-        &file_data_node->parent->decrypted.mht
-             .data_nodes_crypto[file_data_node->node_number % ATTACHED_DATA_NODES_COUNT];
+    file_node_t* nodes[MAX_READAHEAD_NODES];
+    pf_status_t statuses[MAX_READAHEAD_NODES];
+    assert(count <= MAX_READAHEAD_NODES);
 
-    // this function decrypt the data _and_ checks the integrity of the data against the gmac
-    status = g_cb_aes_gcm_decrypt(&gcm_crypto_data->key, &g_empty_iv, NULL, 0,
-                                  file_data_node->encrypted.cipher, PF_NODE_SIZE,
-                                  file_data_node->decrypted.data.data, &gcm_crypto_data->gmac);
+    for (size_t i = 0; i < count; i++) {
+        nodes[i] = calloc(1, sizeof(*nodes[i]));
+        if (!nodes[i]) {
+            while (i--)
+                free(nodes[i]);
+            free(buffer);
+            pf->last_error = PF_STATUS_NO_MEMORY;
+            return NULL;
+        }
 
+        nodes[i]->type = FILE_DATA_NODE_TYPE;
+        nodes[i]->node_number = data_node_number + i;
+        nodes[i]->physical_node_number = physical_node_number + i;
+        nodes[i]->parent = file_mht_node;
+        memcpy(nodes[i]->encrypted.cipher, buffer + i * PF_NODE_SIZE, PF_NODE_SIZE);
+    }
+    free(buffer);
+
+    struct crypt_batch batch = { .nodes = nodes, .statuses = statuses };
+    ipf_run_jobs(ipf_decrypt_node_job, &batch, count);
+
+    // add the read-ahead nodes first (the farthest one first), so that the requested node ends up
+    // at the head of the LRU list; errors in read-ahead nodes are reported only if they are read
+    for (size_t i = count - 1; i > 0; i--) {
+        if (PF_FAILURE(statuses[i])
+                || !lruc_add(pf->cache, nodes[i]->physical_node_number, nodes[i])) {
+            // scrub the plaintext data
+            erase_memory(&nodes[i]->decrypted, sizeof(nodes[i]->decrypted));
+            free(nodes[i]);
+        }
+    }
+    if (count > 1)
+        ipf_bump_mht_nodes(pf, file_mht_node);
+
+    file_data_node = nodes[0];
+    status = statuses[0];
     if (PF_FAILURE(status)) {
+        erase_memory(&file_data_node->decrypted, sizeof(file_data_node->decrypted));
         free(file_data_node);
         pf->last_error = status;
         if (status == PF_STATUS_MAC_MISMATCH)
@@ -1213,7 +1431,7 @@ static file_node_t* ipf_read_mht_node(pf_context_t* pf, uint64_t mht_node_number
 void pf_set_callbacks(pf_read_f read_f, pf_write_f write_f, pf_truncate_f truncate_f,
                       pf_aes_cmac_f aes_cmac_f, pf_aes_gcm_encrypt_f aes_gcm_encrypt_f,
                       pf_aes_gcm_decrypt_f aes_gcm_decrypt_f, pf_random_f random_f,
-                      pf_debug_f debug_f) {
+                      pf_parallel_f parallel_f, pf_debug_f debug_f) {
     g_cb_read            = read_f;
     g_cb_write           = write_f;
     g_cb_truncate        = truncate_f;
@@ -1221,10 +1439,19 @@ void pf_set_callbacks(pf_read_f read_f, pf_write_f write_f, pf_truncate_f trunca
     g_cb_aes_gcm_encrypt = aes_gcm_encrypt_f;
     g_cb_aes_gcm_decrypt = aes_gcm_decrypt_f;
     g_cb_random          = random_f;
+    g_cb_parallel        = parallel_f;
     g_cb_debug           = debug_f;
     g_initialized = true;
 }
 
+pf_status_t pf_set_cache_size(size_t size) {
+    if (size < PF_MIN_CACHE_SIZE)
+        return PF_STATUS_INVALID_PARAMETER;
+
+    g_cache_max_nodes = size / PF_NODE_SIZE;
+    return PF_STATUS_SUCCESS;
+}
+
 pf_status_t pf_open(pf_handle_t handle, const char* path, uint64_t underlying_size,
                     pf_file_mode_t mode, bool create, const pf_key_t* key, pf_context_t** context) {
     if (!g_initialized)
@@ -56,6 +56,12 @@ typedef enum _pf_status_t {
 
 #define PF_NODE_SIZE 4096U
 
+/*! Default maximum size of decrypted nodes cached for a single open file */
+#define PF_DEFAULT_CACHE_SIZE (48 * PF_NODE_SIZE)
+
+/*! Minimum cache size; the cache must hold a data node together with all its MHT ancestors */
+#define PF_MIN_CACHE_SIZE (16 * PF_NODE_SIZE)
+
 /*! PF open modes */
 typedef enum _pf_file_mode_t {
     PF_FILE_MODE_READ  = 1,
@@ -159,6 +165,26 @@ typedef pf_status_t (*pf_aes_gcm_decrypt_f)(const pf_key_t* key, const pf_iv_t*
  */
 typedef pf_status_t (*pf_random_f)(uint8_t* buffer, size_t size);
 
+/*!
+ * \brief Job executed by the parallel execution callback
+ *
+ * \param [in] arg Argument given to the parallel execution callback
+ * \param [in] index Index of the job
+ */
+typedef void (*pf_job_f)(void* arg, size_t index);
+
+/*!
+ * \brief Parallel execution callback
+ *
+ * \param [in] job Job to execute
+ * \param [in] arg Argument passed to every call of \a job
+ * \param [in] count Number of jobs
+ * \details Must call `job(arg, i)` for every `i` in `[0, count)`, possibly in parallel on several
+ *          threads, and return after all calls have finished. Jobs only call the AES-GCM callbacks,
+ *          which must be thread-safe if jobs run in parallel.
+ */
+typedef void (*pf_parallel_f)(pf_job_f job, void* arg, size_t count);
+
 /*!
  * \brief Initialize I/O callbacks
  *
@@ -169,6 +195,8 @@ typedef pf_status_t (*pf_random_f)(uint8_t* buffer, size_t size);
  * \param [in] aes_gcm_encrypt_f AES-GCM encrypt callback
  * \param [in] aes_gcm_decrypt_f AES-GCM decrypt callback
  * \param [in] random_f Cryptographic random number generator callback
+ * \param [in] parallel_f (optional) Parallel execution callback, used to encrypt and decrypt
+ *                        independent nodes on several threads
  * \param [in] debug_f (optional) Debug print callback
  *
  * \details Must be called before any actual APIs
@@ -176,7 +204,17 @@ typedef pf_status_t (*pf_random_f)(uint8_t* buffer, size_t size);
 void pf_set_callbacks(pf_read_f read_f, pf_write_f write_f, pf_truncate_f truncate_f,
                       pf_aes_cmac_f aes_cmac_f, pf_aes_gcm_encrypt_f aes_gcm_encrypt_f,
                       pf_aes_gcm_decrypt_f aes_gcm_decrypt_f, pf_random_f random_f,
-                      pf_debug_f debug_f);
+                      pf_parallel_f parallel_f, pf_debug_f debug_f);
+
+/*!
+ * \brief Set the node cache size for files opened afterwards
+ *
+ * \param [in] size Maximum size (in bytes) of decrypted nodes cached for a single open file
+ * \return PF status
+ * \details Must be at least PF_MIN_CACHE_SIZE. A bigger cache also allows a bigger read-ahead for
+ *          sequential reads (up to a quarter of the cache).
+ */
+pf_status_t pf_set_cache_size(size_t size);
 
 /*! Context representing an open protected file */
 typedef struct pf_context pf_context_t;
@@ -101,7 +101,17 @@ typedef struct _encrypted_node {
 
 static_assert(sizeof(encrypted_node_t) == PF_NODE_SIZE, "sizeof(encrypted_node_t)");
 
-#define MAX_PAGES_IN_CACHE 48
+// read-ahead of sequentially read data nodes (in nodes): the window starts at MIN and doubles on
+// every sequential cache miss, up to MAX (and up to a quarter of the cache size)
+#define MIN_READAHEAD_NODES 4U
+#define MAX_READAHEAD_NODES 32U
+
+// maximum number of adjacent nodes written to disk with one write
+#define MAX_NODES_PER_WRITE 64U
+
+// smaller batches of nodes are encrypted/decrypted on the calling thread only (waking up workers
+// costs more than the crypto)
+#define MIN_PARALLEL_NODES 4U
 
 typedef enum {
     FILE_MHT_NODE_TYPE  = 1,
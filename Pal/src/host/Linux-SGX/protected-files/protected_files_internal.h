@@ -29,6 +29,10 @@ struct pf_context {
     pf_key_t user_kdk_key;
     pf_key_t cur_key;
     lruc_context_t* cache;
+    size_t max_cache_nodes;
+    uint64_t request_end;    // end offset of the current read/write request
+    uint64_t readahead_next; // data node number at which a sequential read would continue
+    size_t readahead_nodes;  // current read-ahead window, 0 for random access
 #ifdef DEBUG
     char* debug_buffer; // buffer for debug output
 #endif
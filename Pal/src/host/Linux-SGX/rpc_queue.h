@@ -10,14 +10,24 @@
  * threads. If user specifies "0" or omits this directive, then no RPC threads are created and all
  * syscalls perform an enclave exit (as in previous versions of Graphene).
  *
- * All enclave and RPC threads work on a single shared RPC queue (global variable `g_rpc_queue`).
- * To issue a syscall, enclave thread enqueues syscall request in the queue and spins waiting for
- * result. RPC threads spin waiting for syscall requests; when request comes, first lucky RPC
- * thread grabs request, issues syscall to OS, and notifies enclave thread by releasing the request
- * lock. RPC queue is implemented as a FIFO ring buffer with one global lock.
+ * Enclave and RPC threads communicate via a sharded RPC queue (global variable `g_rpc_queue`). The
+ * queue consists of RPC_QUEUE_RINGS independent rings; each enclave thread always enqueues into the
+ * ring selected by its TCS index, so with up to RPC_QUEUE_RINGS enclave threads every ring has a
+ * single producer. To issue a syscall, enclave thread enqueues syscall request in its ring and
+ * spins waiting for result. RPC threads spin waiting for syscall requests, scanning all rings
+ * starting from their "home" ring (work stealing); when request comes, first lucky RPC thread
+ * grabs request, issues syscall to OS, and notifies enclave thread by releasing the request lock.
  *
- * The RPC queue with its ring buffer resides in *untrusted memory*. The enclave code accessing the
- * RPC queue must be carefully written to withstand attacks tampering with the queue.
+ * Each ring is a bounded lock-free queue based on Dmitry Vyukov's MPMC algorithm: every slot has a
+ * sequence number which tells producers and consumers whether the slot is free or filled for the
+ * current lap. Producers and consumers never take a lock; they only CAS their own position counter,
+ * and the two counters live on separate cache lines. With one producer per ring the producer CAS
+ * never fails; the algorithm stays correct if more enclave threads than rings share a ring.
+ *
+ * The RPC queue with its rings resides in *untrusted memory*. The enclave code accessing the RPC
+ * queue must be carefully written to withstand attacks tampering with the queue: ring and slot
+ * indices are always masked, and the enclave never spins unboundedly on values controlled by the
+ * host (it falls back to a normal OCALL instead).
  *
  * RPC queue can have up to RPC_QUEUE_SIZE requests simultaneously. All requests are allocated on
  * the untrusted stack of the enclave thread; enclave thread owns its requests and pops them off
@@ -25,6 +35,10 @@
  * for some time in hope the system call returns immediately (fast path), then sleeps waiting on
  * futex (slow path, useful for blocking syscalls).
  *
+ * This header is plain C and depends only on compiler atomics, so that the queue can be built and
+ * stress-tested outside of SGX (see `tools/rpc-queue-bench`). The request type `rpc_request_t` is
+ * defined in `ocall_types.h`.
+ *
  * NOTE: number of created RPC threads must match max number of simultaneous enclave threads. If
  * there are more RPC threads, CPU time is wasted. If there are less, some enclave threads may
  * starve, especially if there are many blocking syscalls by other enclave threads.
@@ -44,8 +58,6 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#include "spinlock.h"
-
 /* Number of iterations to spin before sleeping. We choose 1M as follows: we want to sleep on
  * blocking syscalls but we want to allow ample time for fast syscalls to complete. We choose
  * 1 millisecond -- more than enough time to complete any non-blocking syscall. Assuming a 1GHz
@@ -53,100 +65,152 @@
  * works well in practice. */
 #define RPC_SPINLOCK_TIMEOUT 1000000
 
-#define RPC_QUEUE_SIZE  1024 /* max # of requests in RPC queue */
-#define MAX_RPC_THREADS 256  /* max number of RPC threads */
+#define RPC_QUEUE_RINGS     64  /* number of rings (shards); must be a power of two */
+#define RPC_RING_SIZE       16  /* max # of requests in one ring; must be a power of two */
+#define RPC_QUEUE_SIZE      (RPC_QUEUE_RINGS * RPC_RING_SIZE) /* max # of requests in RPC queue */
+#define MAX_RPC_THREADS     256 /* max number of RPC threads */
+
+/* Number of attempts for an enclave thread to grab a slot in its ring; the producer position can be
+ * moved only by producers of the same ring, so contention (and thus retries) happens only when
+ * several enclave threads share a ring or when the untrusted host tampers with the ring. */
+#define RPC_ENQUEUE_RETRIES 64
+
+#define RPC_CACHELINE_SIZE  64
+
+struct rpc_request;
 
 typedef struct {
-    spinlock_t lock; /* can be UNLOCKED / LOCKED_NO_WAITERS / LOCKED_WITH_WAITERS */
-    long result;
-    uint64_t ocall_index;
-    void* buffer;
-} rpc_request_t;
+    uint64_t seq;             /* lap-tagged state of this slot, see rpc_enqueue()/rpc_dequeue() */
+    struct rpc_request* req;  /* syscall request stored in this slot */
+} rpc_slot_t;
+
+typedef struct {
+    /* producer and consumer positions are on separate cache lines to avoid false sharing between
+     * enclave threads and RPC threads */
+    __attribute__((aligned(RPC_CACHELINE_SIZE))) uint64_t enqueue_pos;
+    __attribute__((aligned(RPC_CACHELINE_SIZE))) uint64_t dequeue_pos;
+    __attribute__((aligned(RPC_CACHELINE_SIZE))) rpc_slot_t slots[RPC_RING_SIZE];
+} rpc_ring_t;
 
 typedef struct rpc_queue {
-    spinlock_t lock;                  /* global lock for enclave and RPC threads */
-    uint64_t front, rear;             /* indexes into front and rear ends of q */
-    rpc_request_t* q[RPC_QUEUE_SIZE]; /* queue of syscall requests */
-    int rpc_threads[MAX_RPC_THREADS]; /* RPC threads (thread IDs) */
-    size_t rpc_threads_cnt;           /* number of RPC threads */
+    rpc_ring_t rings[RPC_QUEUE_RINGS]; /* rings of syscall requests, one per enclave thread */
+    int rpc_threads[MAX_RPC_THREADS];  /* RPC threads (thread IDs) */
+    size_t rpc_threads_cnt;            /* number of RPC threads, updated atomically */
 } rpc_queue_t;
 
 extern rpc_queue_t* g_rpc_queue;  /* global RPC queue */
 
 static inline void rpc_queue_init(rpc_queue_t* q) {
-    spinlock_init(&q->lock);
-    q->front = 0;
-    q->rear  = 0;
-    for (size_t i = 0; i < RPC_QUEUE_SIZE; i++)
-        q->q[i] = NULL;
+    for (size_t r = 0; r < RPC_QUEUE_RINGS; r++) {
+        rpc_ring_t* ring = &q->rings[r];
+        ring->enqueue_pos = 0;
+        ring->dequeue_pos = 0;
+        for (size_t i = 0; i < RPC_RING_SIZE; i++) {
+            ring->slots[i].seq = i;
+            ring->slots[i].req = NULL;
+        }
+    }
+    q->rpc_threads_cnt = 0;
 }
 
 /*!
- * \brief Enqueue OCALL request `req` in the shared RPC queue `q`.
+ * \brief Enqueue OCALL request `req` in ring `ring_idx` of the shared RPC queue `q`.
  *
  * This function is called from the enclave code and thus must be written carefully to withstand
- * attacks tampering with untrusted `req` and untrusted `q`. In particular, `req` and `q` must not
- * have arbitrary pointers (or alternatively the code below must sanitize possible pointer values)
- * to prevent arbitrary writes to/reads from the enclave memory. Similarly, `q->q[idx]` code must
- * ensure that `idx` points inside the `q->q` array to prevent buffer overflows.
+ * attacks tampering with untrusted `q`. In particular, `q` must not have arbitrary pointers (or
+ * alternatively the code below must sanitize possible pointer values) to prevent arbitrary writes
+ * to/reads from the enclave memory. Similarly, all indices into `q->rings` and `ring->slots` are
+ * masked to prevent buffer overflows, and the number of retries is bounded so that the untrusted
+ * host cannot make the enclave thread spin forever.
+ *
+ * Returns false if the ring is full (or was tampered with); the caller should fall back to a normal
+ * OCALL in this case.
  */
-static inline bool rpc_enqueue(rpc_queue_t* q, rpc_request_t* req) {
-    bool ret = false;
-    spinlock_lock(&q->lock);
-
-    if (q->rear - q->front >= RPC_QUEUE_SIZE) {
-        /* queue is full, cannot enqueue */
-        goto out;
-    }
-
-    if (q->q[q->rear % RPC_QUEUE_SIZE]) {
-        /* current slot is occupied, cannot enqueue but the caller can try again */
-        q->rear++;
-        goto out;
+static inline bool rpc_enqueue(rpc_queue_t* q, size_t ring_idx, struct rpc_request* req) {
+    rpc_ring_t* ring = &q->rings[ring_idx & (RPC_QUEUE_RINGS - 1)];
+
+    uint64_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < RPC_ENQUEUE_RETRIES; i++) {
+        rpc_slot_t* slot = &ring->slots[pos & (RPC_RING_SIZE - 1)];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            /* slot is free for this lap, try to claim it */
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, /*weak=*/true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&slot->req, req, __ATOMIC_RELAXED);
+                /* publish the request to consumers */
+                __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            /* CAS failed and reloaded `pos`, retry */
+        } else if (diff < 0) {
+            /* slot still holds a request from the previous lap: ring is full */
+            return false;
+        } else {
+            /* another producer claimed this slot, catch up */
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
     }
-
-    q->q[q->rear % RPC_QUEUE_SIZE] = req;
-    q->rear++;
-    ret = true;
-out:
-    spinlock_unlock(&q->lock);
-    return ret;
+    return false;
 }
 
 /*!
- * \brief Dequeue OCALL request `req` from the shared RPC queue `q`.
+ * \brief Dequeue OCALL request from ring `ring_idx` of the shared RPC queue `q`.
  *
  * This function is called only from the untrusted code and thus has no security implications.
  */
-static inline rpc_request_t* rpc_dequeue(rpc_queue_t* q) {
-    if (__atomic_load_n(&q->front, __ATOMIC_RELAXED) ==
-            __atomic_load_n(&q->rear,  __ATOMIC_RELAXED)) {
-        /* quick check that queue is empty; this doesn't acquire a spinlock and thus lowers latency
-         * on rpc_enqueue() performed by enclave threads (they don't have to wait for spinlock
-         * release); note that untrusted RPC threads will simply retry again if this check fails */
-        return NULL;
-    }
-
-    rpc_request_t* ret = NULL;
-    spinlock_lock(&q->lock);
-
-    if (q->front == q->rear) {
-        /* queue is empty, nothing to dequeue */
-        goto out;
+static inline struct rpc_request* rpc_dequeue_ring(rpc_queue_t* q, size_t ring_idx) {
+    rpc_ring_t* ring = &q->rings[ring_idx & (RPC_QUEUE_RINGS - 1)];
+
+    uint64_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    while (true) {
+        rpc_slot_t* slot = &ring->slots[pos & (RPC_RING_SIZE - 1)];
+        uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - (pos + 1));
+        if (diff == 0) {
+            /* slot is filled for this lap, try to claim it */
+            if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, /*weak=*/true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                struct rpc_request* req = __atomic_load_n(&slot->req, __ATOMIC_RELAXED);
+                /* hand the slot back to producers for the next lap */
+                __atomic_store_n(&slot->seq, pos + RPC_RING_SIZE, __ATOMIC_RELEASE);
+                return req;
+            }
+            /* CAS failed and reloaded `pos`, retry */
+        } else if (diff < 0) {
+            /* ring is empty */
+            return NULL;
+        } else {
+            /* another RPC thread grabbed this request, catch up */
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+        }
     }
+}
 
-    if (!q->q[q->front % RPC_QUEUE_SIZE]) {
-        /* current slot is empty, cannot dequeue but the caller can try next one */
-        q->front++;
-        goto out;
+/*!
+ * \brief Dequeue OCALL request from the shared RPC queue `q`, starting from ring `home_idx`.
+ *
+ * RPC threads first look at their home ring and then steal requests from all other rings, so that
+ * every ring is served even if there are fewer RPC threads than enclave threads.
+ *
+ * This function is called only from the untrusted code and thus has no security implications.
+ */
+static inline struct rpc_request* rpc_dequeue(rpc_queue_t* q, size_t home_idx) {
+    for (size_t i = 0; i < RPC_QUEUE_RINGS; i++) {
+        size_t ring_idx = (home_idx + i) & (RPC_QUEUE_RINGS - 1);
+        rpc_ring_t* ring = &q->rings[ring_idx];
+        if (__atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED) ==
+                __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED)) {
+            /* quick check that ring is empty; this only reads the two positions and thus doesn't
+             * bounce the slot cache lines between RPC threads scanning idle rings */
+            continue;
+        }
+        struct rpc_request* req = rpc_dequeue_ring(q, ring_idx);
+        if (req)
+            return req;
     }
-
-    ret = q->q[q->front % RPC_QUEUE_SIZE];
-    q->q[q->front % RPC_QUEUE_SIZE] = NULL;
-    q->front++;
-out:
-    spinlock_unlock(&q->lock);
-    return ret;
+    return NULL;
 }
 
 #endif /* QUEUE_H_ */
@@ -648,6 +648,41 @@ static long sgx_ocall_eventfd(void* pms) {
     return ret;
 }
 
+static long sgx_ocall_epoll_create(void* pms) {
+    ms_ocall_epoll_create_t* ms = (ms_ocall_epoll_create_t*)pms;
+    long ret;
+    ODEBUG(OCALL_EPOLL_CREATE, ms);
+    ret = INLINE_SYSCALL(epoll_create1, 1, ms->ms_flags);
+    return ret;
+}
+
+static long sgx_ocall_epoll_ctl(void* pms) {
+    ms_ocall_epoll_ctl_t* ms = (ms_ocall_epoll_ctl_t*)pms;
+    long ret;
+    ODEBUG(OCALL_EPOLL_CTL, ms);
+    ret = INLINE_SYSCALL(epoll_ctl, 4, ms->ms_epfd, ms->ms_op, ms->ms_fd, &ms->ms_event);
+    return ret;
+}
+
+static long sgx_ocall_epoll_wait(void* pms) {
+    ms_ocall_epoll_wait_t* ms = (ms_ocall_epoll_wait_t*)pms;
+    long ret;
+    ODEBUG(OCALL_EPOLL_WAIT, ms);
+    int timeout_ms = -1;
+    if (ms->ms_timeout_us >= 0)
+        timeout_ms = MIN((ms->ms_timeout_us + 999) / 1000, (int64_t)INT_MAX);
+    ret = INLINE_SYSCALL(epoll_wait, 4, ms->ms_epfd, ms->ms_events, ms->ms_maxevents, timeout_ms);
+    return ret;
+}
+
+static long sgx_ocall_sendfile(void* pms) {
+    ms_ocall_sendfile_t* ms = (ms_ocall_sendfile_t*)pms;
+    long ret;
+    ODEBUG(OCALL_SENDFILE, ms);
+    ret = INLINE_SYSCALL(sendfile, 4, ms->ms_out_fd, ms->ms_in_fd, &ms->ms_offset, ms->ms_count);
+    return ret;
+}
+
 static long sgx_ocall_debug_map_add(void* pms) {
     ms_ocall_debug_map_add_t* ms = (ms_ocall_debug_map_add_t*)pms;
 
@@ -683,6 +718,45 @@ static long sgx_ocall_get_quote(void* pms) {
                           &ms->ms_nonce, &ms->ms_quote, &ms->ms_quote_len);
 }
 
+static long sgx_ocall_batch_io(void* pms) {
+    ms_ocall_batch_io_t* ms = (ms_ocall_batch_io_t*)pms;
+    ODEBUG(OCALL_BATCH_IO, ms);
+
+    for (size_t i = 0; i < ms->ms_count; i++) {
+        ms_ocall_batch_io_req_t* req = &ms->ms_reqs[i];
+        long ret;
+        switch (req->ms_op) {
+            case BATCH_IO_READ:
+                ret = INLINE_SYSCALL(read, 3, req->ms_fd, req->ms_buf, req->ms_count);
+                break;
+            case BATCH_IO_WRITE:
+                ret = INLINE_SYSCALL(write, 3, req->ms_fd, req->ms_buf, req->ms_count);
+                break;
+            case BATCH_IO_PREAD:
+                ret = INLINE_SYSCALL(pread64, 4, req->ms_fd, req->ms_buf, req->ms_count,
+                                     req->ms_offset);
+                break;
+            case BATCH_IO_PWRITE:
+                ret = INLINE_SYSCALL(pwrite64, 4, req->ms_fd, req->ms_buf, req->ms_count,
+                                     req->ms_offset);
+                break;
+            case BATCH_IO_RECV:
+                ret = INLINE_SYSCALL(recvfrom, 6, req->ms_fd, req->ms_buf, req->ms_count, 0, NULL,
+                                     NULL);
+                break;
+            case BATCH_IO_SEND:
+                ret = INLINE_SYSCALL(sendto, 6, req->ms_fd, req->ms_buf, req->ms_count,
+                                     MSG_NOSIGNAL, NULL, 0);
+                break;
+            default:
+                ret = -EINVAL;
+                break;
+        }
+        req->ms_result = ret;
+    }
+    return 0;
+}
+
 sgx_ocall_fn_t ocall_table[OCALL_NR] = {
     [OCALL_EXIT]             = sgx_ocall_exit,
     [OCALL_MMAP_UNTRUSTED]   = sgx_ocall_mmap_untrusted,
@@ -725,6 +799,11 @@ sgx_ocall_fn_t ocall_table[OCALL_NR] = {
     [OCALL_DEBUG_MAP_REMOVE] = sgx_ocall_debug_map_remove,
     [OCALL_EVENTFD]          = sgx_ocall_eventfd,
     [OCALL_GET_QUOTE]        = sgx_ocall_get_quote,
+    [OCALL_BATCH_IO]         = sgx_ocall_batch_io,
+    [OCALL_EPOLL_CREATE]     = sgx_ocall_epoll_create,
+    [OCALL_EPOLL_CTL]        = sgx_ocall_epoll_ctl,
+    [OCALL_EPOLL_WAIT]       = sgx_ocall_epoll_wait,
+    [OCALL_SENDFILE]         = sgx_ocall_sendfile,
 };
 
 #define EDEBUG(code, ms) \
@@ -734,7 +813,8 @@ sgx_ocall_fn_t ocall_table[OCALL_NR] = {
 rpc_queue_t* g_rpc_queue = NULL; /* pointer to untrusted queue */
 
 static int rpc_thread_loop(void* arg) {
-    __UNUSED(arg);
+    /* index of this RPC thread, also used as its home ring in the RPC queue */
+    size_t rpc_thread_idx = (size_t)arg;
     long mytid = INLINE_SYSCALL(gettid, 0);
 
     /* block all signals except SIGUSR2 for RPC thread */
@@ -743,10 +823,8 @@ static int rpc_thread_loop(void* arg) {
     __sigdelset(&mask, SIGUSR2);
     INLINE_SYSCALL(rt_sigprocmask, 4, SIG_SETMASK, &mask, NULL, sizeof(mask));
 
-    spinlock_lock(&g_rpc_queue->lock);
-    g_rpc_queue->rpc_threads[g_rpc_queue->rpc_threads_cnt] = mytid;
-    g_rpc_queue->rpc_threads_cnt++;
-    spinlock_unlock(&g_rpc_queue->lock);
+    g_rpc_queue->rpc_threads[rpc_thread_idx] = mytid;
+    __atomic_add_fetch(&g_rpc_queue->rpc_threads_cnt, 1, __ATOMIC_RELEASE);
 
     static const uint64_t SPIN_ATTEMPTS_MAX = 10000;     /* rather arbitrary */
     static const uint64_t SLEEP_TIME_MAX    = 100000000; /* nanoseconds (0.1 seconds) */
@@ -757,7 +835,7 @@ static int rpc_thread_loop(void* arg) {
     uint64_t sleep_time    = 0;
 
     while (1) {
-        rpc_request_t* req = rpc_dequeue(g_rpc_queue);
+        rpc_request_t* req = rpc_dequeue(g_rpc_queue, rpc_thread_idx);
         if (!req) {
             if (spin_attempts == SPIN_ATTEMPTS_MAX) {
                 if (sleep_time < SLEEP_TIME_MAX)
@@ -820,7 +898,7 @@ static int start_rpc(size_t num_of_threads) {
         int ret = clone(rpc_thread_loop, child_stack_top,
                         CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SYSVSEM |
                         CLONE_THREAD | CLONE_SIGHAND | CLONE_PTRACE | CLONE_PARENT_SETTID,
-                        NULL, &dummy_parent_tid_field, NULL);
+                        (void*)i, &dummy_parent_tid_field, NULL);
 
         if (ret < 0) {
             INLINE_SYSCALL(munmap, 2, stack, RPC_STACK_SIZE);
@@ -830,9 +908,7 @@ static int start_rpc(size_t num_of_threads) {
 
     /* wait until all RPC threads are initialized in rpc_thread_loop */
     while (1) {
-        spinlock_lock(&g_rpc_queue->lock);
-        size_t n = g_rpc_queue->rpc_threads_cnt;
-        spinlock_unlock(&g_rpc_queue->lock);
+        size_t n = __atomic_load_n(&g_rpc_queue->rpc_threads_cnt, __ATOMIC_ACQUIRE);
         if (n == g_pal_enclave.rpc_thread_num)
             break;
         INLINE_SYSCALL(sched_yield, 0);
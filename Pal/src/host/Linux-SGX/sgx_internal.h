@@ -11,10 +11,10 @@
 #include <sys/syscall.h>
 
 #include "api.h"
+#include "manifest.h"
 #include "pal_linux.h"
 #include "pal_security.h"
 #include "sysdep-arch.h"
-#include "toml.h"
 
 #define IS_ERR_P INTERNAL_SYSCALL_ERROR_P
 #define ERRNO_P  INTERNAL_SYSCALL_ERRNO_P
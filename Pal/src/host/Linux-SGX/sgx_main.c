@@ -16,7 +16,7 @@
 #include "pal_linux_error.h"
 #include "pal_rtld.h"
 #include "hex.h"
-#include "toml.h"
+#include "manifest.h"
 #include "topo_info.h"
 
 #include "debug_map.h"
@@ -557,12 +557,16 @@ out:
 /* Parses only the information needed by the untrusted PAL to correctly initialize the enclave. */
 static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info) {
     int ret = 0;
-    toml_table_t* manifest_root = NULL;
+    struct manifest compiled_manifest;
+    const struct manifest* manifest_root = &compiled_manifest;
+    void* image = NULL;
+    size_t image_size;
     char* sgx_ra_client_spid_str = NULL;
 
+    /* the enclave measures and compiles the TOML manifest itself, this copy is only for us */
     char errbuf[256];
-    manifest_root = toml_parse(manifest, errbuf, sizeof(errbuf));
-    if (!manifest_root) {
+    ret = manifest_compile_toml(manifest, &image, &image_size, errbuf, sizeof(errbuf));
+    if (ret < 0) {
         log_error(
             "PAL failed at parsing the manifest: %s\n"
             "  Graphene switched to the TOML format recently, please update the manifest\n"
@@ -570,9 +574,15 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
         ret = -EINVAL;
         goto out;
     }
+    ret = manifest_load(&compiled_manifest, image, image_size);
+    if (ret < 0) {
+        log_error("Cannot load the compiled manifest");
+        ret = -EINVAL;
+        goto out;
+    }
 
-    ret = toml_sizestring_in(manifest_root, "sgx.enclave_size", /*defaultval=*/0,
-                             &enclave_info->size);
+    ret = manifest_sizestring_in(manifest_root, "sgx.enclave_size", /*defaultval=*/0,
+                                 &enclave_info->size);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.enclave_size' (the value must be put in double quotes!)");
         ret = -EINVAL;
@@ -586,7 +596,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
 
     int64_t thread_num_int64;
-    ret = toml_int_in(manifest_root, "sgx.thread_num", /*defaultval=*/0, &thread_num_int64);
+    ret = manifest_int_in(manifest_root, "sgx.thread_num", /*defaultval=*/0, &thread_num_int64);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.thread_num'");
         ret = -EINVAL;
@@ -614,7 +624,8 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
 
     int64_t rpc_thread_num_int64;
-    ret = toml_int_in(manifest_root, "sgx.rpc_thread_num", /*defaultval=*/0, &rpc_thread_num_int64);
+    ret = manifest_int_in(manifest_root, "sgx.rpc_thread_num", /*defaultval=*/0,
+                          &rpc_thread_num_int64);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.rpc_thread_num'");
         ret = -EINVAL;
@@ -642,7 +653,8 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
 
     bool nonpie_binary;
-    ret = toml_bool_in(manifest_root, "sgx.nonpie_binary", /*defaultval=*/false, &nonpie_binary);
+    ret = manifest_bool_in(manifest_root, "sgx.nonpie_binary", /*defaultval=*/false,
+                           &nonpie_binary);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.nonpie_binary' (the value must be `true` or `false`)");
         ret = -EINVAL;
@@ -650,8 +662,8 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
     enclave_info->nonpie_binary = nonpie_binary;
 
-    ret = toml_bool_in(manifest_root, "sgx.enable_stats", /*defaultval=*/false,
-                       &g_sgx_enable_stats);
+    ret = manifest_bool_in(manifest_root, "sgx.enable_stats", /*defaultval=*/false,
+                           &g_sgx_enable_stats);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.enable_stats' (the value must be `true` or `false`)");
         ret = -EINVAL;
@@ -659,7 +671,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
 
     char* dummy_sigfile_str = NULL;
-    ret = toml_string_in(manifest_root, "sgx.sigfile", &dummy_sigfile_str);
+    ret = manifest_string_in(manifest_root, "sgx.sigfile", &dummy_sigfile_str);
     if (ret < 0 || dummy_sigfile_str) {
         log_error("sgx.sigfile is not supported anymore. Please update your manifest according to "
                   "the current documentation.");
@@ -669,8 +681,8 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     free(dummy_sigfile_str);
 
     bool sgx_remote_attestation_enabled;
-    ret = toml_bool_in(manifest_root, "sgx.remote_attestation", /*defaultval=*/false,
-                       &sgx_remote_attestation_enabled);
+    ret = manifest_bool_in(manifest_root, "sgx.remote_attestation", /*defaultval=*/false,
+                           &sgx_remote_attestation_enabled);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.remote_attestation' (the value must be `true` or `false`)");
         ret = -EINVAL;
@@ -678,7 +690,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
     enclave_info->remote_attestation_enabled = sgx_remote_attestation_enabled;
 
-    ret = toml_string_in(manifest_root, "sgx.ra_client_spid", &sgx_ra_client_spid_str);
+    ret = manifest_string_in(manifest_root, "sgx.ra_client_spid", &sgx_ra_client_spid_str);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.ra_client_spid' (the value must be put in double quotes!)");
         ret = -EINVAL;
@@ -686,7 +698,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
 
     bool sgx_ra_client_linkable_specified =
-        toml_key_exists(manifest_root, "sgx.ra_client_linkable");
+        manifest_key_exists(manifest_root, "sgx.ra_client_linkable");
 
     if (!enclave_info->remote_attestation_enabled &&
             (sgx_ra_client_spid_str || sgx_ra_client_linkable_specified)) {
@@ -702,7 +714,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     enclave_info->use_epid_attestation = sgx_ra_client_spid_str && strlen(sgx_ra_client_spid_str);
 
     char* profile_str = NULL;
-    ret = toml_string_in(manifest_root, "sgx.profile.enable", &profile_str);
+    ret = manifest_string_in(manifest_root, "sgx.profile.enable", &profile_str);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.profile.enable' "
                   "(the value must be \"none\", \"main\" or \"all\")");
@@ -734,7 +746,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
 
     char* profile_mode_str = NULL;
-    ret = toml_string_in(manifest_root, "sgx.profile.mode", &profile_mode_str);
+    ret = manifest_string_in(manifest_root, "sgx.profile.mode", &profile_mode_str);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.profile.mode' "
                   "(the value must be \"aex\", \"ocall_inner\" or \"ocall_outer\")");
@@ -757,8 +769,8 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
 
     bool profile_with_stack;
-    ret = toml_bool_in(manifest_root, "sgx.profile.with_stack", /*defaultval=*/false,
-                       &profile_with_stack);
+    ret = manifest_bool_in(manifest_root, "sgx.profile.with_stack", /*defaultval=*/false,
+                           &profile_with_stack);
     if (ret < 0) {
         log_error("Cannot parse 'sgx.profile.with_stack' (the value must be `true` or `false`)");
         ret = -EINVAL;
@@ -776,8 +788,8 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     }
 
     int64_t profile_frequency;
-    ret = toml_int_in(manifest_root, "sgx.profile.frequency", SGX_PROFILE_DEFAULT_FREQUENCY,
-                      &profile_frequency);
+    ret = manifest_int_in(manifest_root, "sgx.profile.frequency", SGX_PROFILE_DEFAULT_FREQUENCY,
+                          &profile_frequency);
     if (ret < 0 || !(0 < profile_frequency && profile_frequency <= SGX_PROFILE_MAX_FREQUENCY)) {
         log_error("Cannot parse 'sgx.profile.frequency' (the value must be between 1 and %d)",
                   SGX_PROFILE_MAX_FREQUENCY);
@@ -796,7 +808,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
 
     int log_level = PAL_LOG_DEFAULT_LEVEL;
     char* log_level_str = NULL;
-    ret = toml_string_in(manifest_root, "loader.log_level", &log_level_str);
+    ret = manifest_string_in(manifest_root, "loader.log_level", &log_level_str);
     if (ret < 0) {
         log_error("Cannot parse 'loader.log_level'");
         ret = -EINVAL;
@@ -824,7 +836,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
     free(log_level_str);
 
     char* log_file = NULL;
-    ret = toml_string_in(manifest_root, "loader.log_file", &log_file);
+    ret = manifest_string_in(manifest_root, "loader.log_file", &log_file);
     if (ret < 0) {
         log_error("Cannot parse 'loader.log_file'");
         ret = -EINVAL;
@@ -846,7 +858,7 @@ static int parse_loader_config(char* manifest, struct pal_enclave* enclave_info)
 
 out:
     free(sgx_ra_client_spid_str);
-    toml_free(manifest_root);
+    free(image);
     return ret;
 }
 
@@ -0,0 +1,378 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Throughput benchmark for protected files (protected_files.c).
+ *
+ * The protected files library is plain C, so this program runs on any Linux machine without SGX:
+ * files are accessed through regular host reads and writes (which stand for OCALLs in the
+ * enclave), and encryption is done with mbedTLS. Every workload is run with several node cache
+ * sizes; besides throughput, the number of host reads and writes is reported, because in the
+ * enclave every one of them is an OCALL. All data read back is compared with an in-memory copy of
+ * the file, so the benchmark doubles as a correctness test.
+ *
+ * Encryption and decryption of independent nodes can be spread over a pool of threads (the
+ * `parallel_f` callback); every workload is run with several thread counts to show the scaling.
+ *
+ * Usage: pf_bench [--size MB] [--io-size KB] [--ops N] [--cache-size KB] [--threads N]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pf_util.h"
+
+/* size of random reads and writes */
+#define RANDOM_IO_SIZE 4096
+
+static size_t g_file_size = 64 << 20;
+static size_t g_io_size = 64 << 10;
+static size_t g_random_ops = 20000;
+
+static char g_path[] = "/tmp/pf_bench.XXXXXX";
+static pf_key_t g_key;
+static uint8_t* g_shadow; /* expected contents of the file */
+static uint8_t* g_buf;
+
+static uint64_t g_host_reads;
+static uint64_t g_host_writes;
+
+/* Thread pool for the parallel execution callback; the calling thread takes part in every batch,
+ * so a pool of N threads has N - 1 workers. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    size_t workers;      /* workers taking part in batches, the others stay idle */
+    uint64_t gen;        /* incremented for every batch */
+    size_t active;       /* workers still running the current batch */
+    pf_job_f job;
+    void* arg;
+    size_t count;
+    size_t next;         /* next job index, taken atomically */
+} g_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start_cond = PTHREAD_COND_INITIALIZER,
+    .done_cond = PTHREAD_COND_INITIALIZER,
+};
+
+static pf_status_t bench_read(pf_handle_t handle, void* buffer, uint64_t offset, size_t size) {
+    g_host_reads++;
+    ssize_t ret = pread(*(int*)handle, buffer, size, offset);
+    return ret == (ssize_t)size ? PF_STATUS_SUCCESS : PF_STATUS_CALLBACK_FAILED;
+}
+
+static pf_status_t bench_write(pf_handle_t handle, const void* buffer, uint64_t offset,
+                               size_t size) {
+    g_host_writes++;
+    ssize_t ret = pwrite(*(int*)handle, buffer, size, offset);
+    return ret == (ssize_t)size ? PF_STATUS_SUCCESS : PF_STATUS_CALLBACK_FAILED;
+}
+
+static pf_status_t bench_truncate(pf_handle_t handle, uint64_t size) {
+    return ftruncate(*(int*)handle, size) == 0 ? PF_STATUS_SUCCESS : PF_STATUS_CALLBACK_FAILED;
+}
+
+static pf_status_t bench_random(uint8_t* buffer, size_t size) {
+    while (size > 0) {
+        ssize_t ret = getrandom(buffer, size, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return PF_STATUS_CALLBACK_FAILED;
+        }
+        buffer += ret;
+        size -= ret;
+    }
+    return PF_STATUS_SUCCESS;
+}
+
+static void pool_run_jobs(pf_job_f job, void* arg, size_t count) {
+    size_t index;
+    while ((index = __atomic_fetch_add(&g_pool.next, 1, __ATOMIC_RELAXED)) < count)
+        job(arg, index);
+}
+
+static void* pool_worker(void* arg) {
+    size_t id = (size_t)arg;
+    uint64_t seen_gen = 0;
+
+    while (true) {
+        pthread_mutex_lock(&g_pool.lock);
+        while (g_pool.gen == seen_gen)
+            pthread_cond_wait(&g_pool.start_cond, &g_pool.lock);
+        seen_gen = g_pool.gen;
+        if (id >= g_pool.workers) {
+            pthread_mutex_unlock(&g_pool.lock);
+            continue;
+        }
+        pf_job_f job = g_pool.job;
+        void* arg = g_pool.arg;
+        size_t count = g_pool.count;
+        pthread_mutex_unlock(&g_pool.lock);
+
+        pool_run_jobs(job, arg, count);
+
+        pthread_mutex_lock(&g_pool.lock);
+        if (--g_pool.active == 0)
+            pthread_cond_signal(&g_pool.done_cond);
+        pthread_mutex_unlock(&g_pool.lock);
+    }
+    return NULL;
+}
+
+static void bench_parallel(pf_job_f job, void* arg, size_t count) {
+    pthread_mutex_lock(&g_pool.lock);
+    g_pool.job = job;
+    g_pool.arg = arg;
+    g_pool.count = count;
+    g_pool.next = 0;
+    g_pool.active = g_pool.workers;
+    g_pool.gen++;
+    pthread_cond_broadcast(&g_pool.start_cond);
+    pthread_mutex_unlock(&g_pool.lock);
+
+    pool_run_jobs(job, arg, count);
+
+    pthread_mutex_lock(&g_pool.lock);
+    while (g_pool.active > 0)
+        pthread_cond_wait(&g_pool.done_cond, &g_pool.lock);
+    pthread_mutex_unlock(&g_pool.lock);
+}
+
+/* Makes `threads` threads (including the caller) take part in batches and installs the callbacks.
+ * The pool only grows, surplus workers stay idle. */
+static void set_threads(size_t threads) {
+    static size_t started = 0;
+
+    for (; started + 1 < threads; started++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pool_worker, (void*)started) != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            exit(1);
+        }
+    }
+    g_pool.workers = threads - 1;
+
+    /* count host I/O, crypto is done by mbedTLS as in pf_crypt */
+    pf_set_callbacks(bench_read, bench_write, bench_truncate, mbedtls_aes_cmac,
+                     mbedtls_aes_gcm_encrypt, mbedtls_aes_gcm_decrypt, bench_random,
+                     threads > 1 ? bench_parallel : NULL, /*debug_f=*/NULL);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void check(pf_status_t status, const char* what) {
+    if (PF_FAILURE(status)) {
+        fprintf(stderr, "%s failed: %s\n", what, pf_strerror(status));
+        exit(1);
+    }
+}
+
+static void check_data(const void* data, uint64_t offset, size_t size) {
+    if (memcmp(data, g_shadow + offset, size)) {
+        fprintf(stderr, "wrong data read at offset %lu (size %zu)\n", offset, size);
+        exit(1);
+    }
+}
+
+static pf_context_t* open_file(int* fd, bool create) {
+    *fd = open(g_path, O_RDWR | (create ? O_TRUNC : 0));
+    if (*fd < 0) {
+        perror("open");
+        exit(1);
+    }
+
+    uint64_t size = create ? 0 : (uint64_t)lseek(*fd, 0, SEEK_END);
+    pf_context_t* pf;
+    check(pf_open(fd, g_path, size, PF_FILE_MODE_READ | PF_FILE_MODE_WRITE, create, &g_key, &pf),
+          "pf_open");
+    return pf;
+}
+
+static void close_file(pf_context_t* pf, int fd) {
+    check(pf_close(pf), "pf_close");
+    close(fd);
+}
+
+static uint64_t random_offset(void) {
+    return (uint64_t)random() % (g_file_size - RANDOM_IO_SIZE + 1);
+}
+
+static void seq_write(pf_context_t* pf) {
+    for (size_t offset = 0; offset < g_file_size; offset += g_io_size) {
+        size_t size = g_io_size < g_file_size - offset ? g_io_size : g_file_size - offset;
+        check(pf_write(pf, offset, size, g_shadow + offset), "pf_write");
+    }
+}
+
+static void seq_read(pf_context_t* pf) {
+    for (size_t offset = 0; offset < g_file_size; offset += g_io_size) {
+        size_t size = g_io_size < g_file_size - offset ? g_io_size : g_file_size - offset;
+        size_t bytes_read;
+        check(pf_read(pf, offset, size, g_buf, &bytes_read), "pf_read");
+        if (bytes_read != size) {
+            fprintf(stderr, "short read at offset %zu\n", offset);
+            exit(1);
+        }
+        check_data(g_buf, offset, size);
+    }
+}
+
+static void rand_read(pf_context_t* pf) {
+    for (size_t i = 0; i < g_random_ops; i++) {
+        uint64_t offset = random_offset();
+        size_t bytes_read;
+        check(pf_read(pf, offset, RANDOM_IO_SIZE, g_buf, &bytes_read), "pf_read");
+        if (bytes_read != RANDOM_IO_SIZE) {
+            fprintf(stderr, "short read at offset %lu\n", offset);
+            exit(1);
+        }
+        check_data(g_buf, offset, RANDOM_IO_SIZE);
+    }
+}
+
+static void rand_write(pf_context_t* pf) {
+    for (size_t i = 0; i < g_random_ops; i++) {
+        uint64_t offset = random_offset();
+        for (size_t j = 0; j < RANDOM_IO_SIZE; j++)
+            g_shadow[offset + j] = (uint8_t)random();
+        check(pf_write(pf, offset, RANDOM_IO_SIZE, g_shadow + offset), "pf_write");
+    }
+}
+
+static void run(const char* name, void (*workload)(pf_context_t* pf), bool create,
+                size_t bytes) {
+    int fd;
+    g_host_reads = g_host_writes = 0;
+
+    double start = now();
+    pf_context_t* pf = open_file(&fd, create);
+    workload(pf);
+    /* closing flushes all changes, so it is a part of the measurement */
+    close_file(pf, fd);
+    double elapsed = now() - start;
+
+    printf("  %-12s %10.1f MB/s %10lu reads %10lu writes\n", name, bytes / elapsed / (1 << 20),
+           g_host_reads, g_host_writes);
+}
+
+static void run_all(size_t cache_size, size_t threads) {
+    check(pf_set_cache_size(cache_size), "pf_set_cache_size");
+    set_threads(threads);
+    printf("cache size %zu KB, %zu thread(s):\n", cache_size >> 10, threads);
+
+    run("seq-write", seq_write, /*create=*/true, g_file_size);
+    run("seq-read", seq_read, /*create=*/false, g_file_size);
+    run("rand-read", rand_read, /*create=*/false, g_random_ops * RANDOM_IO_SIZE);
+    run("rand-write", rand_write, /*create=*/false, g_random_ops * RANDOM_IO_SIZE);
+
+    /* check that random writes were persisted correctly */
+    int fd;
+    pf_context_t* pf = open_file(&fd, /*create=*/false);
+    seq_read(pf);
+    close_file(pf, fd);
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [--size MB] [--io-size KB] [--ops N] [--cache-size KB] "
+                    "[--threads N]\n", argv0);
+}
+
+int main(int argc, char** argv) {
+    static struct option options[] = {
+        { "size", required_argument, 0, 's' },
+        { "io-size", required_argument, 0, 'i' },
+        { "ops", required_argument, 0, 'n' },
+        { "cache-size", required_argument, 0, 'c' },
+        { "threads", required_argument, 0, 't' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+    size_t cache_size = 0;
+    size_t threads = 0;
+
+    while (true) {
+        int opt = getopt_long(argc, argv, "s:i:n:c:t:h", options, NULL);
+        if (opt == -1)
+            break;
+        switch (opt) {
+            case 's':
+                g_file_size = strtoull(optarg, NULL, 0) << 20;
+                break;
+            case 'i':
+                g_io_size = strtoull(optarg, NULL, 0) << 10;
+                break;
+            case 'n':
+                g_random_ops = strtoull(optarg, NULL, 0);
+                break;
+            case 'c':
+                cache_size = strtoull(optarg, NULL, 0) << 10;
+                break;
+            case 't':
+                threads = strtoull(optarg, NULL, 0);
+                if (!threads) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (g_file_size < RANDOM_IO_SIZE || !g_io_size) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (pf_init() != 0)
+        return 1;
+
+    g_shadow = malloc(g_file_size);
+    g_buf = malloc(g_io_size > RANDOM_IO_SIZE ? g_io_size : RANDOM_IO_SIZE);
+    if (!g_shadow || !g_buf)
+        return 1;
+    for (size_t i = 0; i < g_file_size; i++)
+        g_shadow[i] = (uint8_t)random();
+    check(bench_random(g_key, sizeof(g_key)), "bench_random");
+
+    int fd = mkstemp(g_path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    static const size_t default_cache_sizes[] = { PF_DEFAULT_CACHE_SIZE, 1 << 20, 16 << 20 };
+    static const size_t default_threads[] = { 1, 2, 4 };
+    size_t cache_sizes_count = cache_size ? 1 : sizeof(default_cache_sizes) / sizeof(size_t);
+    size_t threads_count = threads ? 1 : sizeof(default_threads) / sizeof(size_t);
+
+    for (size_t i = 0; i < cache_sizes_count; i++) {
+        for (size_t j = 0; j < threads_count; j++) {
+            run_all(cache_size ? cache_size : default_cache_sizes[i],
+                    threads ? threads : default_threads[j]);
+        }
+    }
+
+    unlink(g_path);
+    free(g_buf);
+    free(g_shadow);
+    printf("TEST OK\n");
+    return 0;
+}
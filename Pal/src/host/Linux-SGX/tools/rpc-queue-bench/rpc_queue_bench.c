@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Stress test and throughput benchmark for the Exitless RPC queue (rpc_queue.h).
+ *
+ * The RPC queue is plain C, so this program runs on any Linux machine without SGX: producer
+ * threads play the role of enclave threads (each one enqueues into its own ring, like enclave
+ * threads do with their TCS index) and consumer threads play the role of untrusted RPC threads
+ * (they dequeue requests with work stealing and "execute" them). For comparison, the same workload
+ * is run against a single ring protected by one global spinlock, which is how the RPC queue used to
+ * be implemented.
+ *
+ * Usage: rpc_queue_bench [--stress] [--consumers N] [--requests N]
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rpc_queue.h"
+
+/* benchmark runs 1..RPC_QUEUE_RINGS producers; stress test goes further so that rings are shared */
+#define MAX_PRODUCERS (2 * RPC_QUEUE_RINGS)
+
+/* the RPC queue only sees pointers to requests, so this test uses its own simplified request */
+struct rpc_request {
+    uint32_t done;
+    uint64_t ocall_index;
+    uint64_t result;
+};
+
+rpc_queue_t* g_rpc_queue;
+
+static uint64_t g_requests_per_producer = 200000;
+static size_t g_consumers = 4;
+static bool g_use_locked_queue;
+static bool g_stop;
+
+/* baseline: single ring protected by a global spinlock, as in the original RPC queue */
+static struct {
+    uint32_t lock;
+    uint64_t front, rear;
+    struct rpc_request* q[RPC_QUEUE_SIZE];
+} g_locked_queue;
+
+static void cpu_relax(size_t* spins);
+
+static void locked_queue_lock(void) {
+    size_t spins = 0;
+    while (__atomic_exchange_n(&g_locked_queue.lock, 1, __ATOMIC_ACQUIRE))
+        while (__atomic_load_n(&g_locked_queue.lock, __ATOMIC_RELAXED))
+            cpu_relax(&spins);
+}
+
+static void locked_queue_unlock(void) {
+    __atomic_store_n(&g_locked_queue.lock, 0, __ATOMIC_RELEASE);
+}
+
+static bool locked_enqueue(struct rpc_request* req) {
+    bool ret = false;
+    locked_queue_lock();
+    if (g_locked_queue.rear - g_locked_queue.front < RPC_QUEUE_SIZE) {
+        g_locked_queue.q[g_locked_queue.rear % RPC_QUEUE_SIZE] = req;
+        g_locked_queue.rear++;
+        ret = true;
+    }
+    locked_queue_unlock();
+    return ret;
+}
+
+static struct rpc_request* locked_dequeue(void) {
+    if (__atomic_load_n(&g_locked_queue.front, __ATOMIC_RELAXED) ==
+            __atomic_load_n(&g_locked_queue.rear, __ATOMIC_RELAXED))
+        return NULL;
+
+    struct rpc_request* ret = NULL;
+    locked_queue_lock();
+    if (g_locked_queue.front != g_locked_queue.rear) {
+        ret = g_locked_queue.q[g_locked_queue.front % RPC_QUEUE_SIZE];
+        g_locked_queue.front++;
+    }
+    locked_queue_unlock();
+    return ret;
+}
+
+/* spin for a while, then yield; keeps the benchmark usable when threads outnumber CPUs */
+static void cpu_relax(size_t* spins) {
+    if (++*spins % 1024 == 0) {
+        sched_yield();
+    } else {
+        __builtin_ia32_pause();
+    }
+}
+
+static void* producer(void* arg) {
+    size_t ring_idx = (size_t)arg;
+    struct rpc_request req;
+
+    for (uint64_t i = 0; i < g_requests_per_producer; i++) {
+        req.ocall_index = (ring_idx << 32) | i;
+        req.result = 0;
+        __atomic_store_n(&req.done, 0, __ATOMIC_RELAXED);
+
+        size_t spins = 0;
+        while (!(g_use_locked_queue ? locked_enqueue(&req)
+                                    : rpc_enqueue(g_rpc_queue, ring_idx, &req)))
+            cpu_relax(&spins);
+
+        while (!__atomic_load_n(&req.done, __ATOMIC_ACQUIRE))
+            cpu_relax(&spins);
+
+        if (req.result != req.ocall_index + 1) {
+            fprintf(stderr, "producer %zu: wrong result for request %lu\n", ring_idx, i);
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+static void* consumer(void* arg) {
+    size_t home_idx = (size_t)arg;
+    uint64_t* served = calloc(1, sizeof(*served));
+    if (!served)
+        abort();
+
+    size_t spins = 0;
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+        struct rpc_request* req = g_use_locked_queue ? locked_dequeue()
+                                                     : rpc_dequeue(g_rpc_queue, home_idx);
+        if (!req) {
+            cpu_relax(&spins);
+            continue;
+        }
+        req->result = req->ocall_index + 1;
+        __atomic_store_n(&req->done, 1, __ATOMIC_RELEASE);
+        (*served)++;
+    }
+    return served;
+}
+
+static double run(size_t producers, bool use_locked_queue) {
+    pthread_t prod_threads[MAX_PRODUCERS];
+    pthread_t cons_threads[MAX_RPC_THREADS];
+    struct timespec start, end;
+
+    g_use_locked_queue = use_locked_queue;
+    rpc_queue_init(g_rpc_queue);
+    memset(&g_locked_queue, 0, sizeof(g_locked_queue));
+    __atomic_store_n(&g_stop, false, __ATOMIC_RELAXED);
+
+    for (size_t i = 0; i < g_consumers; i++)
+        if (pthread_create(&cons_threads[i], NULL, consumer, (void*)i))
+            abort();
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < producers; i++)
+        if (pthread_create(&prod_threads[i], NULL, producer, (void*)i))
+            abort();
+    for (size_t i = 0; i < producers; i++)
+        pthread_join(prod_threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    __atomic_store_n(&g_stop, true, __ATOMIC_RELAXED);
+    uint64_t served = 0;
+    for (size_t i = 0; i < g_consumers; i++) {
+        void* ret;
+        pthread_join(cons_threads[i], &ret);
+        served += *(uint64_t*)ret;
+        free(ret);
+    }
+
+    uint64_t expected = producers * g_requests_per_producer;
+    if (served != expected) {
+        fprintf(stderr, "served %lu requests, expected %lu\n", served, expected);
+        exit(1);
+    }
+
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return expected / secs;
+}
+
+static void usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [--stress] [--consumers N] [--requests N]\n", argv0);
+}
+
+int main(int argc, char** argv) {
+    static struct option options[] = {
+        { "stress", no_argument, 0, 's' },
+        { "consumers", required_argument, 0, 'c' },
+        { "requests", required_argument, 0, 'r' },
+        { "help", no_argument, 0, 'h' },
+        { 0, 0, 0, 0 }
+    };
+    bool stress = false;
+
+    while (true) {
+        int opt = getopt_long(argc, argv, "sc:r:h", options, NULL);
+        if (opt == -1)
+            break;
+        switch (opt) {
+            case 's':
+                stress = true;
+                break;
+            case 'c':
+                g_consumers = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                g_requests_per_producer = strtoull(optarg, NULL, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!g_consumers || g_consumers > MAX_RPC_THREADS) {
+        fprintf(stderr, "Number of consumers must be between 1 and %d\n", MAX_RPC_THREADS);
+        return 1;
+    }
+
+    g_rpc_queue = aligned_alloc(RPC_CACHELINE_SIZE, sizeof(*g_rpc_queue));
+    if (!g_rpc_queue)
+        return 1;
+
+    if (stress) {
+        /* runs with up to twice as many producers as rings, so that rings are shared and wrap
+         * around many times; any lost, duplicated or corrupted request aborts the test */
+        for (size_t producers = 1; producers <= MAX_PRODUCERS; producers *= 2)
+            run(producers, /*use_locked_queue=*/false);
+        printf("TEST OK\n");
+        free(g_rpc_queue);
+        return 0;
+    }
+
+    printf("%9s %9s %16s %16s\n", "producers", "consumers", "lock-free op/s", "locked op/s");
+    for (size_t producers = 1; producers <= RPC_QUEUE_RINGS; producers *= 2) {
+        double lockfree = run(producers, /*use_locked_queue=*/false);
+        double locked = run(producers, /*use_locked_queue=*/true);
+        printf("%9zu %9zu %16.0f %16.0f\n", producers, g_consumers, lockfree, locked);
+    }
+
+    free(g_rpc_queue);
+    return 0;
+}
@@ -5,6 +5,7 @@
 
 #include <asm/errno.h>
 #include <asm/fcntl.h>
+#include <linux/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -101,3 +102,31 @@ out:
     free(buf);
     return (int)ret;
 }
+
+int map_file_readonly(const char* path, void** out_addr, size_t* out_size) {
+    long ret;
+    long fd = INLINE_SYSCALL(open, 3, path, O_RDONLY, 0);
+    if (fd < 0)
+        return fd;
+
+    ret = INLINE_SYSCALL(lseek, 3, fd, 0, SEEK_END);
+    if (ret < 0)
+        goto out;
+    size_t size = ret;
+
+    void* addr = NULL;
+    if (size) {
+        addr = (void*)INLINE_SYSCALL(mmap, 6, NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (INTERNAL_SYSCALL_ERROR_P(addr)) {
+            ret = -INTERNAL_SYSCALL_ERRNO_P(addr);
+            goto out;
+        }
+    }
+
+    *out_addr = addr;
+    *out_size = size;
+    ret = 0;
+out:
+    INLINE_SYSCALL(close, 1, fd);
+    return (int)ret;
+}
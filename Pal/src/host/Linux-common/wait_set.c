@@ -0,0 +1,458 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Wait sets, shared by the Linux and Linux-SGX PALs: the FDs of every PAL handle added to a wait
+ * set are registered in a host epoll instance, so a wait does not pass the whole set to the host
+ * and returns only the ready handles. A handle may be added several times (with different `data`);
+ * its FDs are registered once, with the union of the events of all its entries. Each PAL provides
+ * the host epoll functions declared in "wait_set.h".
+ *
+ * Registered handles are kept in the `regs` array; the epoll data of an FD is the index of its
+ * handle in `regs`, the index of the FD in the handle and a generation number of the slot. On SGX
+ * the epoll data comes back from the untrusted host, so it is checked against the tables before
+ * use.
+ */
+
+#include "api.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_internal.h"
+#include "pal_linux.h"
+#include "pal_linux_error.h"
+#include "spinlock.h"
+#include "wait_set.h"
+
+#define WAIT_SET_MIN_SIZE 64
+#define WAIT_REG_NONE     UINT32_MAX
+/* maximum number of host events fetched by one wait */
+#define WAIT_SET_MAX_HOST_EVENTS 64
+
+struct wait_entry {
+    PAL_NUM data;
+    PAL_FLG events;
+    uint32_t reg;                     /* index of the handle in `regs` */
+    struct wait_entry* hash_next;     /* next entry in the same bucket of `entry_buckets` */
+    struct wait_entry* reg_next;      /* next entry of the same handle */
+};
+
+struct wait_reg {
+    PAL_HANDLE handle;                /* NULL if the slot is unused */
+    uint32_t gen;                     /* incremented when the slot is freed */
+    uint32_t host_events[MAX_FDS];    /* events registered for each FD of the handle, 0 if none */
+    PAL_IDX fds[MAX_FDS];             /* FDs of the handle at the time of registration */
+    struct wait_entry* entries;       /* entries of this handle */
+    uint32_t next;                    /* next slot in the same bucket of `reg_buckets` (or in the
+                                       * free list if the slot is unused) */
+};
+
+struct pal_wait_set {
+    spinlock_t lock;
+    struct wait_reg* regs;
+    uint32_t regs_cnt;                /* size of `regs` and of `reg_buckets`, a power of two */
+    uint32_t free_reg;                /* first unused slot */
+    uint32_t* reg_buckets;            /* chains of used slots, by handle */
+    struct wait_entry** entry_buckets;
+    size_t entry_buckets_cnt;         /* a power of two */
+    size_t entries_cnt;
+};
+
+static size_t ptr_hash(const void* ptr) {
+    return ((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15UL >> 32;
+}
+
+static size_t data_hash(PAL_NUM data) {
+    return (data ^ (data >> 29)) * 0x9e3779b97f4a7c15UL >> 32;
+}
+
+static uint64_t wait_reg_epoll_data(struct pal_wait_set* set, uint32_t idx, size_t fd_idx) {
+    return (uint64_t)set->regs[idx].gen << 32 | (uint64_t)idx << 2 | fd_idx;
+}
+
+/* Grows `regs` (and rehashes `reg_buckets`) so that there is an unused slot. */
+static int wait_set_grow_regs(struct pal_wait_set* set) {
+    uint32_t new_cnt = set->regs_cnt ? set->regs_cnt * 2 : WAIT_SET_MIN_SIZE;
+    if (new_cnt > (1U << 30))
+        return -PAL_ERROR_NOMEM;
+
+    struct wait_reg* regs = malloc(new_cnt * sizeof(*regs));
+    uint32_t* buckets = malloc(new_cnt * sizeof(*buckets));
+    if (!regs || !buckets) {
+        free(regs);
+        free(buckets);
+        return -PAL_ERROR_NOMEM;
+    }
+
+    if (set->regs_cnt)
+        memcpy(regs, set->regs, set->regs_cnt * sizeof(*regs));
+    for (uint32_t i = 0; i < new_cnt; i++)
+        buckets[i] = WAIT_REG_NONE;
+
+    /* new slots go to the free list */
+    for (uint32_t i = set->regs_cnt; i < new_cnt; i++) {
+        regs[i].handle = NULL;
+        regs[i].gen = 0;
+        regs[i].next = i + 1 < new_cnt ? i + 1 : set->free_reg;
+    }
+    set->free_reg = set->regs_cnt;
+
+    for (uint32_t i = 0; i < set->regs_cnt; i++) {
+        if (!regs[i].handle)
+            continue;
+        size_t bucket = ptr_hash(regs[i].handle) & (new_cnt - 1);
+        regs[i].next = buckets[bucket];
+        buckets[bucket] = i;
+    }
+
+    free(set->regs);
+    free(set->reg_buckets);
+    set->regs = regs;
+    set->reg_buckets = buckets;
+    set->regs_cnt = new_cnt;
+    return 0;
+}
+
+static uint32_t wait_set_find_reg(struct pal_wait_set* set, PAL_HANDLE handle) {
+    if (!set->regs_cnt)
+        return WAIT_REG_NONE;
+
+    uint32_t idx = set->reg_buckets[ptr_hash(handle) & (set->regs_cnt - 1)];
+    while (idx != WAIT_REG_NONE && set->regs[idx].handle != handle)
+        idx = set->regs[idx].next;
+    return idx;
+}
+
+static struct wait_entry** wait_set_find_entry(struct pal_wait_set* set, PAL_NUM data) {
+    struct wait_entry** link = &set->entry_buckets[data_hash(data) & (set->entry_buckets_cnt - 1)];
+    while (*link && (*link)->data != data)
+        link = &(*link)->hash_next;
+    return link;
+}
+
+static int wait_set_grow_entries(struct pal_wait_set* set) {
+    size_t new_cnt = set->entry_buckets_cnt * 2;
+    struct wait_entry** buckets = calloc(new_cnt, sizeof(*buckets));
+    if (!buckets)
+        return -PAL_ERROR_NOMEM;
+
+    for (size_t i = 0; i < set->entry_buckets_cnt; i++) {
+        struct wait_entry* entry = set->entry_buckets[i];
+        while (entry) {
+            struct wait_entry* next = entry->hash_next;
+            size_t bucket = data_hash(entry->data) & (new_cnt - 1);
+            entry->hash_next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+
+    free(set->entry_buckets);
+    set->entry_buckets = buckets;
+    set->entry_buckets_cnt = new_cnt;
+    return 0;
+}
+
+/* Registers the FDs of a handle in the host epoll with the union of events of its entries (or
+ * unregisters them if there are no entries left). */
+static int wait_set_update_reg(PAL_HANDLE wait_set, uint32_t idx) {
+    struct pal_wait_set* set = wait_set->waitset.set;
+    struct wait_reg* reg = &set->regs[idx];
+
+    PAL_FLG events = 0;
+    for (struct wait_entry* entry = reg->entries; entry; entry = entry->reg_next)
+        events |= entry->events;
+
+    PAL_FLG flags = HANDLE_HDR(reg->handle)->flags;
+    for (size_t i = 0; i < MAX_FDS; i++) {
+        uint32_t host_events = 0;
+        if (reg->entries && reg->handle->generic.fds[i] != PAL_IDX_POISON) {
+            host_events |= ((flags & RFD(i)) && (events & PAL_WAIT_READ)) ? EPOLLIN : 0;
+            host_events |= ((flags & WFD(i)) && (events & PAL_WAIT_WRITE)) ? EPOLLOUT : 0;
+        }
+        if (host_events == reg->host_events[i])
+            continue;
+
+        int op;
+        if (!reg->host_events[i]) {
+            op = EPOLL_CTL_ADD;
+            reg->fds[i] = reg->handle->generic.fds[i];
+        } else if (!host_events) {
+            op = EPOLL_CTL_DEL;
+        } else {
+            op = EPOLL_CTL_MOD;
+        }
+
+        struct epoll_event event = {
+            .events = host_events,
+            .data = wait_reg_epoll_data(set, idx, i),
+        };
+        int ret = host_epoll_ctl(wait_set->waitset.fd, op, reg->fds[i], &event);
+        if (ret < 0 && op != EPOLL_CTL_DEL)
+            return unix_to_pal_error(ret);
+        /* deleting fails if the host FD was already closed, which removes it from the epoll */
+        reg->host_events[i] = host_events;
+    }
+    return 0;
+}
+
+static void wait_set_free_reg(struct pal_wait_set* set, uint32_t idx) {
+    struct wait_reg* reg = &set->regs[idx];
+    uint32_t* link = &set->reg_buckets[ptr_hash(reg->handle) & (set->regs_cnt - 1)];
+    while (*link != idx)
+        link = &set->regs[*link].next;
+    *link = reg->next;
+
+    reg->handle = NULL;
+    reg->gen++;
+    reg->next = set->free_reg;
+    set->free_reg = idx;
+}
+
+static int wait_set_add(PAL_HANDLE wait_set, PAL_NUM data, PAL_HANDLE handle, PAL_FLG events) {
+    struct pal_wait_set* set = wait_set->waitset.set;
+    int ret;
+
+    if (*wait_set_find_entry(set, data))
+        return -PAL_ERROR_STREAMEXIST;
+
+    if (set->entries_cnt >= set->entry_buckets_cnt) {
+        ret = wait_set_grow_entries(set);
+        if (ret < 0)
+            return ret;
+    }
+
+    struct wait_entry* entry = malloc(sizeof(*entry));
+    if (!entry)
+        return -PAL_ERROR_NOMEM;
+
+    uint32_t idx = wait_set_find_reg(set, handle);
+    bool new_reg = idx == WAIT_REG_NONE;
+    if (new_reg) {
+        if (set->free_reg == WAIT_REG_NONE) {
+            ret = wait_set_grow_regs(set);
+            if (ret < 0) {
+                free(entry);
+                return ret;
+            }
+        }
+        idx = set->free_reg;
+        struct wait_reg* reg = &set->regs[idx];
+        set->free_reg = reg->next;
+
+        reg->handle = handle;
+        reg->entries = NULL;
+        for (size_t i = 0; i < MAX_FDS; i++)
+            reg->host_events[i] = 0;
+        size_t bucket = ptr_hash(handle) & (set->regs_cnt - 1);
+        reg->next = set->reg_buckets[bucket];
+        set->reg_buckets[bucket] = idx;
+    }
+
+    entry->data = data;
+    entry->events = events;
+    entry->reg = idx;
+    entry->reg_next = set->regs[idx].entries;
+    set->regs[idx].entries = entry;
+
+    ret = wait_set_update_reg(wait_set, idx);
+    if (ret < 0) {
+        set->regs[idx].entries = entry->reg_next;
+        free(entry);
+        if (new_reg) {
+            wait_set_update_reg(wait_set, idx);
+            wait_set_free_reg(set, idx);
+        }
+        return ret;
+    }
+
+    struct wait_entry** bucket = &set->entry_buckets[data_hash(data)
+                                                     & (set->entry_buckets_cnt - 1)];
+    entry->hash_next = *bucket;
+    *bucket = entry;
+    set->entries_cnt++;
+    return 0;
+}
+
+static int wait_set_del(PAL_HANDLE wait_set, PAL_NUM data) {
+    struct pal_wait_set* set = wait_set->waitset.set;
+
+    struct wait_entry** link = wait_set_find_entry(set, data);
+    struct wait_entry* entry = *link;
+    if (!entry)
+        return -PAL_ERROR_STREAMNOTEXIST;
+    *link = entry->hash_next;
+    set->entries_cnt--;
+
+    uint32_t idx = entry->reg;
+    struct wait_entry** reg_link = &set->regs[idx].entries;
+    while (*reg_link != entry)
+        reg_link = &(*reg_link)->reg_next;
+    *reg_link = entry->reg_next;
+    free(entry);
+
+    /* unregistering only fails if the host FDs are gone, nothing to do then */
+    (void)wait_set_update_reg(wait_set, idx);
+    if (!set->regs[idx].entries)
+        wait_set_free_reg(set, idx);
+    return 0;
+}
+
+int _DkWaitSetCreate(PAL_HANDLE* handle) {
+    PAL_HANDLE hdl = calloc(1, HANDLE_SIZE(waitset));
+    struct pal_wait_set* set = calloc(1, sizeof(*set));
+    struct wait_entry** entry_buckets = calloc(WAIT_SET_MIN_SIZE, sizeof(*entry_buckets));
+    if (!hdl || !set || !entry_buckets) {
+        free(hdl);
+        free(set);
+        free(entry_buckets);
+        return -PAL_ERROR_NOMEM;
+    }
+
+    int fd = host_epoll_create();
+    if (fd < 0) {
+        free(hdl);
+        free(set);
+        free(entry_buckets);
+        return unix_to_pal_error(fd);
+    }
+
+    spinlock_init(&set->lock);
+    set->free_reg = WAIT_REG_NONE;
+    set->entry_buckets = entry_buckets;
+    set->entry_buckets_cnt = WAIT_SET_MIN_SIZE;
+
+    SET_HANDLE_TYPE(hdl, waitset);
+    HANDLE_HDR(hdl)->flags = 0;
+    hdl->waitset.fd = fd;
+    hdl->waitset.set = set;
+    *handle = hdl;
+    return 0;
+}
+
+int _DkWaitSetCtl(PAL_HANDLE wait_set, enum PAL_WAIT_SET_OP op, PAL_NUM data, PAL_HANDLE handle,
+                  PAL_FLG events) {
+    struct pal_wait_set* set = wait_set->waitset.set;
+    int ret;
+
+    spinlock_lock(&set->lock);
+    switch (op) {
+        case PAL_WAIT_SET_ADD:
+            ret = wait_set_add(wait_set, data, handle, events);
+            break;
+        case PAL_WAIT_SET_MOD: {
+            struct wait_entry* entry = *wait_set_find_entry(set, data);
+            if (!entry) {
+                ret = -PAL_ERROR_STREAMNOTEXIST;
+            } else if (set->regs[entry->reg].handle == handle) {
+                PAL_FLG old_events = entry->events;
+                entry->events = events;
+                ret = wait_set_update_reg(wait_set, entry->reg);
+                if (ret < 0)
+                    entry->events = old_events;
+            } else {
+                /* the entry moves to another handle */
+                ret = wait_set_del(wait_set, data);
+                if (ret == 0)
+                    ret = wait_set_add(wait_set, data, handle, events);
+            }
+            break;
+        }
+        case PAL_WAIT_SET_DEL:
+            ret = wait_set_del(wait_set, data);
+            break;
+        default:
+            ret = -PAL_ERROR_INVAL;
+            break;
+    }
+    spinlock_unlock(&set->lock);
+    return ret;
+}
+
+int _DkWaitSetWait(PAL_HANDLE wait_set, size_t max_count, PAL_NUM* ret_data, PAL_FLG* ret_events,
+                   size_t* ret_count, int64_t timeout_us) {
+    struct pal_wait_set* set = wait_set->waitset.set;
+    struct epoll_event host_events[WAIT_SET_MAX_HOST_EVENTS];
+
+    *ret_count = 0;
+    if (max_count == 0)
+        return -PAL_ERROR_INVAL;
+
+    int ret = host_epoll_wait(wait_set->waitset.fd, host_events,
+                              MIN(max_count, (size_t)WAIT_SET_MAX_HOST_EVENTS), timeout_us);
+    if (ret < 0)
+        return unix_to_pal_error(ret);
+    if (ret == 0)
+        return -PAL_ERROR_TRYAGAIN;
+    size_t host_count = ret;
+
+    size_t count = 0;
+    spinlock_lock(&set->lock);
+    for (size_t i = 0; i < host_count && count < max_count; i++) {
+        uint64_t epoll_data = host_events[i].data;
+        uint32_t idx = (uint32_t)epoll_data >> 2;
+        size_t fd_idx = epoll_data & 3;
+        /* the handle could have been removed (and the slot reused) after the host event */
+        if (idx >= set->regs_cnt || fd_idx >= MAX_FDS || !set->regs[idx].handle
+                || set->regs[idx].gen != epoll_data >> 32 || !set->regs[idx].host_events[fd_idx])
+            continue;
+
+        struct wait_reg* reg = &set->regs[idx];
+        uint32_t revents = host_events[i].events;
+        PAL_FLG events = 0;
+        if (revents & EPOLLIN)
+            events |= PAL_WAIT_READ;
+        if (revents & EPOLLOUT)
+            events |= PAL_WAIT_WRITE;
+        if (HANDLE_HDR(reg->handle)->flags & ERROR(fd_idx))
+            events |= PAL_WAIT_ERROR;
+        if (revents & (EPOLLHUP | EPOLLERR)) {
+            events |= PAL_WAIT_ERROR;
+            HANDLE_HDR(reg->handle)->flags |= ERROR(fd_idx);
+        }
+
+        for (struct wait_entry* entry = reg->entries; entry && count < max_count;
+                entry = entry->reg_next) {
+            PAL_FLG entry_events = events & (entry->events | PAL_WAIT_ERROR);
+            if (!entry_events)
+                continue;
+
+            /* handles with several FDs may be reported more than once */
+            size_t j = 0;
+            while (j < count && ret_data[j] != entry->data)
+                j++;
+            if (j == count) {
+                ret_data[count] = entry->data;
+                ret_events[count] = 0;
+                count++;
+            }
+            ret_events[j] |= entry_events;
+        }
+    }
+    spinlock_unlock(&set->lock);
+
+    *ret_count = count;
+    return count ? 0 : -PAL_ERROR_TRYAGAIN;
+}
+
+static int waitset_close(PAL_HANDLE handle) {
+    struct pal_wait_set* set = handle->waitset.set;
+
+    for (size_t i = 0; i < set->entry_buckets_cnt; i++) {
+        struct wait_entry* entry = set->entry_buckets[i];
+        while (entry) {
+            struct wait_entry* next = entry->hash_next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(set->entry_buckets);
+    free(set->regs);
+    free(set->reg_buckets);
+    free(set);
+
+    host_epoll_close(handle->waitset.fd);
+    return 0;
+}
+
+struct handle_ops g_waitset_ops = {
+    .close = &waitset_close,
+};
@@ -25,6 +25,37 @@ static double get_bogomips(void) {
     return sanitize_bogomips_value(get_bogomips_from_cpuinfo_buf(buf));
 }
 
+#define CPUID_LEAF_INVARIANT_TSC 0x80000007
+#define CPUID_LEAF_TSC_FREQ 0x15
+
+bool is_tsc_usable(void) {
+    uint32_t words[CPUID_WORD_NUM];
+    cpuid(CPUID_LEAF_INVARIANT_TSC, 0, words);
+    return words[CPUID_WORD_EDX] & 1 << 8;
+}
+
+/* Return TSC frequency or 0 if it is not enumerated exactly by CPUID. Unlike Linux-SGX PAL, there
+ * is no fallback to the processor base frequency (CPUID 16H): it is only nominal, and Linux PAL
+ * uses the TSC frequency only for the vDSO time calibration, which must not drift. */
+uint64_t get_tsc_hz(void) {
+    uint32_t words[CPUID_WORD_NUM];
+
+    cpuid(0, 0, words);
+    if (words[CPUID_WORD_EAX] < CPUID_LEAF_TSC_FREQ)
+        return 0;
+
+    cpuid(CPUID_LEAF_TSC_FREQ, 0, words);
+    if (!words[CPUID_WORD_EAX] || !words[CPUID_WORD_EBX] || !words[CPUID_WORD_ECX]) {
+        /* TSC/core crystal clock ratio or crystal clock frequency is not enumerated */
+        return 0;
+    }
+
+    /* calculate TSC frequency as core crystal clock frequency (ECX) * EBX / EAX; cast to 64-bit
+     * first to prevent integer overflow */
+    uint64_t ecx_hz = words[CPUID_WORD_ECX];
+    return ecx_hz * words[CPUID_WORD_EBX] / words[CPUID_WORD_EAX];
+}
+
 #define FOUR_CHARS_VALUE(s, w)      \
     (s)[0] = (w) & 0xff;            \
     (s)[1] = ((w) >>  8) & 0xff;    \
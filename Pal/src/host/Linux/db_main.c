@@ -44,6 +44,7 @@ char* g_pal_internal_mem_addr = NULL;
 const size_t g_page_size = PRESET_PAGESIZE;
 
 static int g_uid, g_gid;
+static struct manifest g_manifest;
 static ElfW(Addr) g_sysinfo_ehdr;
 
 static void read_args_from_stack(void* initial_rsp, int* out_argc, const char*** out_argv,
@@ -158,6 +159,8 @@ noreturn void pal_linux_main(void* initial_rsp, void* fini_callback) {
     if (ret < 0)
         INIT_FAIL(unix_to_pal_error(-ret), "pal_set_tcb() failed");
 
+    init_tsc();
+
     uint64_t start_time;
     ret = _DkSystemTimeQuery(&start_time);
     if (ret < 0)
@@ -259,7 +262,8 @@ noreturn void pal_linux_main(void* initial_rsp, void* fini_callback) {
     g_linux_state.gid = g_gid;
 
     PAL_HANDLE parent = NULL;
-    char* manifest = NULL;
+    void* manifest = NULL;
+    size_t manifest_size = 0;
     uint64_t instance_id = 0;
     if (first_process) {
         const char* application_path = argv[3];
@@ -267,28 +271,33 @@ noreturn void pal_linux_main(void* initial_rsp, void* fini_callback) {
         if (!manifest_path)
             INIT_FAIL(PAL_ERROR_NOMEM, "Out of memory");
 
-        ret = read_text_file_to_cstr(manifest_path, &manifest);
+        /* either TOML or compiled by `graphene-manifest --binary` */
+        ret = map_file_readonly(manifest_path, &manifest, &manifest_size);
         if (ret < 0) {
             INIT_FAIL(unix_to_pal_error(-ret), "Reading manifest failed");
         }
+        free(manifest_path);
     } else {
         // Children receive their argv and config via IPC.
         int parent_pipe_fd = atoi(argv[3]);
-        init_child_process(parent_pipe_fd, &parent, &manifest, &instance_id);
+        init_child_process(parent_pipe_fd, &parent, &manifest, &manifest_size, &instance_id);
     }
-    assert(manifest);
 
     signal_setup();
 
-    g_pal_state.raw_manifest_data = manifest;
-
     char errbuf[256];
-    g_pal_state.manifest_root = toml_parse(manifest, errbuf, sizeof(errbuf));
-    if (!g_pal_state.manifest_root)
+    ret = manifest_init(&g_manifest, manifest, manifest_size, errbuf, sizeof(errbuf));
+    if (ret < 0)
         INIT_FAIL_MANIFEST(PAL_ERROR_DENIED, errbuf);
+    g_pal_state.manifest_root = &g_manifest;
+
+    if (first_process && manifest_image(&g_manifest) != manifest) {
+        /* TOML text, not needed after compilation */
+        INLINE_SYSCALL(munmap, 2, manifest, manifest_size);
+    }
 
-    ret = toml_sizestring_in(g_pal_state.manifest_root, "loader.pal_internal_mem_size",
-                             /*defaultval=*/g_page_size, &g_pal_internal_mem_size);
+    ret = manifest_sizestring_in(g_pal_state.manifest_root, "loader.pal_internal_mem_size",
+                                 /*defaultval=*/g_page_size, &g_pal_internal_mem_size);
     if (ret < 0) {
         INIT_FAIL(PAL_ERROR_INVAL, "Cannot parse 'loader.pal_internal_mem_size'");
     }
@@ -308,6 +317,14 @@ noreturn void pal_linux_main(void* initial_rsp, void* fini_callback) {
     }
     g_pal_internal_mem_addr = internal_mem_addr;
 
+    init_io_uring();
+
+    ret = init_process_pool();
+    if (ret < 0) {
+        INIT_FAIL_MANIFEST(PAL_ERROR_INVAL, "Cannot parse 'loader.process_pool_size' "
+                                            "(the value must be a non-negative integer)");
+    }
+
     /* call to main function */
     pal_main(instance_id, parent, first_thread, first_process ? argv + 3 : argv + 4, envp);
 }
@@ -9,6 +9,7 @@
 #include <linux/time.h>
 
 #include "api.h"
+#include "cpu.h"
 #include "pal.h"
 #include "linux_utils.h"
 #include "pal_defs.h"
@@ -17,8 +18,25 @@
 #include "pal_linux.h"
 #include "pal_linux_defs.h"
 #include "pal_security.h"
+#include "seqlock.h"
 
-int _DkSystemTimeQuery(uint64_t* out_usec) {
+#define TSC_REFINE_INIT_TIMEOUT_USECS 10000000
+
+static uint64_t g_tsc_hz = 0; /* exact TSC frequency, only used for DkSystemTimeCalibration() */
+static uint64_t g_start_tsc = 0;
+static uint64_t g_start_usec = 0;
+static seqlock_t g_tsc_lock = INIT_SEQLOCK_UNLOCKED;
+
+/**
+ * Initialize the data structures used for computing the time from TSC
+ */
+void init_tsc(void) {
+    if (is_tsc_usable()) {
+        g_tsc_hz = get_tsc_hz();
+    }
+}
+
+static int get_host_time(uint64_t* out_usec) {
     struct timespec time;
     int ret;
 
@@ -36,6 +54,61 @@ int _DkSystemTimeQuery(uint64_t* out_usec) {
     return 0;
 }
 
+int _DkSystemTimeQuery(uint64_t* out_usec) {
+    /* the host clock_gettime() is already a vDSO call, so there is nothing to gain from
+     * extrapolating the time from the TSC here */
+    return get_host_time(out_usec);
+}
+
+/* The calibration is only used by LibOS for its vDSO time page: the TSC/usec baseline is taken
+ * from the host clock and refreshed every TSC_REFINE_INIT_TIMEOUT_USECS. Extrapolation from the
+ * TSC slightly drifts from the host clock between refreshes, which LibOS compensates for when
+ * publishing a new baseline. */
+int _DkSystemTimeCalibration(PAL_TIME_CALIBRATION* calib) {
+    if (!g_tsc_hz)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    uint64_t max_delta_tsc = MIN(TSC_REFINE_INIT_TIMEOUT_USECS * g_tsc_hz / 1000000,
+                                 UINT64_MAX / 1000000);
+
+    uint64_t start_tsc;
+    uint64_t start_usec;
+    uint32_t seq;
+    do {
+        seq = read_seqbegin(&g_tsc_lock);
+        start_tsc  = g_start_tsc;
+        start_usec = g_start_usec;
+    } while (read_seqretry(&g_tsc_lock, seq));
+
+    if (!start_tsc || get_tsc() - start_tsc >= max_delta_tsc) {
+        /* the baseline was not yet initialized or is too old, refresh it; the host clock is read
+         * between two RDTSCs, so use the mid-point as its TSC value */
+        uint64_t tsc_cyc1 = get_tsc();
+        int ret = get_host_time(&start_usec);
+        if (ret < 0)
+            return ret;
+        uint64_t tsc_cyc2 = get_tsc();
+        start_tsc = tsc_cyc1 + (tsc_cyc2 - tsc_cyc1) / 2;
+
+        /* refresh the baseline data if no other thread updated g_start_tsc */
+        write_seqbegin(&g_tsc_lock);
+        if (g_start_tsc < start_tsc) {
+            g_start_tsc  = start_tsc;
+            g_start_usec = start_usec;
+        } else {
+            start_tsc  = g_start_tsc;
+            start_usec = g_start_usec;
+        }
+        write_seqend(&g_tsc_lock);
+    }
+
+    calib->tsc_hz        = g_tsc_hz;
+    calib->base_tsc      = start_tsc;
+    calib->base_usec     = start_usec;
+    calib->max_delta_tsc = max_delta_tsc;
+    return 0;
+}
+
 int _DkRandomBitsRead(void* buffer, size_t size) {
     if (!g_pal_sec.random_device) {
         int fd = INLINE_SYSCALL(open, 3, RANDGEN_DEVICE, O_RDONLY, 0);
@@ -2,10 +2,13 @@
 /* Copyright (C) 2014 Stony Brook University */
 
 /*
- * This file contains APIs for waiting on PAL handles (polling).
+ * This file contains APIs for waiting on PAL handles (polling) and the host epoll functions used by
+ * wait sets (see "Linux-common/wait_set.c").
  */
 
 #include <asm/errno.h>
+#include <limits.h>
+#include <linux/eventpoll.h>
 #include <linux/poll.h>
 #include <linux/time.h>
 #include <linux/wait.h>
@@ -17,6 +20,7 @@
 #include "pal_internal.h"
 #include "pal_linux.h"
 #include "pal_linux_defs.h"
+#include "wait_set.h"
 
 /* Wait for specific events on all handles in the handle array and return multiple events
  * (including errors) reported by the host. Return 0 on success, PAL error on failure. */
@@ -130,3 +134,22 @@ out:
     free(offsets);
     return ret;
 }
+
+int host_epoll_create(void) {
+    return INLINE_SYSCALL(epoll_create1, 1, EPOLL_CLOEXEC);
+}
+
+int host_epoll_ctl(int epfd, int op, int fd, struct epoll_event* event) {
+    return INLINE_SYSCALL(epoll_ctl, 4, epfd, op, fd, event);
+}
+
+int host_epoll_wait(int epfd, struct epoll_event* events, int maxevents, int64_t timeout_us) {
+    int timeout_ms = -1;
+    if (timeout_us >= 0)
+        timeout_ms = MIN((timeout_us + 999) / 1000, (int64_t)INT_MAX);
+    return INLINE_SYSCALL(epoll_wait, 4, epfd, events, maxevents, timeout_ms);
+}
+
+void host_epoll_close(int epfd) {
+    INLINE_SYSCALL(close, 1, epfd);
+}
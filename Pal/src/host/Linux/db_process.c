@@ -28,6 +28,7 @@
 #include "pal_linux_defs.h"
 #include "pal_rtld.h"
 #include "pal_security.h"
+#include "spinlock.h"
 
 /*
  * This needs to be included here because it conflicts with sigset.h included in pal_linux.
@@ -130,7 +131,7 @@ static int __attribute_noinline child_process(struct proc_param* proc_param) {
     die_or_inf_loop();
 }
 
-int _DkProcessCreate(PAL_HANDLE* handle, const char** args) {
+static int create_process(PAL_HANDLE* handle, const char** args) {
     PAL_HANDLE parent_handle = NULL;
     PAL_HANDLE child_handle = NULL;
     struct proc_args* proc_args = NULL;
@@ -157,7 +158,8 @@ int _DkProcessCreate(PAL_HANDLE* handle, const char** args) {
         goto out;
     parent_data_size = (size_t)ret;
 
-    manifest_data_size = strlen(g_pal_state.raw_manifest_data);
+    /* children get the compiled manifest, so they don't need to parse TOML again */
+    manifest_data_size = manifest_image_size(g_pal_state.manifest_root);
 
     size_t data_size = parent_data_size + manifest_data_size;
     proc_args = malloc(sizeof(struct proc_args) + data_size);
@@ -176,7 +178,7 @@ int _DkProcessCreate(PAL_HANDLE* handle, const char** args) {
     proc_args->parent_data_size = parent_data_size;
     data += parent_data_size;
 
-    memcpy(data, g_pal_state.raw_manifest_data, manifest_data_size);
+    memcpy(data, manifest_image(g_pal_state.manifest_root), manifest_data_size);
     proc_args->manifest_data_size = manifest_data_size;
     data += manifest_data_size;
 
@@ -239,8 +241,93 @@ out:
     return ret;
 }
 
-void init_child_process(int parent_pipe_fd, PAL_HANDLE* parent_handle, char** manifest_out,
-                        uint64_t* instance_id) {
+/*
+ * Pool of children created in advance (see `loader.process_pool_size` in the manifest). A new child
+ * initializes PAL and LibOS on its own and then waits for the first message from its parent, so all
+ * children created without arguments are identical up to that point and any of them can be handed
+ * out. Taking a child from the pool skips waiting for its initialization; the pool is refilled right
+ * away, but the new children initialize in parallel with the caller.
+ */
+static struct {
+    spinlock_t lock;
+    size_t size;
+    size_t cnt;
+    size_t pending;     /* children being created for the pool */
+    PAL_HANDLE* procs;  /* oldest children first */
+} g_process_pool = { .lock = INIT_SPINLOCK_UNLOCKED };
+
+int init_process_pool(void) {
+    int64_t size;
+    int ret = manifest_int_in(g_pal_state.manifest_root, "loader.process_pool_size",
+                              /*defaultval=*/0, &size);
+    if (ret < 0 || size < 0)
+        return -PAL_ERROR_INVAL;
+
+    g_process_pool.size = size;
+    return 0;
+}
+
+static void refill_process_pool(void) {
+    while (true) {
+        spinlock_lock(&g_process_pool.lock);
+        if (!g_process_pool.procs && g_process_pool.size) {
+            g_process_pool.procs = malloc(sizeof(*g_process_pool.procs) * g_process_pool.size);
+            if (!g_process_pool.procs)
+                g_process_pool.size = 0;
+        }
+        bool full = g_process_pool.cnt + g_process_pool.pending >= g_process_pool.size;
+        if (!full)
+            g_process_pool.pending++;
+        spinlock_unlock(&g_process_pool.lock);
+
+        if (full)
+            return;
+
+        PAL_HANDLE proc = NULL;
+        int ret = create_process(&proc, /*args=*/NULL);
+
+        spinlock_lock(&g_process_pool.lock);
+        g_process_pool.pending--;
+        if (ret >= 0)
+            g_process_pool.procs[g_process_pool.cnt++] = proc;
+        spinlock_unlock(&g_process_pool.lock);
+
+        if (ret < 0) {
+            log_warning("Cannot create a child process for the pool: %d", ret);
+            return;
+        }
+    }
+}
+
+int _DkProcessCreate(PAL_HANDLE* handle, const char** args) {
+    if (args || !g_process_pool.size)
+        return create_process(handle, args);
+
+    PAL_HANDLE proc = NULL;
+    spinlock_lock(&g_process_pool.lock);
+    if (g_process_pool.cnt) {
+        proc = g_process_pool.procs[0];
+        g_process_pool.cnt--;
+        memmove(&g_process_pool.procs[0], &g_process_pool.procs[1],
+                sizeof(*g_process_pool.procs) * g_process_pool.cnt);
+    }
+    spinlock_unlock(&g_process_pool.lock);
+
+    if (!proc) {
+        /* the pool is empty, e.g. this is the first child */
+        int ret = create_process(&proc, /*args=*/NULL);
+        if (ret < 0)
+            return ret;
+    }
+
+    refill_process_pool();
+
+    *handle = proc;
+    return 0;
+}
+
+void init_child_process(int parent_pipe_fd, PAL_HANDLE* parent_handle, void** manifest_out,
+                        size_t* manifest_size_out, uint64_t* instance_id) {
     int ret = 0;
 
     struct proc_args proc_args;
@@ -255,12 +342,22 @@ void init_child_process(int parent_pipe_fd, PAL_HANDLE* parent_handle, char** ma
     if (!proc_args.parent_data_size)
         INIT_FAIL(PAL_ERROR_INVAL, "invalid process created");
 
-    size_t data_size = proc_args.parent_data_size + proc_args.manifest_data_size;
-    char* data = malloc(data_size);
+    char* data = malloc(proc_args.parent_data_size);
     if (!data)
         INIT_FAIL(PAL_ERROR_NOMEM, "Out of memory");
 
-    ret = read_all(parent_pipe_fd, data, data_size);
+    ret = read_all(parent_pipe_fd, data, proc_args.parent_data_size);
+    if (ret < 0) {
+        ret = unix_to_pal_error(ret);
+        INIT_FAIL(-ret, "communication with parent failed");
+    }
+
+    /* the compiled manifest is used in place, so read it into its own (aligned) buffer */
+    void* manifest = malloc(proc_args.manifest_data_size);
+    if (!manifest)
+        INIT_FAIL(PAL_ERROR_NOMEM, "Out of memory");
+
+    ret = read_all(parent_pipe_fd, manifest, proc_args.manifest_data_size);
     if (ret < 0) {
         ret = unix_to_pal_error(ret);
         INIT_FAIL(-ret, "communication with parent failed");
@@ -268,24 +365,16 @@ void init_child_process(int parent_pipe_fd, PAL_HANDLE* parent_handle, char** ma
 
     /* now deserialize the parent_handle */
     PAL_HANDLE parent = NULL;
-    char* data_iter = data;
-    ret = handle_deserialize(&parent, data_iter, proc_args.parent_data_size);
+    ret = handle_deserialize(&parent, data, proc_args.parent_data_size);
     if (ret < 0)
         INIT_FAIL(-ret, "cannot deserialize parent process handle");
-    data_iter += proc_args.parent_data_size;
     *parent_handle = parent;
 
-    char* manifest = malloc(proc_args.manifest_data_size + 1);
-    if (!manifest)
-        INIT_FAIL(PAL_ERROR_NOMEM, "Out of memory");
-    memcpy(manifest, data_iter, proc_args.manifest_data_size);
-    manifest[proc_args.manifest_data_size] = '\0';
-    data_iter += proc_args.manifest_data_size;
-
     g_linux_state.memory_quota = proc_args.memory_quota;
     memcpy(&g_pal_sec, &proc_args.pal_sec, sizeof(struct pal_sec));
 
     *manifest_out = manifest;
+    *manifest_size_out = proc_args.manifest_data_size;
     *instance_id = proc_args.instance_id;
     free(data);
 }
@@ -24,8 +24,10 @@
 #include "pal_internal.h"
 #include "pal_linux.h"
 #include "pal_linux_defs.h"
+#include "pal_linux_io_uring.h"
 #include "pal_security.h"
 #include "perm.h"
+#include "spinlock.h"
 #include "stat.h"
 
 static int g_log_fd = PAL_LOG_DEFAULT_FD;
@@ -388,3 +390,307 @@ int _DkDebugLog(const void* buf, size_t size) {
         return unix_to_pal_error(ret);
     return 0;
 }
+
+/*
+ * Batched I/O. Regular-file requests of a batch are submitted to a process-wide io_uring so that
+ * the host kernel can service them in parallel with a single `io_uring_enter()`; pipes, devices
+ * and connected TCP sockets are served by one `readv`/`writev`/`recvmsg`/`sendmsg` per request.
+ *
+ * The ring is set up once at PAL startup so that its mappings can be reported to LibOS as
+ * preloaded ranges. Only regular files go to the ring: their I/O cannot block indefinitely, so a
+ * thread may wait for completions while holding `g_io_uring_lock`. Threads that find the ring
+ * busy simply fall back to synchronous syscalls instead of waiting.
+ */
+#define IO_URING_ENTRIES 32
+
+static struct {
+    int fd;
+    uint32_t* sq_head;
+    uint32_t* sq_tail;
+    uint32_t sq_mask;
+    uint32_t* sq_array;
+    struct io_uring_sqe* sqes;
+    uint32_t* cq_head;
+    uint32_t* cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe* cqes;
+} g_io_uring = { .fd = -1 };
+
+static spinlock_t g_io_uring_lock = INIT_SPINLOCK_UNLOCKED;
+
+static_assert(sizeof(PAL_IOVEC) == sizeof(struct iovec) &&
+              offsetof(PAL_IOVEC, buffer) == offsetof(struct iovec, iov_base) &&
+              offsetof(PAL_IOVEC, count) == offsetof(struct iovec, iov_len),
+              "PAL_IOVEC must be layout-compatible with struct iovec");
+static_assert(sizeof(struct io_uring_sqe) == 64, "wrong io_uring_sqe size");
+
+static void* io_uring_map(size_t size, uint64_t offset, const char* comment) {
+    void* addr = (void*)ARCH_MMAP(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  g_io_uring.fd, offset);
+    if (IS_ERR_P(addr))
+        return NULL;
+
+    if (add_preloaded_range((uintptr_t)addr, (uintptr_t)addr + ALIGN_UP(size, g_page_size),
+                            comment) < 0) {
+        INLINE_SYSCALL(munmap, 2, addr, size);
+        return NULL;
+    }
+    return addr;
+}
+
+void init_io_uring(void) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = INLINE_SYSCALL(io_uring_setup, 2, IO_URING_ENTRIES, &params);
+    if (fd < 0) {
+        /* old host kernel or io_uring disabled by seccomp/sysctl, batches use plain syscalls */
+        log_debug("io_uring is not available (%d), batched file I/O uses synchronous syscalls",
+                  unix_to_pal_error(fd));
+        return;
+    }
+    g_io_uring.fd = fd;
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_size = cq_size = MAX(sq_size, cq_size);
+
+    void* sq_ring = io_uring_map(sq_size, IORING_OFF_SQ_RING, "io_uring_sq");
+    if (!sq_ring)
+        goto fail;
+
+    void* cq_ring = single_mmap ? sq_ring : io_uring_map(cq_size, IORING_OFF_CQ_RING,
+                                                         "io_uring_cq");
+    if (!cq_ring)
+        goto fail;
+
+    void* sqes = io_uring_map(params.sq_entries * sizeof(struct io_uring_sqe), IORING_OFF_SQES,
+                              "io_uring_sqes");
+    if (!sqes)
+        goto fail;
+
+    g_io_uring.sq_head  = sq_ring + params.sq_off.head;
+    g_io_uring.sq_tail  = sq_ring + params.sq_off.tail;
+    g_io_uring.sq_mask  = *(uint32_t*)(sq_ring + params.sq_off.ring_mask);
+    g_io_uring.sq_array = sq_ring + params.sq_off.array;
+    g_io_uring.sqes     = sqes;
+    g_io_uring.cq_head  = cq_ring + params.cq_off.head;
+    g_io_uring.cq_tail  = cq_ring + params.cq_off.tail;
+    g_io_uring.cq_mask  = *(uint32_t*)(cq_ring + params.cq_off.ring_mask);
+    g_io_uring.cqes     = cq_ring + params.cq_off.cqes;
+    return;
+
+fail:
+    /* the mappings (if any) stay reserved as preloaded ranges, they are tiny */
+    log_debug("Cannot map io_uring rings, batched file I/O uses synchronous syscalls");
+    INLINE_SYSCALL(close, 1, fd);
+    g_io_uring.fd = -1;
+}
+
+static bool is_ring_file_request(PAL_IO_REQUEST* req) {
+    return IS_HANDLE_TYPE(req->handle, file) && req->handle->file.seekable;
+}
+
+/* Returns the host fd through which data of `handle` can be read (`read` is true) or written as is,
+ * or -1 if the stream does not map to a single host fd. */
+static int host_stream_fd(PAL_HANDLE handle, bool read) {
+    switch (PAL_GET_TYPE(handle)) {
+        case pal_type_file:
+            return handle->file.fd;
+        case pal_type_pipe:
+        case pal_type_pipecli:
+            return handle->pipe.fd;
+        case pal_type_pipeprv:
+            return handle->pipeprv.fds[read ? 0 : 1];
+        case pal_type_dev:
+            if (handle->dev.fd == PAL_IDX_POISON ||
+                    !(HANDLE_HDR(handle)->flags & (read ? RFD(0) : WFD(0))))
+                return -1;
+            return handle->dev.fd;
+        case pal_type_tcp:
+            if (!handle->sock.conn || handle->sock.fd == PAL_IDX_POISON)
+                return -1;
+            return handle->sock.fd;
+        default:
+            return -1;
+    }
+}
+
+/* Returns the host fd for a request that can be served by a single vectored syscall, or -1 if the
+ * request has to go through the generic per-buffer path. */
+static int batch_io_fd(PAL_IO_REQUEST* req) {
+    if (req->offset && !IS_HANDLE_TYPE(req->handle, file))
+        return -1;
+    return host_stream_fd(req->handle, req->op == PAL_IO_READ);
+}
+
+static int64_t batch_io_sync(PAL_IO_REQUEST* req) {
+    int fd = batch_io_fd(req);
+    if (fd < 0)
+        return _DkStreamIoRequest(req);
+
+    struct iovec* iov = (struct iovec*)req->iov;
+    bool read = req->op == PAL_IO_READ;
+    int64_t ret;
+
+    if (IS_HANDLE_TYPE(req->handle, tcp)) {
+        struct msghdr hdr = {
+            .msg_iov    = iov,
+            .msg_iovlen = req->iov_cnt,
+        };
+        ret = read ? INLINE_SYSCALL(recvmsg, 3, fd, &hdr, 0)
+                   : INLINE_SYSCALL(sendmsg, 3, fd, &hdr, MSG_NOSIGNAL);
+    } else if (is_ring_file_request(req)) {
+        /* the last argument is the high part of the offset, unused on 64-bit hosts */
+        ret = read ? INLINE_SYSCALL(preadv, 5, fd, iov, req->iov_cnt, req->offset, 0)
+                   : INLINE_SYSCALL(pwritev, 5, fd, iov, req->iov_cnt, req->offset, 0);
+    } else {
+        ret = read ? INLINE_SYSCALL(readv, 3, fd, iov, req->iov_cnt)
+                   : INLINE_SYSCALL(writev, 3, fd, iov, req->iov_cnt);
+    }
+
+    return ret < 0 ? unix_to_pal_error(ret) : ret;
+}
+
+/* Submits up to `IO_URING_ENTRIES` file requests (indices in `idx`) to the ring and reaps their
+ * completions. Must be called with `g_io_uring_lock` held. Requests the kernel did not accept are
+ * executed synchronously. */
+static void batch_io_ring(PAL_IO_REQUEST* reqs, size_t* idx, size_t cnt) {
+    uint32_t tail = *g_io_uring.sq_tail;
+    for (size_t i = 0; i < cnt; i++) {
+        PAL_IO_REQUEST* req = &reqs[idx[i]];
+        uint32_t slot = (tail + i) & g_io_uring.sq_mask;
+        struct io_uring_sqe* sqe = &g_io_uring.sqes[slot];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode    = req->op == PAL_IO_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+        sqe->fd        = req->handle->file.fd;
+        sqe->off       = req->offset;
+        sqe->addr      = (uint64_t)req->iov;
+        sqe->len       = req->iov_cnt;
+        sqe->user_data = idx[i];
+        g_io_uring.sq_array[slot] = slot;
+    }
+    __atomic_store_n(g_io_uring.sq_tail, tail + cnt, __ATOMIC_RELEASE);
+
+    size_t submitted = 0;
+    while (submitted < cnt) {
+        int ret = INLINE_SYSCALL(io_uring_enter, 6, g_io_uring.fd, cnt - submitted,
+                                 /*min_complete=*/0, /*flags=*/0, NULL, 0);
+        if (ret == -EINTR)
+            continue;
+        if (ret <= 0) {
+            /* kernel refused the rest of SQEs (e.g. out of memory), take them back; this is safe
+             * because the kernel consumes SQEs only inside io_uring_enter() */
+            __atomic_store_n(g_io_uring.sq_tail, *g_io_uring.sq_head, __ATOMIC_RELEASE);
+            for (size_t i = submitted; i < cnt; i++)
+                reqs[idx[i]].result = batch_io_sync(&reqs[idx[i]]);
+            break;
+        }
+        submitted += ret;
+    }
+
+    size_t completed = 0;
+    while (completed < submitted) {
+        uint32_t head = *g_io_uring.cq_head;
+        uint32_t cq_tail = __atomic_load_n(g_io_uring.cq_tail, __ATOMIC_ACQUIRE);
+        if (head == cq_tail) {
+            int ret = INLINE_SYSCALL(io_uring_enter, 6, g_io_uring.fd, /*to_submit=*/0,
+                                     submitted - completed, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+                /* cannot happen with a valid ring; in-flight SQEs reference caller's buffers */
+                log_error("io_uring_enter() failed while waiting for completions: %d", ret);
+                _DkProcessExit(1);
+            }
+            continue;
+        }
+        for (; head != cq_tail; head++) {
+            struct io_uring_cqe* cqe = &g_io_uring.cqes[head & g_io_uring.cq_mask];
+            int64_t res = cqe->res;
+            reqs[cqe->user_data].result = res < 0 ? unix_to_pal_error(res) : res;
+            completed++;
+        }
+        __atomic_store_n(g_io_uring.cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+int _DkStreamsBatchIo(size_t count, PAL_IO_REQUEST* reqs) {
+    size_t file_reqs = 0;
+    for (size_t i = 0; i < count; i++)
+        if (is_ring_file_request(&reqs[i]))
+            file_reqs++;
+
+    /* a single file request is cheaper as a plain preadv/pwritev; file requests go first so that
+     * the ring lock is not held while blocking on a pipe or a socket */
+    bool use_ring = g_io_uring.fd >= 0 && file_reqs > 1 && !spinlock_trylock(&g_io_uring_lock);
+    if (use_ring) {
+        size_t ring_idx[IO_URING_ENTRIES];
+        size_t ring_cnt = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (!is_ring_file_request(&reqs[i]))
+                continue;
+            ring_idx[ring_cnt++] = i;
+            if (ring_cnt == IO_URING_ENTRIES || ring_cnt == file_reqs) {
+                batch_io_ring(reqs, ring_idx, ring_cnt);
+                file_reqs -= ring_cnt;
+                ring_cnt = 0;
+            }
+        }
+        spinlock_unlock(&g_io_uring_lock);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (use_ring && is_ring_file_request(&reqs[i]))
+            continue;
+        reqs[i].result = batch_io_sync(&reqs[i]);
+    }
+    return 0;
+}
+
+static bool is_seekable_file(PAL_HANDLE handle) {
+    return IS_HANDLE_TYPE(handle, file) && handle->file.seekable;
+}
+
+/* Private pipes and FIFOs are host pipes; named PAL pipes are UNIX domain sockets. */
+static bool is_host_pipe(PAL_HANDLE handle) {
+    return IS_HANDLE_TYPE(handle, pipeprv) || (IS_HANDLE_TYPE(handle, file) && !handle->file.seekable);
+}
+
+/* Moves the data inside the host kernel: files are copied with `copy_file_range` and sent to other
+ * streams with `sendfile`, host pipes are spliced. Everything else, and transfers that the host
+ * kernel refuses for the given pair of fds (e.g. files on different filesystems on older kernels),
+ * goes through the generic copy. */
+int64_t _DkStreamTransfer(PAL_HANDLE src, uint64_t src_offset, PAL_HANDLE dst, uint64_t dst_offset,
+                          uint64_t count) {
+    int src_fd = host_stream_fd(src, /*read=*/true);
+    int dst_fd = host_stream_fd(dst, /*read=*/false);
+    if (src_fd < 0 || dst_fd < 0)
+        return _DkStreamTransferCopy(src, src_offset, dst, dst_offset, count);
+
+    /* the host kernel never transfers more than `MAX_RW_COUNT` (~2GB) in one syscall anyway */
+    count = MIN(count, 0x7ffff000UL);
+
+    bool src_file = is_seekable_file(src);
+    bool dst_file = is_seekable_file(dst);
+    off_t src_off = src_offset;
+    off_t dst_off = dst_offset;
+    int64_t ret;
+
+    if (src_file && dst_file) {
+        ret = INLINE_SYSCALL(copy_file_range, 6, src_fd, &src_off, dst_fd, &dst_off, count, 0);
+    } else if (src_file) {
+        ret = INLINE_SYSCALL(sendfile, 4, dst_fd, src_fd, &src_off, count);
+    } else if (is_host_pipe(src) || is_host_pipe(dst)) {
+        ret = INLINE_SYSCALL(splice, 6, src_fd, NULL, dst_fd, dst_file ? &dst_off : NULL, count,
+                             0);
+    } else {
+        return _DkStreamTransferCopy(src, src_offset, dst, dst_offset, count);
+    }
+
+    if (ret == -EINVAL || ret == -ENOSYS || ret == -EXDEV || ret == -EOPNOTSUPP)
+        return _DkStreamTransferCopy(src, src_offset, dst, dst_offset, count);
+
+    return ret < 0 ? unix_to_pal_error(ret) : ret;
+}
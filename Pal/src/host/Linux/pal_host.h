@@ -111,6 +111,11 @@ typedef struct pal_handle {
             uint32_t signaled;
             bool auto_clear;
         } event;
+
+        struct {
+            PAL_IDX fd;                 /* host epoll instance */
+            struct pal_wait_set* set;
+        } waitset;
     };
 }* PAL_HANDLE;
 
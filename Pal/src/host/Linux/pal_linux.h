@@ -122,16 +122,27 @@ int handle_set_cloexec(PAL_HANDLE handle, bool enable);
 int handle_serialize(PAL_HANDLE handle, void** data);
 int handle_deserialize(PAL_HANDLE* handle, const void* data, size_t size);
 
+/* set up the io_uring used by DkStreamsBatchIo(); must be called before LibOS starts, because its
+ * mappings are reported as preloaded ranges */
+void init_io_uring(void);
+
+/* read the size of the pool of pre-created children; the pool is filled on the first child */
+int init_process_pool(void);
+
 #define ACCESS_R 4
 #define ACCESS_W 2
 #define ACCESS_X 1
 
 bool stataccess(struct stat* stats, int acc);
 
-void init_child_process(int parent_pipe_fd, PAL_HANDLE* parent, char** manifest_out,
-                        uint64_t* instance_id);
+void init_child_process(int parent_pipe_fd, PAL_HANDLE* parent, void** manifest_out,
+                        size_t* manifest_size_out, uint64_t* instance_id);
 
 void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int words[]);
+
+bool is_tsc_usable(void);
+uint64_t get_tsc_hz(void);
+void init_tsc(void);
 int block_async_signals(bool block);
 void signal_setup(void);
 
@@ -16,6 +16,10 @@ int _DkSystemTimeQuery(uint64_t* out_usec) {
     return -PAL_ERROR_NOTIMPLEMENTED;
 }
 
+int _DkSystemTimeCalibration(PAL_TIME_CALIBRATION* calib) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
 int _DkRandomBitsRead(void* buffer, size_t size) {
     return -PAL_ERROR_NOTIMPLEMENTED;
 }
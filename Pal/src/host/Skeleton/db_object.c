@@ -17,3 +17,19 @@ int _DkStreamsWaitEvents(size_t count, PAL_HANDLE* handle_array, PAL_FLG* events
                          PAL_FLG* ret_events, int64_t timeout_us) {
     return -PAL_ERROR_NOTIMPLEMENTED;
 }
+
+int _DkWaitSetCreate(PAL_HANDLE* handle) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkWaitSetCtl(PAL_HANDLE wait_set, enum PAL_WAIT_SET_OP op, PAL_NUM data, PAL_HANDLE handle,
+                  PAL_FLG events) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkWaitSetWait(PAL_HANDLE wait_set, size_t max_count, PAL_NUM* ret_data, PAL_FLG* ret_events,
+                   size_t* ret_count, int64_t timeout_us) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+struct handle_ops g_waitset_ops = {};
@@ -36,3 +36,12 @@ int _DkInitDebugStream(const char* path) {
 int _DkDebugLog(const void* buf, size_t size) {
     return -PAL_ERROR_NOTIMPLEMENTED;
 }
+
+int _DkStreamsBatchIo(size_t count, PAL_IO_REQUEST* reqs) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int64_t _DkStreamTransfer(PAL_HANDLE src, uint64_t src_offset, PAL_HANDLE dst, uint64_t dst_offset,
+                          uint64_t count) {
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
@@ -66,6 +66,10 @@ typedef struct pal_handle {
         struct {
             int unused;
         } event;
+
+        struct {
+            int unused;
+        } waitset;
     };
 }* PAL_HANDLE;
 
@@ -0,0 +1,118 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Statistics of PAL calls (enabled by `loader.enable_pal_stats`).
+ *
+ * Every PAL API call is counted in the generic `Dk*` wrappers (see `PAL_STATS_CALL`), hosts may
+ * additionally register a table of their own calls (e.g. OCALLs on SGX). If the TSC frequency is
+ * known, the time spent in each call is also recorded, together with a log2 histogram of latencies.
+ * All counters are updated with relaxed atomics, readers (LibOS via `PAL_CONTROL::stats`, or the
+ * dump at process exit) can see slightly inconsistent snapshots.
+ */
+
+#include "api.h"
+#include "cpu.h"
+#include "pal.h"
+#include "pal_error.h"
+#include "pal_internal.h"
+
+bool g_pal_stats_enabled = false;
+bool g_pal_stats_timed = false;
+
+PAL_STATS_ENTRY g_pal_stats_calls[PAL_STATS_CALLS_CNT] = {
+#define PAL_STATS_NAME(call) [PAL_STATS_##call] = { .name = "Dk" #call },
+    PAL_STATS_CALLS(PAL_STATS_NAME)
+#undef PAL_STATS_NAME
+};
+
+PAL_STATS g_pal_stats = {
+    .calls = g_pal_stats_calls,
+    .calls_cnt = PAL_STATS_CALLS_CNT,
+};
+
+void pal_stats_set_host_calls(PAL_STATS_ENTRY* entries, size_t cnt) {
+    g_pal_stats.host_calls     = entries;
+    g_pal_stats.host_calls_cnt = cnt;
+}
+
+int init_pal_stats(void) {
+    bool enable;
+    int ret = manifest_bool_in(g_pal_state.manifest_root, "loader.enable_pal_stats",
+                               /*defaultval=*/false, &enable);
+    if (ret < 0)
+        return ret;
+    if (!enable)
+        return 0;
+
+    /* times are recorded only if the TSC can be used for them */
+    PAL_TIME_CALIBRATION calib;
+    if (_DkSystemTimeCalibration(&calib) == 0) {
+        g_pal_stats.tsc_hz = calib.tsc_hz;
+        g_pal_stats_timed  = true;
+    }
+
+    g_pal_control.stats = &g_pal_stats;
+    g_pal_stats_enabled = true;
+    return 0;
+}
+
+uint64_t pal_stats_start(void) {
+    return g_pal_stats_timed ? get_tsc() : 0;
+}
+
+void pal_stats_record(PAL_STATS_ENTRY* entry, uint64_t start) {
+    __atomic_add_fetch(&entry->count, 1, __ATOMIC_RELAXED);
+    if (!g_pal_stats_timed)
+        return;
+
+    uint64_t cycles = get_tsc() - start;
+    size_t bucket = cycles ? 64 - __builtin_clzl(cycles) : 0;
+    if (bucket >= PAL_STATS_HIST_SIZE)
+        bucket = PAL_STATS_HIST_SIZE - 1;
+
+    __atomic_add_fetch(&entry->cycles, cycles, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&entry->hist[bucket], 1, __ATOMIC_RELAXED);
+}
+
+static void dump_entries(uint64_t id, const char* kind, PAL_STATS_ENTRY* entries, size_t cnt) {
+    for (size_t i = 0; i < cnt; i++) {
+        PAL_STATS_ENTRY* entry = &entries[i];
+        uint64_t count = __atomic_load_n(&entry->count, __ATOMIC_RELAXED);
+        if (!count || !entry->name)
+            continue;
+
+        /* hist is printed without the trailing empty buckets */
+        uint64_t hist[PAL_STATS_HIST_SIZE];
+        size_t hist_len = 0;
+        for (size_t j = 0; j < PAL_STATS_HIST_SIZE; j++) {
+            hist[j] = __atomic_load_n(&entry->hist[j], __ATOMIC_RELAXED);
+            if (hist[j])
+                hist_len = j + 1;
+        }
+
+        char hist_str[PAL_STATS_HIST_SIZE * 21 + 1] = "";
+        size_t off = 0;
+        for (size_t j = 0; j < hist_len; j++)
+            off += snprintf(hist_str + off, sizeof(hist_str) - off, "%s%lu", j ? "," : "",
+                            hist[j]);
+
+        log_always("pal_stats: {\"id\": %lu, \"kind\": \"%s\", \"name\": \"%s\", "
+                   "\"count\": %lu, \"cycles\": %lu, \"hist\": [%s]}", id, kind, entry->name,
+                   count, __atomic_load_n(&entry->cycles, __ATOMIC_RELAXED), hist_str);
+    }
+}
+
+void pal_stats_dump(void) {
+    if (!g_pal_stats_enabled)
+        return;
+
+    /* lines of different processes may be interleaved in the log, hence every line is tagged with
+     * a random ID of the dumping process */
+    uint64_t id = 0;
+    (void)_DkRandomBitsRead(&id, sizeof(id));
+
+    log_always("pal_stats: {\"id\": %lu, \"kind\": \"process\", \"tsc_hz\": %lu}", id,
+               g_pal_stats.tsc_hz);
+    dump_entries(id, "call", g_pal_stats.calls, g_pal_stats.calls_cnt);
+    dump_entries(id, "host", g_pal_stats.host_calls, g_pal_stats.host_calls_cnt);
+}
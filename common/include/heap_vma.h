@@ -0,0 +1,82 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Bookkeeping of allocated areas (VMAs) of a heap range, used by the SGX PAL for the enclave heap.
+ * This module is host-independent and does no locking; callers must serialize all operations on
+ * one `struct heap_vma_mgr`.
+ *
+ * VMAs are kept in an AVL tree ordered by address. Each VMA owns the free gap right below it (down
+ * to the previous VMA or the heap bottom); the gap below the heap top is owned by a sentinel. VMAs
+ * with a non-empty gap are additionally indexed by gap size in power-of-two buckets, each of which
+ * is an address-ordered AVL tree. Allocations without a fixed address go to the highest-address
+ * gap that fits (memory is allocated from higher to lower addresses, which the SGX PAL relies on,
+ * see _DkGetAvailableUserAddressRange()).
+ *
+ * VMA descriptors come from a caller-provided pool and are recycled through a free list.
+ */
+
+#ifndef HEAP_VMA_H
+#define HEAP_VMA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "avl_tree.h"
+
+#define HEAP_VMA_GAP_BUCKETS 64
+
+struct heap_vma {
+    struct avl_tree_node node;          /* in `heap_vma_mgr::vmas` */
+    union {
+        struct avl_tree_node gap_node;  /* in `heap_vma_mgr::gaps[]` if `gap` is not zero */
+        struct heap_vma* next_free;     /* in `heap_vma_mgr::free_list` if not used */
+    };
+    void* bottom;
+    void* top;
+    size_t gap;                         /* size of the free area right below `bottom` */
+    bool is_pal_internal;
+};
+
+struct heap_vma_mgr {
+    void* bottom;
+    void* top;
+    struct avl_tree vmas;
+    struct avl_tree gaps[HEAP_VMA_GAP_BUCKETS];
+    uint64_t gaps_mask;                 /* bit `i` set iff `gaps[i]` is not empty */
+    struct heap_vma top_sentinel;       /* owns the gap below `top`, is not in `vmas` */
+
+    struct heap_vma* pool;
+    size_t pool_size;
+    size_t pool_used;                   /* descriptors in `pool` ever handed out */
+    struct heap_vma* free_list;
+    size_t vma_count;
+};
+
+void heap_vma_mgr_init(struct heap_vma_mgr* mgr, void* bottom, void* top, struct heap_vma* pool,
+                       size_t pool_size);
+
+/*
+ * Allocates [addr, addr + size) or, if `addr` is NULL, the highest free area of `size` bytes.
+ * Overlapping VMAs of the same kind are merged into the new one, similar to mmap(MAP_FIXED);
+ * overlapping a VMA of the other kind fails. `*out_allocated` is set to the number of bytes that
+ * were not allocated before. Returns the start of the allocated area or NULL on failure.
+ */
+void* heap_vma_alloc(struct heap_vma_mgr* mgr, void* addr, size_t size, bool is_pal_internal,
+                     size_t* out_allocated);
+
+/*
+ * Frees [addr, addr + size), which may cover any number of VMAs (and holes), but only of one kind.
+ * On success, `*out_freed` is set to the number of bytes that were actually allocated and
+ * `*out_is_pal_internal` to the kind of freed VMAs. Returns 0 or a negative PAL error code; nothing
+ * is freed on failure.
+ */
+int heap_vma_free(struct heap_vma_mgr* mgr, void* addr, size_t size, size_t* out_freed,
+                  bool* out_is_pal_internal);
+
+/* Returns the bottom of the contiguous allocated area ending at the heap top (or the heap top). */
+void* heap_vma_get_free_top(struct heap_vma_mgr* mgr);
+
+bool debug_heap_vma_mgr_is_consistent(struct heap_vma_mgr* mgr);
+
+#endif /* HEAP_VMA_H */
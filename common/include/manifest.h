@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Compiled (binary) manifest.
+ *
+ * The TOML manifest is the source format, but parsing it on every process start is slow for large
+ * manifests (thousands of trusted files) and allocates memory for every key. Instead, the manifest
+ * is compiled into a flat, position-independent image (by `graphene-manifest --binary` or, if the
+ * loader was given a TOML manifest, once by the PAL of the first process). The image is used in
+ * place: loading it only validates bounds, lookups do not allocate, and child processes receive the
+ * compiled image from their parent.
+ *
+ * Image layout (all integers little-endian, sections 8-byte aligned):
+ *
+ *   struct manifest_header
+ *   struct manifest_node   nodes[nodes_cnt]    node 0 is the root table
+ *   struct manifest_slot   index[index_cnt]    open-addressing hash of full dotted keys
+ *   char                   strings[strings_size]
+ *
+ * Children of a table (or elements of an array) are stored contiguously; children of a table are
+ * sorted by key (bytewise, shorter prefix first), so a table can be searched by bisection. Every
+ * key and string value in the pool is NUL-terminated. The index contains all nodes reachable from
+ * the root through tables only (not nodes inside arrays); the hash is 64-bit FNV-1a of the unquoted
+ * key components joined with '.'.
+ *
+ * The layout is also produced by `python/graphenelibos/manifest.py`; keep both in sync.
+ */
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MANIFEST_MAGIC     "GRAMANF"
+#define MANIFEST_MAGIC_LEN 8
+#define MANIFEST_VERSION   1
+#define MANIFEST_ALIGN     8
+
+/* maximum key depth handled by the hash index; deeper keys are looked up by walking tables */
+#define MANIFEST_MAX_INDEXED_DEPTH 16
+
+enum manifest_node_type {
+    MANIFEST_NODE_BOOL = 1,
+    MANIFEST_NODE_INT,
+    MANIFEST_NODE_STRING,
+    MANIFEST_NODE_RAW,          /* float, datetime: unparsed TOML text */
+    MANIFEST_NODE_TABLE,
+    MANIFEST_NODE_ARRAY,
+};
+
+struct manifest_header {
+    char magic[MANIFEST_MAGIC_LEN];
+    uint32_t version;
+    uint32_t size;              /* size of the whole image */
+    uint32_t nodes_off;
+    uint32_t nodes_cnt;
+    uint32_t index_off;
+    uint32_t index_cnt;         /* power of two, or zero if there is no index */
+    uint32_t strings_off;
+    uint32_t strings_size;
+};
+
+struct manifest_node {
+    uint32_t type;              /* enum manifest_node_type */
+    uint32_t parent;            /* index of the parent node (lower than this node's index) */
+    uint32_t key_off;           /* key in the parent table; empty for array elements */
+    uint32_t key_len;
+    uint32_t count;             /* TABLE, ARRAY: number of children; STRING, RAW: length */
+    uint32_t reserved;
+    uint64_t value;             /* BOOL, INT: value; STRING, RAW: offset in strings;
+                                 * TABLE, ARRAY: index of the first child */
+};
+
+struct manifest_slot {
+    uint32_t tag;               /* upper 32 bits of the key hash */
+    uint32_t node;              /* node index + 1, 0 if the slot is empty */
+};
+
+struct manifest {
+    const struct manifest_header* hdr;
+    const struct manifest_node* nodes;
+    const struct manifest_slot* index;
+    const char* strings;
+};
+
+/* Returns true if `data` starts like a compiled manifest image (as opposed to TOML text). */
+bool manifest_is_binary(const void* data, size_t size);
+
+/*!
+ * \brief Use a compiled manifest image in place.
+ *
+ * \param manifest  Manifest handle to initialize; it points into `image` afterwards.
+ * \param image     Compiled image (must stay valid and unmodified while the manifest is used).
+ * \param size      Size of `image`.
+ *
+ * Validates the image so that no later lookup can read outside of it. Does not allocate memory.
+ * Returns 0 on success or negative PAL error code.
+ */
+int manifest_load(struct manifest* manifest, const void* image, size_t size);
+
+/*!
+ * \brief Compile TOML manifest text into an image.
+ *
+ * \param text         NUL-terminated TOML manifest.
+ * \param out_image    On success, contains the compiled image, allocated with malloc().
+ * \param out_size     On success, contains the size of the image.
+ * \param errbuf       Buffer for a human-readable error message.
+ * \param errbuf_size  Size of `errbuf`.
+ *
+ * Returns 0 on success or negative PAL error code.
+ */
+int manifest_compile_toml(char* text, void** out_image, size_t* out_size, char* errbuf,
+                          size_t errbuf_size);
+
+/*!
+ * \brief Load a manifest given either as a compiled image or as TOML text.
+ *
+ * A compiled image is used in place. TOML text (of `size` bytes, not necessarily NUL-terminated)
+ * is compiled into a newly allocated image, which is never freed. Returns 0 on success or negative
+ * PAL error code; on failure, `errbuf` contains the message.
+ */
+int manifest_init(struct manifest* manifest, const void* data, size_t size, char* errbuf,
+                  size_t errbuf_size);
+
+static inline const void* manifest_image(const struct manifest* manifest) {
+    return manifest->hdr;
+}
+
+static inline size_t manifest_image_size(const struct manifest* manifest) {
+    return manifest->hdr->size;
+}
+
+static inline const struct manifest_node* manifest_root(const struct manifest* manifest) {
+    return &manifest->nodes[0];
+}
+
+/* Returns the node under dotted key `key` (e.g. "fs.mount.lib1.type"), or NULL if not found.
+ * Double quotes are respected, same as in TOML. */
+const struct manifest_node* manifest_lookup(const struct manifest* manifest, const char* key);
+
+/* Returns the child of `table` with the (single, unquoted) key `key`, or NULL if not found. */
+const struct manifest_node* manifest_table_get(const struct manifest* manifest,
+                                               const struct manifest_node* table, const char* key,
+                                               size_t key_len);
+
+/* Returns the number of children of a table or array node, 0 for other nodes. */
+static inline size_t manifest_node_count(const struct manifest_node* node) {
+    return node->type == MANIFEST_NODE_TABLE || node->type == MANIFEST_NODE_ARRAY ? node->count
+                                                                                   : 0;
+}
+
+/* Returns `i`-th child of a table or array node; for tables, children are sorted by key. */
+static inline const struct manifest_node* manifest_node_child(const struct manifest* manifest,
+                                                              const struct manifest_node* node,
+                                                              size_t i) {
+    return &manifest->nodes[node->value + i];
+}
+
+static inline const char* manifest_node_key(const struct manifest* manifest,
+                                            const struct manifest_node* node) {
+    return &manifest->strings[node->key_off];
+}
+
+/* Returns the value of a STRING node (pointing into the image), or NULL for other nodes. */
+static inline const char* manifest_node_str(const struct manifest* manifest,
+                                            const struct manifest_node* node) {
+    return node->type == MANIFEST_NODE_STRING ? &manifest->strings[node->value] : NULL;
+}
+
+/*!
+ * \brief Check if a key was specified in the manifest (with a value that is not a table/array).
+ *
+ * \param manifest   Manifest.
+ * \param key        Dotted key (e.g. "loader.insecure__use_cmdline_argv").
+ */
+bool manifest_key_exists(const struct manifest* manifest, const char* key);
+
+/*!
+ * \brief Find a bool key-value in the manifest.
+ *
+ * \param manifest   Manifest.
+ * \param key        Dotted key (e.g. "loader.insecure__use_cmdline_argv").
+ * \param defaultval `retval` is set to this value if not found in the manifest.
+ * \param retval     Pointer to output bool.
+ *
+ * Returns 0 if there were no errors (but value may have not been found in manifest and was set to
+ * default one) or -1 if there were errors during conversion to bool.
+ */
+int manifest_bool_in(const struct manifest* manifest, const char* key, bool defaultval,
+                     bool* retval);
+
+/*!
+ * \brief Find an integer key-value in the manifest.
+ *
+ * \param manifest   Manifest.
+ * \param key        Dotted key (e.g. "sgx.thread_num").
+ * \param defaultval `retval` is set to this value if not found in the manifest.
+ * \param retval     Pointer to output integer.
+ *
+ * Returns 0 if there were no errors (but value may have not been found in manifest and was set to
+ * default one) or -1 if there were errors during conversion to int.
+ */
+int manifest_int_in(const struct manifest* manifest, const char* key, int64_t defaultval,
+                    int64_t* retval);
+
+/*!
+ * \brief Find a string key-value in the manifest.
+ *
+ * \param manifest  Manifest.
+ * \param key       Dotted key (e.g. "fs.mount.lib1.type").
+ * \param retval    Pointer to output string (a malloc'ed copy).
+ *
+ * Returns 0 if there were no errors (but value may have not been found in manifest and was set to
+ * NULL) or -1 if there were errors during conversion to string.
+ */
+int manifest_string_in(const struct manifest* manifest, const char* key, char** retval);
+
+/*!
+ * \brief Find a "size" string key-value in the manifest (parsed via `parse_size_str()`).
+ *
+ * \param manifest   Manifest.
+ * \param key        Dotted key (e.g. "sys.stack.size").
+ * \param defaultval `retval` is set to this value if not found in the manifest.
+ * \param retval     Pointer to output integer.
+ *
+ * Returns 0 if there were no errors (but value may have not been found in manifest and was set to
+ * default one) or -1 if there were errors during conversion to "size" string.
+ */
+int manifest_sizestring_in(const struct manifest* manifest, const char* key, uint64_t defaultval,
+                           uint64_t* retval);
+
+#endif /* MANIFEST_H */
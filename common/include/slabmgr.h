@@ -291,15 +291,50 @@ static inline int maybe_enlarge_slab_mgr(SLAB_MGR mgr, int level) {
     return 0;
 }
 
-static inline void* slab_alloc(SLAB_MGR mgr, size_t size) {
+// Returns the slab level serving buffers of `size`, or -1 if `size` needs a large object.
+static inline size_t slab_size_to_level(size_t size) {
+    for (size_t i = 0; i < SLAB_LEVEL; i++)
+        if (size <= slab_levels[i])
+            return i;
+    return (size_t)-1;
+}
+
+// SYSTEM_LOCK needs to be held by the caller on entry. Returns NULL on failure.
+static inline SLAB_OBJ __slab_get_obj(SLAB_MGR mgr, size_t level) {
     SLAB_OBJ mobj;
-    size_t level = -1;
+    assert(mgr->addr[level] <= mgr->addr_top[level]);
 
-    for (size_t i = 0; i < SLAB_LEVEL; i++)
-        if (size <= slab_levels[i]) {
-            level = i;
-            break;
-        }
+    int ret = maybe_enlarge_slab_mgr(mgr, level);
+    if (ret < 0)
+        return NULL;
+
+    if (!LISTP_EMPTY(&mgr->free_list[level])) {
+        mobj = LISTP_FIRST_ENTRY(&mgr->free_list[level], SLAB_OBJ_TYPE, __list);
+        LISTP_DEL(mobj, &mgr->free_list[level], __list);
+    } else {
+        mobj = (void*)mgr->addr[level];
+        mgr->addr[level] += slab_levels[level] + SLAB_HDR_SIZE;
+    }
+    assert(mgr->addr[level] <= mgr->addr_top[level]);
+    OBJ_LEVEL(mobj) = level;
+
+#ifdef SLAB_CANARY
+    unsigned long* m = (unsigned long*)((void*)OBJ_RAW(mobj) + slab_levels[level]);
+    *m = SLAB_CANARY_STRING;
+#endif
+
+    return mobj;
+}
+
+// SYSTEM_LOCK needs to be held by the caller on entry.
+static inline void __slab_put_obj(SLAB_MGR mgr, size_t level, SLAB_OBJ mobj) {
+    INIT_LIST_HEAD(mobj, __list);
+    LISTP_ADD_TAIL(mobj, &mgr->free_list[level], __list);
+}
+
+static inline void* slab_alloc(SLAB_MGR mgr, size_t size) {
+    SLAB_OBJ mobj;
+    size_t level = slab_size_to_level(size);
 
     if (level == (size_t)-1) {
         size = ALIGN_UP_POW2(size, MIN_MALLOC_ALIGNMENT);
@@ -315,31 +350,50 @@ static inline void* slab_alloc(SLAB_MGR mgr, size_t size) {
     }
 
     SYSTEM_LOCK();
-    assert(mgr->addr[level] <= mgr->addr_top[level]);
+    mobj = __slab_get_obj(mgr, level);
+    SYSTEM_UNLOCK();
 
-    int ret = maybe_enlarge_slab_mgr(mgr, level);
-    if (ret < 0) {
-        SYSTEM_UNLOCK();
-        return NULL;
-    }
+    return mobj ? OBJ_RAW(mobj) : NULL;
+}
 
-    if (!LISTP_EMPTY(&mgr->free_list[level])) {
-        mobj = LISTP_FIRST_ENTRY(&mgr->free_list[level], SLAB_OBJ_TYPE, __list);
-        LISTP_DEL(mobj, &mgr->free_list[level], __list);
-    } else {
-        mobj = (void*)mgr->addr[level];
-        mgr->addr[level] += slab_levels[level] + SLAB_HDR_SIZE;
+/*
+ * Allocates up to `count` objects of slab level `level` under a single SYSTEM_LOCK and links their
+ * user buffers through the first word into a NULL-terminated chain, returned in `out_chain`.
+ * Returns the number of allocated objects (less than `count` only if memory ran out).
+ */
+static inline size_t slab_alloc_chain(SLAB_MGR mgr, size_t level, size_t count, void** out_chain) {
+    assert(level < SLAB_LEVEL);
+    void* chain = NULL;
+    size_t i;
+
+    SYSTEM_LOCK();
+    for (i = 0; i < count; i++) {
+        SLAB_OBJ mobj = __slab_get_obj(mgr, level);
+        if (!mobj)
+            break;
+        void* raw = OBJ_RAW(mobj);
+        *(void**)raw = chain;
+        chain = raw;
     }
-    assert(mgr->addr[level] <= mgr->addr_top[level]);
-    OBJ_LEVEL(mobj) = level;
     SYSTEM_UNLOCK();
 
-#ifdef SLAB_CANARY
-    unsigned long* m = (unsigned long*)((void*)OBJ_RAW(mobj) + slab_levels[level]);
-    *m = SLAB_CANARY_STRING;
-#endif
+    *out_chain = chain;
+    return i;
+}
+
+/* Returns a chain built by slab_alloc_chain() (possibly reshuffled by the caller, but consisting
+ * only of `level` objects) to the slab manager under a single SYSTEM_LOCK. */
+static inline void slab_free_chain(SLAB_MGR mgr, size_t level, void* chain) {
+    assert(level < SLAB_LEVEL);
 
-    return OBJ_RAW(mobj);
+    SYSTEM_LOCK();
+    while (chain) {
+        /* the link overlaps with `__list`, so read it before the object is put on the free list */
+        void* next = *(void**)chain;
+        __slab_put_obj(mgr, level, RAW_TO_OBJ(chain, SLAB_OBJ_TYPE));
+        chain = next;
+    }
+    SYSTEM_UNLOCK();
 }
 
 // Returns user buffer size (i.e. excluding size of control structures).
@@ -409,8 +463,7 @@ static inline void slab_free(SLAB_MGR mgr, void* obj) {
 #endif
 
     SYSTEM_LOCK();
-    INIT_LIST_HEAD(mobj, __list);
-    LISTP_ADD_TAIL(mobj, &mgr->free_list[level], __list);
+    __slab_put_obj(mgr, level, mobj);
     SYSTEM_UNLOCK();
 }
 
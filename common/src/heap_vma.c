@@ -0,0 +1,391 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Heap VMA bookkeeping, see heap_vma.h for the description.
+ */
+
+#include "heap_vma.h"
+
+#include "api.h"
+#include "assert.h"
+#include "pal_error.h"
+
+static struct heap_vma* node2vma(struct avl_tree_node* node) {
+    return container_of(node, struct heap_vma, node);
+}
+
+static struct heap_vma* gap_node2vma(struct avl_tree_node* node) {
+    return container_of(node, struct heap_vma, gap_node);
+}
+
+static bool vma_cmp(struct avl_tree_node* a, struct avl_tree_node* b) {
+    return node2vma(a)->bottom <= node2vma(b)->bottom;
+}
+
+static bool gap_cmp(struct avl_tree_node* a, struct avl_tree_node* b) {
+    return gap_node2vma(a)->bottom <= gap_node2vma(b)->bottom;
+}
+
+/* Returns true if the VMA `node` ends at or above `addr`. */
+static bool addr_le_top(void* addr, struct avl_tree_node* node) {
+    return addr <= node2vma(node)->top;
+}
+
+/* Returns true if the VMA `node` ends above `addr`. */
+static bool addr_lt_top(void* addr, struct avl_tree_node* node) {
+    return addr < node2vma(node)->top;
+}
+
+/* Returns true if the VMA `node` starts at or above `addr`. */
+static bool addr_le_bottom(void* addr, struct avl_tree_node* node) {
+    return addr <= node2vma(node)->bottom;
+}
+
+static unsigned int gap_bucket(size_t gap) {
+    assert(gap);
+    return 63 - __builtin_clzl(gap);
+}
+
+static struct heap_vma* alloc_vma(struct heap_vma_mgr* mgr) {
+    struct heap_vma* vma;
+    if (mgr->free_list) {
+        vma = mgr->free_list;
+        mgr->free_list = vma->next_free;
+    } else if (mgr->pool_used < mgr->pool_size) {
+        vma = &mgr->pool[mgr->pool_used++];
+    } else {
+        return NULL;
+    }
+    mgr->vma_count++;
+    return vma;
+}
+
+static void free_vma(struct heap_vma_mgr* mgr, struct heap_vma* vma) {
+    assert(mgr->vma_count);
+    vma->bottom = NULL;
+    vma->top = NULL;
+    vma->next_free = mgr->free_list;
+    mgr->free_list = vma;
+    mgr->vma_count--;
+}
+
+/* Returns the VMA directly above `vma` in the address order (possibly the top sentinel). */
+static struct heap_vma* vma_above(struct heap_vma_mgr* mgr, struct heap_vma* vma) {
+    struct avl_tree_node* next = avl_tree_next(&vma->node);
+    return next ? node2vma(next) : &mgr->top_sentinel;
+}
+
+static void* vma_below_top(struct heap_vma_mgr* mgr, struct heap_vma* vma) {
+    struct avl_tree_node* prev = vma == &mgr->top_sentinel ? avl_tree_last(&mgr->vmas)
+                                                           : avl_tree_prev(&vma->node);
+    return prev ? node2vma(prev)->top : mgr->bottom;
+}
+
+static void gap_unindex(struct heap_vma_mgr* mgr, struct heap_vma* vma) {
+    if (!vma->gap)
+        return;
+
+    unsigned int bucket = gap_bucket(vma->gap);
+    avl_tree_delete(&mgr->gaps[bucket], &vma->gap_node);
+    if (!mgr->gaps[bucket].root)
+        mgr->gaps_mask &= ~(1ULL << bucket);
+    vma->gap = 0;
+}
+
+/* Recomputes the gap below `vma` (which must not be indexed) and indexes it. */
+static void gap_index(struct heap_vma_mgr* mgr, struct heap_vma* vma) {
+    assert(!vma->gap);
+
+    void* below = vma_below_top(mgr, vma);
+    assert(below <= vma->bottom);
+    vma->gap = vma->bottom - below;
+    if (!vma->gap)
+        return;
+
+    unsigned int bucket = gap_bucket(vma->gap);
+    avl_tree_insert(&mgr->gaps[bucket], &vma->gap_node);
+    mgr->gaps_mask |= 1ULL << bucket;
+}
+
+static void gap_update(struct heap_vma_mgr* mgr, struct heap_vma* vma) {
+    gap_unindex(mgr, vma);
+    gap_index(mgr, vma);
+}
+
+void heap_vma_mgr_init(struct heap_vma_mgr* mgr, void* bottom, void* top, struct heap_vma* pool,
+                       size_t pool_size) {
+    assert(bottom <= top);
+
+    mgr->bottom = bottom;
+    mgr->top = top;
+    mgr->vmas = (struct avl_tree){ .root = NULL, .cmp = vma_cmp };
+    for (size_t i = 0; i < HEAP_VMA_GAP_BUCKETS; i++)
+        mgr->gaps[i] = (struct avl_tree){ .root = NULL, .cmp = gap_cmp };
+    mgr->gaps_mask = 0;
+
+    mgr->pool = pool;
+    mgr->pool_size = pool_size;
+    mgr->pool_used = 0;
+    mgr->free_list = NULL;
+    mgr->vma_count = 0;
+
+    mgr->top_sentinel = (struct heap_vma){ .bottom = top, .top = top, .gap = 0 };
+    gap_index(mgr, &mgr->top_sentinel);
+}
+
+/* Returns the VMA owning the highest-address gap of at least `size` bytes, or NULL. */
+static struct heap_vma* find_gap(struct heap_vma_mgr* mgr, size_t size) {
+    unsigned int size_bucket = gap_bucket(size);
+    struct heap_vma* best = NULL;
+
+    /* every gap in a bucket above the one of `size` fits, take the highest of them */
+    uint64_t mask = mgr->gaps_mask & ~((2ULL << size_bucket) - 1);
+    while (mask) {
+        unsigned int bucket = __builtin_ctzll(mask);
+        mask &= mask - 1;
+
+        struct heap_vma* vma = gap_node2vma(avl_tree_last(&mgr->gaps[bucket]));
+        if (!best || vma->bottom > best->bottom)
+            best = vma;
+    }
+
+    /* gaps in the bucket of `size` may be too small; only the ones above `best` are of interest */
+    if (mgr->gaps_mask & (1ULL << size_bucket)) {
+        struct avl_tree_node* node = avl_tree_last(&mgr->gaps[size_bucket]);
+        for (; node; node = avl_tree_prev(node)) {
+            struct heap_vma* vma = gap_node2vma(node);
+            if (best && vma->bottom < best->bottom)
+                break;
+            if (vma->gap >= size) {
+                best = vma;
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+void* heap_vma_alloc(struct heap_vma_mgr* mgr, void* addr, size_t size, bool is_pal_internal,
+                     size_t* out_allocated) {
+    assert(size);
+
+    if (!addr) {
+        struct heap_vma* gap_owner = find_gap(mgr, size);
+        if (!gap_owner)
+            return NULL;
+        addr = gap_owner->bottom - size;
+    } else if (addr < mgr->bottom || addr > mgr->top || size > (size_t)(mgr->top - addr)) {
+        return NULL;
+    }
+
+    void* end = addr + size;
+
+    /* first VMA overlapping or adjacent to [addr, end) */
+    struct avl_tree_node* first = avl_tree_lower_bound_fn(&mgr->vmas, addr, addr_le_top);
+
+    /* [addr, end) must not overlap with VMAs of the other kind */
+    for (struct avl_tree_node* node = first; node; node = avl_tree_next(node)) {
+        struct heap_vma* vma = node2vma(node);
+        if (vma->bottom >= end)
+            break;
+        if (vma->is_pal_internal != is_pal_internal && vma->top > addr)
+            return NULL;
+    }
+
+    /* merge all overlapping and adjacent VMAs of the same kind into the first of them; VMAs of the
+     * other kind may only be adjacent at the edges */
+    struct heap_vma* new_vma = NULL;
+    void* new_bottom = addr;
+    void* new_top = end;
+    size_t freed = 0;
+
+    struct avl_tree_node* node = first;
+    while (node) {
+        struct heap_vma* vma = node2vma(node);
+        if (vma->bottom > end)
+            break;
+        node = avl_tree_next(node);
+
+        if (vma->is_pal_internal != is_pal_internal)
+            continue;
+
+        freed += vma->top - vma->bottom;
+        new_bottom = MIN(new_bottom, vma->bottom);
+        new_top = MAX(new_top, vma->top);
+
+        gap_unindex(mgr, vma);
+        if (!new_vma) {
+            new_vma = vma;
+        } else {
+            avl_tree_delete(&mgr->vmas, &vma->node);
+            free_vma(mgr, vma);
+        }
+    }
+
+    if (new_vma) {
+        /* the order of VMAs is not affected, as all VMAs in between were removed */
+        new_vma->bottom = new_bottom;
+        new_vma->top = new_top;
+    } else {
+        new_vma = alloc_vma(mgr);
+        if (!new_vma)
+            return NULL;
+        new_vma->bottom = new_bottom;
+        new_vma->top = new_top;
+        new_vma->gap = 0;
+        new_vma->is_pal_internal = is_pal_internal;
+        avl_tree_insert(&mgr->vmas, &new_vma->node);
+    }
+
+    gap_index(mgr, new_vma);
+    gap_update(mgr, vma_above(mgr, new_vma));
+
+    assert((size_t)(new_top - new_bottom) >= freed);
+    *out_allocated = new_top - new_bottom - freed;
+    return addr;
+}
+
+int heap_vma_free(struct heap_vma_mgr* mgr, void* addr, size_t size, size_t* out_freed,
+                  bool* out_is_pal_internal) {
+    assert(size);
+
+    if (addr < mgr->bottom || addr > mgr->top || size > (size_t)(mgr->top - addr))
+        return -PAL_ERROR_INVAL;
+
+    void* end = addr + size;
+
+    /* first VMA overlapping with [addr, end) */
+    struct avl_tree_node* first = avl_tree_lower_bound_fn(&mgr->vmas, addr, addr_lt_top);
+
+    /* all overlapping VMAs must be of one kind; splitting a VMA needs a new descriptor */
+    bool is_pal_internal = false;
+    bool need_split = false;
+    for (struct avl_tree_node* node = first; node; node = avl_tree_next(node)) {
+        struct heap_vma* vma = node2vma(node);
+        if (vma->bottom >= end)
+            break;
+        if (node == first)
+            is_pal_internal = vma->is_pal_internal;
+        else if (vma->is_pal_internal != is_pal_internal)
+            return -PAL_ERROR_INVAL;
+        if (vma->bottom < addr && vma->top > end)
+            need_split = true;
+    }
+
+    struct heap_vma* split = NULL;
+    if (need_split) {
+        split = alloc_vma(mgr);
+        if (!split)
+            return -PAL_ERROR_NOMEM;
+    }
+
+    size_t freed = 0;
+    struct avl_tree_node* node = first;
+    while (node) {
+        struct heap_vma* vma = node2vma(node);
+        if (vma->bottom >= end)
+            break;
+        node = avl_tree_next(node);
+
+        freed += MIN(vma->top, end) - MAX(vma->bottom, addr);
+
+        if (vma->bottom < addr && vma->top > end) {
+            /* keep [vma->bottom, addr) in `vma` and move [end, vma->top) to `split` */
+            split->bottom = end;
+            split->top = vma->top;
+            split->gap = 0;
+            split->is_pal_internal = vma->is_pal_internal;
+            vma->top = addr;
+            avl_tree_insert(&mgr->vmas, &split->node);
+            gap_index(mgr, split);
+        } else if (vma->bottom < addr) {
+            vma->top = addr;
+        } else if (vma->top > end) {
+            gap_unindex(mgr, vma);
+            vma->bottom = end;
+            gap_index(mgr, vma);
+        } else {
+            gap_unindex(mgr, vma);
+            avl_tree_delete(&mgr->vmas, &vma->node);
+            free_vma(mgr, vma);
+        }
+    }
+
+    /* the gap below the first VMA above the freed area has grown */
+    struct avl_tree_node* above = avl_tree_lower_bound_fn(&mgr->vmas, end, addr_le_bottom);
+    gap_update(mgr, above ? node2vma(above) : &mgr->top_sentinel);
+
+    *out_freed = freed;
+    *out_is_pal_internal = is_pal_internal;
+    return 0;
+}
+
+void* heap_vma_get_free_top(struct heap_vma_mgr* mgr) {
+    void* addr = mgr->top;
+    for (struct avl_tree_node* node = avl_tree_last(&mgr->vmas); node; node = avl_tree_prev(node)) {
+        struct heap_vma* vma = node2vma(node);
+        if (vma->top < addr)
+            break;
+        addr = vma->bottom;
+    }
+    return addr;
+}
+
+static bool gap_is_indexed(struct heap_vma_mgr* mgr, struct heap_vma* vma) {
+    unsigned int bucket = gap_bucket(vma->gap);
+    return avl_tree_find(&mgr->gaps[bucket], &vma->gap_node) == &vma->gap_node;
+}
+
+bool debug_heap_vma_mgr_is_consistent(struct heap_vma_mgr* mgr) {
+    if (!debug_avl_tree_is_balanced(&mgr->vmas))
+        return false;
+
+    size_t count = 0;
+    size_t gaps_count = 0;
+    void* below = mgr->bottom;
+    struct heap_vma* prev = NULL;
+    for (struct avl_tree_node* node = avl_tree_first(&mgr->vmas); node; node = avl_tree_next(node)) {
+        struct heap_vma* vma = node2vma(node);
+        if (vma->bottom >= vma->top || vma->bottom < below || vma->top > mgr->top)
+            return false;
+        if (vma->gap != (size_t)(vma->bottom - below))
+            return false;
+        /* adjacent VMAs of the same kind are always merged */
+        if (prev && prev->top == vma->bottom && prev->is_pal_internal == vma->is_pal_internal)
+            return false;
+        if (vma->gap) {
+            if (!gap_is_indexed(mgr, vma))
+                return false;
+            gaps_count++;
+        }
+        below = vma->top;
+        prev = vma;
+        count++;
+    }
+
+    struct heap_vma* sentinel = &mgr->top_sentinel;
+    if (sentinel->gap != (size_t)(mgr->top - below))
+        return false;
+    if (sentinel->gap) {
+        if (!gap_is_indexed(mgr, sentinel))
+            return false;
+        gaps_count++;
+    }
+
+    size_t indexed = 0;
+    for (size_t i = 0; i < HEAP_VMA_GAP_BUCKETS; i++) {
+        if (!mgr->gaps[i].root != !(mgr->gaps_mask & (1ULL << i)))
+            return false;
+        if (!debug_avl_tree_is_balanced(&mgr->gaps[i]))
+            return false;
+        for (struct avl_tree_node* node = avl_tree_first(&mgr->gaps[i]); node;
+                node = avl_tree_next(node)) {
+            if (gap_bucket(gap_node2vma(node)->gap) != i)
+                return false;
+            indexed++;
+        }
+    }
+
+    return count == mgr->vma_count && indexed == gaps_count;
+}
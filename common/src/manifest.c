@@ -0,0 +1,361 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Loading and lookups of compiled manifests, see manifest.h for the description of the format.
+ */
+
+#include "manifest.h"
+
+#include "api.h"
+#include "assert.h"
+#include "pal_error.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325UL
+#define FNV_PRIME        0x100000001b3UL
+
+static uint64_t fnv_update(uint64_t hash, const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Compares keys bytewise, a proper prefix sorts first (same order as Python's `bytes`). */
+static int key_cmp(const char* a, size_t a_len, const char* b, size_t b_len) {
+    int ret = memcmp(a, b, MIN(a_len, b_len));
+    if (ret)
+        return ret;
+    return a_len < b_len ? -1 : a_len > b_len ? 1 : 0;
+}
+
+static bool range_ok(uint64_t off, uint64_t len, uint64_t size) {
+    return off <= size && len <= size - off;
+}
+
+bool manifest_is_binary(const void* data, size_t size) {
+    return size >= sizeof(struct manifest_header)
+           && !memcmp(data, MANIFEST_MAGIC, MANIFEST_MAGIC_LEN);
+}
+
+static bool is_string_ok(const struct manifest_header* hdr, const char* strings, uint32_t off,
+                         uint32_t len) {
+    return range_ok(off, (uint64_t)len + 1, hdr->strings_size) && strings[off + len] == '\0';
+}
+
+int manifest_load(struct manifest* manifest, const void* image, size_t size) {
+    const struct manifest_header* hdr = image;
+
+    if (!manifest_is_binary(image, size) || hdr->version != MANIFEST_VERSION
+            || hdr->size > size || hdr->size < sizeof(*hdr))
+        return -PAL_ERROR_INVAL;
+    if (!IS_ALIGNED_PTR(image, MANIFEST_ALIGN))
+        return -PAL_ERROR_INVAL;
+
+    if (!IS_ALIGNED(hdr->nodes_off, MANIFEST_ALIGN)
+            || !range_ok(hdr->nodes_off, (uint64_t)hdr->nodes_cnt * sizeof(struct manifest_node),
+                         hdr->size)
+            || hdr->nodes_cnt == 0)
+        return -PAL_ERROR_INVAL;
+    if (!IS_ALIGNED(hdr->index_off, MANIFEST_ALIGN)
+            || !range_ok(hdr->index_off, (uint64_t)hdr->index_cnt * sizeof(struct manifest_slot),
+                         hdr->size)
+            || (hdr->index_cnt & (hdr->index_cnt - 1)))
+        return -PAL_ERROR_INVAL;
+    if (!range_ok(hdr->strings_off, hdr->strings_size, hdr->size))
+        return -PAL_ERROR_INVAL;
+
+    const struct manifest_node* nodes = image + hdr->nodes_off;
+    const struct manifest_slot* index = image + hdr->index_off;
+    const char* strings = image + hdr->strings_off;
+
+    if (nodes[0].type != MANIFEST_NODE_TABLE)
+        return -PAL_ERROR_INVAL;
+
+    /* Check everything that lookups rely on: bounds of keys, strings and children, children
+     * pointing back to their parent (so that walking up from an index hit terminates at the root)
+     * and sorted keys in tables (so that bisection finds every key). Keys of all nodes are checked
+     * first, as checking the order of children compares their keys. */
+    for (uint32_t i = 0; i < hdr->nodes_cnt; i++) {
+        const struct manifest_node* node = &nodes[i];
+
+        if (!is_string_ok(hdr, strings, node->key_off, node->key_len))
+            return -PAL_ERROR_INVAL;
+        if (i > 0 && node->parent >= i)
+            return -PAL_ERROR_INVAL;
+    }
+
+    for (uint32_t i = 0; i < hdr->nodes_cnt; i++) {
+        const struct manifest_node* node = &nodes[i];
+
+        switch (node->type) {
+            case MANIFEST_NODE_BOOL:
+            case MANIFEST_NODE_INT:
+                break;
+            case MANIFEST_NODE_STRING:
+            case MANIFEST_NODE_RAW:
+                if (node->value > UINT32_MAX
+                        || !is_string_ok(hdr, strings, node->value, node->count))
+                    return -PAL_ERROR_INVAL;
+                break;
+            case MANIFEST_NODE_TABLE:
+            case MANIFEST_NODE_ARRAY:
+                if (node->count && (node->value <= i
+                        || !range_ok(node->value, node->count, hdr->nodes_cnt)))
+                    return -PAL_ERROR_INVAL;
+                for (uint32_t j = 0; j < node->count; j++) {
+                    const struct manifest_node* child = &nodes[node->value + j];
+                    if (child->parent != i)
+                        return -PAL_ERROR_INVAL;
+                    if (node->type == MANIFEST_NODE_TABLE && j > 0
+                            && key_cmp(&strings[child[-1].key_off], child[-1].key_len,
+                                       &strings[child->key_off], child->key_len) >= 0)
+                        return -PAL_ERROR_INVAL;
+                }
+                break;
+            default:
+                return -PAL_ERROR_INVAL;
+        }
+    }
+
+    for (uint32_t i = 0; i < hdr->index_cnt; i++)
+        if (index[i].node > hdr->nodes_cnt)
+            return -PAL_ERROR_INVAL;
+
+    manifest->hdr = hdr;
+    manifest->nodes = nodes;
+    manifest->index = index;
+    manifest->strings = strings;
+    return 0;
+}
+
+int manifest_init(struct manifest* manifest, const void* data, size_t size, char* errbuf,
+                  size_t errbuf_size) {
+    int ret;
+
+    if (manifest_is_binary(data, size)) {
+        ret = manifest_load(manifest, data, size);
+        if (ret < 0)
+            snprintf(errbuf, errbuf_size, "invalid compiled manifest");
+        return ret;
+    }
+
+    /* TOML text; tomlc99 needs it NUL-terminated */
+    char* text = malloc(size + 1);
+    if (!text) {
+        snprintf(errbuf, errbuf_size, "out of memory");
+        return -PAL_ERROR_NOMEM;
+    }
+    memcpy(text, data, size);
+    text[size] = '\0';
+
+    void* image;
+    size_t image_size;
+    ret = manifest_compile_toml(text, &image, &image_size, errbuf, errbuf_size);
+    free(text);
+    if (ret < 0)
+        return ret;
+
+    ret = manifest_load(manifest, image, image_size);
+    if (ret < 0) {
+        snprintf(errbuf, errbuf_size, "invalid compiled manifest");
+        free(image);
+    }
+    return ret;
+}
+
+const struct manifest_node* manifest_table_get(const struct manifest* manifest,
+                                               const struct manifest_node* table, const char* key,
+                                               size_t key_len) {
+    if (table->type != MANIFEST_NODE_TABLE)
+        return NULL;
+
+    size_t lo = 0;
+    size_t hi = table->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const struct manifest_node* child = manifest_node_child(manifest, table, mid);
+        int cmp = key_cmp(manifest_node_key(manifest, child), child->key_len, key, key_len);
+        if (cmp == 0)
+            return child;
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+struct key_component {
+    const char* str;
+    size_t len;
+};
+
+/* Splits the next component off a dotted key. Returns the rest of the key (pointing at the
+ * separating '.' or at the terminating NUL), or NULL if the key is malformed. */
+static const char* next_component(const char* key, struct key_component* out) {
+    if (*key == '"') {
+        const char* end = key + 1;
+        while (*end && *end != '"')
+            end++;
+        if (end[0] != '"' || (end[1] != '.' && end[1] != '\0'))
+            return NULL; /* incorrectly terminated '"' */
+        out->str = key + 1;
+        out->len = end - (key + 1);
+        return end + 1;
+    }
+
+    const char* end = key;
+    while (*end && *end != '.')
+        end++;
+    out->str = key;
+    out->len = end - key;
+    return end;
+}
+
+static const struct manifest_node* lookup_by_walk(const struct manifest* manifest,
+                                                  const char* key) {
+    const struct manifest_node* node = manifest_root(manifest);
+    while (true) {
+        struct key_component comp;
+        key = next_component(key, &comp);
+        if (!key)
+            return NULL;
+        node = manifest_table_get(manifest, node, comp.str, comp.len);
+        if (!node || !*key)
+            return node;
+        key++; /* skip '.' */
+    }
+}
+
+/* Checks that `node` is reachable from the root via keys `comps[0..depth)`. */
+static bool node_has_path(const struct manifest* manifest, uint32_t node,
+                          const struct key_component* comps, size_t depth) {
+    for (size_t i = depth; i > 0; i--) {
+        if (node == 0)
+            return false;
+        const struct manifest_node* n = &manifest->nodes[node];
+        if (n->key_len != comps[i - 1].len
+                || memcmp(manifest_node_key(manifest, n), comps[i - 1].str, n->key_len))
+            return false;
+        node = n->parent;
+    }
+    return node == 0;
+}
+
+const struct manifest_node* manifest_lookup(const struct manifest* manifest, const char* key) {
+    const struct manifest_header* hdr = manifest->hdr;
+    if (hdr->index_cnt == 0)
+        return lookup_by_walk(manifest, key);
+
+    struct key_component comps[MANIFEST_MAX_INDEXED_DEPTH];
+    size_t depth = 0;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    const char* rest = key;
+    while (true) {
+        if (depth == ARRAY_SIZE(comps))
+            return lookup_by_walk(manifest, key);
+        rest = next_component(rest, &comps[depth]);
+        if (!rest)
+            return NULL;
+        if (depth > 0)
+            hash = fnv_update(hash, ".", 1);
+        hash = fnv_update(hash, comps[depth].str, comps[depth].len);
+        depth++;
+        if (!*rest)
+            break;
+        rest++; /* skip '.' */
+    }
+
+    uint32_t tag = hash >> 32;
+    uint32_t mask = hdr->index_cnt - 1;
+    for (uint32_t i = 0; i <= mask; i++) {
+        const struct manifest_slot* slot = &manifest->index[(hash + i) & mask];
+        if (!slot->node)
+            return NULL;
+        if (slot->tag == tag && node_has_path(manifest, slot->node - 1, comps, depth))
+            return &manifest->nodes[slot->node - 1];
+    }
+    return NULL;
+}
+
+static bool is_value_node(const struct manifest_node* node) {
+    return node && node->type != MANIFEST_NODE_TABLE && node->type != MANIFEST_NODE_ARRAY;
+}
+
+bool manifest_key_exists(const struct manifest* manifest, const char* key) {
+    return is_value_node(manifest_lookup(manifest, key));
+}
+
+int manifest_bool_in(const struct manifest* manifest, const char* key, bool defaultval,
+                     bool* retval) {
+    const struct manifest_node* node = manifest_lookup(manifest, key);
+    if (!is_value_node(node)) {
+        *retval = defaultval;
+        return 0;
+    }
+    if (node->type == MANIFEST_NODE_BOOL) {
+        *retval = !!node->value;
+        return 0;
+    }
+
+    // Maybe someone used the old syntax?
+    // TODO: remove this fallback after some time.
+    if (node->type == MANIFEST_NODE_INT && (node->value == 0 || node->value == 1)) {
+        log_warning("Manifest contains a deprecated syntax for '%s' key. Please use true/false "
+                    "instead of 1/0", key);
+        *retval = !!node->value;
+        return 0;
+    }
+    return -1;
+}
+
+int manifest_int_in(const struct manifest* manifest, const char* key, int64_t defaultval,
+                    int64_t* retval) {
+    const struct manifest_node* node = manifest_lookup(manifest, key);
+    if (!is_value_node(node)) {
+        *retval = defaultval;
+        return 0;
+    }
+    if (node->type != MANIFEST_NODE_INT)
+        return -1;
+    *retval = (int64_t)node->value;
+    return 0;
+}
+
+int manifest_string_in(const struct manifest* manifest, const char* key, char** retval) {
+    const struct manifest_node* node = manifest_lookup(manifest, key);
+    if (!is_value_node(node)) {
+        *retval = NULL;
+        return 0;
+    }
+    const char* str = manifest_node_str(manifest, node);
+    if (!str)
+        return -1;
+    *retval = malloc(node->count + 1);
+    if (!*retval)
+        return -1;
+    memcpy(*retval, str, node->count + 1);
+    return 0;
+}
+
+int manifest_sizestring_in(const struct manifest* manifest, const char* key, uint64_t defaultval,
+                           uint64_t* retval) {
+    const struct manifest_node* node = manifest_lookup(manifest, key);
+    if (!is_value_node(node)) {
+        *retval = defaultval;
+        return 0;
+    }
+    const char* str = manifest_node_str(manifest, node);
+    if (!str)
+        return -1;
+
+    int64_t ret = parse_size_str(str);
+    if (ret < 0)
+        return -1;
+
+    *retval = (uint64_t)ret;
+    return 0;
+}
@@ -0,0 +1,386 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * Compilation of TOML manifests into the binary format described in manifest.h. This runs at most
+ * once per Graphene instance (or never, if the manifest was compiled by `graphene-manifest`).
+ */
+
+#include "api.h"
+#include "assert.h"
+#include "manifest.h"
+#include "pal_error.h"
+#include "toml.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325UL
+#define FNV_PRIME        0x100000001b3UL
+
+/* TOML object backing a table or array node, needed until the node's children are emitted */
+struct toml_src {
+    const toml_table_t* table;
+    const toml_array_t* array;
+};
+
+struct builder {
+    struct manifest_node* nodes;
+    size_t nodes_cnt;
+    size_t nodes_cap;
+    struct toml_src* srcs;
+    uint64_t* hashes;          /* hash of the full key of each node */
+    bool* indexed;             /* whether the node is reachable from the root through tables */
+    size_t indexed_cnt;
+
+    char* strings;
+    size_t strings_size;
+    size_t strings_cap;
+};
+
+static uint64_t fnv_update(uint64_t hash, const char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static int key_cmp(const char* a, const char* b) {
+    size_t a_len = strlen(a);
+    size_t b_len = strlen(b);
+    int ret = memcmp(a, b, MIN(a_len, b_len));
+    if (ret)
+        return ret;
+    return a_len < b_len ? -1 : a_len > b_len ? 1 : 0;
+}
+
+static void sift_down(const char** keys, size_t root, size_t n) {
+    while (2 * root + 1 < n) {
+        size_t child = 2 * root + 1;
+        if (child + 1 < n && key_cmp(keys[child], keys[child + 1]) < 0)
+            child++;
+        if (key_cmp(keys[root], keys[child]) >= 0)
+            return;
+        const char* tmp = keys[root];
+        keys[root] = keys[child];
+        keys[child] = tmp;
+        root = child;
+    }
+}
+
+/* heapsort: tables with thousands of keys (e.g. `sgx.trusted_files`) are common */
+static void sort_keys(const char** keys, size_t n) {
+    for (size_t i = n / 2; i > 0; i--)
+        sift_down(keys, i - 1, n);
+    for (size_t i = n; i > 1; i--) {
+        const char* tmp = keys[0];
+        keys[0] = keys[i - 1];
+        keys[i - 1] = tmp;
+        sift_down(keys, 0, i - 1);
+    }
+}
+
+static size_t table_size(const toml_table_t* table) {
+    return toml_table_nkval(table) + toml_table_narr(table) + toml_table_ntab(table);
+}
+
+/* Computes upper bounds of the number of nodes and of the string pool size. */
+static void count_array(const toml_array_t* array, size_t* nodes_cnt, size_t* strings_size);
+
+static void count_table(const toml_table_t* table, size_t* nodes_cnt, size_t* strings_size) {
+    size_t n = table_size(table);
+    for (size_t i = 0; i < n; i++) {
+        const char* key = toml_key_in(table, i);
+        *nodes_cnt += 1;
+        *strings_size += strlen(key) + 1;
+
+        toml_raw_t raw = toml_raw_in(table, key);
+        if (raw) {
+            *strings_size += strlen(raw) + 1;
+            continue;
+        }
+        const toml_array_t* array = toml_array_in(table, key);
+        if (array) {
+            count_array(array, nodes_cnt, strings_size);
+            continue;
+        }
+        const toml_table_t* subtable = toml_table_in(table, key);
+        if (subtable)
+            count_table(subtable, nodes_cnt, strings_size);
+    }
+}
+
+static void count_array(const toml_array_t* array, size_t* nodes_cnt, size_t* strings_size) {
+    size_t n = toml_array_nelem(array);
+    for (size_t i = 0; i < n; i++) {
+        *nodes_cnt += 1;
+        switch (toml_array_kind(array)) {
+            case 'v':
+                *strings_size += strlen(toml_raw_at(array, i)) + 1;
+                break;
+            case 'a':
+                count_array(toml_array_at(array, i), nodes_cnt, strings_size);
+                break;
+            case 't':
+                count_table(toml_table_at(array, i), nodes_cnt, strings_size);
+                break;
+        }
+    }
+}
+
+static int add_string(struct builder* b, const char* str, uint32_t* out_off, uint32_t* out_len) {
+    size_t len = strlen(str);
+    if (len == 0) {
+        /* all empty strings share the one at offset 0 */
+        *out_off = 0;
+        *out_len = 0;
+        return 0;
+    }
+    if (len + 1 > b->strings_cap - b->strings_size)
+        return -PAL_ERROR_OVERFLOW;
+    memcpy(b->strings + b->strings_size, str, len + 1);
+    *out_off = b->strings_size;
+    *out_len = len;
+    b->strings_size += len + 1;
+    return 0;
+}
+
+static int set_scalar(struct builder* b, struct manifest_node* node, toml_raw_t raw) {
+    int bool_val;
+    int64_t int_val;
+    char* str_val;
+
+    if (toml_rtob(raw, &bool_val) == 0) {
+        node->type = MANIFEST_NODE_BOOL;
+        node->value = !!bool_val;
+        return 0;
+    }
+    if (toml_rtoi(raw, &int_val) == 0) {
+        node->type = MANIFEST_NODE_INT;
+        node->value = (uint64_t)int_val;
+        return 0;
+    }
+
+    uint32_t off;
+    int ret;
+    if (toml_rtos(raw, &str_val) == 0) {
+        node->type = MANIFEST_NODE_STRING;
+        ret = add_string(b, str_val, &off, &node->count);
+        free(str_val);
+    } else {
+        node->type = MANIFEST_NODE_RAW;
+        ret = add_string(b, raw, &off, &node->count);
+    }
+    node->value = off;
+    return ret;
+}
+
+/* Appends a child of node `parent` (which is `b->nodes[parent]`) with key `key`. Exactly one of
+ * `raw`, `table` and `array` is not NULL. */
+static int add_child(struct builder* b, size_t parent, const char* key, toml_raw_t raw,
+                     const toml_table_t* table, const toml_array_t* array) {
+    if (b->nodes_cnt == b->nodes_cap)
+        return -PAL_ERROR_OVERFLOW;
+
+    size_t idx = b->nodes_cnt++;
+    struct manifest_node* node = &b->nodes[idx];
+    node->parent = parent;
+
+    int ret = add_string(b, key, &node->key_off, &node->key_len);
+    if (ret < 0)
+        return ret;
+
+    if (raw) {
+        ret = set_scalar(b, node, raw);
+        if (ret < 0)
+            return ret;
+    } else if (table) {
+        node->type = MANIFEST_NODE_TABLE;
+        node->count = table_size(table);
+        b->srcs[idx].table = table;
+    } else {
+        assert(array);
+        node->type = MANIFEST_NODE_ARRAY;
+        node->count = toml_array_nelem(array);
+        b->srcs[idx].array = array;
+    }
+
+    /* only keys of tables are indexed, nodes inside arrays are reachable only by walking */
+    if (b->nodes[parent].type == MANIFEST_NODE_TABLE && b->indexed[parent]) {
+        uint64_t hash = b->hashes[parent];
+        if (parent != 0)
+            hash = fnv_update(hash, ".", 1);
+        b->hashes[idx] = fnv_update(hash, key, node->key_len);
+        b->indexed[idx] = true;
+        b->indexed_cnt++;
+    }
+    return 0;
+}
+
+static int emit_table_children(struct builder* b, size_t idx) {
+    const toml_table_t* table = b->srcs[idx].table;
+    size_t n = b->nodes[idx].count;
+    b->nodes[idx].value = b->nodes_cnt;
+    if (!n)
+        return 0;
+
+    const char** keys = malloc(n * sizeof(*keys));
+    if (!keys)
+        return -PAL_ERROR_NOMEM;
+    for (size_t i = 0; i < n; i++)
+        keys[i] = toml_key_in(table, i);
+    sort_keys(keys, n);
+
+    int ret = 0;
+    for (size_t i = 0; i < n; i++) {
+        ret = add_child(b, idx, keys[i], toml_raw_in(table, keys[i]),
+                        toml_table_in(table, keys[i]), toml_array_in(table, keys[i]));
+        if (ret < 0)
+            break;
+    }
+    free(keys);
+    return ret;
+}
+
+static int emit_array_children(struct builder* b, size_t idx) {
+    const toml_array_t* array = b->srcs[idx].array;
+    size_t n = b->nodes[idx].count;
+
+    b->nodes[idx].value = b->nodes_cnt;
+    for (size_t i = 0; i < n; i++) {
+        int ret;
+        switch (toml_array_kind(array)) {
+            case 'v':
+                ret = add_child(b, idx, "", toml_raw_at(array, i), NULL, NULL);
+                break;
+            case 'a':
+                ret = add_child(b, idx, "", NULL, NULL, toml_array_at(array, i));
+                break;
+            case 't':
+                ret = add_child(b, idx, "", NULL, toml_table_at(array, i), NULL);
+                break;
+            default:
+                ret = -PAL_ERROR_INVAL;
+                break;
+        }
+        if (ret < 0)
+            return ret;
+    }
+    return 0;
+}
+
+static int build_image(struct builder* b, void** out_image, size_t* out_size) {
+    size_t index_cnt = 0;
+    if (b->indexed_cnt) {
+        index_cnt = 1;
+        while (index_cnt < 2 * b->indexed_cnt)
+            index_cnt *= 2;
+    }
+
+    size_t nodes_off = ALIGN_UP(sizeof(struct manifest_header), MANIFEST_ALIGN);
+    size_t index_off = nodes_off + b->nodes_cnt * sizeof(struct manifest_node);
+    size_t strings_off = index_off + index_cnt * sizeof(struct manifest_slot);
+    size_t size = strings_off + b->strings_size;
+    if (size > UINT32_MAX)
+        return -PAL_ERROR_TOOLONG;
+
+    void* image = calloc(1, size);
+    if (!image)
+        return -PAL_ERROR_NOMEM;
+
+    struct manifest_header* hdr = image;
+    memcpy(hdr->magic, MANIFEST_MAGIC, MANIFEST_MAGIC_LEN);
+    hdr->version = MANIFEST_VERSION;
+    hdr->size = size;
+    hdr->nodes_off = nodes_off;
+    hdr->nodes_cnt = b->nodes_cnt;
+    hdr->index_off = index_off;
+    hdr->index_cnt = index_cnt;
+    hdr->strings_off = strings_off;
+    hdr->strings_size = b->strings_size;
+
+    memcpy(image + nodes_off, b->nodes, b->nodes_cnt * sizeof(struct manifest_node));
+    memcpy(image + strings_off, b->strings, b->strings_size);
+
+    struct manifest_slot* index = image + index_off;
+    for (size_t i = 0; i < b->nodes_cnt; i++) {
+        if (!b->indexed[i] || i == 0)
+            continue;
+        size_t slot = b->hashes[i] & (index_cnt - 1);
+        while (index[slot].node)
+            slot = (slot + 1) & (index_cnt - 1);
+        index[slot].tag = b->hashes[i] >> 32;
+        index[slot].node = i + 1;
+    }
+
+    *out_image = image;
+    *out_size = size;
+    return 0;
+}
+
+int manifest_compile_toml(char* text, void** out_image, size_t* out_size, char* errbuf,
+                          size_t errbuf_size) {
+    int ret;
+    struct builder b = { 0 };
+
+    toml_table_t* root = toml_parse(text, errbuf, errbuf_size);
+    if (!root)
+        return -PAL_ERROR_DENIED;
+
+    size_t nodes_cnt = 1;
+    size_t strings_size = 1; /* empty key of the root and of array elements */
+    count_table(root, &nodes_cnt, &strings_size);
+    if (nodes_cnt > UINT32_MAX || strings_size > UINT32_MAX) {
+        snprintf(errbuf, errbuf_size, "manifest too large");
+        ret = -PAL_ERROR_TOOLONG;
+        goto out;
+    }
+
+    b.nodes_cap = nodes_cnt;
+    b.nodes = calloc(nodes_cnt, sizeof(*b.nodes));
+    b.srcs = calloc(nodes_cnt, sizeof(*b.srcs));
+    b.hashes = calloc(nodes_cnt, sizeof(*b.hashes));
+    b.indexed = calloc(nodes_cnt, sizeof(*b.indexed));
+    b.strings_cap = strings_size;
+    b.strings = malloc(strings_size);
+    if (!b.nodes || !b.srcs || !b.hashes || !b.indexed || !b.strings) {
+        snprintf(errbuf, errbuf_size, "out of memory");
+        ret = -PAL_ERROR_NOMEM;
+        goto out;
+    }
+
+    b.strings[0] = '\0';
+    b.strings_size = 1;
+    b.nodes[0].type = MANIFEST_NODE_TABLE;
+    b.nodes[0].count = table_size(root);
+    b.srcs[0].table = root;
+    b.hashes[0] = FNV_OFFSET_BASIS;
+    b.indexed[0] = true;
+    b.nodes_cnt = 1;
+
+    /* Breadth-first: children of each node are appended as one contiguous block, after all nodes
+     * emitted so far (so every child has a higher index than its parent). */
+    for (size_t i = 0; i < b.nodes_cnt; i++) {
+        if (b.nodes[i].type == MANIFEST_NODE_TABLE) {
+            ret = emit_table_children(&b, i);
+        } else if (b.nodes[i].type == MANIFEST_NODE_ARRAY) {
+            ret = emit_array_children(&b, i);
+        } else {
+            ret = 0;
+        }
+        if (ret < 0) {
+            snprintf(errbuf, errbuf_size, "cannot compile the manifest: %d", ret);
+            goto out;
+        }
+    }
+
+    ret = build_image(&b, out_image, out_size);
+    if (ret < 0)
+        snprintf(errbuf, errbuf_size, "cannot compile the manifest: %d", ret);
+
+out:
+    free(b.nodes);
+    free(b.srcs);
+    free(b.hashes);
+    free(b.indexed);
+    free(b.strings);
+    toml_free(root);
+    return ret;
+}
@@ -9,12 +9,14 @@ Graphene manifest renderer
 
 import os
 import pathlib
+import struct
 import subprocess
 import sys
 import sysconfig
 
 import click
 import jinja2
+import toml
 
 from . import (
     _CONFIG_PKGLIBDIR,
@@ -104,6 +106,121 @@ def render(template, variables=None):
     '''Render template, given as string. Optional variables may be given as mapping.'''
     return _env.from_string(template).render(**(variables or {}))
 
+# Compiled manifest format, see common/include/manifest.h; keep both in sync.
+MANIFEST_MAGIC = b'GRAMANF\0'
+MANIFEST_VERSION = 1
+MANIFEST_ALIGN = 8
+
+NODE_BOOL, NODE_INT, NODE_STRING, NODE_RAW, NODE_TABLE, NODE_ARRAY = range(1, 7)
+
+_HEADER = struct.Struct('<8s8I')
+_NODE = struct.Struct('<6IQ')
+_SLOT = struct.Struct('<2I')
+
+_FNV_OFFSET_BASIS = 0xcbf29ce484222325
+_FNV_PRIME = 0x100000001b3
+
+def _fnv_update(hash_, data):
+    for byte in data:
+        hash_ = ((hash_ ^ byte) * _FNV_PRIME) & 0xffffffffffffffff
+    return hash_
+
+def _align(value):
+    return (value + MANIFEST_ALIGN - 1) & ~(MANIFEST_ALIGN - 1)
+
+def compile_manifest(manifest):
+    '''Compile manifest (parsed TOML, as a dict) into the binary format used by the PAL.
+
+    Produces exactly the same image as ``manifest_compile_toml()`` in C.
+    '''
+    strings = bytearray(b'\0') # offset 0 is the empty string (e.g. keys of array elements)
+
+    def add_string(data):
+        if not data:
+            return 0
+        offset = len(strings)
+        strings.extend(data + b'\0')
+        return offset
+
+    # [type, parent, key_off, key_len, count, value], the value of each node and the hash of its
+    # full key (None if the node is not indexed, i.e. it is the root or inside an array)
+    nodes = [[NODE_TABLE, 0, 0, 0, len(manifest), 0]]
+    values = [manifest]
+    hashes = [None]
+
+    # breadth-first, so that children of each node are stored contiguously
+    i = 0
+    while i < len(nodes):
+        value = values[i]
+        if isinstance(value, dict):
+            items = sorted(((k.encode(), v) for k, v in value.items()), key=lambda kv: kv[0])
+        elif isinstance(value, list):
+            items = [(b'', v) for v in value]
+        else:
+            i += 1
+            continue
+
+        nodes[i][5] = len(nodes)
+        for key, child in items:
+            node = [0, i, add_string(key), len(key), 0, 0]
+            if isinstance(child, bool):
+                node[0], node[5] = NODE_BOOL, int(child)
+            elif isinstance(child, int):
+                node[0], node[5] = NODE_INT, child & 0xffffffffffffffff
+            elif isinstance(child, str):
+                data = child.encode()
+                node[0], node[4], node[5] = NODE_STRING, len(data), add_string(data)
+            elif isinstance(child, dict):
+                node[0], node[4] = NODE_TABLE, len(child)
+            elif isinstance(child, list):
+                node[0], node[4] = NODE_ARRAY, len(child)
+            else:
+                # float or datetime, kept as TOML text
+                data = (child.isoformat() if hasattr(child, 'isoformat') else repr(child)).encode()
+                node[0], node[4], node[5] = NODE_RAW, len(data), add_string(data)
+
+            hash_ = None
+            if isinstance(value, dict) and (i == 0 or hashes[i] is not None):
+                hash_ = _FNV_OFFSET_BASIS if i == 0 else _fnv_update(hashes[i], b'.')
+                hash_ = _fnv_update(hash_, key)
+
+            nodes.append(node)
+            values.append(child)
+            hashes.append(hash_)
+        i += 1
+
+    indexed = sum(1 for hash_ in hashes if hash_ is not None)
+    index_cnt = 0
+    if indexed:
+        index_cnt = 1
+        while index_cnt < 2 * indexed:
+            index_cnt *= 2
+    index = [(0, 0)] * index_cnt
+    for node_idx, hash_ in enumerate(hashes):
+        if hash_ is None:
+            continue
+        slot = hash_ & (index_cnt - 1)
+        while index[slot][1]:
+            slot = (slot + 1) & (index_cnt - 1)
+        index[slot] = (hash_ >> 32, node_idx + 1)
+
+    # node and slot sizes are multiples of the alignment, so only the header needs padding
+    nodes_off = _align(_HEADER.size)
+    index_off = nodes_off + len(nodes) * _NODE.size
+    strings_off = index_off + index_cnt * _SLOT.size
+    size = strings_off + len(strings)
+
+    image = bytearray(size)
+    _HEADER.pack_into(image, 0, MANIFEST_MAGIC, MANIFEST_VERSION, size, nodes_off, len(nodes),
+        index_off, index_cnt, strings_off, len(strings))
+    for j, node in enumerate(nodes):
+        _NODE.pack_into(image, nodes_off + j * _NODE.size, node[0], node[1], node[2], node[3],
+            node[4], 0, node[5])
+    for j, slot in enumerate(index):
+        _SLOT.pack_into(image, index_off + j * _SLOT.size, *slot)
+    image[strings_off:strings_off + len(strings)] = strings
+    return bytes(image)
+
 def validate_define(_ctx, _param, values):
     ret = {}
     for value in values:
@@ -117,13 +234,19 @@ def validate_define(_ctx, _param, values):
 @click.command()
 @click.option('--string', '-c')
 @click.option('--define', '-D', multiple=True, callback=validate_define)
+@click.option('--binary', is_flag=True,
+    help='output the compiled (binary) manifest instead of TOML')
 @click.argument('infile', type=click.File('r'), required=False)
-@click.argument('outfile', type=click.File('w'), default='-')
-def main(string, define, infile, outfile):
+@click.argument('outfile', type=click.File('wb'), default='-')
+def main(string, define, binary, infile, outfile):
     if not bool(string) ^ bool(infile):
         click.get_current_context().fail('specify exactly one of (infile, -c)')
     template = infile.read() if infile else string
-    outfile.write(render(template, define))
+    rendered = render(template, define)
+    if binary:
+        outfile.write(compile_manifest(toml.loads(rendered)))
+    else:
+        outfile.write(rendered.encode())
 
 if __name__ == '__main__':
     main() # pylint: disable=no-value-for-parameter
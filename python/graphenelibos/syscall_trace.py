@@ -0,0 +1,160 @@
+# SPDX-License-Identifier: LGPL-3.0-or-later
+
+'''
+Analyzer of binary syscall traces written by Graphene with `libos.syscall_trace.file`
+'''
+
+import collections
+import struct
+import sys
+
+import click
+
+MAGIC = b'GSCTRACE'
+VERSION = 1
+
+# see `struct syscall_trace_header` and `struct syscall_trace_record` in shim_syscall_trace.h
+HEADER = struct.Struct('<8sIIIIQ')
+RECORD = struct.Struct('<HHIQQqQII')
+NAME_LEN = struct.Struct('<H')
+
+RECORD_SYSCALL = 0
+RECORD_DROPPED = 1
+
+Record = collections.namedtuple('Record', [
+    'pid', 'tid', 'name', 'start_us', 'duration_us', 'ret', 'args_hash', 'pal_calls', 'host_calls',
+])
+
+class TraceError(Exception):
+    pass
+
+class Trace:
+    '''
+    A parsed trace file of a single Graphene process.
+
+    Timestamps and durations of the records are converted to microseconds.
+    '''
+    def __init__(self, file):
+        header = file.read(HEADER.size)
+        if len(header) < HEADER.size:
+            raise TraceError('truncated header')
+        magic, version, record_size, self.pid, names_cnt, self.tsc_hz = HEADER.unpack(header)
+        if magic != MAGIC:
+            raise TraceError('not a Graphene syscall trace')
+        if version != VERSION or record_size != RECORD.size:
+            raise TraceError(f'unsupported trace version {version} (record size {record_size})')
+
+        self.syscall_names = []
+        for _ in range(names_cnt):
+            length, = NAME_LEN.unpack(file.read(NAME_LEN.size))
+            self.syscall_names.append(file.read(length).decode('ascii'))
+
+        self.records = []
+        self.dropped = collections.Counter()
+        while True:
+            data = file.read(RECORD.size)
+            if len(data) < RECORD.size:
+                # the process could have been killed in the middle of writing a record
+                break
+            rtype, sysnr, tid, start, duration, ret, args_hash, pal_calls, host_calls = \
+                RECORD.unpack(data)
+            if rtype == RECORD_DROPPED:
+                self.dropped[tid] += ret
+                continue
+            self.records.append(Record(self.pid, tid, self.syscall_name(sysnr),
+                self.to_us(start), self.to_us(duration), ret, args_hash, pal_calls, host_calls))
+
+    def syscall_name(self, sysnr):
+        if sysnr < len(self.syscall_names) and self.syscall_names[sysnr]:
+            return self.syscall_names[sysnr]
+        return f'syscall_{sysnr}'
+
+    def to_us(self, value):
+        if not self.tsc_hz:
+            return value
+        return value * 1000000 / self.tsc_hz
+
+def load_traces(files):
+    traces = []
+    for file in files:
+        try:
+            traces.append(Trace(file))
+        except TraceError as e:
+            raise click.ClickException(f'{file.name}: {e}')
+    return traces
+
+def hist_bucket(duration_us):
+    '''Returns `i` such that the duration is in [2^(i-1), 2^i) microseconds (0 for < 1 us).'''
+    return int(duration_us).bit_length()
+
+def format_us(value):
+    if value < 1000:
+        return f'{value:.0f}us'
+    if value < 1000000:
+        return f'{value / 1000:.0f}ms'
+    return f'{value / 1000000:.0f}s'
+
+def print_summary(records, outfile):
+    by_name = collections.defaultdict(list)
+    for record in records:
+        by_name[record.name].append(record)
+
+    outfile.write(f'{"syscall":<24} {"count":>10} {"errors":>8} {"total":>12} {"avg":>10} '
+                  f'{"max":>10} {"pal/call":>9} {"host/call":>9}\n')
+    for name, recs in sorted(by_name.items(), key=lambda item: -sum(r.duration_us
+                                                                     for r in item[1])):
+        total = sum(r.duration_us for r in recs)
+        errors = sum(1 for r in recs if -4095 <= r.ret < 0)
+        outfile.write(f'{name:<24} {len(recs):>10} {errors:>8} {total:>10.0f}us '
+                      f'{total / len(recs):>8.1f}us {max(r.duration_us for r in recs):>8.0f}us '
+                      f'{sum(r.pal_calls for r in recs) / len(recs):>9.1f} '
+                      f'{sum(r.host_calls for r in recs) / len(recs):>9.1f}\n')
+
+    for name, recs in sorted(by_name.items()):
+        hist = collections.Counter(hist_bucket(r.duration_us) for r in recs)
+        peak = max(hist.values())
+        outfile.write(f'\n{name} (latency histogram):\n')
+        for bucket in range(min(hist), max(hist) + 1):
+            low = format_us(2 ** (bucket - 1)) if bucket else '0'
+            high = format_us(2 ** bucket)
+            bar = '@' * (hist[bucket] * 40 // peak)
+            outfile.write(f'  [{low:>6}, {high:>6}) {hist[bucket]:>10} |{bar:<40}|\n')
+
+def print_folded(records, outfile, per_thread):
+    '''Prints the total time (in microseconds) spent in each syscall in the "folded stacks" format
+    of FlameGraph (https://github.com/brendangregg/FlameGraph).'''
+    folded = collections.Counter()
+    for record in records:
+        if per_thread:
+            stack = f'pid-{record.pid};tid-{record.tid};{record.name}'
+        else:
+            stack = f'pid-{record.pid};{record.name}'
+        folded[stack] += record.duration_us
+    for stack, value in sorted(folded.items()):
+        outfile.write(f'{stack} {round(value)}\n')
+
+@click.command()
+@click.option('--folded', is_flag=True,
+    help='Print flame-graph-compatible folded stacks instead of the summary.')
+@click.option('--per-thread', is_flag=True,
+    help='With --folded, split the stacks by thread.')
+@click.argument('files', nargs=-1, required=True, type=click.File('rb'))
+def main(folded, per_thread, files):
+    '''Analyze syscall trace FILES (one per Graphene process).'''
+    traces = load_traces(files)
+    records = [record for trace in traces for record in trace.records]
+
+    for trace in traces:
+        for tid, cnt in sorted(trace.dropped.items()):
+            click.echo(f'warning: {cnt} records of pid {trace.pid} tid {tid} were dropped',
+                       err=True)
+        if not trace.tsc_hz:
+            click.echo(f'note: times of pid {trace.pid} were measured without the TSC', err=True)
+
+    if folded:
+        print_folded(records, sys.stdout, per_thread)
+    else:
+        print_summary(records, sys.stdout)
+
+if __name__ == '__main__':
+    main() # pylint: disable=no-value-for-parameter
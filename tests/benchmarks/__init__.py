@@ -104,10 +104,11 @@ class Exec:
         return os.fspath(self.graphene_path / 'Runtime/pal_loader')
 
 
-    def run_in_graphene(self, *args, sgx=True):
+    def run_in_graphene(self, *args, sgx=True, manifest=None, **kwds):
         self._set_sgx(sgx)
-        return subprocess.run([self.pal_loader, os.fspath(self.manifest_sgx_path), *args],
-            check=True, cwd=self.benchmarks_path)
+        manifest = manifest or self.manifest_sgx_path
+        return subprocess.run([self.pal_loader, os.fspath(manifest), *args],
+            check=True, cwd=self.benchmarks_path, **kwds)
 
     @contextlib.contextmanager
     def graphene_server(self, *args, sgx=True, sleep=30):
@@ -3,6 +3,9 @@
 #                    Wojtek Porczyk <woju@invisiblethingslab.com>
 #
 
+import os
+import subprocess
+
 from . import Exec
 
 # pylint: disable=invalid-name
@@ -32,3 +35,60 @@ class WritePages:
 
     def time_graphene_sgx(self, pagecount):
         self.write_pages.run_in_graphene(str(pagecount), sgx=True)
+
+class ForkLatency:
+    # pylint: disable=no-self-use
+
+    fork_latency = Exec('fork_latency', manifest_template='basic.manifest.template')
+    params = [0, 16, 64]
+    param_names = ['megabytes']
+    setup = fork_latency.setup
+
+    def time_graphene_nosgx(self, megabytes):
+        self.fork_latency.run_in_graphene(str(megabytes), sgx=False)
+
+    def time_graphene_sgx(self, megabytes):
+        self.fork_latency.run_in_graphene(str(megabytes), sgx=True)
+
+class ProcessPool:
+    # pylint: disable=no-self-use
+
+    # pause between the forks, so that the pool of pre-created children has time to refill
+    pause_ms = '100'
+    params = [0, 4]
+    param_names = ['pool_size']
+
+    def setup(self, pool_size):
+        self.fork_latency = Exec('fork_latency', manifest_template='padded.manifest.template',
+            PADDING='loader.process_pool_size = {}'.format(pool_size))
+        self.fork_latency.setup()
+
+    def track_spawn_latency_nosgx(self, _pool_size):
+        result = self.fork_latency.run_in_graphene('0', self.pause_ms, sgx=False,
+            stdout=subprocess.PIPE)
+        return int(result.stdout.decode().split()[-1])
+
+    track_spawn_latency_nosgx.unit = 'us'
+
+class ManifestStartup:
+    # pylint: disable=no-self-use
+
+    # keys which are not used by Graphene, so that only the cost of loading the manifest grows
+    padding = '\n'.join('bench.padding.key{0} = "value{0}"'.format(i) for i in range(20000))
+    helloworld = Exec('helloworld', manifest_template='padded.manifest.template', PADDING=padding)
+
+    @property
+    def manifest_binary_path(self):
+        return self.helloworld.manifest_path.with_suffix('.manifest.bin')
+
+    def setup(self):
+        self.helloworld.setup()
+        subprocess.run(['graphene-manifest', '--binary',
+            os.fspath(self.helloworld.manifest_sgx_path), os.fspath(self.manifest_binary_path)],
+            check=True)
+
+    def time_toml_nosgx(self):
+        self.helloworld.run_in_graphene(sgx=False)
+
+    def time_binary_nosgx(self):
+        self.helloworld.run_in_graphene(sgx=False, manifest=self.manifest_binary_path)
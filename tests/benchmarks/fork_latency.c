@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: LGPL-3.0-or-later */
+
+/*
+ * fork a process with a given amount of memory a number of times and print the average time
+ * (in microseconds) of fork() and waiting for the child, optionally pausing between the forks
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FORK_COUNT 10
+
+void usage(char* argv0) {
+    fprintf(stderr, "usage: %s MEGABYTES [PAUSE_MS]\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+    char* buf = NULL;
+    size_t size, pagesize;
+    unsigned long pause_ms = 0, total_us = 0;
+    struct timeval start, end;
+    int i, status;
+    pid_t pid;
+
+    if (argc != 2 && argc != 3) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    errno = 0;
+    size = strtoul(argv[1], NULL, 0) * 1024 * 1024;
+    if (argc == 3)
+        pause_ms = strtoul(argv[2], NULL, 0);
+    if (errno != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    pagesize = sysconf(_SC_PAGESIZE);
+
+    if (size) {
+        buf = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+
+        /* dirty every other page, so that both copied and all-zero pages are forked */
+        for (size_t off = 0; off < size; off += 2 * pagesize)
+            memset(buf + off, 0xa5, pagesize);
+    }
+
+    for (i = 0; i < FORK_COUNT; i++) {
+        if (pause_ms)
+            usleep(pause_ms * 1000);
+
+        gettimeofday(&start, NULL);
+        pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0)
+            _exit(0);
+
+        if (waitpid(pid, &status, 0) < 0) {
+            perror("waitpid");
+            return 1;
+        }
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "child failed\n");
+            return 1;
+        }
+        gettimeofday(&end, NULL);
+        total_us += (end.tv_sec - start.tv_sec) * 1000000UL + end.tv_usec - start.tv_usec;
+    }
+
+    printf("%lu\n", total_us / FORK_COUNT);
+
+    if (buf)
+        munmap(buf, size);
+    return 0;
+}